@@ -0,0 +1,125 @@
+/*-
+ * Copyright (c) 2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __ABSTRACTION_LAYER_CPU_FEATURES_H__
+#define __ABSTRACTION_LAYER_CPU_FEATURES_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+/*
+ * Run time CPU features detection for SIMD dispatch.
+ * AVX/AVX2/AVX-512 reported only if OS saves ymm/zmm state (XCR0).
+ */
+#if (defined(__x86_64__) || defined(__i386__)) &&			\
+    (defined(__GNUC__) || defined(__clang__))
+#	define CPU_FEATURES_X86	1
+#	include <cpuid.h>
+#endif
+
+
+#define CPU_F_INIT	(((uint32_t)1) << 0) /* Detection done. */
+#define CPU_F_SSE2	(((uint32_t)1) << 1)
+#define CPU_F_SSSE3	(((uint32_t)1) << 2)
+#define CPU_F_SSE41	(((uint32_t)1) << 3)
+#define CPU_F_SSE42	(((uint32_t)1) << 4)
+#define CPU_F_PCLMUL	(((uint32_t)1) << 5)
+#define CPU_F_AVX	(((uint32_t)1) << 6)
+#define CPU_F_AVX2	(((uint32_t)1) << 7)
+#define CPU_F_AVX512F	(((uint32_t)1) << 8)
+#define CPU_F_SHA	(((uint32_t)1) << 9)
+
+/* All __flags set in __features. */
+#define CPU_F_IS_SET(__features, __flags)				\
+	((__flags) == ((__features) & (__flags)))
+
+
+static uint32_t cpu_features_cache = 0;
+
+/* Return CPU_F_* supported by CPU and OS, cpuid called once. */
+static inline uint32_t
+cpu_features_get(void) {
+	uint32_t ret = __atomic_load_n(&cpu_features_cache, __ATOMIC_RELAXED);
+#ifdef CPU_FEATURES_X86
+	uint32_t eax, ebx, ecx, edx, xcr0 = 0, xcr0_hi;
+#endif
+
+	if (0 != ret)
+		return (ret);
+	ret = CPU_F_INIT;
+#ifdef CPU_FEATURES_X86
+	if (0 == __get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		goto done;
+	if (0 != (edx & bit_SSE2)) {
+		ret |= CPU_F_SSE2;
+	}
+	if (0 != (ecx & bit_SSSE3)) {
+		ret |= CPU_F_SSSE3;
+	}
+	if (0 != (ecx & bit_SSE4_1)) {
+		ret |= CPU_F_SSE41;
+	}
+	if (0 != (ecx & bit_SSE4_2)) {
+		ret |= CPU_F_SSE42;
+	}
+	if (0 != (ecx & bit_PCLMUL)) {
+		ret |= CPU_F_PCLMUL;
+	}
+	if (0 != (ecx & bit_OSXSAVE)) {
+		__asm__ __volatile__("xgetbv"
+		    : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0));
+	}
+	/* XCR0: xmm (bit 1) and ymm (bit 2) state saved by OS. */
+	if (0x06 == (xcr0 & 0x06) && 0 != (ecx & bit_AVX)) {
+		ret |= CPU_F_AVX;
+	}
+	if (7 > __get_cpuid_max(0, NULL))
+		goto done;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if (0 != (ebx & bit_SHA)) {
+		ret |= CPU_F_SHA;
+	}
+	if (0 != (CPU_F_AVX & ret) && 0 != (ebx & bit_AVX2)) {
+		ret |= CPU_F_AVX2;
+	}
+	/* XCR0: + opmask (bit 5) and zmm (bits 6, 7) state. */
+	if (0 != (CPU_F_AVX & ret) && 0xe0 == (xcr0 & 0xe0) &&
+	    0 != (ebx & bit_AVX512F)) {
+		ret |= CPU_F_AVX512F;
+	}
+done:
+#endif
+	__atomic_store_n(&cpu_features_cache, ret, __ATOMIC_RELAXED);
+
+	return (ret);
+}
+
+
+#endif /* __ABSTRACTION_LAYER_CPU_FEATURES_H__ */
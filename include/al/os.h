@@ -334,6 +334,58 @@ strlcpy(char * restrict dst, const char * restrict src, size_t size) {
 #endif
 
 
+#ifndef HAVE_ARC4RANDOM_BUF
+static inline void
+arc4random_buf(void *buf, size_t nbytes) {
+	ssize_t rd;
+	uint8_t *ptr = buf;
+#ifndef SYS_getrandom
+	int fd;
+
+	fd = open("/dev/urandom", (O_RDONLY | O_CLOEXEC));
+	if (-1 == fd)
+		abort(); /* No way to report error. */
+#endif
+
+	while (0 != nbytes) {
+#ifdef SYS_getrandom
+		rd = syscall(SYS_getrandom, ptr, nbytes, 0);
+#else
+		rd = read(fd, ptr, nbytes);
+#endif
+		if (0 >= rd) {
+			if (-1 == rd && EINTR == errno)
+				continue;
+			abort();
+		}
+		ptr += rd;
+		nbytes -= (size_t)rd;
+	}
+#ifndef SYS_getrandom
+	close(fd);
+#endif
+}
+#endif
+
+#ifndef HAVE_ARC4RANDOM_UNIFORM
+static inline uint32_t
+arc4random_uniform(const uint32_t upper_bound) {
+	uint32_t r, min;
+
+	if (2 > upper_bound)
+		return (0);
+	/* 2**32 % x == (2**32 - x) % x */
+	min = ((-upper_bound) % upper_bound);
+	/* Reject values in [0, min) to avoid modulo bias. */
+	do {
+		arc4random_buf(&r, sizeof(r));
+	} while (r < min);
+
+	return ((r % upper_bound));
+}
+#endif
+
+
 /* pthread_create(2) can spuriously fail on Linux. This is a function
  * to wrap pthread_create(2) to retry if it fails with EAGAIN. */
 static inline int
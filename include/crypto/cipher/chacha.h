@@ -41,6 +41,17 @@
 #include <sys/types.h>
 #include <string.h> /* memcpy, memmove, memset... */
 #include <inttypes.h>
+#include <errno.h>
+/*
+ * x86-64: SSSE3 / AVX2 / AVX-512 kernels that generate 4 / 8 / 16 blocks
+ * at once, selected at run time by cpuid, no -m flags required.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define CHACHA_X86_SIMD	1
+#	include "al/cpu_features.h"
+#	include <immintrin.h>
+#	define CHACHA_TARGET(__t)	__attribute__((__target__(__t)))
+#endif
 
 #if __x86_64__ || __ppc64__ || __LP64__
 #	define CHACHA_X64
@@ -65,6 +76,14 @@ static void *(*volatile chacha_memset_volatile)(void*, int, size_t) = memset;
 #define XCHACHA_IV_LEN		24	/* 192 bit */
 
 
+/* Implementations. */
+#define CHACHA_IMPL_GENERIC	0
+#define CHACHA_IMPL_SSSE3	1 /* 4 blocks per pass. */
+#define CHACHA_IMPL_AVX2	2 /* 8 blocks per pass. */
+#define CHACHA_IMPL_AVX512	3 /* 16 blocks per pass. */
+#define CHACHA_IMPL_AUTO	0xff
+
+
 /* Simple ChaCha context. */
 typedef struct chacha_context_s {
 	/* const(16) + key(32) + counter(8) + iv(8) */
@@ -72,6 +91,7 @@ typedef struct chacha_context_s {
 	/* Temp buf for chacha transform block. */
 	CHACHA_ALIGN(8) uint32_t x[(CHACHA_BLOCK_LEN / sizeof(uint32_t))];
 	size_t rounds;
+	uint32_t impl; /* CHACHA_IMPL_*, set by chacha_impl_set(). */
 } chacha_context_t, *chacha_context_p;
 
 /* ChaCha context for streams handle. */
@@ -85,8 +105,16 @@ typedef struct chacha_context_str_s {
 
 #define CHACHA_PTR_IS_ALIGNED4(p)	(0 == (((size_t)p) & 3))
 #define CHACHA_PTR_IS_ALIGNED8(p)	(0 == (((size_t)p) & 7))
-#define CHACHA_PTR_8TO32(ptr)		((uint32_t*)(void*)(size_t)(ptr))
-#define CHACHA_PTR_8TO64(ptr)		((uint64_t*)(void*)(size_t)(ptr))
+/* Blocks accessed by 32/64 bit words: state and buffers may alias. */
+#if defined(__GNUC__) || defined(__clang__)
+typedef uint32_t chacha_u32_a __attribute__((__may_alias__));
+typedef uint64_t chacha_u64_a __attribute__((__may_alias__));
+#else
+typedef uint32_t chacha_u32_a;
+typedef uint64_t chacha_u64_a;
+#endif
+#define CHACHA_PTR_8TO32(ptr)		((chacha_u32_a*)(void*)(size_t)(ptr))
+#define CHACHA_PTR_8TO64(ptr)		((chacha_u64_a*)(void*)(size_t)(ptr))
 
 /* interpret four 8 bit unsigned integers as a 32 bit unsigned integer in little endian */
 static inline uint32_t
@@ -129,16 +157,17 @@ static const uint32_t chacha_constants_k128[4] = {
 	c += d; b = ROTL32((b ^ c),  7);				\
 }
 
-#define CHACHA_DOUBLEROUND(n) {						\
-	CHACHA_QUARTERROUND(n[0], n[4], n[ 8], n[12])			\
-	CHACHA_QUARTERROUND(n[1], n[5], n[ 9], n[13])			\
-	CHACHA_QUARTERROUND(n[2], n[6], n[10], n[14])			\
-	CHACHA_QUARTERROUND(n[3], n[7], n[11], n[15])			\
-	CHACHA_QUARTERROUND(n[0], n[5], n[10], n[15])			\
-	CHACHA_QUARTERROUND(n[1], n[6], n[11], n[12])			\
-	CHACHA_QUARTERROUND(n[2], n[7], n[ 8], n[13])			\
-	CHACHA_QUARTERROUND(n[3], n[4], n[ 9], n[14])			\
+#define CHACHA_DOUBLEROUND_QR(__qr, n) {				\
+	__qr(n[0], n[4], n[ 8], n[12])					\
+	__qr(n[1], n[5], n[ 9], n[13])					\
+	__qr(n[2], n[6], n[10], n[14])					\
+	__qr(n[3], n[7], n[11], n[15])					\
+	__qr(n[0], n[5], n[10], n[15])					\
+	__qr(n[1], n[6], n[11], n[12])					\
+	__qr(n[2], n[7], n[ 8], n[13])					\
+	__qr(n[3], n[4], n[ 9], n[14])					\
 }
+#define CHACHA_DOUBLEROUND(n)	CHACHA_DOUBLEROUND_QR(CHACHA_QUARTERROUND, n)
 
 #define CHACHA_BLOCK_ADD32(dst, src) {					\
 	((uint32_t*)(dst))[ 0] += ((uint32_t*)(src))[ 0];		\
@@ -352,6 +381,86 @@ chacha_iv_set(chacha_context_p ctx, const uint8_t *iv) {
 	}
 }
 
+#define CHACHA_CPU_F_INIT	(((uint32_t)1) << 0)
+#define CHACHA_CPU_F_SSSE3	(((uint32_t)1) << 1)
+#define CHACHA_CPU_F_AVX2	(((uint32_t)1) << 2)
+#define CHACHA_CPU_F_AVX512	(((uint32_t)1) << 3) /* AVX-512F + AVX2. */
+
+/* Return CHACHA_CPU_F_* supported by CPU and build. */
+static inline uint32_t
+chacha_cpu_features_get(void) {
+	uint32_t ret = CHACHA_CPU_F_INIT;
+#ifdef CHACHA_X86_SIMD
+	const uint32_t cpu_features = cpu_features_get();
+
+	if (0 != (CPU_F_SSSE3 & cpu_features)) {
+		ret |= CHACHA_CPU_F_SSSE3;
+	}
+	if (0 != (CPU_F_AVX2 & cpu_features)) {
+		ret |= CHACHA_CPU_F_AVX2;
+		if (0 != (CPU_F_AVX512F & cpu_features)) {
+			ret |= CHACHA_CPU_F_AVX512;
+		}
+	}
+#endif
+
+	return (ret);
+}
+
+/* 0 - not supported by CPU / build. */
+static inline int
+chacha_impl_is_supported(const uint32_t impl) {
+
+	switch (impl) {
+	case CHACHA_IMPL_GENERIC:
+	case CHACHA_IMPL_AUTO:
+		return (1);
+	case CHACHA_IMPL_SSSE3:
+		return (0 != (CHACHA_CPU_F_SSSE3 & chacha_cpu_features_get()));
+	case CHACHA_IMPL_AVX2:
+		return (0 != (CHACHA_CPU_F_AVX2 & chacha_cpu_features_get()));
+	case CHACHA_IMPL_AVX512:
+		return (0 != (CHACHA_CPU_F_AVX512 & chacha_cpu_features_get()));
+	}
+	return (0);
+}
+
+/* Select blocks transform: CHACHA_IMPL_*.
+ * Return ENOTSUP if not supported by CPU, ctx is usable with
+ * generic transform anyway. */
+static inline int
+chacha_impl_set(chacha_context_p ctx, const uint32_t impl) {
+	uint32_t cpu_features;
+
+	ctx->impl = CHACHA_IMPL_GENERIC;
+	cpu_features = chacha_cpu_features_get();
+	switch (impl) {
+	case CHACHA_IMPL_GENERIC:
+		break;
+	case CHACHA_IMPL_AUTO:
+		if (0 != (CHACHA_CPU_F_AVX512 & cpu_features)) {
+			ctx->impl = CHACHA_IMPL_AVX512;
+		} else if (0 != (CHACHA_CPU_F_AVX2 & cpu_features)) {
+			ctx->impl = CHACHA_IMPL_AVX2;
+		} else if (0 != (CHACHA_CPU_F_SSSE3 & cpu_features)) {
+			ctx->impl = CHACHA_IMPL_SSSE3;
+		}
+		break;
+	case CHACHA_IMPL_SSSE3:
+	case CHACHA_IMPL_AVX2:
+	case CHACHA_IMPL_AVX512:
+		if (0 == chacha_impl_is_supported(impl))
+			return (ENOTSUP);
+		ctx->impl = impl;
+		break;
+	default:
+		return (EINVAL);
+	}
+
+	return (0);
+}
+
+
 /* key - 16/32 bytes
  * iv - 16 bytes, optional
  * rounds - 8/12/20
@@ -417,6 +526,7 @@ xchacha_set_key_iv_rounds(chacha_context_p ctx, const uint8_t *key, const size_t
 		chacha_iv_set(ctx, NULL);
 	}
 	ctx->rounds = rounds;
+	chacha_impl_set(ctx, CHACHA_IMPL_AUTO);
 }
 
 /* Block tranform. */
@@ -501,6 +611,251 @@ chacha_block_unaligneg(chacha_context_p ctx, const uint8_t *src, uint8_t *dst) {
 	}
 }
 
+#ifdef CHACHA_X86_SIMD
+/*
+ * Wide transforms: vector i holds state word i of N consecutive blocks,
+ * lane l uses counter + l. After rounds every 4 vectors are transposed
+ * back to blocks order: 16 bytes of each block per 128 bit lane.
+ * src - NULL or N * CHACHA_BLOCK_LEN bytes, dst - N * CHACHA_BLOCK_LEN bytes.
+ */
+
+/* Per lane 64 bit counters, split in to two 32 bit halves. */
+static inline void
+chacha_lanes_counter_get(chacha_context_p ctx, const uint32_t lanes,
+    uint32_t *lo, uint32_t *hi) {
+	uint32_t i;
+
+	for (i = 0; i < lanes; i ++) {
+		lo[i] = (ctx->state[12] + i);
+		hi[i] = (ctx->state[13] + ((lo[i] < i) ? 1 : 0));
+	}
+}
+
+static inline void
+chacha_counter_add(chacha_context_p ctx, const uint32_t count) {
+
+	ctx->state[12] += count;
+	if (ctx->state[12] < count) {
+		ctx->state[13] ++;
+	}
+}
+
+/* 4x4 32 bit words transpose inside each 128 bit lane. */
+#define CHACHA_SIMD_TRANSPOSE4(__pfx, __type, a, b, c, d) {		\
+	__type __t0, __t1, __t2, __t3;					\
+	__t0 = __pfx##_unpacklo_epi32(a, b);				\
+	__t1 = __pfx##_unpacklo_epi32(c, d);				\
+	__t2 = __pfx##_unpackhi_epi32(a, b);				\
+	__t3 = __pfx##_unpackhi_epi32(c, d);				\
+	a = __pfx##_unpacklo_epi64(__t0, __t1);				\
+	b = __pfx##_unpackhi_epi64(__t0, __t1);				\
+	c = __pfx##_unpacklo_epi64(__t2, __t3);				\
+	d = __pfx##_unpackhi_epi64(__t2, __t3);				\
+}
+
+
+#define CHACHA_SSE_ROTL(__v, __n)					\
+	_mm_or_si128(_mm_slli_epi32((__v), (__n)),			\
+	    _mm_srli_epi32((__v), (32 - (__n))))
+/* rot16 and rot8: pshufb masks. */
+#define CHACHA_SSE_QUARTERROUND(a, b, c, d) {				\
+	a = _mm_add_epi32(a, b);					\
+	d = _mm_shuffle_epi8(_mm_xor_si128(d, a), rot16);		\
+	c = _mm_add_epi32(c, d);					\
+	b = CHACHA_SSE_ROTL(_mm_xor_si128(b, c), 12);			\
+	a = _mm_add_epi32(a, b);					\
+	d = _mm_shuffle_epi8(_mm_xor_si128(d, a), rot8);		\
+	c = _mm_add_epi32(c, d);					\
+	b = CHACHA_SSE_ROTL(_mm_xor_si128(b, c), 7);			\
+}
+
+#define CHACHA_SSE_STORE(__dst, __src, __off, __v) {			\
+	if (NULL != (__src)) {						\
+		(__v) = _mm_xor_si128((__v), _mm_loadu_si128(		\
+		    (const __m128i*)(const void*)((__src) + (__off))));	\
+	}								\
+	_mm_storeu_si128((__m128i*)(void*)((__dst) + (__off)), (__v));	\
+}
+
+CHACHA_TARGET("ssse3")
+static inline void
+chacha_blocks4_ssse3(chacha_context_p ctx, const uint8_t *src, uint8_t *dst) {
+	size_t i, b;
+	uint32_t lo[4], hi[4];
+	__m128i s[16], x[16];
+	const __m128i rot16 = _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10,
+	    5, 4, 7, 6, 1, 0, 3, 2);
+	const __m128i rot8 = _mm_set_epi8(14, 13, 12, 15, 10, 9, 8, 11,
+	    6, 5, 4, 7, 2, 1, 0, 3);
+
+	chacha_lanes_counter_get(ctx, 4, lo, hi);
+	for (i = 0; i < 16; i ++) {
+		s[i] = _mm_set1_epi32((int)ctx->state[i]);
+	}
+	s[12] = _mm_loadu_si128((const __m128i*)(const void*)lo);
+	s[13] = _mm_loadu_si128((const __m128i*)(const void*)hi);
+	for (i = 0; i < 16; i ++) {
+		x[i] = s[i];
+	}
+	for (i = 0; i < ctx->rounds; i += 2) {
+		CHACHA_DOUBLEROUND_QR(CHACHA_SSE_QUARTERROUND, x);
+	}
+	for (i = 0; i < 16; i += 4) {
+		for (b = 0; b < 4; b ++) {
+			x[(i + b)] = _mm_add_epi32(x[(i + b)], s[(i + b)]);
+		}
+		/* x[i + b] = words i..i+3 of block b. */
+		CHACHA_SIMD_TRANSPOSE4(_mm, __m128i,
+		    x[(i + 0)], x[(i + 1)], x[(i + 2)], x[(i + 3)]);
+		for (b = 0; b < 4; b ++) {
+			CHACHA_SSE_STORE(dst, src,
+			    ((b * CHACHA_BLOCK_LEN) + (i * 4)), x[(i + b)]);
+		}
+	}
+	chacha_counter_add(ctx, 4);
+}
+
+
+#define CHACHA_AVX2_ROTL(__v, __n)					\
+	_mm256_or_si256(_mm256_slli_epi32((__v), (__n)),		\
+	    _mm256_srli_epi32((__v), (32 - (__n))))
+#define CHACHA_AVX2_QUARTERROUND(a, b, c, d) {				\
+	a = _mm256_add_epi32(a, b);					\
+	d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);		\
+	c = _mm256_add_epi32(c, d);					\
+	b = CHACHA_AVX2_ROTL(_mm256_xor_si256(b, c), 12);		\
+	a = _mm256_add_epi32(a, b);					\
+	d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);		\
+	c = _mm256_add_epi32(c, d);					\
+	b = CHACHA_AVX2_ROTL(_mm256_xor_si256(b, c), 7);		\
+}
+
+#define CHACHA_AVX2_STORE(__dst, __src, __off, __v) {			\
+	if (NULL != (__src)) {						\
+		(__v) = _mm256_xor_si256((__v), _mm256_loadu_si256(	\
+		    (const __m256i*)(const void*)((__src) + (__off))));	\
+	}								\
+	_mm256_storeu_si256((__m256i*)(void*)((__dst) + (__off)), (__v)); \
+}
+
+CHACHA_TARGET("avx2")
+static inline void
+chacha_blocks8_avx2(chacha_context_p ctx, const uint8_t *src, uint8_t *dst) {
+	size_t i, b;
+	uint32_t lo[8], hi[8];
+	__m256i s[16], x[16], v;
+	const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10,
+	    5, 4, 7, 6, 1, 0, 3, 2, 13, 12, 15, 14, 9, 8, 11, 10,
+	    5, 4, 7, 6, 1, 0, 3, 2);
+	const __m256i rot8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11,
+	    6, 5, 4, 7, 2, 1, 0, 3, 14, 13, 12, 15, 10, 9, 8, 11,
+	    6, 5, 4, 7, 2, 1, 0, 3);
+
+	chacha_lanes_counter_get(ctx, 8, lo, hi);
+	for (i = 0; i < 16; i ++) {
+		s[i] = _mm256_set1_epi32((int)ctx->state[i]);
+	}
+	s[12] = _mm256_loadu_si256((const __m256i*)(const void*)lo);
+	s[13] = _mm256_loadu_si256((const __m256i*)(const void*)hi);
+	for (i = 0; i < 16; i ++) {
+		x[i] = s[i];
+	}
+	for (i = 0; i < ctx->rounds; i += 2) {
+		CHACHA_DOUBLEROUND_QR(CHACHA_AVX2_QUARTERROUND, x);
+	}
+	for (i = 0; i < 16; i ++) {
+		x[i] = _mm256_add_epi32(x[i], s[i]);
+	}
+	for (i = 0; i < 16; i += 4) {
+		/* x[i + b]: low lane - words i..i+3 of block b,
+		 * high lane - of block b + 4. */
+		CHACHA_SIMD_TRANSPOSE4(_mm256, __m256i,
+		    x[(i + 0)], x[(i + 1)], x[(i + 2)], x[(i + 3)]);
+	}
+	for (i = 0; i < 16; i += 8) {
+		for (b = 0; b < 4; b ++) {
+			/* Words i..i+7 of block b and block b + 4. */
+			v = _mm256_permute2x128_si256(x[(i + b)],
+			    x[(i + 4 + b)], 0x20);
+			CHACHA_AVX2_STORE(dst, src,
+			    ((b * CHACHA_BLOCK_LEN) + (i * 4)), v);
+			v = _mm256_permute2x128_si256(x[(i + b)],
+			    x[(i + 4 + b)], 0x31);
+			CHACHA_AVX2_STORE(dst, src,
+			    (((b + 4) * CHACHA_BLOCK_LEN) + (i * 4)), v);
+		}
+	}
+	chacha_counter_add(ctx, 8);
+}
+
+
+#define CHACHA_AVX512_QUARTERROUND(a, b, c, d) {			\
+	a = _mm512_add_epi32(a, b);					\
+	d = _mm512_rol_epi32(_mm512_xor_si512(d, a), 16);		\
+	c = _mm512_add_epi32(c, d);					\
+	b = _mm512_rol_epi32(_mm512_xor_si512(b, c), 12);		\
+	a = _mm512_add_epi32(a, b);					\
+	d = _mm512_rol_epi32(_mm512_xor_si512(d, a), 8);		\
+	c = _mm512_add_epi32(c, d);					\
+	b = _mm512_rol_epi32(_mm512_xor_si512(b, c), 7);		\
+}
+
+#define CHACHA_AVX512_STORE(__dst, __src, __off, __v) {		\
+	if (NULL != (__src)) {						\
+		(__v) = _mm512_xor_si512((__v), _mm512_loadu_si512(	\
+		    (const void*)((__src) + (__off))));			\
+	}								\
+	_mm512_storeu_si512((void*)((__dst) + (__off)), (__v));		\
+}
+
+CHACHA_TARGET("avx512f")
+static inline void
+chacha_blocks16_avx512(chacha_context_p ctx, const uint8_t *src, uint8_t *dst) {
+	size_t i, b;
+	uint32_t lo[16], hi[16];
+	__m512i s[16], x[16], t0, t1, t2, t3;
+
+	chacha_lanes_counter_get(ctx, 16, lo, hi);
+	for (i = 0; i < 16; i ++) {
+		s[i] = _mm512_set1_epi32((int)ctx->state[i]);
+	}
+	s[12] = _mm512_loadu_si512((const void*)lo);
+	s[13] = _mm512_loadu_si512((const void*)hi);
+	for (i = 0; i < 16; i ++) {
+		x[i] = s[i];
+	}
+	for (i = 0; i < ctx->rounds; i += 2) {
+		CHACHA_DOUBLEROUND_QR(CHACHA_AVX512_QUARTERROUND, x);
+	}
+	for (i = 0; i < 16; i ++) {
+		x[i] = _mm512_add_epi32(x[i], s[i]);
+	}
+	for (i = 0; i < 16; i += 4) {
+		/* x[i + b]: lane k - words i..i+3 of block b + 4 * k. */
+		CHACHA_SIMD_TRANSPOSE4(_mm512, __m512i,
+		    x[(i + 0)], x[(i + 1)], x[(i + 2)], x[(i + 3)]);
+	}
+	for (b = 0; b < 4; b ++) {
+		/* Gather lane k of x[b], x[4 + b], x[8 + b], x[12 + b]. */
+		t0 = _mm512_shuffle_i32x4(x[(0 + b)], x[(4 + b)], 0x44);
+		t1 = _mm512_shuffle_i32x4(x[(8 + b)], x[(12 + b)], 0x44);
+		t2 = _mm512_shuffle_i32x4(x[(0 + b)], x[(4 + b)], 0xee);
+		t3 = _mm512_shuffle_i32x4(x[(8 + b)], x[(12 + b)], 0xee);
+		x[(0 + b)] = _mm512_shuffle_i32x4(t0, t1, 0x88);
+		x[(4 + b)] = _mm512_shuffle_i32x4(t0, t1, 0xdd);
+		x[(8 + b)] = _mm512_shuffle_i32x4(t2, t3, 0x88);
+		x[(12 + b)] = _mm512_shuffle_i32x4(t2, t3, 0xdd);
+		/* x[4 * k + b] - block b + 4 * k. */
+		for (i = 0; i < 16; i += 4) {
+			CHACHA_AVX512_STORE(dst, src,
+			    ((b + i) * CHACHA_BLOCK_LEN), x[(i + b)]);
+		}
+	}
+	chacha_counter_add(ctx, 16);
+}
+#endif /* CHACHA_X86_SIMD */
+
+
 /* Buf tranform. */
 static inline void
 chacha_blocks_transform(chacha_context_p ctx, const uint8_t *src, size_t blocks_count,
@@ -508,6 +863,37 @@ chacha_blocks_transform(chacha_context_p ctx, const uint8_t *src, size_t blocks_
 
 	if (0 == blocks_count)
 		return;
+#ifdef CHACHA_X86_SIMD
+	/* Wide transforms for bulk, tail processed by generic. */
+	switch (ctx->impl) {
+	case CHACHA_IMPL_AVX512:
+		for (; 16 <= blocks_count; blocks_count -= 16) {
+			chacha_blocks16_avx512(ctx, src, dst);
+			if (NULL != src)
+				src += (16 * CHACHA_BLOCK_LEN);
+			dst += (16 * CHACHA_BLOCK_LEN);
+		}
+		/* Passtrouth. */
+	case CHACHA_IMPL_AVX2:
+		for (; 8 <= blocks_count; blocks_count -= 8) {
+			chacha_blocks8_avx2(ctx, src, dst);
+			if (NULL != src)
+				src += (8 * CHACHA_BLOCK_LEN);
+			dst += (8 * CHACHA_BLOCK_LEN);
+		}
+		/* Passtrouth. */
+	case CHACHA_IMPL_SSSE3:
+		for (; 4 <= blocks_count; blocks_count -= 4) {
+			chacha_blocks4_ssse3(ctx, src, dst);
+			if (NULL != src)
+				src += (4 * CHACHA_BLOCK_LEN);
+			dst += (4 * CHACHA_BLOCK_LEN);
+		}
+		if (0 == blocks_count)
+			return;
+		break;
+	}
+#endif
 #ifdef CHACHA_X64
 	if ((CHACHA_PTR_IS_ALIGNED8(src) && CHACHA_PTR_IS_ALIGNED8(dst))) {
 		for (; 0 != blocks_count; blocks_count --) {
@@ -552,6 +938,7 @@ chacha_init(chacha_context_p ctx, const uint8_t *key, const size_t key_size,
 	chacha_counter_set(ctx, counter);
 	chacha_iv_set(ctx, iv);
 	ctx->rounds = rounds;
+	chacha_impl_set(ctx, CHACHA_IMPL_AUTO);
 }
 /* key - 16/32 bytes
  * counter - 8 bytes, optional
@@ -1067,7 +1454,9 @@ chacha_self_test(void) {
 	uint8_t	plain[CHACHA_TEST_LEN];
 	uint8_t	encrypted[CHACHA_TEST_LEN];
 	uint8_t	result[CHACHA_TEST_LEN];
+	uint32_t impl;
 	chacha_context_str_t ctx;
+	chacha_context_t ctx_gen;
 
 	for (i = 0; 0 != chacha_tst1v[i].rounds; i ++) {
 		memset(&tst1v, 0x00, sizeof(tst1v));
@@ -1157,6 +1546,35 @@ chacha_self_test(void) {
 	chacha_res_compact(result, plain, CHACHA_TEST_LEN, result);
 	if (0 != memcmp(expected_chacha_oneshot, result, CHACHA_BLOCK_LEN))
 		error ++;
+	/* Each implementation: odd split and 64 bit counter carry. */
+	for (impl = CHACHA_IMPL_GENERIC; impl <= CHACHA_IMPL_AVX512; impl ++) {
+		if (0 == chacha_impl_is_supported(impl))
+			continue;
+		chacha_str_init(&ctx, key, 256, NULL, iv, 8);
+		if (0 != chacha_impl_set(&ctx.c, impl)) {
+			error ++;
+		}
+		chacha_str_data_crypt(&ctx, plain, 5, result);
+		chacha_str_data_crypt(&ctx, &plain[5], (CHACHA_TEST_LEN - 5), &result[5]);
+		chacha_str_final(&ctx);
+		chacha_res_compact(result, plain, CHACHA_TEST_LEN, result);
+		if (0 != memcmp(expected_chacha_oneshot, result, CHACHA_BLOCK_LEN))
+			error ++;
+		/* Key stream only, unaligned. */
+		chacha_init(&ctx.c, key, 256, NULL, iv, 20);
+		chacha_init(&ctx_gen, key, 256, NULL, iv, 20);
+		chacha_counter_set_u64(&ctx.c, 0xfffffff9);
+		chacha_counter_set_u64(&ctx_gen, 0xfffffff9);
+		chacha_impl_set(&ctx.c, impl);
+		chacha_impl_set(&ctx_gen, CHACHA_IMPL_GENERIC);
+		chacha_blocks_transform(&ctx.c, NULL, 31, &result[1]);
+		chacha_blocks_transform(&ctx_gen, NULL, 31, &encrypted[1]);
+		if (0 != memcmp(&encrypted[1], &result[1], (31 * CHACHA_BLOCK_LEN)) ||
+		    chacha_counter_get_u64(&ctx.c) != chacha_counter_get_u64(&ctx_gen))
+			error ++;
+		chacha_final(&ctx.c);
+		chacha_final(&ctx_gen);
+	}
 
 	return (error);
 }
@@ -0,0 +1,351 @@
+/*-
+ * Copyright (c) 2015 - 2020 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ * ChaCha20-Poly1305 AEAD, RFC 8439: 256 bit key, 96 bit nonce,
+ * 32 bit block counter.
+ *
+ * Same nonce must never be used twice with the same key.
+ *
+ */
+
+#ifndef __CHACHA20_POLY1305_H__
+#define __CHACHA20_POLY1305_H__
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <string.h> /* memcpy, memmove, memset... */
+#include <inttypes.h>
+#include <errno.h>
+
+#include "crypto/cipher/chacha.h"
+#include "crypto/cipher/poly1305.h"
+
+
+#define CHACHA20_POLY1305_KEY_LEN	CHACHA_KEY_256_LEN
+#define CHACHA20_POLY1305_NONCE_LEN	12	/* 96 bit */
+#define CHACHA20_POLY1305_TAG_LEN	POLY1305_TAG_LEN
+/* 32 bit counter, block 0 used for poly1305 key. */
+#define CHACHA20_POLY1305_DATA_MAX	((((uint64_t)1) << 38) - CHACHA_BLOCK_LEN)
+
+
+typedef struct chacha20_poly1305_ctx_s {
+	chacha_context_str_t	chacha;
+	poly1305_ctx_t		poly;
+	uint64_t		aad_size;
+	uint64_t		data_size;
+	int			data; /* AAD done, processing data. */
+} chacha20_poly1305_ctx_t, *chacha20_poly1305_ctx_p;
+
+
+/* Zero pad poly1305 input to 16 bytes boundary. */
+static inline void
+chacha20_poly1305_pad16(chacha20_poly1305_ctx_p ctx, const uint64_t size) {
+	static const uint8_t zero[POLY1305_BLOCK_LEN] = { 0 };
+
+	if (0 == (size % POLY1305_BLOCK_LEN))
+		return;
+	poly1305_update(&ctx->poly, zero,
+	    (POLY1305_BLOCK_LEN - (size % POLY1305_BLOCK_LEN)));
+}
+
+static inline void
+chacha20_poly1305_data_start(chacha20_poly1305_ctx_p ctx) {
+
+	if (0 != ctx->data)
+		return;
+	chacha20_poly1305_pad16(ctx, ctx->aad_size);
+	ctx->data = 1;
+}
+
+/* key - 32 bytes
+ * nonce - 12 bytes
+ */
+static inline void
+chacha20_poly1305_init(chacha20_poly1305_ctx_p ctx, const uint8_t *key,
+    const uint8_t *nonce) {
+	uint8_t poly_key[CHACHA_BLOCK_LEN];
+
+	chacha_str_init(&ctx->chacha, key, CHACHA20_POLY1305_KEY_LEN,
+	    NULL, NULL, 20);
+	/* 32 bit counter + 96 bit nonce instead of 64 + 64. */
+	ctx->chacha.c.state[12] = 0;
+	ctx->chacha.c.state[13] = U8TO32_LITTLE(nonce + 0);
+	ctx->chacha.c.state[14] = U8TO32_LITTLE(nonce + 4);
+	ctx->chacha.c.state[15] = U8TO32_LITTLE(nonce + 8);
+	/* Block 0: one time poly1305 key, data starts from block 1. */
+	chacha_blocks_transform(&ctx->chacha.c, NULL, 1, poly_key);
+	poly1305_init(&ctx->poly, poly_key);
+	chacha_bzero(poly_key, sizeof(poly_key));
+	ctx->aad_size = 0;
+	ctx->data_size = 0;
+	ctx->data = 0;
+}
+
+/* Additional authenticated data, before any encrypt / decrypt. */
+static inline int
+chacha20_poly1305_aad_update(chacha20_poly1305_ctx_p ctx, const uint8_t *aad,
+    const size_t aad_size) {
+
+	if (0 != ctx->data)
+		return (EINVAL);
+	poly1305_update(&ctx->poly, aad, aad_size);
+	ctx->aad_size += aad_size;
+
+	return (0);
+}
+
+/* src and dst may be the same buf. */
+static inline int
+chacha20_poly1305_encrypt_update(chacha20_poly1305_ctx_p ctx,
+    const uint8_t *src, const size_t size, uint8_t *dst) {
+
+	if ((CHACHA20_POLY1305_DATA_MAX - ctx->data_size) < size)
+		return (EFBIG);
+	chacha20_poly1305_data_start(ctx);
+	chacha_str_data_crypt(&ctx->chacha, src, size, dst);
+	poly1305_update(&ctx->poly, dst, size);
+	ctx->data_size += size;
+
+	return (0);
+}
+
+/* src and dst may be the same buf.
+ * Plain text must not be used before chacha20_poly1305_final_verify()
+ * returns 0. */
+static inline int
+chacha20_poly1305_decrypt_update(chacha20_poly1305_ctx_p ctx,
+    const uint8_t *src, const size_t size, uint8_t *dst) {
+
+	if ((CHACHA20_POLY1305_DATA_MAX - ctx->data_size) < size)
+		return (EFBIG);
+	chacha20_poly1305_data_start(ctx);
+	poly1305_update(&ctx->poly, src, size);
+	chacha_str_data_crypt(&ctx->chacha, src, size, dst);
+	ctx->data_size += size;
+
+	return (0);
+}
+
+/* tag - 16 bytes. Context zeroed. */
+static inline void
+chacha20_poly1305_final(chacha20_poly1305_ctx_p ctx, uint8_t *tag) {
+	uint8_t sizes[16];
+
+	chacha20_poly1305_data_start(ctx);
+	chacha20_poly1305_pad16(ctx, ctx->data_size);
+	U32TO8_LITTLE((sizes +  0), (uint32_t)ctx->aad_size);
+	U32TO8_LITTLE((sizes +  4), (uint32_t)(ctx->aad_size >> 32));
+	U32TO8_LITTLE((sizes +  8), (uint32_t)ctx->data_size);
+	U32TO8_LITTLE((sizes + 12), (uint32_t)(ctx->data_size >> 32));
+	poly1305_update(&ctx->poly, sizes, sizeof(sizes));
+	poly1305_final(&ctx->poly, tag);
+	chacha_str_final(&ctx->chacha);
+	chacha_bzero(ctx, sizeof(chacha20_poly1305_ctx_t));
+}
+
+/* Return 0 if tag valid, EBADMSG otherwise. Context zeroed. */
+static inline int
+chacha20_poly1305_final_verify(chacha20_poly1305_ctx_p ctx, const uint8_t *tag) {
+	uint8_t tag_calc[CHACHA20_POLY1305_TAG_LEN];
+	int error;
+
+	chacha20_poly1305_final(ctx, tag_calc);
+	error = poly1305_tag_cmp(tag, tag_calc);
+	chacha_bzero(tag_calc, sizeof(tag_calc));
+	if (0 != error)
+		return (EBADMSG);
+
+	return (0);
+}
+
+
+/* One shot encrypt.
+ * key - 32 bytes
+ * nonce - 12 bytes
+ * tag - 16 bytes
+ */
+static inline int
+chacha20_poly1305_encrypt(const uint8_t *key, const uint8_t *nonce,
+    const uint8_t *aad, const size_t aad_size,
+    const uint8_t *src, const size_t size, uint8_t *dst, uint8_t *tag) {
+	chacha20_poly1305_ctx_t ctx;
+
+	if (CHACHA20_POLY1305_DATA_MAX < size)
+		return (EFBIG);
+	chacha20_poly1305_init(&ctx, key, nonce);
+	chacha20_poly1305_aad_update(&ctx, aad, aad_size);
+	chacha20_poly1305_encrypt_update(&ctx, src, size, dst);
+	chacha20_poly1305_final(&ctx, tag);
+
+	return (0);
+}
+
+/* One shot decrypt: tag checked before decryption, on EBADMSG dst
+ * not modified.
+ * key - 32 bytes
+ * nonce - 12 bytes
+ * tag - 16 bytes
+ */
+static inline int
+chacha20_poly1305_decrypt(const uint8_t *key, const uint8_t *nonce,
+    const uint8_t *aad, const size_t aad_size,
+    const uint8_t *src, const size_t size, const uint8_t *tag, uint8_t *dst) {
+	chacha20_poly1305_ctx_t ctx;
+	chacha_context_str_t chacha;
+	int error;
+
+	if (CHACHA20_POLY1305_DATA_MAX < size)
+		return (EFBIG);
+	chacha20_poly1305_init(&ctx, key, nonce);
+	memcpy(&chacha, &ctx.chacha, sizeof(chacha));
+	chacha20_poly1305_aad_update(&ctx, aad, aad_size);
+	chacha20_poly1305_data_start(&ctx);
+	poly1305_update(&ctx.poly, src, size);
+	ctx.data_size = size;
+	error = chacha20_poly1305_final_verify(&ctx, tag);
+	if (0 == error) {
+		chacha_str_data_crypt(&chacha, src, size, dst);
+	}
+	chacha_str_final(&chacha);
+
+	return (error);
+}
+
+
+#ifdef CHACHA20_POLY1305_SELF_TEST
+/* RFC 8439 2.8.2. */
+static const uint8_t chacha20_poly1305_tv_plain[] =
+    "Ladies and Gentlemen of the class of '99: If I could offer you "
+    "only one tip for the future, sunscreen would be it.";
+static const uint8_t chacha20_poly1305_tv_aad[] = {
+	0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7
+};
+static const uint8_t chacha20_poly1305_tv_nonce[] = {
+	0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43,
+	0x44, 0x45, 0x46, 0x47
+};
+static const uint8_t chacha20_poly1305_tv_encrypted[] = {
+	0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb,
+	0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2,
+	0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe,
+	0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6,
+	0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12,
+	0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+	0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29,
+	0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36,
+	0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c,
+	0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58,
+	0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94,
+	0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+	0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d,
+	0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b,
+	0x61, 0x16
+};
+static const uint8_t chacha20_poly1305_tv_tag[] = {
+	0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+	0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91
+};
+
+/* 0 - OK, non zero - error */
+static inline int
+chacha20_poly1305_self_test(void) {
+	int error = 0;
+	size_t i, size;
+	uint8_t key[CHACHA20_POLY1305_KEY_LEN];
+	uint8_t tag[CHACHA20_POLY1305_TAG_LEN];
+	uint8_t buf[sizeof(chacha20_poly1305_tv_encrypted)];
+	chacha20_poly1305_ctx_t ctx;
+
+	size = sizeof(chacha20_poly1305_tv_encrypted);
+	for (i = 0; i < sizeof(key); i ++) {
+		key[i] = (uint8_t)(0x80 + i);
+	}
+	/* One shot. */
+	chacha20_poly1305_encrypt(key, chacha20_poly1305_tv_nonce,
+	    chacha20_poly1305_tv_aad, sizeof(chacha20_poly1305_tv_aad),
+	    chacha20_poly1305_tv_plain, size, buf, tag);
+	if (0 != memcmp(chacha20_poly1305_tv_encrypted, buf, size) ||
+	    0 != memcmp(chacha20_poly1305_tv_tag, tag, sizeof(tag))) {
+		error ++;
+	}
+	memset(buf, 0x00, sizeof(buf));
+	if (0 != chacha20_poly1305_decrypt(key, chacha20_poly1305_tv_nonce,
+	    chacha20_poly1305_tv_aad, sizeof(chacha20_poly1305_tv_aad),
+	    chacha20_poly1305_tv_encrypted, size, chacha20_poly1305_tv_tag,
+	    buf) ||
+	    0 != memcmp(chacha20_poly1305_tv_plain, buf, size)) {
+		error ++;
+	}
+	/* Streaming, odd pieces, in place. */
+	memcpy(buf, chacha20_poly1305_tv_plain, size);
+	chacha20_poly1305_init(&ctx, key, chacha20_poly1305_tv_nonce);
+	chacha20_poly1305_aad_update(&ctx, chacha20_poly1305_tv_aad, 5);
+	chacha20_poly1305_aad_update(&ctx, &chacha20_poly1305_tv_aad[5],
+	    (sizeof(chacha20_poly1305_tv_aad) - 5));
+	chacha20_poly1305_encrypt_update(&ctx, buf, 1, buf);
+	chacha20_poly1305_encrypt_update(&ctx, &buf[1], 70, &buf[1]);
+	chacha20_poly1305_encrypt_update(&ctx, &buf[71], (size - 71), &buf[71]);
+	if (EINVAL != chacha20_poly1305_aad_update(&ctx, key, 1)) {
+		error ++;
+	}
+	chacha20_poly1305_final(&ctx, tag);
+	if (0 != memcmp(chacha20_poly1305_tv_encrypted, buf, size) ||
+	    0 != memcmp(chacha20_poly1305_tv_tag, tag, sizeof(tag))) {
+		error ++;
+	}
+	chacha20_poly1305_init(&ctx, key, chacha20_poly1305_tv_nonce);
+	chacha20_poly1305_aad_update(&ctx, chacha20_poly1305_tv_aad,
+	    sizeof(chacha20_poly1305_tv_aad));
+	chacha20_poly1305_decrypt_update(&ctx, buf, 17, buf);
+	chacha20_poly1305_decrypt_update(&ctx, &buf[17], (size - 17), &buf[17]);
+	if (0 != chacha20_poly1305_final_verify(&ctx, chacha20_poly1305_tv_tag) ||
+	    0 != memcmp(chacha20_poly1305_tv_plain, buf, size)) {
+		error ++;
+	}
+	/* Forged: tag and aad. */
+	memset(buf, 0x00, sizeof(buf));
+	memcpy(tag, chacha20_poly1305_tv_tag, sizeof(tag));
+	tag[15] ^= 0x01;
+	if (EBADMSG != chacha20_poly1305_decrypt(key, chacha20_poly1305_tv_nonce,
+	    chacha20_poly1305_tv_aad, sizeof(chacha20_poly1305_tv_aad),
+	    chacha20_poly1305_tv_encrypted, size, tag, buf) ||
+	    0 != buf[0]) {
+		error ++;
+	}
+	if (EBADMSG != chacha20_poly1305_decrypt(key, chacha20_poly1305_tv_nonce,
+	    chacha20_poly1305_tv_aad, (sizeof(chacha20_poly1305_tv_aad) - 1),
+	    chacha20_poly1305_tv_encrypted, size, chacha20_poly1305_tv_tag,
+	    buf)) {
+		error ++;
+	}
+
+	return (error);
+}
+#endif
+
+#endif /* __CHACHA20_POLY1305_H__ */
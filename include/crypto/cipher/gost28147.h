@@ -43,6 +43,18 @@
 #include <string.h> /* memcpy, memmove, memset... */
 #include <inttypes.h>
 #include <netinet/in.h> /* ntohs(), htons(), ntohl(), htonl() */
+#include <errno.h>
+
+/*
+ * x86-64: AVX2 gather multi-block engine, selected at run time
+ * by cpuid, no -m flags required.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define GOST28147_X86_SIMD	1
+#	include "al/cpu_features.h"
+#	include <immintrin.h>
+#	define GOST28147_TARGET(__t)	__attribute__((__target__(__t)))
+#endif
 
 #if defined(_MSC_VER) || defined(__INTEL_COMPILER)
 #	define GOST28147_ALIGN(__n) __declspec(align(__n)) /* DECLSPEC_ALIGN() */
@@ -54,6 +66,10 @@ static void *(*volatile gost28147_memset_volatile)(void*, int, size_t) = memset;
 #define gost28147_bzero(mem, size)	gost28147_memset_volatile(mem, 0, size)
 #define gost28147_print(__fmt, args...)	fprintf(stdout, (__fmt), ##args)
 
+#ifndef nitems /* SIZEOF() */
+#	define nitems(__val)	(sizeof(__val) / sizeof(__val[0]))
+#endif
+
 
 /* Tunables. */
 /* Define to use cmall tables but do more calculations. */
@@ -69,6 +85,12 @@ static void *(*volatile gost28147_memset_volatile)(void*, int, size_t) = memset;
 #define GOST28147_KEY_32CNT	(GOST28147_KEY_SIZE / sizeof(uint32_t)) /* 8 */
 
 
+/* Multi-block engine implementations. */
+#define GOST28147_IMPL_GENERIC	0 /* 4 blocks interleaved. */
+#define GOST28147_IMPL_AVX2	1 /* 16 blocks, sbox gather. */
+#define GOST28147_IMPL_AUTO	0xff
+
+
 /* Constants and tables. */
 /* id-GostR3411-94-TestParamSet 1.2.643.2.2.31.0 */
 static const uint8_t id_gostr3411_94_testparamset_sbox[128] = {
@@ -148,6 +170,7 @@ typedef struct gost28147_context_s {
 	const uint8_t			*sbox; /* SBox Replace table pointer. */
 #endif
 	GOST28147_ALIGN(8) uint32_t	mac[GOST28147_BLK_32CNT]; /* Calculated MAC. */
+	uint32_t			impl; /* GOST28147_IMPL_*, gost28147_impl_set(). */
 } gost28147_context_t, *gost28147_context_p;
 
 
@@ -156,7 +179,7 @@ typedef struct gost28147_context_s {
 
 /* interpret four 8 bit unsigned integers as a 32 bit unsigned integer in little endian */
 static inline uint32_t
-U8TO32_LITTLE(const uint8_t *p) {
+gost28147_u8to32_le(const uint8_t *p) {
 	return 
 	    (((uint32_t)(p[0])      ) |
 	     ((uint32_t)(p[1]) <<  8) |
@@ -164,7 +187,7 @@ U8TO32_LITTLE(const uint8_t *p) {
 	     ((uint32_t)(p[3]) << 24));
 }
 static inline uint32_t
-U8TO32_BIG(const uint8_t *p) {
+gost28147_u8to32_be(const uint8_t *p) {
 	return 
 	    (((uint32_t)(p[3])      ) |
 	     ((uint32_t)(p[2]) <<  8) |
@@ -174,14 +197,14 @@ U8TO32_BIG(const uint8_t *p) {
 
 /* store a 32 bit unsigned integer as four 8 bit unsigned integers in little endian */
 static inline void
-U32TO8_LITTLE(uint8_t *p, uint32_t v) {
+gost28147_u32to8_le(uint8_t *p, uint32_t v) {
 	p[0] = (uint8_t)(v      );
 	p[1] = (uint8_t)(v >>  8);
 	p[2] = (uint8_t)(v >> 16);
 	p[3] = (uint8_t)(v >> 24);
 }
 static inline void
-U32TO8_BIG(uint8_t *p, uint32_t v) {
+gost28147_u32to8_be(uint8_t *p, uint32_t v) {
 	p[3] = (uint8_t)(v      );
 	p[2] = (uint8_t)(v >>  8);
 	p[1] = (uint8_t)(v >> 16);
@@ -302,8 +325,8 @@ gost28147_blocks_mac(gost28147_context_p ctx, const uint8_t *src, size_t blocks_
 		for (; 0 != blocks_count; blocks_count --) {
 			/* Load, transform and save block. */
 			gost28147_mac_block(ctx,
-			    U8TO32_LITTLE(src),
-			    U8TO32_LITTLE(src + sizeof(uint32_t)));
+			    gost28147_u8to32_le(src),
+			    gost28147_u8to32_le(src + sizeof(uint32_t)));
 			src += GOST28147_BLK_SIZE;
 		}
 	}
@@ -325,8 +348,8 @@ gost28147_blocks_mac_be(gost28147_context_p ctx, const uint8_t *src, size_t bloc
 		for (; 0 != blocks_count; blocks_count --) {
 			/* Load, transform and save block. */
 			gost28147_mac_block(ctx,
-			    ntohl(U8TO32_LITTLE(src + sizeof(uint32_t))),
-			    ntohl(U8TO32_LITTLE(src)));
+			    ntohl(gost28147_u8to32_le(src + sizeof(uint32_t))),
+			    ntohl(gost28147_u8to32_le(src)));
 			src += GOST28147_BLK_SIZE;
 		}
 	}
@@ -356,13 +379,13 @@ gost28147_blocks_encrypt(gost28147_context_p ctx, const uint8_t *src, size_t blo
 		for (; 0 != blocks_count; blocks_count --) {
 			/* Load, transform and save block. */
 			gost28147_block_encrypt(ctx,
-			    U8TO32_LITTLE(src), /* n1 */
-			    U8TO32_LITTLE(src + sizeof(uint32_t)), /* n2 */
+			    gost28147_u8to32_le(src), /* n1 */
+			    gost28147_u8to32_le(src + sizeof(uint32_t)), /* n2 */
 			    &n1,
 			    &n2);
 			/* Store result to dst. */
-			U32TO8_LITTLE(dst, n1);
-			U32TO8_LITTLE((dst + sizeof(uint32_t)), n2);
+			gost28147_u32to8_le(dst, n1);
+			gost28147_u32to8_le((dst + sizeof(uint32_t)), n2);
 			src += GOST28147_BLK_SIZE;
 			dst += GOST28147_BLK_SIZE;
 		}
@@ -393,13 +416,13 @@ gost28147_blocks_encrypt_be(gost28147_context_p ctx, const uint8_t *src, size_t
 		for (; 0 != blocks_count; blocks_count --) {
 			/* Load, transform and save block. */
 			gost28147_block_encrypt(ctx,
-			    ntohl(U8TO32_LITTLE(src + sizeof(uint32_t))), /* n1 */
-			    ntohl(U8TO32_LITTLE(src)), /* n2 */
+			    ntohl(gost28147_u8to32_le(src + sizeof(uint32_t))), /* n1 */
+			    ntohl(gost28147_u8to32_le(src)), /* n2 */
 			    &n1,
 			    &n2);
 			/* Store result to dst. */
-			U32TO8_LITTLE(dst, htonl(n2));
-			U32TO8_LITTLE((dst + sizeof(uint32_t)), htonl(n1));
+			gost28147_u32to8_le(dst, htonl(n2));
+			gost28147_u32to8_le((dst + sizeof(uint32_t)), htonl(n1));
 			src += GOST28147_BLK_SIZE;
 			dst += GOST28147_BLK_SIZE;
 		}
@@ -430,13 +453,13 @@ gost28147_blocks_decrypt(gost28147_context_p ctx, const uint8_t *src, size_t blo
 		for (; 0 != blocks_count; blocks_count --) {
 			/* Load, transform and save block. */
 			gost28147_block_decrypt(ctx,
-			    ntohl(U8TO32_LITTLE(src + sizeof(uint32_t))),
-			    ntohl(U8TO32_LITTLE(src)),
+			    gost28147_u8to32_le(src), /* n1 */
+			    gost28147_u8to32_le(src + sizeof(uint32_t)), /* n2 */
 			    &n1,
 			    &n2);
 			/* Store result to dst. */
-			U32TO8_LITTLE(dst, n1);
-			U32TO8_LITTLE((dst + sizeof(uint32_t)), n2);
+			gost28147_u32to8_le(dst, n1);
+			gost28147_u32to8_le((dst + sizeof(uint32_t)), n2);
 			src += GOST28147_BLK_SIZE;
 			dst += GOST28147_BLK_SIZE;
 		}
@@ -467,19 +490,78 @@ gost28147_blocks_decrypt_be(gost28147_context_p ctx, const uint8_t *src, size_t
 		for (; 0 != blocks_count; blocks_count --) {
 			/* Load, transform and save block. */
 			gost28147_block_decrypt(ctx,
-			    U8TO32_LITTLE(src), /* n1 */
-			    U8TO32_LITTLE(src + sizeof(uint32_t)), /* n2 */
+			    ntohl(gost28147_u8to32_le(src + sizeof(uint32_t))), /* n1 */
+			    ntohl(gost28147_u8to32_le(src)), /* n2 */
 			    &n1,
 			    &n2);
 			/* Store result to dst. */
-			U32TO8_LITTLE(dst, htonl(n2));
-			U32TO8_LITTLE((dst + sizeof(uint32_t)), htonl(n1));
+			gost28147_u32to8_le(dst, htonl(n2));
+			gost28147_u32to8_le((dst + sizeof(uint32_t)), htonl(n1));
 			src += GOST28147_BLK_SIZE;
 			dst += GOST28147_BLK_SIZE;
 		}
 	}
 }
 
+#define GOST28147_CPU_F_INIT	(((uint32_t)1) << 0)
+#define GOST28147_CPU_F_AVX2	(((uint32_t)1) << 1)
+
+/* Return GOST28147_CPU_F_* supported by CPU and build. */
+static inline uint32_t
+gost28147_cpu_features_get(void) {
+	uint32_t ret = GOST28147_CPU_F_INIT;
+
+#if defined(GOST28147_X86_SIMD) && !defined(GOST28147_USE_SMALL_TABLES)
+	/* Gather need extended sbox tables. */
+	if (0 != (CPU_F_AVX2 & cpu_features_get())) {
+		ret |= GOST28147_CPU_F_AVX2;
+	}
+#endif
+
+	return (ret);
+}
+
+/* 0 - not supported by CPU / build. */
+static inline int
+gost28147_impl_is_supported(const uint32_t impl) {
+
+	switch (impl) {
+	case GOST28147_IMPL_GENERIC:
+	case GOST28147_IMPL_AUTO:
+		return (1);
+	case GOST28147_IMPL_AVX2:
+		return (0 != (GOST28147_CPU_F_AVX2 & gost28147_cpu_features_get()));
+	}
+	return (0);
+}
+
+/* Select multi-block engine: GOST28147_IMPL_*.
+ * Return ENOTSUP if not supported by CPU, ctx is usable with
+ * generic engine anyway. */
+static inline int
+gost28147_impl_set(gost28147_context_p ctx, const uint32_t impl) {
+
+	ctx->impl = GOST28147_IMPL_GENERIC;
+	switch (impl) {
+	case GOST28147_IMPL_GENERIC:
+		break;
+	case GOST28147_IMPL_AUTO:
+		if (0 != gost28147_impl_is_supported(GOST28147_IMPL_AVX2)) {
+			ctx->impl = GOST28147_IMPL_AVX2;
+		}
+		break;
+	case GOST28147_IMPL_AVX2:
+		if (0 == gost28147_impl_is_supported(impl))
+			return (ENOTSUP);
+		ctx->impl = impl;
+		break;
+	default:
+		return (EINVAL);
+	}
+
+	return (0);
+}
+
 /* key - 32 bytes
  * sbox - SBox table pointer
  */
@@ -511,6 +593,7 @@ gost28147_init(const uint8_t *key, const size_t key_size, const uint8_t *sbox,
 #endif
 	ctx->mac[0] = 0;
 	ctx->mac[1] = 0;
+	gost28147_impl_set(ctx, GOST28147_IMPL_AUTO);
 
 	return (0);
 }
@@ -566,6 +649,367 @@ gost28147_final_be(gost28147_context_p ctx, uint8_t *mac, size_t mac_size) {
 }
 
 
+/*
+ * Multi-block engine: many independent blocks per call, for modes where
+ * blocks do not depend on each other (CTR, CFB decrypt).
+ * n1 / n2 - block halves as for gost28147_block_encrypt(), in / out.
+ */
+
+/* Key words order for encryption. */
+static const uint8_t gost28147_key_order_enc[GOST28147_ROUNDS] = {
+	0, 1, 2, 3, 4, 5, 6, 7,
+	0, 1, 2, 3, 4, 5, 6, 7,
+	0, 1, 2, 3, 4, 5, 6, 7,
+	7, 6, 5, 4, 3, 2, 1, 0
+};
+
+/* 4 blocks interleaved: hide tables lookup latency. */
+static inline void
+gost28147_blocks4_encrypt(gost28147_context_p ctx, uint32_t *n1, uint32_t *n2) {
+	size_t i;
+	uint32_t k, a0, a1, a2, a3, b0, b1, b2, b3;
+
+	a0 = n1[0];
+	a1 = n1[1];
+	a2 = n1[2];
+	a3 = n1[3];
+	b0 = n2[0];
+	b1 = n2[1];
+	b2 = n2[2];
+	b3 = n2[3];
+	for (i = 0; i < GOST28147_ROUNDS; i += 2) {
+		k = ctx->key[gost28147_key_order_enc[i]];
+		b0 ^= gost28147_block32(ctx, (a0 + k));
+		b1 ^= gost28147_block32(ctx, (a1 + k));
+		b2 ^= gost28147_block32(ctx, (a2 + k));
+		b3 ^= gost28147_block32(ctx, (a3 + k));
+		k = ctx->key[gost28147_key_order_enc[(i + 1)]];
+		a0 ^= gost28147_block32(ctx, (b0 + k));
+		a1 ^= gost28147_block32(ctx, (b1 + k));
+		a2 ^= gost28147_block32(ctx, (b2 + k));
+		a3 ^= gost28147_block32(ctx, (b3 + k));
+	}
+	/* Halves swapped after last round. */
+	n1[0] = b0;
+	n1[1] = b1;
+	n1[2] = b2;
+	n1[3] = b3;
+	n2[0] = a0;
+	n2[1] = a1;
+	n2[2] = a2;
+	n2[3] = a3;
+}
+
+#if defined(GOST28147_X86_SIMD) && !defined(GOST28147_USE_SMALL_TABLES)
+/* funcG() for 8 lanes: 4 x 8 gathers from extended sbox. */
+#define GOST28147_AVX2_G(__ctx, __x)					\
+	_mm256_xor_si256(						\
+	    _mm256_xor_si256(						\
+		_mm256_i32gather_epi32((const int*)(__ctx)->sboxx[0],	\
+		    _mm256_and_si256((__x), m8), 4),			\
+		_mm256_i32gather_epi32((const int*)(__ctx)->sboxx[1],	\
+		    _mm256_and_si256(_mm256_srli_epi32((__x), 8), m8), 4)), \
+	    _mm256_xor_si256(						\
+		_mm256_i32gather_epi32((const int*)(__ctx)->sboxx[2],	\
+		    _mm256_and_si256(_mm256_srli_epi32((__x), 16), m8), 4), \
+		_mm256_i32gather_epi32((const int*)(__ctx)->sboxx[3],	\
+		    _mm256_srli_epi32((__x), 24), 4)))
+
+/* 16 blocks: 2 x 8 lanes interleaved. */
+GOST28147_TARGET("avx2")
+static inline void
+gost28147_blocks16_encrypt_avx2(gost28147_context_p ctx, uint32_t *n1,
+    uint32_t *n2) {
+	size_t i;
+	__m256i k, a0, a1, b0, b1;
+	const __m256i m8 = _mm256_set1_epi32(0xff);
+
+	a0 = _mm256_loadu_si256((const __m256i*)(const void*)&n1[0]);
+	a1 = _mm256_loadu_si256((const __m256i*)(const void*)&n1[8]);
+	b0 = _mm256_loadu_si256((const __m256i*)(const void*)&n2[0]);
+	b1 = _mm256_loadu_si256((const __m256i*)(const void*)&n2[8]);
+	for (i = 0; i < GOST28147_ROUNDS; i += 2) {
+		k = _mm256_set1_epi32((int)ctx->key[gost28147_key_order_enc[i]]);
+		b0 = _mm256_xor_si256(b0,
+		    GOST28147_AVX2_G(ctx, _mm256_add_epi32(a0, k)));
+		b1 = _mm256_xor_si256(b1,
+		    GOST28147_AVX2_G(ctx, _mm256_add_epi32(a1, k)));
+		k = _mm256_set1_epi32((int)ctx->key[gost28147_key_order_enc[(i + 1)]]);
+		a0 = _mm256_xor_si256(a0,
+		    GOST28147_AVX2_G(ctx, _mm256_add_epi32(b0, k)));
+		a1 = _mm256_xor_si256(a1,
+		    GOST28147_AVX2_G(ctx, _mm256_add_epi32(b1, k)));
+	}
+	/* Halves swapped after last round. */
+	_mm256_storeu_si256((__m256i*)(void*)&n1[0], b0);
+	_mm256_storeu_si256((__m256i*)(void*)&n1[8], b1);
+	_mm256_storeu_si256((__m256i*)(void*)&n2[0], a0);
+	_mm256_storeu_si256((__m256i*)(void*)&n2[8], a1);
+}
+#endif
+
+/* Encrypt count independent blocks in place. */
+static inline void
+gost28147_nblocks_encrypt(gost28147_context_p ctx, uint32_t *n1, uint32_t *n2,
+    size_t count) {
+
+#if defined(GOST28147_X86_SIMD) && !defined(GOST28147_USE_SMALL_TABLES)
+	if (GOST28147_IMPL_AVX2 == ctx->impl) {
+		for (; 16 <= count; count -= 16) {
+			gost28147_blocks16_encrypt_avx2(ctx, n1, n2);
+			n1 += 16;
+			n2 += 16;
+		}
+	}
+#endif
+	for (; 4 <= count; count -= 4) {
+		gost28147_blocks4_encrypt(ctx, n1, n2);
+		n1 += 4;
+		n2 += 4;
+	}
+	for (; 0 != count; count --) {
+		gost28147_block_encrypt(ctx, (*n1), (*n2), n1, n2);
+		n1 ++;
+		n2 ++;
+	}
+}
+
+
+/*
+ * ГОСТ Р 34.13-2015 modes for 64 bit block (magma), byte order as
+ * gost28147_blocks_encrypt_be(): context from gost28147_init_be().
+ * Any data size, may be called many times for stream.
+ */
+
+/* Blocks per gost28147_nblocks_encrypt() call, on stack. */
+#define GOST28147_MODE_BULK_BLOCKS	64
+
+/* Block bytes to halves / dst = src ^ E(block) halves. */
+static inline void
+gost28147_blk_load_be(const uint8_t *blk, uint32_t *n1, uint32_t *n2) {
+
+	(*n1) = gost28147_u8to32_be((blk + sizeof(uint32_t)));
+	(*n2) = gost28147_u8to32_be(blk);
+}
+
+static inline void
+gost28147_blk_xor_be(const uint8_t *src, const uint32_t n1, const uint32_t n2,
+    uint8_t *dst) {
+
+	gost28147_u32to8_be(dst,
+	    (gost28147_u8to32_be(src) ^ n2));
+	gost28147_u32to8_be((dst + sizeof(uint32_t)),
+	    (gost28147_u8to32_be((src + sizeof(uint32_t))) ^ n1));
+}
+
+
+/* CTR: gamma = E(ctr ++), ctr = IV || 0, 32 bit IV. */
+#define GOST28147_CTR_IV_SIZE	(GOST28147_BLK_SIZE / 2)
+
+typedef struct gost28147_ctr_s {
+	uint64_t	ctr; /* Next counter block. */
+	size_t		ks_len; /* Unused key stream bytes at end of ks. */
+	uint8_t		ks[GOST28147_BLK_SIZE];
+} gost28147_ctr_t, *gost28147_ctr_p;
+
+static inline void
+gost28147_ctr_init(gost28147_ctr_p ctr, const uint8_t *iv) {
+
+	ctr->ctr = (((uint64_t)gost28147_u8to32_be(iv)) << 32);
+	ctr->ks_len = 0;
+}
+
+/* Encrypt and decrypt, src and dst may be the same buf. */
+static inline void
+gost28147_ctr_crypt(gost28147_context_p ctx, gost28147_ctr_p ctr,
+    const uint8_t *src, size_t size, uint8_t *dst) {
+	size_t i, count;
+	const uint8_t *ks;
+	uint32_t n1[GOST28147_MODE_BULK_BLOCKS], n2[GOST28147_MODE_BULK_BLOCKS];
+
+	if (0 != ctr->ks_len) { /* Have saved key stream. */
+		count = MIN(ctr->ks_len, size);
+		ks = (ctr->ks + (GOST28147_BLK_SIZE - ctr->ks_len));
+		for (i = 0; i < count; i ++) {
+			dst[i] = (src[i] ^ ks[i]);
+		}
+		ctr->ks_len -= count;
+		src += count;
+		dst += count;
+		size -= count;
+	}
+	while (GOST28147_BLK_SIZE <= size) {
+		count = MIN((size / GOST28147_BLK_SIZE), GOST28147_MODE_BULK_BLOCKS);
+		for (i = 0; i < count; i ++, ctr->ctr ++) {
+			n1[i] = (uint32_t)ctr->ctr;
+			n2[i] = (uint32_t)(ctr->ctr >> 32);
+		}
+		gost28147_nblocks_encrypt(ctx, n1, n2, count);
+		for (i = 0; i < count; i ++) {
+			gost28147_blk_xor_be(src, n1[i], n2[i], dst);
+			src += GOST28147_BLK_SIZE;
+			dst += GOST28147_BLK_SIZE;
+		}
+		size -= (count * GOST28147_BLK_SIZE);
+	}
+	if (0 != size) { /* Tail: save rest of key stream. */
+		n1[0] = (uint32_t)ctr->ctr;
+		n2[0] = (uint32_t)(ctr->ctr >> 32);
+		ctr->ctr ++;
+		gost28147_block_encrypt(ctx, n1[0], n2[0], &n1[0], &n2[0]);
+		gost28147_u32to8_be(ctr->ks, n2[0]);
+		gost28147_u32to8_be((ctr->ks + sizeof(uint32_t)), n1[0]);
+		for (i = 0; i < size; i ++) {
+			dst[i] = (src[i] ^ ctr->ks[i]);
+		}
+		ctr->ks_len = (GOST28147_BLK_SIZE - size);
+	}
+}
+
+
+/* CFB, s = n: gamma = E(MSB_n(R)), R = LSB_{m-n}(R) || C, R = IV. */
+#define GOST28147_CFB_IV_MAX_SIZE	(4 * GOST28147_BLK_SIZE) /* m <= 4n */
+
+typedef struct gost28147_cfb_s {
+	uint8_t		reg[GOST28147_CFB_IV_MAX_SIZE]; /* R: last cipher text blocks. */
+	size_t		reg_size; /* m / 8. */
+	size_t		blk_used; /* Processed bytes of current block. */
+	uint8_t		ks[GOST28147_BLK_SIZE]; /* Current block key stream. */
+	uint8_t		cb[GOST28147_BLK_SIZE]; /* Current block cipher text. */
+} gost28147_cfb_t, *gost28147_cfb_p;
+
+/* iv_size - m / 8: 8, 16, 24 or 32 bytes. */
+static inline int
+gost28147_cfb_init(gost28147_cfb_p cfb, const uint8_t *iv, const size_t iv_size) {
+
+	if (NULL == cfb || NULL == iv || 0 == iv_size ||
+	    GOST28147_CFB_IV_MAX_SIZE < iv_size ||
+	    0 != (iv_size % GOST28147_BLK_SIZE))
+		return (EINVAL);
+	memcpy(cfb->reg, iv, iv_size);
+	cfb->reg_size = iv_size;
+	cfb->blk_used = 0;
+
+	return (0);
+}
+
+/* Shift R left and append count cipher text blocks. */
+static inline void
+gost28147_cfb_reg_push(gost28147_cfb_p cfb, const uint8_t *blocks,
+    const size_t count) {
+	const size_t size = (count * GOST28147_BLK_SIZE);
+
+	if (size >= cfb->reg_size) {
+		memcpy(cfb->reg, (blocks + (size - cfb->reg_size)), cfb->reg_size);
+		return;
+	}
+	memmove(cfb->reg, (cfb->reg + size), (cfb->reg_size - size));
+	memcpy((cfb->reg + (cfb->reg_size - size)), blocks, size);
+}
+
+/* Incomplete block: bytes one by one, returns processed bytes count. */
+static inline size_t
+gost28147_cfb_partial(gost28147_context_p ctx, gost28147_cfb_p cfb,
+    const int encrypt, const uint8_t *src, const size_t size, uint8_t *dst) {
+	size_t i, count;
+	uint32_t n1, n2;
+	uint8_t c;
+
+	if (0 == cfb->blk_used) {
+		gost28147_blk_load_be(cfb->reg, &n1, &n2);
+		gost28147_block_encrypt(ctx, n1, n2, &n1, &n2);
+		gost28147_u32to8_be(cfb->ks, n2);
+		gost28147_u32to8_be((cfb->ks + sizeof(uint32_t)), n1);
+	}
+	count = MIN((GOST28147_BLK_SIZE - cfb->blk_used), size);
+	for (i = 0; i < count; i ++) {
+		c = ((0 != encrypt) ? (src[i] ^ cfb->ks[(cfb->blk_used + i)]) : src[i]);
+		dst[i] = (src[i] ^ cfb->ks[(cfb->blk_used + i)]);
+		cfb->cb[(cfb->blk_used + i)] = c;
+	}
+	cfb->blk_used += count;
+	if (GOST28147_BLK_SIZE == cfb->blk_used) {
+		gost28147_cfb_reg_push(cfb, cfb->cb, 1);
+		cfb->blk_used = 0;
+	}
+
+	return (count);
+}
+
+/* src and dst may be the same buf.
+ * Blocks chained by m / n: up to 4 blocks per engine call. */
+static inline void
+gost28147_cfb_encrypt(gost28147_context_p ctx, gost28147_cfb_p cfb,
+    const uint8_t *src, size_t size, uint8_t *dst) {
+	size_t i, count;
+	uint32_t n1[4], n2[4];
+
+	while (0 != size) {
+		if (0 != cfb->blk_used || GOST28147_BLK_SIZE > size) {
+			count = gost28147_cfb_partial(ctx, cfb, 1, src, size, dst);
+			src += count;
+			dst += count;
+			size -= count;
+			continue;
+		}
+		/* Next blocks depend only on R. */
+		count = MIN((size / GOST28147_BLK_SIZE),
+		    (cfb->reg_size / GOST28147_BLK_SIZE));
+		for (i = 0; i < count; i ++) {
+			gost28147_blk_load_be((cfb->reg + (i * GOST28147_BLK_SIZE)),
+			    &n1[i], &n2[i]);
+		}
+		gost28147_nblocks_encrypt(ctx, n1, n2, count);
+		for (i = 0; i < count; i ++) {
+			gost28147_blk_xor_be((src + (i * GOST28147_BLK_SIZE)),
+			    n1[i], n2[i], (dst + (i * GOST28147_BLK_SIZE)));
+		}
+		gost28147_cfb_reg_push(cfb, dst, count);
+		count *= GOST28147_BLK_SIZE;
+		src += count;
+		dst += count;
+		size -= count;
+	}
+}
+
+/* src and dst may be the same buf.
+ * All gamma blocks known from cipher text: bulk engine calls. */
+static inline void
+gost28147_cfb_decrypt(gost28147_context_p ctx, gost28147_cfb_p cfb,
+    const uint8_t *src, size_t size, uint8_t *dst) {
+	size_t i, count, reg_blks;
+	uint32_t n1[GOST28147_MODE_BULK_BLOCKS], n2[GOST28147_MODE_BULK_BLOCKS];
+
+	reg_blks = (cfb->reg_size / GOST28147_BLK_SIZE);
+	while (0 != size) {
+		if (0 != cfb->blk_used || GOST28147_BLK_SIZE > size) {
+			count = gost28147_cfb_partial(ctx, cfb, 0, src, size, dst);
+			src += count;
+			dst += count;
+			size -= count;
+			continue;
+		}
+		count = MIN((size / GOST28147_BLK_SIZE), GOST28147_MODE_BULK_BLOCKS);
+		/* Block i gamma from cipher text block i - m / n. */
+		for (i = 0; i < count; i ++) {
+			gost28147_blk_load_be(((i < reg_blks) ?
+			    (cfb->reg + (i * GOST28147_BLK_SIZE)) :
+			    (src + ((i - reg_blks) * GOST28147_BLK_SIZE))),
+			    &n1[i], &n2[i]);
+		}
+		/* Before dst overwrite src. */
+		gost28147_cfb_reg_push(cfb, src, count);
+		gost28147_nblocks_encrypt(ctx, n1, n2, count);
+		for (i = 0; i < count; i ++) {
+			gost28147_blk_xor_be(src, n1[i], n2[i], dst);
+			src += GOST28147_BLK_SIZE;
+			dst += GOST28147_BLK_SIZE;
+		}
+		size -= (count * GOST28147_BLK_SIZE);
+	}
+}
+
+
 
 
 #ifdef GOST28147_SELF_TEST
@@ -1012,6 +1456,29 @@ gost28147_cvt_hex(uint8_t *bin, size_t bin_size, uint8_t *hex) {
 	(*hex) = 0;
 }
 
+/* ГОСТ Р 34.13-2015: A.2 modes, key and plain text as for A.2.4 */
+typedef struct gost28147_test3_vectors_s {
+	uint8_t	*iv;
+	size_t	iv_size;
+	uint8_t	*encrypted;
+} gost28147_tst3v_t, *gost28147_tst3v_p;
+
+static uint8_t *gost28147_tst3v_key = (uint8_t*)"ffeeddccbbaa99887766554433221100f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+static uint8_t *gost28147_tst3v_plain = (uint8_t*)"92def06b3c130a59db54c704f8189d204a98fb2e67a8024c8912409b17b57e41";
+
+static gost28147_tst3v_t gost28147_tst3v[] = {
+	{ /* 0. A.2.2 CTR. */
+		/*.iv =*/		(uint8_t*)"12345678",
+		/*.iv_size =*/		8,
+		/*.encrypted =*/	(uint8_t*)"4e98110c97b7b93c3e250d93d6e85d69136d868807b2dbef568eb680ab52a12d",
+	}, { /* 1. A.2.5 CFB, m = 2n. */
+		/*.iv =*/		(uint8_t*)"1234567890abcdef234567890abcdef1",
+		/*.iv_size =*/		32,
+		/*.encrypted =*/	(uint8_t*)"db37e0e266903c830d46644c1f9a089c24bdd2035315d38bbcc0321421075505",
+	}
+};
+
+
 /* Import from little-endian hex string (L->H). */
 static inline int
 gost28147_import_le_hex(uint8_t *a, size_t count, uint8_t *buf, size_t buf_size) {
@@ -1058,7 +1525,8 @@ gost28147_import_le_hex(uint8_t *a, size_t count, uint8_t *buf, size_t buf_size)
 static inline int
 gost28147_self_test(void) {
 	int error = 0;
-	size_t i, tm;
+	size_t i, tm, impl, off, part;
+	uint32_t a, b, n1[40], n2[40];
 	gost28147_tst1v_t tst1v;
 	gost28147_tst2v_t tst2v;
 	uint8_t	key[GOST28147_KEY_SIZE+1];
@@ -1068,6 +1536,8 @@ gost28147_self_test(void) {
 	uint8_t	tmpbuf[GOST28147_TEST_LEN];
 	uint8_t	tmpbuf2[GOST28147_TEST_LEN];
 	gost28147_context_t ctx;
+	gost28147_ctr_t ctr;
+	gost28147_cfb_t cfb;
 
 	/* Test 0: gost28147_block32 / funcG() */
 	for (i = 0; NULL != gost28147_tstgv[i].sbox; i ++) {
@@ -1345,6 +1815,113 @@ gost28147_self_test(void) {
 		}
 	}
 
+	/* Test 3: CTR / CFB modes, split calls and all engines. */
+	gost28147_import_le_hex(key, sizeof(key), gost28147_tst3v_key, 64);
+	gost28147_import_le_hex(plain, sizeof(plain), gost28147_tst3v_plain, 64);
+	for (impl = GOST28147_IMPL_GENERIC; impl <= GOST28147_IMPL_AVX2; impl ++) {
+		if (0 == gost28147_impl_is_supported(impl))
+			continue;
+		gost28147_init_be(key, GOST28147_KEY_SIZE,
+		    id_tc26_gost_28147_param_z_sbox, &ctx);
+		gost28147_impl_set(&ctx, impl);
+		for (i = 0; i < nitems(gost28147_tst3v); i ++) {
+			gost28147_import_le_hex(tmpbuf2, sizeof(tmpbuf2),
+			    gost28147_tst3v[i].iv, gost28147_tst3v[i].iv_size);
+			gost28147_import_le_hex(encrypted, sizeof(encrypted),
+			    gost28147_tst3v[i].encrypted, 64);
+			/* Whole, byte by byte and odd parts. */
+			for (tm = 1; tm <= 33; tm += 16) {
+				memset(result, 0x00, 32);
+				if (0 == i) {
+					gost28147_ctr_init(&ctr, tmpbuf2);
+				} else {
+					gost28147_cfb_init(&cfb, tmpbuf2,
+					    (gost28147_tst3v[i].iv_size / 2));
+				}
+				for (off = 0; off < 32; off += part) {
+					part = MIN((32 - off), tm);
+					if (0 == i) {
+						gost28147_ctr_crypt(&ctx, &ctr,
+						    (plain + off), part, (result + off));
+					} else {
+						gost28147_cfb_encrypt(&ctx, &cfb,
+						    (plain + off), part, (result + off));
+					}
+				}
+				if (0 != memcmp(encrypted, result, 32)) {
+					gost28147_cvt_hex(result, 32, tmpbuf);
+					gost28147_print("test 3: encrypt error: impl %zu, %zu, part %zu: %s - %s\n",
+					    impl, i, tm, gost28147_tst3v[i].encrypted, tmpbuf);
+					error ++;
+				}
+				/* In place decrypt. */
+				if (0 == i) {
+					gost28147_ctr_init(&ctr, tmpbuf2);
+				} else {
+					gost28147_cfb_init(&cfb, tmpbuf2,
+					    (gost28147_tst3v[i].iv_size / 2));
+				}
+				for (off = 0; off < 32; off += part) {
+					part = MIN((32 - off), tm);
+					if (0 == i) {
+						gost28147_ctr_crypt(&ctx, &ctr,
+						    (result + off), part, (result + off));
+					} else {
+						gost28147_cfb_decrypt(&ctx, &cfb,
+						    (result + off), part, (result + off));
+					}
+				}
+				if (0 != memcmp(plain, result, 32)) {
+					gost28147_cvt_hex(result, 32, tmpbuf);
+					gost28147_print("test 3: decrypt error: impl %zu, %zu, part %zu: %s - %s\n",
+					    impl, i, tm, gost28147_tst3v_plain, tmpbuf);
+					error ++;
+				}
+			}
+		}
+
+		/* Multi-block engine vs single block. */
+		for (i = 0; i < nitems(n1); i ++) {
+			n1[i] = (uint32_t)(0x9e3779b9 * (i + 1));
+			n2[i] = (uint32_t)(0x7f4a7c15 * (i + 3));
+		}
+		for (tm = 1; tm <= nitems(n1); tm += 7) {
+			memcpy(tmpbuf, n1, sizeof(n1));
+			memcpy(tmpbuf2, n2, sizeof(n2));
+			gost28147_nblocks_encrypt(&ctx, (uint32_t*)(void*)tmpbuf,
+			    (uint32_t*)(void*)tmpbuf2, tm);
+			for (off = 0; off < tm; off ++) {
+				gost28147_block_encrypt(&ctx, n1[off], n2[off],
+				    &a, &b);
+				if (a == ((uint32_t*)(void*)tmpbuf)[off] &&
+				    b == ((uint32_t*)(void*)tmpbuf2)[off])
+					continue;
+				gost28147_print("test 3: nblocks error: impl %zu, count %zu, block %zu\n",
+				    impl, tm, off);
+				error ++;
+				break;
+			}
+		}
+	}
+
+	/* Test 4: unaligned buffers. */
+	gost28147_init_be(key, GOST28147_KEY_SIZE,
+	    id_tc26_gost_28147_param_z_sbox, &ctx);
+	gost28147_blocks_encrypt_be(&ctx, (plain + 1), 4, (tmpbuf + 1));
+	gost28147_blocks_decrypt_be(&ctx, (tmpbuf + 1), 4, (result + 3));
+	if (0 != memcmp((plain + 1), (result + 3), 32)) {
+		gost28147_print("test 4: unaligned decrypt_be error\n");
+		error ++;
+	}
+	gost28147_init(key, GOST28147_KEY_SIZE,
+	    id_tc26_gost_28147_param_z_sbox, &ctx);
+	gost28147_blocks_encrypt(&ctx, (plain + 1), 4, (tmpbuf + 1));
+	gost28147_blocks_decrypt(&ctx, (tmpbuf + 1), 4, (result + 3));
+	if (0 != memcmp((plain + 1), (result + 3), 32)) {
+		gost28147_print("test 4: unaligned decrypt error\n");
+		error ++;
+	}
+
 	return (error);
 }
 #endif
@@ -0,0 +1,583 @@
+/*-
+ * Copyright (c) 2015 - 2020 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ * Poly1305 one-time authenticator, RFC 8439.
+ *
+ * 64 bit platforms: 3 x 44 bit limbs with 128 bit products,
+ * others: 5 x 26 bit limbs (poly1305-donna).
+ *
+ */
+
+#ifndef __POLY1305_H__
+#define __POLY1305_H__
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <string.h> /* memcpy, memmove, memset... */
+#include <inttypes.h>
+#include <errno.h>
+
+#if defined(__SIZEOF_INT128__)
+#	define POLY1305_INT128	1
+#endif
+
+static void *(*volatile poly1305_memset_volatile)(void*, int, size_t) = memset;
+#define poly1305_bzero(__mem, __size)	poly1305_memset_volatile((__mem), 0x00, (__size))
+
+
+#define POLY1305_KEY_LEN	32 /* r + s. Must be used only once. */
+#define POLY1305_TAG_LEN	16
+#define POLY1305_BLOCK_LEN	16
+
+
+typedef struct poly1305_ctx_s {
+#ifdef POLY1305_INT128
+	uint64_t	r[3];
+	uint64_t	h[3];
+	uint64_t	pad[2];
+#else
+	uint32_t	r[5];
+	uint32_t	h[5];
+	uint32_t	pad[4];
+#endif
+	size_t		buf_used;
+	uint8_t		buf[POLY1305_BLOCK_LEN];
+} poly1305_ctx_t, *poly1305_ctx_p;
+
+
+static inline uint32_t
+poly1305_le32_get(const uint8_t *p) {
+
+	return ((((uint32_t)p[0])      ) |
+	    (((uint32_t)p[1]) <<  8) |
+	    (((uint32_t)p[2]) << 16) |
+	    (((uint32_t)p[3]) << 24));
+}
+
+static inline void
+poly1305_le32_set(uint8_t *p, const uint32_t v) {
+
+	p[0] = (uint8_t)(v      );
+	p[1] = (uint8_t)(v >>  8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+#ifdef POLY1305_INT128
+static inline uint64_t
+poly1305_le64_get(const uint8_t *p) {
+
+	return (((uint64_t)poly1305_le32_get(p)) |
+	    (((uint64_t)poly1305_le32_get((p + 4))) << 32));
+}
+
+static inline void
+poly1305_le64_set(uint8_t *p, const uint64_t v) {
+
+	poly1305_le32_set(p, (uint32_t)v);
+	poly1305_le32_set((p + 4), (uint32_t)(v >> 32));
+}
+
+#define POLY1305_M44	((uint64_t)0xfffffffffff)
+#define POLY1305_M42	((uint64_t)0x3ffffffffff)
+
+static inline void
+poly1305_init(poly1305_ctx_p ctx, const uint8_t *key) {
+	uint64_t t0, t1;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	t0 = poly1305_le64_get((key + 0));
+	t1 = poly1305_le64_get((key + 8));
+	ctx->r[0] = (t0 & 0xffc0fffffff);
+	ctx->r[1] = (((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff);
+	ctx->r[2] = ((t1 >> 24) & 0x00ffffffc0f);
+	ctx->h[0] = 0;
+	ctx->h[1] = 0;
+	ctx->h[2] = 0;
+	ctx->pad[0] = poly1305_le64_get((key + 16));
+	ctx->pad[1] = poly1305_le64_get((key + 24));
+	ctx->buf_used = 0;
+}
+
+/* h = (h + m) * r mod 2^130 - 5, final - last partial block, already padded. */
+static inline void
+poly1305_blocks(poly1305_ctx_p ctx, const uint8_t *m, size_t size,
+    const int final) {
+	const uint64_t hibit = ((0 != final) ? 0 : (((uint64_t)1) << 40));
+	uint64_t r0, r1, r2, s1, s2, h0, h1, h2, c, t0, t1;
+	unsigned __int128 d0, d1, d2, d;
+
+	r0 = ctx->r[0];
+	r1 = ctx->r[1];
+	r2 = ctx->r[2];
+	h0 = ctx->h[0];
+	h1 = ctx->h[1];
+	h2 = ctx->h[2];
+	s1 = (r1 * (5 << 2));
+	s2 = (r2 * (5 << 2));
+
+	for (; POLY1305_BLOCK_LEN <= size; size -= POLY1305_BLOCK_LEN) {
+		t0 = poly1305_le64_get((m + 0));
+		t1 = poly1305_le64_get((m + 8));
+		m += POLY1305_BLOCK_LEN;
+		/* h += m[i] */
+		h0 += (t0 & POLY1305_M44);
+		h1 += (((t0 >> 44) | (t1 << 20)) & POLY1305_M44);
+		h2 += (((t1 >> 24) & POLY1305_M42) | hibit);
+		/* h *= r */
+		d0 = ((unsigned __int128)h0 * r0);
+		d = ((unsigned __int128)h1 * s2);
+		d0 += d;
+		d = ((unsigned __int128)h2 * s1);
+		d0 += d;
+		d1 = ((unsigned __int128)h0 * r1);
+		d = ((unsigned __int128)h1 * r0);
+		d1 += d;
+		d = ((unsigned __int128)h2 * s2);
+		d1 += d;
+		d2 = ((unsigned __int128)h0 * r2);
+		d = ((unsigned __int128)h1 * r1);
+		d2 += d;
+		d = ((unsigned __int128)h2 * r0);
+		d2 += d;
+		/* (partial) h %= p */
+		c = (uint64_t)(d0 >> 44);
+		h0 = ((uint64_t)d0 & POLY1305_M44);
+		d1 += c;
+		c = (uint64_t)(d1 >> 44);
+		h1 = ((uint64_t)d1 & POLY1305_M44);
+		d2 += c;
+		c = (uint64_t)(d2 >> 42);
+		h2 = ((uint64_t)d2 & POLY1305_M42);
+		h0 += (c * 5);
+		c = (h0 >> 44);
+		h0 &= POLY1305_M44;
+		h1 += c;
+	}
+
+	ctx->h[0] = h0;
+	ctx->h[1] = h1;
+	ctx->h[2] = h2;
+}
+
+/* tag = (h mod p + s) mod 2^128 */
+static inline void
+poly1305_finish(poly1305_ctx_p ctx, uint8_t *tag) {
+	uint64_t h0, h1, h2, g0, g1, g2, c, t0, t1;
+
+	h0 = ctx->h[0];
+	h1 = ctx->h[1];
+	h2 = ctx->h[2];
+	/* Fully carry h. */
+	c = (h1 >> 44);
+	h1 &= POLY1305_M44;
+	h2 += c;
+	c = (h2 >> 42);
+	h2 &= POLY1305_M42;
+	h0 += (c * 5);
+	c = (h0 >> 44);
+	h0 &= POLY1305_M44;
+	h1 += c;
+	c = (h1 >> 44);
+	h1 &= POLY1305_M44;
+	h2 += c;
+	c = (h2 >> 42);
+	h2 &= POLY1305_M42;
+	h0 += (c * 5);
+	c = (h0 >> 44);
+	h0 &= POLY1305_M44;
+	h1 += c;
+	/* g = h + -p */
+	g0 = (h0 + 5);
+	c = (g0 >> 44);
+	g0 &= POLY1305_M44;
+	g1 = (h1 + c);
+	c = (g1 >> 44);
+	g1 &= POLY1305_M44;
+	g2 = ((h2 + c) - (((uint64_t)1) << 42));
+	/* Select h if h < p, or h + -p if h >= p, constant time. */
+	c = ((g2 >> 63) - 1);
+	g0 &= c;
+	g1 &= c;
+	g2 &= c;
+	c = ~c;
+	h0 = ((h0 & c) | g0);
+	h1 = ((h1 & c) | g1);
+	h2 = ((h2 & c) | g2);
+	/* h += s */
+	t0 = ctx->pad[0];
+	t1 = ctx->pad[1];
+	h0 += (t0 & POLY1305_M44);
+	c = (h0 >> 44);
+	h0 &= POLY1305_M44;
+	h1 += ((((t0 >> 44) | (t1 << 20)) & POLY1305_M44) + c);
+	c = (h1 >> 44);
+	h1 &= POLY1305_M44;
+	h2 += (((t1 >> 24) & POLY1305_M42) + c);
+	h2 &= POLY1305_M42;
+	/* tag = h % 2^128 */
+	poly1305_le64_set((tag + 0), (h0 | (h1 << 44)));
+	poly1305_le64_set((tag + 8), ((h1 >> 20) | (h2 << 24)));
+}
+
+#else /* 32 bit */
+
+#define POLY1305_M26	((uint32_t)0x3ffffff)
+
+static inline void
+poly1305_init(poly1305_ctx_p ctx, const uint8_t *key) {
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	ctx->r[0] = ((poly1305_le32_get((key +  0))     ) & 0x3ffffff);
+	ctx->r[1] = ((poly1305_le32_get((key +  3)) >> 2) & 0x3ffff03);
+	ctx->r[2] = ((poly1305_le32_get((key +  6)) >> 4) & 0x3ffc0ff);
+	ctx->r[3] = ((poly1305_le32_get((key +  9)) >> 6) & 0x3f03fff);
+	ctx->r[4] = ((poly1305_le32_get((key + 12)) >> 8) & 0x00fffff);
+	ctx->h[0] = 0;
+	ctx->h[1] = 0;
+	ctx->h[2] = 0;
+	ctx->h[3] = 0;
+	ctx->h[4] = 0;
+	ctx->pad[0] = poly1305_le32_get((key + 16));
+	ctx->pad[1] = poly1305_le32_get((key + 20));
+	ctx->pad[2] = poly1305_le32_get((key + 24));
+	ctx->pad[3] = poly1305_le32_get((key + 28));
+	ctx->buf_used = 0;
+}
+
+/* h = (h + m) * r mod 2^130 - 5, final - last partial block, already padded. */
+static inline void
+poly1305_blocks(poly1305_ctx_p ctx, const uint8_t *m, size_t size,
+    const int final) {
+	const uint32_t hibit = ((0 != final) ? 0 : (((uint32_t)1) << 24));
+	uint32_t r0, r1, r2, r3, r4, s1, s2, s3, s4, h0, h1, h2, h3, h4, c;
+	uint64_t d0, d1, d2, d3, d4;
+
+	r0 = ctx->r[0];
+	r1 = ctx->r[1];
+	r2 = ctx->r[2];
+	r3 = ctx->r[3];
+	r4 = ctx->r[4];
+	s1 = (r1 * 5);
+	s2 = (r2 * 5);
+	s3 = (r3 * 5);
+	s4 = (r4 * 5);
+	h0 = ctx->h[0];
+	h1 = ctx->h[1];
+	h2 = ctx->h[2];
+	h3 = ctx->h[3];
+	h4 = ctx->h[4];
+
+	for (; POLY1305_BLOCK_LEN <= size; size -= POLY1305_BLOCK_LEN) {
+		/* h += m[i] */
+		h0 += ((poly1305_le32_get((m +  0))     ) & POLY1305_M26);
+		h1 += ((poly1305_le32_get((m +  3)) >> 2) & POLY1305_M26);
+		h2 += ((poly1305_le32_get((m +  6)) >> 4) & POLY1305_M26);
+		h3 += ((poly1305_le32_get((m +  9)) >> 6) & POLY1305_M26);
+		h4 += ((poly1305_le32_get((m + 12)) >> 8) | hibit);
+		m += POLY1305_BLOCK_LEN;
+		/* h *= r */
+		d0 = (((uint64_t)h0 * r0) + ((uint64_t)h1 * s4) +
+		    ((uint64_t)h2 * s3) + ((uint64_t)h3 * s2) +
+		    ((uint64_t)h4 * s1));
+		d1 = (((uint64_t)h0 * r1) + ((uint64_t)h1 * r0) +
+		    ((uint64_t)h2 * s4) + ((uint64_t)h3 * s3) +
+		    ((uint64_t)h4 * s2));
+		d2 = (((uint64_t)h0 * r2) + ((uint64_t)h1 * r1) +
+		    ((uint64_t)h2 * r0) + ((uint64_t)h3 * s4) +
+		    ((uint64_t)h4 * s3));
+		d3 = (((uint64_t)h0 * r3) + ((uint64_t)h1 * r2) +
+		    ((uint64_t)h2 * r1) + ((uint64_t)h3 * r0) +
+		    ((uint64_t)h4 * s4));
+		d4 = (((uint64_t)h0 * r4) + ((uint64_t)h1 * r3) +
+		    ((uint64_t)h2 * r2) + ((uint64_t)h3 * r1) +
+		    ((uint64_t)h4 * r0));
+		/* (partial) h %= p */
+		c = (uint32_t)(d0 >> 26);
+		h0 = ((uint32_t)d0 & POLY1305_M26);
+		d1 += c;
+		c = (uint32_t)(d1 >> 26);
+		h1 = ((uint32_t)d1 & POLY1305_M26);
+		d2 += c;
+		c = (uint32_t)(d2 >> 26);
+		h2 = ((uint32_t)d2 & POLY1305_M26);
+		d3 += c;
+		c = (uint32_t)(d3 >> 26);
+		h3 = ((uint32_t)d3 & POLY1305_M26);
+		d4 += c;
+		c = (uint32_t)(d4 >> 26);
+		h4 = ((uint32_t)d4 & POLY1305_M26);
+		h0 += (c * 5);
+		c = (h0 >> 26);
+		h0 &= POLY1305_M26;
+		h1 += c;
+	}
+
+	ctx->h[0] = h0;
+	ctx->h[1] = h1;
+	ctx->h[2] = h2;
+	ctx->h[3] = h3;
+	ctx->h[4] = h4;
+}
+
+/* tag = (h mod p + s) mod 2^128 */
+static inline void
+poly1305_finish(poly1305_ctx_p ctx, uint8_t *tag) {
+	uint32_t h0, h1, h2, h3, h4, g0, g1, g2, g3, g4, c;
+	uint64_t f;
+
+	h0 = ctx->h[0];
+	h1 = ctx->h[1];
+	h2 = ctx->h[2];
+	h3 = ctx->h[3];
+	h4 = ctx->h[4];
+	/* Fully carry h. */
+	c = (h1 >> 26);
+	h1 &= POLY1305_M26;
+	h2 += c;
+	c = (h2 >> 26);
+	h2 &= POLY1305_M26;
+	h3 += c;
+	c = (h3 >> 26);
+	h3 &= POLY1305_M26;
+	h4 += c;
+	c = (h4 >> 26);
+	h4 &= POLY1305_M26;
+	h0 += (c * 5);
+	c = (h0 >> 26);
+	h0 &= POLY1305_M26;
+	h1 += c;
+	/* g = h + -p */
+	g0 = (h0 + 5);
+	c = (g0 >> 26);
+	g0 &= POLY1305_M26;
+	g1 = (h1 + c);
+	c = (g1 >> 26);
+	g1 &= POLY1305_M26;
+	g2 = (h2 + c);
+	c = (g2 >> 26);
+	g2 &= POLY1305_M26;
+	g3 = (h3 + c);
+	c = (g3 >> 26);
+	g3 &= POLY1305_M26;
+	g4 = ((h4 + c) - (((uint32_t)1) << 26));
+	/* Select h if h < p, or h + -p if h >= p, constant time. */
+	c = ((g4 >> 31) - 1);
+	g0 &= c;
+	g1 &= c;
+	g2 &= c;
+	g3 &= c;
+	g4 &= c;
+	c = ~c;
+	h0 = ((h0 & c) | g0);
+	h1 = ((h1 & c) | g1);
+	h2 = ((h2 & c) | g2);
+	h3 = ((h3 & c) | g3);
+	h4 = ((h4 & c) | g4);
+	/* h = h % 2^128 */
+	h0 = ((h0      ) | (h1 << 26));
+	h1 = ((h1 >>  6) | (h2 << 20));
+	h2 = ((h2 >> 12) | (h3 << 14));
+	h3 = ((h3 >> 18) | (h4 <<  8));
+	/* tag = (h + s) % 2^128 */
+	f = ((uint64_t)h0 + ctx->pad[0]);
+	poly1305_le32_set((tag +  0), (uint32_t)f);
+	f = ((uint64_t)h1 + ctx->pad[1] + (f >> 32));
+	poly1305_le32_set((tag +  4), (uint32_t)f);
+	f = ((uint64_t)h2 + ctx->pad[2] + (f >> 32));
+	poly1305_le32_set((tag +  8), (uint32_t)f);
+	f = ((uint64_t)h3 + ctx->pad[3] + (f >> 32));
+	poly1305_le32_set((tag + 12), (uint32_t)f);
+}
+#endif /* POLY1305_INT128 */
+
+
+static inline void
+poly1305_update(poly1305_ctx_p ctx, const uint8_t *data, size_t data_size) {
+	size_t count;
+
+	if (0 == data_size)
+		return;
+	if (0 != ctx->buf_used) { /* Have saved data. */
+		count = MIN((POLY1305_BLOCK_LEN - ctx->buf_used), data_size);
+		memcpy((ctx->buf + ctx->buf_used), data, count);
+		ctx->buf_used += count;
+		data += count;
+		data_size -= count;
+		if (POLY1305_BLOCK_LEN > ctx->buf_used)
+			return;
+		poly1305_blocks(ctx, ctx->buf, POLY1305_BLOCK_LEN, 0);
+		ctx->buf_used = 0;
+	}
+	if (POLY1305_BLOCK_LEN <= data_size) {
+		count = (data_size & ~((size_t)(POLY1305_BLOCK_LEN - 1)));
+		poly1305_blocks(ctx, data, count, 0);
+		data += count;
+		data_size -= count;
+	}
+	if (0 != data_size) { /* Save tail. */
+		memcpy(ctx->buf, data, data_size);
+		ctx->buf_used = data_size;
+	}
+}
+
+static inline void
+poly1305_final(poly1305_ctx_p ctx, uint8_t *tag) {
+
+	if (0 != ctx->buf_used) { /* Last block: 1 and zeroes after data. */
+		ctx->buf[ctx->buf_used] = 1;
+		memset((ctx->buf + ctx->buf_used + 1), 0x00,
+		    (POLY1305_BLOCK_LEN - ctx->buf_used - 1));
+		poly1305_blocks(ctx, ctx->buf, POLY1305_BLOCK_LEN, 1);
+	}
+	poly1305_finish(ctx, tag);
+	poly1305_bzero(ctx, sizeof(poly1305_ctx_t));
+}
+
+/* One shot poly1305. */
+static inline void
+poly1305(const uint8_t *key, const uint8_t *data, const size_t data_size,
+    uint8_t *tag) {
+	poly1305_ctx_t ctx;
+
+	poly1305_init(&ctx, key);
+	poly1305_update(&ctx, data, data_size);
+	poly1305_final(&ctx, tag);
+}
+
+/* Constant time tags compare: 0 - equal. */
+static inline int
+poly1305_tag_cmp(const uint8_t *tag1, const uint8_t *tag2) {
+	size_t i;
+	uint32_t diff = 0;
+
+	for (i = 0; i < POLY1305_TAG_LEN; i ++) {
+		diff |= (uint32_t)(tag1[i] ^ tag2[i]);
+	}
+
+	return ((int)((diff + 0xff) >> 8));
+}
+
+
+#ifdef POLY1305_SELF_TEST
+
+typedef struct poly1305_test_vectors_s {
+	uint8_t		key[POLY1305_KEY_LEN];
+	const char	*data;
+	size_t		data_size;
+	uint8_t		tag[POLY1305_TAG_LEN];
+} poly1305_tv_t, *poly1305_tv_p;
+
+static const poly1305_tv_t poly1305_tv[] = {
+	{ /* RFC 8439 2.5.2. */
+		.key = {
+			0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+			0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+			0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+			0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+		},
+		.data = "Cryptographic Forum Research Group",
+		.data_size = 34,
+		.tag = {
+			0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+			0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+		}
+	}, { /* RFC 8439 A.3 #1. */
+		.key = { 0 },
+		.data = "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+		    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+		    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+		    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+		.data_size = 64,
+		.tag = { 0 }
+	}, { /* RFC 8439 A.3 #5: h overflows p. */
+		.key = { 0x02 },
+		.data = "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff",
+		.data_size = 16,
+		.tag = { 0x03 }
+	}, { /* RFC 8439 A.3 #6: h + s overflows 2^128. */
+		.key = {
+			0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+			0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+		},
+		.data = "\x02\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+		.data_size = 16,
+		.tag = { 0x03 }
+	}, { /* RFC 8439 A.3 #7: carry propagation. */
+		.key = { 0x01 },
+		.data = "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff"
+		    "\xf0\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff"
+		    "\x11\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+		.data_size = 48,
+		.tag = { 0x05 }
+	}, { /* RFC 8439 A.3 #8: h mod p = 0. */
+		.key = { 0x01 },
+		.data = "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff"
+		    "\xfb\xfe\xfe\xfe\xfe\xfe\xfe\xfe\xfe\xfe\xfe\xfe\xfe\xfe\xfe\xfe"
+		    "\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01\x01",
+		.data_size = 48,
+		.tag = { 0 }
+	}
+};
+
+/* 0 - OK, non zero - error */
+static inline int
+poly1305_self_test(void) {
+	int error = 0;
+	size_t i, j;
+	uint8_t tag[POLY1305_TAG_LEN];
+	poly1305_ctx_t ctx;
+
+	for (i = 0; i < (sizeof(poly1305_tv) / sizeof(poly1305_tv[0])); i ++) {
+		poly1305(poly1305_tv[i].key, (const uint8_t*)poly1305_tv[i].data,
+		    poly1305_tv[i].data_size, tag);
+		if (0 != poly1305_tag_cmp(poly1305_tv[i].tag, tag)) {
+			error ++;
+		}
+		/* By bytes. */
+		poly1305_init(&ctx, poly1305_tv[i].key);
+		for (j = 0; j < poly1305_tv[i].data_size; j ++) {
+			poly1305_update(&ctx,
+			    (const uint8_t*)&poly1305_tv[i].data[j], 1);
+		}
+		poly1305_final(&ctx, tag);
+		if (0 != memcmp(poly1305_tv[i].tag, tag, POLY1305_TAG_LEN)) {
+			error ++;
+		}
+	}
+	tag[0] ^= 0x80;
+	if (0 == poly1305_tag_cmp(poly1305_tv[(i - 1)].tag, tag)) {
+		error ++;
+	}
+
+	return (error);
+}
+#endif
+
+#endif /* __POLY1305_H__ */
@@ -91,6 +91,7 @@ typedef struct elliptic_curve_curve_str_s {
 			/* order n of the base point G. */
 	uint32_t	algo;	/* ECDSA, GOST */
 	uint32_t	flags;	/* EC_CURVE_FLAG_* */
+	uint32_t	pf;	/* EC_CURVE_PF_*: specialized field arithmetic. */
 } ec_curve_str_t, *ec_curve_str_p;
 
 static ec_curve_str_t ec_curve_str[] = {
@@ -115,6 +116,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp112r2",
 		/*.name_size =*/9,
@@ -135,6 +137,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	4,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp128r1",
 		/*.name_size =*/9,
@@ -155,6 +158,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp128r2",
 		/*.name_size =*/9,
@@ -175,6 +179,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	4,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp160k1",
 		/*.name_size =*/9,
@@ -195,6 +200,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp160r1",
 		/*.name_size =*/9,
@@ -215,6 +221,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp160r2",
 		/*.name_size =*/9,
@@ -235,6 +242,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"brainpoolP160r1",
 		/*.name_size =*/15,
@@ -255,6 +263,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp192k1",
 		/*.name_size =*/9,
@@ -275,6 +284,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp192r1",
 		/*.name_size =*/9,
@@ -295,6 +305,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"brainpoolP192r1",
 		/*.name_size =*/15,
@@ -315,6 +326,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp224k1",
 		/*.name_size =*/9,
@@ -335,6 +347,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp224r1",
 		/*.name_size =*/9,
@@ -355,6 +368,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"brainpoolP224r1",
 		/*.name_size =*/15,
@@ -375,6 +389,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp256k1",
 		/*.name_size =*/9,
@@ -395,6 +410,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_SECP256K1,
 	}, {
 		/*.name =*/	"secp256r1",
 		/*.name_size =*/9,
@@ -415,6 +431,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_P256,
 	}, {
 		/*.name =*/	"brainpoolP256r1",
 		/*.name_size =*/15,
@@ -435,6 +452,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"id-GostR3410-2001-ParamSet-cc",
 		/*.name_size =*/29,
@@ -455,6 +473,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"id-gostR3410-2001-Test_ParamSet",
 		/*.name_size =*/30,
@@ -475,6 +494,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"id-gostR3410-2001-CryptoPro-A-ParamSet",
 		/*.name_size =*/38,
@@ -495,6 +515,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"id-gostR3410-2001-CryptoPro-B-ParamSet",
 		/*.name_size =*/38,
@@ -515,6 +536,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"id-gostR3410-2001-CryptoPro-C-ParamSet",
 		/*.name_size =*/38,
@@ -535,6 +557,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"id-gostR3410-2001-CryptoPro-XchA-ParamSet",
 		/*.name_size =*/41,
@@ -555,6 +578,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"id-gostR3410-2001-CryptoPro-XchB-ParamSet",
 		/*.name_size =*/41,
@@ -575,6 +599,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"brainpoolP320r1",
 		/*.name_size =*/15,
@@ -595,6 +620,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp384r1",
 		/*.name_size =*/9,
@@ -615,6 +641,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_P384,
 	}, {
 		/*.name =*/	"brainpoolP384r1",
 		/*.name_size =*/15,
@@ -635,6 +662,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"brainpoolP512r1",
 		/*.name_size =*/15,
@@ -655,6 +683,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, { /* GOST R 34.10-2012 - 512 */
 		/*.name =*/	"id-tc26-gost-3410-12-512-paramSetA",
 		/*.name_size =*/34,
@@ -675,6 +704,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, { /* GOST R 34.10-2012 - 512 */
 		/*.name =*/	"id-tc26-gost-3410-12-512-paramSetB",
 		/*.name_size =*/34,
@@ -695,6 +725,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, { /* GOST R 34.10-2012 (512 bit) testing parameter set */
 		/*.name =*/	"id-tc26-gost-3410-2012-512-paramSetTest",
 		/*.name_size =*/39,
@@ -715,6 +746,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_GOST20XX,
 		/*.flags =*/	0,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}, {
 		/*.name =*/	"secp521r1",
 		/*.name_size =*/9,
@@ -735,6 +767,7 @@ static ec_curve_str_t ec_curve_str[] = {
 		/*.h =*/	1,
 		/*.algo =*/	EC_CURVE_ALGO_ECDSA,
 		/*.flags =*/	EC_CURVE_FLAG_A_M3,
+		/*.pf =*/	EC_CURVE_PF_GENERIC,
 	}
 };
 
@@ -808,10 +841,16 @@ ecdsa_curve_from_str(ec_curve_str_p curve_str, ec_curve_p curve) {
 
 	BN_RET_ON_ERR(bn_mod_rd_data_init(&curve->p, &curve->p_mod_rd_data));
 	BN_RET_ON_ERR(bn_mod_rd_data_init(&curve->n, &curve->n_mod_rd_data));
+	BN_RET_ON_ERR(ec_curve_pf_init(curve, curve_str->pf));
 
 #if EC_PF_FXP_MULT_ALGO != EC_PF_FXP_MULT_ALGO_BIN
 	BN_RET_ON_ERR(ec_point_fpx_mult_precompute(EC_PF_FXP_MULT_WIN_BITS,
 	    &curve->G, curve, &curve->G_fpx_mult_data));
+#endif
+#ifdef EC_CONSTANT_TIME
+	BN_RET_ON_ERR(ec_point_proj_ct_mult_precompute_affine(&curve->G,
+	    EC_CT_MULT_BP_WIN_BITS, EC_CT_MULT_BP_TBL_CNT, curve,
+	    curve->G_ct_tbl));
 #endif
 	return (0);
 }
@@ -1087,9 +1126,10 @@ ecdsa_key_gen(ec_curve_p curve, bn_p d, ec_point_p Q) {
 		return (EINVAL);
 	/* Reduce random number. */
 	/*  d = (c mod (n − 1)) + 1 */
-	BN_RET_ON_ERR(bn_mod_reduce(d, &curve->n, &curve->n_mod_rd_data));
+	BN_RET_ON_ERR(bn_mod_reduce_ct(d, EC_CURVE_CALC_DIGITS(curve),
+	    &curve->n));
 	/* Q = dG */
-	ec_point_mult_bp(d, curve, Q);
+	BN_RET_ON_ERR(ec_point_ct_mult_bp(d, curve, Q));
 	BN_RET_ON_ERR(ec_point_check_as_pub_key(Q, curve));
 	return (0);
 }
@@ -1198,7 +1238,8 @@ ecdsa_sign(ec_curve_p curve, bn_p hash, bn_p priv_key, bn_p rnd,
 	if (NULL == curve || NULL == hash || NULL == priv_key ||
 	    NULL == rnd || NULL == sign_r || NULL == sign_s)
 		return (EINVAL);
-	if (bn_cmp(priv_key, &curve->n) >= 0) /* Key check. */
+	/* Key check. */
+	if (1 != bn_is_less_ct(priv_key, &curve->n, curve->n.digits))
 		return (EINVAL);
 
 	/* Double size + 1 digit. */
@@ -1208,11 +1249,13 @@ ecdsa_sign(ec_curve_p curve, bn_p hash, bn_p priv_key, bn_p rnd,
 	/* Reduce random number (k). */
 	/* k = (c mod (n − 1)) + 1 */
 	BN_RET_ON_ERR(bn_assign(sign_s, rnd));
-	BN_RET_ON_ERR(bn_mod_reduce(sign_s, &curve->n,
-	    &curve->n_mod_rd_data));
+	BN_RET_ON_ERR(bn_mod_reduce_ct(sign_s, EC_CURVE_CALC_DIGITS(curve),
+	    &curve->n));
 	/* R = rnd*G */
 	/* Slow operation. */
-	ec_point_mult_bp(sign_s, curve, &R);
+	BN_RET_ON_ERR(ec_point_ct_mult_bp(sign_s, curve, &R));
+	if (0 != R.infinity)
+		return (-1);
 	/* r = Rx mod n */
 	BN_RET_ON_ERR(bn_mod(&R.x, &curve->n, &curve->n_mod_rd_data));
 	if (0 != bn_is_zero(&R.x))
@@ -1227,26 +1270,24 @@ ecdsa_sign(ec_curve_p curve, bn_p hash, bn_p priv_key, bn_p rnd,
 
 	/* ECDSA: s = (rnd^−1 * (hash + priv_key * r)) mod n */
 	/* GOST: s = ((rnd * hash) + (priv_key * r))) mod n */
-	/* calc... */
+	/* calc... rnd and priv_key are secret: constant time ops. */
 	/* (priv_key * r) */
-	BN_RET_ON_ERR(bn_mod_mult(&R.x, priv_key, &curve->n,
-	    &curve->n_mod_rd_data));
+	BN_RET_ON_ERR(bn_mod_mult_mont(&R.x, priv_key, &curve->n,
+	    &curve->n_mod_rd_data.mont));
 	switch (curve->algo) {
 	case EC_CURVE_ALGO_ECDSA:
-		BN_RET_ON_ERR(bn_mod_add(&R.y, &R.x, &curve->n,
-		    &curve->n_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_inv(sign_s, &curve->n,
-		    &curve->n_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult(sign_s, &R.y, &curve->n,
+		BN_RET_ON_ERR(bn_mod_add_ct(&R.y, &R.x, &curve->n));
+		BN_RET_ON_ERR(bn_mod_inv_fermat(sign_s, &curve->n,
 		    &curve->n_mod_rd_data));
+		BN_RET_ON_ERR(bn_mod_mult_mont(sign_s, &R.y, &curve->n,
+		    &curve->n_mod_rd_data.mont));
 		break;
 	case EC_CURVE_ALGO_GOST20XX:
 		if (0 == bn_is_zero(&R.y)) { /* GOST step 2: if hash == 0 then hash = 1. */
-			BN_RET_ON_ERR(bn_mod_mult(sign_s, &R.y, &curve->n,
-			    &curve->n_mod_rd_data));
+			BN_RET_ON_ERR(bn_mod_mult_mont(sign_s, &R.y,
+			    &curve->n, &curve->n_mod_rd_data.mont));
 		}
-		BN_RET_ON_ERR(bn_mod_add(sign_s, &R.x, &curve->n,
-		    &curve->n_mod_rd_data));
+		BN_RET_ON_ERR(bn_mod_add_ct(sign_s, &R.x, &curve->n));
 		break;
 	default:
 		return (EINVAL);
@@ -1522,6 +1563,381 @@ ecdsa_verify_le(ec_curve_p curve,
 	return (0);
 }
 
+/* Batch verifying */
+/* Signatures verified in chunks of ECDSA_VERIFY_BATCH_SIZE: s^-1 mod n and
+ * R normalization cost one inversion per chunk, u1*G + u2*Q calculated by
+ * interleaving w-NAF with ECDSA_VERIFY_WIN_BITS tables.
+ * G table and pub key tables are kept in ecdsa_verify_cache_t, pub keys
+ * replaced in LRU order. */
+#ifndef ECDSA_VERIFY_BATCH_SIZE
+#	define ECDSA_VERIFY_BATCH_SIZE	EC_PROJ_NORM_BATCH_MAX
+#endif
+#ifndef ECDSA_VERIFY_WIN_BITS
+#	define ECDSA_VERIFY_WIN_BITS	5
+#endif
+#ifndef ECDSA_VERIFY_CACHE_SIZE
+#	define ECDSA_VERIFY_CACHE_SIZE	8
+#endif
+#if ECDSA_VERIFY_WIN_BITS > EC_PF_TWIN_MULT_WIN_BITS_MAX
+#	error "ECDSA_VERIFY_WIN_BITS must not exceed EC_PF_TWIN_MULT_WIN_BITS_MAX"
+#endif
+#define ECDSA_VERIFY_TBL_SIZE	(1 << (ECDSA_VERIFY_WIN_BITS - 2))
+
+typedef struct ecdsa_verify_batch_item_s {
+	bn_p		hash;	/* Hash of message (e). */
+	bn_p		sign_r;	/* Signature r. */
+	bn_p		sign_s;	/* Signature s. */
+	ec_point_p	pub_key; /* Pub key (Q). */
+	int		error;	/* Out: same as ecdsa_verify() return. */
+} ecdsa_verify_batch_item_t, *ecdsa_verify_batch_item_p;
+
+typedef struct ecdsa_verify_cache_entry_s {
+	uint64_t	used;	/* LRU tick, 0 - free entry. */
+	ec_point_t	pub_key;
+#ifdef EC_USE_PROJECTIVE
+	ec_pt_proj_am_t	tbl[ECDSA_VERIFY_TBL_SIZE]; /* Q, 3Q, 5Q... */
+#endif
+} ecdsa_verify_cache_entry_t, *ecdsa_verify_cache_entry_p;
+
+typedef struct ecdsa_verify_cache_s {
+	ec_curve_p	curve;	/* Tables valid only for this curve. */
+	uint64_t	tick;
+#ifdef EC_USE_PROJECTIVE
+	ec_pt_proj_am_t	G_tbl[ECDSA_VERIFY_TBL_SIZE]; /* G, 3G, 5G... */
+#endif
+	ecdsa_verify_cache_entry_t entry[ECDSA_VERIFY_CACHE_SIZE];
+} ecdsa_verify_cache_t, *ecdsa_verify_cache_p;
+
+
+/* Bind cache to curve: drop all pub keys and calculate G table.
+ * Cache must not be used by more than one thread at same time. */
+static inline int
+ecdsa_verify_cache_init(ecdsa_verify_cache_p cache, ec_curve_p curve) {
+	size_t i;
+
+	if (NULL == cache || NULL == curve)
+		return (EINVAL);
+	cache->curve = curve;
+	cache->tick = 0;
+	for (i = 0; i < ECDSA_VERIFY_CACHE_SIZE; i ++) {
+		cache->entry[i].used = 0;
+	}
+#ifdef EC_USE_PROJECTIVE
+	BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_precalc_affine(&curve->G,
+	    ECDSA_VERIFY_WIN_BITS, curve, cache->G_tbl));
+#endif
+	return (0);
+}
+
+#ifdef EC_USE_PROJECTIVE
+/* Return pub key table, calculate it on cache miss. */
+static inline int
+ecdsa_verify_cache_get__int(ecdsa_verify_cache_p cache, ec_point_p pub_key,
+    ec_pt_proj_am_t **tbl_ret) {
+	size_t i;
+	ecdsa_verify_cache_entry_p entry = &cache->entry[0];
+
+	cache->tick ++;
+	for (i = 0; i < ECDSA_VERIFY_CACHE_SIZE; i ++) {
+		if (0 != cache->entry[i].used &&
+		    0 != ec_point_is_eq(&cache->entry[i].pub_key, pub_key)) {
+			cache->entry[i].used = cache->tick;
+			(*tbl_ret) = cache->entry[i].tbl;
+			return (0);
+		}
+		/* Least recently used or free. */
+		if (entry->used > cache->entry[i].used) {
+			entry = &cache->entry[i];
+		}
+	}
+	entry->used = 0;
+	BN_RET_ON_ERR(ec_point_init(&entry->pub_key, cache->curve->m));
+	BN_RET_ON_ERR(ec_point_assign(&entry->pub_key, pub_key));
+	BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_precalc_affine(pub_key,
+	    ECDSA_VERIFY_WIN_BITS, cache->curve, entry->tbl));
+	entry->used = cache->tick;
+	(*tbl_ret) = entry->tbl;
+	return (0);
+}
+
+/* nums[i] = nums[i]^-1 mod n using one inversion.
+ * See [1]: Algorithm 2.26 Montgomery's simultaneous inversion. */
+static inline int
+ecdsa_mod_inv_batch__int(ec_curve_p curve, bn_t *nums, size_t count) {
+	size_t i, bits;
+	bn_t acc[ECDSA_VERIFY_BATCH_SIZE], inv, tm;
+
+	if (0 == count)
+		return (0);
+	bits = EC_CURVE_CALC_BITS_DBL(curve);
+	BN_RET_ON_ERR(bn_init(&inv, bits));
+	BN_RET_ON_ERR(bn_init(&tm, bits));
+	/* acc[i] = nums[0] * ... * nums[i] */
+	for (i = 0; i < count; i ++) {
+		BN_RET_ON_ERR(bn_init(&acc[i], bits));
+		BN_RET_ON_ERR(bn_assign(&acc[i], &nums[i]));
+		if (0 == i)
+			continue;
+		BN_RET_ON_ERR(bn_mod_mult(&acc[i], &acc[(i - 1)], &curve->n,
+		    &curve->n_mod_rd_data));
+	}
+	BN_RET_ON_ERR(bn_assign(&inv, &acc[(count - 1)]));
+	BN_RET_ON_ERR(bn_mod_inv(&inv, &curve->n, &curve->n_mod_rd_data));
+	for (i = count; 0 < i; i --) {
+		/* nums[i]^-1 = inv * acc[i - 1], inv = inv * nums[i] */
+		BN_RET_ON_ERR(bn_assign(&tm, &inv));
+		if (1 < i) {
+			BN_RET_ON_ERR(bn_mod_mult(&tm, &acc[(i - 2)], &curve->n,
+			    &curve->n_mod_rd_data));
+			BN_RET_ON_ERR(bn_mod_mult(&inv, &nums[(i - 1)], &curve->n,
+			    &curve->n_mod_rd_data));
+		}
+		BN_RET_ON_ERR(bn_assign(&nums[(i - 1)], &tm));
+	}
+	return (0);
+}
+
+/* Verify up to ECDSA_VERIFY_BATCH_SIZE signatures. */
+static inline int
+ecdsa_verify_batch_chunk__int(ec_curve_p curve, ecdsa_verify_cache_p cache,
+    ec_pt_proj_am_t *G_tbl, ecdsa_verify_batch_item_p items, size_t count) {
+	size_t i, cnt, bits;
+	size_t idx[ECDSA_VERIFY_BATCH_SIZE];
+	bn_t u1[ECDSA_VERIFY_BATCH_SIZE], u2[ECDSA_VERIFY_BATCH_SIZE];
+	ec_point_proj_t R[ECDSA_VERIFY_BATCH_SIZE];
+	ec_pt_proj_am_t Q_tbl_buf[ECDSA_VERIFY_TBL_SIZE], *Q_tbl;
+	ecdsa_verify_batch_item_p item;
+
+	/* Double size + 1 digit. */
+	bits = EC_CURVE_CALC_BITS_DBL(curve);
+	/* Check signatures, u1 = hash mod n, u2 = value to inverse. */
+	for (i = 0, cnt = 0; i < count; i ++) {
+		item = &items[i];
+		item->error = EINVAL;
+		if (NULL == item->hash || NULL == item->sign_r ||
+		    NULL == item->sign_s || NULL == item->pub_key ||
+		    bn_cmp(item->sign_r, &curve->n) >= 0 ||
+		    bn_cmp(item->sign_s, &curve->n) >= 0) /* sign_r and sign_s check. */
+			continue;
+		BN_RET_ON_ERR(bn_init(&u1[cnt], bits));
+		BN_RET_ON_ERR(bn_init(&u2[cnt], bits));
+		/* Hash too long? - reduce. */
+		BN_RET_ON_ERR(bn_assign(&u1[cnt], item->hash));
+		BN_RET_ON_ERR(bn_mod_reduce(&u1[cnt], &curve->n,
+		    &curve->n_mod_rd_data));
+		switch (curve->algo) {
+		case EC_CURVE_ALGO_ECDSA:
+			if (0 != bn_is_zero(item->sign_s))
+				continue;
+			BN_RET_ON_ERR(bn_assign(&u2[cnt], item->sign_s));
+			break;
+		case EC_CURVE_ALGO_GOST20XX:
+			if (0 != bn_is_zero(&u1[cnt])) { /* GOST step 2: if e == 0 then e = 1. */
+				BN_RET_ON_ERR(bn_assign_digit(&u1[cnt], 1));
+			}
+			BN_RET_ON_ERR(bn_assign(&u2[cnt], &u1[cnt]));
+			break;
+		default:
+			return (EINVAL);
+		}
+		item->error = -1;
+		idx[cnt ++] = i;
+	}
+	/* ECDSA: s^-1 mod n, GOST: hash^-1 mod n. */
+	BN_RET_ON_ERR(ecdsa_mod_inv_batch__int(curve, u2, cnt));
+	/* ECDSA: u1 = (hash * s^−1) mod n, u2 = (r * s^−1) mod n */
+	/* GOST: u1 = (hash^−1 * s) mod n, u2 = -(hash^−1 * r) mod n */
+	for (i = 0; i < cnt; i ++) {
+		item = &items[idx[i]];
+		switch (curve->algo) {
+		case EC_CURVE_ALGO_ECDSA:
+			BN_RET_ON_ERR(bn_mod_mult(&u1[i], &u2[i], &curve->n,
+			    &curve->n_mod_rd_data));
+			BN_RET_ON_ERR(bn_mod_mult(&u2[i], item->sign_r, &curve->n,
+			    &curve->n_mod_rd_data));
+			break;
+		case EC_CURVE_ALGO_GOST20XX:
+			BN_RET_ON_ERR(bn_assign(&u1[i], &u2[i]));
+			/* u2 = -(hash^−1 * r) */
+			BN_RET_ON_ERR(bn_assign(&u2[i], &curve->n));
+			BN_RET_ON_ERR(bn_mod_sub(&u2[i], &u1[i], &curve->n,
+			    &curve->n_mod_rd_data));
+			BN_RET_ON_ERR(bn_mod_mult(&u2[i], item->sign_r, &curve->n,
+			    &curve->n_mod_rd_data));
+			/* u1 = (hash^−1 * s) */
+			BN_RET_ON_ERR(bn_mod_mult(&u1[i], item->sign_s, &curve->n,
+			    &curve->n_mod_rd_data));
+			break;
+		}
+		/* R = (Rx, Ry) = u1*G + u2*Q */
+		if (NULL != cache) {
+			BN_RET_ON_ERR(ecdsa_verify_cache_get__int(cache,
+			    item->pub_key, &Q_tbl));
+		} else {
+			Q_tbl = Q_tbl_buf;
+			BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_precalc_affine(
+			    item->pub_key, ECDSA_VERIFY_WIN_BITS, curve, Q_tbl));
+		}
+		BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_tbl(G_tbl,
+		    ECDSA_VERIFY_WIN_BITS, &u1[i], Q_tbl, ECDSA_VERIFY_WIN_BITS,
+		    &u2[i], curve, &R[i])); /* Slow operation. */
+	}
+	BN_RET_ON_ERR(ec_point_proj_norm_batch(R, cnt, curve));
+	for (i = 0; i < cnt; i ++) {
+		item = &items[idx[i]];
+		if (0 != ec_point_proj_is_at_infinity(&R[i]))
+			continue; /* -1 */
+		/* v = Rx mod n */
+		BN_RET_ON_ERR(bn_assign(&u1[i], &R[i].x));
+		BN_RET_ON_ERR(ec_pf_from(&u1[i], curve));
+		BN_RET_ON_ERR(bn_mod(&u1[i], &curve->n, &curve->n_mod_rd_data));
+		item->error = ((0 != bn_cmp(&u1[i], item->sign_r)) ? -2 : 0);
+	}
+	return (0);
+}
+#endif /* EC_USE_PROJECTIVE */
+
+/* 
+ * Input:
+ *  curve - EC domain parameters
+ *  cache - optional, pub key tables cache from ecdsa_verify_cache_init()
+ *  items - array of hash, sign_r, sign_s, pub_key
+ *  count - items count
+ * Output:
+ *  items[i].error - result for each signature, same as ecdsa_verify()
+ * Return: 0 if all signatures valid, -2 if some not valid (see
+ * items[i].error), >0 on other error.
+ */
+static inline int
+ecdsa_verify_batch(ec_curve_p curve, ecdsa_verify_cache_p cache,
+    ecdsa_verify_batch_item_p items, size_t count) {
+	size_t i;
+#ifdef EC_USE_PROJECTIVE
+	ec_pt_proj_am_t G_tbl_buf[ECDSA_VERIFY_TBL_SIZE], *G_tbl;
+#endif
+
+	if (NULL == curve || NULL == items ||
+	    (NULL != cache && curve != cache->curve))
+		return (EINVAL);
+	for (i = 0; i < count; i ++) {
+		items[i].error = -1;
+	}
+#ifdef EC_USE_PROJECTIVE
+	if (NULL != cache) {
+		G_tbl = cache->G_tbl;
+	} else {
+		G_tbl = G_tbl_buf;
+		BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_precalc_affine(
+		    &curve->G, ECDSA_VERIFY_WIN_BITS, curve, G_tbl));
+	}
+	for (i = 0; i < count; i += ECDSA_VERIFY_BATCH_SIZE) {
+		BN_RET_ON_ERR(ecdsa_verify_batch_chunk__int(curve, cache, G_tbl,
+		    &items[i], MIN(ECDSA_VERIFY_BATCH_SIZE, (count - i))));
+	}
+#else
+	for (i = 0; i < count; i ++) {
+		if (NULL == items[i].hash || NULL == items[i].sign_r ||
+		    NULL == items[i].sign_s || NULL == items[i].pub_key) {
+			items[i].error = EINVAL;
+			continue;
+		}
+		items[i].error = ecdsa_verify(curve, items[i].hash,
+		    items[i].sign_r, items[i].sign_s, items[i].pub_key);
+	}
+#endif /* EC_USE_PROJECTIVE */
+	for (i = 0; i < count; i ++) {
+		if (0 != items[i].error)
+			return (-2);
+	}
+	return (0);
+}
+
+#ifdef ECDSA_VERIFY_BATCH_TP
+#include "threadpool/threadpool_msg_sys.h"
+
+typedef struct ecdsa_verify_batch_tp_s {
+	ec_curve_p		curve;
+	ecdsa_verify_cache_p	caches;	/* One per thread. */
+	size_t			caches_count;
+	ecdsa_verify_batch_item_p items;
+	size_t			count;
+	size_t			per_thread;
+} ecdsa_verify_batch_tp_t, *ecdsa_verify_batch_tp_p;
+
+static inline void
+ecdsa_verify_batch_tp_msg_cb(tpt_p tpt, void *udata) {
+	ecdsa_verify_batch_tp_p vb = udata;
+	size_t num, off;
+
+	num = tpt_get_num(tpt);
+	off = (num * vb->per_thread);
+	if (off >= vb->count)
+		return;
+	/* Items error set by ecdsa_verify_batch(). */
+	ecdsa_verify_batch(vb->curve,
+	    ((num < vb->caches_count) ? &vb->caches[num] : NULL),
+	    &vb->items[off], MIN(vb->per_thread, (vb->count - off)));
+}
+
+/* Split items between all tp threads and wait for result.
+ * caches - optional, array of caches_count caches, one per thread
+ * number, all bound to curve.
+ * Waiting is busy loop (TP_BMSG_F_SYNC): if called from any thread pool
+ * thread then items verified in caller thread, without split, to avoid
+ * deadlock with other thread waiting for it.
+ * Return: same as ecdsa_verify_batch(). */
+static inline int
+ecdsa_verify_batch_tp(tp_p tp, ec_curve_p curve,
+    ecdsa_verify_cache_p caches, size_t caches_count,
+    ecdsa_verify_batch_item_p items, size_t count) {
+	int error;
+	size_t i, threads_max;
+	tpt_p tpt;
+	ecdsa_verify_batch_tp_t vb;
+
+	if (NULL == tp || NULL == curve || NULL == items)
+		return (EINVAL);
+	for (i = 0; i < caches_count && NULL != caches; i ++) {
+		if (curve != caches[i].curve)
+			return (EINVAL);
+	}
+	tpt = tpt_get_current();
+	if (NULL != tpt) { /* Pool thread: must not wait for others. */
+		if (tp != tpt_get_tp(tpt) ||
+		    tpt_get_num(tpt) >= caches_count) {
+			caches = NULL;
+		} else if (NULL != caches) {
+			caches = &caches[tpt_get_num(tpt)];
+		}
+		return (ecdsa_verify_batch(curve, caches, items, count));
+	}
+	threads_max = tp_thread_count_max_get(tp);
+	for (i = 0; i < count; i ++) {
+		items[i].error = -1;
+	}
+	vb.curve = curve;
+	vb.caches = caches;
+	vb.caches_count = ((NULL != caches) ? caches_count : 0);
+	vb.items = items;
+	vb.count = count;
+	/* Whole chunks per thread. */
+	vb.per_thread = ((count + threads_max - 1) / threads_max);
+	vb.per_thread = (ECDSA_VERIFY_BATCH_SIZE *
+	    ((vb.per_thread + ECDSA_VERIFY_BATCH_SIZE - 1) / ECDSA_VERIFY_BATCH_SIZE));
+	error = tpt_msg_bsend(tp, NULL,
+	    (TP_MSG_F_FORCE | TP_MSG_F_SELF_DIRECT |
+	    TP_MSG_F_FAIL_DIRECT | TP_BMSG_F_SYNC),
+	    ecdsa_verify_batch_tp_msg_cb, &vb);
+	if (0 != error)
+		return (error);
+	for (i = 0; i < count; i ++) {
+		if (0 != items[i].error)
+			return (-2);
+	}
+	return (0);
+}
+#endif /* ECDSA_VERIFY_BATCH_TP */
+
 /* Verifying (alternative), using private key */
 /* 
  * Input:
@@ -1548,7 +1964,8 @@ ecdsa_verify_priv_key(ec_curve_p curve, bn_p hash, bn_p sign_r, bn_p sign_s,
 	if (bn_cmp(sign_r, &curve->n) >= 0 ||
 	    bn_cmp(sign_s, &curve->n) >= 0) /* sign_r and sign_s check. */
 		return (EINVAL);
-	if (bn_cmp(priv_key, &curve->n) >= 0) /* Key check. */
+	/* Key check. */
+	if (1 != bn_is_less_ct(priv_key, &curve->n, curve->n.digits))
 		return (EINVAL);
 	/* Double size + 1 digit. */
 	bits = EC_CURVE_CALC_BITS_DBL(curve);
@@ -1597,11 +2014,10 @@ ecdsa_verify_priv_key(ec_curve_p curve, bn_p hash, bn_p sign_r, bn_p sign_s,
 		return (EINVAL);
 	}
 	/* R = (Rx, Ry) = (u1 + u2 * d) * G */
-	BN_RET_ON_ERR(bn_mod_mult(&u2, priv_key, &curve->n,
-	    &curve->n_mod_rd_data));
-	BN_RET_ON_ERR(bn_mod_add(&u2, &u1, &curve->n,
-	    &curve->n_mod_rd_data));
-	ec_point_mult_bp(&u2, curve, &R);
+	BN_RET_ON_ERR(bn_mod_mult_mont(&u2, priv_key, &curve->n,
+	    &curve->n_mod_rd_data.mont));
+	BN_RET_ON_ERR(bn_mod_add_ct(&u2, &u1, &curve->n));
+	BN_RET_ON_ERR(ec_point_ct_mult_bp(&u2, curve, &R));
 	if (0 != R.infinity)
 		return (-2);
 	/* v = Rx mod n */
@@ -1712,12 +2128,14 @@ ecdsa_verify_priv_key_le(ec_curve_p curve,
 static inline int
 ecdsa_dh(ec_curve_p curve, int use_cofactor, ec_point_p pub_key,
     bn_p priv_key, bn_p shared_key) {
+	bn_t h;
 	ec_point_t Q;
 
 	if (NULL == curve || NULL == pub_key || NULL == priv_key ||
 	    NULL == shared_key)
 		return (EINVAL);
-	if (bn_cmp(priv_key, &curve->n) >= 0) /* Key check. */
+	/* Key check. */
+	if (1 != bn_is_less_ct(priv_key, &curve->n, curve->n.digits))
 		return (EINVAL);
 	/* Init */
 	BN_RET_ON_ERR(ec_point_init(&Q, curve->m));
@@ -1725,10 +2143,12 @@ ecdsa_dh(ec_curve_p curve, int use_cofactor, ec_point_p pub_key,
 	BN_RET_ON_ERR(bn_assign(shared_key, priv_key)); /* Use as temp. */
 	/* P = (Px, Py) = h * d * Q */
 	if (0 != use_cofactor) {
-		BN_RET_ON_ERR(bn_mod_mult_digit(shared_key, curve->h,
-		    &curve->n, &curve->n_mod_rd_data));
+		BN_RET_ON_ERR(bn_init(&h, curve->m));
+		BN_RET_ON_ERR(bn_assign_digit(&h, curve->h));
+		BN_RET_ON_ERR(bn_mod_mult_mont(shared_key, &h, &curve->n,
+		    &curve->n_mod_rd_data.mont));
 	}
-	BN_RET_ON_ERR(ec_point_unknown_pt_mult(&Q, shared_key, curve));
+	BN_RET_ON_ERR(ec_point_ct_mult(&Q, shared_key, curve));
 	if (0 != Q.infinity)
 		return (-1);
 	BN_RET_ON_ERR(bn_assign(shared_key, &Q.x));
@@ -1859,10 +2279,11 @@ ecdsa_recover_pub_key_from_priv_key_be(ec_curve_p curve,
 	BN_RET_ON_ERR(ec_point_init(&Q, bits));
 	/* Key import. */
 	BN_RET_ON_ERR(bn_import_be_bin(&d, priv_key, priv_key_size));
-	if (bn_cmp(&d, &curve->n) >= 0) /* Key check. */
+	/* Key check. */
+	if (1 != bn_is_less_ct(&d, &curve->n, curve->n.digits))
 		return (EINVAL);
 	/* Q = dG */
-	ec_point_mult_bp(&d, curve, &Q);
+	BN_RET_ON_ERR(ec_point_ct_mult_bp(&d, curve, &Q));
 	BN_RET_ON_ERR(ec_point_check_as_pub_key(&Q, curve));
 	/* Export result. */
 	BN_RET_ON_ERR(ecdsa_pub_key_export_be(curve, pub_key_compress,
@@ -1892,10 +2313,11 @@ ecdsa_recover_pub_key_from_priv_key_le(ec_curve_p curve,
 	BN_RET_ON_ERR(ec_point_init(&Q, bits));
 	/* Key import. */
 	BN_RET_ON_ERR(bn_import_le_bin(&d, priv_key, priv_key_size));
-	if (bn_cmp(&d, &curve->n) >= 0) /* Key check. */
+	/* Key check. */
+	if (1 != bn_is_less_ct(&d, &curve->n, curve->n.digits))
 		return (EINVAL);
 	/* Q = dG */
-	ec_point_mult_bp(&d, curve, &Q);
+	BN_RET_ON_ERR(ec_point_ct_mult_bp(&d, curve, &Q));
 	BN_RET_ON_ERR(ec_point_check_as_pub_key(&Q, curve));
 	/* Export result. */
 	BN_RET_ON_ERR(ecdsa_pub_key_export_le(curve, pub_key_compress,
@@ -2188,13 +2610,120 @@ static ec_point_tst2v_t ec_curve_tst2v[] = {
 };
 
 
+/* Field arithmetic against bn_mod_*(): edge values near p.
+ * ec_pf_add(), ec_pf_sub(), ec_pf_half() and ec_pf_mult_digit() do not
+ * depend on representation, ec_pf_mult() - Solinas curves only. */
+static inline int
+ec_self_test_pf__int(ec_curve_p curve) {
+	size_t i, j, bits;
+	bn_t v[8], tm, res;
+
+	bits = EC_CURVE_CALC_BITS_DBL(curve);
+	BN_RET_ON_ERR(bn_init(&tm, bits));
+	BN_RET_ON_ERR(bn_init(&res, bits));
+	for (i = 0; i < nitems(v); i ++) {
+		BN_RET_ON_ERR(bn_init(&v[i], bits));
+	}
+	/* p - 1, p - 2, p - 3, 0, 1, 2^(bits(p) - 1), b, Gx */
+	for (i = 0; i < 3; i ++) {
+		BN_RET_ON_ERR(bn_assign(&v[i], &curve->p));
+		bn_sub_digit(&v[i], (bn_digit_t)(i + 1), NULL);
+	}
+	bn_assign_zero(&v[3]);
+	BN_RET_ON_ERR(bn_assign_digit(&v[4], 1));
+	BN_RET_ON_ERR(bn_assign_2exp(&v[5], (bn_calc_bits(&curve->p) - 1)));
+	BN_RET_ON_ERR(bn_assign(&v[6], &curve->b));
+	BN_RET_ON_ERR(bn_assign(&v[7], &curve->G.x));
+	for (i = 0; i < nitems(v); i ++) {
+		/* bn = bn / 2 * 2 */
+		BN_RET_ON_ERR(bn_assign(&tm, &v[i]));
+		BN_RET_ON_ERR(ec_pf_half(&tm, curve));
+		BN_RET_ON_ERR(ec_pf_add(&tm, &tm, curve));
+		if (0 == bn_is_equal(&tm, &v[i]))
+			return (-1);
+		for (j = 2; j < 9; j ++) {
+			BN_RET_ON_ERR(bn_assign(&tm, &v[i]));
+			BN_RET_ON_ERR(ec_pf_mult_digit(&tm, (bn_digit_t)j,
+			    curve));
+			BN_RET_ON_ERR(bn_assign(&res, &v[i]));
+			BN_RET_ON_ERR(bn_mod_mult_digit(&res, (bn_digit_t)j,
+			    &curve->p, &curve->p_mod_rd_data));
+			if (0 == bn_is_equal(&tm, &res))
+				return (-1);
+		}
+		for (j = 0; j < nitems(v); j ++) {
+			BN_RET_ON_ERR(bn_assign(&tm, &v[i]));
+			BN_RET_ON_ERR(ec_pf_add(&tm, &v[j], curve));
+			BN_RET_ON_ERR(bn_assign(&res, &v[i]));
+			BN_RET_ON_ERR(bn_mod_add(&res, &v[j], &curve->p,
+			    &curve->p_mod_rd_data));
+			if (0 == bn_is_equal(&tm, &res))
+				return (-1);
+			BN_RET_ON_ERR(bn_assign(&tm, &v[i]));
+			BN_RET_ON_ERR(ec_pf_sub(&tm, &v[j], curve));
+			BN_RET_ON_ERR(bn_assign(&res, &v[i]));
+			BN_RET_ON_ERR(bn_mod_sub(&res, &v[j], &curve->p,
+			    &curve->p_mod_rd_data));
+			if (0 == bn_is_equal(&tm, &res))
+				return (-1);
+			if (EC_CURVE_PF_GENERIC == curve->pf)
+				continue;
+			BN_RET_ON_ERR(bn_assign(&tm, &v[i]));
+			if (i == j) {
+				BN_RET_ON_ERR(ec_pf_square(&tm, curve));
+			} else {
+				BN_RET_ON_ERR(ec_pf_mult(&tm, &v[j], curve));
+			}
+			BN_RET_ON_ERR(bn_assign(&res, &v[i]));
+			BN_RET_ON_ERR(bn_mod_mult(&res, &v[j], &curve->p,
+			    &curve->p_mod_rd_data));
+			if (0 == bn_is_equal(&tm, &res))
+				return (-1);
+		}
+	}
+	return (0);
+}
+
+#ifdef EC_CONSTANT_TIME
+/* ec_point_ct_mult() against ec_point_unknown_pt_mult(): scalars near
+ * 0 and n, recoded digits at extremes. */
+static inline int
+ec_self_test_ct_mult__int(ec_curve_p curve) {
+	size_t i, bits;
+	bn_t d;
+	ec_point_t R, TM;
+
+	bits = EC_CURVE_CALC_BITS_DBL(curve);
+	BN_RET_ON_ERR(bn_init(&d, bits));
+	BN_RET_ON_ERR(ec_point_init(&R, bits));
+	BN_RET_ON_ERR(ec_point_init(&TM, bits));
+	for (i = 0; i < 8; i ++) {
+		if (4 > i) { /* 1, 2, 3, 4 */
+			BN_RET_ON_ERR(bn_assign_digit(&d, (bn_digit_t)(i + 1)));
+		} else { /* n - 1, n - 2, n - 3, n - 4 */
+			BN_RET_ON_ERR(bn_assign(&d, &curve->n));
+			bn_sub_digit(&d, (bn_digit_t)(i - 3), NULL);
+		}
+		BN_RET_ON_ERR(ec_point_assign(&R, &curve->G));
+		BN_RET_ON_ERR(ec_point_unknown_pt_mult(&R, &d, curve));
+		BN_RET_ON_ERR(ec_point_assign(&TM, &curve->G));
+		BN_RET_ON_ERR(ec_point_ct_mult(&TM, &d, curve));
+		if (0 == ec_point_is_eq(&TM, &R))
+			return (-1);
+	}
+	return (0);
+}
+#endif
+
 static inline int
 ec_self_test(void) {
-	size_t i, bits, rsize, priv_key_size, pub_key_size;
+	size_t i, j, bits, rsize, priv_key_size, pub_key_size;
 	bn_t d, e, tm;
 	ec_point_t S, T, R, TM;
 	ec_curve_t curve;
 	uint8_t r[512], s[512];
+	ecdsa_verify_cache_t vcache;
+	ecdsa_verify_batch_item_t vitems[4];
 
 	/* Calculations check. */
 	for (i = 0; i < nitems(ec_curve_tst1v); i ++) {
@@ -2262,6 +2791,13 @@ ec_self_test(void) {
 		    ec_curve_tst1v[i].hex_str_len));
 		if (0 == ec_point_is_eq(&TM, &R))
 			return (-1);
+		/* R = dS, constant time. */
+		if (bn_cmp(&d, &curve.n) < 0) {
+			BN_RET_ON_ERR(ec_point_assign(&TM, &S));
+			BN_RET_ON_ERR(ec_point_ct_mult(&TM, &d, &curve));
+			if (0 == ec_point_is_eq(&TM, &R))
+				return (-1);
+		}
 		/* R = dS + eT */
 		BN_RET_ON_ERR(ec_point_twin_mult(&S, &d, &T, &e, &curve, &TM));
 		BN_RET_ON_ERR(bn_import_be_hex(&R.x, (const uint8_t*)ec_curve_tst1v[i].Rx_twin_mult,
@@ -2333,6 +2869,10 @@ ec_self_test(void) {
 	for (i = 0; i < nitems(ec_curve_str); i ++) {
 		BN_RET_ON_ERR(ecdsa_curve_from_str(&ec_curve_str[i], &curve));
 		BN_RET_ON_ERR(ec_curve_validate(&curve, NULL));
+		BN_RET_ON_ERR(ec_self_test_pf__int(&curve));
+#ifdef EC_CONSTANT_TIME
+		BN_RET_ON_ERR(ec_self_test_ct_mult__int(&curve));
+#endif
 
 		bits = EC_CURVE_CALC_BITS_DBL(&curve);
 		BN_RET_ON_ERR(bn_init(&d, bits));
@@ -2360,6 +2900,36 @@ ec_self_test(void) {
 		BN_RET_ON_ERR(ecdsa_verify_priv_key_be(&curve,
 		    (uint8_t*)hash_abc, 20, (uint8_t*)r, (uint8_t*)s, rsize,
 		    (uint8_t*)d.num, priv_key_size));
+
+		/* Batch verify: S - pub key, T - sign, R.x - hash, R.y - bad hash. */
+		BN_RET_ON_ERR(ec_point_init(&S, bits));
+		BN_RET_ON_ERR(ec_point_init(&T, bits));
+		BN_RET_ON_ERR(ec_point_init(&R, bits));
+		BN_RET_ON_ERR(ecdsa_pub_key_import_be(&curve, (uint8_t*)&TM.x.num,
+		    (uint8_t*)&TM.y.num, pub_key_size, &S));
+		BN_RET_ON_ERR(bn_import_be_bin(&T.x, r, rsize));
+		BN_RET_ON_ERR(bn_import_be_bin(&T.y, s, rsize));
+		BN_RET_ON_ERR(bn_import_be_bin(&R.x, hash_abc,
+		    MIN(20, EC_CURVE_CALC_BYTES(&curve))));
+		BN_RET_ON_ERR(bn_assign(&R.y, &R.x));
+		BN_RET_ON_ERR(bn_bit_set(&R.y, 8, (0 == bn_is_bit_set(&R.y, 8))));
+		for (j = 0; j < nitems(vitems); j ++) {
+			vitems[j].hash = &R.x;
+			vitems[j].sign_r = &T.x;
+			vitems[j].sign_s = &T.y;
+			vitems[j].pub_key = &S;
+		}
+		vitems[1].hash = &R.y; /* Bad sign. */
+		vitems[3].sign_r = &curve.n; /* Out of range. */
+		BN_RET_ON_ERR(ecdsa_verify_cache_init(&vcache, &curve));
+		if (-2 != ecdsa_verify_batch(&curve, &vcache, vitems, 4) ||
+		    0 != vitems[0].error || -2 != vitems[1].error ||
+		    0 != vitems[2].error || EINVAL != vitems[3].error)
+			return (-1);
+		if (-2 != ecdsa_verify_batch(&curve, NULL, vitems, 4) ||
+		    0 != vitems[0].error || -2 != vitems[1].error ||
+		    0 != vitems[2].error || EINVAL != vitems[3].error)
+			return (-1);
 	}
 
 	return (0);
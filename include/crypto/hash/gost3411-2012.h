@@ -41,18 +41,16 @@
 #include <sys/types.h>
 #include <string.h> /* memcpy, memmove, memset, strerror... */
 #include <inttypes.h>
-#ifdef __SSE2__
-#	include <cpuid.h>
-#	include <xmmintrin.h> /* SSE */
-#	include <emmintrin.h> /* SSE2 */
-#	include <pmmintrin.h> /* SSE3 */
-#	include <tmmintrin.h> /* SSSE3 */
-#	include <smmintrin.h> /* SSE4.1 */
-#	include <nmmintrin.h> /* SSE4.2 */
-#endif
-#ifdef __AVX__ 
-#	include <cpuid.h>
-#	include <immintrin.h> /* AVX */
+#include <errno.h>
+/*
+ * x86-64: SSE4.1 and AVX2 transforms, selected at run time by cpuid,
+ * no -m flags required.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define GOST3411_2012_X86_SIMD	1
+#	include "al/cpu_features.h"
+#	include <immintrin.h>
+#	define GOST3411_2012_TARGET(__t)	__attribute__((__target__(__t)))
 #endif
 
 #ifndef __unused
@@ -949,12 +947,25 @@ static const GOST3411_2012_ALIGN(32) uint64_t gost3411_2012_C[GOST3411_2012_ROUN
 };
 
 
+/* Implementations. */
+#define GOST3411_2012_IMPL_GENERIC	0
+#define GOST3411_2012_IMPL_SSE		1 /* SSE4.1. */
+#define GOST3411_2012_IMPL_AVX2		2
+#define GOST3411_2012_IMPL_AUTO		0xff
+
+struct gost3411_2012_ctx_s;
+typedef void (*gost3411_2012_transform_n_fn)(struct gost3411_2012_ctx_s *ctx,
+    const size_t block_size_bits, const uint8_t *blocks,
+    const uint8_t *blocks_max);
+typedef void (*gost3411_2012_transform_1_fn)(struct gost3411_2012_ctx_s *ctx,
+    const uint64_t *block);
+
 /* This structure will hold context information for the GOST3411_2012 hashing operation. */
 typedef struct gost3411_2012_ctx_s {
 	size_t hash_size; /* hash size being used. */
 	size_t buffer_usage; /* Data size in buffer. */
-	int use_sse; /* SSE2+ transform. */
-	int use_avx; /* AVX+ transform. */
+	gost3411_2012_transform_n_fn transform_n; /* Selected by gost3411_2012_init_impl(). */
+	gost3411_2012_transform_1_fn transform_1;
 	GOST3411_2012_ALIGN(32) uint64_t hash[GOST3411_2012_HASH_MAX_64CNT]; /* Message Digest. */
 	GOST3411_2012_ALIGN(32) uint64_t counter[GOST3411_2012_MSG_BLK_64CNT]; /* Counter: count processed data len. */
 	GOST3411_2012_ALIGN(32) uint64_t sigma[GOST3411_2012_MSG_BLK_64CNT]; /* EPSILON / Sigma / Summ: summ512 all blocks. */
@@ -1168,12 +1179,7 @@ gost3411_2012_transform_1_generic(gost3411_2012_ctx_p ctx,
 
 
 
-#ifdef __SSE2__
-
-/* Staff for old SSE. */
-#ifndef __SSE4_1__ /* SSE4.1 required. */
-#define _mm_stream_load_si128		_mm_load_si128
-#endif
+#ifdef GOST3411_2012_X86_SIMD
 
 #define GOST3411_2012_SSE_ADDMOD512_MEM(__dmem, __xmm0, __xmm1, __xmm2, __xmm3) do {	\
 	GOST3411_2012_ALIGN(32) uint64_t tmp[GOST3411_2012_MSG_BLK_64CNT]; \
@@ -1211,10 +1217,10 @@ gost3411_2012_transform_1_generic(gost3411_2012_ctx_p ctx,
 } while (0)
 
 #define GOST3411_2012_SSE_STREAM_LOAD(__ptr, __xmm0, __xmm1, __xmm2, __xmm3) do { \
-	(__xmm0) = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[0]); \
-	(__xmm1) = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[1]); \
-	(__xmm2) = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[2]); \
-	(__xmm3) = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[3]); \
+	(__xmm0) = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[0]); \
+	(__xmm1) = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[1]); \
+	(__xmm2) = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[2]); \
+	(__xmm3) = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[3]); \
 } while (0)
 
 #define GOST3411_2012_SSE_STORE(__ptr, __xmm0, __xmm1, __xmm2, __xmm3) do { \
@@ -1309,6 +1315,7 @@ gost3411_2012_transform_1_generic(gost3411_2012_ctx_p ctx,
  * Description:
  *   This function will process the next 512 bits of the message.
  */
+GOST3411_2012_TARGET("sse4.1")
 static inline void
 gost3411_2012_transform_n_sse(gost3411_2012_ctx_p ctx,
     const size_t block_size_bits, const uint8_t *blocks,
@@ -1373,6 +1380,7 @@ gost3411_2012_transform_n_sse(gost3411_2012_ctx_p ctx,
 	_mm_empty();
 }
 
+GOST3411_2012_TARGET("sse4.1")
 static inline void
 gost3411_2012_transform_1_sse(gost3411_2012_ctx_p ctx, const uint64_t *block) {
 	register size_t i;
@@ -1418,14 +1426,7 @@ gost3411_2012_transform_1_sse(gost3411_2012_ctx_p ctx, const uint64_t *block) {
 #endif
 
 
-#ifdef __AVX__
-
-#ifndef __AVX2__ /* AVX2 emulation. */
-#define _mm256_stream_load_si256	_mm256_load_si256
-#define _mm256_xor_si256(__aymm, __bymm) 				\
-	_mm256_castpd_si256(_mm256_xor_pd(				\
-	    _mm256_castsi256_pd((__aymm)), _mm256_castsi256_pd((__bymm))))
-#endif /* __AVX2__ */
+#ifdef GOST3411_2012_X86_SIMD
 
 #define GOST3411_2012_AVX256_ADDMOD512_MEM(__dmem, __ymm0, __ymm1) do {	\
 	GOST3411_2012_ALIGN(32) uint64_t tmp[GOST3411_2012_MSG_BLK_64CNT]; \
@@ -1450,8 +1451,8 @@ gost3411_2012_transform_1_sse(gost3411_2012_ctx_p ctx, const uint64_t *block) {
 } while (0)
 
 #define GOST3411_2012_AVX256_STREAM_LOAD(__ptr, __ymm0, __ymm1) do {	\
-	(__ymm0) = _mm256_stream_load_si256(&((const __m256i*)(const void*)(__ptr))[0]); \
-	(__ymm1) = _mm256_stream_load_si256(&((const __m256i*)(const void*)(__ptr))[1]); \
+	(__ymm0) = _mm256_stream_load_si256(&((__m256i*)(void*)(size_t)(__ptr))[0]); \
+	(__ymm1) = _mm256_stream_load_si256(&((__m256i*)(void*)(size_t)(__ptr))[1]); \
 } while (0)
 
 #define GOST3411_2012_AVX256_LOADU(__ptr, __ymm0, __ymm1) do {		\
@@ -1551,6 +1552,7 @@ gost3411_2012_transform_1_sse(gost3411_2012_ctx_p ctx, const uint64_t *block) {
  * Description:
  *   This function will process the next 512 bits of the message.
  */
+GOST3411_2012_TARGET("avx2")
 static inline void
 gost3411_2012_transform_n_avx(gost3411_2012_ctx_p ctx,
     const size_t block_size_bits, const uint8_t *blocks,
@@ -1613,6 +1615,7 @@ gost3411_2012_transform_n_avx(gost3411_2012_ctx_p ctx,
 	/* Restore the Floating-point status on the CPU. */
 	_mm256_zeroall();
 }
+GOST3411_2012_TARGET("avx2")
 static inline void
 gost3411_2012_transform_1_avx(gost3411_2012_ctx_p ctx, const uint64_t *block) {
 	register size_t i;
@@ -1662,55 +1665,70 @@ gost3411_2012_transform_n(gost3411_2012_ctx_p ctx,
     const size_t block_size_bits, const uint8_t *blocks,
     const uint8_t *blocks_max) {
 
-#ifdef __AVX__
-	if (ctx->use_avx) {
-		gost3411_2012_transform_n_avx(ctx,
-		    block_size_bits, blocks, blocks_max);
-		return;
-	}
-#endif
-#ifdef __SSE2__
-	if (ctx->use_sse) {
-		gost3411_2012_transform_n_sse(ctx,
-		    block_size_bits, blocks, blocks_max);
-		return;
-	}
-#endif
-	/* Use generic implementation. */
-	gost3411_2012_transform_n_generic(ctx, block_size_bits, blocks, blocks_max);
+	ctx->transform_n(ctx, block_size_bits, blocks, blocks_max);
 }
 static inline void
 gost3411_2012_transform_1(gost3411_2012_ctx_p ctx, const uint64_t *block) {
 
-#ifdef __AVX__
-	if (ctx->use_avx) {
-		gost3411_2012_transform_1_avx(ctx, block);
-		return;
+	ctx->transform_1(ctx, block);
+}
+
+
+#define GOST3411_2012_CPU_F_INIT	(((uint32_t)1) << 0)
+#define GOST3411_2012_CPU_F_SSE		(((uint32_t)1) << 1) /* SSE4.1. */
+#define GOST3411_2012_CPU_F_AVX2	(((uint32_t)1) << 2)
+
+/* Return GOST3411_2012_CPU_F_* supported by CPU and build. */
+static inline uint32_t
+gost3411_2012_cpu_features_get(void) {
+	uint32_t ret = GOST3411_2012_CPU_F_INIT;
+#ifdef GOST3411_2012_X86_SIMD
+	const uint32_t cpu_features = cpu_features_get();
+
+	if (0 != (CPU_F_SSE41 & cpu_features)) {
+		ret |= GOST3411_2012_CPU_F_SSE;
 	}
-#endif
-#ifdef __SSE2__
-	if (ctx->use_sse) {
-		gost3411_2012_transform_1_sse(ctx, block);
-		return;
+	if (0 != (CPU_F_AVX2 & cpu_features)) {
+		ret |= GOST3411_2012_CPU_F_AVX2;
 	}
 #endif
-	/* Use generic implementation. */
-	gost3411_2012_transform_1_generic(ctx, block);
+
+	return (ret);
+}
+
+/* 0 - not supported by CPU / build. */
+static inline int
+gost3411_2012_impl_is_supported(const uint32_t impl) {
+
+	switch (impl) {
+	case GOST3411_2012_IMPL_GENERIC:
+	case GOST3411_2012_IMPL_AUTO:
+		return (1);
+	case GOST3411_2012_IMPL_SSE:
+		return (0 != (GOST3411_2012_CPU_F_SSE &
+		    gost3411_2012_cpu_features_get()));
+	case GOST3411_2012_IMPL_AVX2:
+		return (0 != (GOST3411_2012_CPU_F_AVX2 &
+		    gost3411_2012_cpu_features_get()));
+	}
+	return (0);
 }
 
 
 /*
- *  gost3411_2012_init
+ *  gost3411_2012_init_impl
  *
  *  Description:
  *      This function will initialize the gost3411_2012_ctx in preparation
- *      for computing a new GOST3411_2012 message digest.
+ *      for computing a new GOST3411_2012 message digest with specified
+ *      GOST3411_2012_IMPL_* transform.
+ *      Return ENOTSUP if not supported by CPU, ctx is usable with
+ *      generic transform anyway.
  */
-static inline void
-gost3411_2012_init(const size_t bits, gost3411_2012_ctx_p ctx) {
-#if defined(__SSE2__) || defined(__AVX__)
-	uint32_t eax, ebx, ecx, edx;
-#endif
+static inline int
+gost3411_2012_init_impl(const size_t bits, const uint32_t impl,
+    gost3411_2012_ctx_p ctx) {
+	uint32_t cpu_features;
 
 	memset(ctx, 0x00, sizeof(gost3411_2012_ctx_t));
 	/* Load magic initialization constants. */
@@ -1727,25 +1745,58 @@ gost3411_2012_init(const size_t bits, gost3411_2012_ctx_p ctx) {
 		/* IV - all zeros. */
 		break;
 	}
-#ifdef __SSE2__
-	__get_cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
-#	ifdef __SSE4_1__
-		ctx->use_sse |= (ecx & (((uint32_t)1) << 19));
-#	elif defined(__SSSE3__)
-		ctx->use_sse |= (ecx & (((uint32_t)1) <<  9));
-#	elif defined(__SSE3__)
-		ctx->use_sse |= (ecx & (((uint32_t)1) <<  0));
-#	elif defined(__SSE2__)
-		ctx->use_sse |= (edx & (((uint32_t)1) << 26));
-#	endif
+
+	ctx->transform_n = gost3411_2012_transform_n_generic;
+	ctx->transform_1 = gost3411_2012_transform_1_generic;
+	cpu_features = gost3411_2012_cpu_features_get();
+	switch (impl) {
+	case GOST3411_2012_IMPL_GENERIC:
+		break;
+	case GOST3411_2012_IMPL_AUTO:
+#ifdef GOST3411_2012_X86_SIMD
+		if (0 != (GOST3411_2012_CPU_F_AVX2 & cpu_features)) {
+			ctx->transform_n = gost3411_2012_transform_n_avx;
+			ctx->transform_1 = gost3411_2012_transform_1_avx;
+		} else if (0 != (GOST3411_2012_CPU_F_SSE & cpu_features)) {
+			ctx->transform_n = gost3411_2012_transform_n_sse;
+			ctx->transform_1 = gost3411_2012_transform_1_sse;
+		}
 #endif
-#ifdef __AVX2__
-	__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
-	ctx->use_avx |= (ebx & (((uint32_t)1) <<  5)); /* AVX2. */
-#elif defined(__AVX__)
-	__get_cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
-	ctx->use_avx |= (ecx & (((uint32_t)1) << 28)); /* AVX. */
+		break;
+	case GOST3411_2012_IMPL_SSE:
+		if (0 == (GOST3411_2012_CPU_F_SSE & cpu_features))
+			return (ENOTSUP);
+#ifdef GOST3411_2012_X86_SIMD
+		ctx->transform_n = gost3411_2012_transform_n_sse;
+		ctx->transform_1 = gost3411_2012_transform_1_sse;
 #endif
+		break;
+	case GOST3411_2012_IMPL_AVX2:
+		if (0 == (GOST3411_2012_CPU_F_AVX2 & cpu_features))
+			return (ENOTSUP);
+#ifdef GOST3411_2012_X86_SIMD
+		ctx->transform_n = gost3411_2012_transform_n_avx;
+		ctx->transform_1 = gost3411_2012_transform_1_avx;
+#endif
+		break;
+	default:
+		return (EINVAL);
+	}
+
+	return (0);
+}
+
+/*
+ *  gost3411_2012_init
+ *
+ *  Description:
+ *      This function will initialize the gost3411_2012_ctx in preparation
+ *      for computing a new GOST3411_2012 message digest.
+ */
+static inline void
+gost3411_2012_init(const size_t bits, gost3411_2012_ctx_p ctx) {
+
+	gost3411_2012_init_impl(bits, GOST3411_2012_IMPL_AUTO, ctx);
 }
 
 /*
@@ -2160,32 +2211,13 @@ gost3411_2012_self_test(void) {
 	}
 
 	/* Test 2 - HASH by parts. */
-	for (s = 0; s < 3; s ++) {
-#ifndef __SSE2__
-		if (1 == s) /* No SSE2+, skip test. */
-			continue;
-#endif
-#ifndef __AVX__
-		if (2 == s) /* No AVX+, skip test. */
+	for (s = GOST3411_2012_IMPL_GENERIC; s <= GOST3411_2012_IMPL_AVX2; s ++) {
+		if (0 == gost3411_2012_impl_is_supported((uint32_t)s))
 			continue;
-#endif
 		for (k = 0; k < nitems(gost3411_2012_hash_tst); k ++) {
 			for (j = 1; j < gost3411_2012_hash_tst[k].msg_size; j ++) {
 				if (NULL != gost3411_2012_hash_tst[k].hash256) {
-					gost3411_2012_init(256, &ctx);
-					/* Force generic test. */
-					ctx.use_sse = 0;
-					ctx.use_avx = 0;
-#ifdef __SSE2__
-					if (1 == s) { /* SSE2+ test. */
-						ctx.use_sse = 1;
-					}
-#endif
-#ifdef __AVX__
-					if (2 == s) { /* No AVX+, skip test. */
-						ctx.use_avx = 1;
-					}
-#endif
+					gost3411_2012_init_impl(256, (uint32_t)s, &ctx);
 					for (i = 0; i < gost3411_2012_hash_tst[k].msg_size; i += j) {
 						tm = (gost3411_2012_hash_tst[k].msg_size - i);
 						gost3411_2012_update(&ctx,
@@ -2199,20 +2231,7 @@ gost3411_2012_self_test(void) {
 						return (3);
 				}
 				if (NULL != gost3411_2012_hash_tst[k].hash512) {
-					gost3411_2012_init(512, &ctx);
-					/* Force generic test. */
-					ctx.use_sse = 0;
-					ctx.use_avx = 0;
-#ifdef __SSE2__
-					if (1 == s) { /* SSE2+ test. */
-						ctx.use_sse = 1;
-					}
-#endif
-#ifdef __AVX__
-					if (2 == s) { /* No AVX+, skip test. */
-						ctx.use_avx = 1;
-					}
-#endif
+					gost3411_2012_init_impl(512, (uint32_t)s, &ctx);
 					for (i = 0; i < gost3411_2012_hash_tst[k].msg_size; i += j) {
 						tm = (gost3411_2012_hash_tst[k].msg_size - i);
 						gost3411_2012_update(&ctx,
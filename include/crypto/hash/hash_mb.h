@@ -0,0 +1,653 @@
+/*-
+ * Copyright (c) 2003-2025 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Multi-buffer hashing: many independent short messages hashed in
+ * parallel, one message per SIMD lane (MD5, SHA-1, SHA-224/256).
+ * Each lane runs generic round code on a 4/8/16 x 32 bit vector
+ * (SSE2 or NEON / AVX2 / AVX-512F), lanes refilled with next message
+ * as soon as previous one is done, so messages can be of any size.
+ * AVX2 and AVX-512F code compiled with target attributes, selected at
+ * run time.
+ * Profitable for messages up to few blocks, single stream functions
+ * (especially SHA-NI) are better for long messages.
+ */
+
+#ifndef __HASH_MB_H__INCLUDED__
+#define __HASH_MB_H__INCLUDED__
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <string.h> /* memcpy, memmove, memset, strerror... */
+#include <inttypes.h>
+#include <errno.h>
+
+#include "crypto/hash/md5.h"
+#include "crypto/hash/sha1.h"
+#include "crypto/hash/sha2.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#	define HASH_MB_VEC		1 /* Vector extensions. */
+#endif
+#if defined(HASH_MB_VEC) && defined(__x86_64__)
+#	define HASH_MB_X86		1
+#	include "al/cpu_features.h"
+#	define HASH_MB_TARGET(__t)	__attribute__((__target__(__t)))
+#endif
+
+
+#define HASH_MB_ALGO_MD5	0
+#define HASH_MB_ALGO_SHA1	1
+#define HASH_MB_ALGO_SHA2_224	2
+#define HASH_MB_ALGO_SHA2_256	3
+#define HASH_MB_ALGO_COUNT	4
+
+#define HASH_MB_IMPL_GENERIC	0 /* Single stream functions, one by one. */
+#define HASH_MB_IMPL_X4		1 /* 4 lanes: SSE2 / NEON. */
+#define HASH_MB_IMPL_X8		2 /* 8 lanes: AVX2. */
+#define HASH_MB_IMPL_X16	3 /* 16 lanes: AVX-512F. */
+#define HASH_MB_IMPL_COUNT	4
+#define HASH_MB_IMPL_AUTO	0xff
+
+#define HASH_MB_LANES_MAX	16
+#define HASH_MB_BLK_SIZE	64 /* All algos: 512 bit. */
+#define HASH_MB_STATE_WORDS	8
+
+
+typedef struct hash_mb_job_s {
+	const void	*data;
+	size_t		data_size;
+	uint8_t		*digest;	/* Out: hash_mb_hash_size() bytes. */
+} hash_mb_job_t, *hash_mb_job_p;
+
+/* Process one block in each lane.
+ * state[word * lanes + lane], msg[word * lanes + lane]. */
+typedef void (*hash_mb_transform_fn)(uint32_t *state, const uint32_t *msg);
+
+typedef struct hash_mb_lane_s {
+	hash_mb_job_p	job;		/* NULL - idle lane. */
+	const uint8_t	*data;		/* Next full message block. */
+	size_t		blocks;		/* Full message blocks left. */
+	size_t		tail_blocks;	/* Padding blocks: 1 or 2. */
+	size_t		tail_idx;
+	uint8_t		tail[(2 * HASH_MB_BLK_SIZE)];
+} hash_mb_lane_t, *hash_mb_lane_p;
+
+
+static const uint32_t hash_mb_md5_t[64] = { /* RFC 1321: 4294967296 * abs(sin(i)). */
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf,
+	0x4787c62a, 0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af,
+	0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e,
+	0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6,
+	0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+	0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122,
+	0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039,
+	0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244, 0x432aff97,
+	0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d,
+	0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+static const uint32_t hash_mb_sha1_k[4] = {
+	0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+};
+static const uint32_t hash_mb_sha256_k[64] = { /* FIPS-180-2, section 4.2.2 */
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+	0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+	0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+	0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+	0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+	0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+	0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+	0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+	0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+static const uint32_t hash_mb_md5_h0[4] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+};
+static const uint32_t hash_mb_sha1_h0[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+
+#ifdef HASH_MB_VEC
+/*
+ * Lane transforms: same round code for all vector widths.
+ * Vector +, ^, &, |, ~, <<, >> are per lane.
+ */
+#define HASH_MB_VLOAD(__vt, __v, __ptr)	memcpy(&(__v), (__ptr), sizeof(__vt))
+#define HASH_MB_VSTORE(__vt, __ptr, __v) memcpy((__ptr), &(__v), sizeof(__vt))
+
+#define HASH_MB_MD5_STEP(__f, __a, __b, __c, __d, __i, __g, __s) do {	\
+	(__a) += (__f((__b), (__c), (__d)) + W[(__g)] + hash_mb_md5_t[(__i)]); \
+	(__a) = ((__b) + MD5_ROTATE_LEFT((__a), (__s)));		\
+} while (0)
+
+#define HASH_MB_MD5_FN(__name, __vt, __lanes, __attr)			\
+static __attr void							\
+__name(uint32_t *state, const uint32_t *msg) {				\
+	static const uint32_t s[16] = {					\
+		7, 12, 17, 22,  5,  9, 14, 20,				\
+		4, 11, 16, 23,  6, 10, 15, 21				\
+	};								\
+	size_t i;							\
+	__vt a, b, c, d, aa, bb, cc, dd, W[16];				\
+									\
+	for (i = 0; i < 16; i ++) {					\
+		HASH_MB_VLOAD(__vt, W[i], &msg[(i * (__lanes))]);	\
+	}								\
+	HASH_MB_VLOAD(__vt, a, &state[(0 * (__lanes))]);		\
+	HASH_MB_VLOAD(__vt, b, &state[(1 * (__lanes))]);		\
+	HASH_MB_VLOAD(__vt, c, &state[(2 * (__lanes))]);		\
+	HASH_MB_VLOAD(__vt, d, &state[(3 * (__lanes))]);		\
+	aa = a;								\
+	bb = b;								\
+	cc = c;								\
+	dd = d;								\
+	for (i = 0; i < 16; i += 4) {					\
+		HASH_MB_MD5_STEP(MD5_F, a, b, c, d, (i + 0), (i + 0), s[0]); \
+		HASH_MB_MD5_STEP(MD5_F, d, a, b, c, (i + 1), (i + 1), s[1]); \
+		HASH_MB_MD5_STEP(MD5_F, c, d, a, b, (i + 2), (i + 2), s[2]); \
+		HASH_MB_MD5_STEP(MD5_F, b, c, d, a, (i + 3), (i + 3), s[3]); \
+	}								\
+	for (i = 16; i < 32; i += 4) {					\
+		HASH_MB_MD5_STEP(MD5_G, a, b, c, d, (i + 0), ((5 * i + 1) & 15), s[4]); \
+		HASH_MB_MD5_STEP(MD5_G, d, a, b, c, (i + 1), ((5 * i + 6) & 15), s[5]); \
+		HASH_MB_MD5_STEP(MD5_G, c, d, a, b, (i + 2), ((5 * i + 11) & 15), s[6]); \
+		HASH_MB_MD5_STEP(MD5_G, b, c, d, a, (i + 3), ((5 * i + 16) & 15), s[7]); \
+	}								\
+	for (i = 32; i < 48; i += 4) {					\
+		HASH_MB_MD5_STEP(MD5_H, a, b, c, d, (i + 0), ((3 * i + 5) & 15), s[8]); \
+		HASH_MB_MD5_STEP(MD5_H, d, a, b, c, (i + 1), ((3 * i + 8) & 15), s[9]); \
+		HASH_MB_MD5_STEP(MD5_H, c, d, a, b, (i + 2), ((3 * i + 11) & 15), s[10]); \
+		HASH_MB_MD5_STEP(MD5_H, b, c, d, a, (i + 3), ((3 * i + 14) & 15), s[11]); \
+	}								\
+	for (i = 48; i < 64; i += 4) {					\
+		HASH_MB_MD5_STEP(MD5_I, a, b, c, d, (i + 0), ((7 * i) & 15), s[12]); \
+		HASH_MB_MD5_STEP(MD5_I, d, a, b, c, (i + 1), ((7 * i + 7) & 15), s[13]); \
+		HASH_MB_MD5_STEP(MD5_I, c, d, a, b, (i + 2), ((7 * i + 14) & 15), s[14]); \
+		HASH_MB_MD5_STEP(MD5_I, b, c, d, a, (i + 3), ((7 * i + 21) & 15), s[15]); \
+	}								\
+	a += aa;							\
+	b += bb;							\
+	c += cc;							\
+	d += dd;							\
+	HASH_MB_VSTORE(__vt, &state[(0 * (__lanes))], a);		\
+	HASH_MB_VSTORE(__vt, &state[(1 * (__lanes))], b);		\
+	HASH_MB_VSTORE(__vt, &state[(2 * (__lanes))], c);		\
+	HASH_MB_VSTORE(__vt, &state[(3 * (__lanes))], d);		\
+}
+
+#define HASH_MB_SHA1_FN(__name, __vt, __lanes, __attr)			\
+static __attr void							\
+__name(uint32_t *state, const uint32_t *msg) {				\
+	size_t t;							\
+	__vt a, b, c, d, e, tmp, W[80];					\
+									\
+	for (t = 0; t < 16; t ++) {					\
+		HASH_MB_VLOAD(__vt, W[t], &msg[(t * (__lanes))]);	\
+	}								\
+	for (t = 16; t < 80; t ++) {					\
+		tmp = (W[(t - 3)] ^ W[(t - 8)] ^ W[(t - 14)] ^ W[(t - 16)]); \
+		W[t] = SHA1_ROTL(1, tmp);				\
+	}								\
+	HASH_MB_VLOAD(__vt, a, &state[(0 * (__lanes))]);		\
+	HASH_MB_VLOAD(__vt, b, &state[(1 * (__lanes))]);		\
+	HASH_MB_VLOAD(__vt, c, &state[(2 * (__lanes))]);		\
+	HASH_MB_VLOAD(__vt, d, &state[(3 * (__lanes))]);		\
+	HASH_MB_VLOAD(__vt, e, &state[(4 * (__lanes))]);		\
+	for (t = 0; t < 80; t ++) {					\
+		if (20 > t) {						\
+			tmp = SHA1_Ch(b, c, d);				\
+		} else if (40 > t || 60 <= t) {				\
+			tmp = SHA1_Parity(b, c, d);			\
+		} else {						\
+			tmp = SHA1_Maj(b, c, d);			\
+		}							\
+		tmp += (SHA1_ROTL(5, a) + e + W[t] + hash_mb_sha1_k[(t / 20)]); \
+		e = d;							\
+		d = c;							\
+		c = SHA1_ROTL(30, b);					\
+		b = a;							\
+		a = tmp;						\
+	}								\
+	HASH_MB_VLOAD(__vt, tmp, &state[(0 * (__lanes))]);		\
+	a += tmp;							\
+	HASH_MB_VLOAD(__vt, tmp, &state[(1 * (__lanes))]);		\
+	b += tmp;							\
+	HASH_MB_VLOAD(__vt, tmp, &state[(2 * (__lanes))]);		\
+	c += tmp;							\
+	HASH_MB_VLOAD(__vt, tmp, &state[(3 * (__lanes))]);		\
+	d += tmp;							\
+	HASH_MB_VLOAD(__vt, tmp, &state[(4 * (__lanes))]);		\
+	e += tmp;							\
+	HASH_MB_VSTORE(__vt, &state[(0 * (__lanes))], a);		\
+	HASH_MB_VSTORE(__vt, &state[(1 * (__lanes))], b);		\
+	HASH_MB_VSTORE(__vt, &state[(2 * (__lanes))], c);		\
+	HASH_MB_VSTORE(__vt, &state[(3 * (__lanes))], d);		\
+	HASH_MB_VSTORE(__vt, &state[(4 * (__lanes))], e);		\
+}
+
+#define HASH_MB_SHA256_FN(__name, __vt, __lanes, __attr)		\
+static __attr void							\
+__name(uint32_t *state, const uint32_t *msg) {				\
+	size_t t;							\
+	__vt v[8], tmp1, tmp2, W[64];					\
+									\
+	for (t = 0; t < 16; t ++) {					\
+		HASH_MB_VLOAD(__vt, W[t], &msg[(t * (__lanes))]);	\
+	}								\
+	for (t = 16; t < 64; t ++) {					\
+		W[t] = (SHA2_32_sigma1(W[(t - 2)]) + W[(t - 7)] +	\
+		    SHA2_32_sigma0(W[(t - 15)]) + W[(t - 16)]);		\
+	}								\
+	for (t = 0; t < 8; t ++) {					\
+		HASH_MB_VLOAD(__vt, v[t], &state[(t * (__lanes))]);	\
+	}								\
+	for (t = 0; t < 64; t ++) {					\
+		tmp1 = (v[7] + SHA2_32_SIGMA1(v[4]) +			\
+		    SHA2_Ch(v[4], v[5], v[6]) + hash_mb_sha256_k[t] + W[t]); \
+		tmp2 = (SHA2_32_SIGMA0(v[0]) + SHA2_Maj(v[0], v[1], v[2])); \
+		v[7] = v[6];						\
+		v[6] = v[5];						\
+		v[5] = v[4];						\
+		v[4] = (v[3] + tmp1);					\
+		v[3] = v[2];						\
+		v[2] = v[1];						\
+		v[1] = v[0];						\
+		v[0] = (tmp1 + tmp2);					\
+	}								\
+	for (t = 0; t < 8; t ++) {					\
+		HASH_MB_VLOAD(__vt, tmp1, &state[(t * (__lanes))]);	\
+		v[t] += tmp1;						\
+		HASH_MB_VSTORE(__vt, &state[(t * (__lanes))], v[t]);	\
+	}								\
+}
+
+
+typedef uint32_t hash_mb_v4_t __attribute__((__vector_size__(16)));
+HASH_MB_MD5_FN(hash_mb_md5_x4, hash_mb_v4_t, 4, )
+HASH_MB_SHA1_FN(hash_mb_sha1_x4, hash_mb_v4_t, 4, )
+HASH_MB_SHA256_FN(hash_mb_sha256_x4, hash_mb_v4_t, 4, )
+
+#ifdef HASH_MB_X86
+typedef uint32_t hash_mb_v8_t __attribute__((__vector_size__(32)));
+HASH_MB_MD5_FN(hash_mb_md5_x8, hash_mb_v8_t, 8, HASH_MB_TARGET("avx2"))
+HASH_MB_SHA1_FN(hash_mb_sha1_x8, hash_mb_v8_t, 8, HASH_MB_TARGET("avx2"))
+HASH_MB_SHA256_FN(hash_mb_sha256_x8, hash_mb_v8_t, 8, HASH_MB_TARGET("avx2"))
+
+typedef uint32_t hash_mb_v16_t __attribute__((__vector_size__(64)));
+HASH_MB_MD5_FN(hash_mb_md5_x16, hash_mb_v16_t, 16, HASH_MB_TARGET("avx512f"))
+HASH_MB_SHA1_FN(hash_mb_sha1_x16, hash_mb_v16_t, 16, HASH_MB_TARGET("avx512f"))
+HASH_MB_SHA256_FN(hash_mb_sha256_x16, hash_mb_v16_t, 16, HASH_MB_TARGET("avx512f"))
+#endif
+#endif /* HASH_MB_VEC */
+
+
+static inline size_t
+hash_mb_hash_size(const uint32_t algo) {
+
+	switch (algo) {
+	case HASH_MB_ALGO_MD5:
+		return (MD5_HASH_SIZE);
+	case HASH_MB_ALGO_SHA1:
+		return (SHA1_HASH_SIZE);
+	case HASH_MB_ALGO_SHA2_224:
+		return (SHA2_224_HASH_SIZE);
+	case HASH_MB_ALGO_SHA2_256:
+		return (SHA2_256_HASH_SIZE);
+	}
+	return (0);
+}
+
+static inline int
+hash_mb_impl_is_supported(const uint32_t impl) {
+
+	switch (impl) {
+	case HASH_MB_IMPL_GENERIC:
+		return (1);
+#ifdef HASH_MB_VEC
+	case HASH_MB_IMPL_X4:
+		return (1);
+#endif
+#ifdef HASH_MB_X86
+	case HASH_MB_IMPL_X8:
+		return (0 != (CPU_F_AVX2 & cpu_features_get()));
+	case HASH_MB_IMPL_X16:
+		return (0 != (CPU_F_AVX512F & cpu_features_get()));
+#endif
+	}
+	return (0);
+}
+
+/* Widest supported lanes. */
+static inline uint32_t
+hash_mb_impl_best(void) {
+	static volatile uint32_t impl = HASH_MB_IMPL_AUTO;
+	uint32_t i;
+
+	if (HASH_MB_IMPL_AUTO != impl)
+		return (impl);
+	for (i = (HASH_MB_IMPL_COUNT - 1); HASH_MB_IMPL_GENERIC < i; i --) {
+		if (hash_mb_impl_is_supported(i))
+			break;
+	}
+	impl = i;
+
+	return (i);
+}
+
+static inline size_t
+hash_mb_impl_lanes(const uint32_t impl) {
+
+	switch (impl) {
+	case HASH_MB_IMPL_X4:
+		return (4);
+	case HASH_MB_IMPL_X8:
+		return (8);
+	case HASH_MB_IMPL_X16:
+		return (16);
+	}
+	return (1);
+}
+
+
+/* Start job in lane: load IV, prepare padding blocks. */
+static inline void
+hash_mb_lane_start(const uint32_t algo, hash_mb_lane_p lane,
+    uint32_t *state, const size_t lanes, const size_t lane_idx,
+    hash_mb_job_p job) {
+	size_t i, rem, words;
+	const uint32_t *h0;
+	uint64_t bits;
+
+	lane->job = job;
+	if (NULL == job)
+		return;
+	switch (algo) {
+	case HASH_MB_ALGO_MD5:
+		h0 = hash_mb_md5_h0;
+		words = nitems(hash_mb_md5_h0);
+		break;
+	case HASH_MB_ALGO_SHA1:
+		h0 = hash_mb_sha1_h0;
+		words = nitems(hash_mb_sha1_h0);
+		break;
+	case HASH_MB_ALGO_SHA2_224:
+		h0 = SHA2_224_H0;
+		words = nitems(SHA2_224_H0);
+		break;
+	default:
+		h0 = SHA2_256_H0;
+		words = nitems(SHA2_256_H0);
+		break;
+	}
+	for (i = 0; i < words; i ++) {
+		state[((i * lanes) + lane_idx)] = h0[i];
+	}
+	lane->data = job->data;
+	lane->blocks = (job->data_size / HASH_MB_BLK_SIZE);
+	rem = (job->data_size % HASH_MB_BLK_SIZE);
+	lane->tail_blocks = (((HASH_MB_BLK_SIZE - 8) > rem) ? 1 : 2);
+	lane->tail_idx = 0;
+	memcpy(lane->tail, (lane->data + (lane->blocks * HASH_MB_BLK_SIZE)),
+	    rem);
+	lane->tail[rem] = 0x80;
+	memset(&lane->tail[(rem + 1)], 0x00,
+	    ((lane->tail_blocks * HASH_MB_BLK_SIZE) - (rem + 1) - 8));
+	/* Message length in bits: MD5 - LE, SHA - BE. */
+	bits = (((uint64_t)job->data_size) << 3);
+	for (i = 0; i < 8; i ++) {
+		lane->tail[((lane->tail_blocks * HASH_MB_BLK_SIZE) - 8 +
+		    ((HASH_MB_ALGO_MD5 == algo) ? i : (7 - i)))] =
+		    (uint8_t)(bits >> (i * 8));
+	}
+}
+
+static inline void
+hash_mb_lane_digest(const uint32_t algo, hash_mb_lane_p lane,
+    const uint32_t *state, const size_t lanes, const size_t lane_idx) {
+	size_t i, words;
+	uint32_t val;
+	uint8_t *digest = lane->job->digest;
+
+	words = (hash_mb_hash_size(algo) / sizeof(uint32_t));
+	for (i = 0; i < words; i ++) {
+		val = state[((i * lanes) + lane_idx)];
+		if (HASH_MB_ALGO_MD5 == algo) {
+			digest[((i * 4) + 0)] = (uint8_t)(val);
+			digest[((i * 4) + 1)] = (uint8_t)(val >> 8);
+			digest[((i * 4) + 2)] = (uint8_t)(val >> 16);
+			digest[((i * 4) + 3)] = (uint8_t)(val >> 24);
+		} else {
+			digest[((i * 4) + 0)] = (uint8_t)(val >> 24);
+			digest[((i * 4) + 1)] = (uint8_t)(val >> 16);
+			digest[((i * 4) + 2)] = (uint8_t)(val >> 8);
+			digest[((i * 4) + 3)] = (uint8_t)(val);
+		}
+	}
+}
+
+/* Lanes scheduler: each lane take next job when previous is done,
+ * idle lanes hash zero block. */
+static inline void
+hash_mb_run(const uint32_t algo, const size_t lanes,
+    hash_mb_transform_fn transform, hash_mb_job_p jobs, size_t count) {
+	SHA2_ALIGN(64) uint32_t state[(HASH_MB_STATE_WORDS * HASH_MB_LANES_MAX)];
+	SHA2_ALIGN(64) uint32_t msg[(16 * HASH_MB_LANES_MAX)];
+	static const uint8_t zero_blk[HASH_MB_BLK_SIZE] = { 0 };
+	hash_mb_lane_t lane[HASH_MB_LANES_MAX];
+	size_t i, l, next = 0, active = 0;
+	const uint8_t *blk;
+
+	for (l = 0; l < lanes; l ++) {
+		hash_mb_lane_start(algo, &lane[l], state, lanes, l,
+		    ((next < count) ? &jobs[next ++] : NULL));
+		if (NULL != lane[l].job) {
+			active ++;
+		}
+	}
+	while (0 != active) {
+		/* Transpose: word i of lane l to msg[i * lanes + l]. */
+		for (l = 0; l < lanes; l ++) {
+			if (NULL == lane[l].job) {
+				blk = zero_blk;
+			} else if (0 != lane[l].blocks) {
+				blk = lane[l].data;
+				lane[l].data += HASH_MB_BLK_SIZE;
+				lane[l].blocks --;
+			} else {
+				blk = &lane[l].tail[(lane[l].tail_idx * HASH_MB_BLK_SIZE)];
+				lane[l].tail_idx ++;
+			}
+			if (HASH_MB_ALGO_MD5 == algo) {
+				for (i = 0; i < 16; i ++, blk += 4) {
+					msg[((i * lanes) + l)] = (((uint32_t)blk[0]) |
+					    (((uint32_t)blk[1]) << 8) |
+					    (((uint32_t)blk[2]) << 16) |
+					    (((uint32_t)blk[3]) << 24));
+				}
+			} else {
+				for (i = 0; i < 16; i ++, blk += 4) {
+					msg[((i * lanes) + l)] = ((((uint32_t)blk[0]) << 24) |
+					    (((uint32_t)blk[1]) << 16) |
+					    (((uint32_t)blk[2]) << 8) |
+					    ((uint32_t)blk[3]));
+				}
+			}
+		}
+		transform(state, msg);
+		for (l = 0; l < lanes; l ++) {
+			if (NULL == lane[l].job ||
+			    0 != lane[l].blocks ||
+			    lane[l].tail_idx < lane[l].tail_blocks)
+				continue;
+			hash_mb_lane_digest(algo, &lane[l], state, lanes, l);
+			hash_mb_lane_start(algo, &lane[l], state, lanes, l,
+			    ((next < count) ? &jobs[next ++] : NULL));
+			if (NULL == lane[l].job) {
+				active --;
+			}
+		}
+	}
+	/* Zeroize sensitive information. */
+	sha2_bzero(lane, sizeof(lane));
+	sha2_bzero(msg, sizeof(msg));
+}
+
+static inline int
+hash_mb_digest_impl(const uint32_t algo, uint32_t impl,
+    hash_mb_job_p jobs, const size_t count) {
+	size_t i;
+	hash_mb_transform_fn transform = NULL;
+
+	if (HASH_MB_ALGO_COUNT <= algo || (NULL == jobs && 0 != count))
+		return (EINVAL);
+	if (HASH_MB_IMPL_AUTO == impl) {
+		impl = hash_mb_impl_best();
+	}
+	if (0 == hash_mb_impl_is_supported(impl))
+		return (ENOTSUP);
+	for (i = 0; i < count; i ++) {
+		if ((NULL == jobs[i].data && 0 != jobs[i].data_size) ||
+		    NULL == jobs[i].digest)
+			return (EINVAL);
+	}
+
+	switch (impl) {
+#ifdef HASH_MB_VEC
+	case HASH_MB_IMPL_X4:
+		transform = ((HASH_MB_ALGO_MD5 == algo) ? hash_mb_md5_x4 :
+		    ((HASH_MB_ALGO_SHA1 == algo) ? hash_mb_sha1_x4 :
+		    hash_mb_sha256_x4));
+		break;
+#endif
+#ifdef HASH_MB_X86
+	case HASH_MB_IMPL_X8:
+		transform = ((HASH_MB_ALGO_MD5 == algo) ? hash_mb_md5_x8 :
+		    ((HASH_MB_ALGO_SHA1 == algo) ? hash_mb_sha1_x8 :
+		    hash_mb_sha256_x8));
+		break;
+	case HASH_MB_IMPL_X16:
+		transform = ((HASH_MB_ALGO_MD5 == algo) ? hash_mb_md5_x16 :
+		    ((HASH_MB_ALGO_SHA1 == algo) ? hash_mb_sha1_x16 :
+		    hash_mb_sha256_x16));
+		break;
+#endif
+	default: /* HASH_MB_IMPL_GENERIC */
+		for (i = 0; i < count; i ++) {
+			switch (algo) {
+			case HASH_MB_ALGO_MD5:
+				md5_get_digest(jobs[i].data, jobs[i].data_size,
+				    jobs[i].digest);
+				break;
+			case HASH_MB_ALGO_SHA1:
+				sha1_get_digest(jobs[i].data, jobs[i].data_size,
+				    jobs[i].digest);
+				break;
+			case HASH_MB_ALGO_SHA2_224:
+				sha2_get_digest(224, jobs[i].data,
+				    jobs[i].data_size, jobs[i].digest, NULL);
+				break;
+			case HASH_MB_ALGO_SHA2_256:
+				sha2_get_digest(256, jobs[i].data,
+				    jobs[i].data_size, jobs[i].digest, NULL);
+				break;
+			}
+		}
+		return (0);
+	}
+	hash_mb_run(algo, hash_mb_impl_lanes(impl), transform, jobs, count);
+
+	return (0);
+}
+
+/* Hash count messages, digest of each stored to job->digest. */
+static inline int
+hash_mb_digest(const uint32_t algo, hash_mb_job_p jobs, const size_t count) {
+
+	return (hash_mb_digest_impl(algo, HASH_MB_IMPL_AUTO, jobs, count));
+}
+
+
+#ifdef HASH_MB_SELF_TEST
+/* 0 - OK, non zero - error */
+static inline int
+hash_mb_self_test(void) {
+	size_t i, j, impl;
+	uint32_t algo;
+	uint8_t buf[1031];
+	uint8_t digest[37][SHA2_HASH_MAX_SIZE], digest_ref[SHA2_HASH_MAX_SIZE];
+	hash_mb_job_t jobs[37];
+
+	for (i = 0; i < sizeof(buf); i ++) {
+		buf[i] = (uint8_t)((i * 131) ^ (i >> 3));
+	}
+	for (algo = 0; algo < HASH_MB_ALGO_COUNT; algo ++) {
+		for (impl = 0; impl < HASH_MB_IMPL_COUNT; impl ++) {
+			if (0 == hash_mb_impl_is_supported((uint32_t)impl))
+				continue;
+			/* Different sizes: all lanes refilled at different
+			 * times, padding in 1 and 2 blocks. */
+			for (j = 0; j < 8; j ++) {
+				for (i = 0; i < nitems(jobs); i ++) {
+					jobs[i].data = &buf[(i + j)];
+					jobs[i].data_size = (((i * 29) + (j * 53)) % 200);
+					if (0 == j) {
+						jobs[i].data_size = i; /* 0..36 */
+					} else if (1 == j) {
+						jobs[i].data_size = (55 + (i % 11)); /* 55..65 */
+					} else if (7 == j) {
+						jobs[i].data_size = (sizeof(buf) - (i + j));
+					}
+					jobs[i].digest = digest[i];
+				}
+				if (0 != hash_mb_digest_impl(algo, (uint32_t)impl,
+				    jobs, (nitems(jobs) - j)))
+					return (1);
+				for (i = 0; i < (nitems(jobs) - j); i ++) {
+					jobs[i].digest = digest_ref;
+					hash_mb_digest_impl(algo,
+					    HASH_MB_IMPL_GENERIC, &jobs[i], 1);
+					if (0 != memcmp(digest[i], digest_ref,
+					    hash_mb_hash_size(algo)))
+						return ((int)(10 + (algo * 10) + impl));
+				}
+			}
+		}
+	}
+
+	return (0);
+}
+#endif
+
+#endif /* __HASH_MB_H__INCLUDED__ */
@@ -68,15 +68,16 @@
 #include <sys/types.h>
 #include <string.h> /* memcpy, memmove, memset, strerror... */
 #include <inttypes.h>
-#ifdef __SSE2__
-#	include <cpuid.h>
-#	include <xmmintrin.h> /* SSE */
-#	include <emmintrin.h> /* SSE2 */
-#	include <pmmintrin.h> /* SSE3 */
-#	include <tmmintrin.h> /* SSSE3 */
-#	include <smmintrin.h> /* SSE4.1 */
-#	include <nmmintrin.h> /* SSE4.2 */
-#	include <immintrin.h> /* AVX */
+#include <errno.h>
+/*
+ * x86-64: SSE message schedule and SHA extensions, selected at run time
+ * by cpuid, no -m flags required.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define SHA1_X86_SIMD	1
+#	include "al/cpu_features.h"
+#	include <immintrin.h>
+#	define SHA1_TARGET(__t)	__attribute__((__target__(__t)))
 #endif
 
 #ifndef bswap64
@@ -87,11 +88,6 @@
 #	define nitems(__val)	(sizeof(__val) / sizeof(__val[0]))
 #endif
 
-#if defined(__SHA__) && defined(__SSSE3__) && defined(__SSE4_1__)
-#	include <shaintrin.h>
-#	define SHA1_ENABLE_SIMD	1
-#endif
-
 #if defined(_MSC_VER) || defined(__INTEL_COMPILER)
 #	define SHA1_ALIGN(__n)	__declspec(align(__n)) /* DECLSPEC_ALIGN() */
 #else /* GCC/clang */
@@ -124,18 +120,23 @@ static void *(*volatile sha1_memset_volatile)(void*, int, size_t) = memset;
 #define SHA1_Parity(__x, __y, __z)	((__x) ^ (__y) ^ (__z))
 
 
+/* Implementations. */
+#define SHA1_IMPL_GENERIC	0
+#define SHA1_IMPL_SSE		1 /* SSSE3 + SSE4.1 message schedule. */
+#define SHA1_IMPL_SHANI		2 /* SHA extensions. */
+#define SHA1_IMPL_AUTO		0xff
+
+struct sha1_ctx_s;
+typedef void (*sha1_transform_fn)(struct sha1_ctx_s *ctx,
+    const uint8_t *blocks, const uint8_t *blocks_max);
+
 /* This structure will hold context information for the SHA-1 hashing operation. */
 typedef struct sha1_ctx_s {
 	uint64_t count; /* Number of bits, modulo 2^64 (lsb first). */
 	SHA1_ALIGN(32) uint32_t hash[(SHA1_HASH_SIZE / sizeof(uint32_t))]; /* State (ABCDE) / Message Digest. */
 	SHA1_ALIGN(32) uint64_t buffer[SHA1_MSG_BLK_64CNT]; /* Input buffer: 512-bit message blocks. */
 	SHA1_ALIGN(32) uint32_t W[80]; /* Temp buf for sha1_transform(). */
-#ifdef __SSE2__
-	int use_sse; /* SSE2+ transform. */
-#endif
-#ifdef SHA1_ENABLE_SIMD
-	int use_simd; /* SHA SIMD tansform. */
-#endif
+	sha1_transform_fn transform; /* Selected by sha1_init_impl(). */
 } sha1_ctx_t, *sha1_ctx_p;
 
 typedef struct hmac_sha1_ctx_s {
@@ -158,50 +159,6 @@ sha1_memcpy_bswap(uint8_t *dst, const uint8_t *src, size_t size) {
 	}
 }
 
-/*
- *  sha1_init
- *
- *  Description:
- *      This function will initialize the sha1_ctx in preparation
- *      for computing a new SHA1 message digest.
- *
- *  Parameters:
- *      ctx: [in/out]
- *          The ctx to reset.
- */
-static inline void
-sha1_init(sha1_ctx_p ctx) {
-#if defined(__SSE2__) || defined(SHA1_ENABLE_SIMD)
-	uint32_t eax, ebx, ecx, edx;
-#endif
-
-	/* Initial Hash Values: magic initialization constants. */
-	ctx->hash[0] = 0x67452301;
-	ctx->hash[1] = 0xefcdab89;
-	ctx->hash[2] = 0x98badcfe;
-	ctx->hash[3] = 0x10325476;
-	ctx->hash[4] = 0xc3d2e1f0;
-	ctx->count = 0;
-
-#ifdef __SSE2__
-	__get_cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
-	ctx->use_sse = 0;
-#	ifdef __SSE4_1__
-		ctx->use_sse |= (ecx & (((uint32_t)1) << 19));
-#	elif defined(__SSSE3__)
-		ctx->use_sse |= (ecx & (((uint32_t)1) <<  9));
-#	elif defined(__SSE3__)
-		ctx->use_sse |= (ecx & (((uint32_t)1) <<  0));
-#	elif defined(__SSE2__)
-		ctx->use_sse |= (edx & (((uint32_t)1) << 26));
-#	endif
-#endif
-#ifdef SHA1_ENABLE_SIMD
-	__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
-	ctx->use_simd = (ebx & (((uint32_t)1) << 29));
-#endif
-}
-
 /*
  *  sha1_transform
  *
@@ -292,7 +249,7 @@ sha1_transform_generic(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blo
 }
 
 
-#ifdef __SSE2__
+#ifdef SHA1_X86_SIMD
 
 #define SHA1_SSE_LOADU(__ptr, __xmm0, __xmm1, __xmm2, __xmm3) do { 	\
 	__xmm0 = _mm_loadu_si128(&((const __m128i*)(const void*)(__ptr))[0]); \
@@ -300,29 +257,19 @@ sha1_transform_generic(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blo
 	__xmm2 = _mm_loadu_si128(&((const __m128i*)(const void*)(__ptr))[2]); \
 	__xmm3 = _mm_loadu_si128(&((const __m128i*)(const void*)(__ptr))[3]); \
 } while (0)
-#ifdef __SSE4_1__ /* SSE4.1 required. */
 #define SHA1_SSE_STREAM_LOAD(__ptr, __xmm0, __xmm1, __xmm2, __xmm3) do { \
-	__xmm0 = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[0]); \
-	__xmm1 = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[1]); \
-	__xmm2 = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[2]); \
-	__xmm3 = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[3]); \
+	__xmm0 = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[0]); \
+	__xmm1 = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[1]); \
+	__xmm2 = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[2]); \
+	__xmm3 = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[3]); \
 } while (0)
-#endif
 
 
-#ifdef __SSSE3__ /* SSSE3 required. */
 #define _mm_bswap_epi32(__x) do {					\
 	(__x) = _mm_shuffle_epi8((__x), _mm_set_epi8(			\
 	    12, 13, 14, 15, 8,  9, 10, 11,				\
 	    4,  5,  6,  7, 0,  1,  2,  3)); 				\
 } while (0)
-#else
-#define _mm_bswap_epi32(__x) do {					\
-	(__x) = _mm_shufflehi_epi16((__x), _MM_SHUFFLE(2, 3, 0, 1));	\
-	(__x) = _mm_shufflelo_epi16((__x), _MM_SHUFFLE(2, 3, 0, 1));	\
-	(__x) = _mm_or_si128(_mm_slli_epi16((__x), 8), _mm_srli_epi16((__x), 8)); \
-} while (0)
-#endif
 
 /*
  * First 16 bytes just need byte swapping. Preparing just means
@@ -387,6 +334,7 @@ sha1_transform_generic(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blo
 /*
 * SHA-160 Compression Function using SSE for message expansion
 */
+SHA1_TARGET("ssse3,sse4.1")
 static inline void
 sha1_transform_sse(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blocks_max) {
 	const __m128i K00_19 = _mm_set1_epi32((int32_t)0x5a827999);
@@ -417,12 +365,9 @@ sha1_transform_sse(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blocks_
 	E = hash[4];
 
 	for (; blocks < blocks_max; blocks += SHA1_MSG_BLK_SIZE) {
-#ifdef __SSE4_1__ /* SSE4.1 required. */
 		if (0 == (((size_t)blocks) & 15)) { /* 16 byte alligned. */
 			SHA1_SSE_STREAM_LOAD(blocks, W0, W1, W2, W3);
-		} else 
-#endif
-		{ /* Unaligned. */
+		} else { /* Unaligned. */
 			SHA1_SSE_LOADU(blocks, W0, W1, W2, W3);
 			/* Shedule to load into cache. */
 			if ((blocks + (SHA1_MSG_BLK_SIZE * 8)) < blocks_max) {
@@ -560,9 +505,8 @@ sha1_transform_sse(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blocks_
 	/* Restore the Floating-point status on the CPU. */
 	_mm_empty();
 }
-#endif
 
-#ifdef SHA1_ENABLE_SIMD
+SHA1_TARGET("sha,ssse3,sse4.1")
 static inline void
 sha1_transform_simd(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blocks_max) {
 	const __m128i MASK = _mm_set_epi64x(0x0001020304050607ull, 0x08090a0b0c0d0e0full);
@@ -574,12 +518,9 @@ sha1_transform_simd(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blocks
 	E0 = (__m128i)_mm_set_epi32((int32_t)ctx->hash[4], 0, 0, 0);
 
 	for (; blocks < blocks_max; blocks += SHA1_MSG_BLK_SIZE) {
-#ifdef __SSE4_1__ /* SSE4.1 required. */
 		if (0 == (((size_t)blocks) & 15)) { /* 16 byte alligned. */
 			SHA1_SSE_STREAM_LOAD(blocks, MSG0, MSG1, MSG2, MSG3);
-		} else 
-#endif
-		{ /* Unaligned. */
+		} else { /* Unaligned. */
 			SHA1_SSE_LOADU(blocks, MSG0, MSG1, MSG2, MSG3);
 			/* Shedule to load into cache. */
 			if ((blocks + (SHA1_MSG_BLK_SIZE * 8)) < blocks_max) {
@@ -723,22 +664,128 @@ sha1_transform_simd(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blocks
 }
 #endif
 
+#define SHA1_CPU_F_INIT		(((uint32_t)1) << 0)
+#define SHA1_CPU_F_SSE		(((uint32_t)1) << 1) /* SSSE3 + SSE4.1. */
+#define SHA1_CPU_F_SHANI	(((uint32_t)1) << 2) /* SHA + SSSE3 + SSE4.1. */
+
+/* Return SHA1_CPU_F_* supported by CPU and build. */
+static inline uint32_t
+sha1_cpu_features_get(void) {
+	uint32_t ret = SHA1_CPU_F_INIT;
+#ifdef SHA1_X86_SIMD
+	const uint32_t cpu_features = cpu_features_get();
+
+	if (CPU_F_IS_SET(cpu_features, (CPU_F_SSSE3 | CPU_F_SSE41))) {
+		ret |= SHA1_CPU_F_SSE;
+		if (0 != (CPU_F_SHA & cpu_features)) {
+			ret |= SHA1_CPU_F_SHANI;
+		}
+	}
+#endif
+
+	return (ret);
+}
+
+/* 0 - not supported by CPU / build. */
+static inline int
+sha1_impl_is_supported(const uint32_t impl) {
+
+	switch (impl) {
+	case SHA1_IMPL_GENERIC:
+	case SHA1_IMPL_AUTO:
+		return (1);
+	case SHA1_IMPL_SSE:
+		return (0 != (SHA1_CPU_F_SSE & sha1_cpu_features_get()));
+	case SHA1_IMPL_SHANI:
+		return (0 != (SHA1_CPU_F_SHANI & sha1_cpu_features_get()));
+	}
+	return (0);
+}
+
 static inline void
 sha1_transform(sha1_ctx_p ctx, const uint8_t *blocks, const uint8_t *blocks_max) {
 
-#ifdef SHA1_ENABLE_SIMD
-	if (0 != ctx->use_simd) {
-		sha1_transform_simd(ctx, blocks, blocks_max);
-		return;
-	}
+	ctx->transform(ctx, blocks, blocks_max);
+}
+
+/*
+ *  sha1_init_impl
+ *
+ *  Description:
+ *      This function will initialize the sha1_ctx in preparation
+ *      for computing a new SHA1 message digest with specified
+ *      SHA1_IMPL_* transform.
+ *      Return ENOTSUP if not supported by CPU, ctx is usable with
+ *      generic transform anyway.
+ *
+ *  Parameters:
+ *      ctx: [in/out]
+ *          The ctx to reset.
+ *      impl: [in]
+ *          SHA1_IMPL_*.
+ */
+static inline int
+sha1_init_impl(sha1_ctx_p ctx, const uint32_t impl) {
+	uint32_t cpu_features;
+
+	/* Initial Hash Values: magic initialization constants. */
+	ctx->hash[0] = 0x67452301;
+	ctx->hash[1] = 0xefcdab89;
+	ctx->hash[2] = 0x98badcfe;
+	ctx->hash[3] = 0x10325476;
+	ctx->hash[4] = 0xc3d2e1f0;
+	ctx->count = 0;
+
+	ctx->transform = sha1_transform_generic;
+	cpu_features = sha1_cpu_features_get();
+	switch (impl) {
+	case SHA1_IMPL_GENERIC:
+		break;
+	case SHA1_IMPL_AUTO:
+#ifdef SHA1_X86_SIMD
+		if (0 != (SHA1_CPU_F_SHANI & cpu_features)) {
+			ctx->transform = sha1_transform_simd;
+		} else if (0 != (SHA1_CPU_F_SSE & cpu_features)) {
+			ctx->transform = sha1_transform_sse;
+		}
 #endif
-#ifdef __SSE2__
-	if (0 != ctx->use_sse) {
-		sha1_transform_sse(ctx, blocks, blocks_max);
-		return;
-	}
+		break;
+	case SHA1_IMPL_SSE:
+		if (0 == (SHA1_CPU_F_SSE & cpu_features))
+			return (ENOTSUP);
+#ifdef SHA1_X86_SIMD
+		ctx->transform = sha1_transform_sse;
+#endif
+		break;
+	case SHA1_IMPL_SHANI:
+		if (0 == (SHA1_CPU_F_SHANI & cpu_features))
+			return (ENOTSUP);
+#ifdef SHA1_X86_SIMD
+		ctx->transform = sha1_transform_simd;
 #endif
-	sha1_transform_generic(ctx, blocks, blocks_max);
+		break;
+	default:
+		return (EINVAL);
+	}
+
+	return (0);
+}
+
+/*
+ *  sha1_init
+ *
+ *  Description:
+ *      This function will initialize the sha1_ctx in preparation
+ *      for computing a new SHA1 message digest.
+ *
+ *  Parameters:
+ *      ctx: [in/out]
+ *          The ctx to reset.
+ */
+static inline void
+sha1_init(sha1_ctx_p ctx) {
+
+	sha1_init_impl(ctx, SHA1_IMPL_AUTO);
 }
 
 
@@ -990,6 +1037,7 @@ sha1_hmac_get_digest_str(const char *key, size_t key_size,
 static inline int
 sha1_self_test(void) {
 	size_t i, j;
+	uint32_t impl;
 	sha1_ctx_t ctx;
 	uint8_t digest[SHA1_HASH_SIZE];
 	char digest_str[SHA1_HASH_STR_SIZE + 1]; /* Calculated digest. */
@@ -1054,16 +1102,20 @@ sha1_self_test(void) {
 	    "d5d9e4085429568f05a4ef8233f42722c4462d6c"
 	};
 
-	/* Hash test. */
-	for (i = 0; i < nitems(data); i ++) {
-		sha1_init(&ctx);
-		for (j = 0; j < repeat_count[i]; j ++) {
-			sha1_update(&ctx, (const uint8_t*)data[i], data_size[i]);
+	/* Hash test, all supported implementations. */
+	for (impl = SHA1_IMPL_GENERIC; impl <= SHA1_IMPL_SHANI; impl ++) {
+		if (0 == sha1_impl_is_supported(impl))
+			continue;
+		for (i = 0; i < nitems(data); i ++) {
+			sha1_init_impl(&ctx, impl);
+			for (j = 0; j < repeat_count[i]; j ++) {
+				sha1_update(&ctx, (const uint8_t*)data[i], data_size[i]);
+			}
+			sha1_final(&ctx, digest);
+			sha1_cvt_hex(digest, (uint8_t*)digest_str);
+			if (0 != memcmp(digest_str, result_digest[i], SHA1_HASH_STR_SIZE))
+				return (1);
 		}
-		sha1_final(&ctx, digest);
-		sha1_cvt_hex(digest, (uint8_t*)digest_str);
-		if (0 != memcmp(digest_str, result_digest[i], SHA1_HASH_STR_SIZE))
-			return (1);
 	}
 	/* HMAC test. */
 	for (i = 0; i < nitems(data); i ++) {
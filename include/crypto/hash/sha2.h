@@ -38,17 +38,16 @@
 #include <sys/types.h>
 #include <string.h> /* memcpy, memmove, memset, strerror... */
 #include <inttypes.h>
-#if defined(__SHA__) && defined(__SSSE3__) && defined(__SSE4_1__)
-#	include <cpuid.h>
-#	include <xmmintrin.h> /* SSE */
-#	include <emmintrin.h> /* SSE2 */
-#	include <pmmintrin.h> /* SSE3 */
-#	include <tmmintrin.h> /* SSSE3 */
-#	include <smmintrin.h> /* SSE4.1 */
-#	include <nmmintrin.h> /* SSE4.2 */
-#	include <immintrin.h> /* AVX */
-#	include <shaintrin.h>
-#	define SHA2_ENABLE_SIMD	1
+#include <errno.h>
+/*
+ * x86-64: SHA extensions for SHA-224/256 and AVX2 message schedule for
+ * SHA-384/512, selected at run time by cpuid, no -m flags required.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define SHA2_X86_SIMD	1
+#	include "al/cpu_features.h"
+#	include <immintrin.h>
+#	define SHA2_TARGET(__t)	__attribute__((__target__(__t)))
 #endif
 
 #ifndef bswap64
@@ -148,6 +147,16 @@ static const uint64_t SHA2_512_H0[(SHA2_512_HASH_SIZE / sizeof(uint64_t))] = {
 };
 
 
+/* Implementations. */
+#define SHA2_IMPL_GENERIC	0
+#define SHA2_IMPL_SHANI		1 /* SHA-224/256: SHA extensions. */
+#define SHA2_IMPL_AVX2		2 /* SHA-384/512: AVX2 message schedule. */
+#define SHA2_IMPL_AUTO		0xff
+
+struct sha2_ctx_s;
+typedef void (*sha2_transform_fn)(struct sha2_ctx_s *ctx,
+    const uint8_t *blocks, const uint8_t *blocks_max);
+
 /* This structure will hold context information for the SHA-1 hashing operation. */
 typedef struct sha2_ctx_s {
 	SHA2_ALIGN(32) uint64_t hash[(SHA2_HASH_MAX_SIZE / sizeof(uint64_t))]; /* Message Digest. */
@@ -157,9 +166,7 @@ typedef struct sha2_ctx_s {
 	uint64_t count_hi;	/* Number of bits high. */
 	size_t hash_size;	/* hash size of SHA being used */
 	size_t block_size;	/* block size of SHA being used */
-#ifdef SHA2_ENABLE_SIMD
-	int use_simd;		/* Use SIMD SHA */
-#endif
+	sha2_transform_fn transform; /* Selected by sha2_init_impl(). */
 } sha2_ctx_t, *sha2_ctx_p;
 
 typedef struct hmac_sha2_ctx_s {
@@ -203,53 +210,6 @@ sha2_memcpy_bswap8(uint8_t *dst, const uint8_t *src, const size_t size) {
 	}
 }
 
-/*
- *  sha2_init
- *
- *  Description:
- *      This function will initialize the sha2_ctx in preparation
- *      for computing a new SHA2 message digest.
- */
-static inline void
-sha2_init(const size_t bits, sha2_ctx_p ctx) {
-	
-	/* Load magic initialization constants. */
-	switch (bits) {
-	case 224:
-	case SHA2_224_HASH_SIZE:
-		ctx->hash_size = SHA2_224_HASH_SIZE;
-		ctx->block_size = SHA2_256_MSG_BLK_SIZE;
-		memcpy(&ctx->hash, SHA2_224_H0, sizeof(SHA2_224_H0));
-		break;
-	case 256:
-	case SHA2_256_HASH_SIZE:
-		ctx->hash_size = SHA2_256_HASH_SIZE;
-		ctx->block_size = SHA2_256_MSG_BLK_SIZE;
-		memcpy(&ctx->hash, SHA2_256_H0, sizeof(SHA2_256_H0));
-		break;
-	case 384:
-	case SHA2_384_HASH_SIZE:
-		ctx->hash_size = SHA2_384_HASH_SIZE;
-		ctx->block_size = SHA2_512_MSG_BLK_SIZE;
-		memcpy(&ctx->hash, SHA2_384_H0, sizeof(SHA2_384_H0));
-		break;
-	case 512:
-	case SHA2_512_HASH_SIZE:
-		ctx->hash_size = SHA2_512_HASH_SIZE;
-		ctx->block_size = SHA2_512_MSG_BLK_SIZE;
-		memcpy(&ctx->hash, SHA2_512_H0, sizeof(SHA2_512_H0));
-		break;
-	}
-	ctx->count = 0;
-	ctx->count_hi = 0;
-#ifdef SHA2_ENABLE_SIMD
-	uint32_t eax, ebx, ecx, edx;
-
-	__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
-	ctx->use_simd = (ebx & (((uint32_t)1) << 29));
-#endif
-}
-
 /*
  * SHA2_224_256ProcessMessageBlock
  *
@@ -327,7 +287,7 @@ sha2_transform_block64_generic(sha2_ctx_p ctx, const uint8_t *blocks,
 }
 
 
-#ifdef SHA2_ENABLE_SIMD
+#ifdef SHA2_X86_SIMD
 
 #define SHA2_SSE_LOADU(__ptr, __xmm0, __xmm1, __xmm2, __xmm3) do { 	\
 	__xmm0 = _mm_loadu_si128(&((const __m128i*)(const void*)(__ptr))[0]); \
@@ -335,15 +295,14 @@ sha2_transform_block64_generic(sha2_ctx_p ctx, const uint8_t *blocks,
 	__xmm2 = _mm_loadu_si128(&((const __m128i*)(const void*)(__ptr))[2]); \
 	__xmm3 = _mm_loadu_si128(&((const __m128i*)(const void*)(__ptr))[3]); \
 } while (0)
-#ifdef __SSE4_1__ /* SSE4.1 required. */
 #define SHA2_SSE_STREAM_LOAD(__ptr, __xmm0, __xmm1, __xmm2, __xmm3) do { \
-	__xmm0 = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[0]); \
-	__xmm1 = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[1]); \
-	__xmm2 = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[2]); \
-	__xmm3 = _mm_stream_load_si128(&((const __m128i*)(const void*)(__ptr))[3]); \
+	__xmm0 = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[0]); \
+	__xmm1 = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[1]); \
+	__xmm2 = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[2]); \
+	__xmm3 = _mm_stream_load_si128(&((__m128i*)(void*)(size_t)(__ptr))[3]); \
 } while (0)
-#endif
 
+SHA2_TARGET("sha,ssse3,sse4.1")
 static inline void
 sha2_transform_block64_simd(sha2_ctx_p ctx, const uint8_t *blocks,
     const uint8_t *blocks_max) {
@@ -360,12 +319,9 @@ sha2_transform_block64_simd(sha2_ctx_p ctx, const uint8_t *blocks,
 	STATE1 = _mm_blend_epi16(STATE1, TMP, 0xf0); /* CDGH */
 
 	for (; blocks < blocks_max; blocks += SHA2_256_MSG_BLK_SIZE) {
-#ifdef __SSE4_1__ /* SSE4.1 required. */
 		if (0 == (((size_t)blocks) & 15)) { /* 16 byte alligned. */
 			SHA2_SSE_STREAM_LOAD(blocks, TMSG0, TMSG1, TMSG2, TMSG3);
-		} else 
-#endif
-		{ /* Unaligned. */
+		} else { /* Unaligned. */
 			SHA2_SSE_LOADU(blocks, TMSG0, TMSG1, TMSG2, TMSG3);
 			/* Shedule to load into cache. */
 			if ((blocks + (SHA2_256_MSG_BLK_SIZE * 8)) < blocks_max) {
@@ -521,53 +477,44 @@ sha2_transform_block64_simd(sha2_ctx_p ctx, const uint8_t *blocks,
 }
 #endif
 
-/*
- * SHA2_384_512ProcessMessageBlock
- *
- * Description:
- *   This helper function will process the next 1024 bits of the
- *   message stored in the Message_Block array.
- */
+/* Constants defined in FIPS-180-2, section 4.2.3 */
+static const uint64_t SHA2_512_K[80] = {
+	0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full,
+	0xe9b5dba58189dbbcull, 0x3956c25bf348b538ull, 0x59f111f1b605d019ull,
+	0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull, 0xd807aa98a3030242ull,
+	0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
+	0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull,
+	0xc19bf174cf692694ull, 0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull,
+	0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull, 0x2de92c6f592b0275ull,
+	0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
+	0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full,
+	0xbf597fc7beef0ee4ull, 0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull,
+	0x06ca6351e003826full, 0x142929670a0e6e70ull, 0x27b70a8546d22ffcull,
+	0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
+	0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull,
+	0x92722c851482353bull, 0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull,
+	0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull, 0xd192e819d6ef5218ull,
+	0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
+	0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull,
+	0x34b0bcb5e19b48a8ull, 0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull,
+	0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull, 0x748f82ee5defb2fcull,
+	0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
+	0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull,
+	0xc67178f2e372532bull, 0xca273eceea26619cull, 0xd186b8c721c0c207ull,
+	0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull, 0x06f067aa72176fbaull,
+	0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
+	0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull,
+	0x431d67c49c100d4cull, 0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull,
+	0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull
+};
+
+/* 80 rounds, message schedule word t at W[(t * stride)]. */
 static inline void
-sha2_transform_block128_generic(sha2_ctx_p ctx, const uint8_t *blocks,
-    const uint8_t *blocks_max) {
-	/* Constants defined in FIPS-180-2, section 4.2.3 */
-	static const uint64_t K[80] = {
-		0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full,
-		0xe9b5dba58189dbbcull, 0x3956c25bf348b538ull, 0x59f111f1b605d019ull,
-		0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull, 0xd807aa98a3030242ull,
-		0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
-		0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull,
-		0xc19bf174cf692694ull, 0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull,
-		0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull, 0x2de92c6f592b0275ull,
-		0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
-		0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full,
-		0xbf597fc7beef0ee4ull, 0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull,
-		0x06ca6351e003826full, 0x142929670a0e6e70ull, 0x27b70a8546d22ffcull,
-		0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
-		0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull,
-		0x92722c851482353bull, 0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull,
-		0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull, 0xd192e819d6ef5218ull,
-		0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
-		0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull,
-		0x34b0bcb5e19b48a8ull, 0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull,
-		0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull, 0x748f82ee5defb2fcull,
-		0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
-		0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull,
-		0xc67178f2e372532bull, 0xca273eceea26619cull, 0xd186b8c721c0c207ull,
-		0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull, 0x06f067aa72176fbaull,
-		0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
-		0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull,
-		0x431d67c49c100d4cull, 0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull,
-		0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull
-	};
+sha2_block128_rounds(uint64_t *hash, const uint64_t *W, const size_t stride) {
 	register uint32_t t; /* Loop counter. */
 	register uint64_t temp1, temp2; /* Temporary word value. */
 	register uint64_t A, B, C, D, E, F, G, H; /* Word buffers. */
-	uint64_t *W, *hash; /* Word sequence. */
 
-	W = ctx->W;
-	hash = ctx->hash;
 	A = hash[0];
 	B = hash[1];
 	C = hash[2];
@@ -577,6 +524,45 @@ sha2_transform_block128_generic(sha2_ctx_p ctx, const uint8_t *blocks,
 	G = hash[6];
 	H = hash[7];
 
+#pragma unroll
+	for (t = 0; t < 80; t ++) {
+		temp1 = H + SHA2_64_SIGMA1(E) + SHA2_Ch(E, F, G) +
+		    SHA2_512_K[t] + W[(t * stride)];
+		temp2 = SHA2_64_SIGMA0(A) + SHA2_Maj(A, B, C);
+		H = G;
+		G = F;
+		F = E;
+		E = D + temp1;
+		D = C;
+		C = B;
+		B = A;
+		A = temp1 + temp2;
+	}
+
+	hash[0] += A;
+	hash[1] += B;
+	hash[2] += C;
+	hash[3] += D;
+	hash[4] += E;
+	hash[5] += F;
+	hash[6] += G;
+	hash[7] += H;
+}
+
+/*
+ * SHA2_384_512ProcessMessageBlock
+ *
+ * Description:
+ *   This helper function will process the next 1024 bits of the
+ *   message stored in the Message_Block array.
+ */
+static inline void
+sha2_transform_block128_generic(sha2_ctx_p ctx, const uint8_t *blocks,
+    const uint8_t *blocks_max) {
+	register uint32_t t; /* Loop counter. */
+	uint64_t *W; /* Word sequence. */
+
+	W = ctx->W;
 	for (; blocks < blocks_max; blocks += SHA2_512_MSG_BLK_SIZE) {
 		/* Initialize the first 16 words in the array W. */
 		sha2_memcpy_bswap8((uint8_t*)W, blocks, SHA2_512_MSG_BLK_SIZE);
@@ -586,46 +572,232 @@ sha2_transform_block128_generic(sha2_ctx_p ctx, const uint8_t *blocks,
 			W[t] = (SHA2_64_sigma1(W[(t - 2)]) + W[(t - 7)] +
 				SHA2_64_sigma0(W[(t - 15)]) + W[(t - 16)]);
 		}
+		sha2_block128_rounds(ctx->hash, W, 1);
+	}
+}
+
+#ifdef SHA2_X86_SIMD
 
+#define SHA2_AVX2_ROTR64(__n, __ymm)					\
+	_mm256_or_si256(_mm256_srli_epi64((__ymm), (__n)),		\
+	    _mm256_slli_epi64((__ymm), (64 - (__n))))
+#define SHA2_AVX2_64_sigma0(__ymm)					\
+	_mm256_xor_si256(_mm256_xor_si256(SHA2_AVX2_ROTR64(1, (__ymm)),	\
+	    SHA2_AVX2_ROTR64(8, (__ymm))), _mm256_srli_epi64((__ymm), 7))
+#define SHA2_AVX2_64_sigma1(__ymm)					\
+	_mm256_xor_si256(_mm256_xor_si256(SHA2_AVX2_ROTR64(19, (__ymm)), \
+	    SHA2_AVX2_ROTR64(61, (__ymm))), _mm256_srli_epi64((__ymm), 6))
+
+/*
+ * Message schedule does not depend on hash state, so it is computed
+ * for up to 4 blocks at once: one block per 64 bit lane, W[t] of all
+ * blocks in one ymm register. Rounds stay scalar.
+ */
+SHA2_TARGET("avx2")
+static inline void
+sha2_transform_block128_avx2(sha2_ctx_p ctx, const uint8_t *blocks,
+    const uint8_t *blocks_max) {
+	const __m256i MASK = _mm256_set_epi64x(
+	    0x08090a0b0c0d0e0fll, 0x0001020304050607ll,
+	    0x08090a0b0c0d0e0fll, 0x0001020304050607ll);
+	SHA2_ALIGN(32) __m256i W[80]; /* W[t] for 4 blocks. */
+	__m256i R0, R1, R2, R3, T0, T1, T2, T3;
+	const uint8_t *blk[4];
+	size_t i, t, cnt;
+
+	while (blocks < blocks_max) {
+		cnt = (size_t)((blocks_max - blocks) / SHA2_512_MSG_BLK_SIZE);
+		if (4 < cnt) {
+			cnt = 4;
+		}
+		/* Unused lanes repeat last block. */
+		for (i = 0; i < 4; i ++) {
+			blk[i] = (blocks + (SHA2_512_MSG_BLK_SIZE *
+			    ((i < cnt) ? i : (cnt - 1))));
+		}
+		/* Load, bswap and transpose 4x4 words. */
+		for (t = 0; t < 16; t += 4) {
+			R0 = _mm256_shuffle_epi8(_mm256_loadu_si256(
+			    (const __m256i*)(const void*)(blk[0] + (t * 8))), MASK);
+			R1 = _mm256_shuffle_epi8(_mm256_loadu_si256(
+			    (const __m256i*)(const void*)(blk[1] + (t * 8))), MASK);
+			R2 = _mm256_shuffle_epi8(_mm256_loadu_si256(
+			    (const __m256i*)(const void*)(blk[2] + (t * 8))), MASK);
+			R3 = _mm256_shuffle_epi8(_mm256_loadu_si256(
+			    (const __m256i*)(const void*)(blk[3] + (t * 8))), MASK);
+			T0 = _mm256_unpacklo_epi64(R0, R1);
+			T1 = _mm256_unpackhi_epi64(R0, R1);
+			T2 = _mm256_unpacklo_epi64(R2, R3);
+			T3 = _mm256_unpackhi_epi64(R2, R3);
+			W[(t + 0)] = _mm256_permute2x128_si256(T0, T2, 0x20);
+			W[(t + 1)] = _mm256_permute2x128_si256(T1, T3, 0x20);
+			W[(t + 2)] = _mm256_permute2x128_si256(T0, T2, 0x31);
+			W[(t + 3)] = _mm256_permute2x128_si256(T1, T3, 0x31);
+		}
 #pragma unroll
-		for (t = 0; t < 80; t ++) {
-			temp1 = H + SHA2_64_SIGMA1(E) + SHA2_Ch(E, F, G) + K[t] + W[t];
-			temp2 = SHA2_64_SIGMA0(A) + SHA2_Maj(A, B, C);
-			H = G;
-			G = F;
-			F = E;
-			E = D + temp1;
-			D = C;
-			C = B;
-			B = A;
-			A = temp1 + temp2;
+		for (t = 16; t < 80; t ++) {
+			W[t] = _mm256_add_epi64(
+			    _mm256_add_epi64(SHA2_AVX2_64_sigma1(W[(t - 2)]), W[(t - 7)]),
+			    _mm256_add_epi64(SHA2_AVX2_64_sigma0(W[(t - 15)]), W[(t - 16)]));
+		}
+		for (i = 0; i < cnt; i ++) {
+			sha2_block128_rounds(ctx->hash,
+			    (((const uint64_t*)(const void*)W) + i), 4);
 		}
+		blocks += (SHA2_512_MSG_BLK_SIZE * cnt);
+	}
+}
+#endif
 
-		A = (hash[0] += A);
-		B = (hash[1] += B);
-		C = (hash[2] += C);
-		D = (hash[3] += D);
-		E = (hash[4] += E);
-		F = (hash[5] += F);
-		G = (hash[6] += G);
-		H = (hash[7] += H);
+#define SHA2_CPU_F_INIT		(((uint32_t)1) << 0)
+#define SHA2_CPU_F_SHANI	(((uint32_t)1) << 1) /* SHA + SSSE3 + SSE4.1. */
+#define SHA2_CPU_F_AVX2		(((uint32_t)1) << 2)
+
+/* Return SHA2_CPU_F_* supported by CPU and build. */
+static inline uint32_t
+sha2_cpu_features_get(void) {
+	uint32_t ret = SHA2_CPU_F_INIT;
+#ifdef SHA2_X86_SIMD
+	const uint32_t cpu_features = cpu_features_get();
+
+	if (CPU_F_IS_SET(cpu_features,
+	    (CPU_F_SHA | CPU_F_SSSE3 | CPU_F_SSE41))) {
+		ret |= SHA2_CPU_F_SHANI;
+	}
+	if (0 != (CPU_F_AVX2 & cpu_features)) {
+		ret |= SHA2_CPU_F_AVX2;
 	}
+#endif
+
+	return (ret);
+}
+
+/* 0 - not supported by CPU / build. */
+static inline int
+sha2_impl_is_supported(const uint32_t impl) {
+
+	switch (impl) {
+	case SHA2_IMPL_GENERIC:
+	case SHA2_IMPL_AUTO:
+		return (1);
+	case SHA2_IMPL_SHANI:
+		return (0 != (SHA2_CPU_F_SHANI & sha2_cpu_features_get()));
+	case SHA2_IMPL_AVX2:
+		return (0 != (SHA2_CPU_F_AVX2 & sha2_cpu_features_get()));
+	}
+	return (0);
 }
 
 static inline void
 sha2_transform(sha2_ctx_p ctx, const uint8_t *blocks, const uint8_t *blocks_max) {
 
-	if (SHA2_512_MSG_BLK_SIZE == ctx->block_size) {
-		sha2_transform_block128_generic(ctx, blocks, blocks_max);
-		return;
-	}
-#ifdef SHA2_ENABLE_SIMD
-	if (ctx->use_simd) {
-		sha2_transform_block64_simd(ctx, blocks, blocks_max);
-		return;
+	ctx->transform(ctx, blocks, blocks_max);
+}
+
+/*
+ *  sha2_init_impl
+ *
+ *  Description:
+ *      This function will initialize the sha2_ctx in preparation
+ *      for computing a new SHA2 message digest with specified
+ *      SHA2_IMPL_* transform.
+ *      Return EINVAL if bits not supported, ctx not initialized.
+ *      Return EINVAL if impl not for this hash size, ENOTSUP if not
+ *      supported by CPU, ctx is usable with generic transform anyway.
+ */
+static inline int
+sha2_init_impl(const size_t bits, const uint32_t impl, sha2_ctx_p ctx) {
+	uint32_t cpu_features;
+	
+	/* Load magic initialization constants. */
+	switch (bits) {
+	case 224:
+	case SHA2_224_HASH_SIZE:
+		ctx->hash_size = SHA2_224_HASH_SIZE;
+		ctx->block_size = SHA2_256_MSG_BLK_SIZE;
+		memcpy(&ctx->hash, SHA2_224_H0, sizeof(SHA2_224_H0));
+		break;
+	case 256:
+	case SHA2_256_HASH_SIZE:
+		ctx->hash_size = SHA2_256_HASH_SIZE;
+		ctx->block_size = SHA2_256_MSG_BLK_SIZE;
+		memcpy(&ctx->hash, SHA2_256_H0, sizeof(SHA2_256_H0));
+		break;
+	case 384:
+	case SHA2_384_HASH_SIZE:
+		ctx->hash_size = SHA2_384_HASH_SIZE;
+		ctx->block_size = SHA2_512_MSG_BLK_SIZE;
+		memcpy(&ctx->hash, SHA2_384_H0, sizeof(SHA2_384_H0));
+		break;
+	case 512:
+	case SHA2_512_HASH_SIZE:
+		ctx->hash_size = SHA2_512_HASH_SIZE;
+		ctx->block_size = SHA2_512_MSG_BLK_SIZE;
+		memcpy(&ctx->hash, SHA2_512_H0, sizeof(SHA2_512_H0));
+		break;
+	default:
+		return (EINVAL);
 	}
+	ctx->count = 0;
+	ctx->count_hi = 0;
+
+	/* Generic fallback. */
+	ctx->transform = ((SHA2_512_MSG_BLK_SIZE == ctx->block_size) ?
+	    sha2_transform_block128_generic : sha2_transform_block64_generic);
+	cpu_features = sha2_cpu_features_get();
+	switch (impl) {
+	case SHA2_IMPL_GENERIC:
+		break;
+	case SHA2_IMPL_AUTO:
+#ifdef SHA2_X86_SIMD
+		if (SHA2_512_MSG_BLK_SIZE == ctx->block_size) {
+			if (0 != (SHA2_CPU_F_AVX2 & cpu_features)) {
+				ctx->transform = sha2_transform_block128_avx2;
+			}
+		} else {
+			if (0 != (SHA2_CPU_F_SHANI & cpu_features)) {
+				ctx->transform = sha2_transform_block64_simd;
+			}
+		}
+#endif
+		break;
+	case SHA2_IMPL_SHANI:
+		if (SHA2_256_MSG_BLK_SIZE != ctx->block_size)
+			return (EINVAL);
+		if (0 == (SHA2_CPU_F_SHANI & cpu_features))
+			return (ENOTSUP);
+#ifdef SHA2_X86_SIMD
+		ctx->transform = sha2_transform_block64_simd;
 #endif
-	sha2_transform_block64_generic(ctx, blocks, blocks_max);
+		break;
+	case SHA2_IMPL_AVX2:
+		if (SHA2_512_MSG_BLK_SIZE != ctx->block_size)
+			return (EINVAL);
+		if (0 == (SHA2_CPU_F_AVX2 & cpu_features))
+			return (ENOTSUP);
+#ifdef SHA2_X86_SIMD
+		ctx->transform = sha2_transform_block128_avx2;
+#endif
+		break;
+	default:
+		return (EINVAL);
+	}
+
+	return (0);
+}
+
+/*
+ *  sha2_init
+ *
+ *  Description:
+ *      This function will initialize the sha2_ctx in preparation
+ *      for computing a new SHA2 message digest.
+ *      Return EINVAL if bits not supported.
+ */
+static inline int
+sha2_init(const size_t bits, sha2_ctx_p ctx) {
+
+	return (sha2_init_impl(bits, SHA2_IMPL_AUTO, ctx));
 }
 
 /*
@@ -760,20 +932,23 @@ sha2_final(sha2_ctx_p ctx, uint8_t *digest) {
  * key_len - length of authentication key
  * digest - caller digest to be filled in
  */
-static inline void
+static inline int
 hmac_sha2_init(const size_t bits, const uint8_t *key, const size_t key_len,
     hmac_sha2_ctx_p hctx) {
 	register size_t i = key_len;
+	int error;
 	uint64_t k_ipad[SHA2_MSG_BLK_MAX_64CNT]; /* inner padding - key XORd with ipad. */
 
 	/* Start out by storing key in pads. */
 	/* If key is longer than block_size bytes reset it to key = SHA2(key). */
-	sha2_init(bits, &hctx->ctx); /* Init context for 1st pass / Get hash params. */
+	error = sha2_init(bits, &hctx->ctx); /* Init context for 1st pass / Get hash params. */
+	if (0 != error)
+		return (error);
 	if (hctx->ctx.block_size < i) {
 		sha2_update(&hctx->ctx, key, i);
 		i = hctx->ctx.hash_size;
 		sha2_final(&hctx->ctx, (uint8_t*)k_ipad);
-		sha2_init(bits, &hctx->ctx); /* Reinit context for 1st pass. */
+		sha2_init(bits, &hctx->ctx); /* Reinit context for 1st pass, bits already checked. */
 	} else {
 		memcpy(k_ipad, key, i);
 	}
@@ -790,6 +965,8 @@ hmac_sha2_init(const size_t bits, const uint8_t *key, const size_t key_len,
 	sha2_update(&hctx->ctx, (uint8_t*)k_ipad, hctx->ctx.block_size); /* Start with inner pad. */
 	/* Zeroize sensitive information. */
 	sha2_bzero(k_ipad, sizeof(k_ipad));
+
+	return (0);
 }
 
 static inline void
@@ -805,7 +982,7 @@ hmac_sha2_final(hmac_sha2_ctx_p hctx, uint8_t *digest, size_t *digest_size) {
 	bits = hctx->ctx.hash_size;
 	sha2_final(&hctx->ctx, digest); /* Finish up 1st pass. */
 	/* Perform outer SHA2. */
-	sha2_init(bits, &hctx->ctx); /* Init context for 2nd pass. */
+	sha2_init(bits, &hctx->ctx); /* Init context for 2nd pass, hash size is valid bits. */
 	sha2_update(&hctx->ctx, (uint8_t*)hctx->k_opad, hctx->ctx.block_size); /* Start with outer pad. */
 	sha2_update(&hctx->ctx, digest, hctx->ctx.hash_size); /* Then results of 1st hash. */
 	if (NULL != digest_size) {
@@ -816,15 +993,20 @@ hmac_sha2_final(hmac_sha2_ctx_p hctx, uint8_t *digest, size_t *digest_size) {
 	sha2_bzero(hctx->k_opad, sizeof(hctx->k_opad));
 }
 
-static inline void
+static inline int
 hmac_sha2(const size_t bits, const uint8_t *key, const size_t key_len,
     const uint8_t *data, const size_t data_size,
     uint8_t *digest, size_t *digest_size) {
+	int error;
 	hmac_sha2_ctx_t hctx;
 
-	hmac_sha2_init(bits, key, key_len, &hctx);
+	error = hmac_sha2_init(bits, key, key_len, &hctx);
+	if (0 != error)
+		return (error);
 	hmac_sha2_update(&hctx, data, data_size);
 	hmac_sha2_final(&hctx, digest, digest_size);
+
+	return (0);
 }
 
 
@@ -851,28 +1033,36 @@ sha2_cvt_str(const uint8_t *digest, const size_t digest_size, char *digest_str)
 }
 
 
-static inline void
+static inline int
 sha2_get_digest(const size_t bits, const void *data, const size_t data_size,
     uint8_t *digest, size_t *digest_size) {
+	int error;
 	sha2_ctx_t ctx;
 
-	sha2_init(bits, &ctx);
+	error = sha2_init(bits, &ctx);
+	if (0 != error)
+		return (error);
 	sha2_update(&ctx, data, data_size);
 	if (NULL != digest_size) {
 		(*digest_size) = ctx.hash_size;
 	}
 	sha2_final(&ctx, digest);
+
+	return (0);
 }
 
 
-static inline void
+static inline int
 sha2_get_digest_str(const size_t bits, const char *data, const size_t data_size,
     char *digest_str, size_t *digest_str_size) {
+	int error;
 	sha2_ctx_t ctx;
 	size_t digest_size;
 	uint8_t digest[SHA2_HASH_MAX_SIZE];
 
-	sha2_init(bits, &ctx);
+	error = sha2_init(bits, &ctx);
+	if (0 != error)
+		return (error);
 	sha2_update(&ctx, (const uint8_t*)data, data_size);
 	digest_size = ctx.hash_size;
 	sha2_final(&ctx, digest);
@@ -881,32 +1071,39 @@ sha2_get_digest_str(const size_t bits, const char *data, const size_t data_size,
 	if (NULL != digest_str_size) {
 		(*digest_str_size) = (digest_size * 2);
 	}
+
+	return (0);
 }
 
 
-static inline void
+static inline int
 sha2_hmac_get_digest(const size_t bits, const void *key, const size_t key_size,
     const void *data, const size_t data_size, uint8_t *digest,
     size_t *digest_size) {
 
-	hmac_sha2(bits, (const uint8_t*)key, key_size,
-	    (const uint8_t*)data, data_size, digest, digest_size);
+	return (hmac_sha2(bits, (const uint8_t*)key, key_size,
+	    (const uint8_t*)data, data_size, digest, digest_size));
 }
 
 
-static inline void
+static inline int
 sha2_hmac_get_digest_str(const size_t bits, const char *key, const size_t key_size,
     const char *data, const size_t data_size, 
     char *digest_str, size_t *digest_str_size) {
+	int error;
 	size_t digest_size;
 	uint8_t digest[SHA2_HASH_MAX_SIZE];
 
-	hmac_sha2(bits, (const uint8_t*)key, key_size,
+	error = hmac_sha2(bits, (const uint8_t*)key, key_size,
 	    (const uint8_t*)data, data_size, digest, &digest_size);
+	if (0 != error)
+		return (error);
 	sha2_cvt_str(digest, digest_size, digest_str);
 	if (NULL != digest_str_size) {
 		(*digest_str_size) = (digest_size * 2);
 	}
+
+	return (0);
 }
 
 
@@ -914,8 +1111,12 @@ sha2_hmac_get_digest_str(const size_t bits, const char *key, const size_t key_si
 /* 0 - OK, non zero - error */
 static inline int
 sha2_self_test(void) {
-	size_t i;
+	size_t i, j;
+	uint32_t impl;
+	sha2_ctx_t ctx;
+	uint8_t buf[1031], digest[SHA2_HASH_MAX_SIZE], digest_impl[SHA2_HASH_MAX_SIZE];
 	char digest_str[SHA2_HASH_STR_MAX_SIZE + 1]; /* Calculated digest. */
+	const size_t bits[] = { 224, 256, 384, 512 };
 	const char *data[] = {
 	    "",
 	    "a",
@@ -1089,45 +1290,74 @@ sha2_self_test(void) {
 	    "85f64cae9f9c457aa2d921c8d0ebd25f07514d034084ee0c5e937097ef98e697f87083231aa738f378e330ce2d4ff533d31e4ca399f99051acff18b3e2451458"
 	};
 
+	/* Unsupported hash size. */
+	if (EINVAL != sha2_init(160, &ctx))
+		return (9);
+
 	/* Hash test. */
 	for (i = 0; i < nitems(data); i ++) {
 		/* 224 */
-		sha2_get_digest_str(224, data[i], data_size[i], digest_str, NULL);
-		if (0 != memcmp(digest_str, result_digest224[i], SHA2_224_HASH_STR_SIZE))
+		if (0 != sha2_get_digest_str(224, data[i], data_size[i], digest_str, NULL) ||
+		    0 != memcmp(digest_str, result_digest224[i], SHA2_224_HASH_STR_SIZE))
 			return (1);
 		/* 256 */
-		sha2_get_digest_str(256, data[i], data_size[i], digest_str, NULL);
-		if (0 != memcmp(digest_str, result_digest256[i], SHA2_256_HASH_STR_SIZE))
+		if (0 != sha2_get_digest_str(256, data[i], data_size[i], digest_str, NULL) ||
+		    0 != memcmp(digest_str, result_digest256[i], SHA2_256_HASH_STR_SIZE))
 			return (2);
 		/* 384 */
-		sha2_get_digest_str(384, data[i], data_size[i], digest_str, NULL);
-		if (0 != memcmp(digest_str, result_digest384[i], SHA2_384_HASH_STR_SIZE))
+		if (0 != sha2_get_digest_str(384, data[i], data_size[i], digest_str, NULL) ||
+		    0 != memcmp(digest_str, result_digest384[i], SHA2_384_HASH_STR_SIZE))
 			return (3);
 		/* 512 */
-		sha2_get_digest_str(512, data[i], data_size[i], digest_str, NULL);
-		if (0 != memcmp(digest_str, result_digest512[i], SHA2_512_HASH_STR_SIZE))
+		if (0 != sha2_get_digest_str(512, data[i], data_size[i], digest_str, NULL) ||
+		    0 != memcmp(digest_str, result_digest512[i], SHA2_512_HASH_STR_SIZE))
 			return (4);
 	}
 
 	/* HMAC test. */
 	for (i = 0; i < nitems(data); i ++) {
 		/* 256 */
-		sha2_hmac_get_digest_str(256, data[i], data_size[i], data[i],
-		    data_size[i], digest_str, NULL);
-		if (0 != memcmp(digest_str, result_hdigest256[i], SHA2_256_HASH_STR_SIZE))
+		if (0 != sha2_hmac_get_digest_str(256, data[i], data_size[i], data[i],
+		    data_size[i], digest_str, NULL) ||
+		    0 != memcmp(digest_str, result_hdigest256[i], SHA2_256_HASH_STR_SIZE))
 			return (5);
 		/* 384 */
-		sha2_hmac_get_digest_str(384, data[i], data_size[i], data[i],
-		    data_size[i], digest_str, NULL);
-		if (0 != memcmp(digest_str, result_hdigest384[i], SHA2_384_HASH_STR_SIZE))
+		if (0 != sha2_hmac_get_digest_str(384, data[i], data_size[i], data[i],
+		    data_size[i], digest_str, NULL) ||
+		    0 != memcmp(digest_str, result_hdigest384[i], SHA2_384_HASH_STR_SIZE))
 			return (6);
 		/* 512 */
-		sha2_hmac_get_digest_str(512, data[i], data_size[i], data[i],
-		    data_size[i], digest_str, NULL);
-		if (0 != memcmp(digest_str, result_hdigest512[i], SHA2_512_HASH_STR_SIZE))
+		if (0 != sha2_hmac_get_digest_str(512, data[i], data_size[i], data[i],
+		    data_size[i], digest_str, NULL) ||
+		    0 != memcmp(digest_str, result_hdigest512[i], SHA2_512_HASH_STR_SIZE))
 			return (7);
 	}
 
+	/* SIMD implementations must match generic, up to 8 blocks. */
+	for (i = 0; i < sizeof(buf); i ++) {
+		buf[i] = (uint8_t)((i * 131) + 7);
+	}
+	for (impl = SHA2_IMPL_SHANI; impl <= SHA2_IMPL_AVX2; impl ++) {
+		if (0 == sha2_impl_is_supported(impl))
+			continue;
+		for (i = 0; i < nitems(bits); i ++) {
+			for (j = 0; j < sizeof(buf); j += 61) {
+				memset(digest, 0x00, sizeof(digest));
+				memset(digest_impl, 0x00, sizeof(digest_impl));
+				if (0 != sha2_init_impl(bits[i], impl, &ctx))
+					break; /* Not for this hash size. */
+				sha2_update(&ctx, buf, j);
+				sha2_final(&ctx, digest_impl);
+				if (0 != sha2_init_impl(bits[i], SHA2_IMPL_GENERIC, &ctx))
+					return (8);
+				sha2_update(&ctx, buf, j);
+				sha2_final(&ctx, digest);
+				if (0 != memcmp(digest, digest_impl, sizeof(digest)))
+					return (8);
+			}
+		}
+	}
+
 	return (0);
 }
 #endif
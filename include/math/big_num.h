@@ -216,12 +216,20 @@ BN_ALIGN(16) bn_digit_t	num[BN_MAX_DIGITS];
 } bn_t, *bn_p;
 
 
+/* Montgomery domain: x' = x * R mod m, R = 2^(BN_DIGIT_BITS * m->digits). */
+typedef struct big_num_mont_s {
+	size_t		digits; /* m digits count, 0 - not initialized (m is even). */
+	bn_digit_t	m_inv; /* -m^-1 mod 2^BN_DIGIT_BITS. */
+	bn_t		r2; /* R^2 mod m: for conversion to Montgomery form. */
+} bn_mont_t, *bn_mont_p;
+
 typedef struct big_num_mod_reduce_data_s {
 #if BN_MOD_REDUCE_ALGO == BN_MOD_REDUCE_ALGO_BASIC
 	void	*none;
 #elif BN_MOD_REDUCE_ALGO == BN_MOD_REDUCE_ALGO_BARRETT
 	bn_t		Barrett; /* For Barrett Reduction. */
 #endif
+	bn_mont_t	mont; /* Odd m only: bn_mod_exp(), EC field. */
 } bn_mod_rd_data_t, *bn_mod_rd_data_p;
 
 #define BN_EXPORT_F_AUTO_SIZE	(1 << 0)
@@ -949,7 +957,7 @@ bn_digits_calc_digits(bn_digit_t *a, size_t count) {
 }
 
 /* Returns: sign of a - b. */
-/* XXX: timing attack? */
+/* Not constant time: for secret data use bn_digits_cassign()/cswap(). */
 /* XXX: memcmp() optimization? */
 static inline int
 bn_digits_cmp(bn_digit_t *a, bn_digit_t *b, size_t count) {
@@ -1325,6 +1333,96 @@ bn_digits_assign_zero(bn_digit_t *a, size_t count) {
 	memset(a, 0x00, (count * BN_DIGIT_SIZE));
 }
 
+/* Constant time functions: no branches and memory access depending on
+ * data, cond must be 0 or 1. */
+/* Returns: 1 if a == 0, 0 otherwise. */
+static inline bn_digit_t
+bn_digit_ct_is_zero(bn_digit_t a) {
+
+	a |= (bn_digit_t)(((bn_digit_t)0) - a); /* Top bit set if a != 0. */
+	return (1 ^ (a >> (BN_DIGIT_BITS - 1)));
+}
+/* Returns: 1 if a < b, 0 otherwise: borrow of a - b. */
+static inline bn_digit_t
+bn_digit_ct_lt(bn_digit_t a, bn_digit_t b) {
+
+	return ((((~a) & b) | ((~(a ^ b)) & (a - b))) >> (BN_DIGIT_BITS - 1));
+}
+/* Returns: the significant length of a in digits, scans all count digits. */
+static inline size_t
+bn_digits_calc_digits_ct(bn_digit_t *a, size_t count) {
+	register size_t i;
+	register bn_digit_t digits, mask;
+
+	for (i = 0, digits = 0; i < count; i ++) {
+		mask = (((bn_digit_t)0) - (1 ^ bn_digit_ct_is_zero(a[i])));
+		digits ^= (mask & (digits ^ ((bn_digit_t)(i + 1))));
+	}
+	return ((size_t)digits);
+}
+/* Assigns: a = b, b_digits - significant digits of b, zero pad to count.
+ * Reads count digits of b: digits above b_digits masked out. */
+static inline void
+bn_digits_load_ct(bn_digit_t *a, size_t count, bn_digit_t *b,
+    size_t b_digits) {
+	register size_t i;
+
+	for (i = 0; i < count; i ++) {
+		a[i] = (b[i] & (((bn_digit_t)0) -
+		    bn_digit_ct_lt((bn_digit_t)i, (bn_digit_t)b_digits)));
+	}
+}
+/* Assigns: a = b if cond. */
+static inline void
+bn_digits_cassign(bn_digit_t *a, bn_digit_t *b, size_t count, bn_digit_t cond) {
+	register size_t i;
+	register bn_digit_t mask = (((bn_digit_t)0) - cond);
+
+	for (i = 0; i < count; i ++) {
+		a[i] ^= (mask & (a[i] ^ b[i]));
+	}
+}
+/* Swaps a and b if cond. */
+static inline void
+bn_digits_cswap(bn_digit_t *a, bn_digit_t *b, size_t count, bn_digit_t cond) {
+	register size_t i;
+	register bn_digit_t tm, mask = (((bn_digit_t)0) - cond);
+
+	for (i = 0; i < count; i ++) {
+		tm = (mask & (a[i] ^ b[i]));
+		a[i] ^= tm;
+		b[i] ^= tm;
+	}
+}
+/* Computes: res = a + b, res may be a or b. Returns carry. */
+static inline bn_digit_t
+bn_digits_add_ct(bn_digit_t *res, bn_digit_t *a, bn_digit_t *b, size_t count) {
+	register size_t i;
+	register bn_digit_t crr, tm;
+
+	for (i = 0, crr = 0; i < count; i ++) {
+		tm = (a[i] + crr);
+		crr = ((tm < crr) ? 1 : 0);
+		res[i] = (tm + b[i]);
+		crr += ((res[i] < tm) ? 1 : 0);
+	}
+	return (crr);
+}
+/* Computes: res = a - b, res may be a or b. Returns borrow. */
+static inline bn_digit_t
+bn_digits_sub_ct(bn_digit_t *res, bn_digit_t *a, bn_digit_t *b, size_t count) {
+	register size_t i;
+	register bn_digit_t brw, tm;
+
+	for (i = 0, brw = 0; i < count; i ++) {
+		tm = (a[i] - brw);
+		brw = ((tm > a[i]) ? 1 : 0);
+		res[i] = (tm - b[i]);
+		brw += ((res[i] > tm) ? 1 : 0);
+	}
+	return (brw);
+}
+
 
 /*-------------------------- ARITHMETIC OPERATIONS ---------------------------*/
 /* Computes: a *= 2^bits (i.e. shifts left c bits). */
@@ -1834,6 +1932,19 @@ bn_is_equal(bn_p a, bn_p b) {
 
 	return (0 == bn_cmp(a, b));
 }
+/* Returns: 1 if a < b, 0 otherwise, -1 on error. Reads fixed count digits:
+ * borrow of a - b. Constant time. */
+static inline int
+bn_is_less_ct(bn_p a, bn_p b, size_t count) {
+	bn_digit_t ta[BN_MAX_DIGITS], tb[BN_MAX_DIGITS];
+
+	if (NULL == a || NULL == b || BN_MAX_DIGITS < count ||
+	    a->digits > count || b->digits > count)
+		return (-1);
+	bn_digits_load_ct(ta, count, a->num, a->digits);
+	bn_digits_load_ct(tb, count, b->num, b->digits);
+	return ((int)bn_digits_sub_ct(ta, ta, tb, count));
+}
 
 /* Test_ whether the 'bits' bit in bn is one */
 static inline int
@@ -1998,6 +2109,19 @@ bn_assign_init(bn_p dst, bn_p src) {
 	return (0);
 }
 
+/* Assigns: a = b, fixed count digits copied. Constant time. */
+static inline int
+bn_assign_ct(bn_p dst, bn_p src, size_t count) {
+
+	BN_POINTER_CHK_EINVAL(dst);
+	BN_POINTER_CHK_EINVAL(src);
+	if (count > dst->count || src->digits > count)
+		return (EOVERFLOW);
+	bn_digits_load_ct(dst->num, count, src->num, src->digits);
+	dst->digits = src->digits;
+	return (0);
+}
+
 /* Assigns: a = 0. */
 static inline void
 bn_assign_zero(bn_p bn) {
@@ -2941,6 +3065,410 @@ bn_calc_naf(bn_p bn, size_t wnd_bits, size_t naf_arr_size, int8_t *naf_arr,
 
 
 
+/*------------------------- MONTGOMERY ARITHMETIC ----------------------------*/
+/* Montgomery P.: Modular multiplication without trial division, 1985.
+ * Koc C.K., Acar T., Kaliski B.S.: Analyzing and comparing Montgomery
+ * multiplication algorithms, 1996: CIOS and SOS methods.
+ */
+
+/* Computes: (result_hi, result_lo) = a * b + c + d, never overflow. */
+static inline void
+bn_digit_mult_add2__int(bn_digit_t a, bn_digit_t b, bn_digit_t c,
+    bn_digit_t d, bn_digit_t *result_lo, bn_digit_t *result_hi) {
+#if defined(BN_CC_MULL_DIV)
+	register bn_ddigit_t tm = ((((bn_ddigit_t)a) * ((bn_ddigit_t)b)) +
+	    ((bn_ddigit_t)c) + ((bn_ddigit_t)d));
+
+	(*result_lo) = (bn_digit_t)tm;
+	(*result_hi) = (bn_digit_t)(tm >> BN_DIGIT_BITS);
+#else
+	bn_digit_t t_lo, t_hi;
+
+	bn_digit_mult(a, b, &t_lo, &t_hi);
+	t_lo += c;
+	t_hi += ((t_lo < c) ? 1 : 0);
+	t_lo += d;
+	t_hi += ((t_lo < d) ? 1 : 0);
+	(*result_lo) = t_lo;
+	(*result_hi) = t_hi;
+#endif /* BN_CC_MULL_DIV */
+}
+
+/* Computes: a -= m if (carry != 0 || a >= m), a < 2m.
+ * Constant time: subtraction always done, result selected by mask. */
+static inline void
+bn_digits_mont_final_sub__int(bn_digit_t *a, bn_digit_t carry, bn_digit_t *m,
+    size_t count) {
+	bn_digit_t brw, t[BN_MAX_DIGITS];
+
+	brw = bn_digits_sub_ct(t, a, m, count);
+	/* No borrow: a >= m. */
+	bn_digits_cassign(a, t, count, ((0 != carry) | (1 ^ brw)));
+}
+
+/* Computes: res = a * b * R^-1 mod m, CIOS.
+ * a, b < m, count digits each; res may be a or b. */
+static inline void
+bn_digits_mont_mult__int(bn_digit_t *res, bn_digit_t *a, bn_digit_t *b,
+    bn_digit_t *m, size_t count, bn_digit_t m_inv) {
+	register size_t i, j;
+	bn_digit_t u, crr, tm, t[(BN_MAX_DIGITS + 2)];
+
+	memset(t, 0x00, ((count + 2) * BN_DIGIT_SIZE));
+	for (i = 0; i < count; i ++) {
+		/* t += a * b[i] */
+		crr = 0;
+		for (j = 0; j < count; j ++) {
+			bn_digit_mult_add2__int(a[j], b[i], t[j], crr,
+			    &t[j], &crr);
+		}
+		t[count] += crr;
+		t[(count + 1)] = ((t[count] < crr) ? 1 : 0);
+		/* t = (t + u * m) / 2^BN_DIGIT_BITS */
+		u = (t[0] * m_inv);
+		bn_digit_mult_add2__int(u, m[0], t[0], 0, &tm, &crr);
+		for (j = 1; j < count; j ++) {
+			bn_digit_mult_add2__int(u, m[j], t[j], crr,
+			    &t[(j - 1)], &crr);
+		}
+		t[(count - 1)] = (t[count] + crr);
+		t[count] = (t[(count + 1)] + ((t[(count - 1)] < crr) ? 1 : 0));
+	}
+	bn_digits_mont_final_sub__int(t, t[count], m, count);
+	memcpy(res, t, (count * BN_DIGIT_SIZE));
+}
+
+/* Computes: res = a^2 * R^-1 mod m, SOS: cross products calculated once. */
+static inline void
+bn_digits_mont_square__int(bn_digit_t *res, bn_digit_t *a, bn_digit_t *m,
+    size_t count, bn_digit_t m_inv) {
+	register size_t i, j;
+	bn_digit_t u, crr, hi, t[((2 * BN_MAX_DIGITS) + 1)];
+
+	memset(t, 0x00, (((2 * count) + 1) * BN_DIGIT_SIZE));
+	/* t = sum(a[i] * a[j]), i < j */
+	for (i = 0; i < count; i ++) {
+		crr = 0;
+		for (j = (i + 1); j < count; j ++) {
+			bn_digit_mult_add2__int(a[i], a[j], t[(i + j)], crr,
+			    &t[(i + j)], &crr);
+		}
+		t[(i + count)] = crr;
+	}
+	/* t *= 2 */
+	for (i = 0, hi = 0; i < (2 * count); i ++) {
+		crr = (t[i] >> (BN_DIGIT_BITS - 1));
+		t[i] = ((t[i] << 1) | hi);
+		hi = crr;
+	}
+	/* t += sum(a[i]^2) */
+	for (i = 0, crr = 0; i < count; i ++) {
+		bn_digit_mult_add2__int(a[i], a[i], t[(2 * i)], crr,
+		    &t[(2 * i)], &crr);
+		t[((2 * i) + 1)] += crr;
+		crr = ((t[((2 * i) + 1)] < crr) ? 1 : 0);
+	}
+	/* Reduce: t = t * R^-1 */
+	for (i = 0; i < count; i ++) {
+		u = (t[i] * m_inv);
+		crr = 0;
+		for (j = 0; j < count; j ++) {
+			bn_digit_mult_add2__int(u, m[j], t[(i + j)], crr,
+			    &t[(i + j)], &crr);
+		}
+		for (j = (i + count); j <= (2 * count); j ++) {
+			t[j] += crr;
+			crr = ((t[j] < crr) ? 1 : 0);
+		}
+	}
+	bn_digits_mont_final_sub__int(&t[count], t[(2 * count)], m, count);
+	memcpy(res, &t[count], (count * BN_DIGIT_SIZE));
+}
+
+/* Copy digits to buf, zero pad to count: fixed count digits read. */
+static inline int
+bn_mont_load__int(bn_p bn, size_t count, bn_digit_t *buf) {
+
+	if (bn->digits > count)
+		return (EINVAL);
+	bn_digits_load_ct(buf, count, bn->num, bn->digits);
+	return (0);
+}
+
+/* Init Montgomery context for odd m. */
+static inline int
+bn_mont_init(bn_p m, bn_mont_p mont) {
+	register size_t i;
+	bn_digit_t inv, crr, *r;
+
+	BN_POINTER_CHK_EINVAL(m);
+	BN_POINTER_CHK_EINVAL(mont);
+	mont->digits = 0;
+	if (0 == bn_is_odd(m) || 0 != bn_is_one(m))
+		return (EINVAL);
+	/* m_inv = -m^-1 mod 2^BN_DIGIT_BITS, Newton: precision doubles
+	 * on each step, m * m = 1 mod 8 for odd m. */
+	inv = m->num[0];
+	for (i = 3; i < BN_DIGIT_BITS; i *= 2) {
+		inv *= (((bn_digit_t)2) - (m->num[0] * inv));
+	}
+	/* r2 = 2^(2 * BN_DIGIT_BITS * m->digits) mod m: doublings from 1,
+	 * no division and no extra digits required. */
+	BN_RET_ON_ERR(bn_init(&mont->r2, (m->digits * BN_DIGIT_BITS)));
+	r = mont->r2.num;
+	bn_digits_assign_zero(r, m->digits);
+	r[0] = 1;
+	for (i = 0; i < (2 * m->digits * BN_DIGIT_BITS); i ++) {
+		crr = (r[(m->digits - 1)] >> (BN_DIGIT_BITS - 1));
+		bn_digits_l_shift(r, m->digits, 1);
+		bn_digits_mont_final_sub__int(r, crr, m->num, m->digits);
+	}
+	bn_update(&mont->r2);
+	mont->m_inv = (((bn_digit_t)0) - inv);
+	mont->digits = m->digits;
+	return (0);
+}
+
+/* Computes: bn = bn * n * R^-1 mod m. Require: bn, n < m. */
+static inline int
+bn_mont_mult(bn_p bn, bn_p n, bn_p m, bn_mont_p mont) {
+	bn_digit_t a[BN_MAX_DIGITS], b[BN_MAX_DIGITS];
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(n);
+	BN_POINTER_CHK_EINVAL(m);
+	BN_POINTER_CHK_EINVAL(mont);
+	if (0 == mont->digits)
+		return (EINVAL);
+	if (bn->count < mont->digits)
+		return (EOVERFLOW);
+	BN_RET_ON_ERR(bn_mont_load__int(bn, mont->digits, a));
+	BN_RET_ON_ERR(bn_mont_load__int(n, mont->digits, b));
+	bn_digits_mont_mult__int(bn->num, a, b, m->num, mont->digits,
+	    mont->m_inv);
+	bn->digits = bn_digits_calc_digits_ct(bn->num, mont->digits);
+	return (0);
+}
+
+/* Computes: bn = bn^2 * R^-1 mod m. Require: bn < m. */
+static inline int
+bn_mont_square(bn_p bn, bn_p m, bn_mont_p mont) {
+	bn_digit_t a[BN_MAX_DIGITS];
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(m);
+	BN_POINTER_CHK_EINVAL(mont);
+	if (0 == mont->digits)
+		return (EINVAL);
+	if (bn->count < mont->digits)
+		return (EOVERFLOW);
+	BN_RET_ON_ERR(bn_mont_load__int(bn, mont->digits, a));
+	bn_digits_mont_square__int(bn->num, a, m->num, mont->digits,
+	    mont->m_inv);
+	bn->digits = bn_digits_calc_digits_ct(bn->num, mont->digits);
+	return (0);
+}
+
+/* Computes: bn = bn * R mod m: to Montgomery form. */
+static inline int
+bn_mont_to(bn_p bn, bn_p m, bn_mont_p mont) {
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(m);
+	BN_POINTER_CHK_EINVAL(mont);
+	if (bn_cmp(bn, m) >= 0) {
+		BN_RET_ON_ERR(bn_div(bn, m, bn));
+	}
+	BN_RET_ON_ERR(bn_mont_mult(bn, &mont->r2, m, mont));
+	return (0);
+}
+
+/* Computes: bn = bn * R^-1 mod m: from Montgomery form. */
+static inline int
+bn_mont_from(bn_p bn, bn_p m, bn_mont_p mont) {
+	bn_digit_t a[BN_MAX_DIGITS], b[BN_MAX_DIGITS];
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(m);
+	BN_POINTER_CHK_EINVAL(mont);
+	if (0 == mont->digits)
+		return (EINVAL);
+	if (bn->count < mont->digits)
+		return (EOVERFLOW);
+	BN_RET_ON_ERR(bn_mont_load__int(bn, mont->digits, a));
+	memset(b, 0x00, (mont->digits * BN_DIGIT_SIZE));
+	b[0] = 1;
+	bn_digits_mont_mult__int(bn->num, a, b, m->num, mont->digits,
+	    mont->m_inv);
+	bn->digits = bn_digits_calc_digits_ct(bn->num, mont->digits);
+	return (0);
+}
+
+/* Assigns: bn = R mod m: 1 in Montgomery form. */
+static inline int
+bn_mont_one(bn_p bn, bn_p m, bn_mont_p mont) {
+
+	BN_POINTER_CHK_EINVAL(mont);
+	BN_RET_ON_ERR(bn_assign(bn, &mont->r2));
+	BN_RET_ON_ERR(bn_mont_from(bn, m, mont));
+	return (0);
+}
+
+/* Computes: bn = (bn * n) mod m, bn, n < m. Constant time. */
+static inline int
+bn_mod_mult_mont(bn_p bn, bn_p n, bn_p m, bn_mont_p mont) {
+
+	/* bn * n * R^-1 */
+	BN_RET_ON_ERR(bn_mont_mult(bn, n, m, mont));
+	/* bn * n * R^-1 * R^2 * R^-1 */
+	BN_RET_ON_ERR(bn_mont_mult(bn, &mont->r2, m, mont));
+	return (0);
+}
+
+/* Computes: bn = (bn + n) mod m, bn, n < m. Constant time. */
+static inline int
+bn_mod_add_ct(bn_p bn, bn_p n, bn_p m) {
+	bn_digit_t crr, a[BN_MAX_DIGITS], b[BN_MAX_DIGITS];
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(n);
+	BN_POINTER_CHK_EINVAL(m);
+	if (bn->count < m->digits)
+		return (EOVERFLOW);
+	BN_RET_ON_ERR(bn_mont_load__int(bn, m->digits, a));
+	BN_RET_ON_ERR(bn_mont_load__int(n, m->digits, b));
+	crr = bn_digits_add_ct(a, a, b, m->digits);
+	bn_digits_mont_final_sub__int(a, crr, m->num, m->digits);
+	memcpy(bn->num, a, (m->digits * BN_DIGIT_SIZE));
+	bn->digits = bn_digits_calc_digits_ct(bn->num, m->digits);
+	return (0);
+}
+
+/* Computes: bn = (bn - n) mod m, bn, n < m. Constant time. */
+static inline int
+bn_mod_sub_ct(bn_p bn, bn_p n, bn_p m) {
+	bn_digit_t brw, a[BN_MAX_DIGITS], b[BN_MAX_DIGITS];
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(n);
+	BN_POINTER_CHK_EINVAL(m);
+	if (bn->count < m->digits)
+		return (EOVERFLOW);
+	BN_RET_ON_ERR(bn_mont_load__int(bn, m->digits, a));
+	BN_RET_ON_ERR(bn_mont_load__int(n, m->digits, b));
+	brw = bn_digits_sub_ct(a, a, b, m->digits);
+	/* a += m if borrow. */
+	bn_digits_assign_zero(b, m->digits);
+	bn_digits_cassign(b, m->num, m->digits, brw);
+	bn_digits_add_ct(a, a, b, m->digits);
+	memcpy(bn->num, a, (m->digits * BN_DIGIT_SIZE));
+	bn->digits = bn_digits_calc_digits_ct(bn->num, m->digits);
+	return (0);
+}
+
+/* Computes: bn = bn / 2 mod m, bn < m, m - odd. Constant time. */
+static inline int
+bn_mod_half_ct(bn_p bn, bn_p m) {
+	bn_digit_t crr, a[BN_MAX_DIGITS], b[BN_MAX_DIGITS];
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(m);
+	if (bn->count < m->digits)
+		return (EOVERFLOW);
+	BN_RET_ON_ERR(bn_mont_load__int(bn, m->digits, a));
+	/* a += m if a is odd: a is even, a < 2m. */
+	bn_digits_assign_zero(b, m->digits);
+	bn_digits_cassign(b, m->num, m->digits, (a[0] & 1));
+	crr = bn_digits_add_ct(a, a, b, m->digits);
+	bn_digits_r_shift(a, m->digits, 1);
+	a[(m->digits - 1)] |= (crr << (BN_DIGIT_BITS - 1));
+	memcpy(bn->num, a, (m->digits * BN_DIGIT_SIZE));
+	bn->digits = bn_digits_calc_digits_ct(bn->num, m->digits);
+	return (0);
+}
+
+/* Sliding window size for exponent bits count. */
+#define BN_MONT_EXP_WND_BITS_MAX	6
+static inline size_t
+bn_mont_exp_wnd_bits__int(size_t bits) {
+
+	if (bits > 671)
+		return (6);
+	if (bits > 239)
+		return (5);
+	if (bits > 79)
+		return (4);
+	if (bits > 23)
+		return (3);
+	return (1);
+}
+
+/* Computes: bn = bn^exp mod m. Require: bn < m.
+ * [1]: Algorithm 14.85 Sliding-window exponentiation,
+ * all calculations in Montgomery form. */
+static inline int
+bn_mont_exp(bn_p bn, bn_p exp, bn_p m, bn_mont_p mont) {
+	int started = 0;
+	size_t i, j, l, bits, wnd_bits, wnd_val;
+	bn_t g2, g[(((size_t)1) << (BN_MONT_EXP_WND_BITS_MAX - 1))];
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(exp);
+	BN_POINTER_CHK_EINVAL(m);
+	BN_POINTER_CHK_EINVAL(mont);
+	if (0 == mont->digits)
+		return (EINVAL);
+	if (bn->count < mont->digits)
+		return (EOVERFLOW);
+	bits = bn_calc_bits(exp);
+	if (0 == bits) { /* bn^0 = 1 */
+		BN_RET_ON_ERR(bn_assign_digit(bn, 1));
+		return (0);
+	}
+	wnd_bits = bn_mont_exp_wnd_bits__int(bits);
+	/* g[i] = bn^(2i + 1) */
+	BN_RET_ON_ERR(bn_init(&g[0], (mont->digits * BN_DIGIT_BITS)));
+	BN_RET_ON_ERR(bn_assign(&g[0], bn));
+	BN_RET_ON_ERR(bn_mont_to(&g[0], m, mont));
+	if (1 < wnd_bits) {
+		BN_RET_ON_ERR(bn_assign_init(&g2, &g[0]));
+		BN_RET_ON_ERR(bn_mont_square(&g2, m, mont));
+		for (i = 1; i < (((size_t)1) << (wnd_bits - 1)); i ++) {
+			BN_RET_ON_ERR(bn_assign_init(&g[i], &g[(i - 1)]));
+			BN_RET_ON_ERR(bn_mont_mult(&g[i], &g2, m, mont));
+		}
+	}
+	BN_PREFETCH_BN_DATA(exp);
+	for (i = bits; 0 != i;) {
+		if (0 == bn_is_bit_set(exp, (i - 1))) {
+			BN_RET_ON_ERR(bn_mont_square(bn, m, mont));
+			i --;
+			continue;
+		}
+		/* Longest window [i - 1, l] with odd value. */
+		l = ((i > wnd_bits) ? (i - wnd_bits) : 0);
+		while (0 == bn_is_bit_set(exp, l)) {
+			l ++;
+		}
+		for (j = (i - 1), wnd_val = 0; j >= l && j < i; j --) {
+			wnd_val = ((wnd_val << 1) | (size_t)bn_is_bit_set(exp, j));
+		}
+		if (0 == started) {
+			BN_RET_ON_ERR(bn_assign(bn, &g[(wnd_val >> 1)]));
+			started = 1;
+		} else {
+			for (j = l; j < i; j ++) {
+				BN_RET_ON_ERR(bn_mont_square(bn, m, mont));
+			}
+			BN_RET_ON_ERR(bn_mont_mult(bn, &g[(wnd_val >> 1)], m, mont));
+		}
+		i = l;
+	}
+	BN_RET_ON_ERR(bn_mont_from(bn, m, mont));
+	return (0);
+}
+
+
 /*------------------------- NUMBER THEORY ------------------------------------*/
 
 /* From Handbook of Applied Cryptography Algorithm 14.42 */
@@ -2950,11 +3478,13 @@ bn_mod_rd_data_init(bn_p m, bn_mod_rd_data_p mod_rd_data) {
 
 	BN_POINTER_CHK_EINVAL(m);
 	BN_POINTER_CHK_EINVAL(mod_rd_data);
+	/* Montgomery form avaible only for odd m. */
+	mod_rd_data->mont.digits = 0;
+	if (0 != bn_is_odd(m) && 0 == bn_is_one(m)) {
+		BN_RET_ON_ERR(bn_mont_init(m, &mod_rd_data->mont));
+	}
 #if BN_MOD_REDUCE_ALGO == BN_MOD_REDUCE_ALGO_BASIC
 	/* Nothink to do. */
-	/* Supress warnings. */
-	m = NULL;
-	mod_rd_data = NULL;
 #elif BN_MOD_REDUCE_ALGO == BN_MOD_REDUCE_ALGO_BARRETT
 
 	BN_RET_ON_ERR(bn_init(&mod_rd_data->Barrett,
@@ -3184,6 +3714,14 @@ bn_mod_exp(bn_p bn, bn_p exp, bn_p m, bn_mod_rd_data_p mod_rd_data) {
 			return (0);
 		}
 	}
+	if (NULL != mod_rd_data && 0 != mod_rd_data->mont.digits) {
+		/* No double size products: reduce on each step. */
+		if (bn_cmp(bn, m) >= 0) {
+			BN_RET_ON_ERR(bn_div(bn, m, bn));
+		}
+		BN_RET_ON_ERR(bn_mont_exp(bn, exp, m, &mod_rd_data->mont));
+		return (0);
+	}
 	if ((bn->digits * 2) > bn->count)
 		return (EOVERFLOW);
 	if (1 == bn->digits) {
@@ -3213,6 +3751,23 @@ bn_mod_exp(bn_p bn, bn_p exp, bn_p m, bn_mod_rd_data_p mod_rd_data) {
 	return (0);
 }
 
+/* Computes: bn = bn^-1 mod m = bn^(m - 2) mod m, m - odd prime, bn < m.
+ * Operations sequence depends only on m: for secret bn. */
+static inline int
+bn_mod_inv_fermat(bn_p bn, bn_p m, bn_mod_rd_data_p mod_rd_data) {
+	bn_t exp;
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(m);
+	BN_POINTER_CHK_EINVAL(mod_rd_data);
+	if (0 == mod_rd_data->mont.digits)
+		return (EINVAL);
+	BN_RET_ON_ERR(bn_assign_init(&exp, m));
+	bn_sub_digit(&exp, 2, NULL);
+	BN_RET_ON_ERR(bn_mont_exp(bn, &exp, m, &mod_rd_data->mont));
+	return (0);
+}
+
 
 #define bn_mod_inv(bn, m, md)	bn_mod_inv_bin(bn, m, md) //  10389 (103896666)
 //#define bn_mod_inv(bn, m, md)	bn_mod_inv1(bn, m, md) // 14898 (148980955)
@@ -3493,6 +4048,47 @@ bn_mod_reduce(bn_p bn, bn_p m, bn_mod_rd_data_p mod_rd_data) {
 	return (0);
 }
 
+/* Computes bn = (bn mod (m − 1)) + 1 if bn >= m, as bn_mod_reduce().
+ * Require: bn < 2^(count * BN_DIGIT_BITS), m > 1.
+ * Bit by bit: r = 2r + bit, masked subtraction of m - 1: operations
+ * sequence and memory access depend only on count and m. */
+static inline int
+bn_mod_reduce_ct(bn_p bn, size_t count, bn_p m) {
+	register size_t i, cnt;
+	bn_digit_t ge, bit, a[BN_MAX_DIGITS], r[BN_MAX_DIGITS];
+	bn_digit_t t[BN_MAX_DIGITS], m1[BN_MAX_DIGITS], one[BN_MAX_DIGITS];
+
+	BN_POINTER_CHK_EINVAL(bn);
+	BN_POINTER_CHK_EINVAL(m);
+	/* One extra digit: 2r + 1 < 2(m - 1). */
+	cnt = (MAX(count, m->digits) + 1);
+	if (BN_MAX_DIGITS < cnt || bn->digits > count)
+		return (EINVAL);
+	if (bn->count < cnt)
+		return (EOVERFLOW);
+	bn_digits_load_ct(a, cnt, bn->num, bn->digits);
+	bn_digits_load_ct(m1, cnt, m->num, m->digits);
+	bn_digits_assign_zero(one, cnt);
+	one[0] = 1;
+	/* ge = (bn >= m), m1 = m - 1 */
+	ge = (1 ^ bn_digits_sub_ct(t, a, m1, cnt));
+	bn_digits_sub_ct(m1, m1, one, cnt);
+	bn_digits_assign_zero(r, cnt);
+	for (i = (count * BN_DIGIT_BITS); 0 < i; i --) {
+		bit = ((a[((i - 1) / BN_DIGIT_BITS)] >>
+		    ((i - 1) % BN_DIGIT_BITS)) & 1);
+		bn_digits_l_shift(r, cnt, 1);
+		r[0] |= bit;
+		bn_digits_cassign(r, t, cnt,
+		    (1 ^ bn_digits_sub_ct(t, r, m1, cnt)));
+	}
+	bn_digits_add_ct(r, r, one, cnt);
+	bn_digits_cassign(a, r, cnt, ge);
+	memcpy(bn->num, a, (cnt * BN_DIGIT_SIZE));
+	bn->digits = bn_digits_calc_digits_ct(bn->num, cnt);
+	return (0);
+}
+
 /*  */
 static inline int
 bn_mod_small(bn_p bn, bn_p m, bn_mod_rd_data_p mod_rd_data __unused) {
@@ -3656,6 +4252,7 @@ bn_self_test(void) {
 	size_t j;
 	bn_digit_t da, db;
 	bn_t a, b, q, r, bn;
+	bn_mod_rd_data_t mod_rd_data;
 	/*  Welschenbach M., 4.3 Division with Remainder, Test_ values. */
 	const uint8_t *div_a = (const uint8_t*)"e37d3abc904baba7a2ac4b6d8f782b2bf84919d2917347690d9e93dcdd2b91cee9983c564cf1312206c91e74d80ba479064c8f42bd70aaaa689f80d435afc997ce853b465703c8edca";
 	const uint8_t *div_b = (const uint8_t*)"080b0987b72c1667c30c9156a6674c2e73e61a1fd527d4e78b3f1505603c566658459b83ccfd587ba9b5fcbdc0ad09152e0ac265";
@@ -3801,6 +4398,41 @@ bn_self_test(void) {
 	if (0 != bn_cmp(&bn, &r))
 		return (1028);
 
+	/* Montgomery: r = a^-1 mod q, q - prime. */
+	BN_RET_ON_ERR(bn_mod_rd_data_init(&q, &mod_rd_data));
+	if (0 == mod_rd_data.mont.digits)
+		return (1030);
+	BN_RET_ON_ERR(bn_assign(&bn, &a));
+	BN_RET_ON_ERR(bn_mont_to(&bn, &q, &mod_rd_data.mont));
+	BN_RET_ON_ERR(bn_assign(&b, &bn));
+	BN_RET_ON_ERR(bn_mont_from(&b, &q, &mod_rd_data.mont));
+	if (0 != bn_cmp(&b, &a))
+		return (1031);
+	/* a * a^-1 = 1 */
+	BN_RET_ON_ERR(bn_assign(&b, &r));
+	BN_RET_ON_ERR(bn_mont_to(&b, &q, &mod_rd_data.mont));
+	BN_RET_ON_ERR(bn_mont_mult(&b, &bn, &q, &mod_rd_data.mont));
+	BN_RET_ON_ERR(bn_mont_from(&b, &q, &mod_rd_data.mont));
+	if (0 == bn_is_one(&b))
+		return (1032);
+	/* a^2: square == mult. */
+	BN_RET_ON_ERR(bn_assign(&b, &bn));
+	BN_RET_ON_ERR(bn_mont_mult(&b, &bn, &q, &mod_rd_data.mont));
+	BN_RET_ON_ERR(bn_mont_square(&bn, &q, &mod_rd_data.mont));
+	if (0 != bn_cmp(&b, &bn))
+		return (1033);
+	/* a^(q - 2) = a^-1: Montgomery and division paths. */
+	BN_RET_ON_ERR(bn_assign(&b, &q));
+	bn_sub_digit(&b, 2, NULL);
+	BN_RET_ON_ERR(bn_assign(&bn, &a));
+	BN_RET_ON_ERR(bn_mod_exp(&bn, &b, &q, &mod_rd_data));
+	if (0 != bn_cmp(&bn, &r))
+		return (1034);
+	BN_RET_ON_ERR(bn_assign(&bn, &a));
+	BN_RET_ON_ERR(bn_mod_exp(&bn, &b, &q, NULL));
+	if (0 != bn_cmp(&bn, &r))
+		return (1035);
+
 
 	return (0);
 }
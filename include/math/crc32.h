@@ -37,6 +37,11 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <inttypes.h>
+#include <string.h> /* memcpy */
+
+#ifndef nitems /* SIZEOF() */
+#	define nitems(__val)	(sizeof(__val) / sizeof(__val[0]))
+#endif
 
 /* Use small lookup tables on data size less specified. */
 #define CRC32_SMALL_TBL_LIMIT	(sizeof(uint32_t) * 16)
@@ -498,12 +503,647 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
 };
 
 
+/*
+ * Fast paths.
+ * Slicing-by-16 tables and carry-less multiply folding constants are
+ * built on first use for each polynomial (crc32_ctx_t).
+ * x86-64: PCLMULQDQ folding, SSE4.2 crc32 instruction for CRC32C,
+ * selected at run time by cpuid.
+ * AArch64: PMULL folding and ARMv8 crc32/crc32c instructions, selected
+ * at compile time by __ARM_FEATURE_CRYPTO / __ARM_FEATURE_CRC32.
+ */
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define CRC32_X86_SIMD	1
+#	include "al/cpu_features.h"
+#	include <immintrin.h>
+#	define CRC32_TARGET(__t)	__attribute__((__target__(__t)))
+#endif
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#	define CRC32_ARM_CRC	1
+#	include <arm_acle.h>
+#endif
+#if defined(__aarch64__) &&						\
+    (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+#	define CRC32_ARM_PMULL	1
+#	include <arm_neon.h>
+#endif
+
+/* Use carry-less multiply folding on data size not less specified. */
+#define CRC32_FOLD_MIN		64
+/* Folding faster than single stream crc32 instruction from this size. */
+#define CRC32_HW_FOLD_MIN	256
+
+/* Implementations. */
+#define CRC32_IMPL_TBL		0 /* crc32_normal()/crc32_reflect(). */
+#define CRC32_IMPL_SLICE16	1 /* Slicing-by-16. */
+#define CRC32_IMPL_CLMUL	2 /* PCLMULQDQ / PMULL folding. */
+#define CRC32_IMPL_HW		3 /* crc32 instruction. */
+#define CRC32_IMPL_AUTO		0xff
+
+#define CRC32_CTX_F_REFLECT	(((uint32_t)1) << 0)
+#define CRC32_CTX_F_INIT	(((uint32_t)1) << 1) /* Tables and constants ready. */
+#define CRC32_CTX_F_CLMUL	(((uint32_t)1) << 2) /* CPU support folding. */
+#define CRC32_CTX_F_HW		(((uint32_t)1) << 3) /* CPU have crc32 instruction for poly. */
+
+typedef struct crc32_ctx_s {
+	uint32_t	poly;	/* Normal form. */
+	uint32_t	flags;	/* CRC32_CTX_F_*. */
+	const uint32_t	*table256;
+	const uint32_t	*table16;
+	uint64_t	k[8] __attribute__((aligned(16))); /* Folding constants. */
+	uint32_t	slice16[16][256];
+} crc32_ctx_t, *crc32_ctx_p;
+
+#define CRC32_CTX_INITIALIZER(__poly, __flags, __tbl256, __tbl16)	\
+	{ .poly = (__poly), .flags = (__flags),				\
+	  .table256 = (__tbl256), .table16 = (__tbl16) }
+
+static crc32_ctx_t crc32_ctx_04c11db7 __attribute__((__unused__)) =
+    CRC32_CTX_INITIALIZER(0x04c11db7, 0, crc32_tbl256_04c11db7, NULL);
+static crc32_ctx_t crc32_ctx_edb88320 __attribute__((__unused__)) =
+    CRC32_CTX_INITIALIZER(0x04c11db7, CRC32_CTX_F_REFLECT,
+    crc32_tbl256_edb88320, crc32_tbl16_edb88320);
+static crc32_ctx_t crc32_ctx_1edc6f41 __attribute__((__unused__)) =
+    CRC32_CTX_INITIALIZER(0x1edc6f41, CRC32_CTX_F_REFLECT,
+    crc32_tbl256_1edc6f41, crc32_tbl16_1edc6f41);
+static crc32_ctx_t crc32_ctx_a833982b __attribute__((__unused__)) =
+    CRC32_CTX_INITIALIZER(0xa833982b, CRC32_CTX_F_REFLECT,
+    crc32_tbl256_a833982b, crc32_tbl16_a833982b);
+static crc32_ctx_t crc32_ctx_814141ab __attribute__((__unused__)) =
+    CRC32_CTX_INITIALIZER(0x814141ab, 0, crc32_tbl256_814141ab, NULL);
+
+
+static inline uint32_t
+crc32_bitrev32(uint32_t val) {
+
+	val = (((val >> 1) & 0x55555555) | ((val & 0x55555555) << 1));
+	val = (((val >> 2) & 0x33333333) | ((val & 0x33333333) << 2));
+	val = (((val >> 4) & 0x0f0f0f0f) | ((val & 0x0f0f0f0f) << 4));
+	return (__builtin_bswap32(val));
+}
+
+/* x^n mod P, P - normal form with implicit x^32. */
+static inline uint32_t
+crc32_xpow_mod(const uint32_t poly, size_t n) {
+	uint32_t r = 1;
+
+	for (; 0 != n; n --) {
+		r = ((r << 1) ^ ((0 != (r & 0x80000000)) ? poly : 0));
+	}
+	return (r);
+}
+
+/* floor(x^64 / P): 33 bits. */
+static inline uint64_t
+crc32_mu(const uint32_t poly) {
+	uint64_t q = 0, r = (((uint64_t)1) << 32);
+	const uint64_t p = ((((uint64_t)1) << 32) | poly);
+
+	for (size_t i = 33; 0 != i; i --) {
+		if (0 != (r & (((uint64_t)1) << 32))) {
+			q |= (((uint64_t)1) << (i - 1));
+			r ^= p;
+		}
+		r <<= 1;
+	}
+	return (q);
+}
+
+/* Return CRC32_CTX_F_CLMUL / CRC32_CTX_F_HW supported for ctx poly. */
+static inline uint32_t
+crc32_cpu_features_get(const crc32_ctx_t *ctx) {
+	uint32_t ret = 0;
+#ifdef CRC32_X86_SIMD
+	const uint32_t cpu_features = cpu_features_get();
+
+	/* PCLMULQDQ + SSSE3 (pshufb for normal form). */
+	if (CPU_F_IS_SET(cpu_features, (CPU_F_PCLMUL | CPU_F_SSSE3))) {
+		ret |= CRC32_CTX_F_CLMUL;
+	}
+	if (0 != (CPU_F_SSE42 & cpu_features) &&
+	    0x1edc6f41 == ctx->poly &&
+	    0 != (CRC32_CTX_F_REFLECT & ctx->flags)) {
+		ret |= CRC32_CTX_F_HW;
+	}
+#endif
+#ifdef CRC32_ARM_PMULL
+	if (0 != (CRC32_CTX_F_REFLECT & ctx->flags)) {
+		ret |= CRC32_CTX_F_CLMUL;
+	}
+#endif
+#ifdef CRC32_ARM_CRC
+	if (0 != (CRC32_CTX_F_REFLECT & ctx->flags) &&
+	    (0x04c11db7 == ctx->poly || 0x1edc6f41 == ctx->poly)) {
+		ret |= CRC32_CTX_F_HW;
+	}
+#endif
+	return (ret);
+}
+
+/* Build tables and constants once.
+ * Concurrent first calls write same values, flag published last. */
+static inline void
+crc32_ctx_init(crc32_ctx_p ctx) {
+	size_t i, j;
+	uint32_t crc;
+	const uint32_t poly = ctx->poly;
+
+	if (0 != (CRC32_CTX_F_INIT & __atomic_load_n(&ctx->flags, __ATOMIC_ACQUIRE)))
+		return;
+	for (i = 0; i < 256; i ++) {
+		ctx->slice16[0][i] = ctx->table256[i];
+	}
+	for (j = 1; j < 16; j ++) {
+		for (i = 0; i < 256; i ++) {
+			crc = ctx->slice16[(j - 1)][i];
+			if (0 != (CRC32_CTX_F_REFLECT & ctx->flags)) {
+				ctx->slice16[j][i] = ((crc >> 8) ^
+				    ctx->table256[(crc & 0xff)]);
+			} else {
+				ctx->slice16[j][i] = ((crc << 8) ^
+				    ctx->table256[(crc >> 24)]);
+			}
+		}
+	}
+	if (0 != (CRC32_CTX_F_REFLECT & ctx->flags)) {
+		/* [x^n mod P]' << 1: 33 bits. */
+		ctx->k[0] = (((uint64_t)crc32_bitrev32(crc32_xpow_mod(poly, ((4 * 128) + 32)))) << 1);
+		ctx->k[1] = (((uint64_t)crc32_bitrev32(crc32_xpow_mod(poly, ((4 * 128) - 32)))) << 1);
+		ctx->k[2] = (((uint64_t)crc32_bitrev32(crc32_xpow_mod(poly, (128 + 32)))) << 1);
+		ctx->k[3] = (((uint64_t)crc32_bitrev32(crc32_xpow_mod(poly, (128 - 32)))) << 1);
+		ctx->k[4] = (((uint64_t)crc32_bitrev32(crc32_xpow_mod(poly, 64))) << 1);
+		ctx->k[5] = 0;
+		/* P' and u' = [x^64 / P]': 33 bits. */
+		ctx->k[6] = ((((uint64_t)crc32_bitrev32(poly)) << 1) | 1);
+		ctx->k[7] = ((((uint64_t)crc32_bitrev32((uint32_t)crc32_mu(poly))) << 1) |
+		    (crc32_mu(poly) >> 32));
+	} else {
+		ctx->k[0] = crc32_xpow_mod(poly, (4 * 128));
+		ctx->k[1] = crc32_xpow_mod(poly, ((4 * 128) + 64));
+		ctx->k[2] = crc32_xpow_mod(poly, 128);
+		ctx->k[3] = crc32_xpow_mod(poly, (128 + 64));
+		ctx->k[4] = crc32_xpow_mod(poly, 96);
+		ctx->k[5] = crc32_xpow_mod(poly, 64);
+		ctx->k[6] = ((((uint64_t)1) << 32) | poly);
+		ctx->k[7] = crc32_mu(poly);
+	}
+	__atomic_store_n(&ctx->flags, (ctx->flags |
+	    crc32_cpu_features_get(ctx) | CRC32_CTX_F_INIT), __ATOMIC_RELEASE);
+}
+
+
+static inline uint32_t
+crc32_load_le32(const uint8_t *buf) {
+
+	return (((uint32_t)buf[0]) | (((uint32_t)buf[1]) << 8) |
+	    (((uint32_t)buf[2]) << 16) | (((uint32_t)buf[3]) << 24));
+}
+
+static inline uint32_t
+crc32_load_be32(const uint8_t *buf) {
+
+	return ((((uint32_t)buf[0]) << 24) | (((uint32_t)buf[1]) << 16) |
+	    (((uint32_t)buf[2]) << 8) | ((uint32_t)buf[3]));
+}
+
+static inline uint32_t
+crc32_reflect_slice16(const uint32_t tbl[16][256], const uint32_t init_crc32,
+    const uint8_t *buf, const size_t buf_size) {
+	register uint32_t crc = init_crc32, a, b, c, d;
+	size_t i;
+
+	for (i = 0; (i + 16) <= buf_size; i += 16) {
+		a = (crc32_load_le32(&buf[i]) ^ crc);
+		b = crc32_load_le32(&buf[(i + 4)]);
+		c = crc32_load_le32(&buf[(i + 8)]);
+		d = crc32_load_le32(&buf[(i + 12)]);
+		crc = (tbl[15][(a & 0xff)] ^ tbl[14][((a >> 8) & 0xff)] ^
+		    tbl[13][((a >> 16) & 0xff)] ^ tbl[12][(a >> 24)] ^
+		    tbl[11][(b & 0xff)] ^ tbl[10][((b >> 8) & 0xff)] ^
+		    tbl[9][((b >> 16) & 0xff)] ^ tbl[8][(b >> 24)] ^
+		    tbl[7][(c & 0xff)] ^ tbl[6][((c >> 8) & 0xff)] ^
+		    tbl[5][((c >> 16) & 0xff)] ^ tbl[4][(c >> 24)] ^
+		    tbl[3][(d & 0xff)] ^ tbl[2][((d >> 8) & 0xff)] ^
+		    tbl[1][((d >> 16) & 0xff)] ^ tbl[0][(d >> 24)]);
+	}
+	for (; i < buf_size; i ++) {
+		crc = ((crc >> 8) ^ tbl[0][((((uint32_t)buf[i]) ^ crc) & 0xff)]);
+	}
+	return (crc);
+}
+
+static inline uint32_t
+crc32_normal_slice16(const uint32_t tbl[16][256], const uint32_t init_crc32,
+    const uint8_t *buf, const size_t buf_size) {
+	register uint32_t crc = init_crc32, a, b, c, d;
+	size_t i;
+
+	for (i = 0; (i + 16) <= buf_size; i += 16) {
+		a = (crc32_load_be32(&buf[i]) ^ crc);
+		b = crc32_load_be32(&buf[(i + 4)]);
+		c = crc32_load_be32(&buf[(i + 8)]);
+		d = crc32_load_be32(&buf[(i + 12)]);
+		crc = (tbl[15][(a >> 24)] ^ tbl[14][((a >> 16) & 0xff)] ^
+		    tbl[13][((a >> 8) & 0xff)] ^ tbl[12][(a & 0xff)] ^
+		    tbl[11][(b >> 24)] ^ tbl[10][((b >> 16) & 0xff)] ^
+		    tbl[9][((b >> 8) & 0xff)] ^ tbl[8][(b & 0xff)] ^
+		    tbl[7][(c >> 24)] ^ tbl[6][((c >> 16) & 0xff)] ^
+		    tbl[5][((c >> 8) & 0xff)] ^ tbl[4][(c & 0xff)] ^
+		    tbl[3][(d >> 24)] ^ tbl[2][((d >> 16) & 0xff)] ^
+		    tbl[1][((d >> 8) & 0xff)] ^ tbl[0][(d & 0xff)]);
+	}
+	for (; i < buf_size; i ++) {
+		crc = ((crc << 8) ^ tbl[0][((crc >> 24) ^ ((uint32_t)buf[i]))]);
+	}
+	return (crc);
+}
+
+
+#ifdef CRC32_X86_SIMD
+/* buf_size: >= 64, multiple of 16. */
+CRC32_TARGET("pclmul,sse2")
+static inline uint32_t
+crc32_reflect_clmul_x86(const uint64_t *k, const uint32_t init_crc32,
+    const uint8_t *buf, size_t buf_size) {
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i*)(const void*)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*)(const void*)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(const void*)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(const void*)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)init_crc32));
+	x0 = _mm_load_si128((const __m128i*)(const void*)&k[0]);
+	buf += 64;
+	buf_size -= 64;
+	/* Fold by 4. */
+	for (; 64 <= buf_size; buf += 64, buf_size -= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+		    _mm_loadu_si128((const __m128i*)(const void*)(buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+		    _mm_loadu_si128((const __m128i*)(const void*)(buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+		    _mm_loadu_si128((const __m128i*)(const void*)(buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+		    _mm_loadu_si128((const __m128i*)(const void*)(buf + 0x30)));
+	}
+	/* Fold into 128 bits. */
+	x0 = _mm_load_si128((const __m128i*)(const void*)&k[2]);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+	for (; 16 <= buf_size; buf += 16, buf_size -= 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+		    _mm_loadu_si128((const __m128i*)(const void*)buf));
+	}
+	/* Fold 128 bits to 64 bits. */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_loadl_epi64((const __m128i*)(const void*)&k[4]);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	/* Barrett reduction to 32 bits. */
+	x0 = _mm_load_si128((const __m128i*)(const void*)&k[6]);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return ((uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+
+/* buf_size: >= 64, multiple of 16.
+ * Data bytes reversed, so bit 127 is first bit of block. */
+CRC32_TARGET("pclmul,ssse3")
+static inline uint32_t
+crc32_normal_clmul_x86(const uint64_t *k, const uint32_t init_crc32,
+    const uint8_t *buf, size_t buf_size) {
+	uint64_t t;
+	const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+	    7, 6, 5, 4, 3, 2, 1, 0);
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+#define CRC32_X86_LOAD_BE128(__ptr)					\
+	_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(const void*)(__ptr)), bswap)
+
+	x1 = CRC32_X86_LOAD_BE128(buf + 0x00);
+	x2 = CRC32_X86_LOAD_BE128(buf + 0x10);
+	x3 = CRC32_X86_LOAD_BE128(buf + 0x20);
+	x4 = CRC32_X86_LOAD_BE128(buf + 0x30);
+	x1 = _mm_xor_si128(x1,
+	    _mm_slli_si128(_mm_cvtsi32_si128((int)init_crc32), 12));
+	x0 = _mm_load_si128((const __m128i*)(const void*)&k[0]);
+	buf += 64;
+	buf_size -= 64;
+	/* Fold by 4: lo * (x^512 mod P) + hi * (x^576 mod P). */
+	for (; 64 <= buf_size; buf += 64, buf_size -= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+		    CRC32_X86_LOAD_BE128(buf + 0x00));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+		    CRC32_X86_LOAD_BE128(buf + 0x10));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+		    CRC32_X86_LOAD_BE128(buf + 0x20));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+		    CRC32_X86_LOAD_BE128(buf + 0x30));
+	}
+	/* Fold into 128 bits. */
+	x0 = _mm_load_si128((const __m128i*)(const void*)&k[2]);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+	for (; 16 <= buf_size; buf += 16, buf_size -= 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+		    CRC32_X86_LOAD_BE128(buf));
+	}
+#undef CRC32_X86_LOAD_BE128
+	/* R * x^32 = hi * x^96 + lo * x^32: 96 bits. */
+	x0 = _mm_load_si128((const __m128i*)(const void*)&k[4]);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x01);
+	x1 = _mm_xor_si128(_mm_slli_si128(_mm_move_epi64(x1), 4), x2);
+	/* 96 -> 64 bits: hi32 * (x^64 mod P) + lo64. */
+	t = (uint64_t)_mm_cvtsi128_si64(x1);
+	x1 = _mm_srli_si128(x1, 8); /* hi32 in low qword. */
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	t ^= (uint64_t)_mm_cvtsi128_si64(x1);
+	/* Barrett: q = ((t >> 32) * mu) >> 32; crc = t ^ q * P. */
+	x0 = _mm_load_si128((const __m128i*)(const void*)&k[6]);
+	x1 = _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)(t >> 32)), x0, 0x10);
+	x1 = _mm_srli_epi64(x1, 32);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+
+	return ((uint32_t)(t ^ (uint64_t)_mm_cvtsi128_si64(x1)));
+}
+
+CRC32_TARGET("sse4.2")
+static inline uint32_t
+crc32c_hw_x86(const uint32_t init_crc32, const uint8_t *buf, size_t buf_size) {
+	uint64_t crc = init_crc32, val;
+
+	for (; 0 != buf_size && 0 != (((uintptr_t)buf) & 7); buf ++, buf_size --) {
+		crc = _mm_crc32_u8((uint32_t)crc, (*buf));
+	}
+	for (; 8 <= buf_size; buf += 8, buf_size -= 8) {
+		memcpy(&val, buf, sizeof(val));
+		crc = _mm_crc32_u64(crc, val);
+	}
+	for (; 0 != buf_size; buf ++, buf_size --) {
+		crc = _mm_crc32_u8((uint32_t)crc, (*buf));
+	}
+	return ((uint32_t)crc);
+}
+#endif /* CRC32_X86_SIMD */
+
+#ifdef CRC32_ARM_PMULL
+static inline uint64x2_t
+crc32_arm_clmul(const uint64x2_t a, const uint64x2_t b, const int imm) {
+
+	return (vreinterpretq_u64_p128(vmull_p64(
+	    (poly64_t)vgetq_lane_u64(a, ((0 != (imm & 0x01)) ? 1 : 0)),
+	    (poly64_t)vgetq_lane_u64(b, ((0 != (imm & 0x10)) ? 1 : 0)))));
+}
+
+/* buf_size: >= 64, multiple of 16. Same as crc32_reflect_clmul_x86(). */
+static inline uint32_t
+crc32_reflect_clmul_arm(const uint64_t *k, const uint32_t init_crc32,
+    const uint8_t *buf, size_t buf_size) {
+	const uint64x2_t zero = vdupq_n_u64(0);
+	const uint64x2_t mask32 = vreinterpretq_u64_u32((uint32x4_t){ ~0U, 0, ~0U, 0 });
+	uint64x2_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+#define CRC32_ARM_LOAD128(__ptr)	vreinterpretq_u64_u8(vld1q_u8((__ptr)))
+#define CRC32_ARM_SRLI_SI128(__x, __n)					\
+	vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64((__x)),	\
+	    vreinterpretq_u8_u64(zero), (__n)))
+
+	x1 = CRC32_ARM_LOAD128(buf + 0x00);
+	x2 = CRC32_ARM_LOAD128(buf + 0x10);
+	x3 = CRC32_ARM_LOAD128(buf + 0x20);
+	x4 = CRC32_ARM_LOAD128(buf + 0x30);
+	x1 = veorq_u64(x1, vreinterpretq_u64_u32(vsetq_lane_u32(init_crc32,
+	    vdupq_n_u32(0), 0)));
+	x0 = vld1q_u64(&k[0]);
+	buf += 64;
+	buf_size -= 64;
+	for (; 64 <= buf_size; buf += 64, buf_size -= 64) {
+		x5 = crc32_arm_clmul(x1, x0, 0x00);
+		x6 = crc32_arm_clmul(x2, x0, 0x00);
+		x7 = crc32_arm_clmul(x3, x0, 0x00);
+		x8 = crc32_arm_clmul(x4, x0, 0x00);
+		x1 = crc32_arm_clmul(x1, x0, 0x11);
+		x2 = crc32_arm_clmul(x2, x0, 0x11);
+		x3 = crc32_arm_clmul(x3, x0, 0x11);
+		x4 = crc32_arm_clmul(x4, x0, 0x11);
+		x1 = veorq_u64(veorq_u64(x1, x5), CRC32_ARM_LOAD128(buf + 0x00));
+		x2 = veorq_u64(veorq_u64(x2, x6), CRC32_ARM_LOAD128(buf + 0x10));
+		x3 = veorq_u64(veorq_u64(x3, x7), CRC32_ARM_LOAD128(buf + 0x20));
+		x4 = veorq_u64(veorq_u64(x4, x8), CRC32_ARM_LOAD128(buf + 0x30));
+	}
+	x0 = vld1q_u64(&k[2]);
+	x5 = crc32_arm_clmul(x1, x0, 0x00);
+	x1 = crc32_arm_clmul(x1, x0, 0x11);
+	x1 = veorq_u64(veorq_u64(x1, x2), x5);
+	x5 = crc32_arm_clmul(x1, x0, 0x00);
+	x1 = crc32_arm_clmul(x1, x0, 0x11);
+	x1 = veorq_u64(veorq_u64(x1, x3), x5);
+	x5 = crc32_arm_clmul(x1, x0, 0x00);
+	x1 = crc32_arm_clmul(x1, x0, 0x11);
+	x1 = veorq_u64(veorq_u64(x1, x4), x5);
+	for (; 16 <= buf_size; buf += 16, buf_size -= 16) {
+		x5 = crc32_arm_clmul(x1, x0, 0x00);
+		x1 = crc32_arm_clmul(x1, x0, 0x11);
+		x1 = veorq_u64(veorq_u64(x1, x5), CRC32_ARM_LOAD128(buf));
+	}
+	x2 = crc32_arm_clmul(x1, x0, 0x10);
+	x1 = veorq_u64(CRC32_ARM_SRLI_SI128(x1, 8), x2);
+	x0 = vsetq_lane_u64(k[4], zero, 0);
+	x2 = CRC32_ARM_SRLI_SI128(x1, 4);
+	x1 = vandq_u64(x1, mask32);
+	x1 = crc32_arm_clmul(x1, x0, 0x00);
+	x1 = veorq_u64(x1, x2);
+	x0 = vld1q_u64(&k[6]);
+	x2 = vandq_u64(x1, mask32);
+	x2 = crc32_arm_clmul(x2, x0, 0x10);
+	x2 = vandq_u64(x2, mask32);
+	x2 = crc32_arm_clmul(x2, x0, 0x00);
+	x1 = veorq_u64(x1, x2);
+#undef CRC32_ARM_LOAD128
+#undef CRC32_ARM_SRLI_SI128
+
+	return (vgetq_lane_u32(vreinterpretq_u32_u64(x1), 1));
+}
+#endif /* CRC32_ARM_PMULL */
+
+#ifdef CRC32_ARM_CRC
+static inline uint32_t
+crc32_hw_arm(const uint32_t poly, uint32_t crc, const uint8_t *buf,
+    size_t buf_size) {
+	uint64_t val;
+
+	if (0x1edc6f41 == poly) {
+		for (; 8 <= buf_size; buf += 8, buf_size -= 8) {
+			memcpy(&val, buf, sizeof(val));
+			crc = __crc32cd(crc, val);
+		}
+		for (; 0 != buf_size; buf ++, buf_size --) {
+			crc = __crc32cb(crc, (*buf));
+		}
+	} else {
+		for (; 8 <= buf_size; buf += 8, buf_size -= 8) {
+			memcpy(&val, buf, sizeof(val));
+			crc = __crc32d(crc, val);
+		}
+		for (; 0 != buf_size; buf ++, buf_size --) {
+			crc = __crc32b(crc, (*buf));
+		}
+	}
+	return (crc);
+}
+#endif /* CRC32_ARM_CRC */
+
+/* 0 - not supported by CPU / build. */
+static inline int
+crc32_ctx_impl_is_supported(crc32_ctx_p ctx, const uint32_t impl) {
+
+	crc32_ctx_init(ctx);
+	switch (impl) {
+	case CRC32_IMPL_TBL:
+	case CRC32_IMPL_SLICE16:
+	case CRC32_IMPL_AUTO:
+		return (1);
+	case CRC32_IMPL_CLMUL:
+#ifdef CRC32_X86_SIMD
+		return (0 != (CRC32_CTX_F_CLMUL & ctx->flags));
+#endif
+#ifdef CRC32_ARM_PMULL
+		return (0 != (CRC32_CTX_F_CLMUL & ctx->flags));
+#endif
+		break;
+	case CRC32_IMPL_HW:
+		return (0 != (CRC32_CTX_F_HW & ctx->flags));
+	}
+	return (0);
+}
+
+/* Calculate using specified implementation, it must be supported. */
+static inline uint32_t
+crc32_ctx_update_impl(crc32_ctx_p ctx, const uint32_t impl,
+    const uint32_t init_crc32, const uint8_t *buf, const size_t buf_size) {
+	size_t fold_size;
+	uint32_t crc = init_crc32;
+	const int reflect = (0 != (CRC32_CTX_F_REFLECT & ctx->flags));
+
+	if (NULL == buf || 0 == buf_size)
+		return (crc);
+	switch (impl) {
+	case CRC32_IMPL_TBL:
+		if (0 != reflect)
+			return (crc32_reflect(ctx->table256, ctx->table16,
+			    crc, buf, buf_size));
+		return (crc32_normal(ctx->table256, crc, buf, buf_size));
+	case CRC32_IMPL_CLMUL:
+		fold_size = (buf_size & ~((size_t)15));
+		if (CRC32_FOLD_MIN > fold_size)
+			break;
+#ifdef CRC32_X86_SIMD
+		if (0 != reflect) {
+			crc = crc32_reflect_clmul_x86(ctx->k, crc, buf, fold_size);
+		} else {
+			crc = crc32_normal_clmul_x86(ctx->k, crc, buf, fold_size);
+		}
+#endif
+#ifdef CRC32_ARM_PMULL
+		crc = crc32_reflect_clmul_arm(ctx->k, crc, buf, fold_size);
+#endif
+#if defined(CRC32_X86_SIMD) || defined(CRC32_ARM_PMULL)
+		return (crc32_ctx_update_impl(ctx,
+		    ((0 != (CRC32_CTX_F_HW & ctx->flags)) ?
+		     CRC32_IMPL_HW : CRC32_IMPL_SLICE16), crc,
+		    (buf + fold_size), (buf_size - fold_size)));
+#endif
+		break;
+	case CRC32_IMPL_HW:
+#ifdef CRC32_X86_SIMD
+		return (crc32c_hw_x86(crc, buf, buf_size));
+#endif
+#ifdef CRC32_ARM_CRC
+		return (crc32_hw_arm(ctx->poly, crc, buf, buf_size));
+#endif
+		break;
+	}
+	/* CRC32_IMPL_SLICE16 */
+	if (0 != reflect)
+		return (crc32_reflect_slice16(
+		    (const uint32_t (*)[256])ctx->slice16, crc, buf, buf_size));
+	return (crc32_normal_slice16((const uint32_t (*)[256])ctx->slice16,
+	    crc, buf, buf_size));
+}
+
+/* Pick fastest available implementation for data size. */
+static inline uint32_t
+crc32_ctx_update(crc32_ctx_p ctx, const uint32_t init_crc32,
+    const uint8_t *buf, const size_t buf_size) {
+
+	if (16 > buf_size)
+		return (crc32_ctx_update_impl(ctx, CRC32_IMPL_TBL,
+		    init_crc32, buf, buf_size));
+	crc32_ctx_init(ctx);
+	if (0 != (CRC32_CTX_F_HW & ctx->flags) &&
+	    (0 == (CRC32_CTX_F_CLMUL & ctx->flags) ||
+	     CRC32_HW_FOLD_MIN > buf_size))
+		return (crc32_ctx_update_impl(ctx, CRC32_IMPL_HW,
+		    init_crc32, buf, buf_size));
+	if (0 != (CRC32_CTX_F_CLMUL & ctx->flags) &&
+	    CRC32_FOLD_MIN <= buf_size)
+		return (crc32_ctx_update_impl(ctx, CRC32_IMPL_CLMUL,
+		    init_crc32, buf, buf_size));
+	return (crc32_ctx_update_impl(ctx, CRC32_IMPL_SLICE16,
+	    init_crc32, buf, buf_size));
+}
+
+
+
 /* CRC-32/BZIP2
  * Alias: CRC-32/AAL5, CRC-32/DECT-B, B-CRC-32
  * width=32 poly=0x04c11db7 init=0xffffffff refin=false refout=false
  * xorout=0xffffffff check=0xfc891918 residue=0xc704dd7b name="CRC-32/BZIP2" */
 #define crc32a_update(_crc, _data, _size)				\
-	(~crc32_normal(crc32_tbl256_04c11db7, ~(_crc), (_data), (_size)))
+	(~crc32_ctx_update(&crc32_ctx_04c11db7, ~(_crc), (_data), (_size)))
 #define crc32a(_data, _size)						\
 	crc32a_update(~0xffffffff, (_data), (_size))
 
@@ -512,7 +1152,7 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
  * width=32 poly=0x04c11db7 init=0x00000000 refin=false refout=false
  * xorout=0xffffffff check=0x765e7680 residue=0xc704dd7b name="CRC-32/CKSUM" */
 #define crc32cksum_update(_crc, _data, _size)				\
-	(~crc32_normal(crc32_tbl256_04c11db7, ~(_crc), (_data), (_size)))
+	(~crc32_ctx_update(&crc32_ctx_04c11db7, ~(_crc), (_data), (_size)))
 #define crc32cksum(_data, _size)					\
 	crc32cksum_update(~0x00000000, (_data), (_size))
 
@@ -520,7 +1160,7 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
  * width=32 poly=0x04c11db7 init=0xffffffff refin=false refout=false
  * xorout=0x00000000 check=0x0376e6e7 residue=0x00000000 name="CRC-32/MPEG-2" */
 #define crc32mpeg2_update(_crc, _data, _size)				\
-	(crc32_normal(crc32_tbl256_04c11db7, (_crc), (_data), (_size)))
+	(crc32_ctx_update(&crc32_ctx_04c11db7, (_crc), (_data), (_size)))
 #define crc32mpeg2(_data, _size)					\
 	crc32mpeg2_update(0xffffffff, (_data), (_size))
 
@@ -530,7 +1170,7 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
  * width=32 poly=0x04c11db7 init=0xffffffff refin=true refout=true
  * xorout=0xffffffff check=0xcbf43926 residue=0xdebb20e3 name="CRC-32/ISO-HDLC" */
 #define crc32b_update(_crc, _data, _size)				\
-	(~crc32_reflect(crc32_tbl256_edb88320, crc32_tbl16_edb88320, ~(_crc), (_data), (_size)))
+	(~crc32_ctx_update(&crc32_ctx_edb88320, ~(_crc), (_data), (_size)))
 #define crc32b(_data, _size)						\
 	crc32b_update(~0xffffffff, (_data), (_size))
 
@@ -539,7 +1179,7 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
  * width=32 poly=0x04c11db7 init=0xffffffff refin=true refout=true
  * xorout=0x00000000 check=0x340bc6d9 residue=0x00000000 name="CRC-32/JAMCRC" */
 #define crc32jamcrc_update(_crc, _data, _size)				\
-	(crc32_reflect(crc32_tbl256_edb88320, crc32_tbl16_edb88320, (_crc), (_data), (_size)))
+	(crc32_ctx_update(&crc32_ctx_edb88320, (_crc), (_data), (_size)))
 #define crc32jamcrc(_data, _size)					\
 	crc32jamcrc_update(0xffffffff, (_data), (_size))
 
@@ -549,7 +1189,7 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
  * width=32 poly=0x1edc6f41 init=0xffffffff refin=true refout=true
  * xorout=0xffffffff check=0xe3069283 residue=0xb798b438 name="CRC-32/ISCSI" */
 #define crc32c_update(_crc, _data, _size)				\
-	(~crc32_reflect(crc32_tbl256_1edc6f41, crc32_tbl16_1edc6f41, ~(_crc), (_data), (_size)))
+	(~crc32_ctx_update(&crc32_ctx_1edc6f41, ~(_crc), (_data), (_size)))
 #define crc32c(_data, _size)						\
 	crc32c_update(~0xffffffff, (_data), (_size))
 
@@ -559,7 +1199,7 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
  * width=32 poly=0xa833982b init=0xffffffff refin=true refout=true
  * xorout=0xffffffff check=0x87315576 residue=0x45270551 name="CRC-32/BASE91-D" */
 #define crc32d_update(_crc, _data, _size)				\
-	(~crc32_reflect(crc32_tbl256_a833982b, crc32_tbl16_a833982b, ~(_crc), (_data), (_size)))
+	(~crc32_ctx_update(&crc32_ctx_a833982b, ~(_crc), (_data), (_size)))
 #define crc32d(_data, _size)						\
 	crc32d_update(~0xffffffff, (_data), (_size))
 
@@ -569,7 +1209,7 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
  * width=32 poly=0x814141ab init=0x00000000 refin=false refout=false
  * xorout=0x00000000 check=0x3010bf7f residue=0x00000000 name="CRC-32/AIXM" */
 #define crc32q_update(_crc, _data, _size)				\
-	(crc32_normal(crc32_tbl256_814141ab, (_crc), (_data), (_size)))
+	(crc32_ctx_update(&crc32_ctx_814141ab, (_crc), (_data), (_size)))
 #define crc32q(_data, _size)						\
 	crc32q_update(0x00000000, (_data), (_size))
 
@@ -580,6 +1220,11 @@ static const uint32_t crc32_tbl256_814141ab[256] = {
 static inline int
 crc32_self_test(void) {
 	uint32_t crca, crcb, crcc, crcd, crcq;
+	uint8_t buf[1100];
+	crc32_ctx_p ctx[] = {
+		&crc32_ctx_04c11db7, &crc32_ctx_edb88320, &crc32_ctx_1edc6f41,
+		&crc32_ctx_a833982b, &crc32_ctx_814141ab
+	};
 	/* https://crccalc.com/ */
 	const char *data[] = {
 		"123456789",
@@ -653,6 +1298,29 @@ crc32_self_test(void) {
 		if (result_crc32q[i] != crcq)
 			return (5);
 	}
+	/* All implementations must match byte table on all sizes and
+	 * alignments. */
+	for (size_t i = 0; i < sizeof(buf); i ++) {
+		buf[i] = (uint8_t)((i * 251) ^ (i >> 8));
+	}
+	for (size_t i = 0; i < nitems(ctx); i ++) {
+		for (uint32_t impl = CRC32_IMPL_SLICE16; impl <= CRC32_IMPL_HW; impl ++) {
+			if (0 == crc32_ctx_impl_is_supported(ctx[i], impl))
+				continue;
+			for (size_t size = 0; size < (sizeof(buf) - 16);
+			    size += (1 + (size / 16))) {
+				for (size_t off = 0; off < 16; off += 5) {
+					crca = crc32_ctx_update_impl(ctx[i],
+					    CRC32_IMPL_TBL, 0xffffffff,
+					    (buf + off), size);
+					crcb = crc32_ctx_update_impl(ctx[i],
+					    impl, 0xffffffff, (buf + off), size);
+					if (crca != crcb)
+						return ((int)(10 + (i * 10) + impl));
+				}
+			}
+		}
+	}
 
 	return (0);
 }
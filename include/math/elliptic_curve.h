@@ -34,6 +34,10 @@
  * [1]: Guide to Elliptic Curve Cryptography
  * Darrel Hankerson, Alfred Menezes, Scott Vanstone
  * [2]: http://www.hyperelliptic.org/EFD/g1p/auto-shortw-jacobian.html
+ * [3]: FIPS 186-4 Digital Signature Standard (DSS),
+ * D.2 Implementation of Modular Arithmetic
+ * [4]: Exponent Recoding and Regular Exponentiation Algorithms
+ * Marc Joye, Michael Tunstall
  */
 
 #ifndef __MATH_EC_H__
@@ -51,6 +55,8 @@
 
 
 #define EC_CURVE_CALC_BYTES(curve) (((curve)->m + 7) / 8)
+#define EC_CURVE_CALC_DIGITS(curve)					\
+	((EC_CURVE_CALC_BYTES(curve) + BN_DIGIT_SIZE - 1) / BN_DIGIT_SIZE)
 /* Double size + 1 digit. */
 #define EC_CURVE_CALC_BITS_DBL(curve)	(BN_DIGIT_BITS + (2 * (curve)->m))
 
@@ -120,6 +126,27 @@
 #endif /* EC_PROJ_ADD_MIX */
 
 
+/* Prime field arithmetic of projective point operations: fixed size
+ * Solinas reduction for NIST/SEC primes (EC_CURVE_PF_*), other curves
+ * in Montgomery form of p (EC_USE_MONTGOMERY) or generic bn_mod_*().
+ * Conversion only on affine import/export. */
+#ifdef EC_USE_MONTGOMERY
+#	ifndef EC_USE_PROJECTIVE
+#		error "EC_USE_MONTGOMERY require EC_USE_PROJECTIVE"
+#	endif
+#	define ec_pf_is_mont(curve)	(EC_CURVE_PF_GENERIC == (curve)->pf)
+#else
+#	define ec_pf_is_mont(curve)	0
+#endif /* EC_USE_MONTGOMERY */
+
+#if !defined(EC_DISABLE_PF_SPECIALIZED) &&				\
+    (32 == BN_DIGIT_BIT_CNT || 64 == BN_DIGIT_BIT_CNT)
+#	define EC_PF_SPECIALIZED	1
+#endif
+
+#define ec_pf_a(curve)		(&(curve)->a_pf)
+
+
 #ifdef EC_DISABLE_PUB_KEY_CHK
 #	define ec_point_check_as_pub_key__int(point, curve)	0 /* OK, no error. */
 #else
@@ -442,6 +469,51 @@ typedef struct elliptic_curve_proj_pf_fpx_comb2t_mult_data_s {
 		ec_point_proj_inter_twin_mult_affine
 #endif /* EC_PF_TWIN_MULT_ALGO */
 
+/* Max interleaving w-NAF window bits: table has 2^(bits - 2) points. */
+#ifndef EC_PF_TWIN_MULT_WIN_BITS_MAX
+#	define EC_PF_TWIN_MULT_WIN_BITS_MAX	6
+#endif
+
+/* Max points normalized with one field inversion. */
+#ifndef EC_PROJ_NORM_BATCH_MAX
+#	define EC_PROJ_NORM_BATCH_MAX	16
+#endif
+
+/* Constant time point multiplication for secret scalars:
+ * ec_point_ct_mult(), ec_point_ct_mult_bp().
+ * Projective only; EC_DISABLE_CONSTANT_TIME - use
+ * ec_point_unknown_pt_mult() / ec_point_mult_bp() instead.
+ * Table has 2^(bits - 1) odd multiples and their doubles: mixed addition
+ * selects the double for a == b. Base point uses EC_CT_MULT_BP_TBL_CNT
+ * tables, one per scalar part: doublings count divided by tables count.
+ * Secret key range checks and reductions use bn_is_less_ct() and
+ * bn_mod_reduce_ct().
+ * Still variable time: table precompute for ec_point_ct_mult() (depends
+ * on public point), scalar bn->digits (leading zero digits count), checks
+ * of public results (infinity, r == 0, s == 0) and affine export of the
+ * result. */
+#if defined(EC_USE_PROJECTIVE) && !defined(EC_DISABLE_CONSTANT_TIME)
+#	define EC_CONSTANT_TIME	1
+#endif
+#ifndef EC_CT_MULT_WIN_BITS
+#	define EC_CT_MULT_WIN_BITS	4
+#endif
+#ifndef EC_CT_MULT_BP_WIN_BITS
+#	define EC_CT_MULT_BP_WIN_BITS	5
+#endif
+#ifndef EC_CT_MULT_BP_TBL_CNT
+#	define EC_CT_MULT_BP_TBL_CNT	8
+#endif
+#define EC_CT_MULT_TBL_CNT_MAX		8
+#if EC_CT_MULT_WIN_BITS < 2 ||						\
+    EC_CT_MULT_WIN_BITS >= EC_PF_TWIN_MULT_WIN_BITS_MAX ||		\
+    EC_CT_MULT_BP_WIN_BITS < 2 ||					\
+    EC_CT_MULT_BP_WIN_BITS >= EC_PF_TWIN_MULT_WIN_BITS_MAX ||		\
+    EC_CT_MULT_BP_TBL_CNT < 1 ||					\
+    EC_CT_MULT_BP_TBL_CNT > EC_CT_MULT_TBL_CNT_MAX
+#	error "EC_CT_MULT_* out of range"
+#endif
+
 
 
 
@@ -455,13 +527,18 @@ typedef struct elliptic_curve_curve_s {
 	bn_t	p;	/* Prime field Fp */
 	bn_t	a;
 	bn_t	b;
+	bn_t	a_pf;	/* a in ec_pf_*() representation. */
 	ec_point_t G;	/* The base point on the elliptic curve. */
 	bn_t	n;
 	uint32_t h;
 	uint32_t algo;	/* EC_CURVE_ALGO_*: ECDSA, GOST */
 	uint32_t flags;	/* EC_CURVE_FLAG_* */
+	uint32_t pf;	/* EC_CURVE_PF_*: prime field arithmetic. */
 #if EC_PF_FXP_MULT_ALGO != EC_PF_FXP_MULT_ALGO_BIN
 	ec_pt_fpx_mult_data_t G_fpx_mult_data;
+#endif
+#ifdef EC_CONSTANT_TIME
+	ec_point_t G_ct_tbl[(EC_CT_MULT_BP_TBL_CNT << EC_CT_MULT_BP_WIN_BITS)];
 #endif
 	bn_mod_rd_data_t p_mod_rd_data;
 	bn_mod_rd_data_t n_mod_rd_data;
@@ -471,6 +548,446 @@ typedef struct elliptic_curve_curve_s {
 
 #define EC_CURVE_FLAG_A_M3	1 /* a = 3, use tricks. */
 
+#define EC_CURVE_PF_GENERIC	0 /* bn_mod_*() or Montgomery form. */
+#define EC_CURVE_PF_P256	1 /* secp256r1: 2^256 - 2^224 + 2^192 + 2^96 - 1 */
+#define EC_CURVE_PF_P384	2 /* secp384r1: 2^384 - 2^128 - 2^96 + 2^32 - 1 */
+#define EC_CURVE_PF_SECP256K1	3 /* secp256k1: 2^256 - 2^32 - 977 */
+
+
+/*--------------------- PRIME FIELD: SOLINAS PRIMES --------------------------*/
+#ifdef EC_PF_SPECIALIZED
+/* Fixed size: 4/6 limbs for 64 bit digits, 8/12 for 32 bit digits.
+ * Reduction formulas defined on 32 bit words. */
+#define EC_PF_SPEC_DIGITS_256	(256 / BN_DIGIT_BIT_CNT)
+#define EC_PF_SPEC_DIGITS_384	(384 / BN_DIGIT_BIT_CNT)
+#define EC_PF_SPEC_WORDS_PER_DIGIT (BN_DIGIT_BIT_CNT / 32)
+
+static const uint32_t ec_pf_p256_words[8] = {
+	0xffffffff, 0xffffffff, 0xffffffff, 0x00000000,
+	0x00000000, 0x00000000, 0x00000001, 0xffffffff
+};
+static const uint32_t ec_pf_p384_words[12] = {
+	0xffffffff, 0x00000000, 0x00000000, 0xffffffff,
+	0xfffffffe, 0xffffffff, 0xffffffff, 0xffffffff,
+	0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff
+};
+static const uint32_t ec_pf_secp256k1_words[8] = {
+	0xfffffc2f, 0xfffffffe, 0xffffffff, 0xffffffff,
+	0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff
+};
+
+
+static inline void
+ec_pf_spec_to_words__int(const bn_digit_t *a, size_t count, uint32_t *w) {
+	register size_t i;
+
+	for (i = 0; i < (count * EC_PF_SPEC_WORDS_PER_DIGIT); i ++) {
+		w[i] = (uint32_t)(a[(i / EC_PF_SPEC_WORDS_PER_DIGIT)] >>
+		    (32 * (i % EC_PF_SPEC_WORDS_PER_DIGIT)));
+	}
+}
+
+static inline void
+ec_pf_spec_from_words__int(const uint32_t *w, size_t count, bn_digit_t *a) {
+	register size_t i;
+
+	bn_digits_assign_zero(a, count);
+	for (i = 0; i < (count * EC_PF_SPEC_WORDS_PER_DIGIT); i ++) {
+		a[(i / EC_PF_SPEC_WORDS_PER_DIGIT)] |= (((bn_digit_t)w[i]) <<
+		    (32 * (i % EC_PF_SPEC_WORDS_PER_DIGIT)));
+	}
+}
+
+/* res[2 * count] = a * b. count is constant at call site: unrolled. */
+static inline void
+ec_pf_spec_mult__int(bn_digit_t *res, const bn_digit_t *a,
+    const bn_digit_t *b, size_t count) {
+	register size_t i, j;
+	bn_digit_t crr;
+
+	bn_digits_assign_zero(res, count);
+	for (i = 0; i < count; i ++) {
+		crr = 0;
+		for (j = 0; j < count; j ++) {
+			bn_digit_mult_add2__int(a[j], b[i], res[(i + j)], crr,
+			    &res[(i + j)], &crr);
+		}
+		res[(i + count)] = crr;
+	}
+}
+
+/* res[2 * count] = a^2: cross products once and doubled. */
+static inline void
+ec_pf_spec_square__int(bn_digit_t *res, const bn_digit_t *a, size_t count) {
+	register size_t i, j;
+	bn_digit_t crr, hi;
+
+	bn_digits_assign_zero(res, (2 * count));
+	for (i = 0; i < count; i ++) {
+		crr = 0;
+		for (j = (i + 1); j < count; j ++) {
+			bn_digit_mult_add2__int(a[i], a[j], res[(i + j)], crr,
+			    &res[(i + j)], &crr);
+		}
+		res[(i + count)] = crr;
+	}
+	for (i = 0, crr = 0; i < (2 * count); i ++) {
+		hi = (res[i] >> (BN_DIGIT_BITS - 1));
+		res[i] = ((res[i] << 1) | crr);
+		crr = hi;
+	}
+	for (i = 0, crr = 0; i < count; i ++) {
+		bn_digit_mult_add2__int(a[i], a[i], res[(2 * i)], crr,
+		    &res[(2 * i)], &hi);
+		res[((2 * i) + 1)] += hi;
+		crr = ((res[((2 * i) + 1)] < hi) ? 1 : 0);
+	}
+}
+
+/* Computes: r = (top * 2^(32 * count) + r) mod p, r < 2^(32 * count),
+ * top - small signed value: |top| * c < p - c, c = 2^(32 * count) - p.
+ * Fixed limbs count and masked selection: no data dependent branches. */
+static inline void
+ec_pf_spec_words_final__int(uint32_t *r, int64_t top, const uint32_t *p,
+    size_t count) {
+	register size_t i;
+	int64_t acc;
+	uint32_t mask, t[12];
+
+	/* r = r - top * p = r + top * c: top in -1..1. */
+	for (i = 0, acc = 0; i < count; i ++) {
+		acc += (((int64_t)r[i]) - (top * p[i]));
+		r[i] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	top += acc;
+	/* r += p if top < 0: top in 0..1. */
+	mask = (((uint32_t)0) - ((uint32_t)(((uint64_t)top) >> 63)));
+	for (i = 0, acc = 0; i < count; i ++) {
+		acc += (((int64_t)r[i]) + (p[i] & mask));
+		r[i] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	top += acc;
+	/* r -= p if top > 0 or r >= p: 2^(32 * count) < 2p, once. */
+	for (i = 0, acc = 0; i < count; i ++) {
+		acc += (((int64_t)r[i]) - p[i]);
+		t[i] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	top += acc;
+	mask = (((uint32_t)0) - ((uint32_t)(1 ^ (((uint64_t)top) >> 63))));
+	for (i = 0; i < count; i ++) {
+		r[i] ^= (mask & (r[i] ^ t[i]));
+	}
+}
+
+#define EC_PF_SPEC_WORD_OUT(__r, __idx, __acc, __sum) do {		\
+	(__acc) += (__sum);						\
+	(__r)[(__idx)] = (uint32_t)(__acc);				\
+	(__acc) >>= 32;							\
+} while (0)
+
+/* [3]: D.2.3 Curve P-256: r = c mod p256, c - 16 words. */
+static inline void
+ec_pf_spec_p256_reduce__int(const uint32_t *c, uint32_t *r) {
+	int64_t acc = 0;
+
+	/* T + 2S1 + 2S2 + S3 + S4 - D1 - D2 - D3 - D4 */
+	EC_PF_SPEC_WORD_OUT(r, 0, acc, ((int64_t)c[0] + c[8] + c[9]
+	    - c[11] - c[12] - c[13] - c[14]));
+	EC_PF_SPEC_WORD_OUT(r, 1, acc, ((int64_t)c[1] + c[9] + c[10]
+	    - c[12] - c[13] - c[14] - c[15]));
+	EC_PF_SPEC_WORD_OUT(r, 2, acc, ((int64_t)c[2] + c[10] + c[11]
+	    - c[13] - c[14] - c[15]));
+	EC_PF_SPEC_WORD_OUT(r, 3, acc, ((int64_t)c[3] + 2 * ((int64_t)c[11] + c[12])
+	    + c[13] - c[15] - c[8] - c[9]));
+	EC_PF_SPEC_WORD_OUT(r, 4, acc, ((int64_t)c[4] + 2 * ((int64_t)c[12] + c[13])
+	    + c[14] - c[9] - c[10]));
+	EC_PF_SPEC_WORD_OUT(r, 5, acc, ((int64_t)c[5] + 2 * ((int64_t)c[13] + c[14])
+	    + c[15] - c[10] - c[11]));
+	EC_PF_SPEC_WORD_OUT(r, 6, acc, ((int64_t)c[6] + 3 * ((int64_t)c[14])
+	    + 2 * ((int64_t)c[15]) + c[13] - c[8] - c[9]));
+	EC_PF_SPEC_WORD_OUT(r, 7, acc, ((int64_t)c[7] + 3 * ((int64_t)c[15])
+	    + c[8] - c[10] - c[11] - c[12] - c[13]));
+	ec_pf_spec_words_final__int(r, acc, ec_pf_p256_words, 8);
+}
+
+/* [3]: D.2.4 Curve P-384: r = c mod p384, c - 24 words. */
+static inline void
+ec_pf_spec_p384_reduce__int(const uint32_t *c, uint32_t *r) {
+	int64_t acc = 0;
+
+	/* T + 2S1 + S2 + S3 + S4 + S5 + S6 - D1 - D2 - D3 */
+	EC_PF_SPEC_WORD_OUT(r, 0, acc, ((int64_t)c[0] + c[12] + c[20] + c[21]
+	    - c[23]));
+	EC_PF_SPEC_WORD_OUT(r, 1, acc, ((int64_t)c[1] + c[13] + c[22] + c[23]
+	    - c[12] - c[20]));
+	EC_PF_SPEC_WORD_OUT(r, 2, acc, ((int64_t)c[2] + c[14] + c[23]
+	    - c[13] - c[21]));
+	EC_PF_SPEC_WORD_OUT(r, 3, acc, ((int64_t)c[3] + c[12] + c[15] + c[20]
+	    + c[21] - c[14] - c[22] - c[23]));
+	EC_PF_SPEC_WORD_OUT(r, 4, acc, ((int64_t)c[4] + 2 * ((int64_t)c[21])
+	    + c[12] + c[13] + c[16] + c[20] + c[22] - c[15]
+	    - 2 * ((int64_t)c[23])));
+	EC_PF_SPEC_WORD_OUT(r, 5, acc, ((int64_t)c[5] + 2 * ((int64_t)c[22])
+	    + c[13] + c[14] + c[17] + c[21] + c[23] - c[16]));
+	EC_PF_SPEC_WORD_OUT(r, 6, acc, ((int64_t)c[6] + 2 * ((int64_t)c[23])
+	    + c[14] + c[15] + c[18] + c[22] - c[17]));
+	EC_PF_SPEC_WORD_OUT(r, 7, acc, ((int64_t)c[7] + c[15] + c[16] + c[19]
+	    + c[23] - c[18]));
+	EC_PF_SPEC_WORD_OUT(r, 8, acc, ((int64_t)c[8] + c[16] + c[17] + c[20]
+	    - c[19]));
+	EC_PF_SPEC_WORD_OUT(r, 9, acc, ((int64_t)c[9] + c[17] + c[18] + c[21]
+	    - c[20]));
+	EC_PF_SPEC_WORD_OUT(r, 10, acc, ((int64_t)c[10] + c[18] + c[19] + c[22]
+	    - c[21]));
+	EC_PF_SPEC_WORD_OUT(r, 11, acc, ((int64_t)c[11] + c[19] + c[20] + c[23]
+	    - c[22]));
+	ec_pf_spec_words_final__int(r, acc, ec_pf_p384_words, 12);
+}
+
+/* [1]: 2.2.6, p = 2^256 - c, c = 2^32 + 977: r = c mod p, c - 16 words. */
+static inline void
+ec_pf_spec_secp256k1_reduce__int(const uint32_t *c, uint32_t *r) {
+	register size_t i;
+	uint64_t acc, top;
+
+	/* lo + hi * 977 + (hi << 32) */
+	acc = (((uint64_t)c[0]) + (((uint64_t)c[8]) * 977));
+	r[0] = (uint32_t)acc;
+	acc >>= 32;
+	for (i = 1; i < 8; i ++) {
+		acc += (((uint64_t)c[i]) + (((uint64_t)c[(i + 8)]) * 977) +
+		    c[(i + 7)]);
+		r[i] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	top = (acc + c[15]);
+	/* top * 2^256 = top * c, top < 2^33: one fold leaves top in 0..1. */
+	acc = (((uint64_t)r[0]) + (top * 977));
+	r[0] = (uint32_t)acc;
+	acc >>= 32;
+	acc += (((uint64_t)r[1]) + top);
+	r[1] = (uint32_t)acc;
+	acc >>= 32;
+	for (i = 2; i < 8; i ++) {
+		acc += r[i];
+		r[i] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	ec_pf_spec_words_final__int(r, (int64_t)acc, ec_pf_secp256k1_words, 8);
+}
+
+/* res = prod mod p, prod - 2 * count digits, res - count digits. */
+static inline void
+ec_pf_spec_reduce__int(uint32_t pf, const bn_digit_t *prod, bn_digit_t *res) {
+	uint32_t c[24], r[12];
+
+	switch (pf) {
+	case EC_CURVE_PF_P256:
+		ec_pf_spec_to_words__int(prod, (2 * EC_PF_SPEC_DIGITS_256), c);
+		ec_pf_spec_p256_reduce__int(c, r);
+		ec_pf_spec_from_words__int(r, EC_PF_SPEC_DIGITS_256, res);
+		break;
+	case EC_CURVE_PF_P384:
+		ec_pf_spec_to_words__int(prod, (2 * EC_PF_SPEC_DIGITS_384), c);
+		ec_pf_spec_p384_reduce__int(c, r);
+		ec_pf_spec_from_words__int(r, EC_PF_SPEC_DIGITS_384, res);
+		break;
+	case EC_CURVE_PF_SECP256K1:
+		ec_pf_spec_to_words__int(prod, (2 * EC_PF_SPEC_DIGITS_256), c);
+		ec_pf_spec_secp256k1_reduce__int(c, r);
+		ec_pf_spec_from_words__int(r, EC_PF_SPEC_DIGITS_256, res);
+		break;
+	}
+}
+
+/* Computes: bn = bn * n mod p. Require: bn, n < p.
+ * Constant time: fixed count limbs in and out. */
+static inline int
+ec_pf_spec_mult(bn_p bn, bn_p n, ec_curve_p curve) {
+	size_t count;
+	bn_digit_t a[EC_PF_SPEC_DIGITS_384], b[EC_PF_SPEC_DIGITS_384];
+	bn_digit_t prod[(2 * EC_PF_SPEC_DIGITS_384)];
+
+	count = ((EC_CURVE_PF_P384 == curve->pf) ?
+	    EC_PF_SPEC_DIGITS_384 : EC_PF_SPEC_DIGITS_256);
+	if (bn->count < count || bn->digits > count || n->digits > count)
+		return (EOVERFLOW);
+	bn_digits_load_ct(a, count, bn->num, bn->digits);
+	if (bn == n) {
+		if (EC_PF_SPEC_DIGITS_384 == count) {
+			ec_pf_spec_square__int(prod, a, EC_PF_SPEC_DIGITS_384);
+		} else {
+			ec_pf_spec_square__int(prod, a, EC_PF_SPEC_DIGITS_256);
+		}
+	} else {
+		bn_digits_load_ct(b, count, n->num, n->digits);
+		if (EC_PF_SPEC_DIGITS_384 == count) {
+			ec_pf_spec_mult__int(prod, a, b, EC_PF_SPEC_DIGITS_384);
+		} else {
+			ec_pf_spec_mult__int(prod, a, b, EC_PF_SPEC_DIGITS_256);
+		}
+	}
+	ec_pf_spec_reduce__int(curve->pf, prod, bn->num);
+	bn->digits = bn_digits_calc_digits_ct(bn->num, count);
+	return (0);
+}
+#endif /* EC_PF_SPECIALIZED */
+
+
+/*----------------------- PRIME FIELD: DISPATCH ------------------------------*/
+/* Computes: bn = bn * n mod p, in field representation. */
+static inline int
+ec_pf_mult(bn_p bn, bn_p n, ec_curve_p curve) {
+
+#ifdef EC_PF_SPECIALIZED
+	if (EC_CURVE_PF_GENERIC != curve->pf)
+		return (ec_pf_spec_mult(bn, n, curve));
+#endif
+	if (ec_pf_is_mont(curve))
+		return (bn_mont_mult(bn, n, &curve->p, &curve->p_mod_rd_data.mont));
+	return (bn_mod_mult(bn, n, &curve->p, &curve->p_mod_rd_data));
+}
+
+/* Computes: bn = bn^2 mod p, in field representation. */
+static inline int
+ec_pf_square(bn_p bn, ec_curve_p curve) {
+
+#ifdef EC_PF_SPECIALIZED
+	if (EC_CURVE_PF_GENERIC != curve->pf)
+		return (ec_pf_spec_mult(bn, bn, curve));
+#endif
+	if (ec_pf_is_mont(curve))
+		return (bn_mont_square(bn, &curve->p, &curve->p_mod_rd_data.mont));
+	return (bn_mod_square(bn, &curve->p, &curve->p_mod_rd_data));
+}
+
+/* Add, sub, half and assign: fixed p->digits limbs, masked conditional
+ * subtraction/addition of p, no data dependent branches. */
+/* Computes: bn = bn + n mod p. Require: bn, n < p. */
+#define ec_pf_add(bn, n, curve)						\
+	bn_mod_add_ct((bn), (n), &(curve)->p)
+
+/* Computes: bn = bn - n mod p. Require: bn, n < p. */
+#define ec_pf_sub(bn, n, curve)						\
+	bn_mod_sub_ct((bn), (n), &(curve)->p)
+
+/* Computes: bn = bn / 2 mod p. Require: bn < p. */
+#define ec_pf_half(bn, curve)						\
+	bn_mod_half_ct((bn), &(curve)->p)
+
+/* Assigns: bn = n. Require: n < p. */
+#define ec_pf_assign(bn, n, curve)					\
+	bn_assign_ct((bn), (n), (curve)->p.digits)
+
+/* Computes: bn = bn * d mod p. Require: bn < p, d - small public value:
+ * left to right binary, ec_pf_add() only. */
+static inline int
+ec_pf_mult_digit(bn_p bn, bn_digit_t d, ec_curve_p curve) {
+	size_t i;
+	bn_t tm;
+
+	if (0 == d) {
+		bn_assign_zero(bn);
+		return (0);
+	}
+	BN_RET_ON_ERR(bn_init(&tm, (curve->p.digits * BN_DIGIT_BITS)));
+	BN_RET_ON_ERR(ec_pf_assign(&tm, bn, curve));
+	for (i = (BN_DIGIT_BITS - 1); 0 == (d >> i); i --)
+		;
+	for (; 0 < i; i --) {
+		BN_RET_ON_ERR(ec_pf_add(bn, bn, curve));
+		if (0 != ((d >> (i - 1)) & 1)) {
+			BN_RET_ON_ERR(ec_pf_add(bn, &tm, curve));
+		}
+	}
+	return (0);
+}
+
+/* Normal form -> field representation. */
+static inline int
+ec_pf_to(bn_p bn, ec_curve_p curve) {
+
+	if (ec_pf_is_mont(curve))
+		return (bn_mont_to(bn, &curve->p, &curve->p_mod_rd_data.mont));
+	return (0);
+}
+
+/* Normal form -> field representation. Require: bn < p: no range check,
+ * fixed limbs count. */
+static inline int
+ec_pf_to_ct(bn_p bn, ec_curve_p curve) {
+
+	if (ec_pf_is_mont(curve))
+		return (bn_mont_mult(bn, &curve->p_mod_rd_data.mont.r2,
+		    &curve->p, &curve->p_mod_rd_data.mont));
+	return (0);
+}
+
+/* Field representation -> normal form. */
+static inline int
+ec_pf_from(bn_p bn, ec_curve_p curve) {
+
+	if (ec_pf_is_mont(curve))
+		return (bn_mont_from(bn, &curve->p, &curve->p_mod_rd_data.mont));
+	return (0);
+}
+
+/* Assigns: bn = 1 in field representation. */
+static inline int
+ec_pf_one(bn_p bn, ec_curve_p curve) {
+
+	if (ec_pf_is_mont(curve))
+		return (bn_mont_one(bn, &curve->p, &curve->p_mod_rd_data.mont));
+	return (bn_assign_digit(bn, 1));
+}
+
+/* Select field arithmetic: pf - EC_CURVE_PF_* hint from curve params.
+ * Require: p, a and p_mod_rd_data initialized.
+ * Falls back to EC_CURVE_PF_GENERIC if p does not match. */
+static inline int
+ec_curve_pf_init(ec_curve_p curve, uint32_t pf) {
+#ifdef EC_PF_SPECIALIZED
+	size_t count = 0;
+	const uint32_t *p_words = NULL;
+	bn_digit_t p[EC_PF_SPEC_DIGITS_384];
+#endif
+
+	if (NULL == curve)
+		return (EINVAL);
+	curve->pf = EC_CURVE_PF_GENERIC;
+#ifdef EC_PF_SPECIALIZED
+	switch (pf) {
+	case EC_CURVE_PF_P256:
+		count = EC_PF_SPEC_DIGITS_256;
+		p_words = ec_pf_p256_words;
+		break;
+	case EC_CURVE_PF_P384:
+		count = EC_PF_SPEC_DIGITS_384;
+		p_words = ec_pf_p384_words;
+		break;
+	case EC_CURVE_PF_SECP256K1:
+		count = EC_PF_SPEC_DIGITS_256;
+		p_words = ec_pf_secp256k1_words;
+		break;
+	}
+	if (NULL != p_words &&
+	    count == curve->p.digits &&
+	    curve->p.count >= count) {
+		ec_pf_spec_from_words__int(p_words, count, p);
+		if (0 == bn_digits_cmp(p, curve->p.num, count)) {
+			curve->pf = pf;
+		}
+	}
+#endif
+	BN_RET_ON_ERR(bn_assign_init(&curve->a_pf, &curve->a));
+	BN_RET_ON_ERR(ec_pf_to(&curve->a_pf, curve));
+	return (0);
+}
+
+
 
 
 
@@ -584,44 +1101,116 @@ ec_point_proj_import_affine(ec_point_proj_p a, ec_point_p b, ec_curve_p curve) {
 	} else { /* Set to (x, y, 1) */
 		BN_RET_ON_ERR(bn_assign(&a->x, &b->x));
 		BN_RET_ON_ERR(bn_assign(&a->y, &b->y));
-		BN_RET_ON_ERR(bn_assign_digit(&a->z, 1));
+		BN_RET_ON_ERR(ec_pf_to(&a->x, curve));
+		BN_RET_ON_ERR(ec_pf_to(&a->y, curve));
+		BN_RET_ON_ERR(ec_pf_one(&a->z, curve));
 	}
 	return (0);
 }
 
-/* projective -> affine representation / ec_affinify() */
+/* X = X / Z^2, Y = Y / Z^3, Z = 1; z_inv - Z^-1. */
 static inline int
-ec_point_proj_norm(ec_point_proj_p point, ec_curve_p curve) {
+ec_point_proj_norm_zinv__int(ec_point_proj_p point, bn_p z_inv,
+    ec_curve_p curve) {
 	size_t bits;
-	bn_t z_inv, z_inv2, tm;
+	bn_t z_inv2, tm;
 
-	if (NULL == point || NULL == curve)
-		return (EINVAL);
-	if (0 != ec_point_proj_is_at_infinity(point))
-		return (0);
-	if (0 != bn_is_one(&point->z))
-		return (0);
-	/* Init */
 	bits = EC_CURVE_CALC_BITS_DBL(curve);
-	BN_RET_ON_ERR(bn_init(&z_inv, bits));
 	BN_RET_ON_ERR(bn_init(&z_inv2, bits));
 	BN_RET_ON_ERR(bn_init(&tm, bits));
-	/* Pre calc */
-	BN_RET_ON_ERR(bn_assign(&z_inv, &point->z));
-	BN_RET_ON_ERR(bn_mod_inv(&z_inv, &curve->p, &curve->p_mod_rd_data));
-	BN_RET_ON_ERR(bn_assign(&z_inv2, &z_inv));
-	BN_RET_ON_ERR(bn_mod_square(&z_inv2, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(bn_assign(&z_inv2, z_inv));
+	BN_RET_ON_ERR(ec_pf_square(&z_inv2, curve));
 	/* Xres = X / Z^2 */
 	BN_RET_ON_ERR(bn_assign(&tm, &point->x));
-	BN_RET_ON_ERR(bn_mod_mult(&tm, &z_inv2, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_mult(&tm, &z_inv2, curve));
 	BN_RET_ON_ERR(bn_assign(&point->x, &tm));
 	/* Yres = Y / Z^3 */
 	BN_RET_ON_ERR(bn_assign(&tm, &point->y));
-	BN_RET_ON_ERR(bn_mod_mult(&tm, &z_inv2, &curve->p, &curve->p_mod_rd_data));
-	BN_RET_ON_ERR(bn_mod_mult(&tm, &z_inv, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_mult(&tm, &z_inv2, curve));
+	BN_RET_ON_ERR(ec_pf_mult(&tm, z_inv, curve));
 	BN_RET_ON_ERR(bn_assign(&point->y, &tm));
-	/* Yres = 1 */
-	BN_RET_ON_ERR(bn_assign_digit(&point->z, 1));
+	/* Zres = 1 */
+	BN_RET_ON_ERR(ec_pf_one(&point->z, curve));
+	return (0);
+}
+/* projective -> affine representation / ec_affinify() */
+static inline int
+ec_point_proj_norm(ec_point_proj_p point, ec_curve_p curve) {
+	bn_t z_inv;
+
+	if (NULL == point || NULL == curve)
+		return (EINVAL);
+	if (0 != ec_point_proj_is_at_infinity(point))
+		return (0);
+	/* Init */
+	BN_RET_ON_ERR(bn_init(&z_inv, EC_CURVE_CALC_BITS_DBL(curve)));
+	BN_RET_ON_ERR(ec_pf_one(&z_inv, curve));
+	if (0 != bn_is_equal(&point->z, &z_inv))
+		return (0);
+	/* Pre calc: inverse in normal form. */
+	BN_RET_ON_ERR(bn_assign(&z_inv, &point->z));
+	BN_RET_ON_ERR(ec_pf_from(&z_inv, curve));
+	BN_RET_ON_ERR(bn_mod_inv(&z_inv, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_to(&z_inv, curve));
+	BN_RET_ON_ERR(ec_point_proj_norm_zinv__int(point, &z_inv, curve));
+	return (0);
+}
+/* Normalize points array using one field inversion per
+ * EC_PROJ_NORM_BATCH_MAX points.
+ * See [1]: Algorithm 2.26 Montgomery's simultaneous inversion. */
+static inline int
+ec_point_proj_norm_batch(ec_point_proj_p points, size_t count,
+    ec_curve_p curve) {
+	size_t i, j, cnt, bits;
+	size_t idx[EC_PROJ_NORM_BATCH_MAX];
+	bn_t acc[EC_PROJ_NORM_BATCH_MAX];
+	bn_t inv, z_inv, one;
+	ec_point_proj_p point;
+
+	if (NULL == points || NULL == curve)
+		return (EINVAL);
+	/* Init */
+	bits = EC_CURVE_CALC_BITS_DBL(curve);
+	BN_RET_ON_ERR(bn_init(&inv, bits));
+	BN_RET_ON_ERR(bn_init(&z_inv, bits));
+	BN_RET_ON_ERR(bn_init(&one, bits));
+	BN_RET_ON_ERR(ec_pf_one(&one, curve));
+	for (i = 0; i < count;) {
+		/* acc[j] = Z[0] * ... * Z[j], skip infinity and normalized. */
+		for (cnt = 0; i < count && EC_PROJ_NORM_BATCH_MAX > cnt; i ++) {
+			point = &points[i];
+			if (0 != ec_point_proj_is_at_infinity(point) ||
+			    0 != bn_is_equal(&point->z, &one))
+				continue;
+			idx[cnt] = i;
+			BN_RET_ON_ERR(bn_init(&acc[cnt], bits));
+			BN_RET_ON_ERR(bn_assign(&acc[cnt], &point->z));
+			if (0 != cnt) {
+				BN_RET_ON_ERR(ec_pf_mult(&acc[cnt],
+				    &acc[(cnt - 1)], curve));
+			}
+			cnt ++;
+		}
+		if (0 == cnt)
+			continue;
+		/* inv = (Z[0] * ... * Z[cnt - 1])^-1: inverse in normal form. */
+		BN_RET_ON_ERR(bn_assign(&inv, &acc[(cnt - 1)]));
+		BN_RET_ON_ERR(ec_pf_from(&inv, curve));
+		BN_RET_ON_ERR(bn_mod_inv(&inv, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_to(&inv, curve));
+		for (j = cnt; 0 < j; j --) {
+			point = &points[idx[(j - 1)]];
+			/* Z[j]^-1 = inv * acc[j - 1], inv = inv * Z[j] */
+			BN_RET_ON_ERR(bn_assign(&z_inv, &inv));
+			if (1 < j) {
+				BN_RET_ON_ERR(ec_pf_mult(&z_inv, &acc[(j - 2)],
+				    curve));
+				BN_RET_ON_ERR(ec_pf_mult(&inv, &point->z, curve));
+			}
+			BN_RET_ON_ERR(ec_point_proj_norm_zinv__int(point, &z_inv,
+			    curve));
+		}
+	}
 	return (0);
 }
 static inline int
@@ -636,6 +1225,8 @@ ec_point_proj_export_affine(ec_point_proj_p a, ec_point_p b, ec_curve_p curve) {
 	BN_RET_ON_ERR(ec_point_proj_norm(a, curve));
 	BN_RET_ON_ERR(bn_assign(&b->x, &a->x));
 	BN_RET_ON_ERR(bn_assign(&b->y, &a->y));
+	BN_RET_ON_ERR(ec_pf_from(&b->x, curve));
+	BN_RET_ON_ERR(ec_pf_from(&b->y, curve));
 	b->infinity = 0;
 	return (0);
 }
@@ -670,20 +1261,20 @@ ec_point_proj_add(ec_point_proj_p a, ec_point_proj_p b, ec_curve_p curve) {
 		/* Prepare. */
 		/* A = X1 * Z2^2 */
 		BN_RET_ON_ERR(bn_assign(&tmA, &b->z));
-		BN_RET_ON_ERR(bn_mod_square(&tmA, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&tmA, curve));
 		BN_RET_ON_ERR(bn_assign(&tmB, &tmA)); /* Save Z2^2 */
-		BN_RET_ON_ERR(bn_mod_mult(&tmA, &a->x, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tmA, &a->x, curve));
 		/* B = Y1 * Z2^3 */
-		BN_RET_ON_ERR(bn_mod_mult(&tmB, &b->z, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult(&tmB, &a->y, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tmB, &b->z, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&tmB, &a->y, curve));
 		/* C = X2 * Z1^2 */
 		BN_RET_ON_ERR(bn_assign(&tmC, &a->z));
-		BN_RET_ON_ERR(bn_mod_square(&tmC, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&tmC, curve));
 		BN_RET_ON_ERR(bn_assign(&tmD, &tmC)); /* Save Z1^2 */
-		BN_RET_ON_ERR(bn_mod_mult(&tmC, &b->x, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tmC, &b->x, curve));
 		/* D = Y2 * Z1^3 */
-		BN_RET_ON_ERR(bn_mod_mult(&tmD, &a->z, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult(&tmD, &b->y, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tmD, &a->z, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&tmD, &b->y, curve));
 		if (0 == bn_cmp(&tmA, &tmC)) {
 			if (0 == bn_cmp(&tmB, &tmD))
 				goto point_double;
@@ -692,47 +1283,47 @@ ec_point_proj_add(ec_point_proj_p a, ec_point_proj_p b, ec_curve_p curve) {
 		}
 		/* E = (X2 * Z1^2 − X1 * Z2^2) = (C - A) */
 		BN_RET_ON_ERR(bn_assign(&tmE, &tmC));
-		BN_RET_ON_ERR(bn_mod_sub(&tmE, &tmA, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&tmE, &tmA, curve));
 		/* F = (Y2 * Z1^3 − Y1 * Z2^3) = (D - B) */
 		BN_RET_ON_ERR(bn_assign(&tmF, &tmD));
-		BN_RET_ON_ERR(bn_mod_sub(&tmF, &tmB, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&tmF, &tmB, curve));
 		/* C = A * E^2 */
 		BN_RET_ON_ERR(bn_assign(&tmC, &tmE));
-		BN_RET_ON_ERR(bn_mod_square(&tmC, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&tmC, curve));
 		BN_RET_ON_ERR(bn_assign(&tmD, &tmC)); /* Save E^2 */
-		BN_RET_ON_ERR(bn_mod_mult(&tmC, &tmA, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tmC, &tmA, curve));
 		/* D = E^3 */
-		BN_RET_ON_ERR(bn_mod_mult(&tmD, &tmE, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tmD, &tmE, curve));
 
 		/* Xres = F^2 - D - 2 * C */
 		/* ... F^2 */
 		BN_RET_ON_ERR(bn_assign(&res, &tmF));
-		BN_RET_ON_ERR(bn_mod_square(&res, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&res, curve));
 		/* ... - D */
-		BN_RET_ON_ERR(bn_mod_sub(&res, &tmD, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&res, &tmD, curve));
 		/* - 2 * C */
 		BN_RET_ON_ERR(bn_assign(&tm, &tmC));
-		BN_RET_ON_ERR(bn_mod_mult_digit(&tm, 2, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&res, &tm, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult_digit(&tm, 2, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&res, &tm, curve));
 		/* Xres = ... */
 		BN_RET_ON_ERR(bn_assign(&a->x, &res));
 
 		/* Yres = F * (C - Xres) - B * D */
 		/* ... (C - Xres) * F */
 		BN_RET_ON_ERR(bn_assign(&res, &tmC));
-		BN_RET_ON_ERR(bn_mod_sub(&res, &a->x, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult(&res, &tmF, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&res, &a->x, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&res, &tmF, curve));
 		/* ... - B * D */
 		BN_RET_ON_ERR(bn_assign(&tm, &tmD));
-		BN_RET_ON_ERR(bn_mod_mult(&tm, &tmB, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&res, &tm, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tm, &tmB, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&res, &tm, curve));
 		/* Yres = ... */
 		BN_RET_ON_ERR(bn_assign(&a->y, &res));
 
 		/* Zres = Z1 * Z2 * E */
 		BN_RET_ON_ERR(bn_assign(&res, &tmE));
-		BN_RET_ON_ERR(bn_mod_mult(&res, &a->z, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult(&res, &b->z, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&res, &a->z, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&res, &b->z, curve));
 		/* Zres = ... */
 		BN_RET_ON_ERR(bn_assign(&a->z, &res));
 	} else { /* a == b: Doubling. */
@@ -754,49 +1345,47 @@ point_double:
 		if (0 != (EC_CURVE_FLAG_A_M3 & curve->flags)) {
 			/* tmB = 3 * (X1 − Z1^2) * (X1 + Z1^2) */
 			BN_RET_ON_ERR(bn_assign(&tmA, &a->z));
-			BN_RET_ON_ERR(bn_mod_square(&tmA, &curve->p, &curve->p_mod_rd_data));
+			BN_RET_ON_ERR(ec_pf_square(&tmA, curve));
 			BN_RET_ON_ERR(bn_assign(&tmB, &a->x));
-			BN_RET_ON_ERR(bn_mod_sub(&tmB, &tmA, &curve->p, &curve->p_mod_rd_data));
-			BN_RET_ON_ERR(bn_mod_add(&tmA, &a->x, &curve->p, &curve->p_mod_rd_data));
-			BN_RET_ON_ERR(bn_mod_mult(&tmB, &tmA, &curve->p, &curve->p_mod_rd_data));
-			BN_RET_ON_ERR(bn_mod_mult_digit(&tmB, 3, &curve->p, &curve->p_mod_rd_data));
+			BN_RET_ON_ERR(ec_pf_sub(&tmB, &tmA, curve));
+			BN_RET_ON_ERR(ec_pf_add(&tmA, &a->x, curve));
+			BN_RET_ON_ERR(ec_pf_mult(&tmB, &tmA, curve));
+			BN_RET_ON_ERR(ec_pf_mult_digit(&tmB, 3, curve));
 		} else {
 			/* tmB = 3 * X^2 */
 			BN_RET_ON_ERR(bn_assign(&tmB, &a->x));
-			BN_RET_ON_ERR(bn_mod_square(&tmB, &curve->p, &curve->p_mod_rd_data));
-			BN_RET_ON_ERR(bn_mod_mult_digit(&tmB, 3, &curve->p, &curve->p_mod_rd_data));
+			BN_RET_ON_ERR(ec_pf_square(&tmB, curve));
+			BN_RET_ON_ERR(ec_pf_mult_digit(&tmB, 3, curve));
 			if (0 == bn_is_zero(&curve->a)) { /* + (a * Z1^4) */
 				BN_RET_ON_ERR(bn_assign(&tmA, &a->z));
-				BN_RET_ON_ERR(bn_mod_exp_digit(&tmA, 4, &curve->p, &curve->p_mod_rd_data));
-				BN_RET_ON_ERR(bn_mod_mult(&tmA, &curve->a, &curve->p, &curve->p_mod_rd_data));
-				BN_RET_ON_ERR(bn_mod_add(&tmB, &tmA, &curve->p, &curve->p_mod_rd_data));
+				BN_RET_ON_ERR(ec_pf_square(&tmA, curve));
+				BN_RET_ON_ERR(ec_pf_square(&tmA, curve));
+				BN_RET_ON_ERR(ec_pf_mult(&tmA, ec_pf_a(curve), curve));
+				BN_RET_ON_ERR(ec_pf_add(&tmB, &tmA, curve));
 			}
 		}
 		/* Zres */
 		BN_RET_ON_ERR(bn_assign(&y2, &a->y));
-		BN_RET_ON_ERR(bn_mod_mult_digit(&y2, 2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult_digit(&y2, 2, curve));
 		BN_RET_ON_ERR(bn_assign(&tmA, &a->z));
-		BN_RET_ON_ERR(bn_mod_mult(&tmA, &y2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tmA, &y2, curve));
 		BN_RET_ON_ERR(bn_assign(&a->z, &tmA));
 		/* Xres */
-		BN_RET_ON_ERR(bn_mod_square(&y2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&y2, curve));
 		BN_RET_ON_ERR(bn_assign(&tmC, &a->x));
-		BN_RET_ON_ERR(bn_mod_mult(&tmC, &y2, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_square(&y2, &curve->p, &curve->p_mod_rd_data));
-		if (0 != bn_is_odd(&y2)) {
-			BN_RET_ON_ERR(bn_add(&y2, &curve->p, NULL));
-		}
-		bn_r_shift(&y2, 1);
+		BN_RET_ON_ERR(ec_pf_mult(&tmC, &y2, curve));
+		BN_RET_ON_ERR(ec_pf_square(&y2, curve));
+		BN_RET_ON_ERR(ec_pf_half(&y2, curve));
 		BN_RET_ON_ERR(bn_assign(&tmA, &tmB));
-		BN_RET_ON_ERR(bn_mod_square(&tmA, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&tmA, curve));
 		// XXX: - (2 * tmC)
-		BN_RET_ON_ERR(bn_mod_sub(&tmA, &tmC, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&tmA, &tmC, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&tmA, &tmC, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&tmA, &tmC, curve));
 		BN_RET_ON_ERR(bn_assign(&a->x, &tmA));
 		/* Yres */
-		BN_RET_ON_ERR(bn_mod_sub(&tmC, &a->x, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult(&tmC, &tmB, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&tmC, &y2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&tmC, &a->x, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&tmC, &tmB, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&tmC, &y2, curve));
 		BN_RET_ON_ERR(bn_assign(&a->y, &tmC));
 	}
 	return (0);
@@ -819,22 +1408,14 @@ ec_point_proj_sub(ec_point_proj_p a, ec_point_proj_p b, ec_curve_p curve) {
 	return (0);
 }
 
-/* n repeated point doublings. [1]: Algorithm 3.23 */
+/* n repeated point doublings, no checks: infinity (Z = 0) stays
+ * infinity, operations sequence does not depend on values.
+ * [1]: Algorithm 3.23 */
 static inline int
-ec_point_proj_dbl_n(ec_point_proj_p point, size_t n, ec_curve_p curve) {
-	size_t i;
-#ifdef EC_PROJ_REPEAT_DOUBLE
-	size_t bits;
+ec_point_proj_dbl_n__int(ec_point_proj_p point, size_t n, ec_curve_p curve) {
+	size_t i, bits;
 	bn_t Y, y2, tm, tmA, tmB, tmC;
 
-	if (NULL == point || NULL == curve)
-		return (EINVAL);
-	if (0 != bn_is_zero(&point->y)) {
-		bn_assign_zero(&point->z);
-		return (0); /* Point at infinity. */
-	}
-	if (0 == n || 0 != ec_point_proj_is_at_infinity(point)) /* Point at infinity. */
-		return (0);
 	/* Double size + 1 digit. */
 	bits = (EC_CURVE_CALC_BITS_DBL(curve) + (2 * BN_DIGIT_BITS));
 	/* Init */
@@ -845,66 +1426,82 @@ ec_point_proj_dbl_n(ec_point_proj_p point, size_t n, ec_curve_p curve) {
 	BN_RET_ON_ERR(bn_init(&tmC, bits));
 	BN_RET_ON_ERR(bn_init(&tm, bits));
 	/* P0->y = 2 * P0->y */
-	BN_RET_ON_ERR(bn_assign(&Y, &point->y));
-	BN_RET_ON_ERR(bn_mod_mult_digit(&Y, 2, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_assign(&Y, &point->y, curve));
+	BN_RET_ON_ERR(ec_pf_mult_digit(&Y, 2, curve));
 	/* tmC = Z^4 */
-	BN_RET_ON_ERR(bn_assign(&tmC, &point->z));
-	BN_RET_ON_ERR(bn_mod_exp_digit(&tmC, 4, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_assign(&tmC, &point->z, curve));
+	BN_RET_ON_ERR(ec_pf_square(&tmC, curve));
+	BN_RET_ON_ERR(ec_pf_square(&tmC, curve));
 
 	for (i = 0; i < n; i ++) {
 		if (0 != (EC_CURVE_FLAG_A_M3 & curve->flags)) {
 			/* tmA = 3(X^2 - tmC) */
-			BN_RET_ON_ERR(bn_assign(&tmA, &point->x));
-			BN_RET_ON_ERR(bn_mod_square(&tmA, &curve->p, &curve->p_mod_rd_data));
-			BN_RET_ON_ERR(bn_mod_sub(&tmA, &tmC, &curve->p, &curve->p_mod_rd_data));
-			BN_RET_ON_ERR(bn_mod_mult_digit(&tmA, 3, &curve->p, &curve->p_mod_rd_data));
+			BN_RET_ON_ERR(ec_pf_assign(&tmA, &point->x, curve));
+			BN_RET_ON_ERR(ec_pf_square(&tmA, curve));
+			BN_RET_ON_ERR(ec_pf_sub(&tmA, &tmC, curve));
+			BN_RET_ON_ERR(ec_pf_mult_digit(&tmA, 3, curve));
 		} else {
 			/* tmA = 3 * X^2 */
-			BN_RET_ON_ERR(bn_assign(&tmA, &point->x));
-			BN_RET_ON_ERR(bn_mod_square(&tmA, &curve->p, &curve->p_mod_rd_data));
-			BN_RET_ON_ERR(bn_mod_mult_digit(&tmA, 3, &curve->p, &curve->p_mod_rd_data));
+			BN_RET_ON_ERR(ec_pf_assign(&tmA, &point->x, curve));
+			BN_RET_ON_ERR(ec_pf_square(&tmA, curve));
+			BN_RET_ON_ERR(ec_pf_mult_digit(&tmA, 3, curve));
 			if (0 == bn_is_zero(&curve->a)) { /* + a * tmC */
-				BN_RET_ON_ERR(bn_assign(&tm, &curve->a));
-				BN_RET_ON_ERR(bn_mod_mult(&tm, &tmC, &curve->p, &curve->p_mod_rd_data));
-				BN_RET_ON_ERR(bn_mod_add(&tmA, &tm, &curve->p, &curve->p_mod_rd_data));
+				BN_RET_ON_ERR(ec_pf_assign(&tm, ec_pf_a(curve), curve));
+				BN_RET_ON_ERR(ec_pf_mult(&tm, &tmC, curve));
+				BN_RET_ON_ERR(ec_pf_add(&tmA, &tm, curve));
 			}
 		}
 		/* tmB = X * Y^2 */
-		BN_RET_ON_ERR(bn_assign(&y2, &Y));
-		BN_RET_ON_ERR(bn_mod_square(&y2, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_assign(&tmB, &point->x));
-		BN_RET_ON_ERR(bn_mod_mult(&tmB, &y2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_assign(&y2, &Y, curve));
+		BN_RET_ON_ERR(ec_pf_square(&y2, curve));
+		BN_RET_ON_ERR(ec_pf_assign(&tmB, &point->x, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&tmB, &y2, curve));
 		/* X = tmA^2 - 2 * tmB */
-		BN_RET_ON_ERR(bn_assign(&tm, &tmA));
-		BN_RET_ON_ERR(bn_mod_square(&tm, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_assign(&tm, &tmA, curve));
+		BN_RET_ON_ERR(ec_pf_square(&tm, curve));
 		//XXX !!!
-		BN_RET_ON_ERR(bn_mod_sub(&tm, &tmB, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&tm, &tmB, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_assign(&point->x, &tm));
+		BN_RET_ON_ERR(ec_pf_sub(&tm, &tmB, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&tm, &tmB, curve));
+		BN_RET_ON_ERR(ec_pf_assign(&point->x, &tm, curve));
 		/* Z = Z * Y */
-		BN_RET_ON_ERR(bn_assign(&tm, &Y));
-		BN_RET_ON_ERR(bn_mod_mult(&tm, &point->z, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_assign(&point->z, &tm));
+		BN_RET_ON_ERR(ec_pf_assign(&tm, &Y, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&tm, &point->z, curve));
+		BN_RET_ON_ERR(ec_pf_assign(&point->z, &tm, curve));
 		/* y2 = y2^2 */
-		BN_RET_ON_ERR(bn_mod_square(&y2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&y2, curve));
 		if (i < (n - 1)) { /* tmC = tmC * Y^4 */
-			BN_RET_ON_ERR(bn_mod_mult(&tmC, &y2, &curve->p, &curve->p_mod_rd_data));
+			BN_RET_ON_ERR(ec_pf_mult(&tmC, &y2, curve));
 		}
 		/* Y = 2 * tmA * (tmB - X) - Y^4 */
-		BN_RET_ON_ERR(bn_mod_sub(&tmB, &point->x, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult_digit(&tmA, 2, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult(&tmA, &tmB, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&tmA, &y2, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_assign(&Y, &tmA));
+		BN_RET_ON_ERR(ec_pf_sub(&tmB, &point->x, curve));
+		BN_RET_ON_ERR(ec_pf_mult_digit(&tmA, 2, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&tmA, &tmB, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&tmA, &y2, curve));
+		BN_RET_ON_ERR(ec_pf_assign(&Y, &tmA, curve));
 	}
 
-	if (0 != bn_is_odd(&Y)) {
-		BN_RET_ON_ERR(bn_add(&Y, &curve->p, NULL));
-		//BN_RET_ON_ERR(bn_mod_add(&tmA, &tm, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_half(&Y, curve));
+	BN_RET_ON_ERR(ec_pf_assign(&point->y, &Y, curve));
+	return (0);
+}
+
+/* n repeated point doublings. */
+static inline int
+ec_point_proj_dbl_n(ec_point_proj_p point, size_t n, ec_curve_p curve) {
+#ifdef EC_PROJ_REPEAT_DOUBLE
+
+	if (NULL == point || NULL == curve)
+		return (EINVAL);
+	if (0 != bn_is_zero(&point->y)) {
+		bn_assign_zero(&point->z);
+		return (0); /* Point at infinity. */
 	}
-	bn_r_shift(&Y, 1);
-	BN_RET_ON_ERR(bn_assign(&point->y, &Y));
+	if (0 == n || 0 != ec_point_proj_is_at_infinity(point)) /* Point at infinity. */
+		return (0);
+	BN_RET_ON_ERR(ec_point_proj_dbl_n__int(point, n, curve));
 #else
+	size_t i;
+
 	for (i = 0; i < n; i ++) {
 		BN_RET_ON_ERR(ec_point_proj_add(point, point, curve));
 	}
@@ -912,21 +1509,36 @@ ec_point_proj_dbl_n(ec_point_proj_p point, size_t n, ec_curve_p curve) {
 	return (0);
 }
 
-/* Require: curve->a == -3. */
+/* Assigns: a = b if cond, cond - 0 or 1. Fixed p limbs. */
+static inline void
+ec_point_proj_cassign__int(ec_point_proj_p a, ec_point_proj_p b,
+    bn_digit_t cond, ec_curve_p curve) {
+	size_t count = curve->p.digits;
+	bn_digit_t mask = (((bn_digit_t)0) - cond);
+
+	bn_digits_cassign(a->x.num, b->x.num, count, cond);
+	bn_digits_cassign(a->y.num, b->y.num, count, cond);
+	bn_digits_cassign(a->z.num, b->z.num, count, cond);
+	a->x.digits ^= (size_t)(mask & ((bn_digit_t)(a->x.digits ^ b->x.digits)));
+	a->y.digits ^= (size_t)(mask & ((bn_digit_t)(a->y.digits ^ b->y.digits)));
+	a->z.digits ^= (size_t)(mask & ((bn_digit_t)(a->z.digits ^ b->z.digits)));
+}
+
+/* a = a + b, a - projective, b - affine not at infinity.
+ * b_dbl = NULL: a not at infinity, a == +-b checked by branches.
+ * b_dbl != NULL: affine 2b, b and b_dbl in field representation,
+ * a at infinity and a == +-b handled by masked selection of b and b_dbl,
+ * operations sequence does not depend on values. */
 static inline int
-ec_point_proj_add_mix(ec_point_proj_p a, ec_point_p b, ec_curve_p curve) {
-#ifdef EC_PROJ_ADD_MIX
+ec_point_proj_add_mix__int(ec_point_proj_p a, ec_point_p b, ec_point_p b_dbl,
+    ec_curve_p curve) {
 	size_t bits;
+	bn_digit_t is_inf = 0, is_dbl = 0;
 	bn_t tm, tm1, tm2, tm3, tm4;
+	bn_p bx, by;
+	bn_t bx_pf, by_pf;
+	ec_point_proj_t pd, pb;
 
-	if (NULL == a || NULL == b || NULL == curve)
-		return (EINVAL);
-	if (0 != ec_point_is_at_infinity(b))
-		return (0); /* a = a */
-	if (0 != ec_point_proj_is_at_infinity(a)) {
-		BN_RET_ON_ERR(ec_point_proj_import_affine(a, b, curve));
-		return (0); /* a = b */
-	}
 	/* Double size + 1 digit. */
 	bits = EC_CURVE_CALC_BITS_DBL(curve);
 	/* Init */
@@ -935,47 +1547,72 @@ ec_point_proj_add_mix(ec_point_proj_p a, ec_point_p b, ec_curve_p curve) {
 	BN_RET_ON_ERR(bn_init(&tm2, bits));
 	BN_RET_ON_ERR(bn_init(&tm3, bits));
 	BN_RET_ON_ERR(bn_init(&tm4, bits));
+	if (NULL == b_dbl && ec_pf_is_mont(curve)) {
+		/* Affine b is in normal form: 2M to move it. */
+		BN_RET_ON_ERR(bn_init(&bx_pf, bits));
+		BN_RET_ON_ERR(ec_pf_assign(&bx_pf, &b->x, curve));
+		BN_RET_ON_ERR(ec_pf_to_ct(&bx_pf, curve));
+		BN_RET_ON_ERR(bn_init(&by_pf, bits));
+		BN_RET_ON_ERR(ec_pf_assign(&by_pf, &b->y, curve));
+		BN_RET_ON_ERR(ec_pf_to_ct(&by_pf, curve));
+		bx = &bx_pf;
+		by = &by_pf;
+	} else {
+		bx = &b->x;
+		by = &b->y;
+	}
+	if (NULL != b_dbl) { /* Exceptional cases: pd = 2b, pb = b. */
+		BN_RET_ON_ERR(ec_point_proj_init(&pd, bits));
+		BN_RET_ON_ERR(ec_pf_assign(&pd.x, &b_dbl->x, curve));
+		BN_RET_ON_ERR(ec_pf_assign(&pd.y, &b_dbl->y, curve));
+		BN_RET_ON_ERR(ec_pf_one(&pd.z, curve));
+		BN_RET_ON_ERR(ec_point_proj_init(&pb, bits));
+		BN_RET_ON_ERR(ec_pf_assign(&pb.x, bx, curve));
+		BN_RET_ON_ERR(ec_pf_assign(&pb.y, by, curve));
+		BN_RET_ON_ERR(ec_pf_one(&pb.z, curve));
+		is_inf = bn_digit_ct_is_zero((bn_digit_t)a->z.digits);
+	}
 
 #if 0 /* [2]: "mmadd-2007-bl", Z1=1 and Z2=1, 4M + 2S + 6add + 1*4 + 4*2 */
 	if (0 != bn_is_one(&a->z)) {
 		/* H = X2 - X1 */
 		BN_RET_ON_ERR(bn_assign(&tm2, &b->x));
-		BN_RET_ON_ERR(bn_mod_sub(&tm2, &a->x, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&tm2, &a->x, curve));
 		/* Zres */
 		/* Z3 = 2 * H */
 		BN_RET_ON_ERR(bn_assign(&tm1, &tm2));
-		BN_RET_ON_ERR(bn_mod_mult_digit(&tm1, 2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult_digit(&tm1, 2, curve));
 		BN_RET_ON_ERR(bn_assign(&a->z, &tm1));
 		/* HH = H^2 */
 		BN_RET_ON_ERR(bn_assign(&tm1, &tm2));
-		BN_RET_ON_ERR(bn_mod_square(&tm1, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&tm1, curve));
 		/* I = 4 * HH */
-		BN_RET_ON_ERR(bn_mod_mult_digit(&tm1, 4, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult_digit(&tm1, 4, curve));
 		/* J = H * I */
-		BN_RET_ON_ERR(bn_mod_mult(&tm2, &tm1, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tm2, &tm1, curve));
 		/* V = X1 * I */
-		BN_RET_ON_ERR(bn_mod_mult(&tm1, &a->x, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tm1, &a->x, curve));
 		/* r = 2 * (Y2 - Y1) */
 		BN_RET_ON_ERR(bn_assign(&tm3, &b->y));
-		BN_RET_ON_ERR(bn_mod_sub(&tm3, &a->y, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult_digit(&tm3, 2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&tm3, &a->y, curve));
+		BN_RET_ON_ERR(ec_pf_mult_digit(&tm3, 2, curve));
 		/* Xres */
 		/* X3 = r^2 - J - 2 * V */
 		BN_RET_ON_ERR(bn_assign(&tm, &tm3));
-		BN_RET_ON_ERR(bn_mod_square(&tm, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&tm, &tm2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_square(&tm, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&tm, &tm2, curve));
 		// XXX
-		BN_RET_ON_ERR(bn_mod_sub(&tm, &tm1, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&tm, &tm1, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&tm, &tm1, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&tm, &tm1, curve));
 		BN_RET_ON_ERR(bn_assign(&a->x, &tm));
 		/* Yres */
 		/* Y3 = r * (V - X3) - 2 * Y1 * J */
-		BN_RET_ON_ERR(bn_mod_sub(&tm1, &a->x, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult(&tm1, &tm3, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_sub(&tm1, &a->x, curve));
+		BN_RET_ON_ERR(ec_pf_mult(&tm1, &tm3, curve));
 		/* - 2 * Y1 * J */
-		BN_RET_ON_ERR(bn_mod_mult(&tm2, &a->y, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_mult_digit(&tm2, 2, &curve->p, &curve->p_mod_rd_data));
-		BN_RET_ON_ERR(bn_mod_sub(&tm1, &tm2, &curve->p, &curve->p_mod_rd_data));
+		BN_RET_ON_ERR(ec_pf_mult(&tm2, &a->y, curve));
+		BN_RET_ON_ERR(ec_pf_mult_digit(&tm2, 2, curve));
+		BN_RET_ON_ERR(ec_pf_sub(&tm1, &tm2, curve));
 		BN_RET_ON_ERR(bn_assign(&a->y, &tm1));
 		return (0);
 	}
@@ -984,21 +1621,24 @@ ec_point_proj_add_mix(ec_point_proj_p a, ec_point_p b, ec_curve_p curve) {
 	/* [2]: "madd-2004-hmv" (2004 Hankerson–Menezes–Vanstone, page 91.) */
 	/* 8M + 3S + 6add + 1*2 */
 	/* T1 = Z1^2 */
-	BN_RET_ON_ERR(bn_assign(&tm1, &a->z));
-	BN_RET_ON_ERR(bn_mod_square(&tm1, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_assign(&tm1, &a->z, curve));
+	BN_RET_ON_ERR(ec_pf_square(&tm1, curve));
 	/* T2 = T1 * Z1 */
-	BN_RET_ON_ERR(bn_assign(&tm2, &tm1));
-	BN_RET_ON_ERR(bn_mod_mult(&tm2, &a->z, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_assign(&tm2, &tm1, curve));
+	BN_RET_ON_ERR(ec_pf_mult(&tm2, &a->z, curve));
 	/* T1 = T1 * b->x */
-	BN_RET_ON_ERR(bn_mod_mult(&tm1, &b->x, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_mult(&tm1, bx, curve));
 	/* T2 = T2 * b->y */
-	BN_RET_ON_ERR(bn_mod_mult(&tm2, &b->y, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_mult(&tm2, by, curve));
 	/* T1 = T1 - a->x */
-	BN_RET_ON_ERR(bn_mod_sub(&tm1, &a->x, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_sub(&tm1, &a->x, curve));
 	/* T2 = T2 - a->y */
-	BN_RET_ON_ERR(bn_mod_sub(&tm2, &a->y, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_sub(&tm2, &a->y, curve));
 
-	if (0 != bn_is_zero(&tm1)) {
+	if (NULL != b_dbl) { /* a == -b: Z3 = Z1 * T1 = 0, infinity. */
+		is_dbl = (bn_digit_ct_is_zero((bn_digit_t)tm1.digits) &
+		    bn_digit_ct_is_zero((bn_digit_t)tm2.digits));
+	} else if (0 != bn_is_zero(&tm1)) {
 		if (0 != bn_is_zero(&tm2)) {
 			BN_RET_ON_ERR(ec_point_proj_add(a, a, curve));
 			return (0);
@@ -1008,36 +1648,58 @@ ec_point_proj_add_mix(ec_point_proj_p a, ec_point_p b, ec_curve_p curve) {
 		}
 	}
 	/* T3 = T1^2 */
-	BN_RET_ON_ERR(bn_assign(&tm3, &tm1));
-	BN_RET_ON_ERR(bn_mod_square(&tm3, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_assign(&tm3, &tm1, curve));
+	BN_RET_ON_ERR(ec_pf_square(&tm3, curve));
 	/* T4 = T3 * T1 */
-	BN_RET_ON_ERR(bn_assign(&tm4, &tm3));
-	BN_RET_ON_ERR(bn_mod_mult(&tm4, &tm1, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_assign(&tm4, &tm3, curve));
+	BN_RET_ON_ERR(ec_pf_mult(&tm4, &tm1, curve));
 	/* T3 = T3 * a->x */
-	BN_RET_ON_ERR(bn_mod_mult(&tm3, &a->x, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_mult(&tm3, &a->x, curve));
 	/* Z3 = Z1 * T1 */
-	BN_RET_ON_ERR(bn_mod_mult(&tm1, &a->z, &curve->p, &curve->p_mod_rd_data));
-	BN_RET_ON_ERR(bn_assign(&a->z, &tm1));
+	BN_RET_ON_ERR(ec_pf_mult(&tm1, &a->z, curve));
+	BN_RET_ON_ERR(ec_pf_assign(&a->z, &tm1, curve));
 	/* T1 = 2 * T3 */
-	BN_RET_ON_ERR(bn_assign(&tm1, &tm3));
-	BN_RET_ON_ERR(bn_mod_mult_digit(&tm1, 2, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_assign(&tm1, &tm3, curve));
+	BN_RET_ON_ERR(ec_pf_mult_digit(&tm1, 2, curve));
 	/* a->x = T2^2 */
-	BN_RET_ON_ERR(bn_assign(&tm, &tm2));
-	BN_RET_ON_ERR(bn_mod_square(&tm, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_assign(&tm, &tm2, curve));
+	BN_RET_ON_ERR(ec_pf_square(&tm, curve));
 	/* a->x = a->x - T1 */
-	BN_RET_ON_ERR(bn_mod_sub(&tm, &tm1, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_sub(&tm, &tm1, curve));
 	/* a->x = a->x - T4 */
-	BN_RET_ON_ERR(bn_mod_sub(&tm, &tm4, &curve->p, &curve->p_mod_rd_data));
-	BN_RET_ON_ERR(bn_assign(&a->x, &tm));
+	BN_RET_ON_ERR(ec_pf_sub(&tm, &tm4, curve));
+	BN_RET_ON_ERR(ec_pf_assign(&a->x, &tm, curve));
 	/* T3 = T3 - a->x */
-	BN_RET_ON_ERR(bn_mod_sub(&tm3, &a->x, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_sub(&tm3, &a->x, curve));
 	/* T3 = T3 * T2 */
-	BN_RET_ON_ERR(bn_mod_mult(&tm3, &tm2, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_mult(&tm3, &tm2, curve));
 	/* T4 = T4 * a->y */
-	BN_RET_ON_ERR(bn_mod_mult(&tm4, &a->y, &curve->p, &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_mult(&tm4, &a->y, curve));
 	/* a->y = T3 - T4 */
-	BN_RET_ON_ERR(bn_mod_sub(&tm3, &tm4, &curve->p, &curve->p_mod_rd_data));
-	BN_RET_ON_ERR(bn_assign(&a->y, &tm3));
+	BN_RET_ON_ERR(ec_pf_sub(&tm3, &tm4, curve));
+	BN_RET_ON_ERR(ec_pf_assign(&a->y, &tm3, curve));
+	if (NULL != b_dbl) {
+		ec_point_proj_cassign__int(a, &pd, (is_dbl & (1 ^ is_inf)),
+		    curve);
+		ec_point_proj_cassign__int(a, &pb, is_inf, curve);
+	}
+	return (0);
+}
+
+/* Require: curve->a == -3. */
+static inline int
+ec_point_proj_add_mix(ec_point_proj_p a, ec_point_p b, ec_curve_p curve) {
+#ifdef EC_PROJ_ADD_MIX
+
+	if (NULL == a || NULL == b || NULL == curve)
+		return (EINVAL);
+	if (0 != ec_point_is_at_infinity(b))
+		return (0); /* a = a */
+	if (0 != ec_point_proj_is_at_infinity(a)) {
+		BN_RET_ON_ERR(ec_point_proj_import_affine(a, b, curve));
+		return (0); /* a = b */
+	}
+	BN_RET_ON_ERR(ec_point_proj_add_mix__int(a, b, NULL, curve));
 #else /* no EC_PROJ_ADD_MIX */
 	ec_point_proj_t tm;
 
@@ -1739,141 +2401,361 @@ void ep_tab(ep_t *t, const ep_t p, int w) {
 }
 #endif
 
-/* See [1]: Algorithm 3.38 Sliding window method for point multiplication */
+/* pts[i] = (2i + 1) * point, i < cnt.
+ * Table points are calculated in projective and normalized together. */
 static inline int
-ec_point_proj_inter_twin_mult_precalc_affine(ec_point_p point, size_t wnd_bits,
-    ec_curve_p curve, ec_pt_proj_am_t *tbl) {
+ec_point_proj_odd_mult_precalc__int(ec_point_p point, size_t cnt,
+    ec_curve_p curve, ec_point_proj_p pts) {
 	size_t i;
-	
-	if (NULL == point || 2 > wnd_bits || NULL == tbl)
-		return (EINVAL);
-	/* Calc: 1P, 3P, 5P, 7P.... */
-#ifdef EC_PROJ_ADD_MIX
-	ec_point_proj_t tm;
-
-	BN_RET_ON_ERR(ec_point_proj_init(&tm, curve->m));
+	ec_point_proj_t dbl;
 
 	/* Init table. */
-	for (i = 0; i < (((size_t)1) << (wnd_bits - 2)); i ++) {
-		BN_RET_ON_ERR(ec_point_init(&tbl[i], curve->m));
+	for (i = 0; i < cnt; i ++) {
+		BN_RET_ON_ERR(ec_point_proj_init(&pts[i], curve->m));
 	}
-	if (wnd_bits > 2) {
-		/* 0 */
-		BN_RET_ON_ERR(ec_point_proj_import_affine(&tm, point, curve));
-		BN_RET_ON_ERR(ec_point_proj_add(&tm, &tm, curve));
-		BN_RET_ON_ERR(ec_point_proj_export_affine(&tm, &tbl[0], curve));
-		/* 1 */
-		BN_RET_ON_ERR(ec_point_proj_add_mix(&tm, point, curve));
-		BN_RET_ON_ERR(ec_point_proj_export_affine(&tm, &tbl[1], curve));
-		/* 2... */
-		for (i = 2; i < (((size_t)1) << (wnd_bits - 2)); i ++) {
-			BN_RET_ON_ERR(ec_point_proj_add_mix(&tm, &tbl[0], curve));
-			BN_RET_ON_ERR(ec_point_proj_export_affine(&tm, &tbl[i], curve));
+	/* Calc: 1P, 3P, 5P, 7P.... */
+	BN_RET_ON_ERR(ec_point_proj_import_affine(&pts[0], point, curve));
+	if (1 < cnt) {
+		/* 2P */
+		BN_RET_ON_ERR(ec_point_proj_init(&dbl, curve->m));
+		BN_RET_ON_ERR(ec_point_proj_assign(&dbl, &pts[0]));
+		BN_RET_ON_ERR(ec_point_proj_add(&dbl, &dbl, curve));
+		for (i = 1; i < cnt; i ++) {
+			BN_RET_ON_ERR(ec_point_proj_assign(&pts[i], &pts[(i - 1)]));
+			BN_RET_ON_ERR(ec_point_proj_add(&pts[i], &dbl, curve));
 		}
+		BN_RET_ON_ERR(ec_point_proj_norm_batch(&pts[1], (cnt - 1), curve));
 	}
-	/* 0 */
-	BN_RET_ON_ERR(ec_point_assign(&tbl[0], point));
+	return (0);
+}
+
+/* See [1]: Algorithm 3.38 Sliding window method for point multiplication */
+static inline int
+ec_point_proj_inter_twin_mult_precalc_affine(ec_point_p point, size_t wnd_bits,
+    ec_curve_p curve, ec_pt_proj_am_t *tbl) {
+	size_t cnt;
+#ifdef EC_PROJ_ADD_MIX
+	size_t i;
+	ec_point_proj_t pts[(1 << (EC_PF_TWIN_MULT_WIN_BITS_MAX - 2))];
 #else
-	/* Init table. */
-	for (i = 0; i < (((size_t)1) << (wnd_bits - 2)); i ++) {
-		BN_RET_ON_ERR(ec_point_proj_init(&tbl[i], curve->m));
-	}
-	if (wnd_bits > 2) {
-		/* 0 */
-		BN_RET_ON_ERR(ec_point_proj_import_affine(&tbl[0], point, curve));
-		BN_RET_ON_ERR(ec_point_proj_add(&tbl[0], &tbl[0], curve));
-		BN_RET_ON_ERR(ec_point_proj_norm(&tbl[0], curve));
-		/* 1 */
-		BN_RET_ON_ERR(ec_point_proj_import_affine(&tbl[1], point, curve));
-		BN_RET_ON_ERR(ec_point_proj_add(&tbl[1], &tbl[0], curve));
-		BN_RET_ON_ERR(ec_point_proj_norm(&tbl[1], curve));
-		/* 2... */
-		for (i = 2; i < (((size_t)1) << (wnd_bits - 2)); i ++) {
-			BN_RET_ON_ERR(ec_point_proj_assign(&tbl[i], &tbl[(i - 1)]));
-			BN_RET_ON_ERR(ec_point_proj_add(&tbl[i], &tbl[0], curve));
-			BN_RET_ON_ERR(ec_point_proj_norm(&tbl[i], curve));
-		}
+	ec_point_proj_p pts = tbl;
+#endif
+
+	if (NULL == point || 2 > wnd_bits ||
+	    EC_PF_TWIN_MULT_WIN_BITS_MAX < wnd_bits || NULL == tbl)
+		return (EINVAL);
+	cnt = (((size_t)1) << (wnd_bits - 2));
+	BN_RET_ON_ERR(ec_point_proj_odd_mult_precalc__int(point, cnt, curve,
+	    pts));
+#ifdef EC_PROJ_ADD_MIX
+	for (i = 0; i < cnt; i ++) {
+		BN_RET_ON_ERR(ec_point_init(&tbl[i], curve->m));
+		BN_RET_ON_ERR(ec_point_proj_export_affine(&pts[i], &tbl[i],
+		    curve));
 	}
-	/* 0 */
-	BN_RET_ON_ERR(ec_point_proj_import_affine(&tbl[0], point, curve));
 #endif /* EC_PROJ_ADD_MIX */
 	return (0);
 }
 
+/* res = ad * a + bd * b, a and b given by
+ * ec_point_proj_inter_twin_mult_precalc_affine() tables. */
 static inline int
-ec_point_proj_inter_twin_mult_affine(ec_point_p a, bn_p ad, ec_point_p b, bn_p bd,
-    ec_curve_p curve, ec_point_p res) {
+ec_point_proj_inter_twin_mult_tbl(ec_pt_proj_am_t *atbl, size_t a_wnd_bits,
+    bn_p ad, ec_pt_proj_am_t *btbl, size_t b_wnd_bits, bn_p bd,
+    ec_curve_p curve, ec_point_proj_p res) {
 	ssize_t i;
 	size_t naf_cnt, naf0_cnt, naf1_cnt;
-	ec_point_proj_t tm;
-	ec_pt_proj_am_t tbl0[(1 << (EP_DEPTH - 2))], tbl1[(1 << (EP_WIDTH - 2))];
 	int8_t naf0[(BN_BIT_LEN / 2)], naf1[(BN_BIT_LEN / 2)];
 
-	if (NULL == a || NULL == ad || NULL == b || NULL == bd || NULL == curve ||
-	    NULL == res)
+	if (NULL == atbl || NULL == ad || NULL == btbl || NULL == bd ||
+	    NULL == curve || NULL == res)
 		return (EINVAL);
 
-	/* Compute the precomputation table. */
-	BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_precalc_affine(a, EP_DEPTH,
-	    curve, (ec_point_t*)tbl0));
-	BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_precalc_affine(b, EP_WIDTH,
-	    curve, (ec_point_t*)tbl1));
-
 	/* Compute the w-TNAF representation of k. */
-	BN_RET_ON_ERR(bn_calc_naf(ad, EP_DEPTH, sizeof(naf0), naf0, &naf0_cnt));
-	BN_RET_ON_ERR(bn_calc_naf(bd, EP_WIDTH, sizeof(naf1), naf1, &naf1_cnt));
+	BN_RET_ON_ERR(bn_calc_naf(ad, a_wnd_bits, sizeof(naf0), naf0, &naf0_cnt));
+	BN_RET_ON_ERR(bn_calc_naf(bd, b_wnd_bits, sizeof(naf1), naf1, &naf1_cnt));
 	naf_cnt = MAX(naf0_cnt, naf1_cnt);
 
-	BN_RET_ON_ERR(ec_point_proj_init(&tm, curve->m));
-	bn_assign_zero(&tm.z); /* "Zeroize" point. */
+	BN_RET_ON_ERR(ec_point_proj_init(res, curve->m));
+	bn_assign_zero(&res->z); /* "Zeroize" point. */
 	for (i = (ssize_t)(naf_cnt - 1); i >= 0; i --) {
-		BN_RET_ON_ERR(ec_point_proj_add(&tm, &tm, curve));
+		BN_RET_ON_ERR(ec_point_proj_add(res, res, curve));
 #ifdef EC_PROJ_ADD_MIX
 		if (0 != naf0[i]) {
 			if (naf0[i] > 0) {
-				BN_RET_ON_ERR(ec_point_proj_add_mix(&tm,
-				    &tbl0[(naf0[i] / 2)], curve));
+				BN_RET_ON_ERR(ec_point_proj_add_mix(res,
+				    &atbl[(naf0[i] / 2)], curve));
 			} else {
-				BN_RET_ON_ERR(ec_point_proj_sub_mix(&tm,
-				    &tbl0[((-naf0[i]) / 2)], curve));
+				BN_RET_ON_ERR(ec_point_proj_sub_mix(res,
+				    &atbl[((-naf0[i]) / 2)], curve));
 			}
 		}
 		if (0 == naf1[i])
 			continue;
 		if (naf1[i] > 0) {
-			BN_RET_ON_ERR(ec_point_proj_add_mix(&tm,
-			    &tbl1[(naf1[i] / 2)], curve));
+			BN_RET_ON_ERR(ec_point_proj_add_mix(res,
+			    &btbl[(naf1[i] / 2)], curve));
 		} else {
-			BN_RET_ON_ERR(ec_point_proj_sub_mix(&tm,
-			    &tbl1[((-naf1[i]) / 2)], curve));
+			BN_RET_ON_ERR(ec_point_proj_sub_mix(res,
+			    &btbl[((-naf1[i]) / 2)], curve));
 		}
 #else
 		if (0 != naf0[i]) {
 			if (naf0[i] > 0) {
-				BN_RET_ON_ERR(ec_point_proj_add(&tm,
-				    &tbl0[(naf0[i] / 2)], curve));
+				BN_RET_ON_ERR(ec_point_proj_add(res,
+				    &atbl[(naf0[i] / 2)], curve));
 			} else {
-				BN_RET_ON_ERR(ec_point_proj_sub(&tm,
-				    &tbl0[((-naf0[i]) / 2)], curve));
+				BN_RET_ON_ERR(ec_point_proj_sub(res,
+				    &atbl[((-naf0[i]) / 2)], curve));
 			}
 		}
 		if (0 == naf1[i])
 			continue;
 		if (naf1[i] > 0) {
-			BN_RET_ON_ERR(ec_point_proj_add(&tm,
-			    &tbl1[(naf1[i] / 2)], curve));
+			BN_RET_ON_ERR(ec_point_proj_add(res,
+			    &btbl[(naf1[i] / 2)], curve));
 		} else {
-			BN_RET_ON_ERR(ec_point_proj_sub(&tm,
-			    &tbl1[((-naf1[i]) / 2)], curve));
+			BN_RET_ON_ERR(ec_point_proj_sub(res,
+			    &btbl[((-naf1[i]) / 2)], curve));
 		}
 #endif /* EC_PROJ_ADD_MIX */
 	}
+	return (0);
+}
+
+static inline int
+ec_point_proj_inter_twin_mult_affine(ec_point_p a, bn_p ad, ec_point_p b, bn_p bd,
+    ec_curve_p curve, ec_point_p res) {
+	ec_point_proj_t tm;
+	ec_pt_proj_am_t tbl0[(1 << (EP_DEPTH - 2))], tbl1[(1 << (EP_WIDTH - 2))];
+
+	if (NULL == a || NULL == ad || NULL == b || NULL == bd || NULL == curve ||
+	    NULL == res)
+		return (EINVAL);
+
+	/* Compute the precomputation table. */
+	BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_precalc_affine(a, EP_DEPTH,
+	    curve, tbl0));
+	BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_precalc_affine(b, EP_WIDTH,
+	    curve, tbl1));
+	BN_RET_ON_ERR(ec_point_proj_inter_twin_mult_tbl(tbl0, EP_DEPTH, ad,
+	    tbl1, EP_WIDTH, bd, curve, &tm));
 	/* Convert r to affine coordinates. */
 	BN_RET_ON_ERR(ec_point_proj_export_affine(&tm, res, curve));
 	return (0);
 }
 
 
+/* Constant time multiplication for secret scalars.
+ * See [4]: Algorithm 6, regular window recoding: odd k is recoded to
+ * non zero odd digits |k_i| < 2^w, so every window is w doublings and
+ * one addition; table read scans all points.
+ * Addition exceptional cases (doubling, infinity) are reachable only
+ * with negligible probability for d < n. */
+
+/* Constant time projective -> affine: Z^-1 = Z^(p - 2). */
+static inline int
+ec_point_proj_ct_export_affine(ec_point_proj_p a, ec_point_p b,
+    ec_curve_p curve) {
+	bn_t z_inv;
+
+	if (NULL == a || NULL == b || (void*)a == (void*)b || NULL == curve)
+		return (EINVAL);
+	if (0 != ec_point_proj_is_at_infinity(a)) {
+		b->infinity = 1;
+		return (0);
+	}
+	BN_RET_ON_ERR(bn_init(&z_inv, EC_CURVE_CALC_BITS_DBL(curve)));
+	BN_RET_ON_ERR(bn_assign(&z_inv, &a->z));
+	BN_RET_ON_ERR(ec_pf_from(&z_inv, curve));
+	BN_RET_ON_ERR(bn_mod_inv_fermat(&z_inv, &curve->p,
+	    &curve->p_mod_rd_data));
+	BN_RET_ON_ERR(ec_pf_to(&z_inv, curve));
+	BN_RET_ON_ERR(ec_point_proj_norm_zinv__int(a, &z_inv, curve));
+	BN_RET_ON_ERR(ec_point_proj_export_affine(a, b, curve));
+	return (0);
+}
+
+/* Recoded digits count: k < 2n, multiple of tbl_cnt. */
+static inline size_t
+ec_point_ct_mult_steps__int(size_t wnd_bits, size_t tbl_cnt,
+    ec_curve_p curve) {
+	size_t steps;
+
+	steps = ((bn_calc_bits(&curve->n) + wnd_bits) / wnd_bits);
+	return ((((steps + (tbl_cnt - 1)) / tbl_cnt) * tbl_cnt));
+}
+
+/* tbl[(r * 2^wnd_bits) + i] = (2i + 1) * 2^(wnd_bits * s * r) * point,
+ * tbl[(r * 2^wnd_bits) + 2^(wnd_bits - 1) + i] = 2 * tbl[(r * 2^wnd_bits) + i],
+ * i < 2^(wnd_bits - 1), r < tbl_cnt, s = steps / tbl_cnt; affine, field
+ * representation. */
+static inline int
+ec_point_proj_ct_mult_precompute_affine(ec_point_p point, size_t wnd_bits,
+    size_t tbl_cnt, ec_curve_p curve, ec_point_p tbl) {
+	size_t i, r, cnt, dbl_cnt;
+	ec_point_t base, *rtbl;
+	ec_point_proj_t tm, pts[(1 << (EC_PF_TWIN_MULT_WIN_BITS_MAX - 2))];
+
+	if (NULL == point || 2 > wnd_bits ||
+	    EC_PF_TWIN_MULT_WIN_BITS_MAX <= wnd_bits || 0 == tbl_cnt ||
+	    EC_CT_MULT_TBL_CNT_MAX < tbl_cnt || NULL == curve || NULL == tbl)
+		return (EINVAL);
+	if (0 != ec_point_is_at_infinity(point))
+		return (EINVAL);
+	cnt = (((size_t)1) << (wnd_bits - 1));
+	dbl_cnt = (wnd_bits *
+	    (ec_point_ct_mult_steps__int(wnd_bits, tbl_cnt, curve) / tbl_cnt));
+	BN_RET_ON_ERR(ec_point_init(&base, curve->m));
+	BN_RET_ON_ERR(ec_point_assign(&base, point));
+	BN_RET_ON_ERR(ec_point_proj_init(&tm, curve->m));
+	for (r = 0; r < tbl_cnt; r ++) {
+		if (0 != r) { /* base = 2^(wnd_bits * s) * base */
+			BN_RET_ON_ERR(ec_point_proj_import_affine(&tm, &base,
+			    curve));
+			BN_RET_ON_ERR(ec_point_proj_dbl_n(&tm, dbl_cnt, curve));
+			BN_RET_ON_ERR(ec_point_proj_export_affine(&tm, &base,
+			    curve));
+		}
+		BN_RET_ON_ERR(ec_point_proj_odd_mult_precalc__int(&base, cnt,
+		    curve, pts));
+		rtbl = &tbl[(r * 2 * cnt)];
+		for (i = 0; i < cnt; i ++) {
+			BN_RET_ON_ERR(ec_point_init(&rtbl[i], curve->m));
+			BN_RET_ON_ERR(ec_point_proj_export_affine(&pts[i],
+			    &rtbl[i], curve));
+			BN_RET_ON_ERR(ec_point_proj_dbl_n(&pts[i], 1, curve));
+		}
+		BN_RET_ON_ERR(ec_point_proj_norm_batch(pts, cnt, curve));
+		for (i = 0; i < cnt; i ++) {
+			BN_RET_ON_ERR(ec_point_init(&rtbl[(cnt + i)], curve->m));
+			BN_RET_ON_ERR(ec_point_proj_export_affine(&pts[i],
+			    &rtbl[(cnt + i)], curve));
+		}
+		for (i = 0; i < (2 * cnt); i ++) {
+			BN_RET_ON_ERR(ec_pf_to(&rtbl[i].x, curve));
+			BN_RET_ON_ERR(ec_pf_to(&rtbl[i].y, curve));
+			/* Zero pad: ec_point_ct_lookup__int() reads all digits. */
+			bn_digits_assign_zero(&rtbl[i].x.num[rtbl[i].x.digits],
+			    (rtbl[i].x.count - rtbl[i].x.digits));
+			bn_digits_assign_zero(&rtbl[i].y.num[rtbl[i].y.digits],
+			    (rtbl[i].y.count - rtbl[i].y.digits));
+		}
+	}
+	return (0);
+}
+
+/* res = tbl[idx], or -tbl[idx] if neg. Reads all cnt points. */
+static inline void
+ec_point_ct_lookup__int(ec_point_p tbl, size_t cnt, bn_digit_t idx,
+    bn_digit_t neg, ec_curve_p curve, ec_point_p res) {
+	size_t i, count = curve->p.digits;
+	bn_digit_t y_neg[BN_MAX_DIGITS];
+
+	bn_digits_assign_zero(res->x.num, count);
+	bn_digits_assign_zero(res->y.num, count);
+	for (i = 0; i < cnt; i ++) {
+		bn_digits_cassign(res->x.num, tbl[i].x.num, count,
+		    bn_digit_ct_is_zero((((bn_digit_t)i) ^ idx)));
+		bn_digits_cassign(res->y.num, tbl[i].y.num, count,
+		    bn_digit_ct_is_zero((((bn_digit_t)i) ^ idx)));
+	}
+	/* -(x, y) = (x, p - y) */
+	bn_digits_sub_ct(y_neg, curve->p.num, res->y.num, count);
+	bn_digits_cassign(res->y.num, y_neg, count, neg);
+	res->x.digits = bn_digits_calc_digits_ct(res->x.num, count);
+	res->y.digits = bn_digits_calc_digits_ct(res->y.num, count);
+	res->infinity = 0;
+}
+
+/* affine -> projective, b not at infinity, in field representation. */
+static inline int
+ec_point_proj_ct_import_affine__int(ec_point_proj_p a, ec_point_p b,
+    ec_curve_p curve) {
+
+	BN_RET_ON_ERR(ec_pf_assign(&a->x, &b->x, curve));
+	BN_RET_ON_ERR(ec_pf_assign(&a->y, &b->y, curve));
+	BN_RET_ON_ERR(ec_pf_one(&a->z, curve));
+	return (0);
+}
+
+/* res = d * P, d < n, tbl - ec_point_proj_ct_mult_precompute_affine(P).
+ * Operations sequence and memory access depend only on n, wnd_bits and
+ * tbl_cnt. */
+static inline int
+ec_point_proj_ct_mult(ec_point_p tbl, size_t wnd_bits, size_t tbl_cnt,
+    bn_p d, ec_curve_p curve, ec_point_proj_p res) {
+	size_t i, j, r, cnt, count, steps, s;
+	bn_digit_t tm, neg, mask, k[BN_MAX_DIGITS], kn[BN_MAX_DIGITS];
+	uint8_t idx[((BN_BIT_LEN / 2) + EC_CT_MULT_TBL_CNT_MAX)];
+	uint8_t sign[((BN_BIT_LEN / 2) + EC_CT_MULT_TBL_CNT_MAX)];
+	ec_point_t pt, pt_dbl;
+
+	if (NULL == tbl || 2 > wnd_bits ||
+	    EC_PF_TWIN_MULT_WIN_BITS_MAX <= wnd_bits || 0 == tbl_cnt ||
+	    EC_CT_MULT_TBL_CNT_MAX < tbl_cnt || NULL == d || NULL == curve ||
+	    NULL == res)
+		return (EINVAL);
+	count = (curve->n.digits + 1);
+	if (d->digits > curve->n.digits || BN_MAX_DIGITS < count)
+		return (EINVAL);
+	/* k = d if d is odd, k = d + n otherwise: k odd, k < 2n.
+	 * Fixed count digits: top digit zero. */
+	bn_digits_load_ct(k, count, d->num, d->digits);
+	bn_digits_load_ct(kn, count, curve->n.num, curve->n.digits);
+	bn_digits_add_ct(kn, kn, k, count);
+	bn_digits_cassign(k, kn, count, (1 ^ (k[0] & 1)));
+	/* Recode: k = sum(k_i * 2^(w * i)), k_i odd, |k_i| < 2^w. */
+	steps = ec_point_ct_mult_steps__int(wnd_bits, tbl_cnt, curve);
+	mask = ((((bn_digit_t)1) << (wnd_bits + 1)) - 1);
+	for (i = 0; i < (steps - 1); i ++) {
+		/* k_i = (k mod 2^(w + 1)) - 2^w */
+		tm = (k[0] & mask);
+		neg = (1 ^ (tm >> wnd_bits));
+		tm -= (((bn_digit_t)1) << wnd_bits);
+		tm = ((tm ^ (((bn_digit_t)0) - neg)) + neg); /* |k_i| */
+		idx[i] = (uint8_t)(tm >> 1);
+		sign[i] = (uint8_t)neg;
+		/* k = (k - k_i) / 2^w */
+		k[0] = ((k[0] & ~mask) | (((bn_digit_t)1) << wnd_bits));
+		bn_digits_r_shift(k, count, wnd_bits);
+	}
+	/* Top digit: odd, 0 < k < 2^w. */
+	idx[i] = (uint8_t)(k[0] >> 1);
+	sign[i] = 0;
+
+	/* res = sum(2^(w * s * r) * sum(k_(s * r + j) * 2^(w * j))),
+	 * j: s - 1..0, one table per r. */
+	s = (steps / tbl_cnt);
+	cnt = (((size_t)1) << (wnd_bits - 1));
+	BN_RET_ON_ERR(ec_point_init(&pt, curve->m));
+	BN_RET_ON_ERR(ec_point_init(&pt_dbl, curve->m));
+	BN_RET_ON_ERR(ec_point_proj_init(res, curve->m));
+	for (j = s; 0 < j;) {
+		j --;
+		if ((j + 1) != s) { /* No value checks: Z = 0 stays infinity. */
+			BN_RET_ON_ERR(ec_point_proj_dbl_n__int(res, wnd_bits,
+			    curve));
+		}
+		for (r = 0; r < tbl_cnt; r ++) {
+			i = ((s * r) + j);
+			ec_point_ct_lookup__int(&tbl[(r * 2 * cnt)], cnt, idx[i],
+			    sign[i], curve, &pt);
+			if ((j + 1) == s && 0 == r) { /* First point: res = pt. */
+				BN_RET_ON_ERR(ec_point_proj_ct_import_affine__int(res,
+				    &pt, curve));
+				continue;
+			}
+			/* -2b = 2(-b): same idx and sign. */
+			ec_point_ct_lookup__int(&tbl[((r * 2 * cnt) + cnt)], cnt,
+			    idx[i], sign[i], curve, &pt_dbl);
+			BN_RET_ON_ERR(ec_point_proj_add_mix__int(res, &pt,
+			    &pt_dbl, curve));
+		}
+	}
+	return (0);
+}
+
 
 
 
@@ -2430,6 +3312,45 @@ ec_point_twin_mult_bp(bn_p Gd, ec_point_p b, bn_p bd, ec_curve_p curve,
 	return (0);
 }
 
+/* Mult point and secret digit d < n. */
+static inline int
+ec_point_ct_mult(ec_point_p point, bn_p d, ec_curve_p curve) {
+#ifdef EC_CONSTANT_TIME
+	ec_point_t tbl[(1 << EC_CT_MULT_WIN_BITS)];
+	ec_point_proj_t tm;
+
+	if (NULL == point || NULL == d || NULL == curve)
+		return (EINVAL);
+	if (0 != ec_point_is_at_infinity(point))
+		return (0);
+	BN_RET_ON_ERR(ec_point_proj_ct_mult_precompute_affine(point,
+	    EC_CT_MULT_WIN_BITS, 1, curve, tbl));
+	BN_RET_ON_ERR(ec_point_proj_ct_mult(tbl, EC_CT_MULT_WIN_BITS, 1, d,
+	    curve, &tm));
+	BN_RET_ON_ERR(ec_point_proj_ct_export_affine(&tm, point, curve));
+#else
+	BN_RET_ON_ERR(ec_point_unknown_pt_mult(point, d, curve));
+#endif /* EC_CONSTANT_TIME */
+	return (0);
+}
+
+/* Mult fixed base point and secret digit d < n. */
+static inline int
+ec_point_ct_mult_bp(bn_p d, ec_curve_p curve, ec_point_p res) {
+#ifdef EC_CONSTANT_TIME
+	ec_point_proj_t tm;
+
+	if (NULL == d || NULL == curve || NULL == res)
+		return (EINVAL);
+	BN_RET_ON_ERR(ec_point_proj_ct_mult(curve->G_ct_tbl,
+	    EC_CT_MULT_BP_WIN_BITS, EC_CT_MULT_BP_TBL_CNT, d, curve, &tm));
+	BN_RET_ON_ERR(ec_point_proj_ct_export_affine(&tm, res, curve));
+#else
+	BN_RET_ON_ERR(ec_point_mult_bp(d, curve, res));
+#endif /* EC_CONSTANT_TIME */
+	return (0);
+}
+
 
 
 
@@ -0,0 +1,115 @@
+/*-
+ * Copyright (c) 2011-2026 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __NET_MC_MGR_H__
+#define __NET_MC_MGR_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "net/socket_address.h"
+#include "threadpool/threadpool.h"
+
+
+/*
+ * Multicast subscription manager.
+ * One socket per group:port/interface shared by all subscribers,
+ * refcounted. Join/leave not done inline: requests collected during
+ * batch_delay and applied from manager timer, grouped by interface.
+ * Leave delayed for linger time, so re-join on channel zapping reuse
+ * joined socket without IGMP leave/report.
+ */
+
+typedef struct mc_mgr_s		*mc_mgr_p;
+typedef struct mc_mgr_sub_s	*mc_mgr_sub_p;
+
+/* Called from manager timer (any pool thread) when group joined or
+ * join failed, only for mc_mgr_join() that returned EINPROGRESS.
+ * On error sub freed after return. Do not call mc_mgr_*() from cb. */
+typedef void (*mc_mgr_cb)(mc_mgr_sub_p sub, int error, uintptr_t skt,
+    void *udata);
+
+
+typedef struct mc_mgr_settings_s {
+	uint32_t	linger;		/* Delay before leave, ms. */
+	uint32_t	batch_delay;	/* Requests collect time, ms. */
+	uint32_t	rcv_buf;	/* Socket receive buffer, kb. 0 - system default. */
+	uint32_t	flags;		/* MC_MGR_S_F_* */
+} mc_mgr_settings_t, *mc_mgr_settings_p;
+
+#define MC_MGR_S_F_BIND_ANY	(((uint32_t)1) << 0) /* Bind to INADDR_ANY:port, not to group addr. */
+
+/* Default values. */
+#define MC_MGR_S_DEF_LINGER	3000
+#define MC_MGR_S_DEF_BATCH_DELAY 5
+#define MC_MGR_S_DEF_RCV_BUF	1024
+#define MC_MGR_S_DEF_FLAGS	0
+
+
+#define MC_MGR_LAT_HIST_SIZE	16 /* Log2 buckets, 64us << i. */
+
+typedef struct mc_mgr_stat_s {
+	uint64_t	join_req;	/* mc_mgr_join() calls. */
+	uint64_t	join_reuse;	/* Satisfied by joined/lingering group. */
+	uint64_t	join_rescued;	/* Re-joined during linger: IGMP avoided. */
+	uint64_t	joins;		/* Groups joined: setsockopt() done. */
+	uint64_t	join_errors;
+	uint64_t	leaves;		/* Groups leaved: setsockopt() done. */
+	uint64_t	batches;	/* Timer runs with work. */
+	uint64_t	lat_sum;	/* Join latency: request - joined, us. */
+	uint64_t	lat_max;
+	uint64_t	lat_hist[MC_MGR_LAT_HIST_SIZE];
+	size_t		groups;		/* Now: all groups. */
+	size_t		groups_linger;	/* Now: no subscribers, wait for leave. */
+	size_t		subs;		/* Now: subscribers. */
+} mc_mgr_stat_t, *mc_mgr_stat_p;
+
+
+void	mc_mgr_def_settings(mc_mgr_settings_p s_ret);
+
+int	mc_mgr_create(tp_p tp, const mc_mgr_settings_t *s, mc_mgr_p *mgr_ret);
+/* All subscribers must leave before, threads must not run timer. */
+void	mc_mgr_destroy(mc_mgr_p mgr);
+
+/* Subscribe to mc_addr (group + port) on if_index (0 - any).
+ * Returns: 0 - group already joined, socket available;
+ * EINPROGRESS - join queued, cb will be called. */
+int	mc_mgr_join(mc_mgr_p mgr, const sockaddr_storage_t *mc_addr,
+	    uint32_t if_index, mc_mgr_cb cb, void *udata,
+	    mc_mgr_sub_p *sub_ret);
+/* Unsubscribe and free sub. Subscriber must stop socket IO before. */
+void	mc_mgr_leave(mc_mgr_sub_p sub);
+/* Returns socket or (uintptr_t)-1 if join not complete yet. */
+uintptr_t mc_mgr_sub_skt_get(mc_mgr_sub_p sub);
+
+int	mc_mgr_stat_get(mc_mgr_p mgr, mc_mgr_stat_p stat);
+
+
+#endif /* __NET_MC_MGR_H__ */
@@ -0,0 +1,142 @@
+/*-
+ * Copyright (c) 2011-2026 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __NET_UDP_RELAY_H__
+#define __NET_UDP_RELAY_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "threadpool/threadpool.h"
+#include "utils/ring_buffer_fanout.h"
+
+
+/*
+ * UDP to stream (TCP) relay: raw datagrams payload (MPEG2-TS over UDP)
+ * relayed to clients sockets.
+ * Relay and all its clients served by one thread, path is selected at
+ * runtime:
+ * - many clients: recvmmsg() directly into fan-out ring slots, each
+ *   client sendmsg() from ring;
+ * - single client, low packet rate: splice() socket -> pipe -> socket,
+ *   no copy to user space;
+ * - single client, high packet rate: recvmmsg() into own ring slots,
+ *   sendmsg() with MSG_ZEROCOPY for big blocks (plain for small or if
+ *   kernel reports that it copied data anyway).
+ * Path switch do not lose or reorder data: previous path backlog sent
+ * first.
+ */
+
+typedef struct udp_relay_s	*udp_relay_p;
+typedef struct udp_relay_clnt_s	*udp_relay_clnt_p;
+
+
+typedef struct udp_relay_settings_s {
+	size_t		pkt_size_max;	/* Receive slot size: bigger datagrams dropped. */
+	size_t		pkts_max;	/* Datagrams per recvmmsg() call. */
+	size_t		ring_size;	/* Single client ring size. */
+	size_t		pipe_size;	/* Splice pipe size. */
+	size_t		zc_min;		/* Min send size for MSG_ZEROCOPY. */
+	size_t		splice_pkts_max; /* Avg datagrams per wakeup to leave splice
+					  * path, back on half of it. */
+	r_buf_fo_settings_t fo;		/* Fan-out settings, snd_timeout for all. */
+	uint32_t	flags;		/* UDP_RELAY_S_F_* */
+} udp_relay_settings_t, *udp_relay_settings_p;
+
+#define UDP_RELAY_S_F_NO_SPLICE		(((uint32_t)1) << 0) /* Disable splice() path. */
+#define UDP_RELAY_S_F_NO_ZEROCOPY	(((uint32_t)1) << 1) /* Disable MSG_ZEROCOPY. */
+#define UDP_RELAY_S_F_FANOUT_ONLY	(((uint32_t)1) << 2) /* Always use fan-out path. */
+#define UDP_RELAY_S_F_CLOSE_SKT		(((uint32_t)1) << 3) /* Close UDP socket on destroy. */
+
+/* Default values. */
+#define UDP_RELAY_S_DEF_PKT_SIZE_MAX	1316 /* 7 * MPEG2-TS packet. */
+#define UDP_RELAY_S_DEF_PKTS_MAX	32
+#define UDP_RELAY_S_DEF_RING_SIZE	(2 * 1024 * 1024)
+#define UDP_RELAY_S_DEF_PIPE_SIZE	(1024 * 1024)
+#define UDP_RELAY_S_DEF_ZC_MIN		(16 * 1024)
+#define UDP_RELAY_S_DEF_SPLICE_PKTS_MAX	4
+#define UDP_RELAY_S_DEF_FLAGS		0
+
+
+/* Paths. */
+#define UDP_RELAY_PATH_FANOUT	0 /* recvmmsg() to fan-out ring, sendmsg() per client. */
+#define UDP_RELAY_PATH_COPY	1 /* Single: recvmmsg() to ring, sendmsg(). */
+#define UDP_RELAY_PATH_ZEROCOPY	2 /* Single: recvmmsg() to ring, sendmsg(MSG_ZEROCOPY). */
+#define UDP_RELAY_PATH_SPLICE	3 /* Single: splice() socket -> pipe -> socket. */
+#define UDP_RELAY_PATH_COUNT	4
+#define UDP_RELAY_PATH_NONE	0xff /* No clients. */
+
+typedef struct udp_relay_path_stat_s {
+	uint64_t	rcv_pkts;	/* Datagrams received. */
+	uint64_t	rcv_size;
+	uint64_t	rcv_calls;	/* Receive syscalls. */
+	uint64_t	snd_size;	/* Fan-out: written to ring. */
+	uint64_t	snd_calls;	/* Fan-out: ring writes. */
+} udp_relay_path_stat_t, *udp_relay_path_stat_p;
+
+typedef struct udp_relay_stat_s {
+	udp_relay_path_stat_t path[UDP_RELAY_PATH_COUNT];
+	uint64_t	wakeups;
+	uint64_t	switches;	/* Path changes. */
+	uint64_t	drop_pkts;	/* No space / too big / too small. */
+	uint64_t	drop_size;
+	uint64_t	zc_copied;	/* MSG_ZEROCOPY sends copied by kernel. */
+	uint32_t	path_cur;	/* UDP_RELAY_PATH_* */
+	size_t		clnt_count;
+} udp_relay_stat_t, *udp_relay_stat_p;
+
+
+/* Called on send error / timeout / lag drop. Client stopped,
+ * udp_relay_clnt_free() can be called from callback. */
+typedef void (*udp_relay_clnt_cb)(udp_relay_clnt_p clnt, int error,
+    void *udata);
+
+
+void	udp_relay_def_settings(udp_relay_settings_p s_ret);
+
+/* tpt - pool thread (not virtual), relay and all clients served by it.
+ * skt - bound (joined) UDP socket, set to non-blocking. */
+int	udp_relay_create(tpt_p tpt, uintptr_t skt, udp_relay_settings_p s,
+	    udp_relay_p *relay_ret);
+/* Free all clients before. */
+void	udp_relay_destroy(udp_relay_p relay);
+tpt_p	udp_relay_tpt_get(udp_relay_p relay);
+/* Must be called from relay thread. */
+int	udp_relay_stat_get(udp_relay_p relay, udp_relay_stat_p stat);
+
+/* Must be called from relay thread. Client socket set to non-blocking,
+ * SO_ZEROCOPY may be enabled, socket not closed on free. */
+int	udp_relay_clnt_add(udp_relay_p relay, uintptr_t skt,
+	    udp_relay_clnt_cb cb_func, void *udata, udp_relay_clnt_p *clnt_ret);
+void	udp_relay_clnt_free(udp_relay_clnt_p clnt);
+void	*udp_relay_clnt_udata_get(udp_relay_clnt_p clnt);
+
+
+#endif /* __NET_UDP_RELAY_H__ */
@@ -55,10 +55,28 @@ int	dns_resolver_create(tp_p tp, const struct sockaddr_storage *dns_addrs,
 	    uint32_t neg_cache, dns_rslvr_p *dns_rslvr_ret);
 void	dns_resolver_destroy(dns_rslvr_p rslvr);
 
+/* EDNS0 UDP payload size advertised in queries: 512..4096, 0 - no OPT RR.
+ * Truncated replies retried over TCP. */
+int	dns_resolver_edns_udp_size_set(dns_rslvr_p rslvr, uint16_t udp_size);
+
+/* Return expired cached addresses during stale_ttl seconds after
+ * expiration and refresh them in background. 0 - disabled (default).
+ * Stale reply calls cb_func once with task = NULL, background refresh
+ * errors not reported to caller. */
+int	dns_resolver_stale_ttl_set(dns_rslvr_p rslvr, uint32_t stale_ttl);
+
 tpt_p	dns_resolver_tpt_get(dns_rslvr_p rslvr);
 int	dns_resolver_cache_text_dump(dns_rslvr_p rslvr, char *buf, size_t buf_size,
 	    size_t *size_ret);
 
+/* Binary cache snapshot for warm restart. Save writes temp file and
+ * rename it. Load restore entries that still valid (or within stale_ttl),
+ * existing entries not replaced. */
+int	dns_resolver_cache_save(dns_rslvr_p rslvr, const char *file_name,
+	    size_t file_name_size);
+int	dns_resolver_cache_load(dns_rslvr_p rslvr, const char *file_name,
+	    size_t file_name_size, size_t *count_ret);
+
 int	dns_resolv_hostaddr(dns_rslvr_p rslvr, uint8_t *name, size_t name_size,
 	    uint16_t flags, dns_resolv_cb cb_func, void *arg,
 	    dns_rslvr_task_p *task_ret);
@@ -33,62 +33,54 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h> /* struct iovec */
 
 #include "proto/http.h"
+#include "proto/dns_resolv.h"
 
 #include "utils/macro.h"
 #include "threadpool/threadpool.h"
 #include "threadpool/threadpool_task.h"
-#include "net/host_address.h"
-#include "net/net_socket.h"
+#include "net/socket_options.h"
 
-#define HTTP_CLI_MAX_CUSTOM_HDRS_CNT	((IOV_MAX / 2) - 4) /* Limit for http_cli_snd() */
+#define HTTP_CLI_MAX_CUSTOM_HDRS_CNT	((IOV_MAX / 2) - 4) /* Limit for http_cli_req_head_set() */
 
 
 
 typedef struct http_client_s		*http_cli_p;
-typedef struct http_client_connection_s	*http_cli_conn_p;
+typedef struct http_client_request_s	*http_cli_req_p;
 typedef struct http_client_responce_s	*http_cli_resp_p;
 
 
-typedef int (*http_cli_cb)(http_cli_conn_p cli_conn, void *udata, int error);
-
-#define HTTP_CLI_CONN_STATE_DISCONNECTED	0
-#define HTTP_CLI_CONN_STATE_CONNECTING		1 /* Start connecting... */
-#define HTTP_CLI_CONN_STATE_CONNECTED		2 /* Connected. */
-#define HTTP_CLI_CONN_STATE_REQ_HDRS_SENDING	3
-#define HTTP_CLI_CONN_STATE_REQ_HDRS_SENDED	4
-#define HTTP_CLI_CONN_STATE_REQ_PAYLOAD_SENDING	5
-#define HTTP_CLI_CONN_STATE_REQ_PAYLOAD_SENDED	6
-#define HTTP_CLI_CONN_STATE_RESP_HDRS_RCVING	7
-#define HTTP_CLI_CONN_STATE_RESP_HDRS_RECEIVED	8
-#define HTTP_CLI_CONN_STATE_RESP_PAYLOAD_RCVING	9
-
-
+/* Called once per sent request from request thread (tpt).
+ * error: 0 - resp is valid, ETIMEDOUT, ECONNRESET, EBADMSG - bad responce,
+ * ENOBUFS - responce too big, ECANCELED - client destroyed, other
+ * connect / DNS errors.
+ * resp and its data valid only until cb return.
+ * Request is not freed, call http_cli_req_free() or reuse it:
+ * http_cli_req_send() can be called again. */
+typedef void (*http_cli_req_cb)(http_cli_req_p req, int error,
+    http_cli_resp_p resp, void *udata);
 
 
 
 typedef struct http_client_settings_s { /* Settings */
-	http_cli_ccb_t	ccb;			/* Default client callbacks. */
 	skt_opts_t	skt_opts;
-	uint32_t	flags;			/* Flags HTTP_CLI_F_*. */
-	size_t		hdrs_reserve_size;	/* kb - !!! all standart and custom hdrs size */
+	uint16_t	dns_flags;		/* DNS_R_F_*: addr families to resolve. */
+	uint64_t	conn_timeout;		/* sec, connect timeout for one addr. */
+	uint64_t	resp_timeout;		/* sec, inactivity timeout while send request / wait responce. */
+	uint64_t	idle_timeout;		/* sec, keep-alive connection idle time before close. */
+	size_t		conn_max;		/* Max connections per host per thread. */
+	size_t		pipeline_max;		/* Max requests in flight per connection, 1 - no pipelining. */
 	size_t		snd_io_buf_init_size;	/* kb, no hard limit */
 	size_t		rcv_io_buf_init_size;	/* kb */
-	size_t		rcv_io_buf_max_size;	/* kb, max request size (with data). */
-	uint32_t	req_p_flags;		/* Request processing flags HTTP_CLI_RQ_P_F_*. */
-	uint32_t	resp_p_flags;		/* Responce processing flags HTTP_CLI_RESP_P_F_*. */
-	uint32_t	http_user_agent_size;	/* 'OS/version UPnP/1.0 product/version' */
-	char		http_user_agent[256];	/* 'OS/version UPnP/1.0 product/version' */
+	size_t		rcv_io_buf_max_size;	/* kb, max responce size (with data). */
+	uint32_t	req_p_flags;		/* Request processing flags HTTP_CLI_REQ_P_F_*. */
+	uint32_t	http_user_agent_size;	/* 'OS/version product/version' */
+	char		http_user_agent[256];	/* 'OS/version product/version' */
 } http_cli_settings_t, *http_cli_settings_p;
-/* Flags. */
-#define HTTP_CLI_F_EXT_TIMEOUT_CHK	(((uint32_t)1) << 0) /* Do not activate per
-						  * handle timeout timer,
-						  * external code will
-						  * call http_cli_conn_timeout_chk(). */
-
-#define HTTP_CLI_S_SKT_OPTS_LOAD_MASK	(SO_F_HALFCLOSE_WR |		\
-					SO_F_KEEPALIVE_MASK |		\
+
+#define HTTP_CLI_S_SKT_OPTS_LOAD_MASK	(SO_F_KEEPALIVE_MASK |		\
 					SO_F_RCV_MASK |			\
 					SO_F_SND_MASK |			\
 					SO_F_TCP_NODELAY)
@@ -96,109 +88,91 @@ typedef struct http_client_settings_s { /* Settings */
 #define HTTP_CLI_S_SKT_OPTS_INT_VALS	(0)
 
 /* Request processing flags. */
-#define HTTP_CLI_REQ_P_F_HOST		(((uint32_t)1) << 0) /* add 'host' header. */
-#define HTTP_CLI_REQ_P_F_CONN_CLOSE	(((uint32_t)1) << 1) /* force 'Connection: close', use single IO_BUF for send and recv. */
+#define HTTP_CLI_REQ_P_F_HOST		(((uint32_t)1) << 0) /* add 'Host' header. */
+#define HTTP_CLI_REQ_P_F_CONN_CLOSE	(((uint32_t)1) << 1) /* force 'Connection: close', connection not returned to pool. */
 #define HTTP_CLI_REQ_P_F_USER_AGENT	(((uint32_t)1) << 2) /* add 'User-Agent' in request. */
-#define HTTP_CLI_REQ_P_F_CONTENT_LEN	(((uint32_t)1) << 3) /* add 'Content-Length' in request. */
-/* Responce processing flags. */
-#define HTTP_CLI_RESP_P_F_CONNECTION	(((uint32_t)1) << 0) /* process 'connection' header value. */
+#define HTTP_CLI_REQ_P_F_CONTENT_LEN	(((uint32_t)1) << 3) /* add 'Content-Length' in request if payload set. */
+#define HTTP_CLI_REQ_P_F_NO_PIPELINE	(((uint32_t)1) << 4) /* Do not send request on connection that wait other responces. */
 
 /* Default values. */
-#define HTTP_CLI_S_DEF_SKT_OPTS_MASK	(SO_F_RCVTIMEO | SO_F_SNDTIMEO) /* Opts that have def values. */
-#define HTTP_CLI_S_DEF_SKT_OPTS_VALS	(0)
-#define HTTP_CLI_S_DEF_SKT_OPTS_RCVTIMEO (30)
-#define HTTP_CLI_S_DEF_SKT_OPTS_SNDTIMEO (30)
-#define HTTP_CLI_S_DEF_HDRS_SIZE	(1)
+#define HTTP_CLI_S_DEF_SKT_OPTS_MASK	(SO_F_TCP_NODELAY) /* Opts that have def values. */
+#define HTTP_CLI_S_DEF_SKT_OPTS_VALS	(SO_F_TCP_NODELAY)
+#define HTTP_CLI_S_DEF_DNS_FLAGS	(DNS_R_F_IP_ALL)
+#define HTTP_CLI_S_DEF_CONN_TIMEOUT	(10)
+#define HTTP_CLI_S_DEF_RESP_TIMEOUT	(30)
+#define HTTP_CLI_S_DEF_IDLE_TIMEOUT	(30)
+#define HTTP_CLI_S_DEF_CONN_MAX		(8)
+#define HTTP_CLI_S_DEF_PIPELINE_MAX	(4)
 #define HTTP_CLI_S_DEF_SND_IO_BUF_INIT	(4)
 #define HTTP_CLI_S_DEF_RCV_IO_BUF_INIT	(4)
-#define HTTP_CLI_S_DEF_RCV_IO_BUF_MAX	(128)
-#define HTTP_CLI_S_DEF_REQ_P_FLAGS	(HTTP_CLI_REQ_P_F_USER_AGENT | HTTP_CLI_REQ_P_F_CONTENT_LEN)
-#define HTTP_CLI_S_DEF_RESP_P_FLAGS	(0)
-
+#define HTTP_CLI_S_DEF_RCV_IO_BUF_MAX	(1024)
+#define HTTP_CLI_S_DEF_REQ_P_FLAGS	(HTTP_CLI_REQ_P_F_HOST | HTTP_CLI_REQ_P_F_USER_AGENT | HTTP_CLI_REQ_P_F_CONTENT_LEN)
 
 
 
 typedef struct http_client_responce_s {
-	uint8_t		*hdr;
+	uint8_t		*hdr;		/* Responce line + headers, with CRLFCRLF. */
 	size_t		hdr_size;
 	http_resp_line_data_t line;	/* First responce line. */
-	uint8_t		*data;		/* After CRLFCRLF. */
-	size_t		data_size;	/* content-length */
-	uint32_t	flags;		/* Flags */
+	uint8_t		*data;		/* After CRLFCRLF, chunked encoding removed. */
+	size_t		data_size;
+	uint32_t	flags;		/* Flags HTTP_CLI_RD_F_* */
 } http_cli_resp_t;
 #define HTTP_CLI_RD_F_CONN_CLOSE	(((uint32_t)1) << 0) /* 'connection' header value is close or http 1.0 without connection: keep-alive. */
-#define HTTP_CLI_RD_F_MORE_DATA_AVAIL	(((uint32_t)1) << 1) /* 'content-length' or 'transfer-encoding' set, data receiving not complete. */
-#define HTTP_CLI_RD_F_TE_CHUNK		(((uint32_t)1) << 2) /* 'host' header value is text/domain name. */
+#define HTTP_CLI_RD_F_TE_CHUNK		(((uint32_t)1) << 1) /* 'transfer-encoding: chunked' was decoded. */
+#define HTTP_CLI_RD_F_CONN_REUSED	(((uint32_t)1) << 2) /* Received over keep-alive connection from pool. */
+#define HTTP_CLI_RD_F_PIPELINED		(((uint32_t)1) << 3) /* Request was sent before previous responce received. */
+
+
+typedef struct http_client_stat_s { /* Sum for all threads. */
+	uint64_t	conns_created;
+	uint64_t	conns_reused;	/* Requests sent on idle keep-alive connections. */
+	uint64_t	conns_closed;
+	uint64_t	reqs;		/* Requests sent. */
+	uint64_t	reqs_pipelined;
+	uint64_t	reqs_retried;	/* Resent after keep-alive connection closed by server. */
+	uint64_t	reqs_failed;
+} http_cli_stat_t, *http_cli_stat_p;
 
 
 
 void	http_cli_def_settings(int add_os_ver, const char *app_ver, int add_lib_ver,
 	    http_cli_settings_p s_ret);
 
-int	http_cli_create(http_cli_cb ccb, http_cli_settings_p s,
-	    void *udata, http_cli_p *cli_ret);
+/* dns_rslvr - can be NULL if only IP addresses will be used as host. */
+int	http_cli_create(tp_p tp, dns_rslvr_p dns_rslvr,
+	    http_cli_settings_p s, http_cli_p *cli_ret);
+/* Call after tp_shutdown_wait() or from thread pool thread when no other
+ * threads use client: not completed requests callbacks called with
+ * ECANCELED. */
 void	http_cli_destroy(http_cli_p cli);
-int	http_cli_ccb_get(http_cli_p cli, http_cli_cb *ccb);
-int	http_cli_ccb_set(http_cli_p cli, http_cli_cb ccb);
-void *	http_cli_get_udata(http_cli_p cli);
-int	http_cli_set_udata(http_cli_p cli, void *udata);
-
-
-int	http_cli_conn_create(http_cli_p cli, thrpt_p thrpt,
-	    http_cli_cb ccb, void *udata, http_cli_conn_p *cli_conn);
-void	http_cli_conn_free(http_cli_conn_p cli_conn); /* Disconnect and free resources. */
-
-void	http_cli_conn_timeout_chk(http_cli_conn_p cli_conn);
-
-
-/* Set remonte hostname / addr to connect. */
-int	http_cli_conn_host_addr_set_str(http_cli_conn_p cli_conn,
-	    uint8_t *host_name, size_t host_name_size);
-int	http_cli_conn_host_addr_set_ss(http_cli_conn_p cli_conn,
-	    struct sockaddr_storage *addr);
-int	http_cli_conn_host_addr_set_ha(http_cli_conn_p cli_conn,
-	    host_addr_p haddr);
-
-/* Set connected to remonte host socket. */
-/* flags - io task flags: IO_TASK_F_CLOSE_ON_DESTROY */
-int	http_cli_conn_skt_set(http_cli_conn_p cli_conn, uint32_t flags,
-	    uintptr_t ident);
-io_task_p http_cli_conn_get_iotask(http_cli_conn_p cli_conn);
-io_task_p http_cli_conn_export_iotask(http_cli_conn_p cli_conn);
-int	http_cli_conn_io_task_set(http_cli_conn_p cli_conn, uint32_t flags,
-	    io_task_p iotask);
-
-
-int	http_cli_conn_req_head_set(http_cli_conn_p cli_conn, uint32_t req_p_flags,
-	    uint8_t *method, size_t method_size, uint32_t method_code,
-	    uint8_t *uri, size_t uri_size, uint32_t http_ver,
-	    uint64_t content_len, uint32_t transfer_encoding_code,
-	    struct iovec *custom_hdrs, size_t custom_hdrs_count);
-
-int	http_cli_conn_req_payload_set(http_cli_conn_p cli_conn,
-	    uint32_t req_p_flags, uint8_t *payload, size_t payload_size);
-
-int	http_cli_conn_req_send(http_cli_conn_p cli_conn);
-
-
-
-io_buf_p	http_cli_get_buf(http_cli_p cli);
-/* Responce buffer management. */
-int		http_cli_buf_reset(http_cli_p cli);
-int		http_cli_buf_realloc(http_cli_p cli, int allow_decrease,
-		    size_t new_size);
-
-
-uint32_t	http_cli_get_flags(http_cli_p cli);
-#define HTTP_CLI_CONN_F_HALF_CLOSED	(((uint32_t)1) << 0) /* Client call shutdown(, SHUT_WR) and can only receive data. */
-#define HTTP_CLI_CONN_F_AUTHORIZED	(((uint32_t)1) << 1) /* . */
-
-uint32_t	http_cli_get_resp_p_flags(http_cli_p cli);
-uint32_t	http_cli_add_resp_p_flags(http_cli_p cli, uint32_t resp_p_flags);
-uint32_t	http_cli_del_resp_p_flags(http_cli_p cli, uint32_t resp_p_flags);
-void		http_cli_set_resp_p_flags(http_cli_p cli, uint32_t resp_p_flags);
-
-
+int	http_cli_stat_get(http_cli_p cli, http_cli_stat_p stat);
+
+
+/* Per thread pool thread connections pool, keyed by host + port.
+ * tpt - thread that will own connection and call cb_func, NULL - current
+ * thread pool thread or tp_thread_get_rr().
+ * host - host name or IP addr, port after ':' override port arg. */
+int	http_cli_req_create(http_cli_p cli, tpt_p tpt,
+	    const uint8_t *host, size_t host_size, uint16_t port,
+	    http_cli_req_cb cb_func, void *udata, http_cli_req_p *req_ret);
+/* Can be called from cb_func. If request in progress cb_func will not be
+ * called. Must be called from request tpt. */
+void	http_cli_req_free(http_cli_req_p req);
+
+int	http_cli_req_head_set(http_cli_req_p req, uint32_t req_p_flags,
+	    const uint8_t *method, size_t method_size, uint32_t method_code,
+	    const uint8_t *uri, size_t uri_size,
+	    const struct iovec *custom_hdrs, size_t custom_hdrs_count);
+int	http_cli_req_payload_add(http_cli_req_p req,
+	    const uint8_t *payload, size_t payload_size);
+/* Can be called from any thread, if called not from request tpt then
+ * errors reported via cb_func. */
+int	http_cli_req_send(http_cli_req_p req);
+
+tpt_p	http_cli_req_tpt_get(http_cli_req_p req);
+void	*http_cli_req_udata_get(http_cli_req_p req);
+void	http_cli_req_udata_set(http_cli_req_p req, void *udata);
 
 
 #endif /* __CORE_HTTP_CLIENT_H__ */
@@ -35,7 +35,21 @@
 
 #include <sys/types.h>
 #include <inttypes.h>
+#ifdef __SSE2__
+#	include <emmintrin.h> /* SSE2 */
+#endif
+/*
+ * x86-64: AVX2 headers extract, selected at run time by cpuid and
+ * XGETBV, no -m flags required.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define MPEG2_TS_X86_AVX2	1
+#	include "al/cpu_features.h"
+#	include <immintrin.h> /* AVX2 */
+#	define MPEG2_TS_TARGET(__t)	__attribute__((__target__(__t)))
+#endif
 #include "utils/mem_utils.h"
+#include "math/crc32.h"
 
 
 /* 188, 192, 204, 208 bytes packets. */
@@ -1023,5 +1037,1084 @@ mpeg2_ts_serialize_data(const uint32_t pid, const uint8_t sc,
 
 
 
+/*
+ * Bulk demux: validate sync bytes and extract headers for batch of
+ * packets (SSE2/AVX2 with scalar fallback), group packets by PID and
+ * count continuity errors.
+ */
+
+#define MPEG2_TS_DMX_BATCH_MAX	512 /* Packets per mpeg2_ts_dmx_batch() call. */
+
+/* Packed header word: b0 | (b1 << 8) | (b2 << 16) | (b3 << 24). */
+#define MPEG2_TS_DMX_HDR_SB(__h)	((__h) & 0xff)
+#define MPEG2_TS_DMX_HDR_TE(__h)	(((__h) >> 15) & 0x01)
+#define MPEG2_TS_DMX_HDR_PUS(__h)	(((__h) >> 14) & 0x01)
+#define MPEG2_TS_DMX_HDR_TP(__h)	(((__h) >> 13) & 0x01)
+#define MPEG2_TS_DMX_HDR_PID(__h)	((((__h) & 0x1f00)) | (((__h) >> 16) & 0xff))
+#define MPEG2_TS_DMX_HDR_SC(__h)	(((__h) >> 30) & 0x03)
+#define MPEG2_TS_DMX_HDR_AFE(__h)	(((__h) >> 29) & 0x01)
+#define MPEG2_TS_DMX_HDR_CP(__h)	(((__h) >> 28) & 0x01)
+#define MPEG2_TS_DMX_HDR_CC(__h)	(((__h) >> 24) & MPEG2_TS_CC_MASK)
+
+typedef struct mpeg2_ts_dmx_pid_s {
+	uint64_t	pkts;		/* Packets count. */
+	uint32_t	cc_errs;	/* Continuity counter errors. */
+	uint32_t	batch;		/* Batch number of last packet. */
+	uint16_t	idx_off;	/* Last batch: offset in idx[]. */
+	uint16_t	idx_count;	/* Last batch: packets count. */
+	uint8_t		cc;		/* Last continuity counter. */
+	uint8_t		flags;		/* MPEG2_TS_DMX_PID_F_*. */
+} mpeg2_ts_dmx_pid_t, *mpeg2_ts_dmx_pid_p;
+
+#define MPEG2_TS_DMX_PID_F_CC	(((uint8_t)1) << 0) /* cc is valid. */
+
+typedef struct mpeg2_ts_dmx_s {
+	size_t		pkt_size;	/* 188, 192, 204, 208. */
+	uint64_t	pkts;		/* Valid packets count. */
+	uint64_t	sync_errs;	/* Sync lost count. */
+	uint64_t	te_pkts;	/* Packets with Transport Error Indicator. */
+	uint64_t	cc_errs;	/* Continuity counter errors. */
+	uint32_t	batch;		/* Batch number. */
+	int		use_avx2;	/* Set by init if CPU support, 0 - force SSE2/scalar. */
+	/* Last batch. */
+	size_t		pkts_count;
+	size_t		pids_count;
+	const uint8_t	*pkt[MPEG2_TS_DMX_BATCH_MAX];	/* Packets pointers. */
+	uint32_t	hdr[MPEG2_TS_DMX_BATCH_MAX];	/* Packed headers. */
+	uint16_t	pid[MPEG2_TS_DMX_BATCH_MAX];	/* Packets PIDs. */
+	uint16_t	pids[MPEG2_TS_DMX_BATCH_MAX];	/* PIDs in order of first packet. */
+	uint16_t	idx[MPEG2_TS_DMX_BATCH_MAX];	/* Packets indexes grouped by PID. */
+	mpeg2_ts_dmx_pid_t pid_tbl[MPEG2_TS_PID__COUNT__];
+} mpeg2_ts_dmx_t, *mpeg2_ts_dmx_p;
+
+/* Packet indexes list for PID from last batch. */
+#define MPEG2_TS_DMX_PID_IDX(__dmx, __pid)				\
+	(&(__dmx)->idx[(__dmx)->pid_tbl[(__pid)].idx_off])
+#define MPEG2_TS_DMX_PID_IDX_COUNT(__dmx, __pid)			\
+	(((__dmx)->batch == (__dmx)->pid_tbl[(__pid)].batch) ?		\
+	 (__dmx)->pid_tbl[(__pid)].idx_count : 0)
+
+
+#define MPEG2_TS_CPU_F_INIT	(((uint32_t)1) << 0)
+#define MPEG2_TS_CPU_F_AVX2	(((uint32_t)1) << 1) /* AVX2 + OS saves ymm. */
+
+/* Return MPEG2_TS_CPU_F_* supported by CPU and build. */
+static inline uint32_t
+mpeg2_ts_cpu_features_get(void) {
+	uint32_t ret = MPEG2_TS_CPU_F_INIT;
+
+#ifdef MPEG2_TS_X86_AVX2
+	if (0 != (CPU_F_AVX2 & cpu_features_get())) {
+		ret |= MPEG2_TS_CPU_F_AVX2;
+	}
+#endif
+
+	return (ret);
+}
+
+static inline int
+mpeg2_ts_dmx_init(mpeg2_ts_dmx_p dmx, const size_t pkt_size) {
+
+	if (NULL == dmx ||
+	    (MPEG2_TS_PKT_SIZE_188 != pkt_size &&
+	     MPEG2_TS_PKT_SIZE_192 != pkt_size &&
+	     MPEG2_TS_PKT_SIZE_204 != pkt_size &&
+	     MPEG2_TS_PKT_SIZE_208 != pkt_size))
+		return (EINVAL);
+	memset(dmx, 0x00, sizeof(mpeg2_ts_dmx_t));
+	dmx->pkt_size = pkt_size;
+	dmx->use_avx2 = (0 != (MPEG2_TS_CPU_F_AVX2 & mpeg2_ts_cpu_features_get()));
+
+	return (0);
+}
+
+static inline uint32_t
+mpeg2_ts_dmx_hdr_load(const uint8_t *pkt) {
+
+	return (((uint32_t)pkt[0]) | (((uint32_t)pkt[1]) << 8) |
+	    (((uint32_t)pkt[2]) << 16) | (((uint32_t)pkt[3]) << 24));
+}
+
+/* Return count of leading packets with valid sync byte,
+ * hdr and pid filled for them. */
+static inline size_t
+mpeg2_ts_dmx_hdrs_extract_generic(const uint8_t *buf, const size_t pkt_size,
+    const size_t count, uint32_t *hdr, uint16_t *pid) {
+	register size_t i;
+	register uint32_t h;
+
+	for (i = 0; i < count; i ++) {
+		h = mpeg2_ts_dmx_hdr_load(&buf[(i * pkt_size)]);
+		if (MPEG2_TS_SB != MPEG2_TS_DMX_HDR_SB(h))
+			return (i);
+		hdr[i] = h;
+		pid[i] = (uint16_t)MPEG2_TS_DMX_HDR_PID(h);
+	}
+
+	return (count);
+}
+
+#if defined(__SSE2__) && BYTE_ORDER == LITTLE_ENDIAN
+static inline size_t
+mpeg2_ts_dmx_hdrs_extract_sse2(const uint8_t *buf, const size_t pkt_size,
+    const size_t count, uint32_t *hdr, uint16_t *pid) {
+	register size_t i;
+	uint32_t h[4];
+	int mask;
+	const __m128i sb = _mm_set1_epi32(MPEG2_TS_SB);
+	const __m128i m_ff = _mm_set1_epi32(0xff);
+	const __m128i m_pid_hi = _mm_set1_epi32(0x1f00);
+	__m128i v, vpid;
+
+	for (i = 0; (i + 4) <= count; i += 4) {
+		memcpy(&h[0], &buf[((i + 0) * pkt_size)], sizeof(uint32_t));
+		memcpy(&h[1], &buf[((i + 1) * pkt_size)], sizeof(uint32_t));
+		memcpy(&h[2], &buf[((i + 2) * pkt_size)], sizeof(uint32_t));
+		memcpy(&h[3], &buf[((i + 3) * pkt_size)], sizeof(uint32_t));
+		v = _mm_loadu_si128((const __m128i*)(void*)h);
+		mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+		    _mm_and_si128(v, m_ff), sb)));
+		if (0x0f != mask) /* Sync lost in this group. */
+			break;
+		_mm_storeu_si128((__m128i*)(void*)&hdr[i], v);
+		vpid = _mm_or_si128(_mm_and_si128(v, m_pid_hi),
+		    _mm_and_si128(_mm_srli_epi32(v, 16), m_ff));
+		/* PID < 0x8000: signed saturation keep value. */
+		_mm_storel_epi64((__m128i*)(void*)&pid[i],
+		    _mm_packs_epi32(vpid, vpid));
+	}
+
+	return (i + mpeg2_ts_dmx_hdrs_extract_generic(&buf[(i * pkt_size)],
+	    pkt_size, (count - i), &hdr[i], &pid[i]));
+}
+#endif
+
+#if defined(MPEG2_TS_X86_AVX2) && BYTE_ORDER == LITTLE_ENDIAN
+MPEG2_TS_TARGET("avx2")
+static inline size_t
+mpeg2_ts_dmx_hdrs_extract_avx2(const uint8_t *buf, const size_t pkt_size,
+    const size_t count, uint32_t *hdr, uint16_t *pid) {
+	register size_t i;
+	int mask;
+	const __m256i sb = _mm256_set1_epi32(MPEG2_TS_SB);
+	const __m256i m_ff = _mm256_set1_epi32(0xff);
+	const __m256i m_pid_hi = _mm256_set1_epi32(0x1f00);
+	const __m256i vidx = _mm256_mullo_epi32(_mm256_set1_epi32((int)pkt_size),
+	    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	__m256i v, vpid;
+
+	for (i = 0; (i + 8) <= count; i += 8) {
+		v = _mm256_i32gather_epi32((const int*)(const void*)&buf[(i * pkt_size)],
+		    vidx, 1);
+		mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+		    _mm256_and_si256(v, m_ff), sb)));
+		if (0xff != mask) /* Sync lost in this group. */
+			break;
+		_mm256_storeu_si256((__m256i*)(void*)&hdr[i], v);
+		vpid = _mm256_or_si256(_mm256_and_si256(v, m_pid_hi),
+		    _mm256_and_si256(_mm256_srli_epi32(v, 16), m_ff));
+		/* PID < 0x8000: signed saturation keep value. */
+		_mm_storeu_si128((__m128i*)(void*)&pid[i],
+		    _mm_packs_epi32(_mm256_castsi256_si128(vpid),
+		    _mm256_extracti128_si256(vpid, 1)));
+	}
+
+	return (i + mpeg2_ts_dmx_hdrs_extract_generic(&buf[(i * pkt_size)],
+	    pkt_size, (count - i), &hdr[i], &pid[i]));
+}
+#endif
+
+static inline size_t
+mpeg2_ts_dmx_hdrs_extract(mpeg2_ts_dmx_p dmx, const uint8_t *buf,
+    const size_t count, uint32_t *hdr, uint16_t *pid) {
+
+#if defined(MPEG2_TS_X86_AVX2) && BYTE_ORDER == LITTLE_ENDIAN
+	if (0 != dmx->use_avx2)
+		return (mpeg2_ts_dmx_hdrs_extract_avx2(buf, dmx->pkt_size,
+		    count, hdr, pid));
+#endif
+#if defined(__SSE2__) && BYTE_ORDER == LITTLE_ENDIAN
+	return (mpeg2_ts_dmx_hdrs_extract_sse2(buf, dmx->pkt_size, count,
+	    hdr, pid));
+#else
+	return (mpeg2_ts_dmx_hdrs_extract_generic(buf, dmx->pkt_size, count,
+	    hdr, pid));
+#endif
+}
+
+/* Group packets of batch by PID and check continuity counters. */
+static inline void
+mpeg2_ts_dmx_batch_index(mpeg2_ts_dmx_p dmx) {
+	register size_t i;
+	size_t off;
+	uint32_t h;
+	uint8_t cc_exp;
+	const uint8_t *pkt;
+	mpeg2_ts_dmx_pid_p pid_e;
+
+	dmx->batch ++;
+	if (0 == dmx->batch) { /* Wrap: reset batch marks. */
+		for (i = 0; i < MPEG2_TS_PID__COUNT__; i ++) {
+			dmx->pid_tbl[i].batch = 0;
+		}
+		dmx->batch ++;
+	}
+	/* Count packets per PID. */
+	dmx->pids_count = 0;
+	for (i = 0; i < dmx->pkts_count; i ++) {
+		pid_e = &dmx->pid_tbl[dmx->pid[i]];
+		if (dmx->batch != pid_e->batch) {
+			pid_e->batch = dmx->batch;
+			pid_e->idx_count = 0;
+			dmx->pids[dmx->pids_count ++] = dmx->pid[i];
+		}
+		pid_e->idx_count ++;
+	}
+	for (i = 0, off = 0; i < dmx->pids_count; i ++) {
+		pid_e = &dmx->pid_tbl[dmx->pids[i]];
+		pid_e->idx_off = (uint16_t)off;
+		off += pid_e->idx_count;
+		pid_e->idx_count = 0;
+	}
+	/* Fill indexes and check continuity in stream order. */
+	for (i = 0; i < dmx->pkts_count; i ++) {
+		h = dmx->hdr[i];
+		pid_e = &dmx->pid_tbl[dmx->pid[i]];
+		dmx->idx[(pid_e->idx_off + pid_e->idx_count)] = (uint16_t)i;
+		pid_e->idx_count ++;
+		pid_e->pkts ++;
+		if (0 != MPEG2_TS_DMX_HDR_TE(h)) {
+			dmx->te_pkts ++;
+			continue; /* Header can not be trusted. */
+		}
+		if (MPEG2_TS_PID_NULL == dmx->pid[i])
+			continue;
+		if (0 != (MPEG2_TS_DMX_PID_F_CC & pid_e->flags)) {
+			/* No payload: cc not incremented; duplicate allowed. */
+			cc_exp = ((0 != MPEG2_TS_DMX_HDR_CP(h)) ?
+			    MPEG2_TS_CC_GET_NEXT(pid_e->cc) : pid_e->cc);
+			if (cc_exp != MPEG2_TS_DMX_HDR_CC(h) &&
+			    pid_e->cc != MPEG2_TS_DMX_HDR_CC(h)) {
+				pkt = dmx->pkt[i];
+				if (0 == MPEG2_TS_DMX_HDR_AFE(h) ||
+				    0 == pkt[4] ||
+				    0 == (pkt[5] & 0x80)) { /* Not discontinuity indicator. */
+					pid_e->cc_errs ++;
+					dmx->cc_errs ++;
+				}
+			}
+		}
+		pid_e->cc = (uint8_t)MPEG2_TS_DMX_HDR_CC(h);
+		pid_e->flags |= MPEG2_TS_DMX_PID_F_CC;
+	}
+	dmx->pkts += dmx->pkts_count;
+}
+
+/* Demux up to MPEG2_TS_DMX_BATCH_MAX packets from buf.
+ * Return packets count in batch, processed_ret - processed data size,
+ * tail that smaller than packet not processed.
+ * On sync lost skip data to next valid packet. */
+static inline size_t
+mpeg2_ts_dmx_batch(mpeg2_ts_dmx_p dmx, const uint8_t *buf,
+    const size_t buf_size, size_t *processed_ret) {
+	size_t i, off = 0, cnt = 0, n, valid;
+	uint8_t *pkt;
+
+	if (NULL == dmx || NULL == buf) {
+		if (NULL != processed_ret) {
+			(*processed_ret) = 0;
+		}
+		return (0);
+	}
+	while (MPEG2_TS_DMX_BATCH_MAX > cnt &&
+	    dmx->pkt_size <= (buf_size - off)) {
+		n = MIN(((buf_size - off) / dmx->pkt_size),
+		    (MPEG2_TS_DMX_BATCH_MAX - cnt));
+		valid = mpeg2_ts_dmx_hdrs_extract(dmx, &buf[off], n,
+		    &dmx->hdr[cnt], &dmx->pid[cnt]);
+		for (i = 0; i < valid; i ++) {
+			dmx->pkt[(cnt + i)] = &buf[(off + (i * dmx->pkt_size))];
+		}
+		cnt += valid;
+		off += (valid * dmx->pkt_size);
+		if (valid == n)
+			continue;
+		/* Sync lost: find next packet. */
+		dmx->sync_errs ++;
+		if (0 == mpeg2_ts_pkt_get_next(buf, buf_size, (off + 1),
+		    dmx->pkt_size, &pkt)) {
+			/* Keep possible packet start at buf end. */
+			off = MAX((off + 1), (buf_size - MIN(buf_size,
+			    (dmx->pkt_size - 1))));
+			break;
+		}
+		off = (size_t)(pkt - buf);
+	}
+	dmx->pkts_count = cnt;
+	mpeg2_ts_dmx_batch_index(dmx);
+	if (NULL != processed_ret) {
+		(*processed_ret) = off;
+	}
+
+	return (cnt);
+}
+
+
+
+/*
+ * PSI tracker: reassemble sections from TS packets, verify CRC32, keep
+ * decoded PAT/PMT/SDT tables per (PID, table_id, table_id_extension)
+ * and notify on new version.
+ * PMT PIDs tracked from PAT, untracked with cached tables when program
+ * removed from PAT.
+ * Sections equal to already stored (same version, section number and
+ * CRC32 field) skipped without CRC calculation.
+ */
+
+#define MPEG2_PSI_SEC_HDR_SIZE	3 /* table_id + section_length. */
+#define MPEG2_PSI_SEC_SNTX_MIN	(MPEG2_PSI_SEC_HDR_SIZE + 5 + 4) /* + syntax + CRC32. */
+#define MPEG2_PSI_SEC_COUNT_MAX	256
+
+typedef struct mpeg2_psi_pat_prog_s { /* Decoded PAT item. */
+	uint16_t	pn;	/* Program number, 0 - NIT. */
+	uint16_t	pid;	/* PMT PID / NIT PID. */
+} mpeg2_psi_pat_prog_t, *mpeg2_psi_pat_prog_p;
+
+typedef struct mpeg2_psi_pmt_es_s { /* Decoded PMT item. */
+	uint8_t		s_type;	/* Stream type. */
+	uint16_t	pid;	/* Elementary PID. */
+	uint16_t	descrs_size;
+	const uint8_t	*descrs; /* ES descriptors, points to section data. */
+} mpeg2_psi_pmt_es_t, *mpeg2_psi_pmt_es_p;
+
+typedef struct mpeg2_psi_sdt_srv_s { /* Decoded SDT item. */
+	uint16_t	sid;	/* Service ID. */
+	uint8_t		eit_shed;
+	uint8_t		eit_pf;
+	uint8_t		rstatus;
+	uint8_t		free_ca;
+	uint16_t	descrs_size;
+	const uint8_t	*descrs; /* Service descriptors, points to section data. */
+} mpeg2_psi_sdt_srv_t, *mpeg2_psi_sdt_srv_p;
+
+typedef struct mpeg2_psi_tbl_s {
+	uint16_t	pid;
+	uint8_t		tid;	/* Table ID. */
+	uint8_t		ver;	/* Version number. */
+	uint16_t	tid_ext; /* Table ID extension: TSID / program number / ... */
+	uint8_t		lsn;	/* Last section number. */
+	size_t		secs_count; /* Received sections. */
+	uint64_t	sec_bmp[(MPEG2_PSI_SEC_COUNT_MAX / 64)];
+	uint8_t		*sec[MPEG2_PSI_SEC_COUNT_MAX]; /* Sections: from table_id to CRC32. */
+	uint16_t	sec_size[MPEG2_PSI_SEC_COUNT_MAX];
+	uint32_t	sec_crc[MPEG2_PSI_SEC_COUNT_MAX]; /* CRC32 field value. */
+	/* Decoded data. */
+	uint16_t	pcr_pid; /* PMT. */
+	uint16_t	onid;	/* SDT: original_network_id. */
+	size_t		items_count;
+	union {
+		void			*ptr;
+		mpeg2_psi_pat_prog_p	prog;	/* PAT. */
+		mpeg2_psi_pmt_es_p	es;	/* PMT. */
+		mpeg2_psi_sdt_srv_p	srv;	/* SDT. */
+	} items;
+} mpeg2_psi_tbl_t, *mpeg2_psi_tbl_p;
+
+#define MPEG2_PSI_TBL_SEC_IS_SET(__tbl, __sn)				\
+	(0 != ((__tbl)->sec_bmp[((__sn) / 64)] & (((uint64_t)1) << ((__sn) % 64))))
+#define MPEG2_PSI_TBL_SEC_SET(__tbl, __sn)				\
+	(__tbl)->sec_bmp[((__sn) / 64)] |= (((uint64_t)1) << ((__sn) % 64))
+
+typedef struct mpeg2_psi_tbl_e_s { /* Cache entry. */
+	uint16_t	pid;	/* Key: pid, tid, tid_ext. */
+	uint8_t		tid;
+	uint16_t	tid_ext;
+	mpeg2_psi_tbl_p	cur;	/* Last complete table, reported to cb. */
+	mpeg2_psi_tbl_p	nxt;	/* Table in assembling. */
+} mpeg2_psi_tbl_e_t, *mpeg2_psi_tbl_e_p;
+
+typedef struct mpeg2_psi_pid_s { /* Per PID reassembly state. */
+	size_t		size;	/* Data in buf. */
+	size_t		need;	/* Full section size, 0 - unknown yet. */
+	uint8_t		cc;
+	uint8_t		flags;	/* MPEG2_PSI_PID_F_*. */
+	uint8_t		buf[(MPEG2_PSI_SEC_HDR_SIZE + MPEG2_PSI_SEC_LEN_PRIV_MAX)];
+} mpeg2_psi_pid_t, *mpeg2_psi_pid_p;
+
+#define MPEG2_PSI_PID_F_CC	(((uint8_t)1) << 0) /* cc is valid. */
+#define MPEG2_PSI_PID_F_SEC	(((uint8_t)1) << 1) /* Section in progress. */
+
+typedef struct mpeg2_psi_trk_s	*mpeg2_psi_trk_p;
+
+/* Called then all sections of new table version received and decoded. */
+typedef void (*mpeg2_psi_trk_cb)(mpeg2_psi_trk_p trk, mpeg2_psi_tbl_p tbl,
+    void *udata);
+
+typedef struct mpeg2_psi_trk_s {
+	uint32_t	flags;	/* MPEG2_PSI_TRK_F_*. */
+	mpeg2_psi_trk_cb cb;
+	void		*udata;
+	/* Stat. */
+	uint64_t	secs;		/* Sections received. */
+	uint64_t	secs_skipped;	/* Unchanged sections skipped. */
+	uint64_t	crc_errs;
+	uint64_t	sec_errs;	/* Bad sections / decode errors. */
+	uint64_t	cc_errs;	/* Sections dropped due to discontinuity. */
+	uint64_t	updates;	/* Tables updates (cb calls). */
+	/* Tables cache. */
+	size_t		tbls_count;
+	size_t		tbls_allocated;
+	mpeg2_psi_tbl_e_p tbls;
+	mpeg2_psi_pid_p	pid[MPEG2_TS_PID__COUNT__];
+} mpeg2_psi_trk_t;
+
+#define MPEG2_PSI_TRK_F_PAT	(((uint32_t)1) << 0) /* Track PAT PID. */
+#define MPEG2_PSI_TRK_F_PMT	(((uint32_t)1) << 1) /* Track PMT PIDs from PAT. */
+#define MPEG2_PSI_TRK_F_SDT	(((uint32_t)1) << 2) /* Track SDT PID. */
+#define MPEG2_PSI_TRK_F_DEFAULT	(MPEG2_PSI_TRK_F_PAT | MPEG2_PSI_TRK_F_PMT | MPEG2_PSI_TRK_F_SDT)
+
+#define MPEG2_PSI_TRK_TBLS_ALLOC_STEP	16
+
+
+static inline uint16_t
+mpeg2_psi_be16(const uint8_t *buf) {
+
+	return ((uint16_t)((((uint16_t)buf[0]) << 8) | buf[1]));
+}
+
+static inline uint32_t
+mpeg2_psi_be32(const uint8_t *buf) {
+
+	return ((((uint32_t)buf[0]) << 24) | (((uint32_t)buf[1]) << 16) |
+	    (((uint32_t)buf[2]) << 8) | ((uint32_t)buf[3]));
+}
+
+
+static inline void
+mpeg2_psi_tbl_free(mpeg2_psi_tbl_p tbl) {
+	size_t i;
+
+	if (NULL == tbl)
+		return;
+	for (i = 0; i < MPEG2_PSI_SEC_COUNT_MAX; i ++) {
+		free(tbl->sec[i]);
+	}
+	free(tbl->items.ptr);
+	free(tbl);
+}
+
+static inline int
+mpeg2_psi_tbl_is_complete(const mpeg2_psi_tbl_t *tbl) {
+
+	return (((size_t)tbl->lsn + 1) == tbl->secs_count);
+}
+
+/* Return pointer to section payload: after syntax and before CRC32. */
+static inline const uint8_t *
+mpeg2_psi_tbl_sec_data(const mpeg2_psi_tbl_t *tbl, const size_t sn,
+    const size_t sntx_size, size_t *size_ret) {
+
+	if (MPEG2_PSI_SEC_COUNT_MAX <= sn ||
+	    NULL == tbl->sec[sn] ||
+	    (MPEG2_PSI_SEC_HDR_SIZE + sntx_size + 4) > tbl->sec_size[sn])
+		return (NULL);
+	(*size_ret) = (tbl->sec_size[sn] - (MPEG2_PSI_SEC_HDR_SIZE + sntx_size + 4));
+
+	return (tbl->sec[sn] + MPEG2_PSI_SEC_HDR_SIZE + sntx_size);
+}
+
+/* Count items for all sections and allocate items array. */
+static inline int
+mpeg2_psi_tbl_items_alloc(mpeg2_psi_tbl_p tbl, const size_t count,
+    const size_t item_size) {
+
+	tbl->items_count = 0;
+	if (0 == count)
+		return (0);
+	tbl->items.ptr = calloc(count, item_size);
+	if (NULL == tbl->items.ptr)
+		return (ENOMEM);
+	return (0);
+}
+
+static inline int
+mpeg2_psi_tbl_pat_decode(mpeg2_psi_tbl_p tbl) {
+	size_t sn, i, size, count = 0;
+	const uint8_t *data;
+	int error;
+
+	for (sn = 0; sn <= tbl->lsn; sn ++) {
+		data = mpeg2_psi_tbl_sec_data(tbl, sn,
+		    sizeof(mpeg2_psi_pat_sntx_t), &size);
+		if (NULL == data || 0 != (size % sizeof(mpeg2_psi_pat_sec_t)))
+			return (EBADMSG);
+		count += (size / sizeof(mpeg2_psi_pat_sec_t));
+	}
+	error = mpeg2_psi_tbl_items_alloc(tbl, count, sizeof(mpeg2_psi_pat_prog_t));
+	if (0 != error)
+		return (error);
+	for (sn = 0; sn <= tbl->lsn; sn ++) {
+		data = mpeg2_psi_tbl_sec_data(tbl, sn,
+		    sizeof(mpeg2_psi_pat_sntx_t), &size);
+		for (i = 0; i < size; i += sizeof(mpeg2_psi_pat_sec_t)) {
+			tbl->items.prog[tbl->items_count].pn =
+			    mpeg2_psi_be16(&data[i]);
+			tbl->items.prog[tbl->items_count].pid =
+			    (mpeg2_psi_be16(&data[(i + 2)]) & 0x1fff);
+			tbl->items_count ++;
+		}
+	}
+
+	return (0);
+}
+
+static inline int
+mpeg2_psi_tbl_pmt_decode(mpeg2_psi_tbl_p tbl) {
+	size_t sn, i, size, dsize, count = 0;
+	const uint8_t *data;
+	int error;
+
+	/* PMT have one section per program. */
+	for (sn = 0; sn <= tbl->lsn; sn ++) {
+		data = mpeg2_psi_tbl_sec_data(tbl, sn,
+		    sizeof(mpeg2_psi_tbl_sntx_t), &size);
+		if (NULL == data || 4 > size)
+			return (EBADMSG);
+		tbl->pcr_pid = (mpeg2_psi_be16(data) & 0x1fff);
+		dsize = (mpeg2_psi_be16(&data[2]) & 0x0fff);
+		for (i = (4 + dsize); i < size;) {
+			if ((i + sizeof(mpeg2_psi_pmt_sec_t)) > size)
+				return (EBADMSG);
+			i += (sizeof(mpeg2_psi_pmt_sec_t) +
+			    (mpeg2_psi_be16(&data[(i + 3)]) & 0x0fff));
+			count ++;
+		}
+		if (i != size)
+			return (EBADMSG);
+	}
+	error = mpeg2_psi_tbl_items_alloc(tbl, count, sizeof(mpeg2_psi_pmt_es_t));
+	if (0 != error)
+		return (error);
+	for (sn = 0; sn <= tbl->lsn; sn ++) {
+		data = mpeg2_psi_tbl_sec_data(tbl, sn,
+		    sizeof(mpeg2_psi_tbl_sntx_t), &size);
+		dsize = (mpeg2_psi_be16(&data[2]) & 0x0fff);
+		for (i = (4 + dsize); i < size;) {
+			tbl->items.es[tbl->items_count].s_type = data[i];
+			tbl->items.es[tbl->items_count].pid =
+			    (mpeg2_psi_be16(&data[(i + 1)]) & 0x1fff);
+			dsize = (mpeg2_psi_be16(&data[(i + 3)]) & 0x0fff);
+			i += sizeof(mpeg2_psi_pmt_sec_t);
+			tbl->items.es[tbl->items_count].descrs_size = (uint16_t)dsize;
+			tbl->items.es[tbl->items_count].descrs = &data[i];
+			i += dsize;
+			tbl->items_count ++;
+		}
+	}
+
+	return (0);
+}
+
+static inline int
+mpeg2_psi_tbl_sdt_decode(mpeg2_psi_tbl_p tbl) {
+	size_t sn, i, size, dsize, count = 0;
+	const uint8_t *data;
+	int error;
+
+	for (sn = 0; sn <= tbl->lsn; sn ++) {
+		data = mpeg2_psi_tbl_sec_data(tbl, sn,
+		    sizeof(mpeg2_psi_sdt_sntx_t), &size);
+		if (NULL == data)
+			return (EBADMSG);
+		for (i = 0; i < size;) {
+			if ((i + sizeof(mpeg2_psi_sdt_sec_t)) > size)
+				return (EBADMSG);
+			i += (sizeof(mpeg2_psi_sdt_sec_t) +
+			    (mpeg2_psi_be16(&data[(i + 3)]) & 0x0fff));
+			count ++;
+		}
+		if (i != size)
+			return (EBADMSG);
+	}
+	tbl->onid = mpeg2_psi_be16(&tbl->sec[0][(MPEG2_PSI_SEC_HDR_SIZE + 5)]);
+	error = mpeg2_psi_tbl_items_alloc(tbl, count, sizeof(mpeg2_psi_sdt_srv_t));
+	if (0 != error)
+		return (error);
+	for (sn = 0; sn <= tbl->lsn; sn ++) {
+		data = mpeg2_psi_tbl_sec_data(tbl, sn,
+		    sizeof(mpeg2_psi_sdt_sntx_t), &size);
+		for (i = 0; i < size;) {
+			tbl->items.srv[tbl->items_count].sid = mpeg2_psi_be16(&data[i]);
+			tbl->items.srv[tbl->items_count].eit_shed = ((data[(i + 2)] >> 1) & 0x01);
+			tbl->items.srv[tbl->items_count].eit_pf = (data[(i + 2)] & 0x01);
+			tbl->items.srv[tbl->items_count].rstatus = ((data[(i + 3)] >> 5) & 0x07);
+			tbl->items.srv[tbl->items_count].free_ca = ((data[(i + 3)] >> 4) & 0x01);
+			dsize = (mpeg2_psi_be16(&data[(i + 3)]) & 0x0fff);
+			i += sizeof(mpeg2_psi_sdt_sec_t);
+			tbl->items.srv[tbl->items_count].descrs_size = (uint16_t)dsize;
+			tbl->items.srv[tbl->items_count].descrs = &data[i];
+			i += dsize;
+			tbl->items_count ++;
+		}
+	}
+
+	return (0);
+}
+
+static inline int
+mpeg2_psi_tbl_decode(mpeg2_psi_tbl_p tbl) {
+
+	switch (tbl->tid) {
+	case MPEG2_PSI_TID_PAT:
+		return (mpeg2_psi_tbl_pat_decode(tbl));
+	case MPEG2_PSI_TID_PMT:
+		return (mpeg2_psi_tbl_pmt_decode(tbl));
+	case MPEG2_PSI_TID_SDT:
+	case MPEG2_PSI_TID_SDT_OTH:
+		return (mpeg2_psi_tbl_sdt_decode(tbl));
+	}
+	/* Other tables: sections only. */
+	return (0);
+}
+
+
+static inline int
+mpeg2_psi_trk_pid_add(mpeg2_psi_trk_p trk, const uint16_t pid) {
+
+	if (NULL == trk || MPEG2_TS_PID_NULL <= pid)
+		return (EINVAL);
+	if (NULL != trk->pid[pid])
+		return (0);
+	trk->pid[pid] = malloc(sizeof(mpeg2_psi_pid_t));
+	if (NULL == trk->pid[pid])
+		return (ENOMEM);
+	trk->pid[pid]->size = 0;
+	trk->pid[pid]->need = 0;
+	trk->pid[pid]->flags = 0;
+
+	return (0);
+}
+
+static inline void
+mpeg2_psi_trk_pid_del(mpeg2_psi_trk_p trk, const uint16_t pid) {
+
+	if (NULL == trk || MPEG2_TS_PID__COUNT__ <= pid)
+		return;
+	free(trk->pid[pid]);
+	trk->pid[pid] = NULL;
+}
+
+static inline int
+mpeg2_psi_trk_create(const uint32_t flags, mpeg2_psi_trk_cb cb, void *udata,
+    mpeg2_psi_trk_p *trk_ret) {
+	int error = 0;
+	mpeg2_psi_trk_p trk;
+
+	if (NULL == trk_ret)
+		return (EINVAL);
+	trk = calloc(1, sizeof(mpeg2_psi_trk_t));
+	if (NULL == trk)
+		return (ENOMEM);
+	trk->flags = flags;
+	trk->cb = cb;
+	trk->udata = udata;
+	if (0 != (MPEG2_PSI_TRK_F_PAT & flags)) {
+		error = mpeg2_psi_trk_pid_add(trk, MPEG2_TS_PID_PAT);
+	}
+	if (0 == error &&
+	    0 != (MPEG2_PSI_TRK_F_SDT & flags)) {
+		error = mpeg2_psi_trk_pid_add(trk, MPEG2_TS_PID_SDT);
+	}
+	if (0 != error) {
+		free(trk->pid[MPEG2_TS_PID_PAT]);
+		free(trk);
+		return (error);
+	}
+	(*trk_ret) = trk;
+
+	return (0);
+}
+
+static inline void
+mpeg2_psi_trk_destroy(mpeg2_psi_trk_p trk) {
+	size_t i;
+
+	if (NULL == trk)
+		return;
+	for (i = 0; i < trk->tbls_count; i ++) {
+		mpeg2_psi_tbl_free(trk->tbls[i].cur);
+		mpeg2_psi_tbl_free(trk->tbls[i].nxt);
+	}
+	free(trk->tbls);
+	for (i = 0; i < MPEG2_TS_PID__COUNT__; i ++) {
+		free(trk->pid[i]);
+	}
+	free(trk);
+}
+
+/* Entry found by key even if it have no tables: failed decode or
+ * allocation must not add new entry on every repeated section. */
+static inline mpeg2_psi_tbl_e_p
+mpeg2_psi_trk_tbl_e_find(mpeg2_psi_trk_p trk, const uint16_t pid,
+    const uint8_t tid, const uint16_t tid_ext) {
+	size_t i;
+
+	for (i = 0; i < trk->tbls_count; i ++) {
+		if (pid != trk->tbls[i].pid ||
+		    tid != trk->tbls[i].tid ||
+		    tid_ext != trk->tbls[i].tid_ext)
+			continue;
+		return (&trk->tbls[i]);
+	}
+	return (NULL);
+}
+
+/* Return last complete table version or NULL. */
+static inline mpeg2_psi_tbl_p
+mpeg2_psi_trk_tbl_get(mpeg2_psi_trk_p trk, const uint16_t pid,
+    const uint8_t tid, const uint16_t tid_ext) {
+	mpeg2_psi_tbl_e_p tbl_e;
+
+	if (NULL == trk)
+		return (NULL);
+	tbl_e = mpeg2_psi_trk_tbl_e_find(trk, pid, tid, tid_ext);
+	if (NULL == tbl_e)
+		return (NULL);
+	return (tbl_e->cur);
+}
+
+static inline mpeg2_psi_tbl_e_p
+mpeg2_psi_trk_tbl_e_add(mpeg2_psi_trk_p trk, const uint16_t pid,
+    const uint8_t tid, const uint16_t tid_ext) {
+	mpeg2_psi_tbl_e_p tbls_new;
+
+	if (trk->tbls_count == trk->tbls_allocated) {
+		tbls_new = reallocarray(trk->tbls,
+		    (trk->tbls_allocated + MPEG2_PSI_TRK_TBLS_ALLOC_STEP),
+		    sizeof(mpeg2_psi_tbl_e_t));
+		if (NULL == tbls_new)
+			return (NULL);
+		trk->tbls = tbls_new;
+		trk->tbls_allocated += MPEG2_PSI_TRK_TBLS_ALLOC_STEP;
+	}
+	trk->tbls[trk->tbls_count].pid = pid;
+	trk->tbls[trk->tbls_count].tid = tid;
+	trk->tbls[trk->tbls_count].tid_ext = tid_ext;
+	trk->tbls[trk->tbls_count].cur = NULL;
+	trk->tbls[trk->tbls_count].nxt = NULL;
+
+	return (&trk->tbls[trk->tbls_count ++]);
+}
+
+/* Free entry tables and remove it: last entry moved to its place,
+ * pointers to other entries may become invalid. */
+static inline void
+mpeg2_psi_trk_tbl_e_del(mpeg2_psi_trk_p trk, mpeg2_psi_tbl_e_p tbl_e) {
+
+	mpeg2_psi_tbl_free(tbl_e->cur);
+	mpeg2_psi_tbl_free(tbl_e->nxt);
+	trk->tbls_count --;
+	if (tbl_e != &trk->tbls[trk->tbls_count]) {
+		(*tbl_e) = trk->tbls[trk->tbls_count];
+	}
+}
+
+/* Stop tracking PID and drop its cached tables. */
+static inline void
+mpeg2_psi_trk_pid_untrack(mpeg2_psi_trk_p trk, const uint16_t pid) {
+	size_t i;
+
+	mpeg2_psi_trk_pid_del(trk, pid);
+	for (i = 0; i < trk->tbls_count;) {
+		if (pid != trk->tbls[i].pid) {
+			i ++;
+			continue;
+		}
+		mpeg2_psi_trk_tbl_e_del(trk, &trk->tbls[i]);
+	}
+}
+
+static inline int
+mpeg2_psi_tbl_pat_pid_is_set(const mpeg2_psi_tbl_t *tbl, const uint16_t pid) {
+	size_t i;
+
+	for (i = 0; i < tbl->items_count; i ++) {
+		if (0 != tbl->items.prog[i].pn &&
+		    pid == tbl->items.prog[i].pid)
+			return (1);
+	}
+	return (0);
+}
+
+/* tbl_e may be invalid after return. */
+static inline void
+mpeg2_psi_trk_tbl_update(mpeg2_psi_trk_p trk, mpeg2_psi_tbl_e_p tbl_e) {
+	size_t i;
+	uint16_t pid;
+	mpeg2_psi_tbl_p tbl = tbl_e->nxt, tbl_old;
+
+	tbl_e->nxt = NULL;
+	if (0 != mpeg2_psi_tbl_decode(tbl)) {
+		trk->sec_errs ++;
+		mpeg2_psi_tbl_free(tbl);
+		return;
+	}
+	tbl_old = tbl_e->cur;
+	tbl_e->cur = tbl;
+	trk->updates ++;
+	if (MPEG2_PSI_TID_PAT == tbl->tid &&
+	    0 != (MPEG2_PSI_TRK_F_PMT & trk->flags)) {
+		for (i = 0; i < tbl->items_count; i ++) {
+			if (0 == tbl->items.prog[i].pn)
+				continue; /* NIT. */
+			mpeg2_psi_trk_pid_add(trk, tbl->items.prog[i].pid);
+		}
+		/* Programs removed from PAT: untrack PMT PIDs. */
+		for (i = 0; NULL != tbl_old && i < tbl_old->items_count; i ++) {
+			pid = tbl_old->items.prog[i].pid;
+			if (0 == tbl_old->items.prog[i].pn ||
+			    MPEG2_TS_PID_PAT == pid ||
+			    (MPEG2_TS_PID_SDT == pid &&
+			     0 != (MPEG2_PSI_TRK_F_SDT & trk->flags)) ||
+			    0 != mpeg2_psi_tbl_pat_pid_is_set(tbl, pid))
+				continue;
+			mpeg2_psi_trk_pid_untrack(trk, pid);
+		}
+	}
+	mpeg2_psi_tbl_free(tbl_old);
+	if (NULL != trk->cb) {
+		trk->cb(trk, tbl, trk->udata);
+	}
+}
+
+static inline void
+mpeg2_psi_trk_sec_handle(mpeg2_psi_trk_p trk, const uint16_t pid,
+    const uint8_t *sec, const size_t sec_size) {
+	uint8_t tid, ver, sn, lsn;
+	uint16_t tid_ext;
+	uint32_t crc;
+	mpeg2_psi_tbl_e_p tbl_e;
+	mpeg2_psi_tbl_p tbl;
+
+	trk->secs ++;
+	if (0 == (sec[1] & 0x80))
+		return; /* Short section: no version, not cached. */
+	if (MPEG2_PSI_SEC_SNTX_MIN > sec_size) {
+		trk->sec_errs ++;
+		return;
+	}
+	if (0 == (sec[5] & 0x01))
+		return; /* Not applicable yet. */
+	tid = sec[0];
+	tid_ext = mpeg2_psi_be16(&sec[3]);
+	ver = ((sec[5] >> 1) & MPEG2_TS_PSI_TBL_VER_MASK);
+	sn = sec[6];
+	lsn = sec[7];
+	if (sn > lsn) {
+		trk->sec_errs ++;
+		return;
+	}
+	crc = mpeg2_psi_be32(&sec[(sec_size - 4)]);
+	tbl_e = mpeg2_psi_trk_tbl_e_find(trk, pid, tid, tid_ext);
+	if (NULL != tbl_e) { /* Fast path: same section already stored. */
+		tbl = tbl_e->cur;
+		if (NULL != tbl &&
+		    ver == tbl->ver &&
+		    lsn == tbl->lsn &&
+		    crc == tbl->sec_crc[sn] &&
+		    sec_size == tbl->sec_size[sn]) {
+			trk->secs_skipped ++;
+			return;
+		}
+		tbl = tbl_e->nxt;
+		if (NULL != tbl &&
+		    ver == tbl->ver &&
+		    lsn == tbl->lsn &&
+		    MPEG2_PSI_TBL_SEC_IS_SET(tbl, sn) &&
+		    crc == tbl->sec_crc[sn] &&
+		    sec_size == tbl->sec_size[sn]) {
+			trk->secs_skipped ++;
+			return;
+		}
+	}
+	if (0 != crc32mpeg2(sec, sec_size)) {
+		trk->crc_errs ++;
+		return;
+	}
+	if (NULL == tbl_e) {
+		tbl_e = mpeg2_psi_trk_tbl_e_add(trk, pid, tid, tid_ext);
+		if (NULL == tbl_e)
+			return;
+	}
+	tbl = tbl_e->nxt;
+	if (NULL != tbl &&
+	    (ver != tbl->ver || lsn != tbl->lsn)) { /* Version changed. */
+		mpeg2_psi_tbl_free(tbl);
+		tbl_e->nxt = NULL;
+		tbl = NULL;
+	}
+	if (NULL == tbl) {
+		tbl = calloc(1, sizeof(mpeg2_psi_tbl_t));
+		if (NULL == tbl) {
+			if (NULL == tbl_e->cur) { /* Do not keep empty entry. */
+				mpeg2_psi_trk_tbl_e_del(trk, tbl_e);
+			}
+			return;
+		}
+		tbl->pid = pid;
+		tbl->tid = tid;
+		tbl->ver = ver;
+		tbl->tid_ext = tid_ext;
+		tbl->lsn = lsn;
+		tbl_e->nxt = tbl;
+	}
+	if (NULL == tbl->sec[sn] || sec_size != tbl->sec_size[sn]) {
+		free(tbl->sec[sn]);
+		tbl->sec[sn] = malloc(sec_size);
+		if (NULL == tbl->sec[sn])
+			return;
+	}
+	memcpy(tbl->sec[sn], sec, sec_size);
+	tbl->sec_size[sn] = (uint16_t)sec_size;
+	tbl->sec_crc[sn] = crc;
+	if (0 == MPEG2_PSI_TBL_SEC_IS_SET(tbl, sn)) {
+		MPEG2_PSI_TBL_SEC_SET(tbl, sn);
+		tbl->secs_count ++;
+	}
+	if (0 != mpeg2_psi_tbl_is_complete(tbl)) {
+		mpeg2_psi_trk_tbl_update(trk, tbl_e);
+	}
+}
+
+/* Append data to section in progress, return consumed size. */
+static inline size_t
+mpeg2_psi_trk_sec_append(mpeg2_psi_trk_p trk, const uint16_t pid,
+    mpeg2_psi_pid_p pid_st, const uint8_t *data, const size_t data_size) {
+	size_t n, consumed = 0;
+
+	if (MPEG2_PSI_SEC_HDR_SIZE > pid_st->size) {
+		n = MIN((MPEG2_PSI_SEC_HDR_SIZE - pid_st->size), data_size);
+		memcpy(&pid_st->buf[pid_st->size], data, n);
+		pid_st->size += n;
+		consumed += n;
+		if (MPEG2_PSI_SEC_HDR_SIZE > pid_st->size)
+			return (consumed);
+		pid_st->need = (MPEG2_PSI_SEC_HDR_SIZE +
+		    (mpeg2_psi_be16(&pid_st->buf[1]) & 0x0fff));
+		if (sizeof(pid_st->buf) < pid_st->need) {
+			trk->sec_errs ++;
+			pid_st->flags &= ~MPEG2_PSI_PID_F_SEC;
+			return (data_size);
+		}
+	}
+	n = MIN((pid_st->need - pid_st->size), (data_size - consumed));
+	memcpy(&pid_st->buf[pid_st->size], &data[consumed], n);
+	pid_st->size += n;
+	consumed += n;
+	if (pid_st->size == pid_st->need) {
+		pid_st->flags &= ~MPEG2_PSI_PID_F_SEC;
+		mpeg2_psi_trk_sec_handle(trk, pid, pid_st->buf, pid_st->size);
+	}
+
+	return (consumed);
+}
+
+/* Process one TS packet, pkt points to sync byte. */
+static inline void
+mpeg2_psi_trk_pkt(mpeg2_psi_trk_p trk, const uint8_t *pkt) {
+	uint16_t pid;
+	uint8_t cc;
+	size_t off, pf, n;
+	mpeg2_psi_pid_p pid_st;
+
+	if (NULL == trk || NULL == pkt)
+		return;
+	pid = ((((uint16_t)pkt[1]) << 8) | pkt[2]) & 0x1fff;
+	pid_st = trk->pid[pid];
+	if (NULL == pid_st)
+		return;
+	if (0 != (pkt[1] & 0x80)) { /* Transport error. */
+		if (0 != (MPEG2_PSI_PID_F_SEC & pid_st->flags)) {
+			trk->cc_errs ++;
+		}
+		pid_st->flags = 0;
+		return;
+	}
+	if (0 == (pkt[3] & 0x10))
+		return; /* No payload. */
+	cc = (pkt[3] & MPEG2_TS_CC_MASK);
+	if (0 != (MPEG2_PSI_PID_F_CC & pid_st->flags)) {
+		if (cc == pid_st->cc)
+			return; /* Duplicate. */
+		if (cc != MPEG2_TS_CC_GET_NEXT(pid_st->cc) &&
+		    0 != (MPEG2_PSI_PID_F_SEC & pid_st->flags)) {
+			trk->cc_errs ++;
+			pid_st->flags &= ~MPEG2_PSI_PID_F_SEC;
+		}
+	}
+	pid_st->cc = cc;
+	pid_st->flags |= MPEG2_PSI_PID_F_CC;
+	off = 4;
+	if (0 != (pkt[3] & 0x20)) { /* Adaptation field. */
+		off += (1 + (size_t)pkt[4]);
+	}
+	if (MPEG2_TS_PKT_SIZE_188 <= off)
+		return;
+	if (0 == (pkt[1] & 0x40)) { /* Continuation. */
+		if (0 != (MPEG2_PSI_PID_F_SEC & pid_st->flags)) {
+			mpeg2_psi_trk_sec_append(trk, pid, pid_st, &pkt[off],
+			    (MPEG2_TS_PKT_SIZE_188 - off));
+		}
+		return;
+	}
+	/* Payload unit start: pointer field. */
+	pf = pkt[off ++];
+	if (MPEG2_TS_PKT_SIZE_188 < (off + pf)) {
+		trk->sec_errs ++;
+		pid_st->flags &= ~MPEG2_PSI_PID_F_SEC;
+		return;
+	}
+	if (0 != (MPEG2_PSI_PID_F_SEC & pid_st->flags)) {
+		/* Tail of previous section. */
+		mpeg2_psi_trk_sec_append(trk, pid, pid_st, &pkt[off], pf);
+		if (0 != (MPEG2_PSI_PID_F_SEC & pid_st->flags)) {
+			trk->sec_errs ++; /* Section not completed. */
+			pid_st->flags &= ~MPEG2_PSI_PID_F_SEC;
+		}
+	}
+	off += pf;
+	while (MPEG2_TS_PKT_SIZE_188 > off &&
+	    MPEG2_PSI_TID_STUFF != pkt[off]) {
+		pid_st->flags |= MPEG2_PSI_PID_F_SEC;
+		pid_st->size = 0;
+		pid_st->need = 0;
+		n = mpeg2_psi_trk_sec_append(trk, pid, pid_st, &pkt[off],
+		    (MPEG2_TS_PKT_SIZE_188 - off));
+		off += n;
+		if (0 != (MPEG2_PSI_PID_F_SEC & pid_st->flags))
+			break; /* Continued in next packet. */
+	}
+}
+
+/* Process tracked PIDs from last mpeg2_ts_dmx_batch(). */
+static inline void
+mpeg2_psi_trk_dmx_batch(mpeg2_psi_trk_p trk, mpeg2_ts_dmx_p dmx) {
+	size_t i, j, count;
+	uint16_t pid, *idx;
+
+	if (NULL == trk || NULL == dmx)
+		return;
+	for (i = 0; i < dmx->pids_count; i ++) {
+		pid = dmx->pids[i];
+		if (NULL == trk->pid[pid])
+			continue;
+		idx = MPEG2_TS_DMX_PID_IDX(dmx, pid);
+		count = MPEG2_TS_DMX_PID_IDX_COUNT(dmx, pid);
+		for (j = 0; j < count; j ++) {
+			mpeg2_psi_trk_pkt(trk, dmx->pkt[idx[j]]);
+		}
+	}
+}
+
 
 #endif /* __MPEG2_H__ */
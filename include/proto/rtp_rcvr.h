@@ -0,0 +1,136 @@
+/*-
+ * Copyright (c) 2012 - 2018 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __RTP_RECEIVER_H__
+#define __RTP_RECEIVER_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "utils/ring_buffer.h"
+#include "threadpool/threadpool.h"
+
+
+/*
+ * RTP receiver: UDP socket -> jitter/reorder buffer -> in order payload.
+ * Fixed size packets slots allocated once, packets are placed by
+ * sequence number, delivered in order as soon as hole is filled or
+ * declared lost after jbuf_delay.
+ * Payload delivered to data_cb and/or written to ring buffer: in order
+ * packets received directly into ring buffer and RTP header skipped
+ * without copy.
+ * All work done in tpt thread, create/destroy must be called from it.
+ */
+
+typedef struct rtp_rcvr_s	*rtp_rcvr_p;
+
+
+typedef struct rtp_rcvr_settings_s {
+	size_t		pkt_size_max;	/* Max datagram size. */
+	size_t		jbuf_pkts;	/* Jitter buffer size in packets, rounded up to power of 2. */
+	uint64_t	jbuf_delay;	/* Max time to wait for missing packet, ms. */
+	uint32_t	clock_rate;	/* RTP timestamp clock rate, Hz: for jitter calculation. */
+	uint32_t	flags;		/* Flags: RTP_RCVR_S_F_*. */
+} rtp_rcvr_settings_t, *rtp_rcvr_settings_p;
+
+#define RTP_RCVR_S_F_RAW_PASS	(((uint32_t)1) << 0) /* Deliver non RTP datagrams as is (raw UDP MPEG2-TS). */
+#define RTP_RCVR_S_F_CLOSE_SKT	(((uint32_t)1) << 1) /* Close socket on destroy. */
+
+/* Default values. */
+#define RTP_RCVR_S_DEF_PKT_SIZE_MAX	2048
+#define RTP_RCVR_S_DEF_JBUF_PKTS	64
+#define RTP_RCVR_S_DEF_JBUF_DELAY	50 /* ms */
+#define RTP_RCVR_S_DEF_CLOCK_RATE	90000 /* MPEG2-TS, video. */
+#define RTP_RCVR_S_DEF_FLAGS		RTP_RCVR_S_F_RAW_PASS
+
+#define RTP_RCVR_JBUF_PKTS_MAX		2048 /* < RTP_RCVR_DROPOUT_MAX. */
+#define RTP_RCVR_DROPOUT_MAX		3000 /* RFC 3550 A.1 MAX_DROPOUT. */
+#define RTP_RCVR_MISORDER_MAX		100 /* RFC 3550 A.1 MAX_MISORDER. */
+
+
+typedef struct rtp_rcvr_stat_s {
+	uint64_t	pkts;		/* Datagrams received. */
+	uint64_t	pkts_delivered;	/* RTP packets delivered in order. */
+	uint64_t	pkts_raw;	/* Non RTP datagrams passed as is. */
+	uint64_t	pkts_invalid;	/* Bad RTP / non RTP without RAW_PASS. */
+	uint64_t	pkts_dup;	/* Duplicates in jitter buffer. */
+	uint64_t	pkts_late;	/* Arrived after delivered or declared lost. */
+	uint64_t	pkts_reordered;	/* Arrived before some lower seq. */
+	uint64_t	pkts_lost;	/* Declared lost by jitter buffer. */
+	uint64_t	pkts_drop;	/* Delivery failed: no space/too small. */
+	uint64_t	bytes;		/* Payload delivered. */
+	uint64_t	gaps;		/* Lost runs reported. */
+	uint64_t	resyncs;	/* SSRC change / sequence restart. */
+	uint64_t	rcv_errs;	/* recvfrom() errors. */
+	uint32_t	reorder_max;	/* Max reorder distance, packets. */
+	uint32_t	jbuf_used;	/* Packets waiting in jitter buffer now. */
+	uint32_t	jbuf_used_max;
+	uint32_t	ssrc;		/* Current source. */
+	uint32_t	ext_max_seq;	/* Extended highest seq received. */
+	uint32_t	expected;	/* RFC 3550 A.3. */
+	uint32_t	received;
+	int32_t		lost;		/* Cumulative lost: expected - received. */
+	uint32_t	jitter;		/* Interarrival jitter, clock_rate units. */
+} rtp_rcvr_stat_t, *rtp_rcvr_stat_p;
+
+
+/* Payload in order. data points to ring buffer memory (if r_buf set) or
+ * to internal slot: valid only during call. */
+typedef void (*rtp_rcvr_data_cb)(rtp_rcvr_p rcvr, uint8_t *data,
+    size_t data_size, void *udata);
+/* count packets starting from seq declared lost. */
+typedef void (*rtp_rcvr_gap_cb)(rtp_rcvr_p rcvr, uint16_t seq,
+    uint32_t count, void *udata);
+
+
+void	rtp_rcvr_def_settings(rtp_rcvr_settings_p s_ret);
+
+/* r_buf and data_cb: at least one must be set. */
+int	rtp_rcvr_create(tpt_p tpt, uintptr_t skt, rtp_rcvr_settings_p s,
+	    r_buf_p r_buf, rtp_rcvr_data_cb data_cb, rtp_rcvr_gap_cb gap_cb,
+	    void *udata, rtp_rcvr_p *rcvr_ret);
+/* Pending packets are not delivered. */
+void	rtp_rcvr_destroy(rtp_rcvr_p rcvr);
+int	rtp_rcvr_stat_get(rtp_rcvr_p rcvr, rtp_rcvr_stat_p stat);
+/* Deliver all pending packets, missing reported as gaps. */
+void	rtp_rcvr_flush(rtp_rcvr_p rcvr);
+
+/* RTCP: must be called from rcvr tpt thread. */
+/* Handle compound RTCP packet from sender: remember SR time for LSR/DLSR. */
+int	rtp_rcvr_rtcp_process(rtp_rcvr_p rcvr, const uint8_t *buf,
+	    size_t buf_size);
+/* Build RR packet with one report block (RFC 3550 6.4.2, A.3):
+ * fraction lost since previous call, cumulative lost, jitter, LSR/DLSR. */
+int	rtp_rcvr_rtcp_rr_build(rtp_rcvr_p rcvr, uint32_t ssrc_local,
+	    uint8_t *buf, size_t buf_size, size_t *buf_size_ret);
+#define RTP_RCVR_RTCP_RR_SIZE	32
+
+
+#endif /* __RTP_RECEIVER_H__ */
@@ -0,0 +1,124 @@
+/*-
+ * Copyright (c) 2012 - 2018 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __SAP_INDEX_H__
+#define __SAP_INDEX_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "net/socket_address.h"
+
+
+/*
+ * SAP/SDP session index.
+ * Writer (SAP receiver thread) parse full SDP only for new/changed
+ * announcements: same originating source + message id hash only
+ * refresh timeout. Sessions removed by deletion messages and timeout.
+ * Every change publish new immutable snapshot indexed by name and by
+ * group:port; readers (any thread, HTTP handlers) get snapshot without
+ * locks and release it after use.
+ */
+
+typedef struct sap_idx_s	*sap_idx_p;
+typedef struct sap_idx_snap_s	*sap_idx_snap_p;
+
+
+typedef struct sap_sess_s {
+	const char	*name;		/* s= */
+	const char	*info;		/* i=, "" if not set. */
+	const char	*origin;	/* o= without sess-version: session id. */
+	size_t		name_size;
+	size_t		info_size;
+	size_t		origin_size;
+	uint64_t	version;	/* o= sess-version. */
+	sockaddr_storage_t addr;	/* Group (c=) and port (m=). */
+	sockaddr_storage_t src;		/* SAP originating source. */
+	uint32_t	if_index;	/* Interface index, where received. */
+	uint16_t	msg_id_hash;	/* SAP message id hash. */
+	uint16_t	payload_type;	/* First m= fmt. */
+	uint8_t		media_type;	/* SAP_SESS_MEDIA_*. */
+	uint8_t		media_proto;	/* SAP_SESS_PROTO_*. */
+	uint8_t		ttl;		/* c= TTL, 0 if not set. */
+	time_t		time;		/* Time when (re)announced. */
+} sap_sess_t, *sap_sess_p;
+
+#define SAP_SESS_MEDIA_VIDEO	1
+#define SAP_SESS_MEDIA_AUDIO	2
+
+#define SAP_SESS_PROTO_UNKNOWN	0
+#define SAP_SESS_PROTO_UDP	1 /* udp */
+#define SAP_SESS_PROTO_RTP	2 /* RTP/AVP */
+#define SAP_SESS_PROTO_SRTP	3 /* RTP/SAVP */
+
+
+typedef struct sap_idx_stat_s {
+	uint64_t	msgs;		/* Messages processed. */
+	uint64_t	msgs_bad;	/* Invalid SAP / SDP. */
+	uint64_t	msgs_skipped;	/* Encrypted/compressed/not audio or video. */
+	uint64_t	parsed;		/* SDP parsed: new or changed. */
+	uint64_t	deleted;	/* Removed by deletion message. */
+	uint64_t	expired;	/* Removed by timeout. */
+	uint64_t	snaps;		/* Snapshots published. */
+	size_t		count;		/* Sessions now. */
+} sap_idx_stat_t, *sap_idx_stat_p;
+
+
+/* Writer: one thread at a time. */
+int	sap_idx_create(time_t cache_time, sap_idx_p *idx_ret);
+/* All snapshots must be released before. */
+void	sap_idx_destroy(sap_idx_p idx);
+int	sap_idx_stat_get(sap_idx_p idx, sap_idx_stat_p stat);
+/* Process SAP packet.
+ * Returns: 0 - index changed, EEXIST - known announcement refreshed,
+ * ENOENT - deletion for unknown session, other - bad/unsupported. */
+int	sap_idx_msg_process(sap_idx_p idx, uint8_t *pkt, size_t pkt_size,
+	    uint32_t if_index, time_t time);
+/* Remove sessions not announced during cache_time, returns count. */
+size_t	sap_idx_expire(sap_idx_p idx, time_t time);
+
+/* Readers: any thread, lock free. Never returns NULL for valid idx. */
+sap_idx_snap_p sap_idx_snap_get(sap_idx_p idx);
+void	sap_idx_snap_release(sap_idx_snap_p snap);
+/* Generation: changed on every index update, for ETag / change check. */
+uint64_t sap_idx_snap_gen(sap_idx_snap_p snap);
+size_t	sap_idx_snap_count(sap_idx_snap_p snap);
+/* Sessions sorted by name, case insensitive. */
+const sap_sess_t *sap_idx_snap_sess_get(sap_idx_snap_p snap, size_t index);
+const sap_sess_t *sap_idx_snap_find_addr(sap_idx_snap_p snap,
+	    const sockaddr_storage_t *addr);
+/* Returns count of sessions with name started from prefix (case
+ * insensitive), first index in index_ret. */
+size_t	sap_idx_snap_find_name(sap_idx_snap_p snap, const char *prefix,
+	    size_t prefix_size, size_t *index_ret);
+
+
+#endif /* __SAP_INDEX_H__ */
@@ -34,6 +34,7 @@
 #include <sys/types.h>
 #include <inttypes.h>
 #include "threadpool/threadpool.h"
+#include "proto/sap_idx.h"
 
 typedef struct sap_rcvr_s	*sap_rcvr_p;
 
@@ -44,6 +45,8 @@ int	sap_receiver_create(tp_p thp, uint32_t skt_recv_buf_size,
 void	sap_receiver_destroy(sap_rcvr_p srcvr);
 int	sap_receiver_listener_add4(sap_rcvr_p srcvr, const char *ifname,
 	    size_t ifname_size, const char *mcaddr, size_t mcaddr_size);
+/* Sessions index: snapshots can be read from any thread. */
+sap_idx_p sap_receiver_idx_get(sap_rcvr_p srcvr);
 
 //int	sap_receiver_cache_text_dump(sap_rcvr_p srcvr, char *buf, size_t buf_size,
 //	    size_t *size_ret);
@@ -285,6 +285,20 @@ int	tp_task_pkt_rcvr_create(tpt_p tpt, uintptr_t ident,
 /* Valid flags: TP_TASK_F_CB_AFTER_EVERY_READ */
 /* Call tp_task_destroy() then no needed. */
 
+/* Creates packet receiver that drain up to pkts_max datagrams per
+ * recvmmsg() call. Free space in buf is split to pkts_max equal slots,
+ * cb called for each datagram with temporary io_buf that point to slot,
+ * datagrams truncated by slot size are dropped.
+ * Falls back to recvfrom() if recvmmsg() not available or slot is
+ * smaller than TP_TASK_PKT_RCVR_SLOT_MIN. */
+int	tp_task_pkt_rcvr_mmsg_create(tpt_p tpt, uintptr_t ident,
+	    uint32_t flags, uint64_t timeout, io_buf_p buf, size_t pkts_max,
+	    tp_task_pkt_rcvr_cb cb_func, void *udata,
+	    tp_task_p *tptask_ret);
+#define TP_TASK_PKT_RCVR_BATCH_MAX	64
+#define TP_TASK_PKT_RCVR_SLOT_MIN	512
+/* Valid flags: TP_TASK_F_CLOSE_ON_DESTROY */
+
 
 int	tp_task_accept_create(tpt_p tpt, uintptr_t ident,
 	    uint32_t flags, uint64_t timeout,
@@ -33,9 +33,12 @@
 
 #include <sys/param.h>
 #include <sys/types.h>
-#include <sys/mman.h> /* mmap, munmap */
+#include <sys/mman.h> /* mmap, munmap, memfd_create */
 #include <inttypes.h>
 #include <stdlib.h>
+#include <unistd.h> /* ftruncate, close */
+#include <fcntl.h> /* O_* for shm_open */
+#include <errno.h>
 #include <string.h> /* memcpy, memmove, memset... */
 #include <strings.h> /* strncasecmp() */
 #include "al/os.h"
@@ -559,4 +562,76 @@ mapfree(void *buf, const size_t size) {
 	munmap(buf, size);
 }
 
+/* Map same memory twice, back to back: buf[i] == buf[(i + size)].
+ * size must be page aligned. fd: -1 - use anonymous shared memory.
+ * Free with mapfree_mirror(). */
+static inline void *
+mapalloc_mirror_fd(uintptr_t fd, const size_t size) {
+	int error, mfd;
+	uint8_t *buf;
+
+	if (0 == size) {
+		errno = EINVAL;
+		return (NULL);
+	}
+	if (((uintptr_t)-1) == fd) { /* Anonymous shared memory. */
+#ifdef HAVE_MEMFD_CREATE
+		mfd = memfd_create("mapalloc_mirror", MFD_CLOEXEC);
+#elif defined(SHM_ANON)
+		mfd = shm_open(SHM_ANON, (O_RDWR | O_CLOEXEC), 0600);
+#else
+		mfd = -1;
+		errno = ENOSYS;
+#endif
+		if (-1 == mfd)
+			return (NULL);
+		if (0 != ftruncate(mfd, (off_t)size)) {
+			error = errno;
+			close(mfd);
+			errno = error;
+			return (NULL);
+		}
+	} else {
+		mfd = (int)fd;
+	}
+	/* Reserve address space for both copies. */
+	buf = mmap(NULL, (size * 2), PROT_NONE, (MAP_PRIVATE | MAP_ANON), -1, 0);
+	if (MAP_FAILED == buf)
+		goto err_out;
+	if (MAP_FAILED == mmap(buf, size, (PROT_READ | PROT_WRITE),
+	    (MAP_SHARED | MAP_FIXED), mfd, 0) ||
+	    MAP_FAILED == mmap((buf + size), size, (PROT_READ | PROT_WRITE),
+	    (MAP_SHARED | MAP_FIXED), mfd, 0)) {
+		error = errno;
+		munmap(buf, (size * 2));
+		errno = error;
+		goto err_out;
+	}
+	if (((uintptr_t)-1) == fd) { /* Mappings keep memory. */
+		close(mfd);
+	}
+	if (0 != mlock(buf, size)) { /* No fail, just less perfomance. */
+	}
+	memset(buf, 0x00, size);
+
+	return (buf);
+
+err_out:
+	if (((uintptr_t)-1) == fd) {
+		error = errno;
+		close(mfd);
+		errno = error;
+	}
+	return (NULL);
+}
+
+static inline void
+mapfree_mirror(void *buf, const size_t size) {
+
+	if (NULL == buf ||
+	    0 == size)
+		return;
+	munmap(buf, (size * 2));
+}
+
 #endif /* __MEMORY_UTILS_H__ */
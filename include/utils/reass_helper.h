@@ -33,7 +33,12 @@
 
 #include <sys/param.h>
 #include <sys/types.h>
-#include <sys/systm.h>
+#ifdef _KERNEL
+#	include <sys/systm.h>
+#else
+#	include <stdlib.h> /* malloc, free */
+#	include <errno.h>
+#endif
 #include <string.h> /* memcpy, memmove, memset... */
 #include <inttypes.h>
 
@@ -44,9 +49,14 @@
 #ifndef SIZE_T_MAX
 #	define SIZE_T_MAX	((size_t)~0)
 #endif
+#ifndef bswap64
+#	define bswap64		__builtin_bswap64
+#endif
 
 #define REASS_HLP_GET_BIT(__buf, __bit)	(((((uint8_t*)(__buf))[((__bit) >> 3)] >> ((__bit) & 0x07))) & 0x01)
 #define REASS_HLP_SET_BIT(__buf, __bit)	((uint8_t*)(__buf))[((__bit) >> 3)] |= (((uint8_t)1) << ((__bit) & 0x07))
+/* Bitmap size in bytes for blocks count, rounded to 64 bit words. */
+#define REASS_HLP_BITMAP_SIZE(__blks)	((((__blks) + 63) / 64) * sizeof(uint64_t))
 
 
 /* Fragmet reasseble buf + data. */
@@ -55,6 +65,7 @@ typedef struct reasseble_helper_s {
 	size_t		buf_size; /* Buffer size. */
 	uint8_t		*bitmap;
 	size_t		bitmap_size; /* Buffer size. */
+	size_t		bitmap_used; /* Bitmap bytes that may contain set bits. */
 	size_t		blk_size; /* Block size, from first block. */
 	size_t		blk_cnt; /* Received blocks count. */
 	size_t		recv_cnt; /* Received bytes count. */
@@ -66,6 +77,82 @@ typedef struct reasseble_helper_s {
 	uint64_t	cur_seq_no; /* Sequence number, from last received block. */
 } reass_hlp_t, *reass_hlp_p;
 
+/* Range of missing blocks. */
+typedef struct reasseble_helper_range_s {
+	size_t		blk_idx; /* First missing block index. */
+	size_t		blk_cnt; /* Missing blocks count. */
+} reass_hlp_range_t, *reass_hlp_range_p;
+
+
+
+/* Bitmap word-at-a-time scan. */
+/* Returns 64 bits of bitmap starting from byte offset, bytes after
+ * bitmap end are zero. Bit N of result is bit (off * 8 + N) of bitmap. */
+static inline uint64_t
+reass_hlp_bitmap_word_get(const uint8_t *bitmap, size_t bitmap_size,
+    size_t off) {
+	uint64_t word = 0;
+
+	if ((off + sizeof(uint64_t)) <= bitmap_size) {
+		memcpy(&word, (bitmap + off), sizeof(uint64_t));
+	} else if (off < bitmap_size) {
+		memcpy(&word, (bitmap + off), (bitmap_size - off));
+	}
+#if BYTE_ORDER == BIG_ENDIAN
+	word = bswap64(word);
+#endif
+
+	return (word);
+}
+
+/* Returns index of first bit equal to value in [start, end), or end. */
+static inline size_t
+reass_hlp_bitmap_find(const uint8_t *bitmap, size_t bitmap_size,
+    size_t start, size_t end, int value) {
+	uint64_t word;
+	size_t shift;
+
+	if (NULL == bitmap)
+		return (end);
+	end = MIN(end, (bitmap_size * 8));
+	while (start < end) {
+		shift = (start & 0x07);
+		word = reass_hlp_bitmap_word_get(bitmap, bitmap_size,
+		    (start >> 3));
+		if (0 == value) {
+			word = ~word;
+		}
+		word >>= shift; /* (64 - shift) valid bits. */
+		if (0 != word)
+			return (MIN(end, (start + (size_t)__builtin_ctzll(word))));
+		start += (64 - shift);
+	}
+
+	return (end);
+}
+
+/* Returns set bits count in [0, end). */
+static inline size_t
+reass_hlp_bitmap_count(const uint8_t *bitmap, size_t bitmap_size,
+    size_t end) {
+	uint64_t word;
+	size_t i, ret = 0;
+
+	if (NULL == bitmap)
+		return (0);
+	end = MIN(end, (bitmap_size * 8));
+	for (i = 0; (i + 64) <= end; i += 64) {
+		word = reass_hlp_bitmap_word_get(bitmap, bitmap_size, (i >> 3));
+		ret += (size_t)__builtin_popcountll(word);
+	}
+	if (i < end) {
+		word = reass_hlp_bitmap_word_get(bitmap, bitmap_size, (i >> 3));
+		word &= ((((uint64_t)1) << (end - i)) - 1);
+		ret += (size_t)__builtin_popcountll(word);
+	}
+
+	return (ret);
+}
 
 
 /* Fragmet reasseble buf functions. */
@@ -83,9 +170,10 @@ reass_hlp_reset(reass_hlp_p reass_hlp) {
 	reass_hlp->reorders_cnt = 0;
 	reass_hlp->first_seq_no = 0;
 	reass_hlp->last_seq_no = 0;
-	if (NULL != reass_hlp->bitmap) { /* Init bitmap. */
-		memset(reass_hlp->bitmap, 0x00, reass_hlp->bitmap_size);
+	if (NULL != reass_hlp->bitmap) { /* Clear only touched part of bitmap. */
+		memset(reass_hlp->bitmap, 0x00, reass_hlp->bitmap_used);
 	}
+	reass_hlp->bitmap_used = 0;
 }
 
 static inline int
@@ -99,6 +187,7 @@ reass_hlp_init(reass_hlp_p reass_hlp, void *buf, size_t buf_size,
 	reass_hlp->buf_size = buf_size;
 	reass_hlp->bitmap = bitmap;
 	reass_hlp->bitmap_size = bitmap_size;
+	reass_hlp->bitmap_used = bitmap_size;
 	reass_hlp_reset(reass_hlp);
 
 	return (0);
@@ -121,7 +210,7 @@ reass_hlp_alloc(size_t buf_size, size_t min_frag_size) {
 		min_frag_size ++;
 	}
 	buf_size += 128; /* Guard space. */
-	bitmap_size = ((buf_size / min_frag_size) + 128);
+	bitmap_size = REASS_HLP_BITMAP_SIZE(((buf_size / min_frag_size) + 1));
 	reass_hlp = malloc((sizeof(reass_hlp_t) + buf_size + bitmap_size));
 	if (NULL == reass_hlp)
 		return (NULL);
@@ -129,6 +218,7 @@ reass_hlp_alloc(size_t buf_size, size_t min_frag_size) {
 	reass_hlp->buf_size = buf_size;
 	reass_hlp->bitmap = (reass_hlp->buf + buf_size);
 	reass_hlp->bitmap_size = bitmap_size;
+	reass_hlp->bitmap_used = bitmap_size;
 	reass_hlp_reset(reass_hlp);
 
 	return (reass_hlp);
@@ -139,17 +229,33 @@ reass_hlp_alloc(size_t buf_size, size_t min_frag_size) {
 static inline size_t
 reass_hlp_seq_calc_diff(uint64_t first_seq_no, uint64_t last_seq_no) {
 
-	if (last_seq_no >= first_seq_no) {
-		last_seq_no -= first_seq_no;
-	} else { /* Seq num overflow. */
-		last_seq_no += (UINT64_T_MAX - first_seq_no);
-	}
+	last_seq_no -= first_seq_no; /* Seq num overflow handled by unsigned math. */
 	if (SIZE_T_MAX < last_seq_no)
 		return (SIZE_T_MAX); /* sizeof(uint64_t) > sizeof(size_t) */
 
 	return (last_seq_no);
 }
 
+/* Start new sequence with known first sequence number and block size:
+ * all fragments, including first, may be received in any order,
+ * pass is_first = 0 to reass_hlp_handle_frag(). */
+static inline int
+reass_hlp_start(reass_hlp_p reass_hlp, uint64_t first_seq_no,
+    size_t blk_size) {
+
+	if (NULL == reass_hlp || 0 == blk_size)
+		return (EINVAL);
+	reass_hlp_reset(reass_hlp);
+	reass_hlp->blk_size = blk_size;
+	reass_hlp->first_seq_no = first_seq_no;
+	reass_hlp->cur_seq_no = (first_seq_no - 1);
+	if (NULL != reass_hlp->bitmap &&
+	    (reass_hlp->buf_size / reass_hlp->blk_size) > (reass_hlp->bitmap_size * 8))
+		return (ENOBUFS); /* Not enought bitmap space. */
+
+	return (0);
+}
+
 static inline int
 reass_hlp_handle_frag(reass_hlp_p reass_hlp, uint64_t seq_no, int is_first,
     int is_last, void *data, size_t data_size) {
@@ -187,7 +293,7 @@ reass_hlp_handle_frag(reass_hlp_p reass_hlp, uint64_t seq_no, int is_first,
 		return (EINVAL); /* Not enought buf space, assume that it is frag with bad seqno. */
 	/* Check by bitmap: is block already received? */
 	if (NULL != reass_hlp->bitmap) { /* Using bitmap. */
-		if (reass_hlp->bitmap_size <= blk_idx)
+		if ((reass_hlp->bitmap_size * 8) <= blk_idx)
 			return (ERANGE);
 		if (0 != REASS_HLP_GET_BIT(reass_hlp->bitmap, blk_idx)) {
 			reass_hlp->dup_cnt ++;
@@ -195,6 +301,8 @@ reass_hlp_handle_frag(reass_hlp_p reass_hlp, uint64_t seq_no, int is_first,
 		}
 		/* Update bitmap. */
 		REASS_HLP_SET_BIT(reass_hlp->bitmap, blk_idx);
+		reass_hlp->bitmap_used = MAX(reass_hlp->bitmap_used,
+		    ((blk_idx >> 3) + 1));
 	}
 	/* Add new data. */
 	if (is_last && 0 == reass_hlp->sequence_size) {
@@ -217,5 +325,50 @@ reass_hlp_handle_frag(reass_hlp_p reass_hlp, uint64_t seq_no, int is_first,
 	return (0); /* All fragments received!. */
 }
 
+/* Returns blocks count that should be received: known after last
+ * fragment received, before - highest received block index + 1. */
+static inline size_t
+reass_hlp_blk_total(reass_hlp_p reass_hlp) {
+
+	if (NULL == reass_hlp || 0 == reass_hlp->blk_cnt)
+		return (0);
+	if (0 != reass_hlp->sequence_size)
+		return (reass_hlp_seq_calc_diff(reass_hlp->first_seq_no,
+		    reass_hlp->last_seq_no) + 1);
+	/* Highest received block: last touched bitmap byte is not zero. */
+	if (NULL == reass_hlp->bitmap || 0 == reass_hlp->bitmap_used)
+		return (0);
+	return ((((reass_hlp->bitmap_used - 1) * 8) + 32) -
+	    (size_t)__builtin_clz((uint32_t)reass_hlp->bitmap[(reass_hlp->bitmap_used - 1)]));
+}
+
+/* Fill ranges with missing blocks up to reass_hlp_blk_total().
+ * Returns ranges count, may be > ranges_max: only ranges_max stored. */
+static inline size_t
+reass_hlp_missing_get(reass_hlp_p reass_hlp, reass_hlp_range_p ranges,
+    size_t ranges_max) {
+	size_t pos, end, next, ret = 0;
+
+	if (NULL == reass_hlp || NULL == reass_hlp->bitmap)
+		return (0);
+	end = MIN(reass_hlp_blk_total(reass_hlp),
+	    (reass_hlp->bitmap_size * 8));
+	for (pos = 0; pos < end; pos = next) {
+		pos = reass_hlp_bitmap_find(reass_hlp->bitmap,
+		    reass_hlp->bitmap_size, pos, end, 0);
+		if (pos >= end)
+			break;
+		next = reass_hlp_bitmap_find(reass_hlp->bitmap,
+		    reass_hlp->bitmap_size, pos, end, 1);
+		if (NULL != ranges && ret < ranges_max) {
+			ranges[ret].blk_idx = pos;
+			ranges[ret].blk_cnt = (next - pos);
+		}
+		ret ++;
+	}
+
+	return (ret);
+}
+
 
 #endif /* __REASSEMBLE_HELPER_H__ */
@@ -0,0 +1,107 @@
+/*-
+ * Copyright (c) 2012 - 2018 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __REASSEMBLE_POOL_H__
+#define __REASSEMBLE_POOL_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "utils/reass_helper.h"
+
+
+/*
+ * Reassembly pool: many concurrent fragmented sequences over reass_hlp.
+ * All memory allocated on create: entries_max reassemble buffers,
+ * sequences looked up by 64 bit key (caller builds it from src/dst/id).
+ * Incomplete sequence evicted after timeout from first fragment or,
+ * when pool is full, oldest one replaced by new.
+ * Not thread safe: use one pool per thread or lock outside.
+ */
+
+typedef struct reass_pool_s	*reass_pool_p;
+
+
+typedef struct reass_pool_settings_s {
+	size_t		entries_max;	/* Max concurrent sequences. */
+	size_t		buf_size;	/* Max reassembled data size. */
+	size_t		blk_size;	/* Fragment size, except last one. */
+	uint64_t	timeout;	/* Time to wait all fragments, ms. */
+} reass_pool_settings_t, *reass_pool_settings_p;
+
+/* Default values. */
+#define REASS_POOL_S_DEF_ENTRIES_MAX	256
+#define REASS_POOL_S_DEF_BUF_SIZE	(64 * 1024)
+#define REASS_POOL_S_DEF_BLK_SIZE	1472 /* UDP payload in 1500 MTU. */
+#define REASS_POOL_S_DEF_TIMEOUT	1000 /* 1 sec. */
+
+
+typedef struct reass_pool_stat_s {
+	uint64_t	frags;		/* Fragments passed. */
+	uint64_t	frags_dup;	/* Duplicates. */
+	uint64_t	frags_bad;	/* Out of range / bad size. */
+	uint64_t	seq_started;	/* New sequences. */
+	uint64_t	seq_done;	/* Completed. */
+	uint64_t	seq_bad;	/* All fragments received, but size mismatch. */
+	uint64_t	seq_timeout;	/* Evicted by timeout. */
+	uint64_t	seq_evicted;	/* Evicted by new sequence: pool full. */
+	size_t		entries;	/* Sequences in progress. */
+} reass_pool_stat_t, *reass_pool_stat_p;
+
+
+/* Called before incomplete sequence evicted: error = ETIMEDOUT or ENOBUFS
+ * (pool full). reass_hlp_missing_get() can be used to get lost blocks. */
+typedef void (*reass_pool_evict_cb)(reass_pool_p pool, uint64_t key,
+    reass_hlp_p reass_hlp, int error, void *udata);
+
+
+void	reass_pool_def_settings(reass_pool_settings_p s_ret);
+
+int	reass_pool_create(reass_pool_settings_p s, reass_pool_evict_cb cb_func,
+	    void *udata, reass_pool_p *pool_ret);
+void	reass_pool_destroy(reass_pool_p pool);
+int	reass_pool_stat_get(reass_pool_p pool, reass_pool_stat_p stat);
+
+/* Add fragment blk_idx (0 - first) of sequence key.
+ * Returns: 0 - sequence complete: reassembled data in (*reass_hlp_ret)->buf,
+ * size: (*reass_hlp_ret)->sequence_size, call reass_pool_done() after use;
+ * EAGAIN - more fragments required / duplicate;
+ * other - error, fragment ignored. */
+int	reass_pool_frag_add(reass_pool_p pool, uint64_t key, uint64_t time,
+	    size_t blk_idx, int is_last, void *data, size_t data_size,
+	    reass_hlp_p *reass_hlp_ret);
+/* Release completed sequence buffer. */
+void	reass_pool_done(reass_pool_p pool, reass_hlp_p reass_hlp);
+/* Evict sequences older than timeout, returns evicted count.
+ * Also done on every reass_pool_frag_add(). */
+size_t	reass_pool_timeout_check(reass_pool_p pool, uint64_t time);
+
+
+#endif /* __REASSEMBLE_POOL_H__ */
@@ -65,6 +65,10 @@ typedef struct r_buf_s { /* Ring buf. */
 /* User set flags. */
 #define RBUF_F_U__MASK__	0xffff0000
 #define RBUF_F_U_KEEP_TAIL	(((uint32_t)1) << 16) /* Move tail data to head on buffer full. */
+#define RBUF_F_U_MIRROR		(((uint32_t)1) << 17) /* Map buffer memory twice, back to back:
+							* any data window up to size is contiguous,
+							* r_buf_data_get() return single iovec for
+							* unfragmented data. Size rounded up to page size. */
 
 
 typedef struct r_buf_rpos_s { /* Ring buf read pos. */
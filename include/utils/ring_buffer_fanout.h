@@ -0,0 +1,129 @@
+/*-
+ * Copyright (c) 2012 - 2018 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __RING_BUFFER_FANOUT_H__
+#define __RING_BUFFER_FANOUT_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "utils/ring_buffer.h"
+#include "threadpool/threadpool.h"
+
+
+/*
+ * Ring buffer fan-out: one writer (source), many readers (clients sockets).
+ * Readers attached to tp threads, each thread serve own readers with
+ * single sendmsg() per reader per wakeup directly from ring buffer memory.
+ */
+
+typedef struct r_buf_fo_s	*r_buf_fo_p; /* Fan-out source. */
+typedef struct r_buf_fo_rdr_s	*r_buf_fo_rdr_p; /* Reader. */
+
+
+typedef struct r_buf_fo_settings_s {
+	size_t		ring_size;	/* Ring buffer size. */
+	size_t		min_block_size;	/* Minimal data block size written to ring. */
+	size_t		precache;	/* Data size sent to new reader. */
+	size_t		lag_max;	/* Unsent data size for reader to apply lag policy. */
+	size_t		snd_block_min;	/* Minimal data size to send. */
+	uint64_t	snd_timeout;	/* Time to wait socket ready for write, ms. */
+	uint32_t	flags;		/* Flags: R_BUF_FO_S_F_*. */
+} r_buf_fo_settings_t, *r_buf_fo_settings_p;
+
+/* Lag policy: reader unsent data size > lag_max or reader overrun by writer. */
+#define R_BUF_FO_S_F_LAG_JUMP	(((uint32_t)1) << 0) /* Move reader to nearest sync point / precache. */
+#define R_BUF_FO_S_F_LAG_DROP	(((uint32_t)1) << 1) /* Report ENOBUFS to reader cb. */
+#define R_BUF_FO_S_F_KEEP_TAIL	(((uint32_t)1) << 2) /* RBUF_F_U_KEEP_TAIL for ring buffer. */
+#define R_BUF_FO_S_F_MIRROR	(((uint32_t)1) << 3) /* RBUF_F_U_MIRROR for ring buffer. */
+
+/* Default values. */
+#define R_BUF_FO_S_DEF_RING_SIZE	(4 * 1024 * 1024)
+#define R_BUF_FO_S_DEF_MIN_BLOCK_SIZE	188 /* MPEG2-TS packet size. */
+#define R_BUF_FO_S_DEF_PRECACHE		(1024 * 1024)
+#define R_BUF_FO_S_DEF_LAG_MAX		(2 * 1024 * 1024)
+#define R_BUF_FO_S_DEF_SND_BLOCK_MIN	0
+#define R_BUF_FO_S_DEF_SND_TIMEOUT	30000 /* 30 sec. */
+#define R_BUF_FO_S_DEF_FLAGS		R_BUF_FO_S_F_LAG_JUMP
+
+#define R_BUF_FO_IOV_MAX		64 /* Max iovecs per one sendmsg(). */
+#define R_BUF_FO_SYNC_POINTS_MAX	16 /* Sync points remembered for lag policy. */
+
+
+typedef struct r_buf_fo_stat_s {
+	uint64_t	wr_size;	/* Data size written to ring. */
+	uint64_t	wr_blocks;	/* Blocks written to ring. */
+	uint64_t	wakeups;	/* Messages sent to threads. */
+	size_t		rdr_count;	/* Readers attached. */
+} r_buf_fo_stat_t, *r_buf_fo_stat_p;
+
+typedef struct r_buf_fo_rdr_stat_s {
+	uint64_t	snd_size;	/* Data size sent. */
+	uint64_t	snd_calls;	/* sendmsg() calls. */
+	size_t		lag;		/* Unsent data size on last send. */
+	size_t		lag_max;	/* Max unsent data size. */
+	uint64_t	jump_count;	/* Lag policy moves. */
+	uint64_t	drop_count;	/* Overruns by writer and lag policy drops. */
+	uint64_t	drop_size;	/* Data size skipped by reader. */
+} r_buf_fo_rdr_stat_t, *r_buf_fo_rdr_stat_p;
+
+
+/* Called on send error/timeout/lag drop: reader is stopped,
+ * r_buf_fo_rdr_free() can be called from callback. */
+typedef void (*r_buf_fo_rdr_cb)(r_buf_fo_rdr_p rdr, int error, void *udata);
+
+
+void	r_buf_fo_def_settings(r_buf_fo_settings_p s_ret);
+
+int	r_buf_fo_create(tp_p tp, r_buf_fo_settings_p s, r_buf_fo_p *fo_ret);
+/* Call after all readers removed. Pending wakeups hold reference,
+ * memory freed after last one processed. */
+void	r_buf_fo_destroy(r_buf_fo_p fo);
+r_buf_p	r_buf_fo_r_buf_get(r_buf_fo_p fo);
+int	r_buf_fo_stat_get(r_buf_fo_p fo, r_buf_fo_stat_p stat);
+
+/* Writer: any thread, one at a time. */
+size_t	r_buf_fo_wbuf_get(r_buf_fo_p fo, size_t min_buf_size, uint8_t **buf);
+int	r_buf_fo_wbuf_set(r_buf_fo_p fo, size_t offset, size_t buf_size,
+	    uint32_t flags);
+int	r_buf_fo_write(r_buf_fo_p fo, const uint8_t *buf, size_t buf_size,
+	    uint32_t flags);
+#define R_BUF_FO_WR_F_SYNC	(((uint32_t)1) << 0) /* Block is sync point: reader can start from it. */
+
+/* Readers: must be called from tpt thread. */
+int	r_buf_fo_rdr_add(r_buf_fo_p fo, tpt_p tpt, uintptr_t skt,
+	    r_buf_fo_rdr_cb cb_func, void *udata, r_buf_fo_rdr_p *rdr_ret);
+/* Socket not closed. */
+void	r_buf_fo_rdr_free(r_buf_fo_rdr_p rdr);
+int	r_buf_fo_rdr_stat_get(r_buf_fo_rdr_p rdr, r_buf_fo_rdr_stat_p stat);
+void	*r_buf_fo_rdr_udata_get(r_buf_fo_rdr_p rdr);
+
+
+#endif /* __RING_BUFFER_FANOUT_H__ */
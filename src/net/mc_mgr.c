@@ -0,0 +1,551 @@
+/*-
+ * Copyright (c) 2011-2026 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* memcpy, memmove, memset, strerror... */
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+#include "utils/macro.h"
+#include "al/os.h"
+#include "threadpool/threadpool.h"
+#include "net/socket.h"
+#include "net/socket_address.h"
+#include "net/mc_mgr.h"
+
+
+#define MC_MGR_HASH_SIZE	1024 /* Must be pow2. */
+#define MC_MGR_HASH_MASK	(MC_MGR_HASH_SIZE - 1)
+
+
+typedef struct mc_mgr_grp_s	*mc_mgr_grp_p;
+
+typedef struct mc_mgr_sub_s {
+	TAILQ_ENTRY(mc_mgr_sub_s) next;
+	mc_mgr_grp_p	grp;
+	mc_mgr_cb	cb_func;
+	void		*udata;
+} mc_mgr_sub_t;
+
+TAILQ_HEAD(mc_mgr_sub_head, mc_mgr_sub_s);
+
+
+typedef struct mc_mgr_grp_s {
+	LIST_ENTRY(mc_mgr_grp_s) hnext;	/* Hash chain. */
+	TAILQ_ENTRY(mc_mgr_grp_s) next;	/* Join queue / linger / batch. */
+	struct mc_mgr_sub_head subs;
+	mc_mgr_p	mgr;
+	sockaddr_storage_t addr;	/* Group + port. */
+	uint32_t	if_index;
+	uint32_t	hash;
+	uint32_t	state;		/* MC_MGR_G_S_* */
+	int		error;		/* Join result. */
+	size_t		ref_count;	/* Subscribers count. */
+	uintptr_t	skt;
+	uint64_t	time;		/* Join request time / leave deadline, us. */
+} mc_mgr_grp_t;
+
+#define MC_MGR_G_S_JOIN_Q	0 /* In join queue. */
+#define MC_MGR_G_S_JOINING	1 /* Batch: join in progress. */
+#define MC_MGR_G_S_ACTIVE	2 /* Joined, have subscribers. */
+#define MC_MGR_G_S_LINGER	3 /* Joined, no subscribers, wait for leave. */
+#define MC_MGR_G_S_LEAVING	4 /* Batch: leave in progress, not in hash. */
+
+TAILQ_HEAD(mc_mgr_grp_head, mc_mgr_grp_s);
+LIST_HEAD(mc_mgr_grp_lhead, mc_mgr_grp_s);
+
+
+typedef struct mc_mgr_s {
+	MTX_S		mtx;
+	tp_udata_t	tmr;		/* Batch / linger timer. */
+	uint64_t	tmr_time;	/* Timer deadline, us, 0 - not armed. */
+	struct mc_mgr_grp_head join_q;	/* Wait for batch. */
+	struct mc_mgr_grp_head linger;	/* Sorted by deadline: linger is constant. */
+	struct mc_mgr_grp_lhead hash[MC_MGR_HASH_SIZE];
+	mc_mgr_stat_t	stat;
+	mc_mgr_settings_t s;
+} mc_mgr_t;
+
+
+static void	mc_mgr_tmr_cb(tp_event_p ev, tp_udata_p tp_udata);
+
+
+
+static inline uint64_t
+mc_mgr_time_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_FAST, &ts);
+	return ((((uint64_t)ts.tv_sec) * 1000000) +
+	    (((uint64_t)ts.tv_nsec) / 1000));
+}
+
+static uint32_t
+mc_mgr_hash(const sockaddr_storage_t *addr, uint32_t if_index) {
+	const uint8_t *ptm = sa_addr_get(addr);
+	size_t i, size;
+	uint32_t hash = if_index;
+
+	size = ((AF_INET == sa_family(addr)) ?
+	    sizeof(in__addr_t) : sizeof(in6_addr_t));
+	for (i = 0; i < size; i ++) {
+		hash = ((hash << 5) + hash + ptm[i]);
+	}
+	hash ^= sa_port_get(addr);
+
+	return ((hash * 2654435769U) >> 16); /* Fibonacci hashing. */
+}
+
+static mc_mgr_grp_p
+mc_mgr_grp_find(mc_mgr_p mgr, const sockaddr_storage_t *addr,
+    uint32_t if_index, uint32_t hash) {
+	mc_mgr_grp_p grp;
+
+	LIST_FOREACH(grp, &mgr->hash[(hash & MC_MGR_HASH_MASK)], hnext) {
+		if (hash == grp->hash &&
+		    if_index == grp->if_index &&
+		    0 != sa_addr_port_is_eq(addr, &grp->addr))
+			return (grp);
+	}
+	return (NULL);
+}
+
+/* Must be called with lock held. */
+static void
+mc_mgr_tmr_arm(mc_mgr_p mgr, uint64_t deadline, uint64_t time_now) {
+	uint64_t delay;
+
+	if (0 != mgr->tmr_time && mgr->tmr_time <= deadline)
+		return; /* Already armed to fire earlier. */
+	mgr->tmr_time = deadline;
+	delay = ((deadline > time_now) ?
+	    (((deadline - time_now) + 999) / 1000) : 0);
+	if (0 == delay) { /* Zero disarm timer. */
+		delay = 1;
+	}
+	tpt_ev_enable_args(1, TP_EV_TIMER, TP_F_DISPATCH, TP_FF_T_MSEC,
+	    delay, &mgr->tmr);
+}
+
+/* Must be called with lock held. */
+static void
+mc_mgr_grp_linger(mc_mgr_p mgr, mc_mgr_grp_p grp, uint64_t time_now) {
+
+	grp->state = MC_MGR_G_S_LINGER;
+	grp->time = (time_now + (((uint64_t)mgr->s.linger) * 1000));
+	TAILQ_INSERT_TAIL(&mgr->linger, grp, next);
+	mgr->stat.groups_linger ++;
+	mc_mgr_tmr_arm(mgr, grp->time, time_now);
+}
+
+static int
+mc_mgr_grp_skt_open(mc_mgr_p mgr, mc_mgr_grp_p grp) {
+	int error;
+	sockaddr_storage_t addr;
+
+	if (0 != (MC_MGR_S_F_BIND_ANY & mgr->s.flags)) {
+		sa_init(&addr, sa_family(&grp->addr), NULL, 0);
+		sa_port_set(&addr, sa_port_get(&grp->addr));
+	} else { /* Receive only this group traffic. */
+		sa_copy(&grp->addr, &addr);
+	}
+	error = skt_bind(&addr, SOCK_DGRAM, IPPROTO_UDP,
+	    (SO_F_CLOEXEC | SO_F_NONBLOCK | SO_F_REUSEADDR | SO_F_REUSEPORT),
+	    &grp->skt);
+	if (0 != error)
+		goto err_out;
+	if (0 != mgr->s.rcv_buf &&
+	    0 != skt_rcv_tune(grp->skt, mgr->s.rcv_buf, 1)) {
+		error = errno;
+		goto err_out;
+	}
+	error = skt_mc_join(grp->skt, 1, grp->if_index, &grp->addr);
+	if (0 != error)
+		goto err_out;
+
+	return (0);
+
+err_out:
+	if ((uintptr_t)-1 != grp->skt) {
+		close((int)grp->skt);
+	}
+	grp->skt = (uintptr_t)-1;
+	return (error);
+}
+
+static void
+mc_mgr_grp_skt_close(mc_mgr_grp_p grp) {
+
+	if ((uintptr_t)-1 == grp->skt)
+		return;
+	skt_mc_join(grp->skt, 0, grp->if_index, &grp->addr);
+	close((int)grp->skt);
+	grp->skt = (uintptr_t)-1;
+}
+
+/* Apply joins and leaves without lock, grouped by interface,
+ * leaves first: release memberships before new joins. */
+static void
+mc_mgr_batch_apply(mc_mgr_p mgr, struct mc_mgr_grp_head *work) {
+	mc_mgr_grp_p grp, grp_temp;
+	struct mc_mgr_grp_head done;
+	uint32_t if_index;
+
+	TAILQ_INIT(&done);
+	while (NULL != (grp = TAILQ_FIRST(work))) {
+		if_index = grp->if_index;
+		TAILQ_FOREACH_SAFE(grp, work, next, grp_temp) {
+			if (if_index != grp->if_index ||
+			    MC_MGR_G_S_LEAVING != grp->state)
+				continue;
+			mc_mgr_grp_skt_close(grp);
+			TAILQ_REMOVE(work, grp, next);
+			TAILQ_INSERT_TAIL(&done, grp, next);
+		}
+		TAILQ_FOREACH_SAFE(grp, work, next, grp_temp) {
+			if (if_index != grp->if_index)
+				continue;
+			grp->error = mc_mgr_grp_skt_open(mgr, grp);
+			TAILQ_REMOVE(work, grp, next);
+			TAILQ_INSERT_TAIL(&done, grp, next);
+		}
+	}
+	TAILQ_CONCAT(work, &done, next);
+}
+
+static void
+mc_mgr_lat_add(mc_mgr_p mgr, uint64_t lat) {
+	size_t i;
+
+	mgr->stat.lat_sum += lat;
+	if (mgr->stat.lat_max < lat) {
+		mgr->stat.lat_max = lat;
+	}
+	for (i = 0, lat >>= 6; 0 != lat && (MC_MGR_LAT_HIST_SIZE - 1) > i; i ++) {
+		lat >>= 1;
+	}
+	mgr->stat.lat_hist[i] ++;
+}
+
+static void
+mc_mgr_tmr_cb(tp_event_p ev __unused, tp_udata_p tp_udata) {
+	mc_mgr_p mgr = (mc_mgr_p)tp_udata->ident;
+	mc_mgr_grp_p grp;
+	mc_mgr_sub_p sub;
+	struct mc_mgr_grp_head work;
+	uint64_t time_now;
+
+	TAILQ_INIT(&work);
+	MTX_LOCK(&mgr->mtx);
+	mgr->tmr_time = 0;
+	time_now = mc_mgr_time_us();
+	/* Linger expired: leave. */
+	while (NULL != (grp = TAILQ_FIRST(&mgr->linger)) &&
+	    grp->time <= time_now) {
+		TAILQ_REMOVE(&mgr->linger, grp, next);
+		LIST_REMOVE(grp, hnext);
+		grp->state = MC_MGR_G_S_LEAVING;
+		mgr->stat.groups_linger --;
+		TAILQ_INSERT_TAIL(&work, grp, next);
+	}
+	/* Queued joins. */
+	TAILQ_FOREACH(grp, &mgr->join_q, next) {
+		grp->state = MC_MGR_G_S_JOINING;
+	}
+	TAILQ_CONCAT(&work, &mgr->join_q, next);
+	MTX_UNLOCK(&mgr->mtx);
+
+	if (TAILQ_EMPTY(&work))
+		goto rearm;
+	mc_mgr_batch_apply(mgr, &work);
+
+	MTX_LOCK(&mgr->mtx);
+	time_now = mc_mgr_time_us();
+	mgr->stat.batches ++;
+	while (NULL != (grp = TAILQ_FIRST(&work))) {
+		TAILQ_REMOVE(&work, grp, next);
+		if (MC_MGR_G_S_LEAVING == grp->state) {
+			mgr->stat.leaves ++;
+			mgr->stat.groups --;
+			free(grp);
+			continue;
+		}
+		if (0 != grp->error) { /* Join failed: notify and free all. */
+			mgr->stat.join_errors ++;
+			LIST_REMOVE(grp, hnext);
+			while (NULL != (sub = TAILQ_FIRST(&grp->subs))) {
+				TAILQ_REMOVE(&grp->subs, sub, next);
+				mgr->stat.subs --;
+				if (NULL != sub->cb_func) {
+					sub->cb_func(sub, grp->error,
+					    (uintptr_t)-1, sub->udata);
+				}
+				free(sub);
+			}
+			mgr->stat.groups --;
+			free(grp);
+			continue;
+		}
+		mgr->stat.joins ++;
+		mc_mgr_lat_add(mgr, (time_now - grp->time));
+		grp->state = MC_MGR_G_S_ACTIVE;
+		TAILQ_FOREACH(sub, &grp->subs, next) {
+			if (NULL == sub->cb_func)
+				continue;
+			sub->cb_func(sub, 0, grp->skt, sub->udata);
+		}
+		if (0 == grp->ref_count) { /* All leaved during join. */
+			mc_mgr_grp_linger(mgr, grp, time_now);
+		}
+	}
+	MTX_UNLOCK(&mgr->mtx);
+
+rearm:
+	MTX_LOCK(&mgr->mtx);
+	time_now = mc_mgr_time_us();
+	if (0 == TAILQ_EMPTY(&mgr->join_q)) {
+		mc_mgr_tmr_arm(mgr, (time_now +
+		    (((uint64_t)mgr->s.batch_delay) * 1000)), time_now);
+	}
+	grp = TAILQ_FIRST(&mgr->linger);
+	if (NULL != grp) {
+		mc_mgr_tmr_arm(mgr, grp->time, time_now);
+	}
+	MTX_UNLOCK(&mgr->mtx);
+}
+
+
+void
+mc_mgr_def_settings(mc_mgr_settings_p s_ret) {
+
+	if (NULL == s_ret)
+		return;
+	/* Init. */
+	memset(s_ret, 0x00, sizeof(mc_mgr_settings_t));
+
+	/* Default settings. */
+	s_ret->linger = MC_MGR_S_DEF_LINGER;
+	s_ret->batch_delay = MC_MGR_S_DEF_BATCH_DELAY;
+	s_ret->rcv_buf = MC_MGR_S_DEF_RCV_BUF;
+	s_ret->flags = MC_MGR_S_DEF_FLAGS;
+}
+
+int
+mc_mgr_create(tp_p tp, const mc_mgr_settings_t *s, mc_mgr_p *mgr_ret) {
+	int error;
+	mc_mgr_p mgr;
+	size_t i;
+
+	if (NULL == tp || NULL == s || NULL == mgr_ret)
+		return (EINVAL);
+	mgr = calloc(1, sizeof(mc_mgr_t));
+	if (NULL == mgr)
+		return (ENOMEM);
+	memcpy(&mgr->s, s, sizeof(mc_mgr_settings_t));
+	mgr->s.rcv_buf *= 1024; /* kb -> bytes */
+	MTX_INIT(&mgr->mtx);
+	TAILQ_INIT(&mgr->join_q);
+	TAILQ_INIT(&mgr->linger);
+	for (i = 0; i < MC_MGR_HASH_SIZE; i ++) {
+		LIST_INIT(&mgr->hash[i]);
+	}
+	mgr->tmr.cb_func = mc_mgr_tmr_cb;
+	mgr->tmr.ident = (uintptr_t)mgr;
+	error = tpt_ev_add_args(tp_thread_get_pvt(tp), TP_EV_TIMER,
+	    TP_F_DISPATCH, TP_FF_T_MSEC, 1000, &mgr->tmr);
+	if (0 != error) {
+		MTX_DESTROY(&mgr->mtx);
+		free(mgr);
+		return (error);
+	}
+	tpt_ev_enable_args1(0, TP_EV_TIMER, &mgr->tmr);
+
+	(*mgr_ret) = mgr;
+	return (0);
+}
+
+void
+mc_mgr_destroy(mc_mgr_p mgr) {
+	mc_mgr_grp_p grp;
+	mc_mgr_sub_p sub;
+	size_t i;
+
+	if (NULL == mgr)
+		return;
+	tpt_ev_del_args1(TP_EV_TIMER, &mgr->tmr);
+	for (i = 0; i < MC_MGR_HASH_SIZE; i ++) {
+		while (NULL != (grp = LIST_FIRST(&mgr->hash[i]))) {
+			LIST_REMOVE(grp, hnext);
+			mc_mgr_grp_skt_close(grp);
+			while (NULL != (sub = TAILQ_FIRST(&grp->subs))) {
+				TAILQ_REMOVE(&grp->subs, sub, next);
+				free(sub);
+			}
+			free(grp);
+		}
+	}
+	MTX_DESTROY(&mgr->mtx);
+	free(mgr);
+}
+
+int
+mc_mgr_join(mc_mgr_p mgr, const sockaddr_storage_t *mc_addr,
+    uint32_t if_index, mc_mgr_cb cb, void *udata, mc_mgr_sub_p *sub_ret) {
+	int error;
+	mc_mgr_grp_p grp;
+	mc_mgr_sub_p sub;
+	uint32_t hash;
+	uint64_t time_now;
+
+	if (NULL == mgr || NULL == mc_addr || NULL == sub_ret)
+		return (EINVAL);
+	if (AF_INET != sa_family(mc_addr) && AF_INET6 != sa_family(mc_addr))
+		return (EAFNOSUPPORT);
+	if (0 == sa_addr_is_multicast(mc_addr))
+		return (EINVAL);
+	sub = calloc(1, sizeof(mc_mgr_sub_t));
+	if (NULL == sub)
+		return (ENOMEM);
+	sub->cb_func = cb;
+	sub->udata = udata;
+	hash = mc_mgr_hash(mc_addr, if_index);
+
+	MTX_LOCK(&mgr->mtx);
+	time_now = mc_mgr_time_us();
+	mgr->stat.join_req ++;
+	grp = mc_mgr_grp_find(mgr, mc_addr, if_index, hash);
+	if (NULL == grp) { /* New group: queue join. */
+		grp = calloc(1, sizeof(mc_mgr_grp_t));
+		if (NULL == grp) {
+			MTX_UNLOCK(&mgr->mtx);
+			free(sub);
+			return (ENOMEM);
+		}
+		TAILQ_INIT(&grp->subs);
+		grp->mgr = mgr;
+		sa_copy(mc_addr, &grp->addr);
+		grp->if_index = if_index;
+		grp->hash = hash;
+		grp->state = MC_MGR_G_S_JOIN_Q;
+		grp->skt = (uintptr_t)-1;
+		grp->time = time_now;
+		LIST_INSERT_HEAD(&mgr->hash[(hash & MC_MGR_HASH_MASK)],
+		    grp, hnext);
+		TAILQ_INSERT_TAIL(&mgr->join_q, grp, next);
+		mgr->stat.groups ++;
+		mc_mgr_tmr_arm(mgr, (time_now +
+		    (((uint64_t)mgr->s.batch_delay) * 1000)), time_now);
+	} else {
+		mgr->stat.join_reuse ++;
+		if (MC_MGR_G_S_LINGER == grp->state) { /* Zapping back. */
+			TAILQ_REMOVE(&mgr->linger, grp, next);
+			grp->state = MC_MGR_G_S_ACTIVE;
+			mgr->stat.groups_linger --;
+			mgr->stat.join_rescued ++;
+		}
+	}
+	grp->ref_count ++;
+	TAILQ_INSERT_TAIL(&grp->subs, sub, next);
+	sub->grp = grp;
+	mgr->stat.subs ++;
+	error = ((MC_MGR_G_S_ACTIVE == grp->state) ? 0 : EINPROGRESS);
+	MTX_UNLOCK(&mgr->mtx);
+
+	(*sub_ret) = sub;
+	return (error);
+}
+
+void
+mc_mgr_leave(mc_mgr_sub_p sub) {
+	mc_mgr_grp_p grp;
+	mc_mgr_p mgr;
+
+	if (NULL == sub)
+		return;
+	grp = sub->grp;
+	mgr = grp->mgr;
+
+	MTX_LOCK(&mgr->mtx);
+	TAILQ_REMOVE(&grp->subs, sub, next);
+	grp->ref_count --;
+	mgr->stat.subs --;
+	if (0 == grp->ref_count) {
+		switch (grp->state) {
+		case MC_MGR_G_S_JOIN_Q: /* Not joined yet: cancel. */
+			TAILQ_REMOVE(&mgr->join_q, grp, next);
+			LIST_REMOVE(grp, hnext);
+			mgr->stat.groups --;
+			free(grp);
+			break;
+		case MC_MGR_G_S_ACTIVE:
+			mc_mgr_grp_linger(mgr, grp, mc_mgr_time_us());
+			break;
+		/* MC_MGR_G_S_JOINING: linger after join complete. */
+		}
+	}
+	MTX_UNLOCK(&mgr->mtx);
+	free(sub);
+}
+
+uintptr_t
+mc_mgr_sub_skt_get(mc_mgr_sub_p sub) {
+	uintptr_t skt = (uintptr_t)-1;
+	mc_mgr_p mgr;
+
+	if (NULL == sub)
+		return (skt);
+	mgr = sub->grp->mgr;
+	MTX_LOCK(&mgr->mtx);
+	if (MC_MGR_G_S_ACTIVE == sub->grp->state) {
+		skt = sub->grp->skt;
+	}
+	MTX_UNLOCK(&mgr->mtx);
+
+	return (skt);
+}
+
+int
+mc_mgr_stat_get(mc_mgr_p mgr, mc_mgr_stat_p stat) {
+
+	if (NULL == mgr || NULL == stat)
+		return (EINVAL);
+	MTX_LOCK(&mgr->mtx);
+	memcpy(stat, &mgr->stat, sizeof(mc_mgr_stat_t));
+	MTX_UNLOCK(&mgr->mtx);
+
+	return (0);
+}
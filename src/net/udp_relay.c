@@ -0,0 +1,1064 @@
+/*-
+ * Copyright (c) 2011-2026 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * UDP to stream relay.
+ * Single client: own ring (recvmmsg() slots + sendmsg(), optionally with
+ * MSG_ZEROCOPY) or splice() via pipe.
+ * Many clients: fan-out ring buffer.
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/uio.h> /* struct iovec */
+#include <netinet/in.h>
+#include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, read */
+#include <fcntl.h>
+#include <string.h> /* memcpy, memmove, memset, strerror... */
+#include <errno.h>
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#	include <linux/errqueue.h>
+#	define UDP_RELAY_ZEROCOPY	1
+#endif
+
+#include "utils/macro.h"
+#include "al/os.h"
+#include "threadpool/threadpool_task.h"
+#include "net/socket.h"
+#include "utils/ring_buffer_fanout.h"
+#include "net/udp_relay.h"
+
+
+#define UDP_RELAY_PKTS_MAX	256 /* Max datagrams per recvmmsg() call. */
+#define UDP_RELAY_RCV_LOOP_MAX	16 /* Max recv calls per wakeup. */
+#define UDP_RELAY_ZC_FIFO_MAX	64 /* Max MSG_ZEROCOPY sends in flight. */
+#define UDP_RELAY_SEL_WAKEUPS	64 /* Path selection window. */
+
+
+typedef struct udp_relay_zc_s { /* MSG_ZEROCOPY send in flight. */
+	uint32_t	seq;		/* Kernel send number. */
+	uint64_t	end;		/* Ring pos released on completion. */
+} udp_relay_zc_t, *udp_relay_zc_p;
+
+typedef struct udp_relay_clnt_s {
+	TAILQ_ENTRY(udp_relay_clnt_s) next;
+	udp_relay_p	relay;
+	uintptr_t	skt;
+	tp_task_p	tptask;		/* Single: notify socket ready for write. */
+	r_buf_fo_rdr_p	rdr;		/* Fan-out reader. */
+	uint32_t	flags;		/* UDP_RELAY_CLNT_F_* */
+	uint32_t	zc_seq;		/* Next MSG_ZEROCOPY send number. */
+	udp_relay_clnt_cb cb_func;
+	void		*udata;
+} udp_relay_clnt_t;
+
+TAILQ_HEAD(udp_relay_clnt_head, udp_relay_clnt_s);
+
+#define UDP_RELAY_CLNT_F_SND_WAIT	(((uint32_t)1) << 0) /* tptask started: wait for socket. */
+#define UDP_RELAY_CLNT_F_ZEROCOPY	(((uint32_t)1) << 1) /* SO_ZEROCOPY enabled. */
+
+
+typedef struct udp_relay_s {
+	tpt_p		tpt;
+	tp_task_p	tptask;		/* Notify: UDP socket ready for read. */
+	struct udp_relay_clnt_head clnts;
+	size_t		clnt_count;
+	udp_relay_clnt_p single;	/* Client served by own ring / pipe. */
+	r_buf_fo_p	fo;		/* Fan-out: 2 and more clients. */
+	uint32_t	path;		/* UDP_RELAY_PATH_* */
+	uint32_t	flags;		/* UDP_RELAY_S_F_*, runtime. */
+	/* Single client ring, absolute positions: done <= snd <= wr. */
+	uint8_t		*ring;
+	uint64_t	wr;		/* Write pos. */
+	uint64_t	snd;		/* Send pos. */
+	uint64_t	done;		/* Released pos: sent and ZC completed. */
+	uint64_t	pad_pos;	/* Unused ring tail before wrap. */
+	uint64_t	pad_end;
+	udp_relay_zc_t	zc[UDP_RELAY_ZC_FIFO_MAX]; /* Circular. */
+	size_t		zc_idx;		/* First in flight. */
+	size_t		zc_count;
+	/* Splice. */
+	int		pipe_fd[2];
+	size_t		pipe_used;	/* Data size in pipe. */
+	/* Path selection. */
+	uint64_t	sel_wakeups;
+	uint64_t	sel_pkts;
+	/* Receive. */
+	struct iovec	*iov;
+	size_t		*pkt_sizes;
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr	*msgs;
+#endif
+	uint8_t		*scratch;	/* Dropped datagrams. */
+	udp_relay_stat_t stat;
+	udp_relay_settings_t s;
+} udp_relay_t;
+
+
+static int	udp_relay_rcv_cb(tp_task_p tptask, int error,
+		    uint32_t eof, size_t data2transfer_size, void *udata);
+static int	udp_relay_clnt_notify_cb(tp_task_p tptask, int error,
+		    uint32_t eof, size_t data2transfer_size, void *udata);
+static void	udp_relay_fo_rdr_cb(r_buf_fo_rdr_p rdr, int error, void *udata);
+
+
+void
+udp_relay_def_settings(udp_relay_settings_p s_ret) {
+
+	if (NULL == s_ret)
+		return;
+	/* Init. */
+	memset(s_ret, 0x00, sizeof(udp_relay_settings_t));
+
+	/* Default settings. */
+	s_ret->pkt_size_max = UDP_RELAY_S_DEF_PKT_SIZE_MAX;
+	s_ret->pkts_max = UDP_RELAY_S_DEF_PKTS_MAX;
+	s_ret->ring_size = UDP_RELAY_S_DEF_RING_SIZE;
+	s_ret->pipe_size = UDP_RELAY_S_DEF_PIPE_SIZE;
+	s_ret->zc_min = UDP_RELAY_S_DEF_ZC_MIN;
+	s_ret->splice_pkts_max = UDP_RELAY_S_DEF_SPLICE_PKTS_MAX;
+	r_buf_fo_def_settings(&s_ret->fo);
+	s_ret->flags = UDP_RELAY_S_DEF_FLAGS;
+}
+
+int
+udp_relay_create(tpt_p tpt, uintptr_t skt, udp_relay_settings_p s,
+    udp_relay_p *relay_ret) {
+	int error, tm;
+	size_t batch_size;
+	udp_relay_p relay;
+
+	if (NULL == tpt || (uintptr_t)-1 == skt || NULL == s ||
+	    NULL == relay_ret)
+		return (EINVAL);
+	if (0 == s->pkt_size_max || 0 == s->pkts_max ||
+	    UDP_RELAY_PKTS_MAX < s->pkts_max)
+		return (EINVAL);
+	batch_size = (s->pkt_size_max * s->pkts_max);
+	if ((2 * batch_size) > s->ring_size ||
+	    (2 * batch_size) > s->fo.ring_size)
+		return (EINVAL);
+	relay = calloc(1, sizeof(udp_relay_t));
+	if (NULL == relay)
+		return (ENOMEM);
+	relay->tpt = tpt;
+	TAILQ_INIT(&relay->clnts);
+	relay->path = UDP_RELAY_PATH_NONE;
+	relay->pipe_fd[0] = -1;
+	relay->pipe_fd[1] = -1;
+	memcpy(&relay->s, s, sizeof(udp_relay_settings_t));
+	relay->flags = s->flags;
+	relay->stat.path_cur = UDP_RELAY_PATH_NONE;
+#ifndef UDP_RELAY_ZEROCOPY
+	relay->flags |= UDP_RELAY_S_F_NO_ZEROCOPY;
+#endif
+#ifndef HAVE_SPLICE
+	relay->flags |= UDP_RELAY_S_F_NO_SPLICE;
+#endif
+
+	relay->ring = malloc(s->ring_size);
+	relay->scratch = malloc(s->pkt_size_max);
+	relay->iov = calloc(s->pkts_max, sizeof(struct iovec));
+	relay->pkt_sizes = calloc(s->pkts_max, sizeof(size_t));
+#ifdef HAVE_RECVMMSG
+	relay->msgs = calloc(s->pkts_max, sizeof(struct mmsghdr));
+	if (NULL == relay->msgs) {
+		error = ENOMEM;
+		goto err_out;
+	}
+#endif
+	if (NULL == relay->ring || NULL == relay->scratch ||
+	    NULL == relay->iov || NULL == relay->pkt_sizes) {
+		error = ENOMEM;
+		goto err_out;
+	}
+	/* Socket must not block: all datagrams read in loop. */
+	tm = fcntl((int)skt, F_GETFL);
+	if (-1 == tm ||
+	    -1 == fcntl((int)skt, F_SETFL, (tm | O_NONBLOCK))) {
+		error = errno;
+		goto err_out;
+	}
+#ifdef HAVE_SPLICE
+	if (0 == (UDP_RELAY_S_F_NO_SPLICE & relay->flags)) {
+		if (-1 == pipe2(relay->pipe_fd, (O_CLOEXEC | O_NONBLOCK))) {
+			relay->pipe_fd[0] = -1;
+			relay->pipe_fd[1] = -1;
+			relay->flags |= UDP_RELAY_S_F_NO_SPLICE;
+		} else {
+#ifdef F_SETPIPE_SZ
+			/* Optional: default pipe size is 64k. */
+			fcntl(relay->pipe_fd[1], F_SETPIPE_SZ,
+			    (int)s->pipe_size);
+#endif
+		}
+	}
+#endif
+	/* Started on first client. */
+	error = tp_task_notify_create(tpt, skt,
+	    ((0 != (UDP_RELAY_S_F_CLOSE_SKT & s->flags)) ?
+	     TP_TASK_F_CLOSE_ON_DESTROY : 0),
+	    TP_EV_READ, 0, udp_relay_rcv_cb, relay, &relay->tptask);
+	if (0 != error)
+		goto err_out;
+	tp_task_stop(relay->tptask);
+
+	(*relay_ret) = relay;
+	return (0);
+
+err_out:
+	if (-1 != relay->pipe_fd[0]) {
+		close(relay->pipe_fd[0]);
+		close(relay->pipe_fd[1]);
+	}
+#ifdef HAVE_RECVMMSG
+	free(relay->msgs);
+#endif
+	free(relay->pkt_sizes);
+	free(relay->iov);
+	free(relay->scratch);
+	free(relay->ring);
+	free(relay);
+	return (error);
+}
+
+void
+udp_relay_destroy(udp_relay_p relay) {
+
+	if (NULL == relay)
+		return;
+	debugd_break_if(0 != relay->clnt_count);
+	tp_task_destroy(relay->tptask);
+	if (NULL != relay->fo) {
+		r_buf_fo_destroy(relay->fo);
+	}
+	if (-1 != relay->pipe_fd[0]) {
+		close(relay->pipe_fd[0]);
+		close(relay->pipe_fd[1]);
+	}
+#ifdef HAVE_RECVMMSG
+	free(relay->msgs);
+#endif
+	free(relay->pkt_sizes);
+	free(relay->iov);
+	free(relay->scratch);
+	free(relay->ring);
+	free(relay);
+}
+
+tpt_p
+udp_relay_tpt_get(udp_relay_p relay) {
+
+	if (NULL == relay)
+		return (NULL);
+	return (relay->tpt);
+}
+
+int
+udp_relay_stat_get(udp_relay_p relay, udp_relay_stat_p stat) {
+
+	if (NULL == relay || NULL == stat)
+		return (EINVAL);
+	memcpy(stat, &relay->stat, sizeof(udp_relay_stat_t));
+	stat->path_cur = relay->path;
+	stat->clnt_count = relay->clnt_count;
+
+	return (0);
+}
+
+
+/* Receive up to count datagrams to iov slots, return datagrams count,
+ * pkt_sizes[i] = 0 for truncated. */
+static size_t
+udp_relay_recv(udp_relay_p relay, size_t count) {
+	size_t i;
+	ssize_t ios;
+#ifdef HAVE_RECVMMSG
+	int ret;
+
+	for (i = 0; i < count; i ++) {
+		memset(&relay->msgs[i].msg_hdr, 0x00, sizeof(struct msghdr));
+		relay->msgs[i].msg_hdr.msg_iov = &relay->iov[i];
+		relay->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	ret = recvmmsg((int)tp_task_ident_get(relay->tptask), relay->msgs,
+	    (unsigned int)count, MSG_DONTWAIT, NULL);
+	if (-1 == ret)
+		return (0);
+	for (i = 0; i < (size_t)ret; i ++) {
+		ios = relay->msgs[i].msg_len;
+		relay->pkt_sizes[i] = ((0 != (MSG_TRUNC & relay->msgs[i].msg_hdr.msg_flags)) ?
+		    0 : (size_t)ios);
+	}
+#else
+	struct msghdr mhdr;
+
+	for (i = 0; i < count; i ++) {
+		memset(&mhdr, 0x00, sizeof(mhdr));
+		mhdr.msg_iov = &relay->iov[i];
+		mhdr.msg_iovlen = 1;
+		ios = recvmsg((int)tp_task_ident_get(relay->tptask), &mhdr,
+		    MSG_DONTWAIT);
+		if (-1 == ios)
+			break;
+		relay->pkt_sizes[i] = ((0 != (MSG_TRUNC & mhdr.msg_flags)) ?
+		    0 : (size_t)ios);
+	}
+#endif
+	relay->stat.path[relay->path].rcv_calls ++;
+
+	return (i);
+}
+
+/* Receive up to count datagrams to buf slots and pack them,
+ * return data size. */
+static size_t
+udp_relay_recv_pack(udp_relay_p relay, uint8_t *buf, size_t count,
+    size_t *pkts_ret) {
+	size_t i, pkts, data_size = 0;
+	udp_relay_path_stat_p pstat = &relay->stat.path[relay->path];
+
+	for (i = 0; i < count; i ++) {
+		relay->iov[i].iov_base = (buf + (i * relay->s.pkt_size_max));
+		relay->iov[i].iov_len = relay->s.pkt_size_max;
+	}
+	pkts = udp_relay_recv(relay, count);
+	for (i = 0; i < pkts; i ++) {
+		if (0 == relay->pkt_sizes[i]) { /* Too big or empty. */
+			relay->stat.drop_pkts ++;
+			relay->stat.drop_size += relay->s.pkt_size_max;
+			continue;
+		}
+		/* Close gap after short datagram. */
+		if ((buf + data_size) != relay->iov[i].iov_base) {
+			memmove((buf + data_size), relay->iov[i].iov_base,
+			    relay->pkt_sizes[i]);
+		}
+		data_size += relay->pkt_sizes[i];
+		pstat->rcv_pkts ++;
+	}
+	pstat->rcv_size += data_size;
+	relay->sel_pkts += pkts;
+	(*pkts_ret) = pkts;
+
+	return (data_size);
+}
+
+/* Read and drop up to count datagrams, return 0 if socket is empty. */
+static size_t
+udp_relay_recv_drop(udp_relay_p relay, size_t count) {
+	size_t i;
+	ssize_t ios;
+
+	for (i = 0; i < count; i ++) {
+		ios = recv((int)tp_task_ident_get(relay->tptask),
+		    relay->scratch, relay->s.pkt_size_max, MSG_DONTWAIT);
+		if (-1 == ios)
+			break;
+		relay->stat.drop_pkts ++;
+		relay->stat.drop_size += (size_t)ios;
+	}
+
+	return (i);
+}
+
+
+/* Single client ring. */
+static void
+udp_relay_ring_reset(udp_relay_p relay) {
+
+	relay->snd = relay->wr;
+	relay->done = relay->wr;
+	relay->pad_pos = 0;
+	relay->pad_end = 0;
+	relay->zc_idx = 0;
+	relay->zc_count = 0;
+}
+
+static inline uint64_t
+udp_relay_ring_pos_inc(udp_relay_p relay, uint64_t pos, size_t size) {
+	uint64_t ret = (pos + size);
+
+	if (pos < relay->pad_pos && ret > relay->pad_pos) {
+		ret += (relay->pad_end - relay->pad_pos);
+	}
+	if (ret >= relay->pad_pos && ret < relay->pad_end) {
+		ret = relay->pad_end;
+	}
+
+	return (ret);
+}
+
+/* Up to 2 iovecs from snd to wr, pad skipped. */
+static size_t
+udp_relay_ring_iov(udp_relay_p relay, struct iovec *iov, size_t *size_ret) {
+	size_t cnt = 0, size = 0;
+	uint64_t pos, end, off;
+
+	pos = udp_relay_ring_pos_inc(relay, relay->snd, 0);
+	while (pos < relay->wr && 2 > cnt) {
+		off = (pos % relay->s.ring_size);
+		end = MIN(relay->wr, ((pos - off) + relay->s.ring_size));
+		if (pos < relay->pad_pos && end > relay->pad_pos) {
+			end = relay->pad_pos;
+		}
+		iov[cnt].iov_base = (relay->ring + off);
+		iov[cnt].iov_len = (size_t)(end - pos);
+		size += iov[cnt].iov_len;
+		cnt ++;
+		pos = udp_relay_ring_pos_inc(relay, end, 0);
+	}
+	(*size_ret) = size;
+
+	return (cnt);
+}
+
+static void
+udp_relay_rcv_ring(udp_relay_p relay) {
+	size_t i, count, pkts, free_size, cont_size;
+	uint64_t off;
+
+	for (i = 0; i < UDP_RELAY_RCV_LOOP_MAX; i ++) {
+		free_size = (size_t)(relay->s.ring_size - (relay->wr - relay->done));
+		off = (relay->wr % relay->s.ring_size);
+		cont_size = (size_t)(relay->s.ring_size - off);
+		if (cont_size < relay->s.pkt_size_max &&
+		    free_size >= (cont_size + relay->s.pkt_size_max)) {
+			/* Wrap: ring tail too small for datagram. */
+			relay->pad_pos = relay->wr;
+			relay->wr += cont_size;
+			relay->pad_end = relay->wr;
+			free_size -= cont_size;
+			cont_size = relay->s.ring_size;
+			off = 0;
+		}
+		count = MIN(relay->s.pkts_max,
+		    (MIN(free_size, cont_size) / relay->s.pkt_size_max));
+		if (0 == count) { /* Ring full: client too slow. */
+			udp_relay_recv_drop(relay, relay->s.pkts_max);
+			return;
+		}
+		relay->wr += udp_relay_recv_pack(relay, (relay->ring + off),
+		    count, &pkts);
+		if (pkts < count)
+			return; /* Socket is empty. */
+	}
+}
+
+#ifdef UDP_RELAY_ZEROCOPY
+/* Read MSG_ZEROCOPY completions and release ring space,
+ * return completion notifications count. */
+static size_t
+udp_relay_zc_reap(udp_relay_p relay, udp_relay_clnt_p clnt) {
+	size_t ret = 0;
+	uint32_t hi;
+	ssize_t ios;
+	struct msghdr mhdr;
+	struct cmsghdr *cmsg;
+	struct sock_extended_err *serr;
+	uint8_t cbuf[CMSG_SPACE(sizeof(struct sock_extended_err) +
+	    sizeof(struct sockaddr_storage))];
+
+	if (0 == relay->zc_count)
+		return (0);
+	for (;;) {
+		memset(&mhdr, 0x00, sizeof(mhdr));
+		mhdr.msg_control = cbuf;
+		mhdr.msg_controllen = sizeof(cbuf);
+		ios = recvmsg((int)clnt->skt, &mhdr,
+		    (MSG_ERRQUEUE | MSG_DONTWAIT));
+		if (-1 == ios)
+			break;
+		for (cmsg = CMSG_FIRSTHDR(&mhdr); NULL != cmsg;
+		    cmsg = CMSG_NXTHDR(&mhdr, cmsg)) {
+			if ((SOL_IP != cmsg->cmsg_level ||
+			     IP_RECVERR != cmsg->cmsg_type) &&
+			    (SOL_IPV6 != cmsg->cmsg_level ||
+			     IPV6_RECVERR != cmsg->cmsg_type))
+				continue;
+			serr = (struct sock_extended_err*)(void*)CMSG_DATA(cmsg);
+			if (SO_EE_ORIGIN_ZEROCOPY != serr->ee_origin ||
+			    0 != serr->ee_errno)
+				continue;
+			ret ++;
+			if (0 != (SO_EE_CODE_ZEROCOPY_COPIED & serr->ee_code)) {
+				/* Kernel copied data anyway: no profit. */
+				relay->stat.zc_copied ++;
+				clnt->flags &= ~UDP_RELAY_CLNT_F_ZEROCOPY;
+				if (UDP_RELAY_PATH_ZEROCOPY == relay->path) {
+					relay->path = UDP_RELAY_PATH_COPY;
+				}
+			}
+			/* Range [ee_info, ee_data], TCP completes in order. */
+			hi = serr->ee_data;
+			while (0 != relay->zc_count &&
+			    0 >= (int32_t)(relay->zc[relay->zc_idx].seq - hi)) {
+				relay->done = relay->zc[relay->zc_idx].end;
+				relay->zc_idx = ((relay->zc_idx + 1) % UDP_RELAY_ZC_FIFO_MAX);
+				relay->zc_count --;
+			}
+		}
+	}
+	if (0 == relay->zc_count) {
+		relay->done = relay->snd;
+	}
+
+	return (ret);
+}
+#endif
+
+/* Return: 0 - all data sent, EAGAIN - wait for socket, other - error. */
+static int
+udp_relay_ring_snd(udp_relay_p relay, udp_relay_clnt_p clnt) {
+	int error, flags;
+	uint32_t path = UDP_RELAY_PATH_COPY;
+	size_t iov_cnt, data_size;
+	ssize_t ios;
+	struct msghdr mhdr;
+	struct iovec iov[2];
+
+	relay->snd = udp_relay_ring_pos_inc(relay, relay->snd, 0);
+	iov_cnt = udp_relay_ring_iov(relay, iov, &data_size);
+	if (0 == iov_cnt)
+		return (0);
+	memset(&mhdr, 0x00, sizeof(mhdr));
+	mhdr.msg_iov = iov;
+	mhdr.msg_iovlen = iov_cnt;
+	flags = (MSG_DONTWAIT | MSG_NOSIGNAL);
+#ifdef UDP_RELAY_ZEROCOPY
+	if (0 != (UDP_RELAY_CLNT_F_ZEROCOPY & clnt->flags) &&
+	    data_size >= relay->s.zc_min &&
+	    UDP_RELAY_ZC_FIFO_MAX > relay->zc_count) {
+		flags |= MSG_ZEROCOPY;
+		path = UDP_RELAY_PATH_ZEROCOPY;
+	}
+retry:
+#endif
+	ios = sendmsg((int)clnt->skt, &mhdr, flags);
+	relay->stat.path[path].snd_calls ++;
+	if (-1 == ios) {
+		error = errno;
+#ifdef UDP_RELAY_ZEROCOPY
+		if (ENOBUFS == error &&
+		    UDP_RELAY_PATH_ZEROCOPY == path) { /* optmem limit. */
+			flags &= ~MSG_ZEROCOPY;
+			path = UDP_RELAY_PATH_COPY;
+			goto retry;
+		}
+#endif
+		error = SKT_ERR_FILTER(error);
+		if (0 == error)
+			return (EAGAIN);
+		return (error);
+	}
+	relay->stat.path[path].snd_size += (uint64_t)ios;
+	relay->snd = udp_relay_ring_pos_inc(relay, relay->snd, (size_t)ios);
+	if (UDP_RELAY_PATH_ZEROCOPY == path) {
+		/* Pages pinned by kernel until completion. */
+		relay->zc[((relay->zc_idx + relay->zc_count) % UDP_RELAY_ZC_FIFO_MAX)].seq = clnt->zc_seq;
+		relay->zc[((relay->zc_idx + relay->zc_count) % UDP_RELAY_ZC_FIFO_MAX)].end = relay->snd;
+		relay->zc_count ++;
+		clnt->zc_seq ++;
+	} else if (0 != relay->zc_count) {
+		/* Released with last ZC send. */
+		relay->zc[((relay->zc_idx + relay->zc_count - 1) % UDP_RELAY_ZC_FIFO_MAX)].end = relay->snd;
+	} else {
+		relay->done = relay->snd;
+	}
+	if ((size_t)ios < data_size) /* Socket buf full. */
+		return (EAGAIN);
+
+	return (0);
+}
+
+
+/* Splice: UDP socket -> pipe -> client socket.
+ * Return: 0 - ok, EOPNOTSUPP - splice() not supported for socket. */
+static int
+udp_relay_rcv_splice(udp_relay_p relay) {
+#ifdef HAVE_SPLICE
+	int error;
+	size_t i;
+	ssize_t ios;
+	udp_relay_path_stat_p pstat = &relay->stat.path[UDP_RELAY_PATH_SPLICE];
+
+	for (i = 0; i < (UDP_RELAY_RCV_LOOP_MAX * relay->s.pkts_max); i ++) {
+		/* One datagram per call. */
+		ios = splice((int)tp_task_ident_get(relay->tptask), NULL,
+		    relay->pipe_fd[1], NULL, relay->s.pkt_size_max,
+		    SPLICE_F_NONBLOCK);
+		pstat->rcv_calls ++;
+		if (-1 == ios) {
+			error = errno;
+			if (EAGAIN != error && EINTR != error) {
+				if (0 != i || 0 != relay->pipe_used)
+					return (0);
+				return (EOPNOTSUPP);
+			}
+			/* Socket is empty or pipe is full. */
+			if (-1 == recv((int)tp_task_ident_get(relay->tptask),
+			    relay->scratch, 1, (MSG_PEEK | MSG_DONTWAIT)))
+				return (0);
+			/* Pipe full: client too slow. */
+			if (0 == udp_relay_recv_drop(relay, 1))
+				return (0);
+			continue;
+		}
+		if (0 == ios)
+			return (0);
+		relay->pipe_used += (size_t)ios;
+		relay->sel_pkts ++;
+		pstat->rcv_pkts ++;
+		pstat->rcv_size += (uint64_t)ios;
+	}
+
+	return (0);
+#else
+	return (EOPNOTSUPP);
+#endif
+}
+
+static int
+udp_relay_pipe_snd(udp_relay_p relay, udp_relay_clnt_p clnt) {
+#ifdef HAVE_SPLICE
+	int error;
+	ssize_t ios;
+	udp_relay_path_stat_p pstat = &relay->stat.path[UDP_RELAY_PATH_SPLICE];
+
+	if (0 == relay->pipe_used)
+		return (0);
+	ios = splice(relay->pipe_fd[0], NULL, (int)clnt->skt, NULL,
+	    relay->pipe_used, (SPLICE_F_NONBLOCK | SPLICE_F_MOVE));
+	pstat->snd_calls ++;
+	if (-1 == ios) {
+		error = errno;
+		error = SKT_ERR_FILTER(error);
+		if (0 == error)
+			return (EAGAIN);
+		return (error);
+	}
+	relay->pipe_used -= (size_t)ios;
+	pstat->snd_size += (uint64_t)ios;
+	if (0 != relay->pipe_used)
+		return (EAGAIN);
+#endif
+	return (0);
+}
+
+
+static void
+udp_relay_rcv_fo(udp_relay_p relay) {
+	size_t i, pkts, data_size, batch_size;
+	uint8_t *buf = NULL;
+	udp_relay_path_stat_p pstat = &relay->stat.path[UDP_RELAY_PATH_FANOUT];
+
+	batch_size = (relay->s.pkts_max * relay->s.pkt_size_max);
+	for (i = 0; i < UDP_RELAY_RCV_LOOP_MAX; i ++) {
+		if (r_buf_fo_wbuf_get(relay->fo, batch_size, &buf) < batch_size ||
+		    NULL == buf) {
+			udp_relay_recv_drop(relay, relay->s.pkts_max);
+			return;
+		}
+		/* Receive directly to ring slots. */
+		data_size = udp_relay_recv_pack(relay, buf, relay->s.pkts_max,
+		    &pkts);
+		if (0 != data_size) {
+			if (data_size < relay->s.fo.min_block_size ||
+			    0 != r_buf_fo_wbuf_set(relay->fo, 0, data_size,
+			    R_BUF_FO_WR_F_SYNC)) {
+				relay->stat.drop_pkts += pkts;
+				relay->stat.drop_size += data_size;
+			} else {
+				pstat->snd_size += data_size;
+				pstat->snd_calls ++;
+			}
+		}
+		if (pkts < relay->s.pkts_max)
+			return; /* Socket is empty. */
+	}
+}
+
+
+static inline uint32_t
+udp_relay_path_ring(udp_relay_p relay, udp_relay_clnt_p clnt) {
+
+	if (0 != (UDP_RELAY_S_F_NO_ZEROCOPY & relay->flags) ||
+	    0 == (UDP_RELAY_CLNT_F_ZEROCOPY & clnt->flags))
+		return (UDP_RELAY_PATH_COPY);
+	return (UDP_RELAY_PATH_ZEROCOPY);
+}
+
+/* Single client: splice() cost is syscalls per datagram, ring cost is
+ * copy to user space, select by avg datagrams per wakeup. */
+static void
+udp_relay_path_select(udp_relay_p relay) {
+	uint64_t limit;
+
+	relay->sel_wakeups ++;
+	if (UDP_RELAY_SEL_WAKEUPS > relay->sel_wakeups)
+		return;
+	limit = (relay->s.splice_pkts_max * relay->sel_wakeups);
+	if (NULL == relay->single ||
+	    UDP_RELAY_PATH_FANOUT == relay->path) {
+		/* Nothing to select. */
+	} else if (UDP_RELAY_PATH_SPLICE == relay->path) {
+		/* Previous path backlog must be sent before switch. */
+		if (relay->sel_pkts > limit &&
+		    relay->snd == relay->wr) {
+			relay->path = udp_relay_path_ring(relay, relay->single);
+			relay->stat.switches ++;
+		}
+	} else if (0 == (UDP_RELAY_S_F_NO_SPLICE & relay->flags)) {
+		if ((2 * relay->sel_pkts) <= limit &&
+		    0 == relay->pipe_used) {
+			relay->path = UDP_RELAY_PATH_SPLICE;
+			relay->stat.switches ++;
+		}
+	}
+	relay->sel_wakeups = 0;
+	relay->sel_pkts = 0;
+}
+
+
+/* Return: 0 - all data sent, EAGAIN - wait for socket, other - error. */
+static int
+udp_relay_clnt_snd(udp_relay_p relay, udp_relay_clnt_p clnt) {
+	int error;
+
+	/* Previous path backlog first. */
+	if (UDP_RELAY_PATH_SPLICE == relay->path) {
+		error = udp_relay_ring_snd(relay, clnt);
+		if (0 != error)
+			return (error);
+		return (udp_relay_pipe_snd(relay, clnt));
+	}
+	error = udp_relay_pipe_snd(relay, clnt);
+	if (0 != error)
+		return (error);
+	return (udp_relay_ring_snd(relay, clnt));
+}
+
+static void
+udp_relay_single_reset(udp_relay_p relay) {
+#ifdef HAVE_SPLICE
+	/* Drop stale data. */
+	while (0 != relay->pipe_used &&
+	    0 < read(relay->pipe_fd[0], relay->scratch, relay->s.pkt_size_max))
+		;
+#endif
+	relay->pipe_used = 0;
+	udp_relay_ring_reset(relay);
+	relay->sel_wakeups = 0;
+	relay->sel_pkts = 0;
+}
+
+/* Single client backlog sent: continue as fan-out reader. */
+static int
+udp_relay_clnt_fo_move(udp_relay_p relay, udp_relay_clnt_p clnt) {
+
+	tp_task_destroy(clnt->tptask);
+	clnt->tptask = NULL;
+	clnt->flags &= ~UDP_RELAY_CLNT_F_SND_WAIT;
+	relay->single = NULL;
+	udp_relay_single_reset(relay);
+
+	return (r_buf_fo_rdr_add(relay->fo, relay->tpt, clnt->skt,
+	    udp_relay_fo_rdr_cb, clnt, &clnt->rdr));
+}
+
+static int
+udp_relay_clnt_snd_handle(udp_relay_p relay, udp_relay_clnt_p clnt) {
+	int error;
+
+	error = udp_relay_clnt_snd(relay, clnt);
+	if (0 == error &&
+	    UDP_RELAY_PATH_FANOUT == relay->path &&
+	    0 == relay->zc_count) {
+		error = udp_relay_clnt_fo_move(relay, clnt);
+		if (0 == error)
+			return (TP_TASK_CB_NONE);
+		goto err_out;
+	}
+	switch (error) {
+	case 0: /* All sent, wait for data. */
+		if (0 != (UDP_RELAY_CLNT_F_SND_WAIT & clnt->flags)) {
+			tp_task_stop(clnt->tptask);
+			clnt->flags &= ~UDP_RELAY_CLNT_F_SND_WAIT;
+		}
+		return (TP_TASK_CB_NONE);
+	case EAGAIN: /* Wait for socket. */
+		if (0 == (UDP_RELAY_CLNT_F_SND_WAIT & clnt->flags)) {
+			error = tp_task_restart(clnt->tptask);
+			if (0 != error)
+				break;
+			clnt->flags |= UDP_RELAY_CLNT_F_SND_WAIT;
+		}
+		return (TP_TASK_CB_CONTINUE);
+	}
+err_out:
+	tp_task_stop(clnt->tptask);
+	clnt->flags &= ~UDP_RELAY_CLNT_F_SND_WAIT;
+	clnt->cb_func(clnt, error, clnt->udata); /* clnt can be freed here. */
+
+	return (TP_TASK_CB_NONE);
+}
+
+static int
+udp_relay_clnt_notify_cb(tp_task_p tptask, int error,
+    uint32_t eof __unused, size_t data2transfer_size __unused,
+    void *udata) {
+	udp_relay_clnt_p clnt = udata;
+
+	debugd_break_if(NULL == clnt);
+	debugd_break_if(tptask != clnt->tptask);
+
+#ifdef UDP_RELAY_ZEROCOPY
+	/* ZC completions in error queue reported as EPOLLERR. */
+	if (0 != error && ETIMEDOUT != error &&
+	    0 != udp_relay_zc_reap(clnt->relay, clnt)) {
+		error = 0;
+	}
+#endif
+	if (0 != error) {
+		tp_task_stop(tptask);
+		clnt->flags &= ~UDP_RELAY_CLNT_F_SND_WAIT;
+		clnt->cb_func(clnt, error, clnt->udata); /* clnt can be freed here. */
+		return (TP_TASK_CB_NONE);
+	}
+
+	return (udp_relay_clnt_snd_handle(clnt->relay, clnt));
+}
+
+static void
+udp_relay_fo_rdr_cb(r_buf_fo_rdr_p rdr __unused, int error, void *udata) {
+	udp_relay_clnt_p clnt = udata;
+
+	debugd_break_if(NULL == clnt);
+
+	clnt->cb_func(clnt, error, clnt->udata); /* clnt can be freed here. */
+}
+
+static int
+udp_relay_rcv_cb(tp_task_p tptask __unused, int error __unused,
+    uint32_t eof __unused, size_t data2transfer_size __unused,
+    void *udata) {
+	udp_relay_p relay = udata;
+	udp_relay_clnt_p clnt;
+
+	debugd_break_if(NULL == relay);
+
+	relay->stat.wakeups ++;
+	clnt = relay->single;
+#ifdef UDP_RELAY_ZEROCOPY
+	if (NULL != clnt) {
+		udp_relay_zc_reap(relay, clnt);
+	}
+#endif
+	switch (relay->path) {
+	case UDP_RELAY_PATH_FANOUT:
+		udp_relay_rcv_fo(relay);
+		break;
+	case UDP_RELAY_PATH_SPLICE:
+		if (0 == udp_relay_rcv_splice(relay))
+			break;
+		/* Not supported for this socket: switch to ring. */
+		relay->flags |= UDP_RELAY_S_F_NO_SPLICE;
+		relay->path = udp_relay_path_ring(relay, clnt);
+		relay->stat.switches ++;
+		/* FALLTHROUGH */
+	default:
+		udp_relay_rcv_ring(relay);
+		break;
+	}
+	udp_relay_path_select(relay);
+	if (NULL != clnt &&
+	    0 == (UDP_RELAY_CLNT_F_SND_WAIT & clnt->flags)) {
+		udp_relay_clnt_snd_handle(relay, clnt); /* clnt can be freed here. */
+		if (0 == relay->clnt_count)
+			return (TP_TASK_CB_NONE); /* Stopped. */
+	}
+
+	return (TP_TASK_CB_CONTINUE);
+}
+
+
+static int
+udp_relay_fo_start(udp_relay_p relay) {
+	int error;
+
+	error = r_buf_fo_create(tpt_get_tp(relay->tpt), &relay->s.fo,
+	    &relay->fo);
+	if (0 != error)
+		return (error);
+	if (UDP_RELAY_PATH_NONE != relay->path) {
+		relay->stat.switches ++;
+	}
+	relay->path = UDP_RELAY_PATH_FANOUT;
+
+	return (0);
+}
+
+static int
+udp_relay_single_start(udp_relay_p relay, udp_relay_clnt_p clnt) {
+	int error;
+#ifdef UDP_RELAY_ZEROCOPY
+	int on = 1;
+
+	if (0 == (UDP_RELAY_S_F_NO_ZEROCOPY & relay->flags) &&
+	    0 == setsockopt((int)clnt->skt, SOL_SOCKET, SO_ZEROCOPY,
+	    &on, sizeof(on))) {
+		clnt->flags |= UDP_RELAY_CLNT_F_ZEROCOPY;
+	}
+#endif
+	/* First socket ready event: nothing to send, task stopped. */
+	error = tp_task_notify_create(relay->tpt, clnt->skt, 0, TP_EV_WRITE,
+	    relay->s.fo.snd_timeout, udp_relay_clnt_notify_cb, clnt,
+	    &clnt->tptask);
+	if (0 != error)
+		return (error);
+	clnt->flags |= UDP_RELAY_CLNT_F_SND_WAIT;
+	relay->single = clnt;
+	udp_relay_single_reset(relay);
+	relay->path = ((0 != (UDP_RELAY_S_F_NO_SPLICE & relay->flags)) ?
+	    udp_relay_path_ring(relay, clnt) : UDP_RELAY_PATH_SPLICE);
+
+	return (0);
+}
+
+int
+udp_relay_clnt_add(udp_relay_p relay, uintptr_t skt,
+    udp_relay_clnt_cb cb_func, void *udata, udp_relay_clnt_p *clnt_ret) {
+	int error, tm;
+	size_t i;
+	udp_relay_clnt_p clnt;
+
+	if (NULL == relay || (uintptr_t)-1 == skt || NULL == cb_func ||
+	    NULL == clnt_ret)
+		return (EINVAL);
+	/* splice() to blocking socket may block. */
+	tm = fcntl((int)skt, F_GETFL);
+	if (-1 == tm ||
+	    -1 == fcntl((int)skt, F_SETFL, (tm | O_NONBLOCK)))
+		return (errno);
+	clnt = calloc(1, sizeof(udp_relay_clnt_t));
+	if (NULL == clnt)
+		return (ENOMEM);
+	clnt->relay = relay;
+	clnt->skt = skt;
+	clnt->cb_func = cb_func;
+	clnt->udata = udata;
+
+	if (0 == relay->clnt_count) {
+		/* Drop datagrams queued while no clients. */
+		for (i = 0; i < UDP_RELAY_RCV_LOOP_MAX; i ++) {
+			if (relay->s.pkts_max > udp_relay_recv_drop(relay,
+			    relay->s.pkts_max))
+				break;
+		}
+		if (0 != (UDP_RELAY_S_F_FANOUT_ONLY & relay->flags)) {
+			error = udp_relay_fo_start(relay);
+		} else {
+			error = udp_relay_single_start(relay, clnt);
+		}
+		if (0 != error)
+			goto err_out;
+		error = tp_task_restart(relay->tptask);
+		if (0 != error)
+			goto err_out;
+	} else if (UDP_RELAY_PATH_FANOUT != relay->path) {
+		/* Single client moved to fan-out after own backlog sent. */
+		error = udp_relay_fo_start(relay);
+		if (0 != error)
+			goto err_out;
+	}
+	if (UDP_RELAY_PATH_FANOUT == relay->path) {
+		error = r_buf_fo_rdr_add(relay->fo, relay->tpt, skt,
+		    udp_relay_fo_rdr_cb, clnt, &clnt->rdr);
+		if (0 != error)
+			goto err_out;
+	}
+	TAILQ_INSERT_TAIL(&relay->clnts, clnt, next);
+	relay->clnt_count ++;
+
+	(*clnt_ret) = clnt;
+	return (0);
+
+err_out:
+	if (0 == relay->clnt_count) {
+		tp_task_stop(relay->tptask);
+		if (NULL != relay->fo) {
+			r_buf_fo_destroy(relay->fo);
+			relay->fo = NULL;
+		}
+		relay->single = NULL;
+		relay->path = UDP_RELAY_PATH_NONE;
+	}
+	tp_task_destroy(clnt->tptask);
+	free(clnt);
+	return (error);
+}
+
+void
+udp_relay_clnt_free(udp_relay_clnt_p clnt) {
+	udp_relay_p relay;
+
+	if (NULL == clnt)
+		return;
+	relay = clnt->relay;
+	r_buf_fo_rdr_free(clnt->rdr);
+	tp_task_destroy(clnt->tptask);
+	if (relay->single == clnt) {
+		relay->single = NULL;
+		udp_relay_single_reset(relay);
+	}
+	TAILQ_REMOVE(&relay->clnts, clnt, next);
+	relay->clnt_count --;
+	if (0 == relay->clnt_count) {
+		tp_task_stop(relay->tptask);
+		if (NULL != relay->fo) {
+			r_buf_fo_destroy(relay->fo);
+			relay->fo = NULL;
+		}
+		relay->path = UDP_RELAY_PATH_NONE;
+	}
+	free(clnt);
+}
+
+void *
+udp_relay_clnt_udata_get(udp_relay_clnt_p clnt) {
+
+	if (NULL == clnt)
+		return (NULL);
+	return (clnt->udata);
+}
@@ -30,15 +30,28 @@
 /*
  * 
  * This is a simple, non recursive resolver, local cache, but asinc
- * maximum concurrent tasks_tmr is 65534
- * use only one UDP socket to communicate with DNS servers
+ * maximum concurrent tasks is 65534
+ * use small pool of UDP sockets with random source ports to communicate
+ * with DNS servers, task ID (ID in dns msg) is random
+ * upstream DNS servers selected by smoothed RTT and failures count,
+ * slow server raced with next best server
+ * queries carry EDNS0 OPT RR, truncated replies retried over pipelined
+ * TCP connection (one per upstream server, closed when idle)
+ * UDP queries coalesced to sendmmsg(), replies received by recvmmsg()
+ * cache can be saved to / loaded from binary snapshot file for warm
+ * restart, expired entries optionally served while refreshing
  * 
  */
 
 
 #include <sys/param.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+#include <fcntl.h> /* open, fcntl */
+#include <pthread.h>
 #include <unistd.h> /* close, write, sysconf */
 #include <string.h> /* memcpy, memmove, memset, strerror... */
 #include <strings.h> /* explicit_bzero */
@@ -51,6 +64,7 @@
 #include "proto/dns.h"
 
 #include "threadpool/threadpool_task.h"
+#include "threadpool/threadpool_msg_sys.h"
 #include "net/socket.h"
 #include "net/socket_address.h"
 #include "net/utils.h"
@@ -62,58 +76,145 @@
 #define DNS_RESOLVER_SKT_RCV_SIZE	(128 * 1024)
 #define DNS_RESOLVER_SKT_SND_SIZE	(128 * 1024)
 #define DNS_RESOLVER_MAX_UDP_MSG_SIZE	(64 * 1024)
-#define DNS_RESOLVER_OPT_UDP_SIZE	(16 * 1024)
+#define DNS_RESOLVER_EDNS_UDP_SIZE	1232 /* Default EDNS0 UDP payload size, avoid IP fragmentation. */
+#define DNS_RESOLVER_EDNS_UDP_SIZE_MIN	512
+#define DNS_RESOLVER_RCV_BATCH		16 /* Replies per recvmmsg(). */
+#define DNS_RESOLVER_RCV_SLOT_SIZE	(DNS_RESOLVER_MAX_UDP_MSG_SIZE / DNS_RESOLVER_RCV_BATCH)
+#define DNS_RESOLVER_SND_BATCH		32 /* Queries per sendmmsg(). */
+#define DNS_RESOLVER_QUERY_MAX_SIZE	512 /* Header + question + OPT RR. */
+#define DNS_RESOLVER_TCP_BUF_SIZE	(sizeof(uint16_t) + DNS_RESOLVER_MAX_UDP_MSG_SIZE)
+#define DNS_RESOLVER_TCP_IDLE_TIMEOUT	(10 * 1000) /* ms, close unused TCP connection. */
 #define DNS_RESOLVER_MAX_TASKS		65536
+#define DNS_RESOLVER_TASKS_PAGE_SIZE	256 /* Tasks map allocated by pages on demand. */
+#define DNS_RESOLVER_TASKS_PAGES	(DNS_RESOLVER_MAX_TASKS / DNS_RESOLVER_TASKS_PAGE_SIZE)
+#define DNS_RESOLVER_TASK_ID_RND_TRIES	8 /* Random ID tries before linear search. */
+#define DNS_RESOLVER_SKT_POOL_SIZE	4 /* UDP sockets with random source ports. */
+#define DNS_RESOLVER_SKT_BIND_TRIES	16
+#define DNS_RESOLVER_SKT_PORT_MIN	1024
+#define DNS_RESOLVER_MAX_SRVS		64 /* Limited by bits count in task->srv_tried. */
+#define DNS_RESOLVER_SRV_NONE		((uint16_t)0xffff)
+#define DNS_RESOLVER_SRV_FAIL_MAX	3 /* Failures in a row before mark server as down. */
+#define DNS_RESOLVER_SRV_DOWN_TIME	(30 * 1000) /* ms, server not used untill probe. */
+#define DNS_RESOLVER_SRV_RTT_MAX	(60 * 1000) /* ms */
+#define DNS_RESOLVER_RACE_DELAY_MIN	20 /* ms, do not race faster. */
 #define DNS_RESOLVER_CACHE_ALLOC	8
 #define DNS_RESOLVER_MAX_ADDRS		64
 #define DNS_RESOLVER_TTL_MIN		4
-#define ERESTART			(-1)		/* restart syscall */
+#ifndef ERESTART
+#	define ERESTART			(-1)		/* restart syscall */
+#endif
 
 
 typedef struct dns_rslvr_cache_entry_s	*dns_rslvr_cache_entry_p;
+typedef struct dns_rslvr_tcp_s		*dns_rslvr_tcp_p;
+typedef struct dns_rslvr_skt_s		*dns_rslvr_skt_p;
 
 
 
 
 typedef struct dns_rslvr_task_s {
+	tp_udata_t	tmr;		/* Timeout/race timer, ident = task. */
 	dns_rslvr_p	rslvr;		/*  */
 	tpt_p		tpt;		/* Need for timers and correct callback. */
 	dns_rslvr_cache_entry_p cache_entry; /* Used for update existing cache item. */
 	dns_rslvr_task_p next_task;	/* Next task to notify in cache_entry queue. */
-	uint16_t	task_id;	/* ID in dns msg and Index in tasks_tmr array. */
+	uint16_t	task_id;	/* Random ID in dns msg and key in tasks map. */
 	uint16_t	flags;		/* DNS_R_F_* */
 	uint16_t	timeouts;	/* Num with current NS server. */
-	uint16_t	cur_srv_idx;	/* Idx of cur DNS server (see dns_addrs) */
+	uint16_t	cur_srv_idx;	/* Idx of cur DNS server (see srvs) */
+	uint16_t	race_srv_idx;	/* Idx of DNS server raced with cur or DNS_RESOLVER_SRV_NONE. */
+	uint16_t	skt_idx;	/* Idx of UDP socket in skts pool. */
 	uint16_t	loop_count;	/* CName loop count. */
+	uint64_t	srv_tried;	/* Bit mask: DNS servers that got this query. */
+	uint64_t	send_time;	/* Query sent to cur server, ms. */
+	uint64_t	race_send_time;	/* Query sent to race server, ms. */
 	dns_resolv_cb	cb_func;	/* Called after resolv done. */
 	void		*udata;		/* Passed as arg to check and done funcs. */
 } dns_rslvr_task_t;
 
 // DNS_R_F_*
 #define DNS_R_TSK_F_QUEUED		(((uint16_t)1) << 10) /* This task is wait another task complete work and will be notifyed. */
+#define DNS_R_TSK_F_RACE_TMR		(((uint16_t)1) << 11) /* Timer armed to start race with next DNS server. */
+#define DNS_R_TSK_F_TCP			(((uint16_t)1) << 12) /* Got truncated reply, use TCP. */
+
+
+typedef struct dns_rslvr_tcp_s { /* Pipelined TCP connection to upstream. */
+	dns_rslvr_p	rslvr;
+	tpt_p		tpt;		/* IO task, state and bufs owned by this thread. */
+	tp_task_p	io_task;	/* Connect + send, then recv. NULL - not connected. */
+	uint16_t	srv_idx;
+	uint16_t	state;		/* DNS_R_TCP_S_* */
+	io_buf_t	snd_buf;	/* Sending queries: [len][msg][len][msg]... */
+	io_buf_t	rcv_buf;	/* Received replies: [len][msg]... */
+	/* Protected by srv->tcp_mtx: queries from any thread, moved to
+	 * snd_buf by tcp thread. */
+	int		q_kick_sheduled; /* Message to tpt queued. */
+	int		q_closed;	/* Resolver destroyed. */
+	io_buf_t	q_buf;
+	uint8_t		snd_buf_data[DNS_RESOLVER_TCP_BUF_SIZE];
+	uint8_t		rcv_buf_data[DNS_RESOLVER_TCP_BUF_SIZE];
+	uint8_t		q_buf_data[DNS_RESOLVER_TCP_BUF_SIZE];
+} dns_rslvr_tcp_t;
+
+#define DNS_R_TCP_S_NONE		0 /* Not connected. */
+#define DNS_R_TCP_S_SEND		1 /* Connecting / sending queued queries. */
+#define DNS_R_TCP_S_RECV		2 /* All sent, wait replies. */
+
+
+typedef struct dns_rslvr_srv_s { /* Upstream DNS server. */
+	sockaddr_storage_t addr;
+	uint64_t	down_untill;	/* ms, do not use until probe time. 0 - up. */
+	uint32_t	srtt;		/* Smoothed RTT, ms << 3. 0 - no samples. */
+	uint32_t	rttvar;		/* RTT variation, ms << 2. */
+	uint32_t	fails;		/* Timeouts in a row. */
+	uint64_t	queries;	/* Stat: queries sent. */
+	uint64_t	answers;	/* Stat: answers received. */
+	pthread_mutex_t	tcp_mtx;	/* tcp allocation and tcp->q_*. */
+	dns_rslvr_tcp_p	tcp;		/* Allocated on first truncated reply. */
+} dns_rslvr_srv_t, *dns_rslvr_srv_p;
+
+/* Time after that query should be answered: srtt + 4 * rttvar, ms. */
+#define DNS_RSLVR_SRV_SCORE(__srv)	(((__srv)->srtt >> 3) + (__srv)->rttvar)
+
+
+typedef struct dns_rslvr_skt_s { /* UDP socket with random source port. */
+	dns_rslvr_p	rslvr;
+	tp_task_p	io_pkt_rcvr;	/* Packet receiver IPv4 skt. */
+	uintptr_t	skt;		/* IPv4 UDP socket. */
+	io_buf_t	buf;		/* Buffer for recv reply. */
+	uint8_t		buf_data[DNS_RESOLVER_MAX_UDP_MSG_SIZE];
+#ifdef HAVE_SENDMMSG
+	/* Queries queued in current thread loop iteration, sent by one
+	 * sendmmsg() from thread message cb. */
+	pthread_mutex_t	sq_mtx;		/* Queries may be added from any thread. */
+	size_t		sq_count;
+	int		sq_flush_sheduled;
+	struct mmsghdr	sq_msgs[DNS_RESOLVER_SND_BATCH];
+	struct iovec	sq_iov[DNS_RESOLVER_SND_BATCH];
+	uint8_t		sq_data[DNS_RESOLVER_SND_BATCH][DNS_RESOLVER_QUERY_MAX_SIZE];
+#endif
+} dns_rslvr_skt_t;
 
 
 typedef struct dns_rslvr_s {
-	tpt_p		tp;		/* Need for timers. */
+	tp_p		tp;		/* Need for timers. */
+	size_t		ref_count;	/* Atomic: 1 + queued thread messages. */
 	hbucket_p	hbskt;		/* Cache resolved records. */
 	time_t		next_clean_time;
 	uint32_t	clean_interval;
 
-	tp_task_p	io_pkt_rcvr4;	/* Packet receiver IPv4 skt. */
-	//tp_task_p	io_pkt_rcvr6;	/* Packet receiver IPv4 skt. */
-	uintptr_t	sktv4;		/* IPv4 UDP socket. */
-	//uintptr_t	sktv6;		/* IPv6 UDP socket. */
-	io_buf_t	buf;		/* Buffer for recv reply. */
 	uintptr_t	timeout;	/* Timeout for request to NS server. */
 	uint32_t	neg_cache;	/* Time for negative cache. */
-	sockaddr_storage_p dns_addrs; /* Upstream DNS servers. */
-	uint16_t	dns_addrs_count;
+	uint16_t	edns_udp_size;	/* EDNS0 UDP payload size, 0 - no EDNS0. */
+	uint32_t	stale_ttl;	/* Serve expired data while refresh, sec. */
+	dns_rslvr_srv_p	srvs;		/* Upstream DNS servers. */
+	uint16_t	srvs_count;
+	uint16_t	srvs_mtx_count;	/* srv->tcp_mtx initialized. */
 	uint16_t	retry_count;	/* Num of timeout retry req to NS server. */
 	uint16_t	tasks_count;	/* Now resolving for ... hosts. */
-	uint16_t	tasks_index;	/* Next task item index. */
-	tp_udata_t	tasks_tmr[DNS_RESOLVER_MAX_TASKS]; /* Index in this array
-							* used as ID in dns msg. */
-	uint8_t		buf_data[DNS_RESOLVER_MAX_UDP_MSG_SIZE];
+	dns_rslvr_task_p *tasks[DNS_RESOLVER_TASKS_PAGES]; /* Sparse map:
+						* task_id -> task. */
+	dns_rslvr_skt_t	skts[DNS_RESOLVER_SKT_POOL_SIZE];
 } dns_rslvr_t;
 
 
@@ -153,6 +254,41 @@ typedef struct dns_rslvr_cache_entry_s {
 
 
 
+/* Cache snapshot file: header + records, native byte order,
+ * all records 8 bytes aligned, so file can be used via mmap(). */
+#define DNS_RSLVR_SNAP_MAGIC	"LCBDNSC\0"
+#define DNS_RSLVR_SNAP_VERSION	1
+#define DNS_RSLVR_SNAP_ALLOC	(64 * 1024) /* Save buffer grow step. */
+#define DNS_RSLVR_SNAP_ALIGN(__size)	(((__size) + 7) & ~((size_t)7))
+
+typedef struct dns_rslvr_snap_hdr_s {
+	uint8_t		magic[8];	/* DNS_RSLVR_SNAP_MAGIC */
+	uint32_t	version;	/* DNS_RSLVR_SNAP_VERSION */
+	uint16_t	addr_size;	/* sizeof(dns_rslvr_cache_addr_t) */
+	uint16_t	reserved;
+	uint64_t	count;		/* Records count. */
+	uint64_t	size;		/* File size. */
+} dns_rslvr_snap_hdr_t, *dns_rslvr_snap_hdr_p;
+
+typedef struct dns_rslvr_snap_rec_s {
+	int64_t		valid_untill;	/* Absolute, time(). */
+	uint32_t	size;		/* Record size: header + name + data + padding. */
+	uint16_t	name_size;
+	uint16_t	data_count;	/* Addrs count / alias name size. */
+	uint16_t	flags;		/* DNS_R_CD_F_CNAME + DNS_R_F_IP*. */
+	uint16_t	reserved[3];
+	/* uint8_t name[name_size]; */
+	/* dns_rslvr_cache_addr_t addrs[data_count] / uint8_t alias[data_count]; */
+} dns_rslvr_snap_rec_t, *dns_rslvr_snap_rec_p;
+
+/* Used for DNS cache save callback. */
+typedef struct dns_rslvr_snap_save_s {
+	uint8_t		*buf;
+	size_t		buf_size;
+	size_t		cur_off;
+	uint64_t	count;
+} dns_rslvr_snap_save_t;
+
 /* Used for DNS cache dump callback. */
 typedef struct dns_rslvr_cache_dump_s {
 	char *buf;
@@ -165,14 +301,35 @@ int		dns_resolv_hostaddr_int(dns_rslvr_p rslvr, int send_request,
 		    uint8_t *name, size_t name_size, uint16_t flags,
 		    dns_resolv_cb cb_func, void *arg, dns_rslvr_task_p *task_ret);
 int		data_cache_enum_cb_fn(void *udata, hbucket_entry_p entry);
+static int	dns_resolver_cache_save_enum_cb(void *udata,
+		    hbucket_entry_p entry);
+static int	dns_resolver_stale_refresh_cb(dns_rslvr_task_p task, int error,
+		    sockaddr_storage_p addrs, size_t addrs_count, void *arg);
 static void	dns_resolver_task_done(dns_rslvr_task_p task, int error,
 		    dns_rslvr_cache_addr_p addrs, size_t addrs_count,
 		    time_t valid_untill);
-static int	dns_resolver_send(dns_rslvr_task_p task);
+static int	dns_resolver_send(dns_rslvr_task_p task, uint16_t srv_idx,
+		    uint64_t time_now);
+static int	dns_resolver_query(dns_rslvr_task_p task);
+static int	dns_resolver_query_next(dns_rslvr_task_p task, uint64_t time_now);
 static void	dns_resolver_task_timeout_cb(tp_event_p ev, tp_udata_p tp_udata);
 static int	dns_resolver_recv_cb(tp_task_p tptask, int error,
 		    sockaddr_storage_p addr, io_buf_p buf,
 		    size_t transfered_size, void *arg);
+static void	dns_resolver_reply_handle(dns_rslvr_p rslvr,
+		    dns_rslvr_skt_p skt, sockaddr_storage_p addr, uint8_t *msg,
+		    size_t transfered_size);
+static int	dns_resolver_tcp_send(dns_rslvr_p rslvr, uint16_t srv_idx,
+		    const uint8_t *msg, size_t msg_size);
+static void	dns_resolver_tcp_close(dns_rslvr_tcp_p tcp);
+static void	dns_resolver_ref(dns_rslvr_p rslvr);
+static void	dns_resolver_release(dns_rslvr_p rslvr);
+static int	dns_resolver_tcp_send_cb(tp_task_p tptask, int error,
+		    io_buf_p buf, uint32_t eof, size_t transfered_size,
+		    void *arg);
+static int	dns_resolver_tcp_recv_cb(tp_task_p tptask, int error,
+		    io_buf_p buf, uint32_t eof, size_t transfered_size,
+		    void *arg);
 
 
 /* Staff for data_cache. */
@@ -189,6 +346,7 @@ void		dns_rslvr_cache_entry_free(dns_rslvr_cache_entry_p cache_entry);
 int		dns_rslvr_cache_entry_data_add(dns_rslvr_cache_entry_p cache_entry,
 		    void *data, uint16_t data_count, uint16_t flags,
 		    time_t valid_untill);
+void		dns_rslvr_cache_entry_upd_cancel(dns_rslvr_cache_entry_p cache_entry);
 
 int		dns_rslvr_task_alloc(dns_rslvr_p rslvr, dns_resolv_cb cb_func,
 		    void *arg, dns_rslvr_task_p *task_ret);
@@ -227,6 +385,131 @@ dns_rslvr_cache_addr_cp(dns_rslvr_cache_addr_p caddrs, size_t addrs_count,
 	return (0);
 }
 
+static inline uint64_t
+dns_resolver_time_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_FAST, &ts);
+
+	return ((((uint64_t)ts.tv_sec) * 1000) + (((uint64_t)ts.tv_nsec) / 1000000));
+}
+
+static inline dns_rslvr_task_p
+dns_rslvr_task_get(dns_rslvr_p rslvr, uint16_t task_id) {
+	dns_rslvr_task_p *page;
+
+	page = rslvr->tasks[(task_id / DNS_RESOLVER_TASKS_PAGE_SIZE)];
+	if (NULL == page)
+		return (NULL);
+
+	return (page[(task_id % DNS_RESOLVER_TASKS_PAGE_SIZE)]);
+}
+
+
+/* RFC 6298 like estimator, integer scaled. */
+static void
+dns_resolver_srv_rtt_upd(dns_rslvr_srv_p srv, uint64_t rtt) {
+	int64_t delta;
+
+	rtt = MIN(DNS_RESOLVER_SRV_RTT_MAX, MAX(1, rtt));
+	if (0 == srv->srtt) { /* First sample. */
+		srv->srtt = (uint32_t)(rtt << 3);
+		srv->rttvar = (uint32_t)(rtt << 1);
+		return;
+	}
+	delta = ((int64_t)rtt - (int64_t)(srv->srtt >> 3));
+	srv->srtt = (uint32_t)MAX(8, ((int64_t)srv->srtt + delta));
+	if (0 > delta) {
+		delta = - delta;
+	}
+	srv->rttvar = (uint32_t)((int64_t)srv->rttvar + delta -
+	    (int64_t)(srv->rttvar >> 2));
+}
+
+static void
+dns_resolver_srv_ok(dns_rslvr_srv_p srv, uint64_t rtt) {
+
+	dns_resolver_srv_rtt_upd(srv, rtt);
+	srv->fails = 0;
+	srv->down_untill = 0;
+	srv->answers ++;
+}
+
+static void
+dns_resolver_srv_fail(dns_rslvr_p rslvr, uint16_t srv_idx, uint64_t time_now) {
+	dns_rslvr_srv_p srv = &rslvr->srvs[srv_idx];
+
+	/* Penalty: even before marked down server lose priority. */
+	dns_resolver_srv_rtt_upd(srv, rslvr->timeout);
+	srv->fails ++;
+	if (DNS_RESOLVER_SRV_FAIL_MAX <= srv->fails) {
+		srv->down_untill = (time_now + DNS_RESOLVER_SRV_DOWN_TIME);
+		SYSLOGD_EX(LOG_DEBUG, "DNS server %i marked as down.", srv_idx);
+	}
+}
+
+/* Select server with lowest score, skip servers in exclude mask.
+ * If all servers are down then select one that will be probed first. */
+static int
+dns_resolver_srv_select(dns_rslvr_p rslvr, uint64_t exclude, uint64_t time_now,
+    uint16_t *srv_idx_ret) {
+	uint16_t i, best = DNS_RESOLVER_SRV_NONE, best_down = DNS_RESOLVER_SRV_NONE;
+	uint64_t score, best_score = UINT64_MAX, best_down_time = UINT64_MAX;
+	dns_rslvr_srv_p srv;
+
+	for (i = 0; i < rslvr->srvs_count; i ++) {
+		if (0 != ((((uint64_t)1) << i) & exclude))
+			continue;
+		srv = &rslvr->srvs[i];
+		if (srv->down_untill > time_now) {
+			if (best_down_time > srv->down_untill) {
+				best_down_time = srv->down_untill;
+				best_down = i;
+			}
+			continue;
+		}
+		score = DNS_RSLVR_SRV_SCORE(srv);
+		if (best_score > score) {
+			best_score = score;
+			best = i;
+		}
+	}
+	if (DNS_RESOLVER_SRV_NONE == best) {
+		best = best_down;
+	}
+	if (DNS_RESOLVER_SRV_NONE == best)
+		return (ENOENT);
+	(*srv_idx_ret) = best;
+
+	return (0);
+}
+
+/* Arm timer: race with next server if it can help, or wait for timeout. */
+static void
+dns_resolver_tmr_arm(dns_rslvr_task_p task, uint64_t time_now) {
+	dns_rslvr_p rslvr = task->rslvr;
+	dns_rslvr_srv_p srv = &rslvr->srvs[task->cur_srv_idx];
+	uint64_t delay = rslvr->timeout;
+	uint16_t srv_idx;
+
+	task->flags &= ~DNS_R_TSK_F_RACE_TMR;
+	if (DNS_RESOLVER_SRV_NONE == task->race_srv_idx &&
+	    0 == (DNS_R_TSK_F_TCP & task->flags) &&
+	    (DNS_RESOLVER_RACE_DELAY_MIN * 2) < rslvr->timeout &&
+	    0 == dns_resolver_srv_select(rslvr, task->srv_tried, time_now,
+	    &srv_idx) &&
+	    rslvr->srvs[srv_idx].down_untill <= time_now) {
+		delay = (rslvr->timeout / 2);
+		if (0 != srv->srtt) {
+			delay = MIN(delay, MAX(DNS_RESOLVER_RACE_DELAY_MIN,
+			    DNS_RSLVR_SRV_SCORE(srv)));
+		}
+		task->flags |= DNS_R_TSK_F_RACE_TMR;
+	}
+	tpt_ev_enable_args(1, TP_EV_TIMER, TP_F_DISPATCH, TP_FF_T_MSEC,
+	    delay, &task->tmr);
+}
+
 uint32_t
 dns_resolver_data_cache_hash(void *udata __unused, const uint8_t *key,
     size_t key_size) {
@@ -257,8 +540,10 @@ dns_resolver_data_cache_cmp_data(void *udata __unused, const uint8_t *key,
 
 int
 dns_resolver_destroy_entry_enum_cb(void *udata __unused, hbucket_entry_p entry) {
+	dns_rslvr_cache_entry_p cache_entry = entry->data;
 
-	dns_rslvr_cache_entry_free(entry->data);
+	cache_entry->task = NULL; /* Queued tasks already freed. */
+	dns_rslvr_cache_entry_free(cache_entry);
 	return (0);
 }
 
@@ -451,6 +736,24 @@ notify_out:
 	return (error);
 }
 
+/* Update failed before any data received: keep old data, drop
+ * DNS_R_CD_F_UPDATING and restart queued tasks. */
+void
+dns_rslvr_cache_entry_upd_cancel(dns_rslvr_cache_entry_p cache_entry) {
+	dns_rslvr_task_p task;
+
+	if (NULL == cache_entry)
+		return;
+	hbucket_entry_lock(&cache_entry->entry);
+	task = cache_entry->task;
+	cache_entry->flags &= ~DNS_R_CD_F_UPDATING;
+	cache_entry->task = NULL;
+	cache_entry->tasks_count = 0;
+	hbucket_entry_unlock(&cache_entry->entry);
+
+	dns_rslvr_task_notify_chain(task, cache_entry->name, cache_entry->name_size);
+}
+
 /* Zone MUST BE LOCKED!!! */
 static inline void
 dns_rslvr_cache_entry_task_n_add(dns_rslvr_cache_entry_p cache_entry,
@@ -467,49 +770,66 @@ dns_rslvr_cache_entry_task_n_add(dns_rslvr_cache_entry_p cache_entry,
 int
 dns_rslvr_task_alloc(dns_rslvr_p rslvr, dns_resolv_cb cb_func, void *arg,
     dns_rslvr_task_p *task_ret) {
-	dns_rslvr_task_p task;
+	dns_rslvr_task_p task, *page;
 	int error;
+	size_t i;
 	uint16_t task_id;
 
 	if (NULL == rslvr || NULL == cb_func || NULL == task_ret)
 		return (EINVAL);
+	task = calloc(1, sizeof(dns_rslvr_task_t));
+	if (NULL == task)
+		return (ENOMEM);
 	/* XXX Lock */
-	if (0xffff == rslvr->tasks_count)
+	if (0xffff == rslvr->tasks_count) {
+		free(task);
 		return (EAGAIN); /* No free task slot. */
-	for (task_id = rslvr->tasks_index;
-	    task_id != (rslvr->tasks_index - 1); task_id ++) {
-		if (0 == task_id)
-			continue;
-		if (0 == rslvr->tasks_tmr[task_id].ident)
+	}
+	/* Random ID, fallback to linear search from random point. */
+	for (i = 0; i < DNS_RESOLVER_TASK_ID_RND_TRIES; i ++) {
+		task_id = (uint16_t)arc4random_uniform(DNS_RESOLVER_MAX_TASKS);
+		if (0 != task_id &&
+		    NULL == dns_rslvr_task_get(rslvr, task_id))
 			break;
 	}
-	if (0 != rslvr->tasks_tmr[task_id].ident)
-		return (EAGAIN); /* No free task slot. */
-	task = calloc(1, sizeof(dns_rslvr_task_t));
-	if (NULL == task)
-		return (ENOMEM);
-	rslvr->tasks_index = task_id;
-	rslvr->tasks_tmr[task_id].ident = (uintptr_t)task;
+	while (0 == task_id ||
+	    NULL != dns_rslvr_task_get(rslvr, task_id)) {
+		task_id ++;
+	}
+	page = rslvr->tasks[(task_id / DNS_RESOLVER_TASKS_PAGE_SIZE)];
+	if (NULL == page) {
+		page = calloc(DNS_RESOLVER_TASKS_PAGE_SIZE,
+		    sizeof(dns_rslvr_task_p));
+		if (NULL == page) {
+			free(task);
+			return (ENOMEM);
+		}
+		rslvr->tasks[(task_id / DNS_RESOLVER_TASKS_PAGE_SIZE)] = page;
+	}
+	page[(task_id % DNS_RESOLVER_TASKS_PAGE_SIZE)] = task;
 	rslvr->tasks_count ++;
 	/* XXX UnLock */
 
+	task->tmr.cb_func = dns_resolver_task_timeout_cb;
+	task->tmr.ident = (uintptr_t)task;
 	task->rslvr = rslvr;
 	//task->cache_entry = cache_entry;
 	task->task_id = task_id;
 	//task->flags = flags;
 	//task->timeouts = 0;
-	//task->cur_srv_idx = 0;
+	task->cur_srv_idx = DNS_RESOLVER_SRV_NONE;
+	task->race_srv_idx = DNS_RESOLVER_SRV_NONE;
+	task->skt_idx = (uint16_t)arc4random_uniform(DNS_RESOLVER_SKT_POOL_SIZE);
 	//task->loop_count = 0;
 	task->cb_func = cb_func;
 	task->udata = arg;
 	error = tpt_ev_add_args(tp_thread_get_pvt(rslvr->tp), TP_EV_TIMER,
-	    TP_F_DISPATCH, TP_FF_T_MSEC, rslvr->timeout,
-	    &rslvr->tasks_tmr[task_id]);
+	    TP_F_DISPATCH, TP_FF_T_MSEC, rslvr->timeout, &task->tmr);
 	if (0 != error) {
 		dns_rslvr_task_free(task);
 		return (error);
 	}
-	tpt_ev_enable_args1(0, TP_EV_TIMER, &rslvr->tasks_tmr[task_id]);
+	tpt_ev_enable_args1(0, TP_EV_TIMER, &task->tmr);
 	(*task_ret) = task;
 
 	return (0);
@@ -522,9 +842,10 @@ dns_rslvr_task_free(dns_rslvr_task_p task) {
 	if (NULL == task)
 		return;
 	rslvr = task->rslvr;
-	tpt_ev_del_args1(TP_EV_TIMER, &rslvr->tasks_tmr[task->task_id]);
+	tpt_ev_del_args1(TP_EV_TIMER, &task->tmr);
 	/* XXX Lock */
-	rslvr->tasks_tmr[task->task_id].ident = 0;
+	rslvr->tasks[(task->task_id / DNS_RESOLVER_TASKS_PAGE_SIZE)]
+	    [(task->task_id % DNS_RESOLVER_TASKS_PAGE_SIZE)] = NULL;
 	rslvr->tasks_count --;
 	/* XXX UnLock */
 	free(task);
@@ -547,17 +868,165 @@ dns_rslvr_task_notify_chain(dns_rslvr_task_p task, uint8_t *name, size_t name_si
 	}
 }
 
+/* Create UDP socket bound to random port and packet receiver for it. */
+static int
+dns_resolver_skt_init(dns_rslvr_p rslvr, dns_rslvr_skt_p skt) {
+	int error = EADDRINUSE;
+	size_t i;
+	uint16_t port;
+
+	skt->rslvr = rslvr;
+	io_buf_init(&skt->buf, 0, skt->buf_data, sizeof(skt->buf_data));
+	IO_BUF_MARK_TRANSFER_ALL_FREE(&skt->buf);
+
+	for (i = 0; i < DNS_RESOLVER_SKT_BIND_TRIES && 0 != error; i ++) {
+		port = (uint16_t)(DNS_RESOLVER_SKT_PORT_MIN +
+		    arc4random_uniform((65536 - DNS_RESOLVER_SKT_PORT_MIN)));
+		error = skt_bind_ap(AF_INET, NULL, port, SOCK_DGRAM,
+		    IPPROTO_UDP, SO_F_NONBLOCK, &skt->skt);
+	}
+	if (0 != error) { /* Let OS select port. */
+		error = skt_create(AF_INET, SOCK_DGRAM, IPPROTO_UDP,
+		    SO_F_NONBLOCK, &skt->skt);
+		if (0 != error)
+			return (error);
+	}
+	/* Tune socket. */
+	error = skt_snd_tune(skt->skt, DNS_RESOLVER_SKT_SND_SIZE, 1);
+	if (0 != error)
+		return (error);
+	error = skt_rcv_tune(skt->skt, DNS_RESOLVER_SKT_RCV_SIZE, 1);
+	if (0 != error)
+		return (error);
+
+	return (tp_task_pkt_rcvr_mmsg_create(tp_thread_get_pvt(rslvr->tp),
+	    skt->skt, 0, 0, &skt->buf, DNS_RESOLVER_RCV_BATCH,
+	    dns_resolver_recv_cb, skt, &skt->io_pkt_rcvr));
+}
+
+#ifdef HAVE_SENDMMSG
+static void
+dns_resolver_skt_flush(dns_rslvr_skt_p skt) {
+	size_t i;
+	int ios;
+
+	if ((uintptr_t)-1 == skt->skt) {
+		skt->sq_count = 0;
+		return;
+	}
+	for (i = 0; i < skt->sq_count;) {
+		ios = sendmmsg((int)skt->skt, &skt->sq_msgs[i],
+		    (unsigned int)(skt->sq_count - i),
+		    (MSG_DONTWAIT | MSG_NOSIGNAL));
+		if (-1 == ios) {
+			/* Skip failed query, task retry it on timeout. */
+			SYSLOG_ERR(LOG_NOTICE, errno, "sendmmsg().");
+			i ++;
+			continue;
+		}
+		i += (size_t)ios;
+	}
+	skt->sq_count = 0;
+}
+
+static void
+dns_resolver_skt_flush_msg_cb(tpt_p tpt __unused, void *udata) {
+	dns_rslvr_skt_p skt = udata;
+
+	pthread_mutex_lock(&skt->sq_mtx);
+	skt->sq_flush_sheduled = 0;
+	dns_resolver_skt_flush(skt);
+	pthread_mutex_unlock(&skt->sq_mtx);
+	dns_resolver_release(skt->rslvr); /* Reference from skt_send(). */
+}
+#endif
+
+/* Every queued message hold reference to resolver, so memory freed
+ * after last message handled, even if it handled by other thread. */
+static void
+dns_resolver_ref(dns_rslvr_p rslvr) {
+
+	__atomic_add_fetch(&rslvr->ref_count, 1, __ATOMIC_SEQ_CST);
+}
+
+static void
+dns_resolver_release(dns_rslvr_p rslvr) {
+	size_t i;
+
+	if (0 != __atomic_sub_fetch(&rslvr->ref_count, 1, __ATOMIC_ACQ_REL))
+		return;
+	for (i = 0; i < rslvr->srvs_mtx_count; i ++) {
+		pthread_mutex_destroy(&rslvr->srvs[i].tcp_mtx);
+		free(rslvr->srvs[i].tcp);
+	}
+	free(rslvr->srvs);
+#ifdef HAVE_SENDMMSG
+	for (i = 0; i < DNS_RESOLVER_SKT_POOL_SIZE; i ++) {
+		pthread_mutex_destroy(&rslvr->skts[i].sq_mtx);
+	}
+#endif
+	free(rslvr);
+}
+
+static int
+dns_resolver_skt_send(dns_rslvr_skt_p skt, const sockaddr_storage_t *addr,
+    const uint8_t *msg, size_t msg_size) {
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr *mmsg;
+	int flush_shedule;
+
+	if (DNS_RESOLVER_QUERY_MAX_SIZE < msg_size)
+		return (EMSGSIZE);
+	pthread_mutex_lock(&skt->sq_mtx);
+	if (DNS_RESOLVER_SND_BATCH == skt->sq_count) {
+		dns_resolver_skt_flush(skt);
+	}
+	mmsg = &skt->sq_msgs[skt->sq_count];
+	memcpy(skt->sq_data[skt->sq_count], msg, msg_size);
+	skt->sq_iov[skt->sq_count].iov_base = skt->sq_data[skt->sq_count];
+	skt->sq_iov[skt->sq_count].iov_len = msg_size;
+	memset(mmsg, 0x00, sizeof(struct mmsghdr));
+	mmsg->msg_hdr.msg_name = MK_RW_PTR(addr);
+	mmsg->msg_hdr.msg_namelen = sa_size(addr);
+	mmsg->msg_hdr.msg_iov = &skt->sq_iov[skt->sq_count];
+	mmsg->msg_hdr.msg_iovlen = 1;
+	skt->sq_count ++;
+	flush_shedule = (0 == skt->sq_flush_sheduled);
+	skt->sq_flush_sheduled = 1;
+	pthread_mutex_unlock(&skt->sq_mtx);
+	if (0 == flush_shedule)
+		return (0);
+	/* Messages handled after all events returned by current
+	 * kevent()/epoll_wait() call, so queries sent in burst
+	 * coalesced.
+	 * Send without sq_mtx: cb called directly if thread not running. */
+	dns_resolver_ref(skt->rslvr);
+	if (0 != tpt_msg_send(tp_thread_get_pvt(skt->rslvr->tp), NULL,
+	    TP_MSG_F_FORCE, dns_resolver_skt_flush_msg_cb, skt)) {
+		dns_resolver_skt_flush_msg_cb(NULL, skt); /* Send now. */
+	}
+
+	return (0);
+#else
+	if ((ssize_t)msg_size != sendto((int)skt->skt, msg, msg_size,
+	    (MSG_DONTWAIT | MSG_NOSIGNAL), (const struct sockaddr*)addr,
+	    sa_size(addr)))
+		return (errno);
+
+	return (0);
+#endif
+}
+
 int
 dns_resolver_create(tp_p tp, const sockaddr_storage_t *dns_addrs,
     uint16_t dns_addrs_count, uintptr_t timeout, uint16_t retry_count,
     uint32_t neg_cache, dns_rslvr_p *dns_rslvr_ret) {
 	dns_rslvr_p rslvr;
-	int buf = DNS_RESOLVER_SKT_SND_SIZE;
-	int rcv_buf = DNS_RESOLVER_SKT_RCV_SIZE, on = 1;
 	int error;
 	size_t i;
 
 	if (NULL == tp || NULL == dns_addrs || 0 == dns_addrs_count ||
+	    DNS_RESOLVER_MAX_SRVS < dns_addrs_count ||
 	    DNS_TTL_MAX < neg_cache || DNS_RESOLVER_TTL_MIN > neg_cache ||
 	    NULL == dns_rslvr_ret)
 		return (EINVAL);
@@ -565,44 +1034,35 @@ dns_resolver_create(tp_p tp, const sockaddr_storage_t *dns_addrs,
 	rslvr = calloc(1, sizeof(dns_rslvr_t));
 	if (NULL == rslvr)
 		return (ENOMEM);
-	rslvr->dns_addrs = calloc(dns_addrs_count, sizeof(sockaddr_storage_t));
-	if (NULL == rslvr->dns_addrs) {
+	rslvr->ref_count = 1;
+	for (i = 0; i < DNS_RESOLVER_SKT_POOL_SIZE; i ++) {
+		rslvr->skts[i].skt = (uintptr_t)-1;
+#ifdef HAVE_SENDMMSG
+		pthread_mutex_init(&rslvr->skts[i].sq_mtx, NULL);
+#endif
+	}
+	rslvr->srvs = calloc(dns_addrs_count, sizeof(dns_rslvr_srv_t));
+	if (NULL == rslvr->srvs) {
 		error = ENOMEM;
 		goto err_out;
 	}
-	io_buf_init(&rslvr->buf, 0, rslvr->buf_data, sizeof(rslvr->buf_data));
-	IO_BUF_MARK_TRANSFER_ALL_FREE(&rslvr->buf);
-
-	error = skt_create(AF_INET, SOCK_DGRAM, IPPROTO_UDP,
-	    SO_F_NONBLOCK, &rslvr->sktv4);
-	if (0 != error)
-		goto err_out;
-	/* Tune socket. */
-	error = skt_snd_tune(rslvr->sktv4, buf, 1);
-	if (0 != error)
-		goto err_out;
-	error = skt_rcv_tune(rslvr->sktv4, rcv_buf, 1);
-	if (0 != error)
-		goto err_out;
-
-	memset(rslvr->dns_addrs, 0x00,
-	    (sizeof(sockaddr_storage_t) * dns_addrs_count));
-	rslvr->dns_addrs_count = dns_addrs_count;
+	rslvr->srvs_count = dns_addrs_count;
 	for (i = 0; i < dns_addrs_count; i ++) {
-		sa_copy(&dns_addrs[i], &rslvr->dns_addrs[i]);
+		sa_copy(&dns_addrs[i], &rslvr->srvs[i].addr);
+		pthread_mutex_init(&rslvr->srvs[i].tcp_mtx, NULL);
+		rslvr->srvs_mtx_count ++;
 	}
 	rslvr->tp = tp;
 	rslvr->timeout = timeout;
 	rslvr->neg_cache = neg_cache;
 	rslvr->retry_count = retry_count;
-	for (i = 0; i < DNS_RESOLVER_MAX_TASKS; i ++) {
-		rslvr->tasks_tmr[i].cb_func = dns_resolver_task_timeout_cb;
-	}
+	rslvr->edns_udp_size = DNS_RESOLVER_EDNS_UDP_SIZE;
 
-	error = tp_task_pkt_rcvr_create(tp_thread_get_pvt(tp), rslvr->sktv4,
-	    0, 0, &rslvr->buf, dns_resolver_recv_cb, rslvr, &rslvr->io_pkt_rcvr4);
-	if (0 != error)
-		goto err_out;
+	for (i = 0; i < DNS_RESOLVER_SKT_POOL_SIZE; i ++) {
+		error = dns_resolver_skt_init(rslvr, &rslvr->skts[i]);
+		if (0 != error)
+			goto err_out;
+	}
 	error = hbucket_create(1, 256, rslvr, dns_resolver_data_cache_hash,
 	    dns_resolver_data_cache_cmp_data, &rslvr->hbskt);
 	if (0 != error)
@@ -623,29 +1083,67 @@ err_out:
 
 void
 dns_resolver_destroy(dns_rslvr_p rslvr) {
-	size_t i;
+	size_t i, j;
 
 	if (NULL == rslvr)
 		return;
 
-	tp_task_destroy(rslvr->io_pkt_rcvr4);
-	close((int)rslvr->sktv4);
+	for (i = 0; i < DNS_RESOLVER_SKT_POOL_SIZE; i ++) {
+		tp_task_destroy(rslvr->skts[i].io_pkt_rcvr);
+		if ((uintptr_t)-1 != rslvr->skts[i].skt) {
+			close((int)rslvr->skts[i].skt);
+			rslvr->skts[i].skt = (uintptr_t)-1;
+		}
+		io_buf_free(&rslvr->skts[i].buf);
+	}
 
 	/* Destroy all tasks. */
 	/* XXX Lock */
-	for (i = 0; i < 0xffff; i ++) {
-		if (0 == rslvr->tasks_tmr[i].ident)
+	for (i = 0; i < DNS_RESOLVER_TASKS_PAGES; i ++) {
+		if (NULL == rslvr->tasks[i])
 			continue;
-		dns_rslvr_task_free((dns_rslvr_task_p)rslvr->tasks_tmr[i].ident);
+		for (j = 0; j < DNS_RESOLVER_TASKS_PAGE_SIZE; j ++) {
+			dns_rslvr_task_free(rslvr->tasks[i][j]);
+		}
+		free(rslvr->tasks[i]);
 	}
-	dns_rslvr_task_free((dns_rslvr_task_p)rslvr->tasks_tmr[0xffff].ident);
 	/* XXX Lock */
 	/* XXX Lock destroy */
 
-	free(rslvr->dns_addrs);
-	io_buf_free(&rslvr->buf);
+	/* Pending TCP messages point to srvs[].tcp, freed by last release. */
+	for (i = 0; i < rslvr->srvs_mtx_count; i ++) {
+		if (NULL == rslvr->srvs[i].tcp)
+			continue;
+		pthread_mutex_lock(&rslvr->srvs[i].tcp_mtx);
+		rslvr->srvs[i].tcp->q_closed = 1;
+		pthread_mutex_unlock(&rslvr->srvs[i].tcp_mtx);
+		dns_resolver_tcp_close(rslvr->srvs[i].tcp);
+	}
 	hbucket_destroy(rslvr->hbskt, dns_resolver_destroy_entry_enum_cb, rslvr);
-	free(rslvr);
+	/* Pending flush messages point to rslvr->skts[], last one free. */
+	dns_resolver_release(rslvr);
+}
+
+int
+dns_resolver_stale_ttl_set(dns_rslvr_p rslvr, uint32_t stale_ttl) {
+
+	if (NULL == rslvr || DNS_TTL_MAX < stale_ttl)
+		return (EINVAL);
+	rslvr->stale_ttl = stale_ttl;
+
+	return (0);
+}
+
+int
+dns_resolver_edns_udp_size_set(dns_rslvr_p rslvr, uint16_t udp_size) {
+
+	if (NULL == rslvr ||
+	    (0 != udp_size && (DNS_RESOLVER_EDNS_UDP_SIZE_MIN > udp_size ||
+	    DNS_RESOLVER_RCV_SLOT_SIZE < udp_size)))
+		return (EINVAL);
+	rslvr->edns_udp_size = udp_size;
+
+	return (0);
 }
 
 tpt_p
@@ -653,7 +1151,7 @@ dns_resolver_tpt_get(dns_rslvr_p rslvr) {
 
 	if (NULL == rslvr)
 		return (NULL);
-	return (rslvr->tp);
+	return (tp_thread_get_pvt(rslvr->tp));
 }
 
 
@@ -698,7 +1196,11 @@ int
 dns_resolver_cache_text_dump(dns_rslvr_p rslvr, char *buf, size_t buf_size,
     size_t *size_ret) {
 	int rc;
+	size_t i;
+	uint64_t time_now;
+	dns_rslvr_srv_p srv;
 	dns_rslvr_cache_dump_t cache_dump;
+	char straddr[STR_ADDR_LEN];
 
 	if (NULL == rslvr)
 		return (EINVAL);
@@ -721,11 +1223,265 @@ dns_resolver_cache_text_dump(dns_rslvr_p rslvr, char *buf, size_t buf_size,
 		return (ENOSPC);
 	}
 	cache_dump.cur_off += (size_t)rc;
+
+	/* Upstream DNS servers health. */
+	time_now = dns_resolver_time_ms();
+	for (i = 0; i < rslvr->srvs_count; i ++) {
+		srv = &rslvr->srvs[i];
+		sa_addr_port_to_str(&srv->addr, straddr, sizeof(straddr), NULL);
+		rc = snprintf((cache_dump.buf + cache_dump.cur_off),
+		    (cache_dump.buf_size - cache_dump.cur_off),
+		    "server: %-24s [ srtt: %"PRIu32" ms,	rttvar: %"PRIu32" ms,	"
+		    "fails: %"PRIu32",	queries: %"PRIu64",	answers: %"PRIu64",	%s ]\r\n",
+		    straddr, (srv->srtt >> 3), (srv->rttvar >> 2), srv->fails,
+		    srv->queries, srv->answers,
+		    ((srv->down_untill > time_now) ? "down" : "up"));
+		if (0 > rc) /* Error. */
+			return (EFAULT);
+		if ((cache_dump.buf_size - cache_dump.cur_off) <= (size_t)rc) { /* Truncated. */
+			cache_dump.cur_off = cache_dump.buf_size;
+			(*size_ret) = cache_dump.cur_off; /* XXX */
+			return (ENOSPC);
+		}
+		cache_dump.cur_off += (size_t)rc;
+	}
 	(*size_ret) = cache_dump.cur_off;
 
 	return (0);
 }
 
+static int
+dns_resolver_stale_refresh_cb(dns_rslvr_task_p task __unused, int error __unused,
+    sockaddr_storage_p addrs __unused, size_t addrs_count __unused,
+    void *arg __unused) {
+
+	return (0); /* Cache updated by task, nothing to do. */
+}
+
+
+static int
+dns_resolver_cache_save_enum_cb(void *udata, hbucket_entry_p entry) {
+	dns_rslvr_snap_save_t *ss = udata;
+	dns_rslvr_cache_entry_p cache_entry = entry->data;
+	dns_rslvr_snap_rec_p rec;
+	size_t data_size, rec_size;
+	int error;
+
+	if (0 == cache_entry->data_count) /* Negative cache or no data yet. */
+		return (0);
+	data_size = cache_entry->data_count;
+	if (0 == (DNS_R_CD_F_CNAME & cache_entry->flags)) {
+		data_size *= sizeof(dns_rslvr_cache_addr_t);
+	}
+	rec_size = DNS_RSLVR_SNAP_ALIGN(sizeof(dns_rslvr_snap_rec_t) +
+	    cache_entry->name_size + data_size);
+	error = realloc_items((void**)&ss->buf, sizeof(uint8_t),
+	    &ss->buf_size, DNS_RSLVR_SNAP_ALLOC, (ss->cur_off + rec_size));
+	if (0 != error)
+		return (error);
+	rec = (dns_rslvr_snap_rec_p)(ss->buf + ss->cur_off);
+	memset(rec, 0x00, rec_size);
+	rec->valid_untill = (int64_t)cache_entry->valid_untill;
+	rec->size = (uint32_t)rec_size;
+	rec->name_size = (uint16_t)cache_entry->name_size;
+	rec->data_count = (uint16_t)cache_entry->data_count;
+	rec->flags = (cache_entry->flags & (DNS_R_CD_F_CNAME | DNS_R_F_IP_ALL));
+	memcpy((rec + 1), cache_entry->name, cache_entry->name_size);
+	memcpy((((uint8_t*)(rec + 1)) + cache_entry->name_size),
+	    cache_entry->pdata, data_size);
+	ss->cur_off += rec_size;
+	ss->count ++;
+
+	return (0);
+}
+
+int
+dns_resolver_cache_save(dns_rslvr_p rslvr, const char *file_name,
+    size_t file_name_size) {
+	int fd, error;
+	ssize_t ios;
+	size_t off;
+	char filename[1024], filename_tmp[(sizeof(filename) + 4)];
+	dns_rslvr_snap_hdr_p hdr;
+	dns_rslvr_snap_save_t ss;
+
+	if (NULL == rslvr || NULL == file_name)
+		return (EINVAL);
+	if (0 == file_name_size) {
+		file_name_size = strnlen(file_name, sizeof(filename));
+	}
+	if (sizeof(filename) <= file_name_size)
+		return (ENAMETOOLONG);
+	memcpy(filename, file_name, file_name_size);
+	filename[file_name_size] = 0;
+	snprintf(filename_tmp, sizeof(filename_tmp), "%s.tmp", filename);
+
+	memset(&ss, 0x00, sizeof(ss));
+	error = realloc_items((void**)&ss.buf, sizeof(uint8_t), &ss.buf_size,
+	    DNS_RSLVR_SNAP_ALLOC, sizeof(dns_rslvr_snap_hdr_t));
+	if (0 != error)
+		return (error);
+	ss.cur_off = sizeof(dns_rslvr_snap_hdr_t);
+	error = hbucket_entry_enum(rslvr->hbskt,
+	    dns_resolver_cache_save_enum_cb, &ss);
+	if (0 != error)
+		goto err_out;
+	hdr = (dns_rslvr_snap_hdr_p)ss.buf;
+	memset(hdr, 0x00, sizeof(dns_rslvr_snap_hdr_t));
+	memcpy(hdr->magic, DNS_RSLVR_SNAP_MAGIC, sizeof(hdr->magic));
+	hdr->version = DNS_RSLVR_SNAP_VERSION;
+	hdr->addr_size = sizeof(dns_rslvr_cache_addr_t);
+	hdr->count = ss.count;
+	hdr->size = ss.cur_off;
+
+	/* Write to temp file and rename: never leave partial snapshot. */
+	fd = open(filename_tmp, (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC), 0600);
+	if (-1 == fd) {
+		error = errno;
+		goto err_out;
+	}
+	for (off = 0; off < ss.cur_off; off += (size_t)ios) {
+		ios = write(fd, (ss.buf + off), (ss.cur_off - off));
+		if (-1 == ios) {
+			error = errno;
+			if (EINTR == error) {
+				ios = 0;
+				continue;
+			}
+			close(fd);
+			unlink(filename_tmp);
+			goto err_out;
+		}
+	}
+	close(fd);
+	if (0 != rename(filename_tmp, filename)) {
+		error = errno;
+		unlink(filename_tmp);
+		goto err_out;
+	}
+	error = 0;
+
+err_out:
+	free(ss.buf);
+
+	return (error);
+}
+
+int
+dns_resolver_cache_load(dns_rslvr_p rslvr, const char *file_name,
+    size_t file_name_size, size_t *count_ret) {
+	int fd, error = 0;
+	uint8_t *mem, *name, *data;
+	char filename[1024];
+	size_t off, data_size, count = 0;
+	time_t time_now, valid_untill;
+	struct stat sb;
+	dns_rslvr_snap_hdr_p hdr;
+	dns_rslvr_snap_rec_p rec;
+	dns_rslvr_cache_entry_p cache_entry;
+	hbucket_zone_p zone;
+	hbucket_entry_p entry;
+
+	if (NULL == rslvr || NULL == file_name)
+		return (EINVAL);
+	if (0 == file_name_size) {
+		file_name_size = strnlen(file_name, sizeof(filename));
+	}
+	if (sizeof(filename) <= file_name_size)
+		return (ENAMETOOLONG);
+	memcpy(filename, file_name, file_name_size);
+	filename[file_name_size] = 0;
+
+	fd = open(filename, (O_RDONLY | O_CLOEXEC));
+	if (-1 == fd)
+		return (errno);
+	if (0 != fstat(fd, &sb)) {
+		error = errno;
+		close(fd);
+		return (error);
+	}
+	if ((off_t)sizeof(dns_rslvr_snap_hdr_t) > sb.st_size) {
+		close(fd);
+		return (EINVAL);
+	}
+	mem = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == mem)
+		return (errno);
+
+	hdr = (dns_rslvr_snap_hdr_p)mem;
+	if (0 != memcmp(hdr->magic, DNS_RSLVR_SNAP_MAGIC, sizeof(hdr->magic)) ||
+	    DNS_RSLVR_SNAP_VERSION != hdr->version ||
+	    sizeof(dns_rslvr_cache_addr_t) != hdr->addr_size ||
+	    (uint64_t)sb.st_size != hdr->size) {
+		error = EINVAL;
+		goto err_out;
+	}
+	time_now = time(NULL);
+	for (off = sizeof(dns_rslvr_snap_hdr_t); off < hdr->size; off += rec->size) {
+		rec = (dns_rslvr_snap_rec_p)(mem + off);
+		if ((hdr->size - off) < sizeof(dns_rslvr_snap_rec_t) ||
+		    (hdr->size - off) < rec->size ||
+		    0 == rec->size || 0 != (rec->size & 7)) {
+			error = EINVAL; /* Corrupted. */
+			break;
+		}
+		data_size = rec->data_count;
+		if (0 == (DNS_R_CD_F_CNAME & rec->flags)) {
+			data_size *= sizeof(dns_rslvr_cache_addr_t);
+		}
+		if (0 == rec->name_size || DNS_MAX_NAME_LENGTH < rec->name_size ||
+		    0 == data_size ||
+		    (sizeof(dns_rslvr_snap_rec_t) + rec->name_size + data_size) > rec->size) {
+			error = EINVAL;
+			break;
+		}
+		/* Skip expired, keep for stale serving if enabled. */
+		valid_untill = (time_t)rec->valid_untill;
+		if ((valid_untill + (time_t)rslvr->stale_ttl) < time_now)
+			continue;
+		name = (uint8_t*)(rec + 1);
+		data = (name + rec->name_size);
+		/* Do not overwrite existing. */
+		if (0 == hbucket_entry_get(rslvr->hbskt, HBUCKET_GET_F_F_LOCK,
+		    name, rec->name_size, &zone, &entry)) {
+			hbucket_zone_unlock(zone);
+			continue;
+		}
+		error = dns_rslvr_cache_entry_alloc(name, rec->name_size,
+		    &cache_entry);
+		if (0 != error) {
+			hbucket_zone_unlock(zone);
+			break;
+		}
+		cache_entry->pdata = malloc((data_size + 2));
+		if (NULL == cache_entry->pdata) {
+			hbucket_zone_unlock(zone);
+			free(cache_entry);
+			error = ENOMEM;
+			break;
+		}
+		memcpy(cache_entry->pdata, data, data_size);
+		explicit_bzero((cache_entry->pdata + data_size), 2);
+		cache_entry->data_count = rec->data_count;
+		cache_entry->data_allocated = rec->data_count;
+		cache_entry->flags = (rec->flags & (DNS_R_CD_F_CNAME | DNS_R_F_IP_ALL));
+		cache_entry->valid_untill = valid_untill;
+		cache_entry->returned_count = 0;
+		hbucket_entry_add(rslvr->hbskt, HBUCKET_ADD_F_NO_LOCK, zone,
+		    NULL, 0, &cache_entry->entry); /* Zone unlocked after add!!! */
+		count ++;
+	}
+
+err_out:
+	munmap(mem, (size_t)sb.st_size);
+	if (NULL != count_ret) {
+		(*count_ret) = count;
+	}
+
+	return (error);
+}
+
 
 int
 dns_resolv_hostaddr_int(dns_rslvr_p rslvr, int send_request,
@@ -738,7 +1494,7 @@ dns_resolv_hostaddr_int(dns_rslvr_p rslvr, int send_request,
 	time_t time_now = time(NULL);
 	size_t addrs_count;
 	uint16_t loop_count = 0;
-	int error, cache_entry_updating = 0;
+	int error, cache_entry_updating = 0, stale_served = 0;
 	sockaddr_storage_t ssaddrs[DNS_RESOLVER_MAX_ADDRS];
 
 	if (NULL != task_ret && NULL != (*task_ret)) {
@@ -772,6 +1528,30 @@ dns_resolv_hostaddr_int(dns_rslvr_p rslvr, int send_request,
 		}
 		if (cache_entry->valid_untill < time_now) { /* Cached data outdate. */
 			cache_entry->flags |= DNS_R_CD_F_UPDATING;
+			if (NULL == task &&
+			    0 != cache_entry->data_count &&
+			    0 == (DNS_R_CD_F_CNAME & cache_entry->flags) &&
+			    (cache_entry->valid_untill + (time_t)rslvr->stale_ttl) >= time_now) {
+				/* Return stale data and refresh it in
+				 * background task. */
+				error = dns_rslvr_task_alloc(rslvr,
+				    dns_resolver_stale_refresh_cb, NULL, &task);
+				if (0 != error) {
+					cache_entry->flags &= ~DNS_R_CD_F_UPDATING;
+					hbucket_zone_unlock(zone);
+					goto err_out;
+				}
+				task->flags = flags;
+				addrs_count = MIN(cache_entry->data_count,
+				    nitems(ssaddrs));
+				dns_rslvr_cache_addr_cp(cache_entry->addrs,
+				    addrs_count, ssaddrs);
+				hbucket_zone_unlock(zone);
+				/* Refresh task is internal: not for caller. */
+				cb_func(NULL, 0, ssaddrs, addrs_count, arg);
+				stale_served = 1;
+				goto task_alloc;
+			}
 			hbucket_zone_unlock(zone);
 			goto task_alloc;
 		}
@@ -820,8 +1600,6 @@ task_alloc:
 		task->flags = flags;
 	}
 	task->cache_entry = cache_entry;
-	task->timeouts = 0;
-	task->cur_srv_idx = 0;
 	task->loop_count = loop_count;
 	if (0 != cache_entry_updating) {
 		dns_rslvr_cache_entry_task_n_add(cache_entry, task);
@@ -830,11 +1608,11 @@ task_alloc:
 	}
 	if (0 == send_request) /* Return to dns_resolver_recv_cb() and restart search. */
 		return (ERESTART);
-	error = dns_resolver_send(task);
+	error = dns_resolver_query(task);
 	if (0 != error)
 		goto err_out;
 ok_out:
-	if (NULL != task_ret) {
+	if (NULL != task_ret && 0 == stale_served) {
 		(*task_ret) = task;
 	}
 
@@ -842,6 +1620,14 @@ ok_out:
 
 err_out:
 	SYSLOG_ERR(LOG_ERR, error, "dns_resolv_hostaddr_int: failed.");
+	if (0 != stale_served) {
+		/* Caller already got stale data and must not be called
+		 * again: only refresh task callback, keep stale data. */
+		dns_rslvr_cache_entry_upd_cancel(cache_entry);
+		task->cb_func(task, error, NULL, 0, task->udata);
+		dns_rslvr_task_free(task);
+		return (0);
+	}
 	if (0 != send_request) /* Called from: dns_resolver_recv_cb() need callback. */
 		cb_func(task, error, NULL, 0, arg);
 	dns_rslvr_task_free(task);
@@ -890,15 +1676,20 @@ dns_resolver_task_done(dns_rslvr_task_p task, int error,
 
 
 static int
-dns_resolver_send(dns_rslvr_task_p task) {
+dns_resolver_send(dns_rslvr_task_p task, uint16_t srv_idx, uint64_t time_now) {
+	dns_rslvr_p rslvr;
+	dns_rslvr_srv_p srv;
 	uint8_t dns_msg_buf[4096];
 	dns_hdr_p dns_hdr;
 	dns_hdr_flags_t dns_hdr_flags;
 	dns_ex_flags_t dns_ex_flags;
 	size_t msgbuf_size, msg_size;
+	int error;
 
-	if (NULL == task || task->cur_srv_idx >= task->rslvr->dns_addrs_count)
+	if (NULL == task || srv_idx >= task->rslvr->srvs_count)
 		return (EINVAL);
+	rslvr = task->rslvr;
+	srv = &rslvr->srvs[srv_idx];
 
 	dns_hdr_flags.u16 = 0;
 	dns_hdr_flags.bits.rd = 1; //Q- // Recursion Desired
@@ -919,17 +1710,64 @@ dns_resolver_send(dns_rslvr_task_p task) {
 	    task->cache_entry->name_size, DNS_RR_TYPE_A, DNS_RR_CLASS_IN, &msg_size);
 	//dns_msg_question_add(dns_hdr, msg_size, msgbuf_size, 0, task->cache_entry->name,
 	//    task->cache_entry->name_size, DNS_RR_TYPE_AAAA, DNS_RR_CLASS_IN, &msg_size);
-	dns_msg_optrr_add(dns_hdr, msg_size, msgbuf_size, DNS_RESOLVER_OPT_UDP_SIZE,
-	    0, 0, dns_ex_flags.u16, 0, NULL, &msg_size);
-	dns_hdr_ar_inc(dns_hdr, 1);
-
-	if ((ssize_t)msg_size != sendto((int)task->rslvr->sktv4, dns_hdr,
-	    msg_size, (MSG_DONTWAIT | MSG_NOSIGNAL),
-	    (sockaddr_p)&task->rslvr->dns_addrs[task->cur_srv_idx],
-	    sa_size(&task->rslvr->dns_addrs[task->cur_srv_idx])))
-		return (errno);
-	tpt_ev_enable_args(1, TP_EV_TIMER, TP_F_DISPATCH, TP_FF_T_MSEC,
-	    task->rslvr->timeout, &task->rslvr->tasks_tmr[task->task_id]);
+	if (0 != rslvr->edns_udp_size) {
+		dns_msg_optrr_add(dns_hdr, msg_size, msgbuf_size,
+		    rslvr->edns_udp_size, 0, 0, dns_ex_flags.u16, 0, NULL,
+		    &msg_size);
+		dns_hdr_ar_inc(dns_hdr, 1);
+	}
+
+	task->srv_tried |= (((uint64_t)1) << srv_idx);
+	if (0 != (DNS_R_TSK_F_TCP & task->flags)) {
+		error = dns_resolver_tcp_send(rslvr, srv_idx, dns_msg_buf,
+		    msg_size);
+	} else {
+		error = dns_resolver_skt_send(&rslvr->skts[task->skt_idx],
+		    &srv->addr, dns_msg_buf, msg_size);
+	}
+	if (0 != error)
+		return (error);
+	srv->queries ++;
+	if (srv_idx == task->cur_srv_idx) {
+		task->send_time = time_now;
+	} else {
+		task->race_send_time = time_now;
+	}
+
+	return (0);
+}
+
+/* Start new query: select best server from all. */
+static int
+dns_resolver_query(dns_rslvr_task_p task) {
+
+	if (NULL == task)
+		return (EINVAL);
+	task->srv_tried = 0;
+
+	return (dns_resolver_query_next(task, dns_resolver_time_ms()));
+}
+
+/* Send query to best server that not yet tried. */
+static int
+dns_resolver_query_next(dns_rslvr_task_p task, uint64_t time_now) {
+	int error = ETIMEDOUT;
+	uint16_t srv_idx;
+
+	if (NULL == task)
+		return (EINVAL);
+	task->flags &= ~DNS_R_TSK_F_RACE_TMR;
+	task->timeouts = 0;
+	task->race_srv_idx = DNS_RESOLVER_SRV_NONE;
+	while (0 != error &&
+	    0 == dns_resolver_srv_select(task->rslvr, task->srv_tried,
+	    time_now, &srv_idx)) {
+		task->cur_srv_idx = srv_idx;
+		error = dns_resolver_send(task, srv_idx, time_now);
+	}
+	if (0 != error)
+		return (error);
+	dns_resolver_tmr_arm(task, time_now);
 
 	return (0);
 }
@@ -938,37 +1776,312 @@ dns_resolver_send(dns_rslvr_task_p task) {
 static void
 dns_resolver_task_timeout_cb(tp_event_p ev __unused, tp_udata_p tp_udata) {
 	dns_rslvr_task_p task = (dns_rslvr_task_p)tp_udata->ident;
+	dns_rslvr_p rslvr;
+	uint64_t time_now, elapsed;
+	uint16_t srv_idx;
 	int error;
 
 	tpt_ev_enable_args1(0, TP_EV_TIMER, tp_udata);
 	if (NULL == task) /* Task already done/removed. */
 		return;
+	rslvr = task->rslvr;
+	time_now = dns_resolver_time_ms();
+
+	if (0 != (DNS_R_TSK_F_RACE_TMR & task->flags)) {
+		/* Current server is slow: race it with next best server. */
+		task->flags &= ~DNS_R_TSK_F_RACE_TMR;
+		SYSLOGD_EX(LOG_DEBUG, "task %i - %s: race",
+		    task->task_id, task->cache_entry->name);
+		if (0 == dns_resolver_srv_select(rslvr, task->srv_tried,
+		    time_now, &srv_idx) &&
+		    0 == dns_resolver_send(task, srv_idx, time_now)) {
+			task->race_srv_idx = srv_idx;
+		}
+		/* Wait rest of timeout for both. */
+		elapsed = (time_now - task->send_time);
+		tpt_ev_enable_args(1, TP_EV_TIMER, TP_F_DISPATCH, TP_FF_T_MSEC,
+		    ((rslvr->timeout > elapsed) ? (rslvr->timeout - elapsed) : 1),
+		    &task->tmr);
+		return;
+	}
 
 	SYSLOGD_EX(LOG_DEBUG, "task %i - %s",
 	    task->task_id, task->cache_entry->name);
+	dns_resolver_srv_fail(rslvr, task->cur_srv_idx, time_now);
+	if (DNS_RESOLVER_SRV_NONE != task->race_srv_idx) {
+		dns_resolver_srv_fail(rslvr, task->race_srv_idx, time_now);
+		task->race_srv_idx = DNS_RESOLVER_SRV_NONE;
+	}
 	error = ETIMEDOUT;
 	task->timeouts ++;
-	if (task->timeouts <= task->rslvr->retry_count) { /* Re send query. */
-		error = dns_resolver_send(task);
+	if (task->timeouts <= rslvr->retry_count) { /* Re send query. */
+		error = dns_resolver_send(task, task->cur_srv_idx, time_now);
+		if (0 == error) {
+			dns_resolver_tmr_arm(task, time_now);
+		}
 	}
 
 	/* If timeout retry exeed or error on send - try next server. */
-	while ((task->cur_srv_idx + 1) < task->rslvr->dns_addrs_count &&
-	    0 != error) { /* Try next DNS servers. */
-		task->timeouts = 0;
-		task->cur_srv_idx ++;
-		error = dns_resolver_send(task);
+	if (0 != error) {
+		error = dns_resolver_query_next(task, time_now);
 	}
 	if (0 != error) { /* Report about error and destroy task. */
 		dns_resolver_task_done(task, error, NULL, 0,
-		    (time(NULL) + task->rslvr->neg_cache));
+		    (time(NULL) + rslvr->neg_cache));
 	}
 }
 
+/* TCP connection state, io_task and snd/rcv bufs are changed only by
+ * tcp->tpt thread (or by dns_resolver_destroy()), other threads only
+ * append queries to tcp->q_buf and send message to tcp->tpt. */
+static void
+dns_resolver_tcp_close(dns_rslvr_tcp_p tcp) {
+	dns_rslvr_srv_p srv;
+	tp_task_p io_task;
+
+	if (NULL == tcp)
+		return;
+	srv = &tcp->rslvr->srvs[tcp->srv_idx];
+	pthread_mutex_lock(&srv->tcp_mtx);
+	io_task = tcp->io_task;
+	tcp->io_task = NULL;
+	IO_BUF_MARK_AS_EMPTY(&tcp->q_buf); /* Tasks will retry on timeout. */
+	pthread_mutex_unlock(&srv->tcp_mtx);
+	tp_task_destroy(io_task); /* Socket closed by task. */
+	tcp->state = DNS_R_TCP_S_NONE;
+	IO_BUF_MARK_AS_EMPTY(&tcp->snd_buf);
+	IO_BUF_MARK_AS_EMPTY(&tcp->rcv_buf);
+	IO_BUF_MARK_TRANSFER_ALL_FREE(&tcp->rcv_buf);
+}
+
+/* Move queued queries to snd_buf. Caller must hold srv->tcp_mtx.
+ * Return 0 if nothing to send. */
+static int
+dns_resolver_tcp_q_take(dns_rslvr_tcp_p tcp) {
+
+	if (0 == tcp->q_buf.used)
+		return (0);
+	IO_BUF_MARK_AS_EMPTY(&tcp->snd_buf);
+	io_buf_copyin_buf(&tcp->snd_buf, &tcp->q_buf);
+	IO_BUF_MARK_TRANSFER_ALL_USED(&tcp->snd_buf);
+	IO_BUF_MARK_AS_EMPTY(&tcp->q_buf);
+
+	return (1);
+}
+
+/* Called by tcp->tpt: connect or switch connection to send. */
+static void
+dns_resolver_tcp_start(dns_rslvr_tcp_p tcp) {
+	dns_rslvr_p rslvr = tcp->rslvr;
+	dns_rslvr_srv_p srv = &rslvr->srvs[tcp->srv_idx];
+	uintptr_t skt;
+	int error = 0;
+
+	pthread_mutex_lock(&srv->tcp_mtx);
+	/* In DNS_R_TCP_S_SEND state queue taken by dns_resolver_tcp_send_cb(). */
+	if (0 != tcp->q_closed ||
+	    DNS_R_TCP_S_SEND == tcp->state ||
+	    0 == dns_resolver_tcp_q_take(tcp)) {
+		pthread_mutex_unlock(&srv->tcp_mtx);
+		return;
+	}
+	switch (tcp->state) {
+	case DNS_R_TCP_S_NONE:
+		error = skt_connect(&srv->addr, SOCK_STREAM, IPPROTO_TCP,
+		    SO_F_NONBLOCK, &skt);
+		if (0 != error)
+			break;
+		skt_set_tcp_nodelay(skt, 1);
+		error = tp_task_connect_send_create(tcp->tpt, skt,
+		    TP_TASK_F_CLOSE_ON_DESTROY, rslvr->timeout,
+		    &tcp->snd_buf, dns_resolver_tcp_send_cb, tcp,
+		    &tcp->io_task);
+		if (0 != error) {
+			close((int)skt);
+			break;
+		}
+		tcp->state = DNS_R_TCP_S_SEND;
+		break;
+	case DNS_R_TCP_S_RECV: /* Send, continue recv after. */
+		tp_task_stop(tcp->io_task);
+		tcp->state = DNS_R_TCP_S_SEND;
+		error = tp_task_start(tcp->io_task, TP_EV_WRITE, 0,
+		    rslvr->timeout, 0, &tcp->snd_buf, dns_resolver_tcp_send_cb);
+		break;
+	}
+	pthread_mutex_unlock(&srv->tcp_mtx);
+	if (0 != error) {
+		SYSLOG_ERR(LOG_NOTICE, error, "DNS TCP connection: start failed.");
+		dns_resolver_tcp_close(tcp);
+	}
+}
+
+static void
+dns_resolver_tcp_kick_msg_cb(tpt_p tpt __unused, void *udata) {
+	dns_rslvr_tcp_p tcp = udata;
+	dns_rslvr_p rslvr = tcp->rslvr;
+
+	pthread_mutex_lock(&rslvr->srvs[tcp->srv_idx].tcp_mtx);
+	tcp->q_kick_sheduled = 0;
+	pthread_mutex_unlock(&rslvr->srvs[tcp->srv_idx].tcp_mtx);
+	dns_resolver_tcp_start(tcp);
+	dns_resolver_release(rslvr); /* Reference from tcp_send(). */
+}
+
+/* Queue query to upstream TCP connection, connect if needed.
+ * Connection is shared by all tasks with same server, replies
+ * matched to tasks by ID. May be called from any thread. */
+static int
+dns_resolver_tcp_send(dns_rslvr_p rslvr, uint16_t srv_idx,
+    const uint8_t *msg, size_t msg_size) {
+	dns_rslvr_srv_p srv = &rslvr->srvs[srv_idx];
+	dns_rslvr_tcp_p tcp;
+	uint16_t msg_size16;
+	int kick;
+
+	pthread_mutex_lock(&srv->tcp_mtx);
+	tcp = srv->tcp;
+	if (NULL == tcp) {
+		tcp = calloc(1, sizeof(dns_rslvr_tcp_t));
+		if (NULL == tcp) {
+			pthread_mutex_unlock(&srv->tcp_mtx);
+			return (ENOMEM);
+		}
+		tcp->rslvr = rslvr;
+		tcp->tpt = tp_thread_get_rr(rslvr->tp);
+		tcp->srv_idx = srv_idx;
+		tcp->state = DNS_R_TCP_S_NONE;
+		io_buf_init(&tcp->snd_buf, 0, tcp->snd_buf_data,
+		    sizeof(tcp->snd_buf_data));
+		io_buf_init(&tcp->rcv_buf, 0, tcp->rcv_buf_data,
+		    sizeof(tcp->rcv_buf_data));
+		IO_BUF_MARK_TRANSFER_ALL_FREE(&tcp->rcv_buf);
+		io_buf_init(&tcp->q_buf, 0, tcp->q_buf_data,
+		    sizeof(tcp->q_buf_data));
+		srv->tcp = tcp;
+	}
+	if (IO_BUF_FREE_SIZE(&tcp->q_buf) < (sizeof(uint16_t) + msg_size)) {
+		pthread_mutex_unlock(&srv->tcp_mtx);
+		return (ENOBUFS);
+	}
+	msg_size16 = htons((uint16_t)msg_size);
+	io_buf_copyin(&tcp->q_buf, &msg_size16, sizeof(uint16_t));
+	io_buf_copyin(&tcp->q_buf, msg, msg_size);
+	kick = (0 == tcp->q_kick_sheduled);
+	tcp->q_kick_sheduled = 1;
+	pthread_mutex_unlock(&srv->tcp_mtx);
+	if (0 == kick)
+		return (0);
+	/* Send without lock: cb called directly if thread not running. */
+	dns_resolver_ref(rslvr);
+	if (0 != tpt_msg_send(tcp->tpt, NULL, TP_MSG_F_FORCE,
+	    dns_resolver_tcp_kick_msg_cb, tcp)) {
+		pthread_mutex_lock(&srv->tcp_mtx);
+		tcp->q_kick_sheduled = 0;
+		IO_BUF_MARK_AS_EMPTY(&tcp->q_buf);
+		pthread_mutex_unlock(&srv->tcp_mtx);
+		dns_resolver_release(rslvr);
+		return (EIO);
+	}
+
+	return (0);
+}
+
+static int
+dns_resolver_tcp_send_cb(tp_task_p tptask, int error, io_buf_p buf,
+    uint32_t eof, size_t transfered_size __unused, void *arg) {
+	dns_rslvr_tcp_p tcp = arg;
+	dns_rslvr_srv_p srv = &tcp->rslvr->srvs[tcp->srv_idx];
+	int more;
+
+	if (0 != error || 0 != eof) {
+		SYSLOG_ERR(LOG_NOTICE, error, "DNS TCP connection: send failed.");
+		goto err_out;
+	}
+	if (0 != IO_BUF_TR_SIZE_GET(buf))
+		return (TP_TASK_CB_CONTINUE);
+	/* All sent, send queries queued meanwhile. */
+	pthread_mutex_lock(&srv->tcp_mtx);
+	more = dns_resolver_tcp_q_take(tcp);
+	pthread_mutex_unlock(&srv->tcp_mtx);
+	if (0 != more)
+		return (TP_TASK_CB_CONTINUE);
+	/* Wait for replies. */
+	IO_BUF_MARK_AS_EMPTY(buf);
+	tp_task_stop(tptask);
+	tp_task_flags_add(tptask, TP_TASK_F_CB_AFTER_EVERY_READ);
+	tcp->state = DNS_R_TCP_S_RECV;
+	error = tp_task_start(tptask, TP_EV_READ, 0,
+	    DNS_RESOLVER_TCP_IDLE_TIMEOUT, 0, &tcp->rcv_buf,
+	    dns_resolver_tcp_recv_cb);
+	if (0 != error)
+		goto err_out;
+
+	return (TP_TASK_CB_NONE);
+
+err_out:
+	/* Tasks will retry on timeout. */
+	dns_resolver_tcp_close(tcp);
+
+	return (TP_TASK_CB_NONE);
+}
+
+static int
+dns_resolver_tcp_recv_cb(tp_task_p tptask __unused, int error, io_buf_p buf,
+    uint32_t eof, size_t transfered_size __unused, void *arg) {
+	dns_rslvr_tcp_p tcp = arg;
+	dns_rslvr_p rslvr = tcp->rslvr;
+	uint8_t *ptr = buf->data;
+	size_t avail = buf->used, msg_size;
+
+	/* Handle all complete replies. New queries from handler queued
+	 * and sent by message, or inline if thread not running. */
+	while (sizeof(uint16_t) <= avail) {
+		msg_size = ((((size_t)ptr[0]) << 8) | ptr[1]);
+		if ((sizeof(uint16_t) + msg_size) > avail)
+			break;
+		dns_resolver_reply_handle(rslvr, NULL,
+		    &rslvr->srvs[tcp->srv_idx].addr, (ptr + sizeof(uint16_t)),
+		    msg_size);
+		ptr += (sizeof(uint16_t) + msg_size);
+		avail -= (sizeof(uint16_t) + msg_size);
+	}
+	if (DNS_R_TCP_S_NONE == tcp->state) /* Closed by handler. */
+		return (TP_TASK_CB_NONE);
+	memmove(buf->data, ptr, avail);
+	buf->used = avail;
+	IO_BUF_MARK_TRANSFER_ALL_FREE(buf);
+	if (DNS_R_TCP_S_RECV != tcp->state) /* Task restarted by handler. */
+		return (TP_TASK_CB_NONE);
+	if (0 != error || 0 != eof) {
+		/* ETIMEDOUT - idle, EOF - server close connection. */
+		dns_resolver_tcp_close(tcp);
+		return (TP_TASK_CB_NONE);
+	}
+
+	return (TP_TASK_CB_CONTINUE);
+}
+
+
 static int
 dns_resolver_recv_cb(tp_task_p tptask __unused, int error, sockaddr_storage_p addr,
     io_buf_p buf, size_t transfered_size, void *arg) {
-	dns_rslvr_p rslvr = arg;
+	dns_rslvr_skt_p skt = arg;
+
+	if (0 == error) {
+		dns_resolver_reply_handle(skt->rslvr, skt, addr, buf->data,
+		    transfered_size);
+	}
+	IO_BUF_MARK_AS_EMPTY(buf);
+	IO_BUF_MARK_TRANSFER_ALL_FREE(buf);
+
+	return (TP_TASK_CB_CONTINUE);
+}
+
+/* skt - UDP socket that receive reply, NULL for TCP. */
+static void
+dns_resolver_reply_handle(dns_rslvr_p rslvr, dns_rslvr_skt_p skt,
+    sockaddr_storage_p addr, uint8_t *msg, size_t transfered_size) {
 	dns_rslvr_task_p task;
 	size_t tm, rr_count, Offset, rr_size = 0;
 	size_t qd_off, an_off = 0, ns_off, ar_off, total_rr_count = 0, msg_size = 0;
@@ -976,29 +2089,75 @@ dns_resolver_recv_cb(tp_task_p tptask __unused, int error, sockaddr_storage_p ad
 	dns_hdr_p dns_hdr;
 	uint8_t *rr_data;
 	time_t time_now, valid_untill = 0;
+	uint64_t time_now_ms;
+	uint16_t srv_idx;
 	int restarted = 0; /* Found cname in answer, call dns_resolv_hostaddr_int() and now looking for another name. */
 	uint32_t rr_ttl = 0, tmu32;
 	uint16_t rr_type = 0, rr_class = 0, rr_data_size = 0;
+	int error;
 	dns_rslvr_cache_addr_t addrs[DNS_RESOLVER_MAX_ADDRS];
 
 
-	if (0 != error)
-		goto rcv_next;
-	dns_hdr = (dns_hdr_p)buf->data;
+	dns_hdr = (dns_hdr_p)msg;
 	error = dns_msg_info_get(dns_hdr, transfered_size, &qd_off, &an_off, &ns_off,
 	    &ar_off, &total_rr_count, &msg_size);
 	if (0 != error)
 		goto rcv_next;
 	/* task_id */
-	task = (dns_rslvr_task_p)rslvr->tasks_tmr[dns_hdr_id_get(dns_hdr)].ident;
-	if (NULL == task)
+	task = dns_rslvr_task_get(rslvr, dns_hdr_id_get(dns_hdr));
+	if (NULL == task ||
+	    0 != (DNS_R_TSK_F_QUEUED & task->flags) ||
+	    DNS_RESOLVER_SRV_NONE == task->cur_srv_idx)
+		goto rcv_next;
+	/* Filter packets by transport/socket used for query and from addr. */
+	if (NULL == skt) {
+		if (0 == (DNS_R_TSK_F_TCP & task->flags))
+			goto rcv_next;
+	} else if (0 != (DNS_R_TSK_F_TCP & task->flags) ||
+	    skt != &rslvr->skts[task->skt_idx])
 		goto rcv_next;
-	/* Filter packets by from addr. */
-	if (0 == sa_addr_port_is_eq(addr, &rslvr->dns_addrs[task->cur_srv_idx]))
+	if (0 != sa_addr_port_is_eq(addr, &rslvr->srvs[task->cur_srv_idx].addr)) {
+		srv_idx = task->cur_srv_idx;
+	} else if (DNS_RESOLVER_SRV_NONE != task->race_srv_idx &&
+	    0 != sa_addr_port_is_eq(addr, &rslvr->srvs[task->race_srv_idx].addr)) {
+		srv_idx = task->race_srv_idx;
+	} else
 		goto rcv_next;
 
 	/* Looks like answer for resolv task... */
-	tpt_ev_enable_args1(0, TP_EV_TIMER, &rslvr->tasks_tmr[task->task_id]);
+	tpt_ev_enable_args1(0, TP_EV_TIMER, &task->tmr);
+	task->flags &= ~DNS_R_TSK_F_RACE_TMR;
+	/* Update servers health. */
+	time_now_ms = dns_resolver_time_ms();
+	if (srv_idx == task->cur_srv_idx) {
+		dns_resolver_srv_ok(&rslvr->srvs[srv_idx],
+		    (time_now_ms - task->send_time));
+	} else { /* Race winner: loser is at least that slow. */
+		dns_resolver_srv_ok(&rslvr->srvs[srv_idx],
+		    (time_now_ms - task->race_send_time));
+		dns_resolver_srv_rtt_upd(&rslvr->srvs[task->cur_srv_idx],
+		    (time_now_ms - task->send_time));
+		task->cur_srv_idx = srv_idx;
+	}
+	task->race_srv_idx = DNS_RESOLVER_SRV_NONE;
+
+	if (0 != dns_hdr->flags.bits.tc &&
+	    0 == (DNS_R_TSK_F_TCP & task->flags)) {
+		/* Truncated: retry same server over TCP. */
+		SYSLOGD_EX(LOG_DEBUG, "%s - truncated, retry over TCP.",
+		    task->cache_entry->name);
+		task->flags |= DNS_R_TSK_F_TCP;
+		task->timeouts = 0;
+		error = dns_resolver_send(task, task->cur_srv_idx, time_now_ms);
+		if (0 == error) {
+			dns_resolver_tmr_arm(task, time_now_ms);
+			goto rcv_next;
+		}
+		error = dns_resolver_query_next(task, time_now_ms);
+		if (0 == error)
+			goto rcv_next;
+		goto call_cb;
+	}
 
 	time_now = time(NULL);
 	valid_untill = (time_now + rslvr->neg_cache);
@@ -1013,8 +2172,7 @@ dns_resolver_recv_cb(tp_task_p tptask __unused, int error, sockaddr_storage_p ad
 			SYSLOGD_EX(LOG_DEBUG,
 			    "%s - Send query to next dns server.",
 			    task->cache_entry->name);
-			task->cur_srv_idx ++;
-			error = dns_resolver_send(task);
+			error = dns_resolver_query_next(task, time_now_ms);
 		} else {
 			while (0 == dns_msg_rr_get_data(dns_hdr, msg_size, Offset,
 			    NULL, 0, &rr_type, &rr_class, &rr_ttl, &rr_data_size,
@@ -1121,9 +2279,10 @@ dns_resolver_recv_cb(tp_task_p tptask __unused, int error, sockaddr_storage_p ad
 	} /* while. */
 	if ((0 != restarted || 0 != error) && 0 == addrs_count) { /* No addr for cname in answer, request it. */
 		if (0 != error) { /* Try next dns server if answer with errors. */
-			task->cur_srv_idx ++;
+			error = dns_resolver_query_next(task, time_now_ms);
+		} else {
+			error = dns_resolver_query(task);
 		}
-		error = dns_resolver_send(task);
 		if (0 == error)
 			goto rcv_next;
 		/* Fail, callback and end. */
@@ -1133,8 +2292,5 @@ call_cb:
 	dns_resolver_task_done(task, error, addrs, addrs_count, valid_untill);
 
 rcv_next:
-	IO_BUF_MARK_AS_EMPTY(buf);
-	IO_BUF_MARK_TRANSFER_ALL_FREE(buf);
-
-	return (TP_TASK_CB_CONTINUE);
+	return;
 }
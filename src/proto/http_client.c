@@ -31,9 +31,10 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <net/if.h>
+#include <sys/queue.h>
 #include <netinet/in.h>
 
+#include <inttypes.h>
 #include <stdlib.h> /* malloc, exit */
 #include <unistd.h> /* close, write, sysconf */
 #include <string.h> /* memcpy, memmove, memset, strerror... */
@@ -41,1445 +42,1471 @@
 #include <time.h>
 #include <errno.h>
 
+#include "utils/macro.h"
 #include "utils/mem_utils.h"
-#include "utils/num2str.h"
 #include "utils/str2num.h"
+#include "utils/io_buf.h"
 #include "proto/http.h"
 
-#include "utils/macro.h"
 #include "threadpool/threadpool_task.h"
+#include "threadpool/threadpool_msg_sys.h"
 #include "net/socket.h"
+#include "net/socket_address.h"
 #include "net/utils.h"
 #include "utils/info.h"
-#include "net/hostname_list.h"
 #include "proto/http_client.h"
 
 
 
-#define HTTP_LIB_NAME			"HTTP core server by Rozhuk Ivan"
+#define HTTP_LIB_NAME			"HTTP core client by Rozhuk Ivan"
 #define HTTP_LIB_VER			"1.7"
 #define HTTP_LIB_NAME_VER		HTTP_LIB_NAME"/"HTTP_LIB_VER
 
-#define HTTP_CLI_ALLOC_CNT		8
+#define HTTP_CLI_CONN_ADDRS_MAX		8 /* Max resolved addrs to try connect. */
+#define HTTP_CLI_REQ_RETRY_MAX		1 /* Resend if keep-alive connection closed by server. */
+
+
+TAILQ_HEAD(http_cli_req_head, http_client_request_s);
+TAILQ_HEAD(http_cli_conn_head, http_client_connection_s);
+TAILQ_HEAD(http_cli_host_head, http_client_host_s);
 
 
+typedef struct http_client_pool_s { /* Per thread, used only by owner thread. */
+	struct http_cli_host_head hosts;
+	struct http_client_s *cli;
+	tpt_p		tpt;
+	http_cli_stat_t	stat;
+} http_cli_pool_t, *http_cli_pool_p;
 
 
 typedef struct http_client_s {
-	http_cli_cb	ccb;	/* Client callbacks. */
-	void		*udata;	/* Associated data. */
-	http_srv_settings_t s;	/* Settings. */
+	tp_p		tp;
+	dns_rslvr_p	dns_rslvr;
+	http_cli_pool_p	pools;		/* One per thread. */
+	size_t		pools_count;
+	int		destroying;
+	http_cli_settings_t s;		/* Settings. */
 } http_cli_t;
 
 
+typedef struct http_client_host_s {
+	TAILQ_ENTRY(http_client_host_s) next;
+	http_cli_pool_p	pool;
+	struct http_cli_conn_head idle;	/* Keep-alive connections, MRU first. */
+	struct http_cli_conn_head busy;	/* Connecting / have requests in flight. */
+	struct http_cli_req_head wait;	/* Requests waiting for connection. */
+	size_t		conn_count;	/* idle + busy. */
+	uint8_t		*name;
+	size_t		name_size;
+	uint16_t	port;
+} http_cli_host_t, *http_cli_host_p;
+
 
 typedef struct http_client_connection_s {
-	io_task_p	iotask;		/* recv/send from/to client, and socket container. */
-	io_buf_t	snd_hdrs_buf;	/* Used for send http request and responce. */
-	io_buf_t	snd_data_buf;	/* Used for send http request and responce. */
-	io_buf_t	rcv_hdrs_buf;	/* Used for send http request and responce. */
-	io_buf_t	rcv_data_buf;	/* Used for send http request and responce. */
-	http_cli_resp_t	resp;		/* Parsed responce data. */
-	http_cli_cb	ccb;		/* Custom client callbacks. */
-	void		*udata;		/* Client associated data. */
-	uint32_t	state;	/* Client connection state. */
-	uint32_t	flags;		/* Flags: HTTP_CLI_CONN_F_*. */
-	uint32_t	resp_p_flags;	/* Responce processing flags HTTP_CLI_RESP_P_F_*. */
-	host_addr_p	haddr;		/* Hostname and addrs (with port). */
-	size_t		haddr_idx;	/* Index of current IP addr. */
-	thrpt_p		thrpt;
+	TAILQ_ENTRY(http_client_connection_s) next;
+	http_cli_host_p	host;
+	tp_task_p	tptask;		/* Socket container. */
+	tpt_p		tpt;		/* Pool thread, for DNS callback. */
+	size_t		ref_count;	/* Atomic: 1 + pending DNS callback. */
+	uint32_t	state;		/* HTTP_CLI_CONN_S_* */
+	uint32_t	flags;		/* HTTP_CLI_CONN_F_* */
+	int		error;		/* Last connect / DNS / deferred error. */
+	struct http_cli_req_head reqs;	/* Sent requests in responce order. */
+	size_t		reqs_count;
+	size_t		reqs_done;
+	io_buf_p	snd_buf;	/* Serialized requests. */
+	io_buf_p	rcv_buf;
+	/* Responce parse state for first request in reqs. */
+	http_cli_resp_t	resp;
+	size_t		hdr_size;	/* 0 - headers not received. */
+	size_t		body_size;	/* Content-Length / decoded chunks size. */
+	size_t		chunk_off;	/* Offset of next not parsed chunk. */
+	size_t		resp_size;	/* Complete responce size in rcv_buf. */
+	uint32_t	body_type;	/* HTTP_CLI_BODY_* */
+	tp_task_conn_prms_t conn_prms;
+	struct sockaddr_storage addrs[HTTP_CLI_CONN_ADDRS_MAX];
+} http_cli_conn_t, *http_cli_conn_p;
+
+#define HTTP_CLI_CONN_S_RESOLV		0
+#define HTTP_CLI_CONN_S_CONNECT		1
+#define HTTP_CLI_CONN_S_SEND		2
+#define HTTP_CLI_CONN_S_RECV		3
+#define HTTP_CLI_CONN_S_IDLE		4
+
+#define HTTP_CLI_CONN_F_KEEPALIVE	(((uint32_t)1) << 0) /* Server keep connection: can pipeline. */
+#define HTTP_CLI_CONN_F_CLOSE		(((uint32_t)1) << 1) /* No more requests, close after last responce. */
+#define HTTP_CLI_CONN_F_CB		(((uint32_t)1) << 2) /* Responce callbacks in progress. */
+#define HTTP_CLI_CONN_F_FAILED		(((uint32_t)1) << 3) /* Fail deferred until callbacks return. */
+#define HTTP_CLI_CONN_F_FREED		(((uint32_t)1) << 4) /* Freed, wait DNS callback. */
+
+#define HTTP_CLI_BODY_NONE		0
+#define HTTP_CLI_BODY_LEN		1
+#define HTTP_CLI_BODY_CHUNKED		2
+#define HTTP_CLI_BODY_EOF		3 /* Until connection close. */
+
+
+typedef struct http_client_request_s {
+	TAILQ_ENTRY(http_client_request_s) next;
 	http_cli_p	cli;
-} http_cli_conn_t;
-
-
-
-static int	http_srv_new_conn_cb(io_task_p iotask, int error, uintptr_t skt,
-		    struct sockaddr_storage *addr, void *arg);
-static int	http_cli_snd_done_cb(io_task_p iotask, int error,
-		    io_buf_p buf, int eof, size_t transfered_size, void *arg);
-static int	http_cli_recv_done_cb(io_task_p iotask, int error,
-		    io_buf_p buf, int eof, size_t transfered_size, void *arg);
-
+	tpt_p		tpt;
+	http_cli_host_p	host;		/* Set while in host wait list. */
+	http_cli_conn_p	conn;		/* Set while on connection. */
+	http_cli_req_cb	cb_func;
+	void		*udata;
+	uint32_t	flags;		/* HTTP_CLI_REQ_F_* */
+	uint32_t	req_p_flags;	/* HTTP_CLI_REQ_P_F_* */
+	uint32_t	method_code;
+	uint32_t	retry_count;
+	io_buf_p	hdrs_buf;	/* Request line + headers, without final CRLF. */
+	io_buf_p	data_buf;	/* Payload. */
+	uint8_t		*host_hdr;	/* As passed to http_cli_req_create(). */
+	size_t		host_hdr_size;
+	uint8_t		*name;		/* Host name / addr without port. */
+	size_t		name_size;
+	uint16_t	port;
+	int		port_in_hdr;
+} http_cli_req_t;
+
+#define HTTP_CLI_REQ_F_ACTIVE		(((uint32_t)1) << 0) /* Sent, cb not called yet. */
+#define HTTP_CLI_REQ_F_WAIT		(((uint32_t)1) << 1) /* In host wait list. */
+#define HTTP_CLI_REQ_F_MSG		(((uint32_t)1) << 2) /* Send message to tpt in queue. */
+#define HTTP_CLI_REQ_F_FREE		(((uint32_t)1) << 3) /* Freed while in progress. */
+#define HTTP_CLI_REQ_F_IDEMPOTENT	(((uint32_t)1) << 4) /* Can be pipelined / resent. */
+#define HTTP_CLI_REQ_F_REUSED		(((uint32_t)1) << 5)
+#define HTTP_CLI_REQ_F_PIPELINED	(((uint32_t)1) << 6)
+
+
+
+static int	http_cli_host_get(http_cli_pool_p pool, const uint8_t *name,
+		    size_t name_size, uint16_t port, http_cli_host_p *host_ret);
+static void	http_cli_host_gc(http_cli_host_p host);
+static void	http_cli_host_destroy(http_cli_host_p host);
+static void	http_cli_host_wait_dispatch(http_cli_host_p host);
+
+static void	http_cli_req_free_int(http_cli_req_p req);
+static int	http_cli_req_dispatch(http_cli_req_p req);
+static void	http_cli_req_done(http_cli_req_p req, int error,
+		    http_cli_resp_p resp);
+static void	http_cli_req_send_msg_cb(tpt_p tpt, void *udata);
+
+static int	http_cli_conn_create(http_cli_host_p host,
+		    http_cli_conn_p *conn_ret);
+static void	http_cli_conn_free(http_cli_conn_p conn);
+static void	http_cli_conn_release(http_cli_conn_p conn);
+static void	http_cli_conn_fail(http_cli_conn_p conn, int error);
+static int	http_cli_conn_start(http_cli_conn_p conn);
+static int	http_cli_conn_connect(http_cli_conn_p conn);
+static int	http_cli_conn_req_attach(http_cli_conn_p conn,
+		    http_cli_req_p req);
+static int	http_cli_conn_snd_start(http_cli_conn_p conn);
+static int	http_cli_conn_rcv_start(http_cli_conn_p conn);
+static void	http_cli_conn_idle(http_cli_conn_p conn);
+static void	http_cli_conn_resp_reset(http_cli_conn_p conn);
+static int	http_cli_conn_resp_parse(http_cli_conn_p conn,
+		    http_cli_req_p req, int eof);
+static int	http_cli_conn_chunked_parse(http_cli_conn_p conn,
+		    size_t *end_off);
+
+static int	http_cli_dns_cb(dns_rslvr_task_p task, int error,
+		    struct sockaddr_storage *addrs, size_t addrs_count,
+		    void *arg);
+static void	http_cli_dns_msg_cb(tpt_p tpt, void *udata);
+static int	http_cli_connect_cb(tp_task_p tptask, int error,
+		    tp_task_conn_prms_p conn_prms, size_t addr_index,
+		    void *udata);
+static int	http_cli_snd_cb(tp_task_p tptask, int error,
+		    io_buf_p buf, uint32_t eof, size_t transfered_size,
+		    void *udata);
+static int	http_cli_rcv_cb(tp_task_p tptask, int error,
+		    io_buf_p buf, uint32_t eof, size_t transfered_size,
+		    void *udata);
+static int	http_cli_idle_cb(tp_task_p tptask, int error,
+		    io_buf_p buf, uint32_t eof, size_t transfered_size,
+		    void *udata);
 
 
 
 void
 http_cli_def_settings(int add_os_ver, const char *app_ver, int add_lib_ver,
     http_cli_settings_p s_ret) {
-	size_t tm;
+	size_t tm, app_ver_size;
 
 	if (NULL == s_ret)
 		return;
 	/* Init. */
 	memset(s_ret, 0x00, sizeof(http_cli_settings_t));
-	io_net_skt_opts_init(HTTP_CLI_S_SKT_OPTS_INT_MASK,
+	skt_opts_init(HTTP_CLI_S_SKT_OPTS_INT_MASK,
 	    HTTP_CLI_S_SKT_OPTS_INT_VALS, &s_ret->skt_opts);
-	s_ret->skt_opts.mask |= SO_F_NONBLOCK;
-	s_ret->skt_opts.bit_vals |= SO_F_NONBLOCK;
 
 	/* Default settings. */
 	s_ret->skt_opts.mask |= HTTP_CLI_S_DEF_SKT_OPTS_MASK;
 	s_ret->skt_opts.bit_vals |= HTTP_CLI_S_DEF_SKT_OPTS_VALS;
-	s_ret->skt_opts.rcv_timeout = HTTP_CLI_S_DEF_SKT_OPTS_RCVTIMEO;
-	s_ret->skt_opts.snd_timeout = HTTP_CLI_S_DEF_SKT_OPTS_SNDTIMEO;
-	s_ret->hdrs_reserve_size = HTTP_CLI_S_DEF_HDRS_SIZE;
+	s_ret->dns_flags = HTTP_CLI_S_DEF_DNS_FLAGS;
+	s_ret->conn_timeout = HTTP_CLI_S_DEF_CONN_TIMEOUT;
+	s_ret->resp_timeout = HTTP_CLI_S_DEF_RESP_TIMEOUT;
+	s_ret->idle_timeout = HTTP_CLI_S_DEF_IDLE_TIMEOUT;
+	s_ret->conn_max = HTTP_CLI_S_DEF_CONN_MAX;
+	s_ret->pipeline_max = HTTP_CLI_S_DEF_PIPELINE_MAX;
 	s_ret->snd_io_buf_init_size = HTTP_CLI_S_DEF_SND_IO_BUF_INIT;
 	s_ret->rcv_io_buf_init_size = HTTP_CLI_S_DEF_RCV_IO_BUF_INIT;
 	s_ret->rcv_io_buf_max_size = HTTP_CLI_S_DEF_RCV_IO_BUF_MAX;
 	s_ret->req_p_flags = HTTP_CLI_S_DEF_REQ_P_FLAGS;
-	s_ret->resp_p_flags = HTTP_CLI_S_DEF_RESP_P_FLAGS;
 
-	/* 'OS/version UPnP/1.1 product/version' */
+	/* 'OS/version product/version' */
 	s_ret->http_user_agent_size = 0;
 	if (0 != add_os_ver) {
-		if (0 == core_info_get_os_ver("/", 1, s_ret->http_user_agent,
+		if (0 == info_get_os_ver("/", 1, s_ret->http_user_agent,
 		    (sizeof(s_ret->http_user_agent) - 1), &tm)) {
-			s_ret->http_user_agent_size = tm;
+			s_ret->http_user_agent_size = (uint32_t)tm;
 		} else {
 			memcpy(s_ret->http_user_agent, "Generic OS/1.0", 15);
 			s_ret->http_user_agent_size = 14;
 		}
 	}
 	if (NULL != app_ver &&
-	    (sizeof(s_ret->http_server) - 2) > (app_ver_size = strlen(app_ver))) {
-		if (0 != s_ret->http_server_size) {
-			s_ret->http_server[s_ret->http_server_size ++] = ' ';
+	    (sizeof(s_ret->http_user_agent) - 2) >
+	    (s_ret->http_user_agent_size + (app_ver_size = strlen(app_ver)))) {
+		if (0 != s_ret->http_user_agent_size) {
+			s_ret->http_user_agent[s_ret->http_user_agent_size ++] = ' ';
 		}
-		memcpy(s_ret->http_server, app_ver, app_ver_size);
-		s_ret->http_server_size = app_ver_size;
+		memcpy((s_ret->http_user_agent + s_ret->http_user_agent_size),
+		    app_ver, app_ver_size);
+		s_ret->http_user_agent_size += (uint32_t)app_ver_size;
 	}
 	if (0 != add_lib_ver &&
-	    (sizeof(s_ret->http_server) - 2) > sizeof(HTTP_LIB_NAME_VER)) {
-		if (0 != s_ret->http_server_size) {
-			s_ret->http_server[s_ret->http_server_size ++] = ' ';
+	    (sizeof(s_ret->http_user_agent) - 2) >
+	    (s_ret->http_user_agent_size + sizeof(HTTP_LIB_NAME_VER))) {
+		if (0 != s_ret->http_user_agent_size) {
+			s_ret->http_user_agent[s_ret->http_user_agent_size ++] = ' ';
 		}
-		memcpy(s_ret->http_server, HTTP_LIB_NAME_VER,
-		    sizeof(HTTP_LIB_NAME_VER));
-		s_ret->http_server_size = (sizeof(HTTP_LIB_NAME_VER) - 1);
+		memcpy((s_ret->http_user_agent + s_ret->http_user_agent_size),
+		    HTTP_LIB_NAME_VER, sizeof(HTTP_LIB_NAME_VER));
+		s_ret->http_user_agent_size += (sizeof(HTTP_LIB_NAME_VER) - 1);
 	}
-	s_ret->http_server[s_ret->http_server_size] = 0;
+	s_ret->http_user_agent[s_ret->http_user_agent_size] = 0;
 }
 
 
-
 int
-http_cli_create(http_cli_cb ccb, http_cli_settings_p s, void *udata,
+http_cli_create(tp_p tp, dns_rslvr_p dns_rslvr, http_cli_settings_p s,
     http_cli_p *cli_ret) {
-	int error;
-	http_cli_p cli = NULL;
-
-	SYSLOGD_EX(LOG_DEBUG, "...");
-	
-	if (NULL == cli_ret) {
-		error = EINVAL;
-		goto err_out;
-	}
-	if (NULL != s) { /* Validate settings. */
-		if ((s->hdrs_reserve_size + HTTP_CLI_S_DEF_HDRS_SIZE) >
-		    s->snd_io_buf_init_size ||
-		    sizeof(s->http_user_agent) <= s->http_user_agent_size) {
-			error = EINVAL;
-			goto err_out;
-		}
-	}
-	/* Create. */
+	http_cli_p cli;
+	size_t i;
+
+	if (NULL == tp || NULL == cli_ret)
+		return (EINVAL);
 	cli = calloc(1, sizeof(http_cli_t));
-	if (NULL == cli) {
-		error = ENOMEM;
-		goto err_out;
+	if (NULL == cli)
+		return (ENOMEM);
+	cli->pools_count = tp_thread_count_max_get(tp);
+	cli->pools = calloc(cli->pools_count, sizeof(http_cli_pool_t));
+	if (NULL == cli->pools) {
+		free(cli);
+		return (ENOMEM);
+	}
+	cli->tp = tp;
+	cli->dns_rslvr = dns_rslvr;
+	for (i = 0; i < cli->pools_count; i ++) {
+		TAILQ_INIT(&cli->pools[i].hosts);
+		cli->pools[i].cli = cli;
+		cli->pools[i].tpt = tp_thread_get(tp, i);
 	}
-	cli->ccb = ccb;
-	cli->udata = udata;
-	if (NULL == s) { /* Apply default settings */
+	if (NULL == s) {
 		http_cli_def_settings(1, NULL, 1, &cli->s);
 	} else {
 		memcpy(&cli->s, s, sizeof(http_cli_settings_t));
 	}
+	/* Fix values. */
+	if (0 == cli->s.conn_max) {
+		cli->s.conn_max = 1;
+	}
+	if (0 == cli->s.pipeline_max) {
+		cli->s.pipeline_max = 1;
+	}
+	if (0 == cli->s.snd_io_buf_init_size) {
+		cli->s.snd_io_buf_init_size = HTTP_CLI_S_DEF_SND_IO_BUF_INIT;
+	}
+	if (0 == cli->s.rcv_io_buf_init_size) {
+		cli->s.rcv_io_buf_init_size = HTTP_CLI_S_DEF_RCV_IO_BUF_INIT;
+	}
+	cli->s.rcv_io_buf_max_size = MAX(cli->s.rcv_io_buf_max_size,
+	    cli->s.rcv_io_buf_init_size);
+	if (sizeof(cli->s.http_user_agent) <= cli->s.http_user_agent_size) {
+		cli->s.http_user_agent_size = (sizeof(cli->s.http_user_agent) - 1);
+	}
 	/* kb -> bytes, sec -> msec */
-	io_net_skt_opts_cvt(IO_NET_SKT_OPTS_MULT_K, &cli->s.skt_opts);
-	cli->s.hdrs_reserve_size *= 1024;
+	skt_opts_cvt(SKT_OPTS_MULT_K, &cli->s.skt_opts);
+	cli->s.conn_timeout *= 1000;
+	cli->s.resp_timeout *= 1000;
+	cli->s.idle_timeout *= 1000;
 	cli->s.snd_io_buf_init_size *= 1024;
 	cli->s.rcv_io_buf_init_size *= 1024;
 	cli->s.rcv_io_buf_max_size *= 1024;
 	cli->s.http_user_agent[cli->s.http_user_agent_size] = 0;
 
-
 	(*cli_ret) = cli;
 	return (0);
-err_out:
-	if (NULL != cli)
-		free(cli);
-	/* Error. */
-	LOG_ERR(error, "err_out");
-	return (error);
 }
 
 void
 http_cli_destroy(http_cli_p cli) {
+	size_t i;
+	http_cli_host_p host;
 
-	SYSLOGD_EX(LOG_DEBUG, "...");
 	if (NULL == cli)
 		return;
+	cli->destroying = 1;
+	for (i = 0; i < cli->pools_count; i ++) {
+		while (NULL != (host = TAILQ_FIRST(&cli->pools[i].hosts))) {
+			http_cli_host_destroy(host);
+		}
+	}
+	free(cli->pools);
 	free(cli);
 }
 
 int
-http_cli_ccb_get(http_cli_p cli, http_cli_cb *ccb) {
-
-	if (NULL == cli || NULL == ccb)
-		return (EINVAL);
-	(*ccb) = cli->ccb;
-	return (0);
-}
-
-int
-http_cli_ccb_set(http_cli_p cli, http_cli_cb ccb) {
+http_cli_stat_get(http_cli_p cli, http_cli_stat_p stat) {
+	size_t i;
+	http_cli_stat_p pstat;
 
-	if (NULL == cli || NULL == ccb)
+	if (NULL == cli || NULL == stat)
 		return (EINVAL);
-	cli->ccb = ccb;
-	return (0);
-}
-
-void *
-http_cli_get_udata(http_cli_p cli) {
-
-	if (NULL == cli)
-		return (NULL);
-	return (cli->udata);
-}
-
-int
-http_cli_set_udata(http_cli_p cli, void *udata) {
+	memset(stat, 0x00, sizeof(http_cli_stat_t));
+	for (i = 0; i < cli->pools_count; i ++) {
+		pstat = &cli->pools[i].stat;
+		stat->conns_created += pstat->conns_created;
+		stat->conns_reused += pstat->conns_reused;
+		stat->conns_closed += pstat->conns_closed;
+		stat->reqs += pstat->reqs;
+		stat->reqs_pipelined += pstat->reqs_pipelined;
+		stat->reqs_retried += pstat->reqs_retried;
+		stat->reqs_failed += pstat->reqs_failed;
+	}
 
-	if (NULL == cli)
-		return (EINVAL);
-	cli->udata = udata;
 	return (0);
 }
 
 
-int
-http_cli_conn_create(http_cli_p cli, thrpt_p thrpt, http_cli_cb ccb,
-    void *udata, http_cli_conn_p *cli_conn_ret) {
-	
-	if (NULL == cli || NULL == cli_conn_ret)
-		return (EINVAL);
-	cli_conn = calloc(1, sizeof(http_cli_conn_t));
-	if (NULL == cli_conn)
-		return (errno);
-
-	io_buf_init(&cli_conn->snd_hdrs_buf, IO_BUF_F_DATA_ALLOC, NULL, 0);
-	io_buf_init(&cli_conn->snd_data_buf, IO_BUF_F_DATA_ALLOC, NULL, 0);
-	io_buf_init(&cli_conn->rcv_hdrs_buf, IO_BUF_F_DATA_ALLOC, NULL, 0);
-	io_buf_init(&cli_conn->rcv_data_buf, IO_BUF_F_DATA_ALLOC, NULL, 0);
-	if (NULL != ccb) {
-		cli_conn->ccb = ccb;
-	} else {
-		cli_conn->ccb = cli->ccb;
+static int
+http_cli_host_get(http_cli_pool_p pool, const uint8_t *name, size_t name_size,
+    uint16_t port, http_cli_host_p *host_ret) {
+	http_cli_host_p host;
+
+	TAILQ_FOREACH(host, &pool->hosts, next) {
+		if (port != host->port ||
+		    name_size != host->name_size ||
+		    0 != mem_cmpi(name, host->name, name_size))
+			continue;
+		if (host != TAILQ_FIRST(&pool->hosts)) { /* Move to head. */
+			TAILQ_REMOVE(&pool->hosts, host, next);
+			TAILQ_INSERT_HEAD(&pool->hosts, host, next);
+		}
+		(*host_ret) = host;
+		return (0);
 	}
-	cli_conn->udata = udata;
-	cli_conn->state = HTTP_CLI_CONN_STATE_DISCONNECTED;
-	/* Map resp_p_flags. */
-	cli_conn->resp_p_flags = cli->s.resp_p_flags;
-	cli_conn->thrpt = thrpt;
-	cli_conn->cli = cli;
-	
-	(*cli_conn_ret) = cli_conn;
-
+	host = calloc(1, (sizeof(http_cli_host_t) + name_size + sizeof(void*)));
+	if (NULL == host)
+		return (ENOMEM);
+	TAILQ_INIT(&host->idle);
+	TAILQ_INIT(&host->busy);
+	TAILQ_INIT(&host->wait);
+	host->pool = pool;
+	host->name = (uint8_t*)(host + 1);
+	memcpy(host->name, name, name_size);
+	host->name[name_size] = 0;
+	host->name_size = name_size;
+	host->port = port;
+	TAILQ_INSERT_HEAD(&pool->hosts, host, next);
+
+	(*host_ret) = host;
 	return (0);
 }
 
-void
-http_cli_conn_free(http_cli_conn_p cli_conn) {
+/* Free host if no connections and requests. */
+static void
+http_cli_host_gc(http_cli_host_p host) {
 
-	if (NULL == cli_conn)
+	if (0 != host->pool->cli->destroying ||
+	    0 != host->conn_count ||
+	    0 == TAILQ_EMPTY(&host->wait))
 		return;
-	io_task_destroy(cli_conn->iotask);
-	io_buf_free(&cli_conn->snd_hdrs_buf);
-	io_buf_free(&cli_conn->snd_data_buf);
-	io_buf_free(&cli_conn->rcv_hdrs_buf);
-	io_buf_free(&cli_conn->rcv_data_buf);
-	host_addr_free(cli_conn->haddr);
-	free(cli_conn);
-	
-}
-
-void
-http_cli_conn_timeout_chk(http_cli_conn_p cli_conn) {
-
-
+	TAILQ_REMOVE(&host->pool->hosts, host, next);
+	free(host);
 }
 
-/* Set remonte hostname / addr to connect. */
-int
-http_cli_conn_host_addr_set_str(http_cli_conn_p cli_conn,
-    uint8_t *host_name, size_t host_name_size) {
+static void
+http_cli_host_destroy(http_cli_host_p host) {
+	http_cli_req_p req;
+	http_cli_conn_p conn;
 
-	if (NULL == cli_conn || NULL == host_name || 0 == host_name_size)
-		return (EINVAL);
-	cli_conn->haddr = host_addr_alloc(host_name, host_name_size, HTTP_PORT);
-	if (NULL == cli_conn->haddr)
-		return (errno);
-	return (0);
+	while (NULL != (req = TAILQ_FIRST(&host->wait))) {
+		TAILQ_REMOVE(&host->wait, req, next);
+		http_cli_req_done(req, ECANCELED, NULL);
+	}
+	while (NULL != (conn = TAILQ_FIRST(&host->idle))) {
+		http_cli_conn_fail(conn, ECANCELED);
+	}
+	while (NULL != (conn = TAILQ_FIRST(&host->busy))) {
+		http_cli_conn_fail(conn, ECANCELED);
+	}
+	TAILQ_REMOVE(&host->pool->hosts, host, next);
+	free(host);
 }
 
-int
-http_cli_conn_host_addr_set_ss(http_cli_conn_p cli_conn,
-    struct sockaddr_storage *addr) {
+/* Send waiting requests while free connections available. */
+static void
+http_cli_host_wait_dispatch(http_cli_host_p host) {
 	int error;
-	char straddr[STR_ADDR_LEN];
-	size_t straddr_size;
-
-	if (NULL == cli_conn || NULL == addr)
-		return (EINVAL);
-	error = sa_addr_port_to_str(addr, straddr, sizeof(straddr),
-	    &straddr_size);
-	if (0 != error)
-		return (error);
-	error = http_cli_conn_host_addr_set_str(cli_conn, straddr,
-	    straddr_size);
-	if (0 != error)
-		return (error);
-	return (host_addr_add_addr(cli_conn->haddr, addr));
-}
-
-int
-http_cli_conn_host_addr_set_ha(http_cli_conn_p cli_conn,
-    host_addr_p haddr) {
+	http_cli_req_p req;
 
-	if (NULL == cli_conn || NULL == haddr)
-		return (EINVAL);
-	cli_conn->haddr = host_addr_clone(haddr);
-	if (NULL == cli_conn->haddr)
-		return (errno);
-	return (0);
+	if (0 != host->pool->cli->destroying)
+		return;
+	while (NULL != (req = TAILQ_FIRST(&host->wait))) {
+		if (TAILQ_EMPTY(&host->idle) &&
+		    host->conn_count >= host->pool->cli->s.conn_max)
+			break;
+		TAILQ_REMOVE(&host->wait, req, next);
+		req->flags &= ~HTTP_CLI_REQ_F_WAIT;
+		req->host = NULL;
+		error = http_cli_req_dispatch(req);
+		if (0 != error) {
+			host->pool->stat.reqs_failed ++;
+			http_cli_req_done(req, error, NULL);
+		}
+	}
 }
 
 
-/* Set connected to remonte host socket. */
-/* flags - io task flags: IO_TASK_F_CLOSE_ON_DESTROY */
 int
-http_cli_conn_skt_set(http_cli_conn_p cli_conn, uint32_t flags,
-    uintptr_t ident) {
-
-	if (NULL == cli_conn || (uintptr_t)-1 == ident)
+http_cli_req_create(http_cli_p cli, tpt_p tpt, const uint8_t *host,
+    size_t host_size, uint16_t port, http_cli_req_cb cb_func, void *udata,
+    http_cli_req_p *req_ret) {
+	http_cli_req_p req;
+	const uint8_t *name = host, *ptm;
+	size_t name_size = host_size;
+	int port_in_hdr = 0;
+
+	if (NULL == cli || NULL == host || 0 == host_size ||
+	    NULL == cb_func || NULL == req_ret)
+		return (EINVAL);
+	if (NULL == tpt) {
+		tpt = tpt_get_current();
+		if (0 == tp_thread_is_tp_thr(cli->tp, tpt)) {
+			tpt = tp_thread_get_rr(cli->tp);
+		}
+	}
+	if (cli->pools_count <= tpt_get_num(tpt))
+		return (EINVAL);
+	/* Split host and port: "name", "name:port", "[IPv6]:port", "IPv6". */
+	if ('[' == host[0]) {
+		ptm = mem_chr(host, host_size, ']');
+		if (NULL == ptm)
+			return (EINVAL);
+		name = (host + 1);
+		name_size = (size_t)(ptm - name);
+		ptm ++;
+		if (ptm < (host + host_size)) {
+			if (':' != (*ptm))
+				return (EINVAL);
+			ptm ++;
+			port = ustr2u16(ptm, (size_t)((host + host_size) - ptm));
+			port_in_hdr = 1;
+		}
+	} else {
+		ptm = mem_chr(host, host_size, ':');
+		if (NULL != ptm &&
+		    NULL == mem_chr((ptm + 1), (size_t)((host + host_size) - (ptm + 1)), ':')) {
+			name_size = (size_t)(ptm - host);
+			ptm ++;
+			port = ustr2u16(ptm, (size_t)((host + host_size) - ptm));
+			port_in_hdr = 1;
+		}
+	}
+	if (0 == name_size || 0 == port)
 		return (EINVAL);
-	flags &= IO_TASK_F_CLOSE_ON_DESTROY;
-	flags |= IO_TASK_F_CB_AFTER_EVERY_READ;
-	io_task_destroy(cli_conn->iotask);
-
-	return (io_task_create(cli_conn->thrpt, ident, io_task_sr_handler,
-	    flags, cli_conn, &cli_conn->iotask));
-}
-
-io_task_p
-http_cli_conn_get_iotask(http_cli_conn_p cli_conn) {
 
-	if (NULL == cli_conn)
-		return (NULL);
-	return (cli_conn->iotask);
+	req = calloc(1, (sizeof(http_cli_req_t) + host_size + sizeof(void*)));
+	if (NULL == req)
+		return (ENOMEM);
+	req->cli = cli;
+	req->tpt = tpt;
+	req->cb_func = cb_func;
+	req->udata = udata;
+	req->host_hdr = (uint8_t*)(req + 1);
+	memcpy(req->host_hdr, host, host_size);
+	req->host_hdr[host_size] = 0;
+	req->host_hdr_size = host_size;
+	req->name = (req->host_hdr + (name - host));
+	req->name_size = name_size;
+	req->port = port;
+	req->port_in_hdr = port_in_hdr;
+
+	(*req_ret) = req;
+	return (0);
 }
 
-io_task_p
-http_cli_conn_export_iotask(http_cli_conn_p cli_conn) {
-	io_task_p iotask;
+static void
+http_cli_req_free_int(http_cli_req_p req) {
 
-	if (NULL == cli_conn)
-		return (NULL);
-	iotask = cli_conn->iotask;
-	cli_conn->iotask = NULL;
-	return (iotask);
+	io_buf_free(req->hdrs_buf);
+	io_buf_free(req->data_buf);
+	free(req);
 }
 
-int
-http_cli_conn_io_task_set(http_cli_conn_p cli_conn, uint32_t flags,
-    io_task_p iotask) {
-
-	if (NULL == cli_conn || NULL == iotask)
-		return (EINVAL);
-	flags &= IO_TASK_F_CLOSE_ON_DESTROY; /* Filter flags. */
-	flags |= IO_TASK_F_CB_AFTER_EVERY_READ; /* Add flag. */
-	io_task_destroy(cli_conn->iotask);
-	cli_conn->iotask = iotask;
-	io_task_flags_set(iotask, flags);
+void
+http_cli_req_free(http_cli_req_p req) {
+	http_cli_host_p host;
 
-	return (0);
+	if (NULL == req)
+		return;
+	if (0 != (HTTP_CLI_REQ_F_WAIT & req->flags)) {
+		host = req->host;
+		TAILQ_REMOVE(&host->wait, req, next);
+		http_cli_host_gc(host);
+	} else if (NULL != req->conn ||
+	    0 != (HTTP_CLI_REQ_F_MSG & req->flags)) {
+		/* Already sent / will be handled by message cb: drop later. */
+		req->flags |= HTTP_CLI_REQ_F_FREE;
+		return;
+	}
+	http_cli_req_free_int(req);
 }
 
-
 int
-http_cli_conn_req_head_set(http_cli_conn_p cli_conn, uint32_t req_p_flags,
-    uint8_t *method, size_t method_size, uint32_t method_code,
-    uint8_t *uri, size_t uri_size, uint32_t http_ver,
-    uint64_t content_len, uint32_t transfer_encoding_code,
-    struct iovec *custom_hdrs, size_t custom_hdrs_count) {
+http_cli_req_head_set(http_cli_req_p req, uint32_t req_p_flags,
+    const uint8_t *method, size_t method_size, uint32_t method_code,
+    const uint8_t *uri, size_t uri_size,
+    const struct iovec *custom_hdrs, size_t custom_hdrs_count) {
 	int error;
 	size_t i, buf_size;
+	io_buf_p buf;
+	http_cli_settings_p s;
 
-	if (NULL == cli_conn ||
+	if (NULL == req ||
 	    ((NULL == method || 0 == method_size) &&
-	     (HTTP_REQ_METHOD_UNKNOWN == method_code || HTTP_REQ_METHOD__LAST__ < method_code)) ||
-	    NULL == uri || uri_size == 0 ||
-	    (HTTP_VER_1_0 != http_ver && HTTP_VER_1_1 != http_ver) ||
+	     (HTTP_REQ_METHOD_UNKNOWN == method_code ||
+	      HTTP_REQ_METHOD__COUNT__ <= method_code)) ||
+	    NULL == uri || 0 == uri_size ||
 	    (NULL == custom_hdrs && 0 != custom_hdrs_count) ||
-	    (HTTP_REQ_TE__LAST__ > transfer_encoding_code))
+	    HTTP_CLI_MAX_CUSTOM_HDRS_CNT < custom_hdrs_count)
 		return (EINVAL);
+	if (0 != (HTTP_CLI_REQ_F_ACTIVE & req->flags))
+		return (EBUSY);
+	s = &req->cli->s;
 
 	/* Additional cheks and calc headers buf size. */
 	if (NULL == method || 0 == method_size) {
-		method = HTTPReqMethod[method_code];
+		method = (const uint8_t*)HTTPReqMethod[method_code];
 		method_size = HTTPReqMethodSize[method_code];
+	} else if (HTTP_REQ_METHOD_UNKNOWN == method_code) {
+		method_code = http_get_method_fast(method, method_size);
 	}
-	if (0 == cli_conn->s.http_user_agent_size)
+	if (0 == s->http_user_agent_size) {
 		req_p_flags &= ~HTTP_CLI_REQ_P_F_USER_AGENT; /* Unset flag. */
-	buf_size = (method_size + 1 + uri_size + 9 + 2 + iovec_calc_size(custom_hdrs, custom_hdrs_count) + 64);
-	if (0 != (HTTP_CLI_REQ_P_F_HOST & req_p_flags))
-		buf_size += (6 /* "host: " */ + cli_conn->haddr->name_size + 2);
-	if (0 != (HTTP_CLI_REQ_P_F_CONN_CLOSE & req_p_flags))
+	}
+	buf_size = (method_size + 1 + uri_size + 11 +
+	    iovec_calc_size((struct iovec*)(size_t)custom_hdrs, custom_hdrs_count) +
+	    (2 * custom_hdrs_count) + 64);
+	if (0 != (HTTP_CLI_REQ_P_F_HOST & req_p_flags)) {
+		buf_size += (6 /* "Host: " */ + req->host_hdr_size + 8 + 2);
+	}
+	if (0 != (HTTP_CLI_REQ_P_F_CONN_CLOSE & req_p_flags)) {
 		buf_size += 19; /* "Connection: close\r\n" */
-	if (0 != (HTTP_CLI_REQ_P_F_USER_AGENT & req_p_flags))
-		buf_size += (12 /* "User-Agent: " */ + cli_conn->s.http_user_agent_size + 2);
-	if (0 != (HTTP_CLI_REQ_P_F_CONTENT_LEN & req_p_flags))
-		buf_size += 48; /* "Content-Length: \r\n" */
-	if (HTTP_REQ_TE_UNKNOWN != transfer_encoding_code)
-		buf_size += 64;
-
+	}
+	if (0 != (HTTP_CLI_REQ_P_F_USER_AGENT & req_p_flags)) {
+		buf_size += (12 /* "User-Agent: " */ + s->http_user_agent_size + 2);
+	}
 	buf_size = ALIGNEX(buf_size, 1024);
-	error = io_buf_realloc(&cli_conn->snd_hdrs_buf,
-	    IO_BUF_F_DATA_ALLOC, buf_size);
+	error = io_buf_realloc(&req->hdrs_buf, IO_BUF_F_DATA_ALLOC, buf_size);
 	if (0 != error)
 		return (error);
+	buf = req->hdrs_buf;
+	IO_BUF_MARK_AS_EMPTY(buf);
 
 	/* HTTP request line. */
-	/* Method. */
-	io_buf_copyin(&cli_conn->snd_hdrs_buf, method, method_size);
-	IO_BUF_COPYIN_CSTR(&cli_conn->snd_hdrs_buf, " ");
-	/* URI. */
-	io_buf_copyin(&cli_conn->snd_hdrs_buf, uri, uri_size);
-	/* HTTP version. */
-	if (HTTP_VER_1_1 == http_ver) {
-		IO_BUF_COPYIN_CSTR(&cli_conn->snd_hdrs_buf,
-		    " HTTP/1.1\r\n");
-	} else { /* HTTP/1.0 client. */
-		IO_BUF_COPYIN_CSTR(&cli_conn->snd_hdrs_buf,
-		    " HTTP/1.0\r\n");
-	}
-	
+	io_buf_copyin(buf, method, method_size);
+	IO_BUF_COPYIN_CSTR(buf, " ");
+	io_buf_copyin(buf, uri, uri_size);
+	IO_BUF_COPYIN_CSTR(buf, " HTTP/1.1\r\n");
+
 	/* HTTP headers. */
-	/* host */
 	if (0 != (HTTP_CLI_REQ_P_F_HOST & req_p_flags)) {
-		IO_BUF_COPYIN_CSTR(&cli_conn->snd_hdrs_buf, "host: ");
-		io_buf_copyin(&cli_conn->snd_hdrs_buf, cli_conn->haddr->name,
-		    cli_conn->haddr->name_size);
-		IO_BUF_COPYIN_CRLF(&cli_conn->snd_hdrs_buf);
-	}
-	/* Connection: close */
-	if (0 != (HTTP_CLI_REQ_P_F_CONN_CLOSE & req_p_flags)) {
-		IO_BUF_COPYIN_CSTR(&cli_conn->snd_hdrs_buf,
-		    "Connection: close\r\n");
+		IO_BUF_COPYIN_CSTR(buf, "Host: ");
+		io_buf_copyin(buf, req->host_hdr, req->host_hdr_size);
+		if (0 == req->port_in_hdr && HTTP_PORT != req->port) {
+			io_buf_printf(buf, ":%"PRIu16, req->port);
+		}
+		IO_BUF_COPYIN_CRLF(buf);
 	}
-	/* User-Agent */
-	if (0 != (HTTP_CLI_REQ_P_F_HOST & req_p_flags)) {
-		IO_BUF_COPYIN_CSTR(&cli_conn->snd_hdrs_buf,
-		    "User-Agent: ");
-		io_buf_copyin(&cli_conn->snd_hdrs_buf,
-		    cli_conn->s.http_user_agent,
-		    cli_conn->s.http_user_agent_size);
-		IO_BUF_COPYIN_CRLF(&cli_conn->snd_hdrs_buf);
-	}
-	/* Content-Length */
 	if (0 != (HTTP_CLI_REQ_P_F_CONN_CLOSE & req_p_flags)) {
-		error = io_buf_printf(&cli_conn->snd_hdrs_buf,
-		    "Content-Length: %"PRIu64"\r\n",
-		    content_len);
+		IO_BUF_COPYIN_CSTR(buf, "Connection: close\r\n");
 	}
-	/* Transfer-Encoding */
-	if (HTTP_REQ_TE_UNKNOWN != transfer_encoding_code) {
-		error = io_buf_printf(&cli_conn->snd_hdrs_buf,
-		    "Transfer-Encoding: %s\r\n",
-		    HTTPTransferEncoding[transfer_encoding_code]);
+	if (0 != (HTTP_CLI_REQ_P_F_USER_AGENT & req_p_flags)) {
+		IO_BUF_COPYIN_CSTR(buf, "User-Agent: ");
+		io_buf_copyin(buf, s->http_user_agent,
+		    s->http_user_agent_size);
+		IO_BUF_COPYIN_CRLF(buf);
 	}
-
 	for (i = 0; i < custom_hdrs_count; i ++) { /* Add custom headers. */
 		if (NULL == custom_hdrs[i].iov_base || 3 > custom_hdrs[i].iov_len)
 			continue; /* Skeep empty header part. */
-		io_buf_copyin(&cli_conn->snd_hdrs_buf,
-		    custom_hdrs[i].iov_base,
+		io_buf_copyin(buf, custom_hdrs[i].iov_base,
 		    custom_hdrs[i].iov_len);
 		if (0 == memcmp((((uint8_t*)custom_hdrs[i].iov_base) +
 		    (custom_hdrs[i].iov_len - 2)), "\r\n", 2))
 			continue; /* No need to add tailing CRLF. */
-		IO_BUF_COPYIN_CRLF(&cli_conn->snd_hdrs_buf);
+		IO_BUF_COPYIN_CRLF(buf);
+	}
+
+	req->req_p_flags = req_p_flags;
+	req->method_code = method_code;
+	switch (method_code) {
+	case HTTP_REQ_METHOD_OPTIONS:
+	case HTTP_REQ_METHOD_GET:
+	case HTTP_REQ_METHOD_HEAD:
+	case HTTP_REQ_METHOD_PUT:
+	case HTTP_REQ_METHOD_DELETE:
+	case HTTP_REQ_METHOD_TRACE:
+		req->flags |= HTTP_CLI_REQ_F_IDEMPOTENT;
+		break;
+	default:
+		req->flags &= ~HTTP_CLI_REQ_F_IDEMPOTENT;
 	}
-	/* Final empty line - headers end. */
-	IO_BUF_COPYIN_CRLF(&cli_conn->snd_hdrs_buf);
 
 	return (0);
 }
 
-
 int
-http_cli_conn_req_payload_add(http_cli_conn_p cli_conn,
-    uint32_t req_p_flags, uint8_t *payload, size_t payload_size) {
+http_cli_req_payload_add(http_cli_req_p req, const uint8_t *payload,
+    size_t payload_size) {
 	int error;
+	size_t used;
 
-	if (NULL == cli_conn)
+	if (NULL == req || (NULL == payload && 0 != payload_size))
 		return (EINVAL);
-
-	error = io_buf_realloc(&cli_conn->snd_data_buf, 0,
-	    (cli_conn->snd_data_buf.used + payload_size + sizeof(void*)));
+	if (0 != (HTTP_CLI_REQ_F_ACTIVE & req->flags))
+		return (EBUSY);
+	used = ((NULL != req->data_buf) ? req->data_buf->used : 0);
+	error = io_buf_realloc(&req->data_buf, IO_BUF_F_DATA_ALLOC,
+	    (used + payload_size + sizeof(void*)));
 	if (0 != error)
 		return (error);
-	return (io_buf_copyin(&cli_conn->snd_data_buf, payload, payload_size));
+	return (io_buf_copyin(req->data_buf, payload, payload_size));
 }
 
-
 int
-http_cli_conn_req_send(http_cli_conn_p cli_conn) {
+http_cli_req_send(http_cli_req_p req) {
 	int error;
 
-	if (NULL == cli_conn)
+	if (NULL == req || NULL == req->hdrs_buf)
 		return (EINVAL);
-
-	cli_conn->haddr_idx = 0;
-	/* Try connect to server... */
-	if (0 != cli_conn->haddr->count) {
-		error = http_cli_conn_connet(cli_conn);
-	} else {
-		error = dns_resolv_hostaddr(g_data.dns_rslvr,
-		    cli_conn->haddr->name, cli_conn->haddr->name_size,
-		    DNS_R_F_IP_ALL, http_cli_dns_reslv_done_cb,
-		    cli_conn, NULL);
-	}
-}
-
-
-/* Connect to server... */
-int
-http_cli_conn_connet(http_cli_conn_p cli_conn) {
-	int error;
-	uintptr_t ident;
-
-try_conn_next_addr: /* Try connect to another host address. */
-	error = EADDRNOTAVAIL;
-	while (cli_conn->haddr_idx < cli_conn->haddr->count) {
-		error = io_net_connect(
-		    &cli_conn->haddr->addrs[cli_conn->haddr_idx],
-		    SOCK_STREAM, IPPROTO_TCP, (SO_F_NONBLOCK), &ident);
-		cli_conn->haddr_idx ++;
-		if (0 == error)
-			break;
-		LOG_ERR_FMT(error, "Tracker: %s",
-		    cli_conn->haddr->name);
-	}
-
-	if (0 == error) {
-		IO_BUF_MARK_TRANSFER_ALL_USED(&cli_conn->buf_c);
-		io_task_ident_set(cli_conn->iotask, ident);
-		error = io_task_start(cli_conn->iotask, THRP_EV_WRITE, 0,
-			TR_HOST_CONN_SEND_TIMEOUT, 0, cli_conn->buf_c,
-			(io_task_cb)io_send_http_to_tracker_done_cb);
+	if (0 != (HTTP_CLI_REQ_F_ACTIVE & req->flags))
+		return (EBUSY);
+	req->flags |= HTTP_CLI_REQ_F_ACTIVE;
+	req->retry_count = 0;
+	if (tpt_get_current() != req->tpt) { /* Pool owned by req->tpt. */
+		req->flags |= HTTP_CLI_REQ_F_MSG;
+		error = tpt_msg_send(req->tpt, NULL, TP_MSG_F_FORCE,
+		    http_cli_req_send_msg_cb, req);
 		if (0 != error) {
-			LOG_ERR_FMT(error, "Tracker: %s",
-			    cli_conn->haddr->name);
-			goto try_conn_next_addr;
+			req->flags &= ~(HTTP_CLI_REQ_F_ACTIVE | HTTP_CLI_REQ_F_MSG);
 		}
+		return (error);
+	}
+	error = http_cli_req_dispatch(req);
+	if (0 != error) {
+		req->flags &= ~HTTP_CLI_REQ_F_ACTIVE;
 	}
 
 	return (error);
 }
 
-/* Custom step, for user requested tracker. */
-int
-http_cli_dns_reslv_done_cb(dns_rslvr_task_p task __unused, int error,
-    struct sockaddr_storage *addrs, size_t addrs_count, void *arg) {
-	size_t i;
-	http_cli_conn_p cli_conn = arg;
-
-	LOG_ERR_FMT(error, "Tracker: %s (%s)",
-	    cli_conn->haddr->name, cli_conn->descr);
+static void
+http_cli_req_send_msg_cb(tpt_p tpt __unused, void *udata) {
+	http_cli_req_p req = udata;
+	int error;
 
-	for (i = 0; i < addrs_count; i ++) {
-		host_addr_add_addr(cli_conn->haddr, &addrs[i]);
+	req->flags &= ~HTTP_CLI_REQ_F_MSG;
+	if (0 != (HTTP_CLI_REQ_F_FREE & req->flags)) {
+		http_cli_req_free_int(req);
+		return;
 	}
-
-	error = http_cli_conn_connet(cli_conn);
-	if (0 != error) /* Error. */
-		io_recv_http_from_tracker_done_cb(NULL, 0, NULL, 0, 0, cli_conn);
-	return (0);
-}
-
-/* Now we connected to tracker, and send to them http request */
-/* http request is send to tracker, start recv reply. */
-int
-io_send_http_to_tracker_done_cb(io_task_p iotask, int error, io_buf_p buf __unused,
-    int eof __unused, size_t transfered_size __unused, void *arg) {
-	bt_tr_conn_p bt_tr_conn = arg;
-
-	if (0 != error) { /* On error try connect to other host address. */
-		io_task_ident_close(iotask);
-		error = http_cli_conn_connet(bt_tr_conn); /* Retry with next addr. */
-	} else { /* Request sended, receiving responce... */
-		io_task_stop(iotask); /* Stop write. */
-
-		IO_BUF_MARK_AS_EMPTY(&bt_tr_conn->buf_c);
-		IO_BUF_MARK_TRANSFER_ALL_FREE(&bt_tr_conn->buf_c);
-		error = io_task_start(iotask, THRP_EV_READ, 0, TR_HOST_RECV_TIMEOUT,
-		    0, &bt_tr_conn->buf_c, io_recv_http_from_tracker_done_cb);
-		if (0 != error) {
-			bt_tr_conn->tp_stat_tr->send_error ++;
-			LOG_ERR_FMT(error, "Tracker: %s (%s)",
-			    bt_tr_conn->bt_tracker->haddr->name,
-			    bt_tr_conn->bt_tracker->descr);
-		}
+	error = http_cli_req_dispatch(req);
+	if (0 != error) {
+		http_cli_req_done(req, error, NULL);
 	}
-
-	if (0 != error) /* Error. */
-		io_recv_http_from_tracker_done_cb(NULL, 0, NULL, 0, 0, bt_tr_conn);
-	return (IO_TASK_CB_NONE);
 }
 
+tpt_p
+http_cli_req_tpt_get(http_cli_req_p req) {
 
+	if (NULL == req)
+		return (NULL);
+	return (req->tpt);
+}
 
+void *
+http_cli_req_udata_get(http_cli_req_p req) {
 
+	if (NULL == req)
+		return (NULL);
+	return (req->udata);
+}
 
+void
+http_cli_req_udata_set(http_cli_req_p req, void *udata) {
 
+	if (NULL == req)
+		return;
+	req->udata = udata;
+}
 
 
+/* Pick connection for request: idle keep-alive, new, pipeline or wait. */
+static int
+http_cli_req_dispatch(http_cli_req_p req) {
+	int error;
+	http_cli_p cli = req->cli;
+	http_cli_pool_p pool = &cli->pools[tpt_get_num(req->tpt)];
+	http_cli_host_p host;
+	http_cli_conn_p conn, conn_pl = NULL;
+
+	if (0 != cli->destroying)
+		return (ECANCELED);
+	error = http_cli_host_get(pool, req->name, req->name_size, req->port,
+	    &host);
+	if (0 != error)
+		return (error);
+	req->flags &= ~(HTTP_CLI_REQ_F_REUSED | HTTP_CLI_REQ_F_PIPELINED);
+
+	/* Most recently used idle connection. */
+	conn = TAILQ_FIRST(&host->idle);
+	if (NULL != conn) {
+		TAILQ_REMOVE(&host->idle, conn, next);
+		TAILQ_INSERT_TAIL(&host->busy, conn, next);
+		req->flags |= HTTP_CLI_REQ_F_REUSED;
+		pool->stat.conns_reused ++;
+		return (http_cli_conn_req_attach(conn, req));
+	}
+	/* New connection. */
+	if (host->conn_count < cli->s.conn_max) {
+		error = http_cli_conn_create(host, &conn);
+		if (0 != error)
+			goto err_out;
+		error = http_cli_conn_req_attach(conn, req);
+		if (0 == error) {
+			error = http_cli_conn_start(conn);
+		}
+		if (0 != error) {
+			TAILQ_INIT(&conn->reqs);
+			conn->reqs_count = 0;
+			req->conn = NULL;
+			http_cli_conn_free(conn);
+			goto err_out;
+		}
+		return (0);
+	}
+	/* Pipeline: idempotent only, on connection that already keep-alive,
+	 * resent requests wait for free connection. */
+	if (1 < cli->s.pipeline_max &&
+	    0 == req->retry_count &&
+	    0 != (HTTP_CLI_REQ_F_IDEMPOTENT & req->flags) &&
+	    0 == ((HTTP_CLI_REQ_P_F_NO_PIPELINE | HTTP_CLI_REQ_P_F_CONN_CLOSE) &
+	    req->req_p_flags)) {
+		TAILQ_FOREACH(conn, &host->busy, next) {
+			if (HTTP_CLI_CONN_F_KEEPALIVE != (conn->flags &
+			    (HTTP_CLI_CONN_F_KEEPALIVE | HTTP_CLI_CONN_F_CLOSE |
+			    HTTP_CLI_CONN_F_FAILED)) ||
+			    cli->s.pipeline_max <= conn->reqs_count)
+				continue;
+			if (NULL == conn_pl ||
+			    conn_pl->reqs_count > conn->reqs_count) {
+				conn_pl = conn;
+			}
+		}
+		if (NULL != conn_pl) {
+			req->flags |= HTTP_CLI_REQ_F_PIPELINED;
+			pool->stat.reqs_pipelined ++;
+			return (http_cli_conn_req_attach(conn_pl, req));
+		}
+	}
+	/* Wait for free connection. */
+	req->host = host;
+	req->flags |= HTTP_CLI_REQ_F_WAIT;
+	TAILQ_INSERT_TAIL(&host->wait, req, next);
 
+	return (0);
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-io_buf_p
-http_cli_get_buf(http_cli_p cli) {
-
-	if (NULL == cli)
-		return (NULL);
-	return (cli->buf);
+err_out:
+	http_cli_host_gc(host);
+	return (error);
 }
 
-int
-http_cli_buf_reset(http_cli_p cli) {
+static void
+http_cli_req_done(http_cli_req_p req, int error, http_cli_resp_p resp) {
 
-	if (NULL == cli || NULL == cli->buf)
-		return (EINVAL);
-	IO_BUF_BUSY_SIZE_SET(cli->buf, cli->bnd->srv->s.hdrs_reserve_size);
-	return (0);
+	req->flags &= ~(HTTP_CLI_REQ_F_ACTIVE | HTTP_CLI_REQ_F_WAIT);
+	req->host = NULL;
+	req->conn = NULL;
+	if (0 != (HTTP_CLI_REQ_F_FREE & req->flags)) {
+		http_cli_req_free_int(req);
+		return;
+	}
+	req->cb_func(req, error, resp, req->udata);
 }
 
-int
-http_cli_buf_realloc(http_cli_p cli, int allow_decrease, size_t new_size) {
 
-	if (NULL == cli || NULL == cli->buf)
-		return (EINVAL);
-	new_size += cli->bnd->srv->s.hdrs_reserve_size;
-	if (new_size > cli->buf->size || /* Need more space! */
-	    (0 != allow_decrease && (new_size * 2) < cli->buf->size)) { /* Space too mach. */
-		return (io_buf_realloc(&cli->buf, 0, new_size));
+static int
+http_cli_conn_create(http_cli_host_p host, http_cli_conn_p *conn_ret) {
+	http_cli_conn_p conn;
+	http_cli_settings_p s = &host->pool->cli->s;
+
+	conn = calloc(1, sizeof(http_cli_conn_t));
+	if (NULL == conn)
+		return (ENOMEM);
+	conn->snd_buf = io_buf_alloc(IO_BUF_F_DATA_ALLOC,
+	    s->snd_io_buf_init_size);
+	conn->rcv_buf = io_buf_alloc(IO_BUF_F_DATA_ALLOC,
+	    s->rcv_io_buf_init_size);
+	if (NULL == conn->snd_buf || NULL == conn->rcv_buf) {
+		io_buf_free(conn->snd_buf);
+		io_buf_free(conn->rcv_buf);
+		free(conn);
+		return (ENOMEM);
 	}
+	TAILQ_INIT(&conn->reqs);
+	conn->host = host;
+	conn->tpt = host->pool->tpt;
+	conn->ref_count = 1;
+	conn->state = HTTP_CLI_CONN_S_RESOLV;
+	TAILQ_INSERT_TAIL(&host->busy, conn, next);
+	host->conn_count ++;
+	host->pool->stat.conns_created ++;
+
+	(*conn_ret) = conn;
 	return (0);
 }
 
-http_srv_p
-http_cli_get_srv(http_cli_p cli) {
-
-	if (NULL == cli)
-		return (NULL);
-	if (NULL == cli->bnd)
-		return (NULL);
-	return (cli->bnd->srv);
+/* Unlink from host and free resources, memory freed after pending DNS
+ * callback message, if any. */
+static void
+http_cli_conn_free(http_cli_conn_p conn) {
+	http_cli_host_p host = conn->host;
+
+	tp_task_destroy(conn->tptask);
+	conn->tptask = NULL;
+	io_buf_free(conn->snd_buf);
+	io_buf_free(conn->rcv_buf);
+	if (HTTP_CLI_CONN_S_IDLE == conn->state) {
+		TAILQ_REMOVE(&host->idle, conn, next);
+	} else {
+		TAILQ_REMOVE(&host->busy, conn, next);
+	}
+	host->conn_count --;
+	host->pool->stat.conns_closed ++;
+	conn->host = NULL;
+	conn->flags |= HTTP_CLI_CONN_F_FREED;
+	http_cli_conn_release(conn);
 }
 
-http_srv_req_p
-http_cli_get_req(http_cli_p cli) {
+static void
+http_cli_conn_release(http_cli_conn_p conn) {
 
-	if (NULL == cli)
-		return (NULL);
-	return (&cli->req);
+	if (0 != __atomic_sub_fetch(&conn->ref_count, 1, __ATOMIC_ACQ_REL))
+		return;
+	free(conn);
 }
 
-int
-http_cli_ccb_get(http_cli_p cli, http_cli_cb ccb) {
+/* Close connection, resend or report error for requests on it. */
+static void
+http_cli_conn_fail(http_cli_conn_p conn, int error) {
+	int partial;
+	http_cli_host_p host = conn->host;
+	http_cli_pool_p pool = host->pool;
+	http_cli_req_p req;
+	struct http_cli_req_head reqs_retry, reqs_fail;
+
+	if (0 != (HTTP_CLI_CONN_F_CB & conn->flags)) {
+		/* Called from responce callback: http_cli_rcv_cb() finish it. */
+		conn->flags |= HTTP_CLI_CONN_F_FAILED;
+		if (0 == conn->error) {
+			conn->error = error;
+		}
+		return;
+	}
+	TAILQ_INIT(&reqs_retry);
+	TAILQ_INIT(&reqs_fail);
+	/* First request got part of responce: can not resend. */
+	partial = (0 != conn->rcv_buf->used);
+	while (NULL != (req = TAILQ_FIRST(&conn->reqs))) {
+		TAILQ_REMOVE(&conn->reqs, req, next);
+		req->conn = NULL;
+		if (0 != (HTTP_CLI_REQ_F_FREE & req->flags)) {
+			http_cli_req_free_int(req);
+			continue;
+		}
+		/* Server may close keep-alive connection at any time. */
+		if (0 == partial &&
+		    0 == pool->cli->destroying &&
+		    (ECONNRESET == error || EPIPE == error || ENOTCONN == error) &&
+		    0 != (HTTP_CLI_REQ_F_IDEMPOTENT & req->flags) &&
+		    0 != ((HTTP_CLI_REQ_F_REUSED | HTTP_CLI_REQ_F_PIPELINED) & req->flags) &&
+		    HTTP_CLI_REQ_RETRY_MAX > req->retry_count) {
+			req->retry_count ++;
+			TAILQ_INSERT_TAIL(&reqs_retry, req, next);
+		} else {
+			TAILQ_INSERT_TAIL(&reqs_fail, req, next);
+		}
+		partial = 0;
+	}
+	conn->reqs_count = 0;
+	http_cli_conn_free(conn);
 
-	if (NULL == cli || NULL == ccb)
-		return (EINVAL);
-	(*ccb) = cli->ccb;
-	return (0);
+	while (NULL != (req = TAILQ_FIRST(&reqs_retry))) {
+		TAILQ_REMOVE(&reqs_retry, req, next);
+		pool->stat.reqs_retried ++;
+		error = http_cli_req_dispatch(req);
+		if (0 != error) {
+			pool->stat.reqs_failed ++;
+			http_cli_req_done(req, error, NULL);
+		}
+	}
+	while (NULL != (req = TAILQ_FIRST(&reqs_fail))) {
+		TAILQ_REMOVE(&reqs_fail, req, next);
+		pool->stat.reqs_failed ++;
+		http_cli_req_done(req, ((0 != error) ? error : ECONNRESET), NULL);
+	}
+	http_cli_host_wait_dispatch(host);
+	http_cli_host_gc(host);
 }
 
-int
-http_cli_ccb_set(http_cli_p cli, http_cli_cb ccb) {
-
-	if (NULL == cli || NULL == ccb)
-		return (EINVAL);
-	cli->ccb = (*ccb);
-	return (0);
+static int
+http_cli_conn_start(http_cli_conn_p conn) {
+	http_cli_host_p host = conn->host;
+	http_cli_p cli = host->pool->cli;
+
+	if (0 == sa_addr_from_str(&conn->addrs[0], (const char*)host->name,
+	    host->name_size)) { /* IP address. */
+		sa_port_set(&conn->addrs[0], host->port);
+		conn->conn_prms.addrs_count = 1;
+		return (http_cli_conn_connect(conn));
+	}
+	if (NULL == cli->dns_rslvr)
+		return (EDESTADDRREQ);
+	conn->state = HTTP_CLI_CONN_S_RESOLV;
+	/* Resolver always call back, even on error: connection memory
+	 * held until http_cli_dns_msg_cb(). */
+	__atomic_add_fetch(&conn->ref_count, 1, __ATOMIC_RELAXED);
+	return (dns_resolv_hostaddr(cli->dns_rslvr, host->name,
+	    host->name_size, cli->s.dns_flags, http_cli_dns_cb, conn, NULL));
 }
 
-void *
-http_cli_get_udata(http_cli_p cli) {
-
-	if (NULL == cli)
-		return (NULL);
-	return (cli->udata);
-}
+/* May be called from resolver thread: touch only conn fields not used
+ * by pool thread while resolving, conn may be already freed by pool. */
+static int
+http_cli_dns_cb(dns_rslvr_task_p task __unused, int error,
+    struct sockaddr_storage *addrs, size_t addrs_count, void *arg) {
+	http_cli_conn_p conn = arg;
+	size_t i;
 
-int
-http_cli_set_udata(http_cli_p cli, void *udata) {
+	if (0 == error && 0 == addrs_count) {
+		error = EHOSTUNREACH;
+	}
+	conn->error = error;
+	if (0 == error) {
+		addrs_count = MIN(addrs_count, HTTP_CLI_CONN_ADDRS_MAX);
+		for (i = 0; i < addrs_count; i ++) {
+			sa_copy(&addrs[i], &conn->addrs[i]);
+		}
+		conn->conn_prms.addrs_count = addrs_count;
+	}
+	/* Continue in connection thread, always async: cache hit call
+	 * this cb before dns_resolv_hostaddr() return. */
+	error = tpt_msg_send(conn->tpt, NULL, TP_MSG_F_FORCE,
+	    http_cli_dns_msg_cb, conn);
+	if (0 != error) {
+		SYSLOG_ERR(LOG_ERR, error, "tpt_msg_send().");
+		http_cli_conn_release(conn); /* Leave it for timeout. */
+	}
 
-	if (NULL == cli)
-		return (EINVAL);
-	cli->udata = udata;
 	return (0);
 }
 
-uint32_t
-http_cli_get_flags(http_cli_p cli) {
+static void
+http_cli_dns_msg_cb(tpt_p tpt __unused, void *udata) {
+	http_cli_conn_p conn = udata;
+	size_t i;
+	int error;
 
-	if (NULL == cli)
-		return (0);
-	return (cli->flags);
+	if (0 != (HTTP_CLI_CONN_F_FREED & conn->flags)) {
+		http_cli_conn_release(conn); /* Freed while resolving. */
+		return;
+	}
+	error = conn->error;
+	if (0 == error) {
+		for (i = 0; i < conn->conn_prms.addrs_count; i ++) {
+			sa_port_set(&conn->addrs[i], conn->host->port);
+		}
+		error = http_cli_conn_connect(conn);
+	}
+	if (0 != error) {
+		http_cli_conn_fail(conn, error);
+	}
+	http_cli_conn_release(conn);
 }
 
-uint32_t
-http_cli_get_resp_p_flags(http_cli_p cli) {
-
-	if (NULL == cli)
-		return (0);
-	return (cli->resp_p_flags);
+static int
+http_cli_conn_connect(http_cli_conn_p conn) {
+	http_cli_pool_p pool = conn->host->pool;
+
+	conn->state = HTTP_CLI_CONN_S_CONNECT;
+	conn->error = 0;
+	conn->conn_prms.max_tries = 1;
+	conn->conn_prms.protocol = IPPROTO_TCP;
+	conn->conn_prms.addrs = conn->addrs;
+	/* CB_AFTER_EVERY_READ: get connect errors and recv notifications. */
+	return (tp_task_connect_ex_create(pool->tpt,
+	    (TP_TASK_F_CLOSE_ON_DESTROY | TP_TASK_F_CB_AFTER_EVERY_READ),
+	    pool->cli->s.conn_timeout, &conn->conn_prms,
+	    http_cli_connect_cb, conn, &conn->tptask));
 }
 
-uint32_t
-http_cli_add_resp_p_flags(http_cli_p cli, uint32_t resp_p_flags) {
-
-	if (NULL == cli)
-		return (0);
-	cli->resp_p_flags |= resp_p_flags;
-	return (cli->resp_p_flags);
-}
+static int
+http_cli_connect_cb(tp_task_p tptask, int error,
+    tp_task_conn_prms_p conn_prms, size_t addr_index, void *udata) {
+	http_cli_conn_p conn = udata;
+	http_cli_settings_p s = &conn->host->pool->cli->s;
 
-uint32_t
-http_cli_del_resp_p_flags(http_cli_p cli, uint32_t resp_p_flags) {
+	if (0 != error) {
+		if (-1 != error) { /* Remember and try next addr. */
+			conn->error = error;
+			return (TP_TASK_CB_CONTINUE);
+		}
+		http_cli_conn_fail(conn,
+		    ((0 != conn->error) ? conn->error : ECONNREFUSED));
+		return (TP_TASK_CB_NONE);
+	}
+	skt_opts_apply(tp_task_ident_get(tptask),
+	    HTTP_CLI_S_SKT_OPTS_LOAD_MASK, &s->skt_opts,
+	    sa_family(&conn_prms->addrs[addr_index]), NULL);
+	tp_task_tp_cb_func_set(tptask, tp_task_sr_handler);
+	error = http_cli_conn_snd_start(conn);
+	if (0 != error) {
+		http_cli_conn_fail(conn, error);
+	}
 
-	if (NULL == cli)
-		return (0);
-	cli->resp_p_flags &= ~resp_p_flags;
-	return (cli->resp_p_flags);
+	return (TP_TASK_CB_NONE);
 }
 
-void
-http_cli_set_resp_p_flags(http_cli_p cli, uint32_t resp_p_flags) {
+/* Serialize request to connection send buffer. */
+static int
+http_cli_conn_req_attach(http_cli_conn_p conn, http_cli_req_p req) {
+	int error;
+	size_t used, data_size;
+	io_buf_p buf = conn->snd_buf;
 
-	if (NULL == cli)
-		return;
-	cli->resp_p_flags = resp_p_flags;
-}
+	data_size = ((NULL != req->data_buf) ? req->data_buf->used : 0);
+	switch (conn->state) {
+	case HTTP_CLI_CONN_S_SEND: /* Drop already sent. */
+		io_buf_cut_head(buf, buf->offset);
+		break;
+	case HTTP_CLI_CONN_S_RECV:
+	case HTTP_CLI_CONN_S_IDLE:
+		IO_BUF_MARK_AS_EMPTY(buf);
+		break;
+	}
+	used = buf->used;
+	if (IO_BUF_FREE_SIZE(buf) < (req->hdrs_buf->used + 48 + data_size)) {
+		error = io_buf_realloc(&conn->snd_buf, IO_BUF_F_DATA_ALLOC,
+		    ALIGNEX((used + req->hdrs_buf->used + 48 + data_size), 1024));
+		if (0 != error)
+			return (error);
+	}
+	io_buf_copyin(buf, req->hdrs_buf->data, req->hdrs_buf->used);
+	if (0 != (HTTP_CLI_REQ_P_F_CONTENT_LEN & req->req_p_flags) &&
+	    (0 != data_size ||
+	     HTTP_REQ_METHOD_POST == req->method_code ||
+	     HTTP_REQ_METHOD_PUT == req->method_code)) {
+		io_buf_printf(buf, "Content-Length: %zu\r\n", data_size);
+	}
+	IO_BUF_COPYIN_CRLF(buf);
+	if (0 != data_size) {
+		io_buf_copyin(buf, req->data_buf->data, data_size);
+	}
+	IO_BUF_TR_SIZE_INC(buf, (buf->used - used));
 
-int
-http_cli_get_addr(http_cli_p cli, struct sockaddr_storage *addr) {
+	if (0 != (HTTP_CLI_REQ_P_F_CONN_CLOSE & req->req_p_flags)) {
+		conn->flags |= HTTP_CLI_CONN_F_CLOSE;
+	}
+	req->conn = conn;
+	TAILQ_INSERT_TAIL(&conn->reqs, req, next);
+	conn->reqs_count ++;
+	conn->host->pool->stat.reqs ++;
+
+	switch (conn->state) {
+	case HTTP_CLI_CONN_S_RECV:
+	case HTTP_CLI_CONN_S_IDLE:
+		error = http_cli_conn_snd_start(conn);
+		if (0 != error) {
+			TAILQ_REMOVE(&conn->reqs, req, next);
+			conn->reqs_count --;
+			req->conn = NULL;
+			http_cli_conn_fail(conn, error);
+			return (error);
+		}
+		break;
+	}
 
-	if (NULL == cli || NULL == addr)
-		return (EINVAL);
-	sa_copy(&cli->addr, addr);
 	return (0);
 }
 
+static int
+http_cli_conn_snd_start(http_cli_conn_p conn) {
+
+	/* May be called from rcv cb: shedule IO, no direct send. */
+	tp_task_stop(conn->tptask);
+	conn->state = HTTP_CLI_CONN_S_SEND;
+	return (tp_task_start(conn->tptask, TP_EV_WRITE, 0,
+	    conn->host->pool->cli->s.resp_timeout, 0, conn->snd_buf,
+	    http_cli_snd_cb));
+}
 
+static int
+http_cli_conn_rcv_start(http_cli_conn_p conn) {
+
+	tp_task_stop(conn->tptask);
+	conn->state = HTTP_CLI_CONN_S_RECV;
+	IO_BUF_MARK_TRANSFER_ALL_FREE(conn->rcv_buf);
+	return (tp_task_start(conn->tptask, TP_EV_READ, 0,
+	    conn->host->pool->cli->s.resp_timeout, 0, conn->rcv_buf,
+	    http_cli_rcv_cb));
+}
 
+/* All responces received: return to pool or serve waiting request. */
+static void
+http_cli_conn_idle(http_cli_conn_p conn) {
+	int error;
+	http_cli_host_p host = conn->host;
 
-/* New connection received. */
-static int
-http_srv_new_conn_cb(io_task_p iotask, int error, uintptr_t skt,
-    struct sockaddr_storage *addr, void *arg) {
-	http_cli_p cli;
-	http_srv_bind_p bnd = (http_srv_bind_p)arg;
-	http_srv_p srv;
-	thrpt_p thrpt;
-	http_cli_ccb_t ccb;
-	void *udata;
-	char straddr[STR_ADDR_LEN];
-
-	srv = bnd->srv;
+	if (0 != conn->rcv_buf->used) { /* Garbage after last responce. */
+		http_cli_conn_fail(conn, 0);
+		return;
+	}
+	TAILQ_REMOVE(&host->busy, conn, next);
+	TAILQ_INSERT_HEAD(&host->idle, conn, next);
+	conn->state = HTTP_CLI_CONN_S_IDLE;
+	/* Wait for idle timeout or server close. */
+	tp_task_stop(conn->tptask);
+	IO_BUF_MARK_TRANSFER_ALL_FREE(conn->rcv_buf);
+	error = tp_task_start(conn->tptask, TP_EV_READ, 0,
+	    host->pool->cli->s.idle_timeout, 0, conn->rcv_buf,
+	    http_cli_idle_cb);
 	if (0 != error) {
-		close(skt);
-		srv->stat.errors ++;
-		LOG_ERR(error, "on new conn");
-		return (IO_TASK_CB_CONTINUE);
+		http_cli_conn_fail(conn, 0);
+		return;
 	}
+	/* Waiting requests take this connection first. */
+	http_cli_host_wait_dispatch(host);
+}
 
-	/* Default values for new client. */
-	if (IO_NET_SKT_OPTS_IS_FLAG_ACTIVE(&bnd->s.skt_opts, SO_F_REUSEPORT)) {
-		thrpt = io_task_thrpt_get(iotask);
-	} else {
-		thrpt = thrp_thread_get_rr(srv->thrp);
-	}
-	ccb = srv->ccb; /* memcpy */
-	udata = srv->udata;
+static int
+http_cli_snd_cb(tp_task_p tptask __unused, int error, io_buf_p buf,
+    uint32_t eof, size_t transfered_size __unused, void *udata) {
+	http_cli_conn_p conn = udata;
 
-	/* Call back handler. */
-	if (NULL != srv->on_conn) {
-		if (HTTP_CLI_CB_DESTROY == srv->on_conn(bnd, srv->udata,
-		    skt, addr, &thrpt, &ccb, &udata)) {
-			close(skt);
-			return (IO_TASK_CB_CONTINUE);
-		}
+	if (0 != error || 0 != eof) {
+		http_cli_conn_fail(conn, ((0 != error) ? error : ECONNRESET));
+		return (TP_TASK_CB_NONE);
+	}
+	if (0 != IO_BUF_TR_SIZE_GET(buf))
+		return (TP_TASK_CB_CONTINUE);
+	/* All queued requests sent, wait for responces. */
+	IO_BUF_MARK_AS_EMPTY(buf);
+	error = http_cli_conn_rcv_start(conn);
+	if (0 != error) {
+		http_cli_conn_fail(conn, error);
 	}
-	if (0 != LOG_IS_ENABLED()) {
-		sa_addr_port_to_str(addr, straddr, sizeof(straddr), NULL);
-		LOGD_INFO_FMT("New client: %s (fd: %zu)", straddr, skt);
-	}
-
-	cli = http_cli_alloc(bnd, thrpt, skt, &ccb, udata);
-	if (NULL == cli) {
-		if (NULL != ccb.on_destroy) /* Call back handler. */
-			ccb.on_destroy(NULL, udata);
-		close(skt);
-		srv->stat.errors ++;
-		LOG_ERR_FMT(ENOMEM, "%s: http_cli_alloc()", straddr);
-		return (IO_TASK_CB_CONTINUE);
-	}
-	sa_copy(addr, &cli->addr);
-	/* Tune socket. */
-	error = io_net_skt_opts_set_ex(skt, SO_F_TCP_ES_CONN_MASK,
-	    &bnd->s.skt_opts, NULL);
-	SYSLOG_ERR(LOG_NOTICE, error,
-	    "%s: skt_opts_apply(), this is not fatal.", straddr);
-	/* Receive http request. */
-	IO_BUF_MARK_TRANSFER_ALL_FREE(cli->rcv_buf);
-	/* Shedule data receive / Receive http request. */
-	error = io_task_start_ex(IO_NET_SKT_OPTS_IS_FLAG_ACTIVE(&bnd->s.skt_opts, SO_F_ACC_FILTER),
-	    cli->iotask, THRP_EV_READ, 0, bnd->s.skt_opts.rcv_timeout, 0, cli->rcv_buf,
-	    http_srv_recv_done_cb);
-	if (0 != error) { /* Error. */
-		srv->stat.errors ++;
-		http_cli_free(cli);
-		LOG_ERR_FMT(error, "client ip: %s", straddr);
-	}
-	return (IO_TASK_CB_CONTINUE);
-}
 
+	return (TP_TASK_CB_NONE);
+}
 
-/* http request from client is received now, process it. */
 static int
-http_cli_recv_done_cb(io_task_p iotask, int error, io_buf_p buf, int eof,
-    size_t transfered_size, void *arg) {
-	http_cli_p cli = (http_cli_p)arg;
-	http_srv_bind_p bnd;
-	http_srv_p srv;
-	char straddr[STR_ADDR_LEN];
-	uint8_t *ptm;
-	uint16_t host_port;
-	size_t i, tm;
-	int action;
-	struct sockaddr_storage addr;
-
-	SYSLOGD_EX(LOG_DEBUG, "...");
-
-	bnd = cli->bnd;
-	srv = bnd->srv;
-	/* iotask == cli->iotask !!! */
-	/* buf == cli->rcv_buf !!! */
-	// buf->used = buf->offset;
-	action = io_task_cb_check(buf, eof, transfered_size);
-	if (0 != error || IO_TASK_CB_ERROR == action) { /* Fail! :( */
-err_out:
-		if (0 != error && 0 != LOG_IS_ENABLED()) {
-			sa_addr_port_to_str(&cli->addr, straddr, sizeof(straddr), NULL);
-			LOG_ERR_FMT(error, "client ip: %s", straddr);
-		}
-		switch (error) {
-		case 0:
-			break;
-		case ETIMEDOUT:
-			srv->stat.timeouts ++;
+http_cli_rcv_cb(tp_task_p tptask __unused, int error, io_buf_p buf,
+    uint32_t eof, size_t transfered_size __unused, void *udata) {
+	http_cli_conn_p conn = udata;
+	http_cli_req_p req;
+	http_cli_settings_p s = &conn->host->pool->cli->s;
+	int perror;
+
+	/* Handle all complete responces. */
+	conn->flags |= HTTP_CLI_CONN_F_CB;
+	while (NULL != (req = TAILQ_FIRST(&conn->reqs))) {
+		perror = http_cli_conn_resp_parse(conn, req,
+		    (0 == error && 0 != eof));
+		if (EAGAIN == perror)
 			break;
-		default:
-			srv->stat.errors ++;
+		if (0 != perror) {
+			conn->flags |= HTTP_CLI_CONN_F_FAILED;
+			conn->error = perror;
 			break;
 		}
-		http_cli_free(cli);
-		return (IO_TASK_CB_NONE);
-	}
-
-	if (0 != (IO_TASK_IOF_F_SYS & eof)) { /* Client call shutdown(, SHUT_WR) and can only receive data. */
-		cli->flags |= HTTP_CLI_CLI_F_HALF_CLOSED;
-		cli->resp_p_flags |= HTTP_CLI_RESP_P_F_CONN_CLOSE;
-	}
-
-	if (NULL != cli->req.data) { /* Header allready received in prev call, continue receve data. */
-		if (IO_TASK_CB_CONTINUE == action && 0 != IO_BUF_TR_SIZE_GET(buf))
-			goto continue_recv; /* Continue receive request data. */
-		goto req_received; /* Have HTTP headers and (all data / OEF). */
-	}
-
-	/* Analize HTTP header. */
-	ptm = mem_find_cstr(buf->data, buf->used, CRLFCRLF);
-	if (NULL == ptm) { /* No HTTP headers end found. */
-		if (IO_TASK_CB_CONTINUE != action) { /* Cant receive more, drop. */
-drop_cli_without_hdr:
-			if (0 != LOG_IS_ENABLED()) {
-				sa_addr_port_to_str(&cli->addr, straddr, sizeof(straddr), NULL);
-				LOG_INFO_FMT("error: no http header, client ip: %s", straddr);
-			}
-			srv->stat.http_errors ++;
-			http_cli_free(cli);
-			return (IO_TASK_CB_NONE);
+		TAILQ_REMOVE(&conn->reqs, req, next);
+		conn->reqs_count --;
+		conn->reqs_done ++;
+		if (0 != (HTTP_CLI_RD_F_CONN_CLOSE & conn->resp.flags)) {
+			conn->flags |= HTTP_CLI_CONN_F_CLOSE;
+		} else {
+			conn->flags |= HTTP_CLI_CONN_F_KEEPALIVE;
 		}
-continue_recv:
-		/* Realloc buf if needed. */
-		if (0 != IO_BUF_FREE_SIZE(buf))
-			return (IO_TASK_CB_CONTINUE); /* Continue receive. */
-		/* Not enough buf space, try realloc more. */
-		if (buf->size >= srv->s.rcv_io_buf_max_size)
-			goto drop_cli_without_hdr; /* Request too big. */
-		error = io_buf_realloc(&cli->rcv_buf, 0, srv->s.rcv_io_buf_max_size);
-		if (0 == error)
-			goto err_out;
-		io_task_buf_set(iotask, cli->rcv_buf);
-		return (IO_TASK_CB_CONTINUE); /* Continue receive. */
-	}
-	/* CRLFCRLF - end headers marker found. */
-	cli->req.hdr = buf->data;
-	cli->req.hdr_size = (ptm - buf->data);
-	cli->req.data = (ptm + 4);
-
-	/* Parse request line. */
-	if (0 != http_parse_req_line(cli->req.hdr, cli->req.hdr_size, &cli->req.line)) {
-		if (0 != LOG_IS_ENABLED()) {
-			sa_addr_port_to_str(&cli->addr, straddr, sizeof(straddr), NULL);
-			LOG_INFO_FMT("http_parse_req_line(): %s", straddr);
+		if (0 != (HTTP_CLI_REQ_F_REUSED & req->flags)) {
+			conn->resp.flags |= HTTP_CLI_RD_F_CONN_REUSED;
 		}
-		error = 400;
-drop_cli_with_http_err:
-		io_task_stop(iotask);
-		http_srv_snd_err(cli, error, NULL, 0);
-		return (IO_TASK_CB_NONE);
-	}
-
-	/* Do security cheks. */
-	if (0 != http_req_sec_chk(cli->req.hdr, cli->req.hdr_size,
-	    cli->req.line.method_code)) {
-		/* Something wrong in headers. */
-		if (0 != LOG_IS_ENABLED()) {
-			sa_addr_port_to_str(&cli->addr, straddr, sizeof(straddr), NULL);
-			LOG_INFO_FMT("http_req_sec_chk(): %s !!!", straddr);
+		if (0 != (HTTP_CLI_REQ_F_PIPELINED & req->flags)) {
+			conn->resp.flags |= HTTP_CLI_RD_F_PIPELINED;
 		}
-		srv->stat.insecure_requests ++;
-		error = 400;
-		goto drop_cli_with_http_err;
+		http_cli_req_done(req, 0, &conn->resp);
+		io_buf_cut_head(buf, conn->resp_size);
+		http_cli_conn_resp_reset(conn);
+		if (0 != (HTTP_CLI_CONN_F_CLOSE & conn->flags))
+			break; /* Other requests will be resent. */
 	}
+	conn->flags &= ~HTTP_CLI_CONN_F_CB;
 
-	/* Request methods additional handling. */
-	switch (cli->req.line.method_code) {
-	case HTTP_REQ_METHOD_GET:
-	case HTTP_REQ_METHOD_SUBSCRIBE:
-		cli->req.data_size = 0; /* No data in get requests. */
-		break;
-	case HTTP_REQ_METHOD_POST:
-		if (0 != http_hdr_val_get(cli->req.hdr, cli->req.hdr_size,
-		    (uint8_t*)"content-length", 14, &ptm, &tm)) {
-			error = 411; /* Length Required. */
-			goto drop_cli_with_http_err;
-		}
-		cli->req.data_size = UStr8ToUNum(ptm, tm);
-		tm = (buf->used - (cli->req.data - buf->data));
-		if (cli->req.data_size <= tm) /* All data received. */
-			break;
-		if (cli->req.data_size >= srv->s.rcv_io_buf_max_size) {
-			error = 413; /* Request Entity Too Large. */
-			goto drop_cli_with_http_err;
-		}
-		/* Need receive nore data. */
-		if (IO_TASK_CB_CONTINUE != action ||
-		    0 != (HTTP_CLI_CLI_F_HALF_CLOSED & cli->flags)) { /* But we cant! */
-			error = 400; /* Bad request. */
-			goto drop_cli_with_http_err;
-		}
-		io_task_flags_del(iotask, IO_TASK_F_CB_AFTER_EVERY_READ);
-		IO_BUF_TR_SIZE_SET(buf, (cli->req.data_size - tm));
-		if (IO_BUF_FREE_SIZE(buf) < IO_BUF_TR_SIZE_GET(buf)) { /* Reallocate buf. */
-			error = io_buf_realloc(&cli->rcv_buf, 0,
-			    ((32 + IO_BUF_TR_SIZE_GET(buf)) - IO_BUF_FREE_SIZE(buf)));
-			if (0 != error)
-				goto err_out;
-			io_task_buf_set(iotask, cli->rcv_buf);
-		}
-		//LOGD_EV_FMT("tm = %zu, buf->transfer_size = %zu...", tm, IO_BUF_TR_SIZE_GET(buf));
-		goto continue_recv;
-		break;
-	case HTTP_REQ_METHOD_UNKNOWN: /* Not Implemented */
-		error = 501; /* Not Implemented. */
-		goto drop_cli_with_http_err;
-		break;
-	}
-	
-req_received: /* Full request received! */
-	io_task_stop(iotask);
-	if (0 != IO_BUF_FREE_SIZE(buf))
-		(*((uint8_t*)IO_BUF_FREE_GET(buf))) = 0;
-	LOGD_EV_FMT("req in: size=%zu, req line size = %zu, hdr_size = %zu"
-	    "\n==========================================="
-	    "\n%s"
-	    "\n===========================================",
-	    buf->used, cli->req.line.line_size, cli->req.hdr_size, buf->data);
-
-	srv->stat.requests[cli->req.line.method_code] ++;
-	srv->stat.requests_total ++;
-
-	/* Process some headers. */
-	/* Process 'connection' header value. */
-	if (0 == (HTTP_CLI_REQ_P_F_CONNECTION & srv->s.req_p_flags))
-		goto skeep_connection_hdr;
-	if (0 != http_hdr_val_get(cli->req.hdr, cli->req.hdr_size,
-	    (uint8_t*)"connection", 10, &ptm, &tm)) {
-		if (HTTP_VER_1_0 == cli->req.line.proto_ver) {
-			cli->req.flags |= HTTP_CLI_RD_F_CONN_CLOSE;
-		}
-		goto skeep_connection_hdr;
-	}
-	if (0 == mem_cmpin_cstr("close", ptm, tm)) {
-		cli->req.flags |= HTTP_CLI_RD_F_CONN_CLOSE;
-	}
-skeep_connection_hdr:
-	
-	/* Process 'host' header value. */
-	if (0 == (HTTP_CLI_REQ_P_F_HOST & srv->s.req_p_flags))
-		goto skeep_host_hdr;
-	if (0 != http_hdr_val_get(cli->req.hdr, cli->req.hdr_size,
-	    (uint8_t*)"host", 4, &cli->req.host, &cli->req.host_size)) { /* No "host" hdr. */
-		if (HTTP_VER_1_0 == cli->req.line.proto_ver)
-			cli->req.flags |= HTTP_CLI_RD_F_HOST_IS_LOCAL;
-		goto skeep_host_hdr;
-	}
-	/* Is 'host' from request line and from header euqual? */
-	if (NULL != cli->req.line.host) {
-		if (0 != mem_cmpn(cli->req.host, cli->req.host_size,
-		    cli->req.line.host, cli->req.line.host_size)) {
-			if (0 != LOG_IS_ENABLED()) {
-				sa_addr_port_to_str(&cli->addr, straddr, sizeof(straddr), NULL);
-				cli->req.host[cli->req.host_size] = 0;
-				cli->req.line.host[cli->req.line.host_size] = 0;
-				LOG_INFO_FMT("%s: host in request line: \"$s\" "
-				    "does not euqual host in headers: \"$s\"",
-				    cli->req.line.host, cli->req.host, straddr);
-			}
-			srv->stat.insecure_requests ++;
-			http_srv_snd_err(cli, 400, NULL, 0);
-			return (IO_TASK_CB_NONE);
-		}
+	if (0 != (HTTP_CLI_CONN_F_FAILED & conn->flags)) {
+		http_cli_conn_fail(conn, conn->error);
+		return (TP_TASK_CB_NONE);
 	}
-	if (0 == sa_addr_port_from_str(&addr, (const char*)cli->req.host,
-	    cli->req.host_size)) { /* Binary host address. */
-		/* Is connection to loopback from ext host? */
-		if (0 != sa_addr_is_loopback(&addr) && /* To loopback */
-		    0 == sa_addr_is_loopback(&cli->addr)) { /* From net */
-conn_from_net_to_loopback:
-			if (0 != LOG_IS_ENABLED()) {
-				sa_addr_port_to_str(&cli->addr, straddr,
-				    sizeof(straddr), NULL);
-				LOG_INFO_FMT("HACKING ATTEMPT: %s set in host header loopback address.", straddr);
-			}
-			srv->stat.insecure_requests ++;
-			http_srv_snd_err(cli, 403, NULL, 0);
-			return (IO_TASK_CB_NONE);
-		}
-		host_port = sa_port_get(&addr);
-		if (0 == host_port) /* Def http port. */
-			host_port = HTTP_PORT;
-		if (sa_port_get(&bnd->s.addr) == host_port &&
-		    (0 == hostname_list_check_any(&bnd->hst_name_lst) ||
-		    0 == hostname_list_check_any(&srv->hst_name_lst))) {
-			cli->req.flags |= HTTP_CLI_RD_F_HOST_IS_LOCAL;
-			goto skeep_host_hdr;
-		}
-		ptm = NULL; /* Addr info cache. */
-		for (i = 0; i < srv->bind_count; i ++) {
-			if (srv->bnd[i]->s.addr.ss_family != addr.ss_family ||
-			    sa_port_get(&srv->bnd[i]->s.addr) != host_port) /* not equal port! */
-				continue;
-			if (0 == sa_addr_is_specified(&srv->bnd[i]->s.addr)) {
-				/* Binded to: 0.0.0.0 or [::]. */
-				if (0 == is_host_addr_ex(&addr, (void**)&ptm))
-					continue;
-			} else { /* Binded to IP addr. */
-				if (0 == sa_addr_is_eq(&srv->bnd[i]->s.addr, &addr))
-					continue;
-			}
-			cli->req.flags |= HTTP_CLI_RD_F_HOST_IS_LOCAL;
-			break;
-		}
-		is_host_addr_ex_free(ptm);
-	} else { /* Text host address. */
-		cli->req.flags |= HTTP_CLI_RD_F_HOST_IS_STR;
-		ptm = mem_chr(cli->req.host, cli->req.host_size, ':');
-		host_port = HTTP_PORT;
-		if (NULL == ptm) {
-			tm = cli->req.host_size;
+	if (HTTP_CLI_CONN_S_RECV != conn->state) /* Restarted by callback. */
+		return (TP_TASK_CB_NONE);
+	if (0 == conn->reqs_count) {
+		if (0 != (HTTP_CLI_CONN_F_CLOSE & conn->flags)) {
+			http_cli_conn_fail(conn, 0);
 		} else {
-			ptm ++;
-			tm = (ptm - cli->req.host);
-			if (cli->req.host_size > tm) 
-				host_port = UStr8ToUNum32(ptm, (cli->req.host_size - tm));
-			tm --;
-		}
-		action = (0 == mem_cmpin_cstr("localhost", li->req.host, tm));
-		/* Is connection to loopback from ext host? */
-		if (0 != action && 0 == sa_addr_is_loopback(&cli->addr)) /* from ext host? */
-			goto conn_from_net_to_loopback;
-		/* Is hostname point to this host? */
-		if (sa_port_get(&bnd->s.addr) == host_port &&
-		    (0 != action ||
-		    0 == hostname_list_check(&bnd->hst_name_lst, cli->req.host, tm) ||
-		    0 == hostname_list_check(&srv->hst_name_lst, cli->req.host, tm)))
-			cli->req.flags |= HTTP_CLI_RD_F_HOST_IS_LOCAL;
-	}
-skeep_host_hdr:
-
-	/* Delayed allocation buffer for answer */
-	/* cli->buf != cli->rcv_buf!!!: if cb func realloc buf, then rcv_buf became invalid. */
-	if (NULL == cli->buf || cli->buf == cli->rcv_buf) {
-		cli->buf = io_buf_alloc(IO_BUF_FLAGS_STD, srv->s.snd_io_buf_init_size);
-		if (NULL == cli->buf) { /* Allocate fail, send error. */
-			/* Force 'connection: close'. */
-			cli->resp_p_flags |= HTTP_CLI_RESP_P_F_CONN_CLOSE;
-			cli->buf = cli->rcv_buf;
-			srv->stat.errors ++;
-			srv->stat.http_errors --; /* http_srv_snd_err() will increase it.*/
-			http_srv_snd_err(cli, 500, NULL, 0);
-			return (IO_TASK_CB_NONE);
+			http_cli_conn_idle(conn);
 		}
+		return (TP_TASK_CB_NONE);
 	}
-	/* Reserve space for HTTP headers. */
-	IO_BUF_BUSY_SIZE_SET(cli->buf, srv->s.hdrs_reserve_size);
-
-	/* Call client custom on_req_rcv cb. */
-	if (NULL != cli->ccb.on_req_rcv) { /* Call back handler. */
-		action = cli->ccb.on_req_rcv(cli, cli->udata, &cli->req);
-	} else {
-		action = 404; /* Default action. */
+	if (0 != (HTTP_CLI_CONN_F_CLOSE & conn->flags)) {
+		/* Server will close connection: resend pipelined requests. */
+		IO_BUF_MARK_AS_EMPTY(buf);
+		http_cli_conn_fail(conn, ECONNRESET);
+		return (TP_TASK_CB_NONE);
 	}
-	
-	/* Handle call back function return code. */
-	switch (action) {
-	case HTTP_CLI_CB_DESTROY:
-		http_cli_free(cli);
-		break;
-	case HTTP_CLI_CB_NONE:
-		break;
-	default: /* Send HTTP code. */
-		http_srv_snd_err(cli, action, NULL, 0);
+	if (0 != error || 0 != eof) {
+		http_cli_conn_fail(conn, ((0 != error) ? error : ECONNRESET));
+		return (TP_TASK_CB_NONE);
 	}
+	if (0 == IO_BUF_FREE_SIZE(buf)) { /* Grow buffer. */
+		if (s->rcv_io_buf_max_size <= buf->size ||
+		    0 != io_buf_realloc(&conn->rcv_buf, IO_BUF_F_DATA_ALLOC,
+		    MIN(s->rcv_io_buf_max_size, (buf->size * 2)))) {
+			http_cli_conn_fail(conn, ENOBUFS);
+			return (TP_TASK_CB_NONE);
+		}
+	}
+	IO_BUF_MARK_TRANSFER_ALL_FREE(buf);
 
-	return (IO_TASK_CB_NONE);
+	return (TP_TASK_CB_CONTINUE);
 }
 
+static int
+http_cli_idle_cb(tp_task_p tptask __unused, int error __unused,
+    io_buf_p buf __unused, uint32_t eof __unused,
+    size_t transfered_size __unused, void *udata) {
 
+	/* Idle timeout, server close connection or unexpected data. */
+	http_cli_conn_fail(udata, 0);
 
+	return (TP_TASK_CB_NONE);
+}
 
-int
-http_srv_gen_resp_hdrs(uint32_t http_ver, uint32_t status_code,
-    uint32_t resp_p_flags, const char *reason_phrase, size_t reason_phrase_size,
-    const char *http_user_agent, size_t http_user_agent_size,
-    uint64_t content_len, char *buf, size_t buf_size, size_t *buf_size_ret) {
-	int error;
-	size_t hdrs_size, sztm;
 
-	if (NULL == buf || 0 == buf_size)
-		return (EINVAL);
-	if (NULL != reason_phrase && 0 != reason_phrase_size) {
-		/* Remove CRLF from tail. */
-		while (0 < reason_phrase_size &&
-		    ('\r' == reason_phrase[(reason_phrase_size - 1)] ||
-		    '\n' == reason_phrase[(reason_phrase_size - 1)]))
-			reason_phrase_size --;
-	}
-	if (NULL == reason_phrase || 0 == reason_phrase_size)
-		reason_phrase = http_get_err_descr(status_code, &reason_phrase_size);
-	if (NULL == http_user_agent || 0 == http_user_agent_size)
-		resp_p_flags &= ~HTTP_CLI_RESP_P_F_SERVER; /* Unset flag. */
-	if (buf_size < (9 + 8 + reason_phrase_size + 
-	    ((0 != (HTTP_CLI_RESP_P_F_SERVER & resp_p_flags)) ? (10 + http_user_agent_size) : 0) +
-	    ((0 != (HTTP_CLI_RESP_P_F_CONTENT_SIZE & resp_p_flags)) ? 32 : 0) +
-	    ((0 != (HTTP_CLI_RESP_P_F_CONN_CLOSE & resp_p_flags)) ? 19 : 0)))
-		return (ENOMEM); /* Not enough space in buf. */
-	buf_size --; /* Keep last byte for zero. */
-	/* HTTP header. */
-	if (HTTP_VER_1_1 == http_ver) { /* HTTP/1.1 client. */
-		memcpy(buf, "HTTP/1.1 ", 9);
-	} else { /* HTTP/1.0 client. */
-		memcpy(buf, "HTTP/1.0 ", 9);
-	}
-	hdrs_size = 9;
-
-	error = u322str(status_code,
-	    (buf + hdrs_size), (buf_size - hdrs_size), &sztm);
-	if (0 != error)
-		return (error);
-	hdrs_size += sztm;
-	buf[hdrs_size ++] = ' ';
-	memcpy((buf + hdrs_size), reason_phrase, reason_phrase_size);
-	hdrs_size += reason_phrase_size;
-	buf[hdrs_size ++] = '\r';
-	buf[hdrs_size ++] = '\n';
-
-	if (0 != (resp_p_flags & HTTP_CLI_RESP_P_F_SERVER)) {
-		memcpy((buf + hdrs_size), "Server: ", 8);
-		hdrs_size += 8;
-		memcpy((buf + hdrs_size), http_user_agent, http_user_agent_size);
-		hdrs_size += http_user_agent_size;
-		buf[hdrs_size ++] = '\r';
-		buf[hdrs_size ++] = '\n';
-	}
-	if (0 != (resp_p_flags & HTTP_CLI_RESP_P_F_CONTENT_SIZE)) {
-		memcpy((buf + hdrs_size), "Content-Length: ", 16);
-		hdrs_size += 16;
-		error = u642str(content_len, (buf + hdrs_size),
-		    (buf_size - hdrs_size), &sztm);
-		if (0 != error)
-			return (error);
-		hdrs_size += sztm;
-		buf[hdrs_size ++] = '\r';
-		buf[hdrs_size ++] = '\n';
+static void
+http_cli_conn_resp_reset(http_cli_conn_p conn) {
+
+	memset(&conn->resp, 0x00, sizeof(http_cli_resp_t));
+	conn->hdr_size = 0;
+	conn->body_size = 0;
+	conn->chunk_off = 0;
+	conn->resp_size = 0;
+	conn->body_type = HTTP_CLI_BODY_NONE;
+}
+
+/* Return: 0 - responce complete, EAGAIN - need more data, other - error. */
+static int
+http_cli_conn_resp_parse(http_cli_conn_p conn, http_cli_req_p req, int eof) {
+	int error;
+	io_buf_p buf = conn->rcv_buf;
+	uint8_t *ptr;
+	const uint8_t *ptm;
+	size_t tm, end_off = 0;
+	uint32_t status_code;
+
+	if (0 != conn->hdr_size)
+		goto parse_body;
+parse_hdr:
+	ptr = mem_find_cstr(buf->data, buf->used, CRLFCRLF);
+	if (NULL == ptr) {
+		if (0 == eof)
+			return (EAGAIN);
+		return ((0 == buf->used) ? ECONNRESET : EBADMSG);
+	}
+	conn->hdr_size = ((size_t)(ptr - buf->data) + 4);
+	if (0 != http_parse_resp_line(buf->data, conn->hdr_size,
+	    &conn->resp.line))
+		return (EBADMSG);
+	status_code = conn->resp.line.status_code;
+	if (100 <= status_code && 200 > status_code) { /* Interim responce. */
+		io_buf_cut_head(buf, conn->hdr_size);
+		http_cli_conn_resp_reset(conn);
+		goto parse_hdr;
 	}
-	if (0 != (HTTP_CLI_RESP_P_F_CONN_CLOSE & resp_p_flags)) { /* Conn close. */
-		memcpy((buf + hdrs_size), "Connection: close\r\n", 19);
-		hdrs_size += 19;
+	/* Connection persistence. */
+	if (0 == http_hdr_val_get(buf->data, conn->hdr_size,
+	    (const uint8_t*)"connection", 10, &ptm, &tm)) {
+		if (0 == mem_cmpin_cstr("close", ptm, tm)) {
+			conn->resp.flags |= HTTP_CLI_RD_F_CONN_CLOSE;
+		}
+	} else if (HTTP_VER_1_1 > conn->resp.line.proto_ver) {
+		conn->resp.flags |= HTTP_CLI_RD_F_CONN_CLOSE;
+	}
+	/* Body length: RFC 7230 3.3.3. */
+	if (HTTP_REQ_METHOD_HEAD == req->method_code ||
+	    204 == status_code || 304 == status_code) {
+		conn->body_type = HTTP_CLI_BODY_NONE;
+	} else if (0 == http_hdr_val_get(buf->data, conn->hdr_size,
+	    (const uint8_t*)"transfer-encoding", 17, &ptm, &tm) &&
+	    NULL != mem_find_cstr(ptm, tm, "chunked")) {
+		conn->body_type = HTTP_CLI_BODY_CHUNKED;
+		conn->chunk_off = conn->hdr_size;
+		conn->resp.flags |= HTTP_CLI_RD_F_TE_CHUNK;
+	} else if (0 == http_hdr_val_get(buf->data, conn->hdr_size,
+	    (const uint8_t*)"content-length", 14, &ptm, &tm)) {
+		conn->body_type = HTTP_CLI_BODY_LEN;
+		conn->body_size = ustr2usize(ptm, tm);
+	} else {
+		conn->body_type = HTTP_CLI_BODY_EOF;
+		conn->resp.flags |= HTTP_CLI_RD_F_CONN_CLOSE;
 	}
 
-	buf[hdrs_size] = 0;
-	if (NULL != buf_size_ret) {
-		(*buf_size_ret) = hdrs_size;
+parse_body:
+	switch (conn->body_type) {
+	case HTTP_CLI_BODY_NONE:
+		end_off = conn->hdr_size;
+		break;
+	case HTTP_CLI_BODY_LEN:
+		end_off = (conn->hdr_size + conn->body_size);
+		if (conn->hdr_size > end_off || /* Overflow. */
+		    conn->host->pool->cli->s.rcv_io_buf_max_size < end_off)
+			return (ENOBUFS);
+		if (buf->used < end_off)
+			return ((0 == eof) ? EAGAIN : ECONNRESET);
+		break;
+	case HTTP_CLI_BODY_CHUNKED:
+		error = http_cli_conn_chunked_parse(conn, &end_off);
+		if (EAGAIN == error && 0 != eof)
+			return (ECONNRESET);
+		if (0 != error)
+			return (error);
+		break;
+	case HTTP_CLI_BODY_EOF:
+		if (0 == eof)
+			return (EAGAIN);
+		end_off = buf->used;
+		conn->body_size = (end_off - conn->hdr_size);
+		break;
 	}
+	/* Buffer may be reallocated since headers parsed: update pointers. */
+	if (0 != http_parse_resp_line(buf->data, conn->hdr_size,
+	    &conn->resp.line))
+		return (EBADMSG);
+	conn->resp.hdr = buf->data;
+	conn->resp.hdr_size = conn->hdr_size;
+	conn->resp.data = (buf->data + conn->hdr_size);
+	conn->resp.data_size = conn->body_size;
+	conn->resp_size = end_off;
 
 	return (0);
 }
 
-
-/* Offset must pont to data start, size = data offset + data size. */
-int
-http_srv_snd(http_cli_p cli, uint32_t status_code,
-    const char *reason_phrase, size_t reason_phrase_size,
-    struct iovec *custom_hdrs, size_t custom_hdrs_count) {
-	int error;
-	http_srv_p srv;
-	uint8_t	*wr_pos;
-	char hdrs[1024], *crlf = (char*)"\r\n";
-	size_t hdrs_size, data_size, i;
-	ssize_t ios = 0;
-	struct iovec iov[IOV_MAX];
-	struct msghdr mhdr;
-
-	if (NULL == cli)
-		return (EINVAL);
-	srv = cli->bnd->srv;
-	if (404 == status_code)
-		srv->stat.unhandled_requests ++;
-	if (cli->buf->used < cli->buf->offset ||
-	    HTTP_CLI_MAX_CUSTOM_HDRS_CNT < custom_hdrs_count) { /* Limit custom hdrs count. */
-		error = EINVAL;
-		goto err_out;
-	}
-	data_size = (cli->buf->used - cli->buf->offset);
-	if (0 != (HTTP_CLI_CLI_F_HALF_CLOSED & cli->flags) ||
-	    0 != (HTTP_CLI_RD_F_CONN_CLOSE & cli->req.flags)) {
-		cli->resp_p_flags |= HTTP_CLI_RESP_P_F_CONN_CLOSE;
-	}
-
-	/* HTTP header. */
-	error = http_srv_gen_resp_hdrs(cli->req.line.proto_ver, status_code,
-	    cli->resp_p_flags, reason_phrase, reason_phrase_size, srv->s.http_user_agent,
-	    srv->s.http_user_agent_size, data_size, (char*)hdrs, sizeof(hdrs),
-	    &hdrs_size);
-	if (0 != error)
-		goto err_out;
-	/* Custom headers pre process. */
-	if (NULL == custom_hdrs)
-		custom_hdrs_count = 0;
-	LOGD_EV_FMT("\r\n%s", hdrs);
-	//LOGD_EV(custom_hdrs);
-	//LOGD_EV((cli->buf->data + cli->buf->offset));
-	//LOGD_EV_FMT("offset: %zu, used: %zu", cli->buf->offset, cli->buf->used);
-
-	/* Send data... */
-	/* Try "zero copy" send first. */
-	memset(&mhdr, 0x00, sizeof(mhdr));
-	mhdr.msg_iov = iov;
-	mhdr.msg_iovlen ++;
-	iov[0].iov_base = hdrs;
-	iov[0].iov_len = hdrs_size;
-	for (i = 0; i < custom_hdrs_count; i ++) { /* Add custom headers. */
-		if (NULL == custom_hdrs[i].iov_base || 3 > custom_hdrs[i].iov_len)
-			continue; /* Skeep empty header part. */
-		iov[mhdr.msg_iovlen].iov_base = custom_hdrs[i].iov_base;
-		iov[mhdr.msg_iovlen].iov_len = custom_hdrs[i].iov_len;
-		mhdr.msg_iovlen ++;
-		hdrs_size += custom_hdrs[i].iov_len;
-		if (0 == memcmp((((uint8_t*)custom_hdrs[i].iov_base) +
-		    (custom_hdrs[i].iov_len - 2)), crlf, 2))
-			continue; /* No need to add tailing CRLF. */
-		iov[mhdr.msg_iovlen].iov_base = (void*)crlf;
-		iov[mhdr.msg_iovlen].iov_len = 2;
-		mhdr.msg_iovlen ++;
-		hdrs_size += 2;
-	}
-	iov[mhdr.msg_iovlen].iov_base = (void*)crlf;
-	iov[mhdr.msg_iovlen].iov_len = 2;
-	hdrs_size += 2;
-	iov[(1 + mhdr.msg_iovlen)].iov_base = IO_BUF_OFFSET_GET(cli->buf);
-	iov[(1 + mhdr.msg_iovlen)].iov_len = data_size;
-	mhdr.msg_iovlen += 2;
-	//LOGD_EV_FMT("mhdr.msg_iovlen: %zu, data_size: %zu", mhdr.msg_iovlen, data_size);
-	/* Try send (write to socket buf).*/
-	ios = sendmsg(io_task_ident_get(cli->iotask), &mhdr,
-	    (MSG_DONTWAIT | MSG_NOSIGNAL));
-	if (-1 == ios) {
-		error = errno;
-		goto err_out;
-	}
-	if ((hdrs_size + data_size) == (size_t)ios) { /* OK, all done. */
-		http_srv_snd_done_cb(cli->iotask, 0, cli->buf, 0, ios, cli);
-		return (0);
+static int
+http_cli_chunk_size_get(const uint8_t *buf, size_t buf_size,
+    size_t *size_ret) {
+	size_t i, val = 0;
+	uint8_t c;
+
+	for (i = 0; i < buf_size; i ++) {
+		c = buf[i];
+		if ('0' <= c && '9' >= c) {
+			c -= '0';
+		} else if ('a' <= (c | 0x20) && 'f' >= (c | 0x20)) {
+			c = (uint8_t)((c | 0x20) - 'a' + 10);
+		} else
+			break;
+		if ((SIZE_MAX >> 4) < val)
+			return (EOVERFLOW);
+		val = ((val << 4) | c);
 	}
-	/* Not all data send. */
-	if (hdrs_size > (size_t)ios) { /* Not all headers send. */
-		/* Copy http headers to buffer before data. */
-		hdrs_size -= ios;
-		IO_BUF_TR_SIZE_SET(cli->buf, (hdrs_size + data_size));
-		if (hdrs_size > cli->buf->offset) { /* Worst case :( */
-			/* Not enough space before data, move data. */
-			/* Check buf free space!!! */
-			if ((hdrs_size - cli->buf->offset) >
-			    IO_BUF_FREE_SIZE(cli->buf)) {
-				error = ENOMEM;
-				LOG_ERR(error, "Not enough space in socket buffer and in io_buf for HTTP headers, increace skt_snd_buf or/and hdrs_reserve_size.");
-				goto err_out;
-			}
-			memmove((cli->buf->data + hdrs_size),
-			    IO_BUF_OFFSET_GET(cli->buf), data_size);
-			cli->buf->used = (hdrs_size + data_size);
-			cli->buf->offset = 0;
-		} else {
-			IO_BUF_OFFSET_DEC(cli->buf, hdrs_size);
-		}
-		wr_pos = IO_BUF_OFFSET_GET(cli->buf);
-		for (i = 0; i < (size_t)(mhdr.msg_iovlen - 1); i ++) {
-			if ((size_t)ios > iov[i].iov_len) { /* Skeep sended. */
-				ios -= iov[i].iov_len;
-				continue;
-			}
-			if (0 != ios) { /* Part of iov buf. */
-				iov[i].iov_base = (void*)(((size_t)iov[i].iov_base) + ios);
-				iov[i].iov_len -= ios;
-				ios = 0;
-			}
-			memcpy(wr_pos, iov[i].iov_base, iov[i].iov_len);
-			wr_pos += iov[i].iov_len;
-		}
-	} else { /* All headers sended, send body. */
-		IO_BUF_OFFSET_INC(cli->buf, (ios - hdrs_size));
-		IO_BUF_TR_SIZE_SET(cli->buf, (cli->buf->used - cli->buf->offset));
-	}
-	// send answer to cli
-	error = io_task_start(cli->iotask, THRP_EV_WRITE, 0,
-	    cli->bnd->s.skt_opts.snd_timeout, 0, cli->buf, http_srv_snd_done_cb);
-	if (0 == error) /* No Error. */
-		return (0);
+	/* Skip chunk extensions. */
+	if (0 == i ||
+	    (i < buf_size && ';' != buf[i] && ' ' != buf[i] && '\t' != buf[i]))
+		return (EBADMSG);
+	(*size_ret) = val;
 
-err_out:
-	/* Error. */
-	http_srv_snd_done_cb(cli->iotask, error, cli->buf, 0, ios, cli);
-	LOG_ERR(error, "err_out");
-	return (error);
+	return (0);
 }
 
-
-/* http answer to cli is sended, work done. */
+/* Scan received chunks, on last chunk remove chunked encoding in place. */
 static int
-http_cli_snd_done_cb(io_task_p iotask __unused, int error, io_buf_p buf __unused,
-    int eof, size_t transfered_size __unused, void *arg) {
-	http_cli_p cli = (http_cli_p)arg;
-	http_srv_p srv;
-	char straddr[STR_ADDR_LEN];
-	int action;
-	size_t tm;
-
-	SYSLOGD_EX(LOG_DEBUG, "...");
-
-	srv = cli->bnd->srv;
-	if (0 != error) { /* Fail! :( */
-		if (0 != LOG_IS_ENABLED()) {
-			sa_addr_port_to_str(&cli->addr, straddr,
-			    sizeof(straddr), NULL);
-			LOG_ERR_FMT(error, "client: %s", straddr);
-		}
-		switch (error) {
-		case 0:
-			break;
-		case ETIMEDOUT:
-			srv->stat.timeouts ++;
-			break;
-		default:
-			srv->stat.errors ++;
+http_cli_conn_chunked_parse(http_cli_conn_p conn, size_t *end_off) {
+	io_buf_p buf = conn->rcv_buf;
+	uint8_t *data = buf->data, *ptr;
+	size_t off, line_end, chunk_size, dst;
+
+	for (;;) {
+		off = conn->chunk_off;
+		ptr = mem_find_off_cstr(off, data, buf->used, CRLF);
+		if (NULL == ptr)
+			return (EAGAIN);
+		line_end = (size_t)(ptr - data);
+		if (0 != http_cli_chunk_size_get((data + off),
+		    (line_end - off), &chunk_size))
+			return (EBADMSG);
+		off = (line_end + 2);
+		if (0 == chunk_size) { /* Last chunk, optional trailer. */
+			if (buf->used < (off + 2))
+				return (EAGAIN);
+			if (0 == memcmp((data + off), CRLF, 2)) {
+				(*end_off) = (off + 2);
+				break;
+			}
+			ptr = mem_find_off_cstr(off, data, buf->used, CRLFCRLF);
+			if (NULL == ptr)
+				return (EAGAIN);
+			(*end_off) = ((size_t)(ptr - data) + 4);
 			break;
 		}
-		http_cli_free(cli);
-		return (IO_TASK_CB_NONE);
+		if (conn->host->pool->cli->s.rcv_io_buf_max_size < chunk_size)
+			return (ENOBUFS);
+		if (buf->used < (off + chunk_size + 2))
+			return (EAGAIN);
+		if (0 != memcmp((data + off + chunk_size), CRLF, 2))
+			return (EBADMSG);
+		conn->chunk_off = (off + chunk_size + 2);
+		conn->body_size += chunk_size;
 	}
-
-	if (0 != eof) { /* Client call shutdown(, SHUT_WR) and can only receive data. */
-		cli->flags |= HTTP_CLI_CLI_F_HALF_CLOSED;
+	/* Decode: move chunks data to body start. */
+	dst = conn->hdr_size;
+	for (off = conn->hdr_size; off < conn->chunk_off;) {
+		ptr = mem_find_off_cstr(off, data, buf->used, CRLF);
+		line_end = (size_t)(ptr - data);
+		http_cli_chunk_size_get((data + off), (line_end - off),
+		    &chunk_size);
+		memmove((data + dst), (data + line_end + 2), chunk_size);
+		dst += chunk_size;
+		off = (line_end + 2 + chunk_size + 2);
 	}
 
-	if (NULL != cli->ccb.on_rep_snd) { /* Call back handler. */
-		action = cli->ccb.on_rep_snd(cli, cli->udata);
-	} else {
-		action = HTTP_CLI_CB_NONE;
-	}
-	if (0 != (HTTP_CLI_CLI_F_HALF_CLOSED & cli->flags) ||
-	    0 != (HTTP_CLI_RESP_P_F_CONN_CLOSE & cli->resp_p_flags) ||
-	    0 != (HTTP_CLI_RD_F_CONN_CLOSE & cli->req.flags))
-		action = HTTP_CLI_CB_DESTROY; /* Force destroy. */
-
-	/* Handle call back function return code. */
-	if (HTTP_CLI_CB_DESTROY == action) { /* Free resourses */
-		http_cli_free(cli);
-		return (IO_TASK_CB_NONE);
-	}
-	/* Reuse connection. */
-	/* Move data to buf start. */
-	cli->req.data += cli->req.data_size; /* Move pointer to next request. */
-	tm = (cli->rcv_buf->used - (cli->req.data - cli->rcv_buf->data));
-	memmove(cli->rcv_buf->data, cli->req.data, tm);
-	/* Re init client. */
-	memset(&cli->req, 0x00, sizeof(http_srv_req_t));
-	cli->resp_p_flags = 0;
-	/* Receive next http request. */
-	IO_BUF_BUSY_SIZE_SET(cli->rcv_buf, tm);
-	IO_BUF_MARK_TRANSFER_ALL_FREE(cli->rcv_buf);
-	/* Shedule data receive / Receive http request / Process next. */
-	error = io_task_start_ex(0, cli->iotask, THRP_EV_READ, 0,
-	    cli->bnd->s.skt_opts.rcv_timeout, 0, cli->rcv_buf, http_srv_recv_done_cb);
-	if (0 != error) { /* Error. */
-		srv->stat.errors ++;
-		http_cli_free(cli);
-		LOG_ERR_FMT(error, "client ip: %s", straddr);
-	}
-
-	return (IO_TASK_CB_NONE);
+	return (0);
 }
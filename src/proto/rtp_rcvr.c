@@ -0,0 +1,650 @@
+/*-
+ * Copyright (c) 2011-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* memcpy, memmove, memset, strerror... */
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h> /* ntohs, htonl... */
+
+#include "utils/macro.h"
+#include "utils/mem_utils.h"
+#include "utils/io_buf.h"
+#include "utils/ring_buffer.h"
+#include "threadpool/threadpool.h"
+#include "threadpool/threadpool_task.h"
+#include "proto/rtp.h"
+#include "proto/rtp_rcvr.h"
+
+
+typedef struct rtp_rcvr_slot_s {
+	uint8_t		*data;		/* Packet/payload memory: pkt_size_max. */
+	size_t		offset;		/* Payload offset in data. */
+	size_t		size;		/* Payload size. */
+	uint64_t	time;		/* Arrival time, ms. */
+	uint16_t	seq;
+	uint16_t	used;
+} rtp_rcvr_slot_t, *rtp_rcvr_slot_p;
+
+
+typedef struct rtp_rcvr_s {
+	tp_task_p	tptask;		/* Packet receiver. */
+	r_buf_p		r_buf;		/* Optional output ring buffer. */
+	io_buf_t	buf;		/* Receive buffer: ring buffer or spare. */
+	uint8_t		*spare;		/* Free slot memory, swapped with slots. */
+	int		rcv_in_rbuf;	/* buf point to ring buffer memory. */
+	uint32_t	flags;		/* RTP_RCVR_F_*. */
+	uint16_t	next_seq;	/* Next seq to deliver: jitter buffer window start. */
+	uint32_t	bad_seq;	/* Last out of window seq + 1: for restart detection. */
+	uint32_t	pending;	/* Packets in slots. */
+	uint64_t	wait_since;	/* Arrival time of first packet after hole, ms. */
+	uint32_t	ssrc;
+	rtp_src_info_t	info;		/* RFC 3550 A.1 seq and A.8 jitter state. */
+	uint32_t	lsr;		/* Middle 32 bits of last SR NTP timestamp. */
+	uint64_t	lsr_time;	/* Last SR receive time, ms. */
+	rtp_rcvr_stat_t	stat;
+	rtp_rcvr_settings_t s;
+	rtp_rcvr_data_cb data_cb;
+	rtp_rcvr_gap_cb	gap_cb;
+	void		*udata;
+	size_t		slots_mask;
+	rtp_rcvr_slot_t	slots[];
+} rtp_rcvr_t;
+
+#define RTP_RCVR_F_SSRC_VALID	(((uint32_t)1) << 0) /* Source selected. */
+#define RTP_RCVR_F_TRANSIT_VALID (((uint32_t)1) << 1) /* info.transit set. */
+
+
+static int	rtp_rcvr_recv_cb(tp_task_p tptask, int error,
+		    struct sockaddr_storage *addr, io_buf_p buf,
+		    size_t transfered_size, void *udata);
+
+
+static inline void
+rtp_rcvr_time_get(uint32_t clock_rate, uint64_t *time_ms, uint32_t *arrival) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_FAST, &ts);
+	(*time_ms) = ((((uint64_t)ts.tv_sec) * 1000) +
+	    (((uint64_t)ts.tv_nsec) / 1000000));
+	if (NULL == arrival)
+		return;
+	/* Arrival time in RTP timestamp units, wraps as RTP ts. */
+	(*arrival) = (uint32_t)((((uint64_t)ts.tv_sec) * clock_rate) +
+	    ((((uint64_t)ts.tv_nsec) * clock_rate) / 1000000000));
+}
+
+static inline uint32_t
+rtp_rcvr_be32_get(const uint8_t *buf) {
+	uint32_t val;
+
+	memcpy(&val, buf, sizeof(uint32_t));
+
+	return (ntohl(val));
+}
+
+static inline void
+rtp_rcvr_be32_set(uint8_t *buf, uint32_t val) {
+
+	val = htonl(val);
+	memcpy(buf, &val, sizeof(uint32_t));
+}
+
+
+/* Set next receive buffer: ring buffer if set and have space, spare slot. */
+static void
+rtp_rcvr_rcv_buf_set(rtp_rcvr_p rcvr) {
+	uint8_t *buf = NULL;
+
+	if (NULL != rcvr->r_buf &&
+	    0 != r_buf_wbuf_get(rcvr->r_buf, rcvr->s.pkt_size_max, &buf)) {
+		rcvr->rcv_in_rbuf = 1;
+	} else {
+		buf = rcvr->spare;
+		rcvr->rcv_in_rbuf = 0;
+	}
+	io_buf_init(&rcvr->buf, 0, buf, rcvr->s.pkt_size_max);
+	IO_BUF_TR_SIZE_SET(&rcvr->buf, rcvr->s.pkt_size_max);
+}
+
+static void
+rtp_rcvr_deliver(rtp_rcvr_p rcvr, uint8_t *data, size_t offset,
+    size_t size, int in_rbuf) {
+	uint8_t *buf;
+
+	if (0 == size) { /* Nothing to write. */
+		rcvr->stat.pkts_delivered ++;
+		return;
+	}
+	if (NULL != rcvr->r_buf) {
+		if (0 == in_rbuf) {
+			if (size > r_buf_wbuf_get(rcvr->r_buf, size, &buf)) {
+				rcvr->stat.pkts_drop ++;
+				return;
+			}
+			memcpy(buf, (data + offset), size);
+			data = buf;
+			offset = 0;
+		}
+		/* Offset skip RTP header: no copy. */
+		if (0 != r_buf_wbuf_set(rcvr->r_buf, offset, (offset + size))) {
+			rcvr->stat.pkts_drop ++;
+			return;
+		}
+	}
+	rcvr->stat.pkts_delivered ++;
+	rcvr->stat.bytes += size;
+	if (NULL != rcvr->data_cb) {
+		rcvr->data_cb(rcvr, (data + offset), size, rcvr->udata);
+	}
+}
+
+static void
+rtp_rcvr_gap_report(rtp_rcvr_p rcvr, uint16_t seq, uint32_t count) {
+
+	if (0 == count)
+		return;
+	rcvr->stat.pkts_lost += count;
+	rcvr->stat.gaps ++;
+	if (NULL != rcvr->gap_cb) {
+		rcvr->gap_cb(rcvr, seq, count, rcvr->udata);
+	}
+}
+
+static inline void
+rtp_rcvr_slot_deliver(rtp_rcvr_p rcvr, rtp_rcvr_slot_p slot) {
+
+	rtp_rcvr_deliver(rcvr, slot->data, slot->offset, slot->size, 0);
+	slot->used = 0;
+	rcvr->pending --;
+}
+
+/* Returns first used slot, window start slot must be empty. */
+static rtp_rcvr_slot_p
+rtp_rcvr_jbuf_first_get(rtp_rcvr_p rcvr) {
+	rtp_rcvr_slot_p slot;
+	size_t i;
+
+	if (0 == rcvr->pending)
+		return (NULL);
+	for (i = 1; i <= rcvr->slots_mask; i ++) {
+		slot = &rcvr->slots[((rcvr->next_seq + i) & rcvr->slots_mask)];
+		if (0 != slot->used)
+			return (slot);
+	}
+	return (NULL);
+}
+
+/* Deliver continuous run of packets from window start. */
+static void
+rtp_rcvr_jbuf_deliver(rtp_rcvr_p rcvr) {
+	rtp_rcvr_slot_p slot;
+
+	while (0 != rcvr->pending) {
+		slot = &rcvr->slots[(rcvr->next_seq & rcvr->slots_mask)];
+		if (0 == slot->used)
+			break;
+		rtp_rcvr_slot_deliver(rcvr, slot);
+		rcvr->next_seq ++;
+	}
+	slot = rtp_rcvr_jbuf_first_get(rcvr);
+	if (NULL != slot) { /* New hole: wait from oldest packet after it. */
+		rcvr->wait_since = slot->time;
+	}
+}
+
+/* Move window start to seq: deliver packets, report holes as lost. */
+static void
+rtp_rcvr_jbuf_advance(rtp_rcvr_p rcvr, uint16_t seq) {
+	rtp_rcvr_slot_p slot;
+	uint16_t gap_seq = 0;
+	uint32_t gap_count = 0;
+
+	for (; seq != rcvr->next_seq; rcvr->next_seq ++) {
+		slot = &rcvr->slots[(rcvr->next_seq & rcvr->slots_mask)];
+		if (0 == slot->used) {
+			if (0 == gap_count) {
+				gap_seq = rcvr->next_seq;
+			}
+			gap_count ++;
+			continue;
+		}
+		rtp_rcvr_gap_report(rcvr, gap_seq, gap_count);
+		gap_count = 0;
+		rtp_rcvr_slot_deliver(rcvr, slot);
+	}
+	rtp_rcvr_gap_report(rcvr, gap_seq, gap_count);
+	rtp_rcvr_jbuf_deliver(rcvr);
+}
+
+/* Skip holes that wait longer than jbuf_delay. */
+static void
+rtp_rcvr_jbuf_check(rtp_rcvr_p rcvr, uint64_t time_ms, int force) {
+	rtp_rcvr_slot_p slot;
+
+	while (0 != rcvr->pending &&
+	    (0 != force || (time_ms - rcvr->wait_since) >= rcvr->s.jbuf_delay)) {
+		slot = rtp_rcvr_jbuf_first_get(rcvr);
+		if (NULL == slot) /* Paranoid check. */
+			break;
+		rtp_rcvr_jbuf_advance(rcvr, slot->seq);
+	}
+}
+
+/* Pending slots will be written to ring buffer before received packet:
+ * move packet out of ring buffer write position. */
+static uint8_t *
+rtp_rcvr_rcv_buf_detach(rtp_rcvr_p rcvr, uint8_t *data, size_t data_size) {
+
+	if (0 == rcvr->rcv_in_rbuf || 0 == rcvr->pending)
+		return (data);
+	memcpy(rcvr->spare, data, data_size);
+	rcvr->rcv_in_rbuf = 0;
+
+	return (rcvr->spare);
+}
+
+static void
+rtp_rcvr_resync(rtp_rcvr_p rcvr, uint32_t ssrc, uint16_t seq) {
+
+	if (0 != (RTP_RCVR_F_SSRC_VALID & rcvr->flags)) {
+		/* Give out all from previous source/sequence. */
+		rtp_rcvr_jbuf_check(rcvr, 0, 1);
+		rcvr->stat.resyncs ++;
+	}
+	rcvr->flags = RTP_RCVR_F_SSRC_VALID;
+	rcvr->ssrc = ssrc;
+	rcvr->next_seq = seq;
+	rcvr->bad_seq = (RTP_SEQ_MOD + 1);
+	memset(&rcvr->info, 0x00, sizeof(rtp_src_info_t));
+	rtp_src_info_seq_init(&rcvr->info, seq);
+	rcvr->lsr = 0;
+	rcvr->lsr_time = 0;
+}
+
+static void
+rtp_rcvr_pkt_process(rtp_rcvr_p rcvr, uint8_t *data, size_t data_size,
+    uint64_t time_ms, uint32_t arrival) {
+	const rtp_hdr_t *rtp_hdr = (const rtp_hdr_t*)data;
+	rtp_rcvr_slot_p slot;
+	uint8_t *tmp;
+	size_t s_off, e_off, size;
+	uint16_t seq;
+	uint32_t ssrc, transit;
+	int32_t delta;
+
+	if (0 != rtp_payload_get(data, data_size, &s_off, &e_off)) {
+		if (0 == (RTP_RCVR_S_F_RAW_PASS & rcvr->s.flags)) {
+			rcvr->stat.pkts_invalid ++;
+			return;
+		}
+		rcvr->stat.pkts_raw ++;
+		rtp_rcvr_deliver(rcvr, data, 0, data_size, rcvr->rcv_in_rbuf);
+		return;
+	}
+	size = (data_size - s_off - e_off);
+	seq = ntohs(rtp_hdr->seq);
+	ssrc = ntohl(rtp_hdr->ssrc);
+	transit = (arrival - ntohl(rtp_hdr->ts));
+
+	if (0 == (RTP_RCVR_F_SSRC_VALID & rcvr->flags) ||
+	    ssrc != rcvr->ssrc) {
+		data = rtp_rcvr_rcv_buf_detach(rcvr, data, data_size);
+		rtp_rcvr_resync(rcvr, ssrc, seq);
+	}
+	delta = (int16_t)(seq - rcvr->next_seq);
+	if (0 > delta) {
+		if ((-RTP_RCVR_MISORDER_MAX) > delta)
+			goto seq_jump;
+		/* Already delivered or declared lost. */
+		rcvr->stat.pkts_late ++;
+		goto stat_update;
+	}
+	if (RTP_RCVR_DROPOUT_MAX <= delta) {
+seq_jump:
+		if (seq != rcvr->bad_seq) {
+			rcvr->bad_seq = ((seq + 1) & (RTP_SEQ_MOD - 1));
+			rcvr->stat.pkts_invalid ++;
+			return;
+		}
+		/* Two sequential packets: other side restarted. */
+		data = rtp_rcvr_rcv_buf_detach(rcvr, data, data_size);
+		rtp_rcvr_resync(rcvr, ssrc, seq);
+		delta = 0;
+	}
+	if ((int32_t)rcvr->slots_mask < delta) { /* Window full: shift. */
+		data = rtp_rcvr_rcv_buf_detach(rcvr, data, data_size);
+		rtp_rcvr_jbuf_advance(rcvr,
+		    (uint16_t)(seq - rcvr->slots_mask));
+		delta = (int32_t)rcvr->slots_mask;
+	}
+
+	if (0 == delta) { /* In order: deliver from receive buffer. */
+		rtp_rcvr_deliver(rcvr, data, s_off, size, rcvr->rcv_in_rbuf);
+		rcvr->next_seq ++;
+		rtp_rcvr_jbuf_deliver(rcvr);
+		goto stat_update;
+	}
+	/* Out of order: keep in slot. */
+	slot = &rcvr->slots[(seq & rcvr->slots_mask)];
+	if (0 != slot->used) {
+		rcvr->stat.pkts_dup ++;
+		goto stat_update;
+	}
+	if (0 != rcvr->rcv_in_rbuf) {
+		memcpy(slot->data, (data + s_off), size);
+		slot->offset = 0;
+	} else { /* Received to spare: swap. */
+		tmp = slot->data;
+		slot->data = rcvr->spare;
+		rcvr->spare = tmp;
+		slot->offset = s_off;
+	}
+	slot->size = size;
+	slot->time = time_ms;
+	slot->seq = seq;
+	slot->used = 1;
+	if (0 == rcvr->pending) {
+		rcvr->wait_since = time_ms;
+	}
+	rcvr->pending ++;
+	rcvr->stat.jbuf_used_max = MAX(rcvr->stat.jbuf_used_max,
+	    rcvr->pending);
+
+stat_update:
+	/* Reorder distance from highest seq. */
+	delta = (int16_t)(seq - rcvr->info.max_seq);
+	if (0 > delta) {
+		rcvr->stat.pkts_reordered ++;
+		rcvr->stat.reorder_max = MAX(rcvr->stat.reorder_max,
+		    (uint32_t)-delta);
+	}
+	rtp_src_info_seq_update(&rcvr->info, seq);
+	/* RFC 3550 A.8: interarrival jitter. */
+	if (0 != (RTP_RCVR_F_TRANSIT_VALID & rcvr->flags)) {
+		delta = (int32_t)(transit - rcvr->info.transit);
+		if (0 > delta) {
+			delta = -delta;
+		}
+		rcvr->info.jitter += ((uint32_t)delta -
+		    ((rcvr->info.jitter + 8) >> 4));
+	}
+	rcvr->info.transit = transit;
+	rcvr->flags |= RTP_RCVR_F_TRANSIT_VALID;
+}
+
+
+void
+rtp_rcvr_def_settings(rtp_rcvr_settings_p s_ret) {
+
+	if (NULL == s_ret)
+		return;
+	/* Init. */
+	memset(s_ret, 0x00, sizeof(rtp_rcvr_settings_t));
+
+	/* Default settings. */
+	s_ret->pkt_size_max = RTP_RCVR_S_DEF_PKT_SIZE_MAX;
+	s_ret->jbuf_pkts = RTP_RCVR_S_DEF_JBUF_PKTS;
+	s_ret->jbuf_delay = RTP_RCVR_S_DEF_JBUF_DELAY;
+	s_ret->clock_rate = RTP_RCVR_S_DEF_CLOCK_RATE;
+	s_ret->flags = RTP_RCVR_S_DEF_FLAGS;
+}
+
+int
+rtp_rcvr_create(tpt_p tpt, uintptr_t skt, rtp_rcvr_settings_p s,
+    r_buf_p r_buf, rtp_rcvr_data_cb data_cb, rtp_rcvr_gap_cb gap_cb,
+    void *udata, rtp_rcvr_p *rcvr_ret) {
+	int error;
+	rtp_rcvr_p rcvr;
+	uint8_t *mem;
+	size_t i, slots_count;
+
+	if (NULL == tpt || (uintptr_t)-1 == skt || NULL == s ||
+	    (NULL == r_buf && NULL == data_cb) || NULL == rcvr_ret)
+		return (EINVAL);
+	if (sizeof(rtp_hdr_t) > s->pkt_size_max ||
+	    0 == s->jbuf_pkts || RTP_RCVR_JBUF_PKTS_MAX < s->jbuf_pkts ||
+	    0 == s->clock_rate)
+		return (EINVAL);
+	/* Round up to power of 2: index = seq & mask. */
+	for (slots_count = 2; slots_count < s->jbuf_pkts; slots_count <<= 1)
+		;
+	/* Header + slots + (slots_count + 1) packets buffers. */
+	rcvr = malloc((sizeof(rtp_rcvr_t) +
+	    (sizeof(rtp_rcvr_slot_t) * slots_count) +
+	    (s->pkt_size_max * (slots_count + 1))));
+	if (NULL == rcvr)
+		return (ENOMEM);
+	memset(rcvr, 0x00, (sizeof(rtp_rcvr_t) +
+	    (sizeof(rtp_rcvr_slot_t) * slots_count)));
+	memcpy(&rcvr->s, s, sizeof(rtp_rcvr_settings_t));
+	rcvr->s.jbuf_pkts = slots_count;
+	rcvr->r_buf = r_buf;
+	rcvr->data_cb = data_cb;
+	rcvr->gap_cb = gap_cb;
+	rcvr->udata = udata;
+	rcvr->slots_mask = (slots_count - 1);
+	rcvr->bad_seq = (RTP_SEQ_MOD + 1);
+	mem = (uint8_t*)&rcvr->slots[slots_count];
+	for (i = 0; i < slots_count; i ++) {
+		rcvr->slots[i].data = mem;
+		mem += s->pkt_size_max;
+	}
+	rcvr->spare = mem;
+	rtp_rcvr_rcv_buf_set(rcvr);
+
+	/* Timeout: flush jitter buffer if no packets. */
+	error = tp_task_pkt_rcvr_create(tpt, skt,
+	    ((0 != (RTP_RCVR_S_F_CLOSE_SKT & s->flags)) ?
+	    TP_TASK_F_CLOSE_ON_DESTROY : 0),
+	    s->jbuf_delay, &rcvr->buf, rtp_rcvr_recv_cb, rcvr,
+	    &rcvr->tptask);
+	if (0 != error) {
+		free(rcvr);
+		return (error);
+	}
+
+	(*rcvr_ret) = rcvr;
+
+	return (0);
+}
+
+void
+rtp_rcvr_destroy(rtp_rcvr_p rcvr) {
+
+	if (NULL == rcvr)
+		return;
+	tp_task_destroy(rcvr->tptask);
+	free(rcvr);
+}
+
+int
+rtp_rcvr_stat_get(rtp_rcvr_p rcvr, rtp_rcvr_stat_p stat) {
+	uint32_t ext_max;
+
+	if (NULL == rcvr || NULL == stat)
+		return (EINVAL);
+	memcpy(stat, &rcvr->stat, sizeof(rtp_rcvr_stat_t));
+	stat->jbuf_used = rcvr->pending;
+	if (0 == (RTP_RCVR_F_SSRC_VALID & rcvr->flags))
+		return (0);
+	ext_max = (rcvr->info.cycles + rcvr->info.max_seq);
+	stat->ssrc = rcvr->ssrc;
+	stat->ext_max_seq = ext_max;
+	stat->expected = ((ext_max - rcvr->info.base_seq) + 1);
+	stat->received = rcvr->info.received;
+	stat->lost = (int32_t)(stat->expected - stat->received);
+	stat->jitter = (rcvr->info.jitter >> 4);
+
+	return (0);
+}
+
+void
+rtp_rcvr_flush(rtp_rcvr_p rcvr) {
+
+	if (NULL == rcvr)
+		return;
+	rtp_rcvr_jbuf_check(rcvr, 0, 1);
+}
+
+
+int
+rtp_rcvr_rtcp_process(rtp_rcvr_p rcvr, const uint8_t *buf,
+    size_t buf_size) {
+	size_t off, pkt_size;
+	uint64_t time_ms;
+
+	if (NULL == rcvr || NULL == buf)
+		return (EINVAL);
+	/* Compound packet: sequence of RTCP packets. */
+	for (off = 0; (off + sizeof(rtcp_common_t)) <= buf_size;
+	    off += pkt_size) {
+		if (RTP_VERSION != (buf[off] >> 6))
+			return (EINVAL);
+		pkt_size = (((((size_t)buf[(off + 2)]) << 8) |
+		    buf[(off + 3)]) + 1) * sizeof(uint32_t);
+		if ((off + pkt_size) > buf_size)
+			return (EINVAL);
+		if (RTCP_SR != buf[(off + 1)] ||
+		    28 > pkt_size) /* Hdr + SSRC + NTP + RTP ts + counters. */
+			continue;
+		if (0 == (RTP_RCVR_F_SSRC_VALID & rcvr->flags) ||
+		    rcvr->ssrc != rtp_rcvr_be32_get((buf + off + 4)))
+			continue;
+		/* Middle 32 bits of NTP timestamp. */
+		rcvr->lsr = ((rtp_rcvr_be32_get((buf + off + 8)) << 16) |
+		    (rtp_rcvr_be32_get((buf + off + 12)) >> 16));
+		rtp_rcvr_time_get(0, &time_ms, NULL);
+		rcvr->lsr_time = time_ms;
+	}
+
+	return (0);
+}
+
+int
+rtp_rcvr_rtcp_rr_build(rtp_rcvr_p rcvr, uint32_t ssrc_local,
+    uint8_t *buf, size_t buf_size, size_t *buf_size_ret) {
+	rtp_src_info_p info;
+	uint64_t time_ms;
+	uint32_t ext_max, expected, expected_interval, received_interval;
+	uint32_t dlsr = 0;
+	int32_t lost, lost_interval;
+	uint8_t fraction = 0, rc = 1;
+
+	if (NULL == rcvr || NULL == buf)
+		return (EINVAL);
+	if (0 == (RTP_RCVR_F_SSRC_VALID & rcvr->flags)) {
+		rc = 0; /* No source: empty RR. */
+	}
+	if ((8 + (24 * (size_t)rc)) > buf_size)
+		return (ENOBUFS);
+	/* Header: V=2, P=0, RC, PT=RR, length in words - 1. */
+	buf[0] = (uint8_t)((RTP_VERSION << 6) | rc);
+	buf[1] = RTCP_RR;
+	buf[2] = 0;
+	buf[3] = (uint8_t)(1 + (6 * rc));
+	rtp_rcvr_be32_set((buf + 4), ssrc_local);
+	if (0 == rc) {
+		if (NULL != buf_size_ret) {
+			(*buf_size_ret) = 8;
+		}
+		return (0);
+	}
+
+	/* RFC 3550 A.3: determining number of packets expected and lost. */
+	info = &rcvr->info;
+	ext_max = (info->cycles + info->max_seq);
+	expected = ((ext_max - info->base_seq) + 1);
+	lost = (int32_t)(expected - info->received);
+	/* Clamp to 24 bit signed. */
+	lost = MIN(0x7fffff, MAX(-0x800000, lost));
+	expected_interval = (expected - info->expected_prior);
+	info->expected_prior = expected;
+	received_interval = (info->received - info->received_prior);
+	info->received_prior = info->received;
+	lost_interval = (int32_t)(expected_interval - received_interval);
+	if (0 != expected_interval && 0 < lost_interval) {
+		fraction = (uint8_t)((((uint64_t)lost_interval) << 8) /
+		    expected_interval);
+	}
+	if (0 != rcvr->lsr_time) { /* Delay since last SR, 1/65536 sec. */
+		rtp_rcvr_time_get(0, &time_ms, NULL);
+		dlsr = (uint32_t)(((time_ms - rcvr->lsr_time) << 16) / 1000);
+	}
+
+	/* Report block. */
+	rtp_rcvr_be32_set((buf + 8), rcvr->ssrc);
+	rtp_rcvr_be32_set((buf + 12), (uint32_t)lost);
+	buf[12] = fraction;
+	rtp_rcvr_be32_set((buf + 16), ext_max);
+	rtp_rcvr_be32_set((buf + 20), (info->jitter >> 4));
+	rtp_rcvr_be32_set((buf + 24), rcvr->lsr);
+	rtp_rcvr_be32_set((buf + 28), dlsr);
+	if (NULL != buf_size_ret) {
+		(*buf_size_ret) = RTP_RCVR_RTCP_RR_SIZE;
+	}
+
+	return (0);
+}
+
+
+static int
+rtp_rcvr_recv_cb(tp_task_p tptask __unused, int error,
+    struct sockaddr_storage *addr __unused, io_buf_p buf,
+    size_t transfered_size, void *udata) {
+	rtp_rcvr_p rcvr = udata;
+	uint64_t time_ms;
+	uint32_t arrival;
+
+	debugd_break_if(NULL == rcvr);
+	debugd_break_if(&rcvr->buf != buf);
+
+	rtp_rcvr_time_get(rcvr->s.clock_rate, &time_ms, &arrival);
+	if (0 != error) {
+		if (ETIMEDOUT != error) {
+			rcvr->stat.rcv_errs ++;
+		}
+		/* No packets: give out what waits too long. */
+		rtp_rcvr_jbuf_check(rcvr, time_ms, 0);
+		goto rcv_next;
+	}
+	rcvr->stat.pkts ++;
+	rtp_rcvr_pkt_process(rcvr, buf->data, transfered_size, time_ms,
+	    arrival);
+	rtp_rcvr_jbuf_check(rcvr, time_ms, 0);
+
+rcv_next:
+	rtp_rcvr_rcv_buf_set(rcvr);
+
+	return (TP_TASK_CB_CONTINUE);
+}
@@ -0,0 +1,823 @@
+/*-
+ * Copyright (c) 2011-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * SAP/SDP session index
+ *
+ * Writer: single thread (SAP receiver). Repeated announcements
+ * (same originating source and msg id hash) only refresh timeout,
+ * full SDP parsed only for new/changed announcements.
+ *
+ * Readers: immutable snapshots, published by pointer swap.
+ * Reader mark itself in idx->readers while it take snapshot reference,
+ * so writer free retired snapshot only when no one in this window
+ * and snapshot reference count is zero.
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* memcpy, memmove, memset, strerror... */
+#include <errno.h>
+#include <time.h>
+
+#include "utils/macro.h"
+#include "utils/mem_utils.h"
+#include "utils/str2num.h"
+#include "net/socket_address.h"
+#include "proto/sap.h"
+#include "proto/sdp.h"
+#include "proto/sap_idx.h"
+
+
+#define SAP_IDX_HASH_SIZE	256 /* Must be pow2. */
+#define SAP_IDX_HASH_MASK	(SAP_IDX_HASH_SIZE - 1)
+
+
+typedef struct sap_idx_entry_s {
+	TAILQ_ENTRY(sap_idx_entry_s) next;
+	LIST_ENTRY(sap_idx_entry_s) next_msg; /* By src + msg_id_hash. */
+	LIST_ENTRY(sap_idx_entry_s) next_orig; /* By origin. */
+	time_t		valid_untill;
+	uint32_t	msg_hash;
+	uint32_t	orig_hash;
+	sap_sess_t	sess;
+	/* name, info, origin: zero terminated, follow. */
+} sap_idx_entry_t, *sap_idx_entry_p;
+
+TAILQ_HEAD(sap_idx_entry_head, sap_idx_entry_s);
+LIST_HEAD(sap_idx_entry_lhead, sap_idx_entry_s);
+
+
+typedef struct sap_idx_snap_s {
+	sap_idx_snap_p	next;		/* Retired list. */
+	uint64_t	gen;
+	size_t		ref_count;	/* Atomic. */
+	size_t		count;
+	size_t		addr_mask;
+	sap_sess_p	sess;		/* Sorted by name. */
+	uint32_t	*addr_tbl;	/* Open addressing: index + 1, 0 - empty. */
+	/* sess array, addr table, strings: follow. */
+} sap_idx_snap_t;
+
+
+typedef struct sap_idx_s {
+	sap_idx_snap_p	snap;		/* Atomic: current snapshot. */
+	size_t		readers;	/* Atomic: readers in snap_get(). */
+	sap_idx_snap_p	retired;	/* Replaced snapshots, wait for free. */
+	struct sap_idx_entry_head entries;
+	struct sap_idx_entry_lhead msg_hash[SAP_IDX_HASH_SIZE];
+	struct sap_idx_entry_lhead orig_hash[SAP_IDX_HASH_SIZE];
+	time_t		cache_time;
+	uint64_t	gen;
+	int		dirty;		/* Snapshot must be rebuilded. */
+	sap_idx_stat_t	stat;
+} sap_idx_t;
+
+
+/* Parsed SDP, points to message. */
+typedef struct sap_idx_sdp_s {
+	uint8_t		*name;
+	uint8_t		*info;
+	uint8_t		*orig[5];	/* o= feilds without sess-version. */
+	size_t		name_size;
+	size_t		info_size;
+	size_t		orig_sizes[5];
+	size_t		origin_size;	/* Key size: feilds + separators. */
+	uint64_t	version;
+	sockaddr_storage_t addr;
+	uint16_t	payload_type;
+	uint8_t		media_type;
+	uint8_t		media_proto;
+	uint8_t		ttl;
+} sap_idx_sdp_t, *sap_idx_sdp_p;
+
+
+static void	sap_idx_reclaim(sap_idx_p idx);
+static void	sap_idx_publish(sap_idx_p idx);
+
+
+
+static inline uint32_t
+sap_idx_hash_mem(uint32_t hash, const uint8_t *buf, size_t buf_size) {
+	size_t i;
+
+	for (i = 0; i < buf_size; i ++) {
+		hash = ((hash << 5) + hash + buf[i]); /* djb2 */
+	}
+	return (hash);
+}
+
+static uint32_t
+sap_idx_hash_addr(const sockaddr_storage_t *addr) {
+	uint32_t hash = 5381;
+	uint16_t port;
+
+	switch (sa_family(addr)) {
+	case AF_INET:
+		hash = sap_idx_hash_mem(hash, sa_addr_get(addr),
+		    sizeof(in__addr_t));
+		break;
+	case AF_INET6:
+		hash = sap_idx_hash_mem(hash, sa_addr_get(addr),
+		    sizeof(in6_addr_t));
+		break;
+	}
+	port = sa_port_get(addr);
+	hash = sap_idx_hash_mem(hash, (const uint8_t*)&port, sizeof(port));
+
+	return (hash * 2654435769U); /* Fibonacci: spread low bits. */
+}
+
+static uint32_t
+sap_idx_hash_msg(const sockaddr_storage_t *src, uint16_t msg_id_hash) {
+	uint32_t hash = 5381;
+
+	hash = sap_idx_hash_mem(hash, sa_addr_get(src),
+	    ((AF_INET == sa_family(src)) ? sizeof(in__addr_t) : sizeof(in6_addr_t)));
+	hash = sap_idx_hash_mem(hash, (const uint8_t*)&msg_id_hash,
+	    sizeof(msg_id_hash));
+
+	return (hash);
+}
+
+static uint32_t
+sap_idx_hash_orig(const sap_idx_sdp_t *sdp) {
+	uint32_t hash = 5381;
+	size_t i;
+
+	for (i = 0; i < nitems(sdp->orig); i ++) {
+		hash = sap_idx_hash_mem(hash, sdp->orig[i], sdp->orig_sizes[i]);
+		hash = ((hash << 5) + hash + ' ');
+	}
+	return (hash);
+}
+
+/* Case insensitive compare. */
+static int
+sap_idx_name_cmp(const char *name1, size_t name1_size,
+    const char *name2, size_t name2_size) {
+	size_t i, size = MIN(name1_size, name2_size);
+	int c1, c2;
+
+	for (i = 0; i < size; i ++) {
+		c1 = (uint8_t)name1[i];
+		c2 = (uint8_t)name2[i];
+		if ('A' <= c1 && 'Z' >= c1) {
+			c1 += ('a' - 'A');
+		}
+		if ('A' <= c2 && 'Z' >= c2) {
+			c2 += ('a' - 'A');
+		}
+		if (c1 != c2)
+			return ((c1 - c2));
+	}
+	if (name1_size == name2_size)
+		return (0);
+	return (((name1_size < name2_size) ? -1 : 1));
+}
+
+static int
+sap_idx_sess_cmp(const void *a, const void *b) {
+	const sap_sess_t *s1 = a, *s2 = b;
+
+	return (sap_idx_name_cmp(s1->name, s1->name_size,
+	    s2->name, s2->name_size));
+}
+
+
+/* o= <username> <sess-id> <sess-version> <nettype> <addrtype> <unicast-address> */
+static int
+sap_idx_sdp_origin_parse(uint8_t *sdp_msg, size_t sdp_msg_size,
+    sap_idx_sdp_p sdp) {
+	uint8_t *val, *feilds[6];
+	size_t val_size, feilds_sizes[6], i;
+
+	if (0 != sdp_msg_type_get(sdp_msg, sdp_msg_size, 'o', NULL,
+	    &val, &val_size))
+		return (EINVAL);
+	if (6 != sdp_msg_feilds_get(val, val_size, 6, feilds, feilds_sizes))
+		return (EINVAL);
+	sdp->version = ustr2u64(feilds[2], feilds_sizes[2]);
+	sdp->origin_size = 0;
+	for (i = 0; i < nitems(sdp->orig); i ++) {
+		sdp->orig[i] = feilds[((2 > i) ? i : (i + 1))];
+		sdp->orig_sizes[i] = feilds_sizes[((2 > i) ? i : (i + 1))];
+		sdp->origin_size += (sdp->orig_sizes[i] + 1);
+	}
+	sdp->origin_size --; /* No trailing space. */
+
+	return (0);
+}
+
+/* Full SDP parse: session and first audio/video media. */
+static int
+sap_idx_sdp_parse(uint8_t *sdp_msg, size_t sdp_msg_size, sap_idx_sdp_p sdp) {
+	uint8_t *val, *ptm, *feilds[8];
+	size_t val_size, feilds_sizes[8], cnt;
+	size_t m_line, m_next_line, c_line;
+	uint16_t port;
+	char straddr[(INET6_ADDRSTRLEN + 1)];
+
+	if (0 != sdp_msg_sec_chk(sdp_msg, sdp_msg_size))
+		return (EINVAL);
+	if (0 != sap_idx_sdp_origin_parse(sdp_msg, sdp_msg_size, sdp))
+		return (EINVAL);
+	/* s= */
+	if (0 != sdp_msg_type_get(sdp_msg, sdp_msg_size, 's', NULL,
+	    &sdp->name, &sdp->name_size))
+		return (EINVAL);
+	/* i= (optional) */
+	if (0 != sdp_msg_type_get(sdp_msg, sdp_msg_size, 'i', NULL,
+	    &sdp->info, &sdp->info_size)) {
+		sdp->info = NULL;
+		sdp->info_size = 0;
+	}
+
+	/* m= <media> <port>[/<number of ports>] <proto> <fmt> ...: first audio/video. */
+	for (m_line = 0;; m_line ++) {
+		if (0 != sdp_msg_type_get(sdp_msg, sdp_msg_size, 'm', &m_line,
+		    &val, &val_size))
+			return (EPROTONOSUPPORT); /* No audio/video. */
+		if (6 > val_size)
+			continue;
+		if (0 == memcmp("video ", val, 6)) {
+			sdp->media_type = SAP_SESS_MEDIA_VIDEO;
+			break;
+		}
+		if (0 == memcmp("audio ", val, 6)) {
+			sdp->media_type = SAP_SESS_MEDIA_AUDIO;
+			break;
+		}
+	}
+	cnt = sdp_msg_feilds_get(val, val_size, 8, feilds, feilds_sizes);
+	if (4 > cnt)
+		return (EINVAL);
+	ptm = mem_chr(feilds[1], feilds_sizes[1], '/');
+	if (NULL != ptm) {
+		feilds_sizes[1] = (size_t)(ptm - feilds[1]);
+	}
+	port = ustr2u16(feilds[1], feilds_sizes[1]);
+	if (3 == feilds_sizes[2] &&
+	    0 == memcmp("udp", feilds[2], feilds_sizes[2])) {
+		sdp->media_proto = SAP_SESS_PROTO_UDP;
+	} else if (7 == feilds_sizes[2] &&
+	    0 == memcmp("RTP/AVP", feilds[2], feilds_sizes[2])) {
+		sdp->media_proto = SAP_SESS_PROTO_RTP;
+	} else if (8 == feilds_sizes[2] &&
+	    0 == memcmp("RTP/SAVP", feilds[2], feilds_sizes[2])) {
+		sdp->media_proto = SAP_SESS_PROTO_SRTP;
+	} else {
+		sdp->media_proto = SAP_SESS_PROTO_UNKNOWN;
+	}
+	sdp->payload_type = ustr2u16(feilds[3], feilds_sizes[3]);
+
+	/* c= <nettype> <addrtype> <connection-address>[/<ttl>][/<number of addresses>]
+	 * Media level c= (before next m=) override session level. */
+	m_next_line = (m_line + 1);
+	if (0 != sdp_msg_type_get(sdp_msg, sdp_msg_size, 'm', &m_next_line,
+	    NULL, NULL)) {
+		m_next_line = SIZE_T_MAX;
+	}
+	c_line = (m_line + 1);
+	if (0 != sdp_msg_type_get(sdp_msg, sdp_msg_size, 'c', &c_line,
+	    &val, &val_size) ||
+	    c_line > m_next_line) {
+		c_line = 0;
+		if (0 != sdp_msg_type_get(sdp_msg, sdp_msg_size, 'c', &c_line,
+		    &val, &val_size) ||
+		    c_line > m_line)
+			return (EINVAL); /* No connection info for media. */
+	}
+	cnt = sdp_msg_feilds_get(val, val_size, 8, feilds, feilds_sizes);
+	if (3 > cnt)
+		return (EINVAL);
+	if (2 != feilds_sizes[0] ||
+	    0 != memcmp("IN", feilds[0], 2) ||
+	    3 != feilds_sizes[1])
+		return (EINVAL);
+	if (0 == memcmp("IP4", feilds[1], 3)) {
+		sa_init(&sdp->addr, AF_INET, NULL, 0);
+	} else if (0 == memcmp("IP6", feilds[1], 3)) {
+		sa_init(&sdp->addr, AF_INET6, NULL, 0);
+	} else {
+		return (EAFNOSUPPORT);
+	}
+	sdp->ttl = 0;
+	ptm = mem_chr(feilds[2], feilds_sizes[2], '/');
+	if (NULL != ptm) {
+		val = (ptm + 1);
+		val_size = (feilds_sizes[2] - (size_t)(val - feilds[2]));
+		feilds_sizes[2] = (size_t)(ptm - feilds[2]);
+		if (AF_INET == sa_family(&sdp->addr)) { /* IPv6: no TTL. */
+			ptm = mem_chr(val, val_size, '/');
+			if (NULL != ptm) {
+				val_size = (size_t)(ptm - val);
+			}
+			sdp->ttl = ustr2u8(val, val_size);
+		}
+	}
+	if (0 == feilds_sizes[2] || sizeof(straddr) <= feilds_sizes[2])
+		return (EINVAL);
+	memcpy(straddr, feilds[2], feilds_sizes[2]);
+	straddr[feilds_sizes[2]] = 0;
+	if (1 != inet_pton(sa_family(&sdp->addr), straddr,
+	    sa_addr_get(&sdp->addr)))
+		return (EINVAL);
+	sa_port_set(&sdp->addr, port);
+
+	return (0);
+}
+
+
+static sap_idx_entry_p
+sap_idx_find_msg(sap_idx_p idx, const sockaddr_storage_t *src,
+    uint16_t msg_id_hash, uint32_t hash) {
+	sap_idx_entry_p entry;
+
+	LIST_FOREACH(entry, &idx->msg_hash[(hash & SAP_IDX_HASH_MASK)], next_msg) {
+		if (hash == entry->msg_hash &&
+		    msg_id_hash == entry->sess.msg_id_hash &&
+		    0 != sa_addr_is_eq(src, &entry->sess.src))
+			return (entry);
+	}
+	return (NULL);
+}
+
+static sap_idx_entry_p
+sap_idx_find_orig(sap_idx_p idx, const sap_idx_sdp_t *sdp, uint32_t hash) {
+	sap_idx_entry_p entry;
+	const char *ptm;
+	size_t i;
+
+	LIST_FOREACH(entry, &idx->orig_hash[(hash & SAP_IDX_HASH_MASK)], next_orig) {
+		if (hash != entry->orig_hash ||
+		    sdp->origin_size != entry->sess.origin_size)
+			continue;
+		ptm = entry->sess.origin;
+		for (i = 0; i < nitems(sdp->orig); i ++) {
+			if (0 != memcmp(ptm, sdp->orig[i], sdp->orig_sizes[i]))
+				break;
+			ptm += (sdp->orig_sizes[i] + 1);
+		}
+		if (nitems(sdp->orig) == i)
+			return (entry);
+	}
+	return (NULL);
+}
+
+static void
+sap_idx_entry_free(sap_idx_p idx, sap_idx_entry_p entry) {
+
+	TAILQ_REMOVE(&idx->entries, entry, next);
+	LIST_REMOVE(entry, next_msg);
+	LIST_REMOVE(entry, next_orig);
+	free(entry);
+	idx->stat.count --;
+	idx->dirty = 1;
+}
+
+static int
+sap_idx_entry_add(sap_idx_p idx, const sap_idx_sdp_t *sdp,
+    const sockaddr_storage_t *src, uint16_t msg_id_hash, uint32_t msg_hash,
+    uint32_t orig_hash, uint32_t if_index, time_t time) {
+	sap_idx_entry_p entry;
+	char *ptm;
+	size_t i;
+
+	entry = malloc((sizeof(sap_idx_entry_t) + sdp->name_size +
+	    sdp->info_size + sdp->origin_size + 3));
+	if (NULL == entry)
+		return (ENOMEM);
+	memset(entry, 0x00, sizeof(sap_idx_entry_t));
+	entry->valid_untill = (time + idx->cache_time);
+	entry->msg_hash = msg_hash;
+	entry->orig_hash = orig_hash;
+	/* Strings. */
+	ptm = (char*)(entry + 1);
+	entry->sess.name = ptm;
+	entry->sess.name_size = sdp->name_size;
+	memcpy(ptm, sdp->name, sdp->name_size);
+	ptm += sdp->name_size;
+	(*ptm ++) = 0;
+	entry->sess.info = ptm;
+	entry->sess.info_size = sdp->info_size;
+	if (0 != sdp->info_size) {
+		memcpy(ptm, sdp->info, sdp->info_size);
+		ptm += sdp->info_size;
+	}
+	(*ptm ++) = 0;
+	entry->sess.origin = ptm;
+	entry->sess.origin_size = sdp->origin_size;
+	for (i = 0; i < nitems(sdp->orig); i ++) {
+		memcpy(ptm, sdp->orig[i], sdp->orig_sizes[i]);
+		ptm += sdp->orig_sizes[i];
+		(*ptm ++) = ' ';
+	}
+	ptm[-1] = 0;
+	/* Other. */
+	entry->sess.version = sdp->version;
+	sa_copy(&sdp->addr, &entry->sess.addr);
+	sa_copy(src, &entry->sess.src);
+	entry->sess.if_index = if_index;
+	entry->sess.msg_id_hash = msg_id_hash;
+	entry->sess.payload_type = sdp->payload_type;
+	entry->sess.media_type = sdp->media_type;
+	entry->sess.media_proto = sdp->media_proto;
+	entry->sess.ttl = sdp->ttl;
+	entry->sess.time = time;
+
+	TAILQ_INSERT_TAIL(&idx->entries, entry, next);
+	LIST_INSERT_HEAD(&idx->msg_hash[(msg_hash & SAP_IDX_HASH_MASK)],
+	    entry, next_msg);
+	LIST_INSERT_HEAD(&idx->orig_hash[(orig_hash & SAP_IDX_HASH_MASK)],
+	    entry, next_orig);
+	idx->stat.count ++;
+	idx->dirty = 1;
+
+	return (0);
+}
+
+
+static sap_idx_snap_p
+sap_idx_snap_build(sap_idx_p idx) {
+	sap_idx_snap_p snap;
+	sap_idx_entry_p entry;
+	size_t i, j, count = 0, tbl_size = 4, str_size = 0, mem_size;
+	uint32_t hash;
+	char *ptm;
+
+	TAILQ_FOREACH(entry, &idx->entries, next) {
+		count ++;
+		str_size += (entry->sess.name_size + entry->sess.info_size +
+		    entry->sess.origin_size + 3);
+	}
+	while (tbl_size < (count * 2)) {
+		tbl_size <<= 1;
+	}
+	mem_size = (sizeof(sap_idx_snap_t) + (count * sizeof(sap_sess_t)) +
+	    (tbl_size * sizeof(uint32_t)) + str_size);
+	snap = malloc(mem_size);
+	if (NULL == snap)
+		return (NULL);
+	memset(snap, 0x00, (mem_size - str_size));
+	snap->gen = idx->gen;
+	snap->ref_count = 1; /* Index reference. */
+	snap->count = count;
+	snap->addr_mask = (tbl_size - 1);
+	snap->sess = (sap_sess_p)(snap + 1);
+	snap->addr_tbl = (uint32_t*)(snap->sess + count);
+	ptm = (char*)(snap->addr_tbl + tbl_size);
+
+	/* Copy sessions with strings. */
+	i = 0;
+	TAILQ_FOREACH(entry, &idx->entries, next) {
+		memcpy(&snap->sess[i], &entry->sess, sizeof(sap_sess_t));
+		memcpy(ptm, entry->sess.name, (entry->sess.name_size + 1));
+		snap->sess[i].name = ptm;
+		ptm += (entry->sess.name_size + 1);
+		memcpy(ptm, entry->sess.info, (entry->sess.info_size + 1));
+		snap->sess[i].info = ptm;
+		ptm += (entry->sess.info_size + 1);
+		memcpy(ptm, entry->sess.origin, (entry->sess.origin_size + 1));
+		snap->sess[i].origin = ptm;
+		ptm += (entry->sess.origin_size + 1);
+		i ++;
+	}
+	qsort(snap->sess, count, sizeof(sap_sess_t), sap_idx_sess_cmp);
+	/* Index by group:port, linear probing. */
+	for (i = 0; i < count; i ++) {
+		hash = sap_idx_hash_addr(&snap->sess[i].addr);
+		for (j = (hash & snap->addr_mask); 0 != snap->addr_tbl[j];
+		    j = ((j + 1) & snap->addr_mask))
+			;
+		snap->addr_tbl[j] = (uint32_t)(i + 1);
+	}
+
+	return (snap);
+}
+
+static void
+sap_idx_publish(sap_idx_p idx) {
+	sap_idx_snap_p snap, snap_old;
+
+	if (0 == idx->dirty)
+		return;
+	idx->gen ++;
+	snap = sap_idx_snap_build(idx);
+	if (NULL == snap) { /* Keep dirty, try later. */
+		idx->gen --;
+		return;
+	}
+	snap_old = __atomic_exchange_n(&idx->snap, snap, __ATOMIC_SEQ_CST);
+	idx->dirty = 0;
+	idx->stat.snaps ++;
+	if (NULL != snap_old) {
+		snap_old->next = idx->retired;
+		idx->retired = snap_old;
+		sap_idx_snap_release(snap_old); /* Drop index reference. */
+	}
+	sap_idx_reclaim(idx);
+}
+
+static void
+sap_idx_reclaim(sap_idx_p idx) {
+	sap_idx_snap_p snap, *snap_prev;
+
+	if (NULL == idx->retired)
+		return;
+	/* Reader that see old snapshot pointer can be between load
+	 * and reference increment. */
+	if (0 != __atomic_load_n(&idx->readers, __ATOMIC_SEQ_CST))
+		return;
+	snap_prev = &idx->retired;
+	while (NULL != (snap = (*snap_prev))) {
+		if (0 != __atomic_load_n(&snap->ref_count, __ATOMIC_ACQUIRE)) {
+			snap_prev = &snap->next;
+			continue;
+		}
+		(*snap_prev) = snap->next;
+		free(snap);
+	}
+}
+
+
+int
+sap_idx_create(time_t cache_time, sap_idx_p *idx_ret) {
+	sap_idx_p idx;
+	size_t i;
+
+	if (NULL == idx_ret)
+		return (EINVAL);
+	idx = calloc(1, sizeof(sap_idx_t));
+	if (NULL == idx)
+		return (ENOMEM);
+	TAILQ_INIT(&idx->entries);
+	for (i = 0; i < SAP_IDX_HASH_SIZE; i ++) {
+		LIST_INIT(&idx->msg_hash[i]);
+		LIST_INIT(&idx->orig_hash[i]);
+	}
+	idx->cache_time = cache_time;
+	/* Empty snapshot: readers never get NULL. */
+	idx->dirty = 1;
+	sap_idx_publish(idx);
+	if (NULL == idx->snap) {
+		free(idx);
+		return (ENOMEM);
+	}
+
+	(*idx_ret) = idx;
+	return (0);
+}
+
+void
+sap_idx_destroy(sap_idx_p idx) {
+	sap_idx_entry_p entry, entry_temp;
+	sap_idx_snap_p snap;
+
+	if (NULL == idx)
+		return;
+	TAILQ_FOREACH_SAFE(entry, &idx->entries, next, entry_temp) {
+		free(entry);
+	}
+	while (NULL != (snap = idx->retired)) {
+		idx->retired = snap->next;
+		free(snap);
+	}
+	free(idx->snap);
+	free(idx);
+}
+
+int
+sap_idx_stat_get(sap_idx_p idx, sap_idx_stat_p stat) {
+
+	if (NULL == idx || NULL == stat)
+		return (EINVAL);
+	memcpy(stat, &idx->stat, sizeof(sap_idx_stat_t));
+
+	return (0);
+}
+
+int
+sap_idx_msg_process(sap_idx_p idx, uint8_t *pkt, size_t pkt_size,
+    uint32_t if_index, time_t time) {
+	int error;
+	sap_hdr_p sap_hdr = (sap_hdr_p)pkt;
+	sap_idx_entry_p entry;
+	sap_idx_sdp_t sdp;
+	sockaddr_storage_t src;
+	uint8_t *sdp_msg;
+	size_t sdp_msg_size;
+	uint32_t msg_hash, orig_hash;
+
+	if (NULL == idx || NULL == pkt)
+		return (EINVAL);
+	idx->stat.msgs ++;
+	if (0 == sap_packet_is_valid(pkt, pkt_size)) {
+		idx->stat.msgs_bad ++;
+		return (EINVAL);
+	}
+	if (0 != sap_hdr->flags.bits.e || 0 != sap_hdr->flags.bits.c) {
+		idx->stat.msgs_skipped ++;
+		return (EPROTONOSUPPORT);
+	}
+	sa_init(&src, sap_packet_get_orig_src_type(pkt), NULL, 0);
+	sa_addr_set(&src, sap_packet_get_orig_src(pkt));
+	msg_hash = sap_idx_hash_msg(&src, sap_hdr->msg_id_hash);
+	entry = sap_idx_find_msg(idx, &src, sap_hdr->msg_id_hash, msg_hash);
+	sdp_msg = sap_packet_get_payload(pkt, pkt_size);
+	sdp_msg_size = (pkt_size - (size_t)(sdp_msg - pkt));
+
+	if (0 != sap_hdr->flags.bits.t) { /* Session deletion. */
+		if (NULL == entry &&
+		    0 == sap_idx_sdp_origin_parse(sdp_msg, sdp_msg_size, &sdp)) {
+			entry = sap_idx_find_orig(idx, &sdp,
+			    sap_idx_hash_orig(&sdp));
+		}
+		if (NULL == entry)
+			return (ENOENT);
+		sap_idx_entry_free(idx, entry);
+		idx->stat.deleted ++;
+		sap_idx_publish(idx);
+		return (0);
+	}
+
+	if (NULL != entry) { /* Known announcement: only refresh. */
+		entry->valid_untill = (time + idx->cache_time);
+		sap_idx_publish(idx); /* Retry if previous publish failed. */
+		return (EEXIST);
+	}
+
+	/* New or changed announcement: full parse. */
+	memset(&sdp, 0x00, sizeof(sdp));
+	error = sap_idx_sdp_parse(sdp_msg, sdp_msg_size, &sdp);
+	if (0 != error) {
+		if (EPROTONOSUPPORT == error) {
+			idx->stat.msgs_skipped ++;
+		} else {
+			idx->stat.msgs_bad ++;
+		}
+		return (error);
+	}
+	idx->stat.parsed ++;
+	orig_hash = sap_idx_hash_orig(&sdp);
+	/* Changed session: same origin, new msg id hash. */
+	entry = sap_idx_find_orig(idx, &sdp, orig_hash);
+	if (NULL != entry) {
+		sap_idx_entry_free(idx, entry);
+	}
+	error = sap_idx_entry_add(idx, &sdp, &src, sap_hdr->msg_id_hash,
+	    msg_hash, orig_hash, if_index, time);
+	sap_idx_publish(idx);
+
+	return (error);
+}
+
+size_t
+sap_idx_expire(sap_idx_p idx, time_t time) {
+	sap_idx_entry_p entry, entry_temp;
+	size_t ret = 0;
+
+	if (NULL == idx)
+		return (0);
+	TAILQ_FOREACH_SAFE(entry, &idx->entries, next, entry_temp) {
+		if (entry->valid_untill > time)
+			continue;
+		sap_idx_entry_free(idx, entry);
+		ret ++;
+	}
+	idx->stat.expired += ret;
+	if (0 != idx->dirty) {
+		sap_idx_publish(idx);
+	} else {
+		sap_idx_reclaim(idx);
+	}
+
+	return (ret);
+}
+
+
+sap_idx_snap_p
+sap_idx_snap_get(sap_idx_p idx) {
+	sap_idx_snap_p snap;
+
+	if (NULL == idx)
+		return (NULL);
+	__atomic_add_fetch(&idx->readers, 1, __ATOMIC_SEQ_CST);
+	snap = __atomic_load_n(&idx->snap, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&snap->ref_count, 1, __ATOMIC_SEQ_CST);
+	__atomic_sub_fetch(&idx->readers, 1, __ATOMIC_SEQ_CST);
+
+	return (snap);
+}
+
+void
+sap_idx_snap_release(sap_idx_snap_p snap) {
+
+	if (NULL == snap)
+		return;
+	__atomic_sub_fetch(&snap->ref_count, 1, __ATOMIC_RELEASE);
+}
+
+uint64_t
+sap_idx_snap_gen(sap_idx_snap_p snap) {
+
+	if (NULL == snap)
+		return (0);
+	return (snap->gen);
+}
+
+size_t
+sap_idx_snap_count(sap_idx_snap_p snap) {
+
+	if (NULL == snap)
+		return (0);
+	return (snap->count);
+}
+
+const sap_sess_t *
+sap_idx_snap_sess_get(sap_idx_snap_p snap, size_t index) {
+
+	if (NULL == snap || snap->count <= index)
+		return (NULL);
+	return (&snap->sess[index]);
+}
+
+const sap_sess_t *
+sap_idx_snap_find_addr(sap_idx_snap_p snap, const sockaddr_storage_t *addr) {
+	size_t i;
+
+	if (NULL == snap || NULL == addr)
+		return (NULL);
+	for (i = (sap_idx_hash_addr(addr) & snap->addr_mask);
+	    0 != snap->addr_tbl[i]; i = ((i + 1) & snap->addr_mask)) {
+		if (0 != sa_addr_port_is_eq(addr,
+		    &snap->sess[(snap->addr_tbl[i] - 1)].addr))
+			return (&snap->sess[(snap->addr_tbl[i] - 1)]);
+	}
+	return (NULL);
+}
+
+size_t
+sap_idx_snap_find_name(sap_idx_snap_p snap, const char *prefix,
+    size_t prefix_size, size_t *index_ret) {
+	size_t lo, hi, mid, i;
+	const sap_sess_t *sess;
+
+	if (NULL == snap || (NULL == prefix && 0 != prefix_size))
+		return (0);
+	/* Lower bound: first name >= prefix. */
+	lo = 0;
+	hi = snap->count;
+	while (lo < hi) {
+		mid = (lo + ((hi - lo) / 2));
+		sess = &snap->sess[mid];
+		if (0 > sap_idx_name_cmp(sess->name, sess->name_size,
+		    prefix, prefix_size)) {
+			lo = (mid + 1);
+		} else {
+			hi = mid;
+		}
+	}
+	for (i = lo; i < snap->count; i ++) {
+		sess = &snap->sess[i];
+		if (sess->name_size < prefix_size ||
+		    0 != sap_idx_name_cmp(sess->name, prefix_size,
+		    prefix, prefix_size))
+			break;
+	}
+	if (NULL != index_ret) {
+		(*index_ret) = lo;
+	}
+
+	return ((i - lo));
+}
@@ -55,6 +55,7 @@ typedef struct tp_task_s {
 	off_t		offset;	/* Read/write offset for tp_task_rw_handler() / try_no for connect_ex(). */
 	io_buf_p	buf;	/* Buffer to read/write / send/recv / tp_task_conn_prms_p for connect_ex(). */
 	size_t		tot_transfered_size; /* Total transfered size between calls of cb func / addrs_cur for connect_ex(). */
+	size_t		pkts_max; /* Datagrams per recvmmsg() for pkt_rcvr_mmsg, 0 - recvfrom(). */
 	uint64_t	start_time; /* Task start time. Used in connect_ex for time_limit work. ms from system up time (MONOTONIC).*/
 	tp_task_cb	cb_func;/* Called after check return TP_TASK_DONE. */
 	void		*udata;	/* Passed as arg to check and done funcs. */
@@ -656,6 +657,78 @@ tp_task_notify_handler(tp_event_p ev, tp_udata_p tp_udata) {
 	tp_task_handler_post_int(ev, tptask, cb_ret);
 }
 
+#ifdef HAVE_RECVMMSG
+/* Split free space in buf to slots and receive up to tptask->pkts_max
+ * datagrams per syscall. Each datagram passed to cb in own io_buf view
+ * that point to slot, tptask->buf is not modified.
+ * Truncated datagrams (bigger than slot) are dropped. */
+static void
+tp_task_pkt_rcvr_mmsg(tp_event_p ev, tp_task_p tptask,
+    size_t data2transfer_size) {
+	int error, cb_ret = TP_TASK_CB_CONTINUE;
+	size_t i, pkts_max, slot_size, transfered_size = 0;
+	ssize_t ios;
+	uint8_t *slots;
+	io_buf_t buf;
+	struct mmsghdr msgs[TP_TASK_PKT_RCVR_BATCH_MAX];
+	struct iovec iov[TP_TASK_PKT_RCVR_BATCH_MAX];
+	struct sockaddr_storage ssaddrs[TP_TASK_PKT_RCVR_BATCH_MAX];
+
+	pkts_max = MIN(tptask->pkts_max, TP_TASK_PKT_RCVR_BATCH_MAX);
+	slot_size = (IO_BUF_TR_SIZE_GET(tptask->buf) / pkts_max);
+	slots = IO_BUF_OFFSET_GET(tptask->buf);
+	while (transfered_size < data2transfer_size) { /* recv loop. */
+		for (i = 0; i < pkts_max; i ++) {
+			iov[i].iov_base = (slots + (i * slot_size));
+			iov[i].iov_len = slot_size;
+			msgs[i].msg_hdr.msg_name = &ssaddrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = NULL;
+			msgs[i].msg_hdr.msg_controllen = 0;
+			msgs[i].msg_hdr.msg_flags = 0;
+			msgs[i].msg_len = 0;
+		}
+		ios = recvmmsg((int)tptask->tp_data.ident, msgs,
+		    (unsigned int)pkts_max, MSG_DONTWAIT, NULL);
+		if (-1 == ios) { /* Error. */
+			error = errno;
+			if (0 == error) {
+				error = EINVAL;
+			}
+			error = SKT_ERR_FILTER(error);
+			if (0 == error) /* No more data. */
+				break;
+			cb_ret = ((tp_task_pkt_rcvr_cb)tptask->cb_func)(tptask,
+			    error, NULL, tptask->buf, 0, tptask->udata);
+			if (TP_TASK_CB_CONTINUE != cb_ret)
+				return;
+			break;
+		}
+		for (i = 0; i < (size_t)ios; i ++) {
+			transfered_size += msgs[i].msg_len;
+			if (0 != (MSG_TRUNC & msgs[i].msg_hdr.msg_flags))
+				continue; /* Incomplete, drop. */
+			buf.data = (uint8_t*)iov[i].iov_base;
+			buf.size = slot_size;
+			buf.flags = 0;
+			IO_BUF_BUSY_SIZE_SET(&buf, msgs[i].msg_len);
+			IO_BUF_TR_SIZE_SET(&buf, IO_BUF_FREE_SIZE(&buf));
+			cb_ret = ((tp_task_pkt_rcvr_cb)tptask->cb_func)(tptask,
+			    /*error*/ 0, &ssaddrs[i], &buf, msgs[i].msg_len,
+			    tptask->udata);
+			if (TP_TASK_CB_CONTINUE != cb_ret)
+				return;
+		}
+		if ((size_t)ios < pkts_max) /* Socket drained. */
+			break;
+	} /* end recv while */
+
+	tp_task_handler_post_int(ev, tptask, cb_ret);
+}
+#endif
+
 void
 tp_task_pkt_rcvr_handler(tp_event_p ev, tp_udata_p tp_udata) {
 	tp_task_p tptask;
@@ -689,6 +762,15 @@ call_cb:
 
 	cb_ret = TP_TASK_CB_CONTINUE;
 	ident = tptask->tp_data.ident;
+#ifdef HAVE_RECVMMSG
+	/* Batch mode. */
+	if (1 < tptask->pkts_max &&
+	    TP_TASK_PKT_RCVR_SLOT_MIN <= (IO_BUF_TR_SIZE_GET(tptask->buf) /
+	    MIN(tptask->pkts_max, TP_TASK_PKT_RCVR_BATCH_MAX))) {
+		tp_task_pkt_rcvr_mmsg(ev, tptask, data2transfer_size);
+		return;
+	}
+#endif
 	while (transfered_size < data2transfer_size) { /* recv loop. */
 		addrlen = sizeof(ssaddr);
 		ios = recvfrom((int)ident, IO_BUF_OFFSET_GET(tptask->buf),
@@ -848,6 +930,33 @@ tp_task_pkt_rcvr_create(tpt_p tpt, uintptr_t ident, uint32_t flags,
 	return (error);
 }
 
+int
+tp_task_pkt_rcvr_mmsg_create(tpt_p tpt, uintptr_t ident, uint32_t flags,
+    uint64_t timeout, io_buf_p buf, size_t pkts_max,
+    tp_task_pkt_rcvr_cb cb_func, void *udata, tp_task_p *tptask_ret) {
+	tp_task_p tptask;
+	int error;
+
+	if (0 == pkts_max || TP_TASK_PKT_RCVR_BATCH_MAX < pkts_max ||
+	    NULL == tptask_ret)
+		return (EINVAL);
+	flags &= TP_TASK_F_CLOSE_ON_DESTROY; /* Filter out flags. */
+	flags |= TP_TASK_F_CB_AFTER_EVERY_READ; /* Add flags. */
+	error = tp_task_create(tpt, ident, tp_task_pkt_rcvr_handler, flags,
+	    udata, &tptask);
+	if (0 != error)
+		return (error);
+	tptask->pkts_max = pkts_max; /* Before start: used by handler. */
+	error = tp_task_start(tptask, TP_EV_READ, 0/*TP_F_DISPATCH*/,
+	    timeout, 0, buf, (tp_task_cb)cb_func);
+	if (0 != error) {
+		tp_task_destroy(tptask);
+		tptask = NULL;
+	}
+	(*tptask_ret) = tptask;
+	return (error);
+}
+
 int
 tp_task_accept_create(tpt_p tpt, uintptr_t ident, uint32_t flags,
     uint64_t timeout, tp_task_accept_cb cb_func, void *udata,
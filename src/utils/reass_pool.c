@@ -0,0 +1,314 @@
+/*-
+ * Copyright (c) 2012 - 2018 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * Reassembly pool
+ * many concurrent fragmented sequences with bounded memory
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "utils/macro.h"
+#include "utils/mem_utils.h"
+#include "utils/reass_helper.h"
+#include "utils/reass_pool.h"
+
+
+typedef struct reass_pool_entry_s {
+	reass_hlp_t	hlp;		/* Must be first: reass_pool_done() cast. */
+	LIST_ENTRY(reass_pool_entry_s) hnext; /* Hash chain. */
+	TAILQ_ENTRY(reass_pool_entry_s) next; /* Age list or free list. */
+	uint64_t	key;
+	uint64_t	time;		/* First fragment time. */
+	uint32_t	flags;		/* REASS_POOL_E_F_*. */
+} reass_pool_entry_t, *reass_pool_entry_p;
+
+#define REASS_POOL_E_F_ACTIVE	(((uint32_t)1) << 0) /* In hash and age list. */
+#define REASS_POOL_E_F_DONE	(((uint32_t)1) << 1) /* Complete, owned by caller. */
+
+LIST_HEAD(reass_pool_entry_lhead, reass_pool_entry_s);
+TAILQ_HEAD(reass_pool_entry_head, reass_pool_entry_s);
+
+
+typedef struct reass_pool_s {
+	struct reass_pool_entry_head age; /* Active entries, oldest first. */
+	struct reass_pool_entry_head free; /* Free entries. */
+	struct reass_pool_entry_lhead *hash;
+	size_t		hash_mask;
+	reass_pool_entry_p entries;
+	uint8_t		*mem;		/* Buffers and bitmaps for all entries. */
+	reass_pool_stat_t stat;
+	reass_pool_settings_t s;
+	reass_pool_evict_cb cb_func;
+	void		*udata;
+} reass_pool_t;
+
+
+static inline size_t
+reass_pool_hash(reass_pool_p pool, uint64_t key) {
+
+	/* Fibonacci hashing: keys often differ in few bits only. */
+	return ((size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & pool->hash_mask);
+}
+
+static inline reass_pool_entry_p
+reass_pool_entry_find(reass_pool_p pool, uint64_t key) {
+	reass_pool_entry_p entry;
+
+	LIST_FOREACH(entry, &pool->hash[reass_pool_hash(pool, key)], hnext) {
+		if (key == entry->key)
+			return (entry);
+	}
+	return (NULL);
+}
+
+/* Remove from hash and age list. */
+static inline void
+reass_pool_entry_deactivate(reass_pool_p pool, reass_pool_entry_p entry) {
+
+	if (0 == (REASS_POOL_E_F_ACTIVE & entry->flags))
+		return;
+	LIST_REMOVE(entry, hnext);
+	TAILQ_REMOVE(&pool->age, entry, next);
+	entry->flags &= ~REASS_POOL_E_F_ACTIVE;
+	pool->stat.entries --;
+}
+
+static inline void
+reass_pool_entry_free(reass_pool_p pool, reass_pool_entry_p entry) {
+
+	reass_pool_entry_deactivate(pool, entry);
+	entry->flags = 0;
+	/* LIFO: reuse recently touched buffer. */
+	TAILQ_INSERT_HEAD(&pool->free, entry, next);
+}
+
+static void
+reass_pool_entry_evict(reass_pool_p pool, reass_pool_entry_p entry,
+    int error) {
+
+	if (ETIMEDOUT == error) {
+		pool->stat.seq_timeout ++;
+	} else {
+		pool->stat.seq_evicted ++;
+	}
+	if (NULL != pool->cb_func) {
+		pool->cb_func(pool, entry->key, &entry->hlp, error,
+		    pool->udata);
+	}
+	reass_pool_entry_free(pool, entry);
+}
+
+
+void
+reass_pool_def_settings(reass_pool_settings_p s_ret) {
+
+	if (NULL == s_ret)
+		return;
+	/* Init. */
+	memset(s_ret, 0x00, sizeof(reass_pool_settings_t));
+
+	/* Default settings. */
+	s_ret->entries_max = REASS_POOL_S_DEF_ENTRIES_MAX;
+	s_ret->buf_size = REASS_POOL_S_DEF_BUF_SIZE;
+	s_ret->blk_size = REASS_POOL_S_DEF_BLK_SIZE;
+	s_ret->timeout = REASS_POOL_S_DEF_TIMEOUT;
+}
+
+int
+reass_pool_create(reass_pool_settings_p s, reass_pool_evict_cb cb_func,
+    void *udata, reass_pool_p *pool_ret) {
+	reass_pool_p pool;
+	size_t i, hash_size, bitmap_size;
+	uint8_t *mem;
+
+	if (NULL == s || NULL == pool_ret)
+		return (EINVAL);
+	if (0 == s->entries_max || 0 == s->blk_size ||
+	    s->blk_size > s->buf_size)
+		return (EINVAL);
+	for (hash_size = 2; hash_size < (s->entries_max * 2); hash_size <<= 1)
+		;
+	bitmap_size = REASS_HLP_BITMAP_SIZE(((s->buf_size / s->blk_size) + 1));
+	pool = calloc(1, (sizeof(reass_pool_t) +
+	    (sizeof(struct reass_pool_entry_lhead) * hash_size)));
+	if (NULL == pool)
+		return (ENOMEM);
+	pool->hash = (struct reass_pool_entry_lhead*)(pool + 1);
+	pool->hash_mask = (hash_size - 1);
+	pool->entries = calloc(s->entries_max, sizeof(reass_pool_entry_t));
+	pool->mem = malloc((s->entries_max * (s->buf_size + bitmap_size)));
+	if (NULL == pool->entries || NULL == pool->mem) {
+		free(pool->entries);
+		free(pool->mem);
+		free(pool);
+		return (ENOMEM);
+	}
+	memcpy(&pool->s, s, sizeof(reass_pool_settings_t));
+	pool->cb_func = cb_func;
+	pool->udata = udata;
+	TAILQ_INIT(&pool->age);
+	TAILQ_INIT(&pool->free);
+	for (i = 0; i < hash_size; i ++) {
+		LIST_INIT(&pool->hash[i]);
+	}
+	mem = pool->mem;
+	for (i = 0; i < s->entries_max; i ++) {
+		reass_hlp_init(&pool->entries[i].hlp, mem, s->buf_size,
+		    (mem + s->buf_size), bitmap_size);
+		mem += (s->buf_size + bitmap_size);
+		TAILQ_INSERT_TAIL(&pool->free, &pool->entries[i], next);
+	}
+
+	(*pool_ret) = pool;
+
+	return (0);
+}
+
+void
+reass_pool_destroy(reass_pool_p pool) {
+
+	if (NULL == pool)
+		return;
+	free(pool->entries);
+	free(pool->mem);
+	free(pool);
+}
+
+int
+reass_pool_stat_get(reass_pool_p pool, reass_pool_stat_p stat) {
+
+	if (NULL == pool || NULL == stat)
+		return (EINVAL);
+	memcpy(stat, &pool->stat, sizeof(reass_pool_stat_t));
+
+	return (0);
+}
+
+int
+reass_pool_frag_add(reass_pool_p pool, uint64_t key, uint64_t time,
+    size_t blk_idx, int is_last, void *data, size_t data_size,
+    reass_hlp_p *reass_hlp_ret) {
+	int error;
+	size_t dup_cnt;
+	reass_pool_entry_p entry;
+
+	if (NULL == pool || NULL == reass_hlp_ret)
+		return (EINVAL);
+	reass_pool_timeout_check(pool, time);
+	pool->stat.frags ++;
+
+	entry = reass_pool_entry_find(pool, key);
+	if (NULL == entry) { /* New sequence. */
+		if (TAILQ_EMPTY(&pool->free)) { /* Replace oldest. */
+			entry = TAILQ_FIRST(&pool->age);
+			if (NULL == entry) { /* All buffers owned by caller. */
+				pool->stat.frags_bad ++;
+				return (ENOBUFS);
+			}
+			reass_pool_entry_evict(pool, entry, ENOBUFS);
+		}
+		entry = TAILQ_FIRST(&pool->free);
+		TAILQ_REMOVE(&pool->free, entry, next);
+		entry->key = key;
+		entry->time = time;
+		entry->flags = REASS_POOL_E_F_ACTIVE;
+		reass_hlp_start(&entry->hlp, 0, pool->s.blk_size);
+		LIST_INSERT_HEAD(&pool->hash[reass_pool_hash(pool, key)],
+		    entry, hnext);
+		TAILQ_INSERT_TAIL(&pool->age, entry, next);
+		pool->stat.entries ++;
+		pool->stat.seq_started ++;
+	}
+
+	dup_cnt = entry->hlp.dup_cnt;
+	error = reass_hlp_handle_frag(&entry->hlp, (uint64_t)blk_idx, 0,
+	    is_last, data, data_size);
+	switch (error) {
+	case 0: /* Complete: give buffer to caller. */
+		reass_pool_entry_deactivate(pool, entry);
+		entry->flags |= REASS_POOL_E_F_DONE;
+		pool->stat.seq_done ++;
+		(*reass_hlp_ret) = &entry->hlp;
+		break;
+	case EAGAIN:
+		if (dup_cnt != entry->hlp.dup_cnt) {
+			pool->stat.frags_dup ++;
+		}
+		break;
+	case EBADMSG: /* Sequence is broken. */
+		pool->stat.seq_bad ++;
+		reass_pool_entry_free(pool, entry);
+		break;
+	default:
+		pool->stat.frags_bad ++;
+		if (0 == entry->hlp.blk_cnt) { /* Nothing useful received. */
+			pool->stat.seq_started --;
+			reass_pool_entry_free(pool, entry);
+		}
+		break;
+	}
+
+	return (error);
+}
+
+void
+reass_pool_done(reass_pool_p pool, reass_hlp_p reass_hlp) {
+	reass_pool_entry_p entry = (reass_pool_entry_p)reass_hlp;
+
+	if (NULL == pool || NULL == entry ||
+	    0 == (REASS_POOL_E_F_DONE & entry->flags))
+		return;
+	reass_pool_entry_free(pool, entry);
+}
+
+size_t
+reass_pool_timeout_check(reass_pool_p pool, uint64_t time) {
+	reass_pool_entry_p entry;
+	size_t ret = 0;
+
+	if (NULL == pool)
+		return (0);
+	while (NULL != (entry = TAILQ_FIRST(&pool->age))) {
+		if ((entry->time + pool->s.timeout) > time)
+			break; /* Rest are younger. */
+		reass_pool_entry_evict(pool, entry, ETIMEDOUT);
+		ret ++;
+	}
+
+	return (ret);
+}
@@ -78,24 +78,85 @@ r_buf_rpos_index_inc(r_buf_p r_buf, r_buf_rpos_p rpos) {
 	return (1);
 }
 
+/* Mirror mode: current round data from iov[0] to wpos,
+ * free space up to iov[0] in next copy. */
+static inline size_t
+r_buf_mirror_free_size(r_buf_p r_buf) {
+
+	return ((size_t)((r_buf->iov[0].iov_base + r_buf->size) -
+	    (r_buf->buf + r_buf->wpos)));
+}
+
+/* Mirror mode: join regions that contiguous in mirrored memory. */
+static size_t
+r_buf_mirror_iovec_join(r_buf_p r_buf, iovec_p iov, size_t iov_cnt) {
+	size_t i, j = 0;
+
+	if (0 == iov_cnt)
+		return (0);
+	if (iov[0].iov_base >= r_buf->buf_max) { /* Start from first copy. */
+		iov[0].iov_base -= r_buf->size;
+	}
+	for (i = 1; i < iov_cnt; i ++) {
+		if (iov[i].iov_base >= r_buf->buf_max) {
+			iov[i].iov_base -= r_buf->size;
+		}
+		if ((iov[j].iov_base + iov[j].iov_len) == iov[i].iov_base ||
+		    (iov[j].iov_base + iov[j].iov_len) ==
+		    (iov[i].iov_base + r_buf->size)) {
+			iov[j].iov_len += iov[i].iov_len;
+			continue;
+		}
+		j ++;
+		iov[j] = iov[i];
+	}
+
+	return ((j + 1));
+}
+
+/* Reader at previous round: check that current round blocks not
+ * overwrite data at reader pos. Blocks size may vary between rounds,
+ * so index check is not enough. */
+static inline int
+r_buf_rpos_is_overwritten(r_buf_p r_buf, r_buf_rpos_p rpos) {
+	uint8_t *rptr;
+
+	rptr = (r_buf->iov[rpos->iov_index].iov_base + rpos->iov_off);
+	if (0 != (RBUF_F_U_MIRROR & r_buf->flags)) {
+		/* Previous round tail + current round data must fit. */
+		return (((size_t)((r_buf->iov[r_buf->iov_index_max].iov_base +
+		    r_buf->iov[r_buf->iov_index_max].iov_len) - rptr) +
+		    (size_t)((r_buf->buf + r_buf->wpos) -
+		    r_buf->iov[0].iov_base)) > r_buf->size);
+	}
+
+	return (rptr < (r_buf->buf + r_buf->wpos));
+}
+
 static size_t
 iovec_aggregate_ex(iovec_p iov, size_t iov_cnt, size_t data_size, size_t off,
-    iovec_p ret, size_t ret_cnt, size_t *reminder_data_size_ret) {
-	register size_t i, j = 0;
+    iovec_p ret, size_t ret_cnt, size_t *reminder_data_size_ret,
+    size_t *iov_used_ret) {
+	register size_t i = 0, j = 0;
 
-	/* Do not send packet fragment as last packet in buf. */
 	if (0 == iov_cnt || 0 == ret_cnt || 0 == data_size ||
-	    (iov[0].iov_len - off) >= data_size ||
 	    (1 == iov_cnt && 0 == (iov[0].iov_len - off))) {
 		if (NULL != reminder_data_size_ret) {
-			(*reminder_data_size_ret) = 0;
+			(*reminder_data_size_ret) = data_size;
+		}
+		if (NULL != iov_used_ret) { /* Last empty block is used. */
+			(*iov_used_ret) = ((0 != data_size && 0 != ret_cnt) ?
+			    iov_cnt : 0);
 		}
 		return (0);
 	}
 	ret_cnt --;
 	ret[0].iov_base = (iov[0].iov_base + off);
-	ret[0].iov_len = (iov[0].iov_len - off);
+	ret[0].iov_len = MIN((iov[0].iov_len - off), data_size);
 	data_size -= ret[0].iov_len;
+	if (ret[0].iov_len != (iov[0].iov_len - off))
+		goto out_ok; /* Only fragment of first block fit. */
+	/* Do not send packet fragment as last packet in buf. */
 	for (i = 1; i < iov_cnt && j < ret_cnt && data_size >= iov[i].iov_len; i ++) {
 		data_size -= iov[i].iov_len;
 		if ((iov[(i - 1)].iov_base + iov[(i - 1)].iov_len) ==
@@ -106,14 +167,17 @@ iovec_aggregate_ex(iovec_p iov, size_t iov_cnt, size_t data_size, size_t off,
 			ret[j] = iov[i];
 		}
 	}
+out_ok:
 	if (NULL != reminder_data_size_ret) {
 		(*reminder_data_size_ret) = data_size;
 	}
+	if (NULL != iov_used_ret) { /* Source blocks used completely. */
+		(*iov_used_ret) = i;
+	}
 
 	return ((j + 1));
 }
 
-
 int
 r_buf_rpos_cmp(r_buf_rpos_p rpos1, r_buf_rpos_p rpos2) {
 
@@ -188,7 +252,7 @@ r_buf_rpos_calc_size(r_buf_p r_buf, r_buf_rpos_p rpos1, r_buf_rpos_p rpos2) {
 			    r_buf->iov[rpos_lo->iov_index].iov_base);
 			ret += (size_t)((r_buf->iov[rpos_hi->iov_index].iov_base +
 			    r_buf->iov[rpos_hi->iov_index].iov_len) -
-			    r_buf->buf);
+			    r_buf->iov[0].iov_base);
 		}
 	}
 
@@ -230,7 +294,7 @@ r_buf_rpos_init_near(r_buf_p r_buf, r_buf_rpos_p rpos, size_t data_size,
     r_buf_rpos_p rposs, size_t rposs_cnt) {
 	int error, cmp;
 	size_t i, dsize_lo, dsize_hi;
-	
+
 	if (1 == rposs_cnt) {
 		memcpy(rpos, &rposs[0], sizeof(r_buf_rpos_t));
 		return (0);
@@ -240,16 +304,27 @@ r_buf_rpos_init_near(r_buf_p r_buf, r_buf_rpos_p rpos, size_t data_size,
 	    0 == rposs_cnt) /* No error in this case. */
 		return (error);
 
-	for (i = 1; i < rposs_cnt; i ++) {
+	/* rposs sorted from oldest to newest. */
+	for (i = 0; i < rposs_cnt; i ++) {
 		cmp = r_buf_rpos_cmp(rpos, &rposs[i]);
 		if (0 == cmp)
 			return (0); /* No need to find near index. */
 		if (0 > cmp)
 			break;
 	}
-	/* Select nearest index. */
-	dsize_lo = (data_size - r_buf_data_avail_size(r_buf, &rposs[(i - 1)], NULL));
-	dsize_hi = (r_buf_data_avail_size(r_buf, &rposs[i], NULL) - data_size);
+	if (0 == i) { /* All newer. */
+		memcpy(rpos, &rposs[0], sizeof(r_buf_rpos_t));
+		return (0);
+	}
+	if (rposs_cnt == i) { /* All older. */
+		memcpy(rpos, &rposs[(i - 1)], sizeof(r_buf_rpos_t));
+		return (0);
+	}
+	/* Select nearest index: older have more data. */
+	dsize_lo = r_buf_data_avail_size(r_buf, &rposs[(i - 1)], NULL);
+	dsize_lo = ((dsize_lo > data_size) ? (dsize_lo - data_size) : 0);
+	dsize_hi = r_buf_data_avail_size(r_buf, &rposs[i], NULL);
+	dsize_hi = ((data_size > dsize_hi) ? (data_size - dsize_hi) : 0);
 	if (dsize_lo < dsize_hi) {
 		memcpy(rpos, &rposs[(i - 1)], sizeof(r_buf_rpos_t));
 	} else {
@@ -276,7 +351,8 @@ r_buf_rpos_check_fast(r_buf_p r_buf, r_buf_rpos_p rpos) {
 			/* Reader out of buf range in previous round - normal. */
 			return (1); /* OK: fixed. */
 		}
-		if (rpos->iov_index > r_buf->iov_index)
+		if (rpos->iov_index > r_buf->iov_index &&
+		    0 == r_buf_rpos_is_overwritten(r_buf, rpos))
 			return (1); /* OK: in range. */
 		/* Out of range: slow reader. */
 		return (0);
@@ -315,11 +391,21 @@ r_buf_rpos_check(r_buf_p r_buf, r_buf_rpos_p rpos, size_t *drop_size_ret) {
 			rpos->round_num ++;
 			return (1); /* OK: fixed. */
 		}
-		if (rpos->iov_index > r_buf->iov_index)
+		if (rpos->iov_index > r_buf->iov_index &&
+		    0 == r_buf_rpos_is_overwritten(r_buf, rpos))
 			return (1); /* OK: in range. */
 		/* Out of range: slow reader. */
-		drop_size = (r_buf->size + r_buf_iovec_calc_size(&r_buf->iov[rpos->iov_index],
-		    (1 + r_buf->iov_index - rpos->iov_index)));
+		if (rpos->iov_index <= r_buf->iov_index) {
+			drop_size = (r_buf->size + r_buf_iovec_calc_size(&r_buf->iov[rpos->iov_index],
+			    (1 + r_buf->iov_index - rpos->iov_index)) -
+			    rpos->iov_off);
+		} else { /* Overwritten by bigger blocks. */
+			drop_size = r_buf->size;
+		}
+		/* Move to write pos, as for very slow reader. */
+		rpos->iov_off = 0;
+		rpos->iov_index = (r_buf->iov_index + 1);
+		rpos->round_num = r_buf->round_num;
 		if (NULL != drop_size_ret) {
 			(*drop_size_ret) = drop_size;
 		}
@@ -366,10 +452,18 @@ r_buf_alloc(uintptr_t fd, size_t size, const size_t min_block_size,
 	//r_buf->size = ALIGNEX((size + min_block_size), page_size); /* XXX: Minimum buf. */
 	//while (r_buf->size > size)
 	//	r_buf->size -= page_size;
-	r_buf->size = size;
+	r_buf->flags = (RBUF_F_U__MASK__ & flags);
+	if (0 != (RBUF_F_U_MIRROR & r_buf->flags)) {
+		/* Tail data always contiguous, no need to move. */
+		r_buf->flags &= ~RBUF_F_U_KEEP_TAIL;
+		r_buf->size = ALIGNEX(size, page_size);
+		r_buf->buf = mapalloc_mirror_fd(fd, r_buf->size);
+	} else {
+		r_buf->size = size;
+		r_buf->buf = mapalloc_fd(fd, r_buf->size);
+	}
 	SYSLOGD_EX(LOG_DEBUG, "mapalloc_fd: size = %zu, r_buf->size = %zu",
 	    size, r_buf->size);
-	r_buf->buf = mapalloc_fd(fd, r_buf->size);
 	if (NULL == r_buf->buf) {
 		SYSLOGD_ERR(LOG_DEBUG, errno, "mapalloc_fd()");
 		goto err_out;
@@ -382,9 +476,9 @@ r_buf_alloc(uintptr_t fd, size_t size, const size_t min_block_size,
 		goto err_out;
 	}
 	//r_buf->iov_index = ~0; /* r_buf_wbuf_get() increment this, set to: -1. */
+	r_buf->iov[0].iov_base = r_buf->buf; /* Readers may check before first write. */
 	r_buf->buf_max = (r_buf->buf + r_buf->size);
 	r_buf->min_block_size = min_block_size;
-	r_buf->flags = (RBUF_F_U__MASK__ & flags);
 
 	return (r_buf);
 
@@ -402,7 +496,11 @@ r_buf_free(r_buf_p r_buf) {
 		return;
 
 	if (NULL != r_buf->buf) {
-		mapfree(r_buf->buf, r_buf->size);
+		if (0 != (RBUF_F_U_MIRROR & r_buf->flags)) {
+			mapfree_mirror(r_buf->buf, r_buf->size);
+		} else {
+			mapfree(r_buf->buf, r_buf->size);
+		}
 	}
 	if (NULL != r_buf->iov) {
 		mapfree(r_buf->iov, r_buf->iov_size);
@@ -451,11 +549,29 @@ r_buf_wbuf_get(r_buf_p r_buf, size_t min_buf_size, uint8_t **buf) {
 	if (r_buf->size < min_buf_size) /* Paranoid check. */
 		return (0); /* Not enough space. */
 
-	buf_size = (r_buf->size - r_buf->wpos);
 	if (0 != r_buf->iov[r_buf->iov_index].iov_len) {
 		r_buf->iov_index ++;
 		r_buf->iov[r_buf->iov_index].iov_len = 0;
 	}
+	if (0 != (RBUF_F_U_MIRROR & r_buf->flags)) {
+		/* Space up to round head in next copy: blocks can cross buf end. */
+		buf_size = r_buf_mirror_free_size(r_buf);
+		if (buf_size < min_buf_size || /* Round is full. */
+		    buf_size < r_buf->min_block_size) {
+			/* New round starts from current pos. */
+			if (r_buf->wpos >= r_buf->size) {
+				r_buf->wpos -= r_buf->size;
+			}
+			buf_size = r_buf->size;
+			r_buf->iov_index_max = (r_buf->iov_index - 1);
+			r_buf->iov_index = 0;
+			r_buf->round_num ++;
+			r_buf->flags |= RBUF_F_FULL;
+			r_buf->iov[r_buf->iov_index].iov_len = 0;
+		}
+		goto set_base;
+	}
+	buf_size = (r_buf->size - r_buf->wpos);
 	if (buf_size < min_buf_size || /* Not enough space at buf end. */
 	    buf_size < r_buf->min_block_size /*||
 	    r_buf->iov_count == r_buf->iov_index*/) { /* Paranoid check. */
@@ -470,6 +586,7 @@ r_buf_wbuf_get(r_buf_p r_buf, size_t min_buf_size, uint8_t **buf) {
 		r_buf->flags |= RBUF_F_FULL;
 		r_buf->iov[r_buf->iov_index].iov_len = 0;
 	}
+set_base:
 	r_buf->iov[r_buf->iov_index].iov_base = (r_buf->buf + r_buf->wpos);
 	if (NULL != buf) {
 		(*buf) = r_buf->iov[r_buf->iov_index].iov_base;
@@ -491,7 +608,8 @@ r_buf_wbuf_set(r_buf_p r_buf, size_t offset, size_t buf_size) {
 		return (EINVAL);
 	data_size = (buf_size - offset);
 	if (data_size < r_buf->min_block_size || /* Data to small. */
-	    data_size > (r_buf->size - r_buf->wpos)) /* Not enough space. */
+	    data_size > ((0 != (RBUF_F_U_MIRROR & r_buf->flags)) ?
+	    r_buf_mirror_free_size(r_buf) : (r_buf->size - r_buf->wpos))) /* Not enough space. */
 		return (EINVAL);
 	r_buf->iov[r_buf->iov_index].iov_len = data_size;
 	if (0 != offset) {
@@ -516,7 +634,8 @@ r_buf_wbuf_set2(r_buf_p r_buf, uint8_t *buf, size_t buf_size, r_buf_rpos_p rpos)
 	    buf < r_buf->iov[r_buf->iov_index].iov_base) /* Invalid buf pointer. */
 		return (EINVAL); /* Paranoid check. */
 	buf_end = (buf + buf_size);
-	if (buf_end > r_buf->buf_max) /* Invalid buf pointer. */
+	if (buf_end > ((0 != (RBUF_F_U_MIRROR & r_buf->flags)) ?
+	    (r_buf->iov[0].iov_base + r_buf->size) : r_buf->buf_max)) /* Invalid buf pointer. */
 		return (EINVAL);
 	if (buf != r_buf->iov[r_buf->iov_index].iov_base) {
 		r_buf->flags |= RBUF_F_FRAG;
@@ -599,7 +718,8 @@ r_buf_data_avail_size(r_buf_p r_buf, r_buf_rpos_p rpos, size_t *drop_size_ret) {
 			ret = (size_t)((r_buf->iov[r_buf->iov_index_max].iov_base +
 			    r_buf->iov[r_buf->iov_index_max].iov_len) -
 			    r_buf->iov[rpos->iov_index].iov_base);
-			ret += r_buf->wpos;
+			ret += (size_t)((r_buf->buf + r_buf->wpos) -
+			    r_buf->iov[0].iov_base);
 		}
 	}
 	ret -= rpos->iov_off;
@@ -614,7 +734,7 @@ return_ok:
 size_t
 r_buf_data_get(r_buf_p r_buf, r_buf_rpos_p rpos, size_t data_size,
     iovec_p iov, size_t iov_cnt, size_t *drop_size_ret, size_t *data_size_ret) {
-	size_t ret = 0, tm;
+	size_t ret = 0, tm, cnt, used;
 
 	if (NULL == r_buf || NULL == rpos || 0 == data_size ||
 	    NULL == iov || 0 == iov_cnt ||
@@ -633,13 +753,19 @@ r_buf_data_get(r_buf_p r_buf, r_buf_rpos_p rpos, size_t data_size,
 		}
 		ret = iovec_aggregate_ex(&r_buf->iov[rpos->iov_index],
 		    (1 + r_buf->iov_index - rpos->iov_index), data_size,
-		    rpos->iov_off, iov, iov_cnt, &tm);
+		    rpos->iov_off, iov, iov_cnt, &tm, NULL);
 	} else {
+		cnt = (1 + r_buf->iov_index_max - rpos->iov_index);
 		ret = iovec_aggregate_ex(&r_buf->iov[rpos->iov_index],
-		    (1 + r_buf->iov_index_max - rpos->iov_index), data_size,
-		    rpos->iov_off, iov, iov_cnt, &tm);
-		ret += iovec_aggregate_ex(r_buf->iov, (1 + r_buf->iov_index),
-		    tm, 0, &iov[ret], (iov_cnt - ret), &tm);
+		    cnt, data_size, rpos->iov_off, iov, iov_cnt, &tm, &used);
+		if (used == cnt) { /* Previous round tail done, continue from head. */
+			ret += iovec_aggregate_ex(r_buf->iov,
+			    (1 + r_buf->iov_index), tm, 0, &iov[ret],
+			    (iov_cnt - ret), &tm, NULL);
+		}
+	}
+	if (0 != (RBUF_F_U_MIRROR & r_buf->flags)) {
+		ret = r_buf_mirror_iovec_join(r_buf, iov, ret);
 	}
 return_ok:
 	if (NULL != drop_size_ret) {
@@ -663,6 +789,10 @@ r_buf_data_get_conv2off(r_buf_p r_buf, iovec_p iov, size_t iov_cnt) {
 
 	for (i = 0; i < iov_cnt; i ++) {
 		iov[i].iov_base -= (size_t)r_buf->buf;
+		if (0 != (RBUF_F_U_MIRROR & r_buf->flags) &&
+		    (size_t)iov[i].iov_base >= r_buf->size) {
+			iov[i].iov_base -= r_buf->size;
+		}
 	}
 
 	return (0);
@@ -0,0 +1,549 @@
+/*-
+ * Copyright (c) 2012 - 2018 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * Ring buffer fan-out
+ * single writer, readers served by own tp threads
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/queue.h>
+#include <sys/uio.h> /* struct iovec */
+#include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* memcpy, memmove, memset, strerror... */
+#include <pthread.h>
+#include <errno.h>
+
+#include "utils/macro.h"
+#include "utils/mem_utils.h"
+#include "net/socket.h"
+#include "threadpool/threadpool_task.h"
+#include "threadpool/threadpool_msg_sys.h"
+#include "utils/ring_buffer.h"
+#include "utils/ring_buffer_fanout.h"
+
+
+TAILQ_HEAD(r_buf_fo_rdr_head, r_buf_fo_rdr_s);
+
+typedef struct r_buf_fo_grp_s { /* Per thread readers. */
+	struct r_buf_fo_rdr_head rdrs;	/* Used only by owner thread. */
+	r_buf_fo_p	fo;
+	tpt_p		tpt;
+	size_t		rdr_count;	/* Protected by fo->mtx. */
+	int		pending;	/* Wakeup message sent. Protected by fo->mtx. */
+} r_buf_fo_grp_t, *r_buf_fo_grp_p;
+
+typedef struct r_buf_fo_rdr_s {
+	TAILQ_ENTRY(r_buf_fo_rdr_s) next;
+	r_buf_fo_grp_p	grp;
+	tp_task_p	tptask;		/* Notify: socket ready for write. */
+	r_buf_rpos_t	rpos;		/* Protected by fo->rw_lock. */
+	uint32_t	flags;		/* R_BUF_FO_RDR_F_*. */
+	r_buf_fo_rdr_stat_t stat;
+	r_buf_fo_rdr_cb	cb_func;
+	void		*udata;
+} r_buf_fo_rdr_t;
+
+#define R_BUF_FO_RDR_F_SND_WAIT	(((uint32_t)1) << 0) /* tptask started: wait for socket. */
+
+
+typedef struct r_buf_fo_s {
+	r_buf_p		r_buf;
+	tp_p		tp;
+	pthread_rwlock_t rw_lock;	/* Write: ring buf and sync points update. */
+	MTX_S		mtx;		/* Wakeups, ref_count, readers count. */
+	size_t		ref_count;
+	r_buf_rpos_t	sync[R_BUF_FO_SYNC_POINTS_MAX]; /* Circular. */
+	size_t		sync_idx;	/* Next sync point write index. */
+	size_t		sync_count;
+	r_buf_fo_stat_t	stat;
+	r_buf_fo_settings_t s;
+	size_t		grps_count;
+	r_buf_fo_grp_p	grps;
+} r_buf_fo_t;
+
+
+static void	r_buf_fo_release(r_buf_fo_p fo);
+static int	r_buf_fo_rdr_notify_cb(tp_task_p tptask, int error,
+		    uint32_t eof, size_t data2transfer_size, void *udata);
+
+
+void
+r_buf_fo_def_settings(r_buf_fo_settings_p s_ret) {
+
+	if (NULL == s_ret)
+		return;
+	/* Init. */
+	memset(s_ret, 0x00, sizeof(r_buf_fo_settings_t));
+
+	/* Default settings. */
+	s_ret->ring_size = R_BUF_FO_S_DEF_RING_SIZE;
+	s_ret->min_block_size = R_BUF_FO_S_DEF_MIN_BLOCK_SIZE;
+	s_ret->precache = R_BUF_FO_S_DEF_PRECACHE;
+	s_ret->lag_max = R_BUF_FO_S_DEF_LAG_MAX;
+	s_ret->snd_block_min = R_BUF_FO_S_DEF_SND_BLOCK_MIN;
+	s_ret->snd_timeout = R_BUF_FO_S_DEF_SND_TIMEOUT;
+	s_ret->flags = R_BUF_FO_S_DEF_FLAGS;
+}
+
+int
+r_buf_fo_create(tp_p tp, r_buf_fo_settings_p s, r_buf_fo_p *fo_ret) {
+	int error;
+	size_t i;
+	r_buf_fo_p fo;
+
+	if (NULL == tp || NULL == s || NULL == fo_ret)
+		return (EINVAL);
+	/* Lag must be detected before writer overwrite data, including
+	 * data accumulated up to snd_block_min. */
+	if (0 == s->ring_size || 0 == s->min_block_size ||
+	    s->min_block_size > s->ring_size ||
+	    s->lag_max >= s->ring_size ||
+	    s->snd_block_min >= (s->ring_size - s->lag_max) ||
+	    s->precache > s->lag_max)
+		return (EINVAL);
+	fo = calloc(1, sizeof(r_buf_fo_t));
+	if (NULL == fo)
+		return (ENOMEM);
+	fo->r_buf = r_buf_alloc((uintptr_t)-1, s->ring_size, s->min_block_size,
+	    (((0 != (R_BUF_FO_S_F_KEEP_TAIL & s->flags)) ? RBUF_F_U_KEEP_TAIL : 0) |
+	    ((0 != (R_BUF_FO_S_F_MIRROR & s->flags)) ? RBUF_F_U_MIRROR : 0)));
+	if (NULL == fo->r_buf) {
+		error = ENOMEM;
+		goto err_out;
+	}
+	error = pthread_rwlock_init(&fo->rw_lock, NULL);
+	if (0 != error) {
+		r_buf_free(fo->r_buf);
+		goto err_out;
+	}
+	MTX_INIT(&fo->mtx);
+	fo->tp = tp;
+	fo->ref_count = 1;
+	memcpy(&fo->s, s, sizeof(r_buf_fo_settings_t));
+	fo->grps_count = tp_thread_count_max_get(tp);
+	fo->grps = calloc(fo->grps_count, sizeof(r_buf_fo_grp_t));
+	if (NULL == fo->grps) {
+		r_buf_fo_release(fo);
+		return (ENOMEM);
+	}
+	for (i = 0; i < fo->grps_count; i ++) {
+		TAILQ_INIT(&fo->grps[i].rdrs);
+		fo->grps[i].fo = fo;
+		fo->grps[i].tpt = tp_thread_get(tp, i);
+	}
+
+	(*fo_ret) = fo;
+	return (0);
+
+err_out:
+	free(fo);
+	return (error);
+}
+
+static void
+r_buf_fo_release(r_buf_fo_p fo) {
+	size_t ref_count;
+
+	MTX_LOCK(&fo->mtx);
+	fo->ref_count --;
+	ref_count = fo->ref_count;
+	MTX_UNLOCK(&fo->mtx);
+	if (0 != ref_count)
+		return;
+	/* Last reference. */
+	r_buf_free(fo->r_buf);
+	pthread_rwlock_destroy(&fo->rw_lock);
+	MTX_DESTROY(&fo->mtx);
+	free(fo->grps);
+	free(fo);
+}
+
+void
+r_buf_fo_destroy(r_buf_fo_p fo) {
+
+	if (NULL == fo)
+		return;
+	r_buf_fo_release(fo);
+}
+
+r_buf_p
+r_buf_fo_r_buf_get(r_buf_fo_p fo) {
+
+	if (NULL == fo)
+		return (NULL);
+	return (fo->r_buf);
+}
+
+int
+r_buf_fo_stat_get(r_buf_fo_p fo, r_buf_fo_stat_p stat) {
+
+	if (NULL == fo || NULL == stat)
+		return (EINVAL);
+	pthread_rwlock_rdlock(&fo->rw_lock);
+	MTX_LOCK(&fo->mtx);
+	memcpy(stat, &fo->stat, sizeof(r_buf_fo_stat_t));
+	MTX_UNLOCK(&fo->mtx);
+	pthread_rwlock_unlock(&fo->rw_lock);
+
+	return (0);
+}
+
+
+/* Set reader pos to nearest sync point to precache size.
+ * fo->rw_lock must be read locked. */
+static size_t
+r_buf_fo_rpos_init(r_buf_fo_p fo, r_buf_rpos_p rpos) {
+	size_t i, cnt = 0, ret;
+	r_buf_rpos_t rposs[R_BUF_FO_SYNC_POINTS_MAX];
+
+	/* Copy valid sync points from oldest to newest:
+	 * r_buf_rpos_init_near() may modify them. */
+	for (i = 0; i < fo->sync_count; i ++) {
+		memcpy(&rposs[cnt],
+		    &fo->sync[((fo->sync_idx + R_BUF_FO_SYNC_POINTS_MAX -
+		    fo->sync_count + i) % R_BUF_FO_SYNC_POINTS_MAX)],
+		    sizeof(r_buf_rpos_t));
+		if (0 == r_buf_rpos_check_fast(fo->r_buf, &rposs[cnt]))
+			continue; /* Overwritten. */
+		cnt ++;
+	}
+	r_buf_rpos_init_near(fo->r_buf, rpos, fo->s.precache, rposs, cnt);
+	ret = r_buf_data_avail_size(fo->r_buf, rpos, NULL);
+	if (ret > fo->s.lag_max) { /* Sync point too old. */
+		r_buf_rpos_init(fo->r_buf, rpos, fo->s.precache);
+		ret = r_buf_data_avail_size(fo->r_buf, rpos, NULL);
+	}
+
+	return (ret);
+}
+
+/* Return: 0 - all data sent, EAGAIN - wait for socket, other - error. */
+static int
+r_buf_fo_rdr_snd(r_buf_fo_rdr_p rdr) {
+	int error;
+	r_buf_fo_p fo = rdr->grp->fo;
+	size_t avail, drop_size = 0, data_size = 0, iov_cnt;
+	ssize_t ios;
+	struct msghdr mhdr;
+	iovec_t iov[R_BUF_FO_IOV_MAX];
+
+	pthread_rwlock_rdlock(&fo->rw_lock);
+	avail = r_buf_data_avail_size(fo->r_buf, &rdr->rpos, &drop_size);
+	if (0 != drop_size || avail > fo->s.lag_max) {
+		/* Overrun by writer (rpos moved to write pos) or lag. */
+		if (0 != (R_BUF_FO_S_F_LAG_DROP & fo->s.flags)) {
+			pthread_rwlock_unlock(&fo->rw_lock);
+			rdr->stat.drop_count ++;
+			rdr->stat.drop_size += MAX(drop_size, avail);
+			return (ENOBUFS);
+		}
+		if (0 != drop_size) {
+			rdr->stat.drop_count ++;
+		}
+		if (0 != (R_BUF_FO_S_F_LAG_JUMP & fo->s.flags)) {
+			data_size = r_buf_fo_rpos_init(fo, &rdr->rpos);
+			rdr->stat.jump_count ++;
+			/* Skipped: up to write pos on overrun or unsent
+			 * data, except data from new pos. */
+			if (0 == drop_size) {
+				drop_size = avail;
+			}
+			drop_size -= MIN(drop_size, data_size);
+			avail = data_size;
+		}
+		rdr->stat.drop_size += drop_size;
+	}
+	rdr->stat.lag = avail;
+	rdr->stat.lag_max = MAX(rdr->stat.lag_max, avail);
+	if (0 == avail || avail < fo->s.snd_block_min) {
+		pthread_rwlock_unlock(&fo->rw_lock);
+		return (0);
+	}
+	iov_cnt = r_buf_data_get(fo->r_buf, &rdr->rpos, avail, iov,
+	    R_BUF_FO_IOV_MAX, NULL, &data_size);
+	pthread_rwlock_unlock(&fo->rw_lock);
+	if (0 == iov_cnt || 0 == data_size)
+		return (0);
+
+	/* Send directly from ring buf. */
+	memset(&mhdr, 0x00, sizeof(mhdr));
+	mhdr.msg_iov = (struct iovec*)iov;
+	mhdr.msg_iovlen = iov_cnt;
+	ios = sendmsg((int)tp_task_ident_get(rdr->tptask), &mhdr,
+	    (MSG_DONTWAIT | MSG_NOSIGNAL));
+	rdr->stat.snd_calls ++;
+	if (-1 == ios) {
+		error = errno;
+		error = SKT_ERR_FILTER(error);
+		if (0 == error)
+			return (EAGAIN);
+		return (error);
+	}
+	pthread_rwlock_rdlock(&fo->rw_lock);
+	r_buf_rpos_inc(fo->r_buf, &rdr->rpos, (size_t)ios);
+	pthread_rwlock_unlock(&fo->rw_lock);
+	rdr->stat.snd_size += (uint64_t)ios;
+	rdr->stat.lag -= (size_t)ios;
+	if ((size_t)ios < data_size || /* Socket buf full. */
+	    data_size < avail) /* More data, send on next ready event. */
+		return (EAGAIN);
+
+	return (0);
+}
+
+static int
+r_buf_fo_rdr_snd_handle(r_buf_fo_rdr_p rdr) {
+	int error;
+
+	error = r_buf_fo_rdr_snd(rdr);
+	switch (error) {
+	case 0: /* All sent, wait for writer. */
+		if (0 != (R_BUF_FO_RDR_F_SND_WAIT & rdr->flags)) {
+			tp_task_stop(rdr->tptask);
+			rdr->flags &= ~R_BUF_FO_RDR_F_SND_WAIT;
+		}
+		return (TP_TASK_CB_NONE);
+	case EAGAIN: /* Wait for socket. */
+		if (0 == (R_BUF_FO_RDR_F_SND_WAIT & rdr->flags)) {
+			error = tp_task_restart(rdr->tptask);
+			if (0 != error)
+				break;
+			rdr->flags |= R_BUF_FO_RDR_F_SND_WAIT;
+		}
+		return (TP_TASK_CB_CONTINUE);
+	}
+	/* Error. */
+	tp_task_stop(rdr->tptask);
+	rdr->flags &= ~R_BUF_FO_RDR_F_SND_WAIT;
+	rdr->cb_func(rdr, error, rdr->udata); /* rdr can be freed here. */
+
+	return (TP_TASK_CB_NONE);
+}
+
+static int
+r_buf_fo_rdr_notify_cb(tp_task_p tptask, int error,
+    uint32_t eof __unused, size_t data2transfer_size __unused,
+    void *udata) {
+	r_buf_fo_rdr_p rdr = udata;
+
+	debugd_break_if(NULL == rdr);
+	debugd_break_if(tptask != rdr->tptask);
+
+	if (0 != error) {
+		tp_task_stop(tptask);
+		rdr->flags &= ~R_BUF_FO_RDR_F_SND_WAIT;
+		rdr->cb_func(rdr, error, rdr->udata); /* rdr can be freed here. */
+		return (TP_TASK_CB_NONE);
+	}
+
+	return (r_buf_fo_rdr_snd_handle(rdr));
+}
+
+/* New data in ring buf: serve readers that wait for writer. */
+static void
+r_buf_fo_grp_msg_cb(tpt_p tpt __unused, void *udata) {
+	r_buf_fo_grp_p grp = udata;
+	r_buf_fo_rdr_p rdr, rdr_temp;
+
+	debugd_break_if(NULL == grp);
+
+	MTX_LOCK(&grp->fo->mtx);
+	grp->pending = 0;
+	MTX_UNLOCK(&grp->fo->mtx);
+	TAILQ_FOREACH_SAFE(rdr, &grp->rdrs, next, rdr_temp) {
+		if (0 != (R_BUF_FO_RDR_F_SND_WAIT & rdr->flags))
+			continue; /* Will be served on socket ready event. */
+		r_buf_fo_rdr_snd_handle(rdr);
+	}
+	r_buf_fo_release(grp->fo);
+}
+
+static void
+r_buf_fo_wakeup(r_buf_fo_p fo) {
+	size_t i;
+	r_buf_fo_grp_p grp;
+
+	MTX_LOCK(&fo->mtx);
+	for (i = 0; i < fo->grps_count; i ++) {
+		grp = &fo->grps[i];
+		if (0 == grp->rdr_count || 0 != grp->pending)
+			continue;
+		grp->pending = 1;
+		fo->ref_count ++;
+		fo->stat.wakeups ++;
+		if (0 == tpt_msg_send(grp->tpt, NULL, TP_MSG_F_FORCE,
+		    r_buf_fo_grp_msg_cb, grp))
+			continue;
+		grp->pending = 0;
+		fo->ref_count --;
+	}
+	MTX_UNLOCK(&fo->mtx);
+}
+
+
+size_t
+r_buf_fo_wbuf_get(r_buf_fo_p fo, size_t min_buf_size, uint8_t **buf) {
+	size_t ret;
+
+	if (NULL == fo)
+		return (0);
+	pthread_rwlock_wrlock(&fo->rw_lock);
+	ret = r_buf_wbuf_get(fo->r_buf, min_buf_size, buf);
+	pthread_rwlock_unlock(&fo->rw_lock);
+
+	return (ret);
+}
+
+int
+r_buf_fo_wbuf_set(r_buf_fo_p fo, size_t offset, size_t buf_size,
+    uint32_t flags) {
+	int error;
+	r_buf_rpos_p rpos;
+
+	if (NULL == fo)
+		return (EINVAL);
+	pthread_rwlock_wrlock(&fo->rw_lock);
+	error = r_buf_wbuf_set(fo->r_buf, offset, buf_size);
+	if (0 == error) {
+		fo->stat.wr_size += (buf_size - offset);
+		fo->stat.wr_blocks ++;
+		if (0 != (R_BUF_FO_WR_F_SYNC & flags)) {
+			rpos = &fo->sync[fo->sync_idx];
+			rpos->iov_index = fo->r_buf->iov_index;
+			rpos->iov_off = 0;
+			rpos->round_num = fo->r_buf->round_num;
+			fo->sync_idx = ((fo->sync_idx + 1) % R_BUF_FO_SYNC_POINTS_MAX);
+			if (R_BUF_FO_SYNC_POINTS_MAX > fo->sync_count) {
+				fo->sync_count ++;
+			}
+		}
+	}
+	pthread_rwlock_unlock(&fo->rw_lock);
+	if (0 != error)
+		return (error);
+	r_buf_fo_wakeup(fo);
+
+	return (0);
+}
+
+int
+r_buf_fo_write(r_buf_fo_p fo, const uint8_t *buf, size_t buf_size,
+    uint32_t flags) {
+	uint8_t *wbuf = NULL;
+
+	if (NULL == fo || NULL == buf)
+		return (EINVAL);
+	if (r_buf_fo_wbuf_get(fo, buf_size, &wbuf) < buf_size ||
+	    NULL == wbuf)
+		return (ENOBUFS);
+	memcpy(wbuf, buf, buf_size);
+
+	return (r_buf_fo_wbuf_set(fo, 0, buf_size, flags));
+}
+
+
+int
+r_buf_fo_rdr_add(r_buf_fo_p fo, tpt_p tpt, uintptr_t skt,
+    r_buf_fo_rdr_cb cb_func, void *udata, r_buf_fo_rdr_p *rdr_ret) {
+	int error;
+	size_t i;
+	r_buf_fo_rdr_p rdr;
+
+	if (NULL == fo || NULL == tpt || (uintptr_t)-1 == skt ||
+	    NULL == cb_func || NULL == rdr_ret)
+		return (EINVAL);
+	i = tpt_get_num(tpt);
+	if (i >= fo->grps_count)
+		return (EINVAL);
+	rdr = calloc(1, sizeof(r_buf_fo_rdr_t));
+	if (NULL == rdr)
+		return (ENOMEM);
+	rdr->grp = &fo->grps[i];
+	rdr->cb_func = cb_func;
+	rdr->udata = udata;
+	pthread_rwlock_rdlock(&fo->rw_lock);
+	r_buf_fo_rpos_init(fo, &rdr->rpos);
+	pthread_rwlock_unlock(&fo->rw_lock);
+	/* Send precache on first socket ready event. */
+	error = tp_task_notify_create(tpt, skt, 0, TP_EV_WRITE,
+	    fo->s.snd_timeout, r_buf_fo_rdr_notify_cb, rdr, &rdr->tptask);
+	if (0 != error) {
+		free(rdr);
+		return (error);
+	}
+	rdr->flags |= R_BUF_FO_RDR_F_SND_WAIT;
+	TAILQ_INSERT_TAIL(&rdr->grp->rdrs, rdr, next);
+	MTX_LOCK(&fo->mtx);
+	rdr->grp->rdr_count ++;
+	fo->stat.rdr_count ++;
+	MTX_UNLOCK(&fo->mtx);
+
+	(*rdr_ret) = rdr;
+	return (0);
+}
+
+void
+r_buf_fo_rdr_free(r_buf_fo_rdr_p rdr) {
+	r_buf_fo_p fo;
+
+	if (NULL == rdr)
+		return;
+	fo = rdr->grp->fo;
+	tp_task_destroy(rdr->tptask);
+	TAILQ_REMOVE(&rdr->grp->rdrs, rdr, next);
+	MTX_LOCK(&fo->mtx);
+	rdr->grp->rdr_count --;
+	fo->stat.rdr_count --;
+	MTX_UNLOCK(&fo->mtx);
+	free(rdr);
+}
+
+int
+r_buf_fo_rdr_stat_get(r_buf_fo_rdr_p rdr, r_buf_fo_rdr_stat_p stat) {
+
+	if (NULL == rdr || NULL == stat)
+		return (EINVAL);
+	memcpy(stat, &rdr->stat, sizeof(r_buf_fo_rdr_stat_t));
+
+	return (0);
+}
+
+void *
+r_buf_fo_rdr_udata_get(r_buf_fo_rdr_p rdr) {
+
+	if (NULL == rdr)
+		return (NULL);
+	return (rdr->udata);
+}
@@ -39,10 +39,7 @@
 #define BASE64_SELF_TEST 1
 
 #include "utils/base64.h"
-
-
-#define LOG_INFO_FMT(fmt, args...)					\
-	    fprintf(stdout, fmt"\n", ##args)
+#include "../test_utils.h"
 
 
 int
@@ -0,0 +1,627 @@
+/*-
+ * Copyright (c) 2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * Crypto primitives benchmark: not a test, not run by ctest.
+ * bench_crypto [-j] [-q] [-f name]
+ *  -j - JSON output
+ *  -q - quick run: short measures
+ *  -f - run only algorithms / curves which name contain substring
+ * Hashes and ciphers: MB/s and cycles/byte per message size, each
+ * message processed from init to final; every supported implementation,
+ * "generic" is SIMD off.
+ * ECDSA: ecdsa_key_gen / sign / verify / dh ops/s per curve.
+ * Cycles are TSC ticks: not core clocks if frequency scaling is on.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* strcmp */
+#include <stdio.h> /* snprintf, fprintf */
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#	include <x86intrin.h> /* __rdtsc() */
+#	define BENCH_HAVE_TSC	1
+#endif
+
+#define BN_DIGIT_BIT_CNT 	64
+#define BN_BIT_LEN		1408
+#define BN_CC_MULL_DIV		1
+#define BN_NO_POINTERS_CHK	1
+#define BN_MOD_REDUCE_ALGO	BN_MOD_REDUCE_ALGO_BASIC
+#define EC_USE_PROJECTIVE	1
+#define EC_PROJ_REPEAT_DOUBLE	1
+#define EC_PROJ_ADD_MIX		1
+#define EC_USE_MONTGOMERY	1
+#define EC_PF_FXP_MULT_ALGO	EC_PF_FXP_MULT_ALGO_COMB_2T
+#define EC_PF_FXP_MULT_WIN_BITS	9
+#define EC_PF_UNKPT_MULT_ALGO	EC_PF_UNKPT_MULT_ALGO_COMB_1T
+#define EC_PF_UNKPT_MULT_WIN_BITS 2
+#define EC_PF_TWIN_MULT_ALGO	EC_PF_TWIN_MULT_ALGO_INTER
+#define EC_DISABLE_PUB_KEY_CHK	1
+
+#include "crypto/hash/md5.h"
+#include "crypto/hash/sha1.h"
+#include "crypto/hash/sha2.h"
+#include "crypto/hash/gost3411-2012.h"
+#include "crypto/cipher/chacha.h"
+#include "crypto/cipher/poly1305.h"
+#include "crypto/cipher/chacha20poly1305.h"
+#include "crypto/cipher/gost28147.h"
+#include "crypto/dsa/ecdsa.h"
+#include "../test_utils.h"
+
+
+#ifndef nitems /* SIZEOF() */
+#	define nitems(__val)	(sizeof(__val) / sizeof(__val[0]))
+#endif
+
+
+#define BENCH_TIME_NS		(200 * 1000000ull) /* Min time per measure. */
+#define BENCH_TIME_QUICK_NS	(20 * 1000000ull)
+#define BENCH_BUF_SIZE		(1024 * 1024)
+
+
+typedef struct bench_s {
+	int		json;
+	int		json_first;
+	uint64_t	time_ns;
+	const char	*filter;
+	uint8_t		*buf;
+	uint8_t		out[128]; /* Digest / tag: keep results alive. */
+} bench_t, *bench_p;
+
+typedef struct bench_res_s {
+	uint64_t	ops;
+	uint64_t	time_ns;
+	uint64_t	cycles;
+} bench_res_t, *bench_res_p;
+
+/* Process one message: init, update / crypt, final. */
+typedef void (*bench_data_cb)(bench_p bench, uint32_t impl, size_t bits,
+    size_t size);
+
+typedef struct bench_algo_s {
+	const char	*name;
+	bench_data_cb	cb;
+	size_t		bits;
+	size_t		impl_count;
+	const char	**impl_name;
+	int		(*impl_is_supported)(bench_p bench, uint32_t impl,
+			    size_t bits);
+} bench_algo_t, *bench_algo_p;
+
+
+static const size_t bench_sizes[] = {
+	16, 64, 256, 1024, 4096, 16384, 65536, (1024 * 1024)
+};
+
+
+static uint64_t
+cycles_get(void) {
+
+#ifdef BENCH_HAVE_TSC
+	return ((uint64_t)__rdtsc());
+#else
+	return (0);
+#endif
+}
+
+static int
+bench_filter_match(bench_p bench, const char *name) {
+
+	if (NULL == bench->filter)
+		return (1);
+	return ((NULL != strstr(name, bench->filter)));
+}
+
+/* Begin JSON record: separator from previous one. */
+static void
+bench_json_rec_begin(bench_p bench) {
+
+	fprintf(stdout, "%s\n    {", ((0 != bench->json_first) ? "" : ","));
+	bench->json_first = 0;
+}
+
+
+/* Hashes. */
+static void
+bench_md5(bench_p bench, uint32_t impl __unused, size_t bits __unused,
+    size_t size) {
+	md5_ctx_t ctx;
+
+	md5_init(&ctx);
+	md5_update(&ctx, bench->buf, size);
+	md5_final(&ctx, bench->out);
+}
+
+static void
+bench_sha1(bench_p bench, uint32_t impl, size_t bits __unused,
+    size_t size) {
+	sha1_ctx_t ctx;
+
+	sha1_init_impl(&ctx, impl);
+	sha1_update(&ctx, bench->buf, size);
+	sha1_final(&ctx, bench->out);
+}
+
+static int
+bench_sha1_is_supported(bench_p bench __unused, uint32_t impl,
+    size_t bits __unused) {
+
+	return (sha1_impl_is_supported(impl));
+}
+
+static void
+bench_sha2(bench_p bench, uint32_t impl, size_t bits, size_t size) {
+	sha2_ctx_t ctx;
+
+	if (0 != sha2_init_impl(bits, impl, &ctx))
+		return;
+	sha2_update(&ctx, bench->buf, size);
+	sha2_final(&ctx, bench->out);
+}
+
+static int
+bench_sha2_is_supported(bench_p bench __unused, uint32_t impl,
+    size_t bits) {
+	sha2_ctx_t ctx;
+
+	/* SHA-NI: 224/256 only, AVX2: 384/512 only. */
+	return ((0 == sha2_init_impl(bits, impl, &ctx)));
+}
+
+static void
+bench_gost3411_2012(bench_p bench, uint32_t impl, size_t bits,
+    size_t size) {
+	gost3411_2012_ctx_t ctx;
+
+	gost3411_2012_init_impl(bits, impl, &ctx);
+	gost3411_2012_update(&ctx, bench->buf, size);
+	gost3411_2012_final(&ctx, bench->out);
+}
+
+static int
+bench_gost3411_2012_is_supported(bench_p bench __unused, uint32_t impl,
+    size_t bits __unused) {
+
+	return (gost3411_2012_impl_is_supported(impl));
+}
+
+
+/* Ciphers: encrypt in place. */
+static void
+bench_chacha20(bench_p bench, uint32_t impl, size_t bits __unused,
+    size_t size) {
+	chacha_context_str_t ctx;
+
+	chacha_str_init(&ctx, bench->out, CHACHA_KEY_256_LEN, NULL,
+	    &bench->out[CHACHA_KEY_256_LEN], 20);
+	chacha_impl_set(&ctx.c, impl);
+	chacha_str_data_crypt(&ctx, bench->buf, size, bench->buf);
+	chacha_str_final(&ctx);
+}
+
+static int
+bench_chacha20_is_supported(bench_p bench __unused, uint32_t impl,
+    size_t bits __unused) {
+
+	return (chacha_impl_is_supported(impl));
+}
+
+static void
+bench_poly1305(bench_p bench, uint32_t impl __unused, size_t bits __unused,
+    size_t size) {
+
+	poly1305(bench->out, bench->buf, size,
+	    &bench->out[CHACHA_KEY_256_LEN]);
+}
+
+static void
+bench_chacha20_poly1305(bench_p bench, uint32_t impl __unused,
+    size_t bits __unused, size_t size) {
+
+	chacha20_poly1305_encrypt(bench->out, &bench->out[CHACHA_KEY_256_LEN],
+	    NULL, 0, bench->buf, size, bench->buf,
+	    &bench->out[(CHACHA_KEY_256_LEN + CHACHA20_POLY1305_NONCE_LEN)]);
+}
+
+/* bits: 0 - CTR, 1 - CFB encrypt, 2 - CFB decrypt. */
+static void
+bench_gost28147(bench_p bench, uint32_t impl, size_t bits, size_t size) {
+	gost28147_context_t ctx;
+	gost28147_ctr_t ctr;
+	gost28147_cfb_t cfb;
+
+	gost28147_init_be(bench->out, GOST28147_KEY_SIZE,
+	    id_tc26_gost_28147_param_z_sbox, &ctx);
+	gost28147_impl_set(&ctx, impl);
+	switch (bits) {
+	case 0:
+		gost28147_ctr_init(&ctr, &bench->out[GOST28147_KEY_SIZE]);
+		gost28147_ctr_crypt(&ctx, &ctr, bench->buf, size, bench->buf);
+		break;
+	case 1:
+		gost28147_cfb_init(&cfb, &bench->out[GOST28147_KEY_SIZE],
+		    GOST28147_BLK_SIZE);
+		gost28147_cfb_encrypt(&ctx, &cfb, bench->buf, size, bench->buf);
+		break;
+	default:
+		gost28147_cfb_init(&cfb, &bench->out[GOST28147_KEY_SIZE],
+		    GOST28147_BLK_SIZE);
+		gost28147_cfb_decrypt(&ctx, &cfb, bench->buf, size, bench->buf);
+		break;
+	}
+}
+
+static int
+bench_gost28147_is_supported(bench_p bench __unused, uint32_t impl,
+    size_t bits __unused) {
+
+	return (gost28147_impl_is_supported(impl));
+}
+
+
+static const char *bench_impl_generic[] = {
+	"generic"
+};
+static const char *bench_impl_sha1[] = {
+	"generic", "sse", "shani"
+};
+static const char *bench_impl_sha2[] = {
+	"generic", "shani", "avx2"
+};
+static const char *bench_impl_gost3411_2012[] = {
+	"generic", "sse4.1", "avx2"
+};
+static const char *bench_impl_chacha[] = {
+	"generic", "ssse3", "avx2", "avx512"
+};
+static const char *bench_impl_gost28147[] = {
+	"generic", "avx2"
+};
+
+static const bench_algo_t bench_hashes[] = {
+	{ "md5",		bench_md5,		0,
+	    nitems(bench_impl_generic),	bench_impl_generic,	NULL },
+	{ "sha1",		bench_sha1,		0,
+	    nitems(bench_impl_sha1),	bench_impl_sha1,
+	    bench_sha1_is_supported },
+	{ "sha2-224",		bench_sha2,		224,
+	    nitems(bench_impl_sha2),	bench_impl_sha2,
+	    bench_sha2_is_supported },
+	{ "sha2-256",		bench_sha2,		256,
+	    nitems(bench_impl_sha2),	bench_impl_sha2,
+	    bench_sha2_is_supported },
+	{ "sha2-384",		bench_sha2,		384,
+	    nitems(bench_impl_sha2),	bench_impl_sha2,
+	    bench_sha2_is_supported },
+	{ "sha2-512",		bench_sha2,		512,
+	    nitems(bench_impl_sha2),	bench_impl_sha2,
+	    bench_sha2_is_supported },
+	{ "gost3411-2012-256",	bench_gost3411_2012,	256,
+	    nitems(bench_impl_gost3411_2012), bench_impl_gost3411_2012,
+	    bench_gost3411_2012_is_supported },
+	{ "gost3411-2012-512",	bench_gost3411_2012,	512,
+	    nitems(bench_impl_gost3411_2012), bench_impl_gost3411_2012,
+	    bench_gost3411_2012_is_supported },
+};
+
+static const bench_algo_t bench_ciphers[] = {
+	{ "chacha20",		bench_chacha20,		0,
+	    nitems(bench_impl_chacha),	bench_impl_chacha,
+	    bench_chacha20_is_supported },
+	{ "poly1305",		bench_poly1305,		0,
+	    nitems(bench_impl_generic),	bench_impl_generic,	NULL },
+	{ "chacha20-poly1305",	bench_chacha20_poly1305, 0,
+	    nitems(bench_impl_generic),	bench_impl_generic,	NULL },
+	{ "gost28147-ctr",	bench_gost28147,	0,
+	    nitems(bench_impl_gost28147), bench_impl_gost28147,
+	    bench_gost28147_is_supported },
+	{ "gost28147-cfb-enc",	bench_gost28147,	1,
+	    nitems(bench_impl_gost28147), bench_impl_gost28147,
+	    bench_gost28147_is_supported },
+	{ "gost28147-cfb-dec",	bench_gost28147,	2,
+	    nitems(bench_impl_gost28147), bench_impl_gost28147,
+	    bench_gost28147_is_supported },
+};
+
+
+/* Run cb until bench->time_ns elapsed, iterations count doubles. */
+static void
+bench_data_run(bench_p bench, const bench_algo_t *algo, uint32_t impl,
+    size_t size, bench_res_p res) {
+	uint64_t n, iters, tm, cycles;
+
+	algo->cb(bench, impl, algo->bits, size); /* Warm up. */
+	for (iters = 1;; iters *= 2) {
+		tm = time_ns_get();
+		cycles = cycles_get();
+		for (n = 0; n < iters; n ++) {
+			algo->cb(bench, impl, algo->bits, size);
+		}
+		cycles = (cycles_get() - cycles);
+		tm = (time_ns_get() - tm);
+		if (tm >= bench->time_ns)
+			break;
+	}
+	res->ops = iters;
+	res->time_ns = MAX(1, tm);
+	res->cycles = cycles;
+}
+
+static void
+bench_data_report(bench_p bench, const char *group, const char *name,
+    const char *impl_name, int simd, size_t size, bench_res_p res) {
+	double mb_s, cycles_byte;
+
+	mb_s = (((double)(res->ops * size) * 1000.0) / (double)res->time_ns);
+	cycles_byte = ((double)res->cycles / (double)(res->ops * size));
+	if (0 == bench->json) {
+		LOG_INFO_FMT("  %-20s %-8s %8zu: %10.2f MB/s %10.2f c/B",
+		    name, impl_name, size, mb_s, cycles_byte);
+		return;
+	}
+	bench_json_rec_begin(bench);
+	fprintf(stdout, "\"group\": \"%s\", \"name\": \"%s\", "
+	    "\"impl\": \"%s\", \"simd\": %s, \"size\": %zu, "
+	    "\"mb_s\": %.2f, \"cycles_byte\": %.3f}",
+	    group, name, impl_name, ((0 != simd) ? "true" : "false"),
+	    size, mb_s, cycles_byte);
+}
+
+static void
+bench_data(bench_p bench, const char *group, const bench_algo_t *algos,
+    size_t algos_count) {
+	size_t i, k;
+	uint32_t impl;
+	bench_res_t res;
+	const bench_algo_t *algo;
+
+	for (i = 0; i < algos_count; i ++) {
+		algo = &algos[i];
+		if (0 == bench_filter_match(bench, algo->name))
+			continue;
+		for (impl = 0; impl < algo->impl_count; impl ++) {
+			if (NULL != algo->impl_is_supported &&
+			    0 == algo->impl_is_supported(bench, impl,
+			    algo->bits))
+				continue;
+			for (k = 0; k < nitems(bench_sizes); k ++) {
+				bench_data_run(bench, algo, impl,
+				    bench_sizes[k], &res);
+				bench_data_report(bench, group, algo->name,
+				    algo->impl_name[impl], (0 != impl),
+				    bench_sizes[k], &res);
+			}
+		}
+	}
+}
+
+
+/* ECDSA. */
+#define BENCH_ECDSA_OP_KEY_GEN	0
+#define BENCH_ECDSA_OP_SIGN	1
+#define BENCH_ECDSA_OP_VERIFY	2
+#define BENCH_ECDSA_OP_DH	3
+#define BENCH_ECDSA_OP_COUNT	4
+
+static const char *bench_ecdsa_op_name[] = {
+	"key_gen", "sign", "verify", "dh"
+};
+
+typedef struct bench_ecdsa_s {
+	ec_curve_t	curve;
+	bn_t		rnd;	/* Private key source. */
+	bn_t		d;	/* Private key. */
+	bn_t		k;	/* Sign random. */
+	bn_t		hash;
+	bn_t		r;
+	bn_t		s;
+	bn_t		tm;
+	ec_point_t	Q;	/* Pub key. */
+} bench_ecdsa_t, *bench_ecdsa_p;
+
+static int
+bench_ecdsa_op(bench_ecdsa_p ecb, uint32_t op) {
+	int error;
+
+	switch (op) {
+	case BENCH_ECDSA_OP_KEY_GEN:
+		BN_RET_ON_ERR(bn_assign(&ecb->tm, &ecb->rnd));
+		error = ecdsa_key_gen(&ecb->curve, &ecb->tm, &ecb->Q);
+		break;
+	case BENCH_ECDSA_OP_SIGN:
+		BN_RET_ON_ERR(bn_assign(&ecb->tm, &ecb->k));
+		error = ecdsa_sign(&ecb->curve, &ecb->hash, &ecb->d, &ecb->tm,
+		    &ecb->r, &ecb->s);
+		break;
+	case BENCH_ECDSA_OP_VERIFY:
+		error = ecdsa_verify(&ecb->curve, &ecb->hash, &ecb->r,
+		    &ecb->s, &ecb->Q);
+		break;
+	case BENCH_ECDSA_OP_DH:
+		error = ecdsa_dh(&ecb->curve, 0, &ecb->Q, &ecb->d, &ecb->tm);
+		break;
+	default:
+		error = EINVAL;
+		break;
+	}
+	return (error);
+}
+
+static int
+bench_ecdsa_curve(bench_p bench, ec_curve_str_p curve_str,
+    bench_ecdsa_p ecb) {
+	size_t i, bits, bytes;
+	uint32_t op;
+	uint64_t n, iters, tm;
+	double ops_s;
+
+	BN_RET_ON_ERR(ecdsa_curve_from_str(curve_str, &ecb->curve));
+	bits = EC_CURVE_CALC_BITS_DBL(&ecb->curve);
+	bytes = EC_CURVE_CALC_BYTES(&ecb->curve);
+	BN_RET_ON_ERR(bn_init(&ecb->rnd, bits));
+	BN_RET_ON_ERR(bn_init(&ecb->d, bits));
+	BN_RET_ON_ERR(bn_init(&ecb->k, bits));
+	BN_RET_ON_ERR(bn_init(&ecb->hash, bits));
+	BN_RET_ON_ERR(bn_init(&ecb->r, bits));
+	BN_RET_ON_ERR(bn_init(&ecb->s, bits));
+	BN_RET_ON_ERR(bn_init(&ecb->tm, bits));
+	BN_RET_ON_ERR(ec_point_init(&ecb->Q, bits));
+	for (i = 0; i < (3 * bytes); i ++) {
+		bench->buf[i] = (uint8_t)((i * 131) + 7);
+	}
+	BN_RET_ON_ERR(bn_import_be_bin(&ecb->rnd, bench->buf, bytes));
+	BN_RET_ON_ERR(bn_import_be_bin(&ecb->k, &bench->buf[bytes], bytes));
+	BN_RET_ON_ERR(bn_import_be_bin(&ecb->hash, &bench->buf[(2 * bytes)],
+	    bytes));
+	BN_RET_ON_ERR(bn_mod_reduce(&ecb->k, &ecb->curve.n,
+	    &ecb->curve.n_mod_rd_data));
+	BN_RET_ON_ERR(bn_assign(&ecb->d, &ecb->rnd));
+	BN_RET_ON_ERR(ecdsa_key_gen(&ecb->curve, &ecb->d, &ecb->Q));
+	BN_RET_ON_ERR(ecdsa_sign(&ecb->curve, &ecb->hash, &ecb->d, &ecb->k,
+	    &ecb->r, &ecb->s));
+
+	if (0 == bench->json) {
+		fprintf(stdout, "  %-40s", curve_str->name);
+	}
+	for (op = 0; op < BENCH_ECDSA_OP_COUNT; op ++) {
+		for (iters = 1;; iters *= 2) {
+			tm = time_ns_get();
+			for (n = 0; n < iters; n ++) {
+				BN_RET_ON_ERR(bench_ecdsa_op(ecb, op));
+			}
+			tm = (time_ns_get() - tm);
+			if (tm >= bench->time_ns)
+				break;
+		}
+		ops_s = (((double)iters * 1000000000.0) / (double)MAX(1, tm));
+		if (0 == bench->json) {
+			fprintf(stdout, " %s: %9.1f", bench_ecdsa_op_name[op],
+			    ops_s);
+			continue;
+		}
+		bench_json_rec_begin(bench);
+		fprintf(stdout, "\"group\": \"ecdsa\", \"name\": \"%s\", "
+		    "\"op\": \"%s\", \"bits\": %zu, \"ops_s\": %.1f}",
+		    curve_str->name, bench_ecdsa_op_name[op],
+		    (size_t)curve_str->m, ops_s);
+	}
+	if (0 == bench->json) {
+		fprintf(stdout, "\n");
+	}
+	return (0);
+}
+
+static int
+bench_ecdsa(bench_p bench) {
+	int error;
+	size_t i;
+	bench_ecdsa_p ecb;
+
+	ecb = malloc(sizeof(bench_ecdsa_t)); /* Curve tables are big. */
+	if (NULL == ecb)
+		return (ENOMEM);
+	for (i = 0; i < nitems(ec_curve_str); i ++) {
+		if (0 == bench_filter_match(bench, ec_curve_str[i].name))
+			continue;
+		error = bench_ecdsa_curve(bench, &ec_curve_str[i], ecb);
+		if (0 != error) {
+			fprintf(stderr, "%s: err: %i\n", ec_curve_str[i].name,
+			    error);
+			free(ecb);
+			return (error);
+		}
+	}
+	free(ecb);
+
+	return (0);
+}
+
+
+int
+main(int argc, char *argv[]) {
+	int error, i;
+	bench_t bench;
+
+	memset(&bench, 0x00, sizeof(bench));
+	bench.json_first = 1;
+	bench.time_ns = BENCH_TIME_NS;
+	for (i = 1; i < argc; i ++) {
+		if (0 == strcmp(argv[i], "-j")) {
+			bench.json = 1;
+		} else if (0 == strcmp(argv[i], "-q")) {
+			bench.time_ns = BENCH_TIME_QUICK_NS;
+		} else if (0 == strcmp(argv[i], "-f") && (i + 1) < argc) {
+			i ++;
+			bench.filter = argv[i];
+		} else {
+			fprintf(stderr, "usage: %s [-j] [-q] [-f name]\n",
+			    argv[0]);
+			return (EINVAL);
+		}
+	}
+	bench.buf = malloc(BENCH_BUF_SIZE);
+	if (NULL == bench.buf)
+		return (ENOMEM);
+	memset(bench.buf, 0x5a, BENCH_BUF_SIZE);
+	memset(bench.out, 0xa5, sizeof(bench.out));
+
+	if (0 != bench.json) {
+		fprintf(stdout, "{\n  \"bench_crypto\": 1,\n"
+		    "  \"tsc\": %s,\n  \"results\": [",
+#ifdef BENCH_HAVE_TSC
+		    "true"
+#else
+		    "false"
+#endif
+		    );
+	} else {
+		LOG_INFO_FMT("hashes, MB/s, cycles/byte:");
+	}
+	bench_data(&bench, "hash", bench_hashes, nitems(bench_hashes));
+	if (0 == bench.json) {
+		LOG_INFO_FMT("ciphers, MB/s, cycles/byte:");
+	}
+	bench_data(&bench, "cipher", bench_ciphers, nitems(bench_ciphers));
+	if (0 == bench.json) {
+		LOG_INFO_FMT("ecdsa, ops/s:");
+	}
+	error = bench_ecdsa(&bench);
+	if (0 != bench.json) {
+		fprintf(stdout, "\n  ]\n}\n");
+	}
+	free(bench.buf);
+
+	return (error);
+}
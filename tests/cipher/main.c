@@ -0,0 +1,202 @@
+/*-
+ * Copyright (c) 2016-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* strcmp */
+#include <stdio.h> /* snprintf, fprintf */
+#include <time.h>
+
+
+#define CHACHA_SELF_TEST 1
+#define POLY1305_SELF_TEST 1
+#define CHACHA20_POLY1305_SELF_TEST 1
+#define GOST28147_SELF_TEST 1
+
+#include "crypto/cipher/chacha.h"
+#include "crypto/cipher/poly1305.h"
+#include "crypto/cipher/chacha20poly1305.h"
+#include "crypto/cipher/gost28147.h"
+#include "../test_utils.h"
+
+
+#ifndef nitems /* SIZEOF() */
+#	define nitems(__val)	(sizeof(__val) / sizeof(__val[0]))
+#endif
+
+
+#define BENCH_DATA_TOTAL	(256 * 1024 * 1024) /* Bytes per measure. */
+
+
+static int
+cipher_bench(void) {
+	uint8_t *buf, key[CHACHA_KEY_256_LEN], iv[CHACHA20_POLY1305_NONCE_LEN];
+	uint8_t tag[CHACHA20_POLY1305_TAG_LEN];
+	uint64_t tm;
+	size_t i, k, n, iters;
+	uint32_t impl;
+	chacha_context_str_t ctx;
+	gost28147_context_t gctx;
+	gost28147_ctr_t gctr;
+	gost28147_cfb_t gcfb;
+	const char *impl_name[] = {
+		"generic", "ssse3 x4", "avx2 x8", "avx512 x16"
+	};
+	const char *gimpl_name[] = {
+		"generic x4", "avx2 x16"
+	};
+	const size_t sizes[] = {
+		64, 256, 1024, 16384, (1024 * 1024)
+	};
+
+	buf = malloc(sizes[(nitems(sizes) - 1)]);
+	if (NULL == buf)
+		return (ENOMEM);
+	for (i = 0; i < sizes[(nitems(sizes) - 1)]; i ++) {
+		buf[i] = (uint8_t)(i * 131);
+	}
+	memset(key, 0x55, sizeof(key));
+	memset(iv, 0xaa, sizeof(iv));
+	LOG_INFO_FMT("chacha20, MB/s:");
+	for (impl = CHACHA_IMPL_GENERIC; impl <= CHACHA_IMPL_AVX512; impl ++) {
+		if (0 == chacha_impl_is_supported(impl))
+			continue;
+		fprintf(stdout, "  %-10s", impl_name[impl]);
+		for (k = 0; k < nitems(sizes); k ++) {
+			iters = MAX(1, (BENCH_DATA_TOTAL / sizes[k]));
+			chacha_str_init(&ctx, key, sizeof(key), NULL, iv, 20);
+			chacha_impl_set(&ctx.c, impl);
+			tm = time_ns_get();
+			for (n = 0; n < iters; n ++) {
+				chacha_str_data_crypt(&ctx, buf, sizes[k], buf);
+			}
+			tm = MAX(1, (time_ns_get() - tm));
+			chacha_str_final(&ctx);
+			fprintf(stdout, " %7zu: %5"PRIu64, sizes[k],
+			    (((uint64_t)(iters * sizes[k]) * 1000) / tm));
+		}
+		fprintf(stdout, "\n");
+	}
+	LOG_INFO_FMT("poly1305 / chacha20-poly1305 (auto), MB/s:");
+	for (k = 0; k < nitems(sizes); k ++) {
+		iters = MAX(1, (BENCH_DATA_TOTAL / 4 / sizes[k]));
+		tm = time_ns_get();
+		for (n = 0; n < iters; n ++) {
+			poly1305(key, buf, sizes[k], tag);
+		}
+		tm = MAX(1, (time_ns_get() - tm));
+		fprintf(stdout, "  %7zu: %5"PRIu64, sizes[k],
+		    (((uint64_t)(iters * sizes[k]) * 1000) / tm));
+		tm = time_ns_get();
+		for (n = 0; n < iters; n ++) {
+			chacha20_poly1305_encrypt(key, iv, tag, sizeof(tag),
+			    buf, sizes[k], buf, tag);
+		}
+		tm = MAX(1, (time_ns_get() - tm));
+		fprintf(stdout, " / %5"PRIu64"\n",
+		    (((uint64_t)(iters * sizes[k]) * 1000) / tm));
+	}
+	LOG_INFO_FMT("gost28147 ctr / cfb decrypt / cfb encrypt, MB/s:");
+	for (impl = GOST28147_IMPL_GENERIC; impl <= GOST28147_IMPL_AVX2; impl ++) {
+		if (0 == gost28147_impl_is_supported(impl))
+			continue;
+		gost28147_init_be(key, sizeof(key),
+		    id_tc26_gost_28147_param_z_sbox, &gctx);
+		gost28147_impl_set(&gctx, impl);
+		LOG_INFO_FMT("  %s", gimpl_name[impl]);
+		for (k = 0; k < nitems(sizes); k ++) {
+			iters = MAX(1, (BENCH_DATA_TOTAL / 16 / sizes[k]));
+			tm = time_ns_get();
+			for (n = 0; n < iters; n ++) {
+				gost28147_ctr_init(&gctr, iv);
+				gost28147_ctr_crypt(&gctx, &gctr, buf, sizes[k], buf);
+			}
+			tm = MAX(1, (time_ns_get() - tm));
+			fprintf(stdout, "  %7zu: %5"PRIu64, sizes[k],
+			    (((uint64_t)(iters * sizes[k]) * 1000) / tm));
+			tm = time_ns_get();
+			for (n = 0; n < iters; n ++) {
+				gost28147_cfb_init(&gcfb, iv, GOST28147_BLK_SIZE);
+				gost28147_cfb_decrypt(&gctx, &gcfb, buf, sizes[k], buf);
+			}
+			tm = MAX(1, (time_ns_get() - tm));
+			fprintf(stdout, " / %5"PRIu64,
+			    (((uint64_t)(iters * sizes[k]) * 1000) / tm));
+			tm = time_ns_get();
+			for (n = 0; n < iters; n ++) {
+				gost28147_cfb_init(&gcfb, iv, GOST28147_BLK_SIZE);
+				gost28147_cfb_encrypt(&gctx, &gcfb, buf, sizes[k], buf);
+			}
+			tm = MAX(1, (time_ns_get() - tm));
+			fprintf(stdout, " / %5"PRIu64"\n",
+			    (((uint64_t)(iters * sizes[k]) * 1000) / tm));
+		}
+	}
+	free(buf);
+
+	return (0);
+}
+
+
+int
+main(int argc, char *argv[]) {
+	int error;
+
+	error = chacha_self_test();
+	if (0 != error) {
+		LOG_INFO_FMT("chacha_self_test(): err: %i", error);
+		return (error);
+	}
+
+	error = poly1305_self_test();
+	if (0 != error) {
+		LOG_INFO_FMT("poly1305_self_test(): err: %i", error);
+		return (error);
+	}
+
+	error = chacha20_poly1305_self_test();
+	if (0 != error) {
+		LOG_INFO_FMT("chacha20_poly1305_self_test(): err: %i", error);
+		return (error);
+	}
+
+	error = gost28147_self_test();
+	if (0 != error) {
+		LOG_INFO_FMT("gost28147_self_test(): err: %i", error);
+		return (error);
+	}
+	if (1 < argc && 0 == strcmp(argv[1], "-b")) {
+		error = cipher_bench();
+	}
+
+	return (0);
+}
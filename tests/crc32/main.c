@@ -0,0 +1,122 @@
+/*-
+ * Copyright (c) 2016-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* strcmp */
+#include <stdio.h> /* snprintf, fprintf */
+#include <time.h>
+
+
+#define CRC32_SELF_TEST 1
+
+#include "math/crc32.h"
+#include "../test_utils.h"
+
+
+#define BENCH_DATA_SIZE_MAX	(1024 * 1024)
+#define BENCH_DATA_TOTAL	(256 * 1024 * 1024) /* Bytes per measure. */
+
+
+/* Compare all available implementations across buffer sizes. */
+static int
+crc32_bench(void) {
+	uint8_t *buf;
+	uint32_t crc = 0;
+	uint64_t tm;
+	size_t i, j, k, iters;
+	const char *impl_name[] = {
+		"table", "slice16", "clmul", "hw"
+	};
+	const struct {
+		const char	*name;
+		crc32_ctx_p	ctx;
+	} crcs[] = {
+		{ "crc32/mpeg2 (0x04c11db7)",	&crc32_ctx_04c11db7 },
+		{ "crc32b (0xedb88320)",	&crc32_ctx_edb88320 },
+		{ "crc32c (0x1edc6f41)",	&crc32_ctx_1edc6f41 },
+		{ "crc32d (0xa833982b)",	&crc32_ctx_a833982b },
+		{ "crc32q (0x814141ab)",	&crc32_ctx_814141ab }
+	};
+	const size_t sizes[] = {
+		16, 64, 188, 256, 1024, 4096, 65536, BENCH_DATA_SIZE_MAX
+	};
+
+	buf = malloc(BENCH_DATA_SIZE_MAX);
+	if (NULL == buf)
+		return (ENOMEM);
+	for (i = 0; i < BENCH_DATA_SIZE_MAX; i ++) {
+		buf[i] = (uint8_t)(i * 131);
+	}
+	for (i = 0; i < nitems(crcs); i ++) {
+		LOG_INFO_FMT("%s, MB/s:", crcs[i].name);
+		for (j = 0; j < nitems(impl_name); j ++) {
+			if (0 == crc32_ctx_impl_is_supported(crcs[i].ctx, (uint32_t)j))
+				continue;
+			fprintf(stdout, "  %-8s", impl_name[j]);
+			for (k = 0; k < nitems(sizes); k ++) {
+				iters = (BENCH_DATA_TOTAL / 16 / sizes[k]);
+				tm = time_ns_get();
+				for (size_t n = 0; n < iters; n ++) {
+					crc = crc32_ctx_update_impl(crcs[i].ctx,
+					    (uint32_t)j, crc, buf, sizes[k]);
+				}
+				tm = (time_ns_get() - tm);
+				fprintf(stdout, " %7zu: %6"PRIu64, sizes[k],
+				    (((uint64_t)(iters * sizes[k]) * 1000) /
+				    MAX(1, tm)));
+			}
+			fprintf(stdout, "\n");
+		}
+	}
+	free(buf);
+	LOG_INFO_FMT("(%08x)", crc);
+
+	return (0);
+}
+
+
+int
+main(int argc, char *argv[]) {
+	int error;
+
+	error = crc32_self_test();
+	if (0 != error) {
+		LOG_INFO_FMT("crc32_self_test(): err: %i", error);
+		return (error);
+	}
+	if (1 < argc && 0 == strcmp(argv[1], "-b")) {
+		error = crc32_bench();
+	}
+
+	return (error);
+}
@@ -35,6 +35,7 @@
 #include <stdio.h> /* snprintf, fprintf */
 #include <unistd.h> /* close, write, sysconf */
 #include <string.h> /* memcpy, memmove, memset, strerror... */
+#include <time.h>
 #include <errno.h>
 
 
@@ -47,6 +48,7 @@
 #define EC_USE_PROJECTIVE	1
 #define EC_PROJ_REPEAT_DOUBLE	1
 #define EC_PROJ_ADD_MIX		1
+#define EC_USE_MONTGOMERY	1
 #define EC_PF_FXP_MULT_ALGO	EC_PF_FXP_MULT_ALGO_COMB_2T
 #define EC_PF_FXP_MULT_WIN_BITS	9
 #define EC_PF_UNKPT_MULT_ALGO	EC_PF_UNKPT_MULT_ALGO_COMB_1T
@@ -56,10 +58,100 @@
 #define EC_SELF_TEST		1
 
 #include "crypto/dsa/ecdsa.h"
+#include "../test_utils.h"
 
 
-#define LOG_INFO_FMT(fmt, args...)					\
-	    fprintf(stdout, fmt"\n", ##args)
+/* Timing test run only with -t: wall clock based, noisy on loaded hosts. */
+#define CT_SAMPLES	1024 /* Both classes, after warm up. */
+#define CT_WARM_UP	32
+#define CT_CROP_PCT	90 /* Drop slowest samples: interrupts, migrations. */
+#define CT_T_MAX	10 /* |t| above: run time depends on scalar. */
+
+
+static ec_curve_t ct_curve;
+static uint64_t ct_time[(CT_WARM_UP + CT_SAMPLES)];
+static uint8_t ct_class[(CT_WARM_UP + CT_SAMPLES)];
+static uint64_t rnd_state = 0x2545f4914f6cdd1dull;
+
+
+static uint64_t
+rnd_get(void) { /* xorshift64* */
+
+	rnd_state ^= (rnd_state >> 12);
+	rnd_state ^= (rnd_state << 25);
+	rnd_state ^= (rnd_state >> 27);
+	return (rnd_state * 0x2545f4914f6cdd1dull);
+}
+
+static int
+u64_cmp(const void *a, const void *b) {
+
+	if ((*(const uint64_t*)a) == (*(const uint64_t*)b))
+		return (0);
+	return (((*(const uint64_t*)a) < (*(const uint64_t*)b)) ? -1 : 1);
+}
+
+/* dudect style check of ec_point_proj_ct_mult() with base point tables:
+ * Welch's t-test on run time, class 0 - fixed scalar n - 2 (recoded sum
+ * hits doubling and infinity cases), class 1 - random scalars < n.
+ * Classes interleaved at random to cancel frequency drift. */
+static int
+test_ct_mult_timing(const char *name) {
+	size_t i, j, cls, cnt[2];
+	uint64_t tm, cutoff, srt[CT_SAMPLES];
+	double mean[2], m2[2], delta, var;
+	bn_t d[2];
+	ec_point_proj_t res;
+
+	TEST_CHK(0 == ecdsa_curve_from_str(ecdsa_curve_str_get_by_name(name,
+	    strlen(name)), &ct_curve));
+	TEST_CHK(0 == bn_init(&d[0], ct_curve.m));
+	TEST_CHK(0 == bn_init(&d[1], ct_curve.m));
+	TEST_CHK(0 == bn_assign(&d[0], &ct_curve.n));
+	bn_sub_digit(&d[0], 2, NULL);
+	for (i = 0; i < (CT_WARM_UP + CT_SAMPLES); i ++) {
+		cls = (rnd_get() >> 63);
+		if (1 == cls) { /* Random d < 2^(bits(n) - 1) < n. */
+			TEST_CHK(0 == bn_assign(&d[1], &ct_curve.n));
+			for (j = 0; j < d[1].digits; j ++) {
+				d[1].num[j] = (bn_digit_t)rnd_get();
+			}
+			bn_bit_set(&d[1], (bn_calc_bits(&ct_curve.n) - 1), 0);
+			bn_update(&d[1]);
+		}
+		tm = time_ns_get();
+		TEST_CHK(0 == ec_point_proj_ct_mult(ct_curve.G_ct_tbl,
+		    EC_CT_MULT_BP_WIN_BITS, EC_CT_MULT_BP_TBL_CNT, &d[cls],
+		    &ct_curve, &res));
+		ct_time[i] = (time_ns_get() - tm);
+		ct_class[i] = (uint8_t)cls;
+	}
+	memcpy(srt, &ct_time[CT_WARM_UP], sizeof(srt));
+	qsort(srt, CT_SAMPLES, sizeof(uint64_t), u64_cmp);
+	cutoff = srt[((CT_SAMPLES * CT_CROP_PCT) / 100)];
+	/* Welford mean and variance per class. */
+	memset(cnt, 0x00, sizeof(cnt));
+	memset(mean, 0x00, sizeof(mean));
+	memset(m2, 0x00, sizeof(m2));
+	for (i = CT_WARM_UP; i < (CT_WARM_UP + CT_SAMPLES); i ++) {
+		if (ct_time[i] > cutoff)
+			continue;
+		cls = ct_class[i];
+		cnt[cls] ++;
+		delta = (((double)ct_time[i]) - mean[cls]);
+		mean[cls] += (delta / (double)cnt[cls]);
+		m2[cls] += (delta * (((double)ct_time[i]) - mean[cls]));
+	}
+	TEST_CHK(2 < cnt[0] && 2 < cnt[1]);
+	/* t^2 = (mean0 - mean1)^2 / (var0 / cnt0 + var1 / cnt1) */
+	delta = (mean[0] - mean[1]);
+	var = ((m2[0] / (double)((cnt[0] - 1) * cnt[0])) +
+	    (m2[1] / (double)((cnt[1] - 1) * cnt[1])));
+	LOG_INFO_FMT("%s: ct mult: %.0f / %.0f ns, t^2 = %.2f", name,
+	    mean[0], mean[1], ((0.0 < var) ? ((delta * delta) / var) : 0.0));
+	TEST_CHK((delta * delta) <= (var * (CT_T_MAX * CT_T_MAX)));
+	return (0);
+}
 
 
 int
@@ -78,5 +170,21 @@ main(int argc, char *argv[]) {
 		return (error);
 	}
 
+	if (1 < argc && 0 == strcmp(argv[1], "-t")) {
+		/* Solinas and Montgomery field. */
+		error = test_ct_mult_timing("secp256r1");
+		if (0 != error) {
+			LOG_INFO_FMT("test_ct_mult_timing(secp256r1): err: %i",
+			    error);
+			return (error);
+		}
+		error = test_ct_mult_timing("brainpoolP256r1");
+		if (0 != error) {
+			LOG_INFO_FMT("test_ct_mult_timing(brainpoolP256r1): err: %i",
+			    error);
+			return (error);
+		}
+	}
+
 	return (0);
 }
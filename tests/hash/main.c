@@ -30,24 +30,171 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* strcmp */
 #include <stdio.h> /* snprintf, fprintf */
+#include <time.h>
 
 
-#undef __SSE2__
-
 #define MD5_SELF_TEST 1
 #define SHA1_SELF_TEST 1
 #define SHA2_SELF_TEST 1
 #define GOST3411_2012_SELF_TEST 1
+#define HASH_MB_SELF_TEST 1
 
 #include "crypto/hash/md5.h"
 #include "crypto/hash/sha1.h"
 #include "crypto/hash/sha2.h"
 #include "crypto/hash/gost3411-2012.h"
+#include "crypto/hash/hash_mb.h"
+#include "../test_utils.h"
+
+
+#define BENCH_JOBS		4096
+#define BENCH_DATA_TOTAL	(64 * 1024 * 1024) /* Bytes per measure. */
+
+
+/* Multi-buffer vs single stream for short messages. */
+static int
+hash_mb_bench(void) {
+	uint8_t *buf, *digests;
+	uint64_t tm;
+	size_t i, k, n, iters;
+	uint32_t algo, impl;
+	hash_mb_job_t *jobs;
+	const char *algo_name[] = {
+		"md5", "sha1", "sha2-224", "sha2-256"
+	};
+	const char *impl_name[] = {
+		"single", "x4", "x8 avx2", "x16 avx512"
+	};
+	const size_t sizes[] = {
+		16, 32, 64, 128, 256, 1024, 4096
+	};
+
+	buf = malloc((BENCH_JOBS + sizes[(nitems(sizes) - 1)]));
+	digests = malloc((BENCH_JOBS * SHA2_256_HASH_SIZE));
+	jobs = malloc((BENCH_JOBS * sizeof(hash_mb_job_t)));
+	if (NULL == buf || NULL == digests || NULL == jobs) {
+		free(buf);
+		free(digests);
+		free(jobs);
+		return (ENOMEM);
+	}
+	for (i = 0; i < (BENCH_JOBS + sizes[(nitems(sizes) - 1)]); i ++) {
+		buf[i] = (uint8_t)(i * 131);
+	}
+	for (algo = 0; algo < HASH_MB_ALGO_COUNT; algo ++) {
+		LOG_INFO_FMT("%s, %i messages per call, MB/s (Mhash/s):",
+		    algo_name[algo], BENCH_JOBS);
+		for (impl = 0; impl < HASH_MB_IMPL_COUNT; impl ++) {
+			if (0 == hash_mb_impl_is_supported(impl))
+				continue;
+			fprintf(stdout, "  %-10s", impl_name[impl]);
+			for (k = 0; k < nitems(sizes); k ++) {
+				for (i = 0; i < BENCH_JOBS; i ++) {
+					jobs[i].data = &buf[i];
+					jobs[i].data_size = sizes[k];
+					jobs[i].digest = &digests[(i * SHA2_256_HASH_SIZE)];
+				}
+				iters = MAX(1, (BENCH_DATA_TOTAL / BENCH_JOBS / sizes[k]));
+				tm = time_ns_get();
+				for (n = 0; n < iters; n ++) {
+					hash_mb_digest_impl(algo, impl, jobs, BENCH_JOBS);
+				}
+				tm = MAX(1, (time_ns_get() - tm));
+				fprintf(stdout, " %5zu: %5"PRIu64" (%5.2f)", sizes[k],
+				    (((uint64_t)(iters * BENCH_JOBS * sizes[k]) * 1000) / tm),
+				    (((double)(iters * BENCH_JOBS) * 1000.0) / (double)tm));
+			}
+			fprintf(stdout, "\n");
+		}
+	}
+	free(buf);
+	free(digests);
+	free(jobs);
+
+	return (0);
+}
+
+/* Single stream, each supported transform. */
+static int
+hash_impl_bench(void) {
+	uint8_t *buf, digest[SHA2_HASH_MAX_SIZE];
+	uint64_t tm;
+	size_t n, iters;
+	uint32_t impl;
+	sha1_ctx_t sha1_ctx;
+	sha2_ctx_t sha2_ctx;
+	gost3411_2012_ctx_t gost_ctx;
+	const size_t buf_size = (1024 * 1024);
+	const char *impl_name[] = {
+		"generic", "simd 1", "simd 2"
+	};
 
+	buf = malloc(buf_size);
+	if (NULL == buf)
+		return (ENOMEM);
+	for (n = 0; n < buf_size; n ++) {
+		buf[n] = (uint8_t)(n * 131);
+	}
+	iters = MAX(1, (BENCH_DATA_TOTAL / buf_size));
+	LOG_INFO_FMT("single stream, %zu bytes messages, MB/s:", buf_size);
+	for (impl = 0; impl < 3; impl ++) {
+		fprintf(stdout, "  %-10s", impl_name[impl]);
+		if (0 != sha1_impl_is_supported(impl)) {
+			tm = time_ns_get();
+			for (n = 0; n < iters; n ++) {
+				sha1_init_impl(&sha1_ctx, impl);
+				sha1_update(&sha1_ctx, buf, buf_size);
+				sha1_final(&sha1_ctx, digest);
+			}
+			tm = MAX(1, (time_ns_get() - tm));
+			fprintf(stdout, " sha1: %5"PRIu64,
+			    (((uint64_t)(iters * buf_size) * 1000) / tm));
+		}
+		if (0 == sha2_init_impl(256, impl, &sha2_ctx)) {
+			tm = time_ns_get();
+			for (n = 0; n < iters; n ++) {
+				if (0 != sha2_init_impl(256, impl, &sha2_ctx))
+					break;
+				sha2_update(&sha2_ctx, buf, buf_size);
+				sha2_final(&sha2_ctx, digest);
+			}
+			tm = MAX(1, (time_ns_get() - tm));
+			fprintf(stdout, " sha2-256: %5"PRIu64,
+			    (((uint64_t)(iters * buf_size) * 1000) / tm));
+		}
+		if (0 == sha2_init_impl(512, impl, &sha2_ctx)) {
+			tm = time_ns_get();
+			for (n = 0; n < iters; n ++) {
+				if (0 != sha2_init_impl(512, impl, &sha2_ctx))
+					break;
+				sha2_update(&sha2_ctx, buf, buf_size);
+				sha2_final(&sha2_ctx, digest);
+			}
+			tm = MAX(1, (time_ns_get() - tm));
+			fprintf(stdout, " sha2-512: %5"PRIu64,
+			    (((uint64_t)(iters * buf_size) * 1000) / tm));
+		}
+		if (0 != gost3411_2012_impl_is_supported(impl)) {
+			tm = time_ns_get();
+			for (n = 0; n < (iters / 4); n ++) {
+				gost3411_2012_init_impl(512, impl, &gost_ctx);
+				gost3411_2012_update(&gost_ctx, buf, buf_size);
+				gost3411_2012_final(&gost_ctx, digest);
+			}
+			tm = MAX(1, (time_ns_get() - tm));
+			fprintf(stdout, " gost-512: %5"PRIu64,
+			    (((uint64_t)((iters / 4) * buf_size) * 1000) / tm));
+		}
+		fprintf(stdout, "\n");
+	}
+	free(buf);
 
-#define LOG_INFO_FMT(fmt, args...)					\
-	    fprintf(stdout, fmt"\n", ##args)
+	return (0);
+}
 
 
 int
@@ -78,5 +225,17 @@ main(int argc, char *argv[]) {
 		return (error);
 	}
 
+	error = hash_mb_self_test();
+	if (0 != error) {
+		LOG_INFO_FMT("hash_mb_self_test(): err: %i", error);
+		return (error);
+	}
+	if (1 < argc && 0 == strcmp(argv[1], "-b")) {
+		error = hash_impl_bench();
+		if (0 == error) {
+			error = hash_mb_bench();
+		}
+	}
+
 	return (0);
 }
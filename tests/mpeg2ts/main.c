@@ -0,0 +1,677 @@
+/*-
+ * Copyright (c) 2016-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* memcpy */
+#include <stdio.h> /* snprintf, fprintf */
+
+#include "proto/mpeg2ts.h"
+#include "../test_utils.h"
+
+#ifndef __unused
+#	define __unused	__attribute__((__unused__))
+#endif
+
+
+#define TEST_PKTS_CNT	1500
+#define TEST_BUF_SIZE	((TEST_PKTS_CNT * MPEG2_TS_PKT_SIZE_MAX) + 64)
+
+
+static const size_t test_pkt_sizes[MPEG2_TS_PKT_SIZES_CNT] = {
+	MPEG2_TS_PKT_SIZE_188, MPEG2_TS_PKT_SIZE_192,
+	MPEG2_TS_PKT_SIZE_204, MPEG2_TS_PKT_SIZE_208
+};
+static uint8_t test_buf[TEST_BUF_SIZE];
+static mpeg2_ts_dmx_t test_dmx[2]; /* 0 - SSE2/scalar, 1 - auto. */
+static uint32_t test_rnd = 0x2545f491;
+
+
+static uint32_t
+test_rand(void) {
+
+	test_rnd ^= (test_rnd << 13);
+	test_rnd ^= (test_rnd >> 17);
+	test_rnd ^= (test_rnd << 5);
+
+	return (test_rnd);
+}
+
+/* Fill buf with valid packets of few PIDs with continuous CC. */
+static void
+test_pkts_gen(uint8_t *buf, const size_t pkt_size, const size_t count) {
+	size_t i, j;
+	uint16_t pid;
+	uint8_t cc[8], *pkt;
+
+	memset(cc, 0x00, sizeof(cc));
+	for (i = 0; i < count; i ++) {
+		pkt = &buf[(i * pkt_size)];
+		j = (test_rand() % nitems(cc));
+		pid = (uint16_t)((0 == j) ? MPEG2_TS_PID_NULL : (0x100 * j + j));
+		pkt[0] = MPEG2_TS_SB;
+		pkt[1] = (uint8_t)((pid >> 8) & 0x1f);
+		pkt[2] = (uint8_t)pid;
+		pkt[3] = (uint8_t)(0x10 | cc[j]); /* Payload only. */
+		cc[j] = MPEG2_TS_CC_GET_NEXT(cc[j]);
+		for (j = 4; j < pkt_size; j ++) {
+			/* No sync byte in payload: resync must not
+			 * find false packets, results are deterministic. */
+			pkt[j] = (uint8_t)(test_rand() & 0x3f);
+		}
+	}
+}
+
+/* All headers extract implementations must return same result. */
+static int
+test_extract_cmp(const uint8_t *buf, const size_t pkt_size,
+    const size_t count) {
+	size_t cnt, cnt_ref;
+	static uint32_t hdr[2][MPEG2_TS_DMX_BATCH_MAX];
+	static uint16_t pid[2][MPEG2_TS_DMX_BATCH_MAX];
+
+	cnt_ref = mpeg2_ts_dmx_hdrs_extract_generic(buf, pkt_size, count,
+	    hdr[0], pid[0]);
+#if defined(__SSE2__) && BYTE_ORDER == LITTLE_ENDIAN
+	cnt = mpeg2_ts_dmx_hdrs_extract_sse2(buf, pkt_size, count,
+	    hdr[1], pid[1]);
+	TEST_CHK(cnt_ref == cnt);
+	TEST_CHK(0 == memcmp(hdr[0], hdr[1], (cnt * sizeof(uint32_t))));
+	TEST_CHK(0 == memcmp(pid[0], pid[1], (cnt * sizeof(uint16_t))));
+#endif
+#if defined(MPEG2_TS_X86_AVX2) && BYTE_ORDER == LITTLE_ENDIAN
+	if (0 != (MPEG2_TS_CPU_F_AVX2 & mpeg2_ts_cpu_features_get())) {
+		cnt = mpeg2_ts_dmx_hdrs_extract_avx2(buf, pkt_size, count,
+		    hdr[1], pid[1]);
+		TEST_CHK(cnt_ref == cnt);
+		TEST_CHK(0 == memcmp(hdr[0], hdr[1], (cnt * sizeof(uint32_t))));
+		TEST_CHK(0 == memcmp(pid[0], pid[1], (cnt * sizeof(uint16_t))));
+	}
+#endif
+	(void)cnt;
+
+	return (0);
+}
+
+/* Demux whole buffer with forced SSE2/scalar and with auto selected
+ * implementation: batches, resync points and counters must match. */
+static int
+test_dmx_cmp(const uint8_t *buf, const size_t buf_size, const size_t pkt_size) {
+	size_t i, off = 0, cnt[2], processed[2];
+
+	TEST_CHK(0 == mpeg2_ts_dmx_init(&test_dmx[0], pkt_size));
+	TEST_CHK(0 == mpeg2_ts_dmx_init(&test_dmx[1], pkt_size));
+	test_dmx[0].use_avx2 = 0;
+	while (pkt_size <= (buf_size - off)) {
+		TEST_CHK(0 == test_extract_cmp(&buf[off], pkt_size,
+		    MIN(((buf_size - off) / pkt_size), MPEG2_TS_DMX_BATCH_MAX)));
+		for (i = 0; i < 2; i ++) {
+			cnt[i] = mpeg2_ts_dmx_batch(&test_dmx[i], &buf[off],
+			    (buf_size - off), &processed[i]);
+		}
+		TEST_CHK(cnt[0] == cnt[1]);
+		TEST_CHK(processed[0] == processed[1]);
+		TEST_CHK(0 == memcmp(test_dmx[0].pkt, test_dmx[1].pkt,
+		    (cnt[0] * sizeof(uint8_t*))));
+		TEST_CHK(0 == memcmp(test_dmx[0].hdr, test_dmx[1].hdr,
+		    (cnt[0] * sizeof(uint32_t))));
+		TEST_CHK(0 == memcmp(test_dmx[0].pid, test_dmx[1].pid,
+		    (cnt[0] * sizeof(uint16_t))));
+		TEST_CHK(0 == memcmp(test_dmx[0].idx, test_dmx[1].idx,
+		    (cnt[0] * sizeof(uint16_t))));
+		for (i = 0; i < cnt[0]; i ++) {
+			TEST_CHK(MPEG2_TS_SB == test_dmx[0].pkt[i][0]);
+		}
+		if (0 == processed[0])
+			break;
+		off += processed[0];
+	}
+	TEST_CHK(test_dmx[0].pkts == test_dmx[1].pkts);
+	TEST_CHK(test_dmx[0].sync_errs == test_dmx[1].sync_errs);
+	TEST_CHK(test_dmx[0].te_pkts == test_dmx[1].te_pkts);
+	TEST_CHK(test_dmx[0].cc_errs == test_dmx[1].cc_errs);
+
+	return (0);
+}
+
+
+static int
+test_dmx_clean(void) {
+	size_t i, off;
+
+	for (i = 0; i < MPEG2_TS_PKT_SIZES_CNT; i ++) {
+		/* Misaligned buffers, no garbage. */
+		for (off = 0; off < 8; off ++) {
+			test_pkts_gen(&test_buf[off], test_pkt_sizes[i],
+			    TEST_PKTS_CNT);
+			TEST_CHK(0 == test_dmx_cmp(&test_buf[off],
+			    (test_pkt_sizes[i] * TEST_PKTS_CNT),
+			    test_pkt_sizes[i]));
+			TEST_CHK(TEST_PKTS_CNT == test_dmx[0].pkts);
+			TEST_CHK(0 == test_dmx[0].sync_errs);
+			TEST_CHK(0 == test_dmx[0].cc_errs);
+		}
+	}
+
+	return (0);
+}
+
+static int
+test_dmx_resync(void) {
+	size_t i, j, off, buf_size;
+	const size_t lost[] = { 0, 7, 10, 16, 31, 511, 514, 700 };
+
+	for (i = 0; i < MPEG2_TS_PKT_SIZES_CNT; i ++) {
+		/* Garbage before first packet. */
+		for (off = 1; off < 8; off ++) {
+			memset(test_buf, 0x00, off);
+			test_pkts_gen(&test_buf[off], test_pkt_sizes[i],
+			    TEST_PKTS_CNT);
+			buf_size = (off + (test_pkt_sizes[i] * TEST_PKTS_CNT));
+			TEST_CHK(0 == test_dmx_cmp(test_buf, buf_size,
+			    test_pkt_sizes[i]));
+			TEST_CHK(TEST_PKTS_CNT == test_dmx[0].pkts);
+			TEST_CHK(0 != test_dmx[0].sync_errs);
+		}
+		/* Sync lost at start, middle and end of SIMD groups and batches. */
+		test_pkts_gen(&test_buf[3], test_pkt_sizes[i], TEST_PKTS_CNT);
+		buf_size = (test_pkt_sizes[i] * TEST_PKTS_CNT);
+		for (j = 0; j < nitems(lost); j ++) {
+			test_buf[(3 + (lost[j] * test_pkt_sizes[i]))] = 0x00;
+		}
+		TEST_CHK(0 == test_dmx_cmp(&test_buf[3], buf_size,
+		    test_pkt_sizes[i]));
+		TEST_CHK((TEST_PKTS_CNT - nitems(lost)) == test_dmx[0].pkts);
+		TEST_CHK(nitems(lost) == test_dmx[0].sync_errs);
+		/* Skipped packets: CC jumps, at least on some PIDs. */
+		TEST_CHK(0 != test_dmx[0].cc_errs);
+	}
+
+	return (0);
+}
+
+static int
+test_dmx_corrupt(void) {
+	size_t i, j, buf_size;
+
+	for (i = 0; i < MPEG2_TS_PKT_SIZES_CNT; i ++) {
+		buf_size = (test_pkt_sizes[i] * TEST_PKTS_CNT);
+		/* Random bytes with random sync bytes. */
+		for (j = 0; j < buf_size; j ++) {
+			test_buf[j] = (uint8_t)test_rand();
+			if (0 == (test_rand() % 64)) {
+				test_buf[j] = MPEG2_TS_SB;
+			}
+		}
+		TEST_CHK(0 == test_dmx_cmp(&test_buf[1], (buf_size - 1),
+		    test_pkt_sizes[i]));
+		/* Valid stream with random damaged bytes, TE and CC. */
+		test_pkts_gen(test_buf, test_pkt_sizes[i], TEST_PKTS_CNT);
+		for (j = 0; j < (TEST_PKTS_CNT / 4); j ++) {
+			test_buf[(test_rand() % buf_size)] = (uint8_t)test_rand();
+		}
+		TEST_CHK(0 == test_dmx_cmp(test_buf, buf_size,
+		    test_pkt_sizes[i]));
+		/* Truncated last packet. */
+		TEST_CHK(0 == test_dmx_cmp(test_buf, (buf_size - 5),
+		    test_pkt_sizes[i]));
+	}
+
+	return (0);
+}
+
+
+/* PSI tracker. */
+#define TEST_PMT_PID1	0x0100
+#define TEST_PMT_PID2	0x0200
+#define TEST_SEC_SIZE	(MPEG2_PSI_SEC_HDR_SIZE + MPEG2_PSI_SEC_LEN_MAX)
+
+typedef struct test_psi_s {
+	size_t		cb_count;
+	uint16_t	pid;	/* Last cb table. */
+	uint8_t		tid;
+	uint8_t		ver;
+	size_t		items_count;
+	uint8_t		cc[MPEG2_TS_PID__COUNT__];
+} test_psi_t, *test_psi_p;
+
+static uint8_t test_secs[(4 * TEST_SEC_SIZE)];
+
+
+static void
+test_psi_cb(mpeg2_psi_trk_p trk __unused, mpeg2_psi_tbl_p tbl, void *udata) {
+	test_psi_p tpsi = udata;
+
+	tpsi->cb_count ++;
+	tpsi->pid = tbl->pid;
+	tpsi->tid = tbl->tid;
+	tpsi->ver = tbl->ver;
+	tpsi->items_count = tbl->items_count;
+}
+
+/* Build long form section, return section size. */
+static size_t
+test_sec_build(uint8_t *sec, const uint8_t tid, const uint16_t tid_ext,
+    const uint8_t ver, const uint8_t sn, const uint8_t lsn,
+    const uint8_t *data, const size_t data_size) {
+	size_t sec_len = (5 + data_size + 4);
+	uint32_t crc;
+
+	sec[0] = tid;
+	sec[1] = (uint8_t)(0xb0 | ((sec_len >> 8) & 0x0f));
+	sec[2] = (uint8_t)sec_len;
+	sec[3] = (uint8_t)(tid_ext >> 8);
+	sec[4] = (uint8_t)tid_ext;
+	sec[5] = (uint8_t)(0xc1 | ((ver & MPEG2_TS_PSI_TBL_VER_MASK) << 1));
+	sec[6] = sn;
+	sec[7] = lsn;
+	memcpy(&sec[8], data, data_size);
+	crc = crc32mpeg2(sec, (8 + data_size));
+	sec[(8 + data_size)] = (uint8_t)(crc >> 24);
+	sec[(9 + data_size)] = (uint8_t)(crc >> 16);
+	sec[(10 + data_size)] = (uint8_t)(crc >> 8);
+	sec[(11 + data_size)] = (uint8_t)crc;
+
+	return ((MPEG2_PSI_SEC_HDR_SIZE + sec_len));
+}
+
+static size_t
+test_pat_build(uint8_t *sec, const uint8_t ver, const uint16_t *pmt_pids,
+    const size_t count) {
+	size_t i;
+	uint8_t data[64];
+
+	for (i = 0; i < count; i ++) {
+		data[((i * 4) + 0)] = 0;
+		data[((i * 4) + 1)] = (uint8_t)(i + 1); /* Program number. */
+		data[((i * 4) + 2)] = (uint8_t)(0xe0 | (pmt_pids[i] >> 8));
+		data[((i * 4) + 3)] = (uint8_t)pmt_pids[i];
+	}
+
+	return (test_sec_build(sec, MPEG2_PSI_TID_PAT, 1, ver, 0, 0, data,
+	    (count * 4)));
+}
+
+/* PMT with es_count streams, each with descr_size bytes descriptors. */
+static size_t
+test_pmt_build(uint8_t *sec, const uint16_t pn, const uint8_t ver,
+    const size_t es_count, const size_t descr_size) {
+	size_t i, off = 4;
+	uint8_t data[(TEST_SEC_SIZE - 12)];
+
+	data[0] = 0xe1; /* PCR PID: 0x0101. */
+	data[1] = 0x01;
+	data[2] = 0xf0; /* No program info. */
+	data[3] = 0x00;
+	for (i = 0; i < es_count; i ++) {
+		data[(off + 0)] = 0x1b; /* H.264. */
+		data[(off + 1)] = (uint8_t)(0xe1);
+		data[(off + 2)] = (uint8_t)(0x10 + i);
+		data[(off + 3)] = (uint8_t)(0xf0 | (descr_size >> 8));
+		data[(off + 4)] = (uint8_t)descr_size;
+		memset(&data[(off + 5)], (int)i, descr_size);
+		off += (5 + descr_size);
+	}
+
+	return (test_sec_build(sec, MPEG2_PSI_TID_PMT, pn, ver, 0, 0, data,
+	    off));
+}
+
+/* Split sections stream to TS packets as muxer do: pointer field points
+ * to first section started in packet, sections may share packet. */
+static void
+test_psi_send(mpeg2_psi_trk_p trk, test_psi_p tpsi, const uint16_t pid,
+    const uint8_t *data, const size_t data_size, const size_t *secs_off,
+    const size_t secs_count) {
+	size_t pos = 0, i, n, hdr_size;
+	uint8_t pkt[MPEG2_TS_PKT_SIZE_188];
+
+	while (pos < data_size) {
+		for (i = 0; i < secs_count; i ++) {
+			if (secs_off[i] >= pos &&
+			    secs_off[i] < (pos + (MPEG2_TS_PKT_SIZE_188 - 5)))
+				break;
+		}
+		pkt[0] = MPEG2_TS_SB;
+		pkt[1] = (uint8_t)(pid >> 8);
+		pkt[2] = (uint8_t)pid;
+		pkt[3] = (uint8_t)(0x10 | tpsi->cc[pid]);
+		tpsi->cc[pid] = MPEG2_TS_CC_GET_NEXT(tpsi->cc[pid]);
+		hdr_size = 4;
+		if (i < secs_count) { /* Section start in this packet. */
+			pkt[1] |= 0x40;
+			pkt[4] = (uint8_t)(secs_off[i] - pos);
+			hdr_size = 5;
+		}
+		n = MIN((data_size - pos), (MPEG2_TS_PKT_SIZE_188 - hdr_size));
+		memcpy(&pkt[hdr_size], &data[pos], n);
+		memset(&pkt[(hdr_size + n)], 0xff,
+		    (MPEG2_TS_PKT_SIZE_188 - (hdr_size + n)));
+		pos += n;
+		mpeg2_psi_trk_pkt(trk, pkt);
+	}
+}
+
+static void
+test_psi_send_sec(mpeg2_psi_trk_p trk, test_psi_p tpsi, const uint16_t pid,
+    const uint8_t *sec, const size_t sec_size) {
+	const size_t off = 0;
+
+	test_psi_send(trk, tpsi, pid, sec, sec_size, &off, 1);
+}
+
+static int
+test_psi_create(test_psi_p tpsi, mpeg2_psi_trk_p *trk) {
+
+	memset(tpsi, 0x00, sizeof(test_psi_t));
+	TEST_CHK(0 == mpeg2_psi_trk_create(MPEG2_PSI_TRK_F_DEFAULT,
+	    test_psi_cb, tpsi, trk));
+
+	return (0);
+}
+
+
+static int
+test_psi_reassembly(void) {
+	size_t i, sec_size, secs_off[3];
+	uint16_t pmt_pids[1] = { TEST_PMT_PID1 };
+	uint8_t data[8];
+	test_psi_t tpsi;
+	mpeg2_psi_trk_p trk;
+	mpeg2_psi_tbl_p tbl;
+
+	TEST_CHK(0 == test_psi_create(&tpsi, &trk));
+	/* PAT, PMT PID tracking. */
+	sec_size = test_pat_build(test_secs, 0, pmt_pids, 1);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(1 == tpsi.cb_count);
+	TEST_CHK(MPEG2_PSI_TID_PAT == tpsi.tid);
+	TEST_CHK(1 == tpsi.items_count);
+	TEST_CHK(NULL != trk->pid[TEST_PMT_PID1]);
+	/* PMT in 5 packets. */
+	sec_size = test_pmt_build(test_secs, 1, 0, 4, 200);
+	TEST_CHK((4 * MPEG2_TS_PKT_SIZE_188) < sec_size);
+	test_psi_send_sec(trk, &tpsi, TEST_PMT_PID1, test_secs, sec_size);
+	TEST_CHK(2 == tpsi.cb_count);
+	tbl = mpeg2_psi_trk_tbl_get(trk, TEST_PMT_PID1, MPEG2_PSI_TID_PMT, 1);
+	TEST_CHK(NULL != tbl);
+	TEST_CHK(0x0101 == tbl->pcr_pid);
+	TEST_CHK(4 == tbl->items_count);
+	for (i = 0; i < tbl->items_count; i ++) {
+		TEST_CHK((0x0110 + i) == tbl->items.es[i].pid);
+		TEST_CHK(200 == tbl->items.es[i].descrs_size);
+		TEST_CHK(i == tbl->items.es[i].descrs[199]);
+	}
+	/* Three sections in one packet, table complete on last.
+	 * SDT: onid, reserved, one service without descriptors. */
+	memset(data, 0x00, sizeof(data));
+	data[1] = 0x01;
+	data[2] = 0xff;
+	data[5] = 0xfc;
+	data[6] = 0x80;
+	for (i = 0, sec_size = 0; i < 3; i ++) {
+		data[4] = (uint8_t)(i + 1);
+		secs_off[i] = sec_size;
+		sec_size += test_sec_build(&test_secs[sec_size],
+		    MPEG2_PSI_TID_SDT, 7, 3, (uint8_t)i, 2, data, 8);
+	}
+	test_psi_send(trk, &tpsi, MPEG2_TS_PID_SDT, test_secs, sec_size,
+	    secs_off, 3);
+	TEST_CHK(3 == tpsi.cb_count);
+	tbl = mpeg2_psi_trk_tbl_get(trk, MPEG2_TS_PID_SDT, MPEG2_PSI_TID_SDT, 7);
+	TEST_CHK(NULL != tbl);
+	TEST_CHK(1 == tbl->onid);
+	TEST_CHK(3 == tbl->items_count);
+	TEST_CHK(3 == tbl->items.srv[2].sid);
+	TEST_CHK(4 == tbl->items.srv[2].rstatus);
+	/* Section tail before next section start in same packet. */
+	sec_size = test_pmt_build(test_secs, 1, 1, 1, 170);
+	secs_off[0] = 0;
+	secs_off[1] = sec_size;
+	sec_size += test_pmt_build(&test_secs[sec_size], 1, 2, 2, 30);
+	test_psi_send(trk, &tpsi, TEST_PMT_PID1, test_secs, sec_size,
+	    secs_off, 2);
+	TEST_CHK(5 == tpsi.cb_count);
+	TEST_CHK(2 == tpsi.ver);
+	TEST_CHK(2 == tpsi.items_count);
+	TEST_CHK(0 == trk->crc_errs);
+	TEST_CHK(0 == trk->sec_errs);
+	TEST_CHK(0 == trk->cc_errs);
+	/* Lost packet in section: dropped, next repetition is ok. */
+	sec_size = test_pmt_build(test_secs, 1, 3, 4, 200);
+	test_psi_send_sec(trk, &tpsi, TEST_PMT_PID1, test_secs, (183 + 184));
+	tpsi.cc[TEST_PMT_PID1] = MPEG2_TS_CC_GET_NEXT(tpsi.cc[TEST_PMT_PID1]);
+	test_psi_send(trk, &tpsi, TEST_PMT_PID1, &test_secs[(183 + (2 * 184))],
+	    (sec_size - (183 + (2 * 184))), NULL, 0);
+	TEST_CHK(1 == trk->cc_errs);
+	TEST_CHK(5 == tpsi.cb_count);
+	test_psi_send_sec(trk, &tpsi, TEST_PMT_PID1, test_secs, sec_size);
+	TEST_CHK(6 == tpsi.cb_count);
+	TEST_CHK(3 == tpsi.ver);
+	mpeg2_psi_trk_destroy(trk);
+
+	return (0);
+}
+
+static int
+test_psi_version(void) {
+	size_t sec_size, tbls_count;
+	uint16_t pmt_pids[2] = { TEST_PMT_PID1, TEST_PMT_PID2 };
+	test_psi_t tpsi;
+	mpeg2_psi_trk_p trk;
+	mpeg2_psi_tbl_p tbl;
+
+	TEST_CHK(0 == test_psi_create(&tpsi, &trk));
+	sec_size = test_pat_build(test_secs, 5, pmt_pids, 1);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(1 == tpsi.cb_count);
+	TEST_CHK(1 == trk->secs_skipped);
+	tbls_count = trk->tbls_count;
+	/* New version. */
+	sec_size = test_pat_build(test_secs, 6, pmt_pids, 2);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(2 == tpsi.cb_count);
+	TEST_CHK(6 == tpsi.ver);
+	TEST_CHK(2 == tpsi.items_count);
+	TEST_CHK(tbls_count == trk->tbls_count);
+	TEST_CHK(NULL != trk->pid[TEST_PMT_PID2]);
+	/* Damaged section: CRC error, table not changed.
+	 * Damage in data with same CRC field skipped as unchanged. */
+	test_secs[9] ^= 0x01;
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(2 == trk->secs_skipped);
+	test_secs[(sec_size - 1)] ^= 0x01;
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(1 == trk->crc_errs);
+	TEST_CHK(2 == tpsi.cb_count);
+	/* Same version, other content with valid CRC: updated. */
+	sec_size = test_pat_build(test_secs, 6, &pmt_pids[1], 1);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(3 == tpsi.cb_count);
+	tbl = mpeg2_psi_trk_tbl_get(trk, MPEG2_TS_PID_PAT, MPEG2_PSI_TID_PAT, 1);
+	TEST_CHK(NULL != tbl);
+	TEST_CHK(1 == tbl->items_count);
+	TEST_CHK(TEST_PMT_PID2 == tbl->items.prog[0].pid);
+	TEST_CHK(tbls_count == trk->tbls_count);
+	mpeg2_psi_trk_destroy(trk);
+
+	return (0);
+}
+
+static int
+test_psi_malformed(void) {
+	size_t i, sec_size, tbls_count;
+	uint16_t pmt_pids[1] = { TEST_PMT_PID1 };
+	uint8_t data[8];
+	test_psi_t tpsi;
+	mpeg2_psi_trk_p trk;
+
+	TEST_CHK(0 == test_psi_create(&tpsi, &trk));
+	sec_size = test_pat_build(test_secs, 0, pmt_pids, 1);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(1 == tpsi.cb_count);
+	/* PMT ES loop out of section: decode fail, no cache growth. */
+	for (i = 0; i < 100; i ++) {
+		sec_size = test_pmt_build(test_secs, 1, (uint8_t)i, 1, 10);
+		test_secs[16] = 0xff; /* ES info length. */
+		sec_size = test_sec_build(test_secs, MPEG2_PSI_TID_PMT, 1,
+		    (uint8_t)i, 0, 0, &test_secs[8], (sec_size - 12));
+		test_psi_send_sec(trk, &tpsi, TEST_PMT_PID1, test_secs,
+		    sec_size);
+		if (0 == i) {
+			tbls_count = trk->tbls_count;
+		}
+	}
+	TEST_CHK(100 == trk->sec_errs);
+	TEST_CHK(1 == tpsi.cb_count);
+	TEST_CHK(2 == tbls_count);
+	TEST_CHK(tbls_count == trk->tbls_count);
+	TEST_CHK(NULL == mpeg2_psi_trk_tbl_get(trk, TEST_PMT_PID1,
+	    MPEG2_PSI_TID_PMT, 1));
+	/* Valid PMT after errors reuse entry. */
+	sec_size = test_pmt_build(test_secs, 1, 0, 1, 10);
+	test_psi_send_sec(trk, &tpsi, TEST_PMT_PID1, test_secs, sec_size);
+	TEST_CHK(2 == tpsi.cb_count);
+	TEST_CHK(tbls_count == trk->tbls_count);
+	/* Section number above last section number. */
+	memset(data, 0x00, sizeof(data));
+	sec_size = test_sec_build(test_secs, MPEG2_PSI_TID_SDT, 1, 0, 2, 1,
+	    data, 0);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_SDT, test_secs, sec_size);
+	TEST_CHK(101 == trk->sec_errs);
+	/* Too short long form section. */
+	test_secs[1] = 0xb0;
+	test_secs[2] = 5;
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_SDT, test_secs, 8);
+	TEST_CHK(102 == trk->sec_errs);
+	/* Section not completed before next section start. */
+	test_secs[1] = 0xbf;
+	test_secs[2] = 0xff;
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_SDT, test_secs, 183);
+	TEST_CHK(102 == trk->sec_errs);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_SDT, test_secs, 183);
+	TEST_CHK(103 == trk->sec_errs);
+	TEST_CHK(2 == tpsi.cb_count);
+	TEST_CHK(tbls_count == trk->tbls_count);
+	mpeg2_psi_trk_destroy(trk);
+
+	return (0);
+}
+
+static int
+test_psi_pat_remove(void) {
+	size_t sec_size, tbls_count;
+	uint16_t pmt_pids[2] = { TEST_PMT_PID1, TEST_PMT_PID2 };
+	test_psi_t tpsi;
+	mpeg2_psi_trk_p trk;
+
+	TEST_CHK(0 == test_psi_create(&tpsi, &trk));
+	sec_size = test_pat_build(test_secs, 0, pmt_pids, 2);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(NULL != trk->pid[TEST_PMT_PID1]);
+	TEST_CHK(NULL != trk->pid[TEST_PMT_PID2]);
+	sec_size = test_pmt_build(test_secs, 1, 0, 1, 10);
+	test_psi_send_sec(trk, &tpsi, TEST_PMT_PID1, test_secs, sec_size);
+	sec_size = test_pmt_build(test_secs, 2, 0, 2, 10);
+	test_psi_send_sec(trk, &tpsi, TEST_PMT_PID2, test_secs, sec_size);
+	TEST_CHK(3 == tpsi.cb_count);
+	tbls_count = trk->tbls_count;
+	TEST_CHK(NULL != mpeg2_psi_trk_tbl_get(trk, TEST_PMT_PID2,
+	    MPEG2_PSI_TID_PMT, 2));
+	/* Program 2 removed. */
+	sec_size = test_pat_build(test_secs, 1, pmt_pids, 1);
+	test_psi_send_sec(trk, &tpsi, MPEG2_TS_PID_PAT, test_secs, sec_size);
+	TEST_CHK(4 == tpsi.cb_count);
+	TEST_CHK(NULL != trk->pid[TEST_PMT_PID1]);
+	TEST_CHK(NULL == trk->pid[TEST_PMT_PID2]);
+	TEST_CHK((tbls_count - 1) == trk->tbls_count);
+	TEST_CHK(NULL == mpeg2_psi_trk_tbl_get(trk, TEST_PMT_PID2,
+	    MPEG2_PSI_TID_PMT, 2));
+	TEST_CHK(NULL != mpeg2_psi_trk_tbl_get(trk, TEST_PMT_PID1,
+	    MPEG2_PSI_TID_PMT, 1));
+	/* Untracked PID packets ignored. */
+	sec_size = test_pmt_build(test_secs, 2, 1, 2, 10);
+	test_psi_send_sec(trk, &tpsi, TEST_PMT_PID2, test_secs, sec_size);
+	TEST_CHK(4 == tpsi.cb_count);
+	TEST_CHK((tbls_count - 1) == trk->tbls_count);
+	mpeg2_psi_trk_destroy(trk);
+
+	return (0);
+}
+
+
+int
+main(int argc __unused, char *argv[] __unused) {
+	int error;
+
+	LOG_INFO_FMT("AVX2: %s", ((0 != (MPEG2_TS_CPU_F_AVX2 &
+	    mpeg2_ts_cpu_features_get())) ? "yes" : "no"));
+	error = test_dmx_clean();
+	if (0 != error) {
+		LOG_INFO_FMT("test_dmx_clean(): err: %i", error);
+		return (error);
+	}
+	error = test_dmx_resync();
+	if (0 != error) {
+		LOG_INFO_FMT("test_dmx_resync(): err: %i", error);
+		return (error);
+	}
+	error = test_dmx_corrupt();
+	if (0 != error) {
+		LOG_INFO_FMT("test_dmx_corrupt(): err: %i", error);
+		return (error);
+	}
+	error = test_psi_reassembly();
+	if (0 != error) {
+		LOG_INFO_FMT("test_psi_reassembly(): err: %i", error);
+		return (error);
+	}
+	error = test_psi_version();
+	if (0 != error) {
+		LOG_INFO_FMT("test_psi_version(): err: %i", error);
+		return (error);
+	}
+	error = test_psi_malformed();
+	if (0 != error) {
+		LOG_INFO_FMT("test_psi_malformed(): err: %i", error);
+		return (error);
+	}
+	error = test_psi_pat_remove();
+	if (0 != error) {
+		LOG_INFO_FMT("test_psi_pat_remove(): err: %i", error);
+		return (error);
+	}
+
+	return (0);
+}
@@ -0,0 +1,419 @@
+/*-
+ * Copyright (c) 2016-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* strcmp */
+#include <stdio.h> /* snprintf, fprintf */
+#include <time.h>
+
+#include "utils/reass_helper.h"
+#include "utils/reass_pool.h"
+#include "../test_utils.h"
+
+#ifndef nitems
+#	define nitems(__val)	(sizeof(__val) / sizeof(__val[0]))
+#endif
+#ifndef __unused
+#	define __unused	__attribute__((__unused__))
+#endif
+
+
+#define SEQ_SIZE	(64 * 1024)
+#define BLK_SIZE	1472
+#define SEQ_BLKS	((SEQ_SIZE + BLK_SIZE - 1) / BLK_SIZE)
+#define SEQ_LAST_SIZE	(SEQ_SIZE - ((SEQ_BLKS - 1) * BLK_SIZE))
+
+
+typedef struct frag_s {
+	uint64_t	key;
+	uint32_t	blk_idx;
+	uint32_t	is_last;
+} frag_t, *frag_p;
+
+static uint8_t src_data[SEQ_SIZE];
+static uint64_t rnd_state = 0x2545f4914f6cdd1dull;
+
+
+static uint32_t
+rnd_get(void) { /* xorshift64* */
+
+	rnd_state ^= (rnd_state >> 12);
+	rnd_state ^= (rnd_state << 25);
+	rnd_state ^= (rnd_state >> 27);
+	return ((uint32_t)((rnd_state * 0x2545f4914f6cdd1dull) >> 32));
+}
+
+/* Probability in 1/1000000 units. */
+static int
+rnd_chance(uint32_t ppm) {
+
+	return ((rnd_get() % 1000000) < ppm);
+}
+
+/* seqs_count sequences, up to active interleaved at same time,
+ * fragments lost with loss ppm, moved up to 16 positions with reorder ppm. */
+static size_t
+frags_gen(frag_p frags, size_t seqs_count, size_t active, uint32_t loss,
+    uint32_t reorder) {
+	size_t i, j, k, n = 0, next_blk[256];
+	frag_t tmp;
+
+	active = MIN(active, nitems(next_blk));
+	for (i = 0; i < seqs_count; i += active) {
+		memset(next_blk, 0x00, sizeof(next_blk));
+		for (j = 0; j < SEQ_BLKS; j ++) {
+			for (k = 0; k < active && (i + k) < seqs_count; k ++) {
+				if (rnd_chance(loss))
+					continue;
+				frags[n].key = (i + k);
+				frags[n].blk_idx = (uint32_t)j;
+				frags[n].is_last = ((SEQ_BLKS - 1) == j);
+				n ++;
+			}
+		}
+	}
+	for (i = 0; i < n; i ++) {
+		if (0 == rnd_chance(reorder))
+			continue;
+		j = (i + 1 + (rnd_get() % 16));
+		j = MIN((n - 1), j);
+		tmp = frags[i];
+		frags[i] = frags[j];
+		frags[j] = tmp;
+	}
+
+	return (n);
+}
+
+static size_t evicted_missing;
+
+static void
+evict_cb(reass_pool_p pool __unused, uint64_t key __unused,
+    reass_hlp_p reass_hlp, int error __unused, void *udata __unused) {
+
+	evicted_missing += reass_hlp_missing_get(reass_hlp, NULL, 0);
+}
+
+
+static int
+reass_bitmap_test(void) {
+	uint8_t bitmap[67];
+	size_t i, j, pos, ref, end;
+
+	for (i = 0; i < 1000; i ++) {
+		for (j = 0; j < sizeof(bitmap); j ++) {
+			bitmap[j] = (uint8_t)rnd_get();
+			if (0 == (i & 3)) { /* Dense / sparse runs. */
+				bitmap[j] = ((rnd_get() & 1) ? 0xff : 0x00);
+			}
+		}
+		pos = (rnd_get() % (sizeof(bitmap) * 8));
+		end = (pos + (rnd_get() % ((sizeof(bitmap) * 8) - pos + 1)));
+		for (j = 0; j < 2; j ++) {
+			for (ref = pos; ref < end; ref ++) {
+				if (j == REASS_HLP_GET_BIT(bitmap, ref))
+					break;
+			}
+			TEST_CHK(ref == reass_hlp_bitmap_find(bitmap,
+			    sizeof(bitmap), pos, end, (int)j));
+		}
+		for (ref = 0, j = 0; j < end; j ++) {
+			ref += REASS_HLP_GET_BIT(bitmap, j);
+		}
+		TEST_CHK(ref == reass_hlp_bitmap_count(bitmap, sizeof(bitmap),
+		    end));
+	}
+
+	return (0);
+}
+
+static int
+reass_hlp_test(void) {
+	reass_hlp_p reass_hlp;
+	reass_hlp_range_t ranges[8];
+	size_t i;
+
+	reass_hlp = reass_hlp_alloc(SEQ_SIZE, BLK_SIZE);
+	TEST_CHK(NULL != reass_hlp);
+	/* Classic: first fragment received first. */
+	TEST_CHK(EAGAIN == reass_hlp_handle_frag(reass_hlp, 1000, 1, 0,
+	    src_data, BLK_SIZE));
+	for (i = (SEQ_BLKS - 1); i > 0; i --) {
+		if (3 == i || 4 == i || 10 == i)
+			continue; /* Lost. */
+		TEST_CHK(EAGAIN == reass_hlp_handle_frag(reass_hlp, (1000 + i),
+		    0, ((SEQ_BLKS - 1) == i), (src_data + (i * BLK_SIZE)),
+		    (((SEQ_BLKS - 1) == i) ? SEQ_LAST_SIZE : BLK_SIZE)));
+	}
+	TEST_CHK(EAGAIN == reass_hlp_handle_frag(reass_hlp, 1005, 0, 0,
+	    (src_data + (5 * BLK_SIZE)), BLK_SIZE));
+	TEST_CHK(1 == reass_hlp->dup_cnt);
+	TEST_CHK(SEQ_BLKS == reass_hlp_blk_total(reass_hlp));
+	TEST_CHK(2 == reass_hlp_missing_get(reass_hlp, ranges, nitems(ranges)));
+	TEST_CHK(3 == ranges[0].blk_idx && 2 == ranges[0].blk_cnt);
+	TEST_CHK(10 == ranges[1].blk_idx && 1 == ranges[1].blk_cnt);
+	TEST_CHK(EAGAIN == reass_hlp_handle_frag(reass_hlp, 1003, 0, 0,
+	    (src_data + (3 * BLK_SIZE)), BLK_SIZE));
+	TEST_CHK(EAGAIN == reass_hlp_handle_frag(reass_hlp, 1010, 0, 0,
+	    (src_data + (10 * BLK_SIZE)), BLK_SIZE));
+	TEST_CHK(0 == reass_hlp_handle_frag(reass_hlp, 1004, 0, 0,
+	    (src_data + (4 * BLK_SIZE)), BLK_SIZE));
+	TEST_CHK(SEQ_SIZE == reass_hlp->sequence_size);
+	TEST_CHK(0 == memcmp(reass_hlp->buf, src_data, SEQ_SIZE));
+	TEST_CHK(0 == reass_hlp_missing_get(reass_hlp, NULL, 0));
+
+	/* Known block size: first fragment can be late, seq number wrap. */
+	TEST_CHK(0 == reass_hlp_start(reass_hlp, (UINT64_T_MAX - 1), BLK_SIZE));
+	TEST_CHK(0 == reass_hlp->bitmap_used);
+	for (i = SEQ_BLKS; i > 0; i --) {
+		TEST_CHK(((1 == i) ? 0 : EAGAIN) == reass_hlp_handle_frag(
+		    reass_hlp, (UINT64_T_MAX - 1 + (i - 1)), 0,
+		    (SEQ_BLKS == i), (src_data + ((i - 1) * BLK_SIZE)),
+		    ((SEQ_BLKS == i) ? SEQ_LAST_SIZE : BLK_SIZE)));
+	}
+	TEST_CHK(0 == memcmp(reass_hlp->buf, src_data, SEQ_SIZE));
+	reass_hlp_free(reass_hlp);
+
+	return (0);
+}
+
+static int
+reass_pool_test(void) {
+	int error;
+	reass_pool_p pool;
+	reass_pool_settings_t s;
+	reass_pool_stat_t stat;
+	reass_hlp_p reass_hlp;
+	frag_p frags;
+	size_t i, n, done = 0;
+
+	reass_pool_def_settings(&s);
+	s.entries_max = 64;
+	s.buf_size = SEQ_SIZE;
+	s.blk_size = BLK_SIZE;
+	s.timeout = 100000;
+	TEST_CHK(0 == reass_pool_create(&s, evict_cb, NULL, &pool));
+	frags = malloc((1024 * SEQ_BLKS * sizeof(frag_t)));
+	TEST_CHK(NULL != frags);
+	/* 1024 sequences, 32 at same time, 10% reordered, no loss. */
+	n = frags_gen(frags, 1024, 32, 0, 100000);
+	for (i = 0; i < n; i ++) {
+		error = reass_pool_frag_add(pool, frags[i].key, i,
+		    frags[i].blk_idx, (int)frags[i].is_last,
+		    (src_data + (frags[i].blk_idx * BLK_SIZE)),
+		    (frags[i].is_last ? SEQ_LAST_SIZE : BLK_SIZE), &reass_hlp);
+		if (EAGAIN == error)
+			continue;
+		TEST_CHK(0 == error);
+		TEST_CHK(SEQ_SIZE == reass_hlp->sequence_size);
+		TEST_CHK(0 == memcmp(reass_hlp->buf, src_data, SEQ_SIZE));
+		reass_pool_done(pool, reass_hlp);
+		done ++;
+	}
+	TEST_CHK(1024 == done);
+	reass_pool_stat_get(pool, &stat);
+	TEST_CHK(0 == stat.entries && 1024 == stat.seq_done);
+	TEST_CHK(0 == stat.seq_evicted && 0 == stat.seq_timeout);
+
+	/* Incomplete sequences: timeout eviction with missing report. */
+	TEST_CHK(EAGAIN == reass_pool_frag_add(pool, 1, 0, 0, 0, src_data,
+	    BLK_SIZE, &reass_hlp));
+	TEST_CHK(EAGAIN == reass_pool_frag_add(pool, 1, 10, 5, 0, src_data,
+	    BLK_SIZE, &reass_hlp));
+	TEST_CHK(EAGAIN == reass_pool_frag_add(pool, 1, 10, 5, 0, src_data,
+	    BLK_SIZE, &reass_hlp));
+	TEST_CHK(EINVAL == reass_pool_frag_add(pool, 2, 10, 5, 0, src_data,
+	    10, &reass_hlp));
+	evicted_missing = 0;
+	TEST_CHK(0 == reass_pool_timeout_check(pool, (s.timeout - 1)));
+	TEST_CHK(1 == reass_pool_timeout_check(pool, s.timeout));
+	TEST_CHK(1 == evicted_missing); /* Blocks 1-4. */
+	reass_pool_stat_get(pool, &stat);
+	TEST_CHK(0 == stat.entries && 1 == stat.seq_timeout);
+	TEST_CHK(1 == stat.frags_dup && 1 == stat.frags_bad);
+
+	/* Pool full: oldest replaced. */
+	for (i = 0; i < (s.entries_max + 10); i ++) {
+		TEST_CHK(EAGAIN == reass_pool_frag_add(pool, (100 + i), 0, 0,
+		    0, src_data, BLK_SIZE, &reass_hlp));
+	}
+	reass_pool_stat_get(pool, &stat);
+	TEST_CHK(s.entries_max == stat.entries && 10 == stat.seq_evicted);
+	free(frags);
+	reass_pool_destroy(pool);
+
+	return (0);
+}
+
+
+/* Reassembly throughput at various loss and reorder rates. */
+static int
+reass_bench(void) {
+	int error;
+	reass_pool_p pool;
+	reass_pool_settings_t s;
+	reass_pool_stat_t stat;
+	reass_hlp_p reass_hlp;
+	frag_p frags;
+	uint8_t *bitmap;
+	uint64_t tm;
+	size_t i, j, k, n, iters, ranges_count = 0;
+	const size_t seqs_count = 4096, active = 64;
+	const uint32_t loss[] = { 0, 1000, 10000, 50000 };
+	const uint32_t reorder[] = { 0, 100000, 500000 };
+
+	frags = malloc((seqs_count * SEQ_BLKS * sizeof(frag_t)));
+	if (NULL == frags)
+		return (ENOMEM);
+	reass_pool_def_settings(&s);
+	s.entries_max = (active * 2);
+	s.buf_size = SEQ_SIZE;
+	s.blk_size = BLK_SIZE;
+	s.timeout = (active * SEQ_BLKS * 2); /* Time = fragment number. */
+	LOG_INFO_FMT("%zu sequences x %i bytes, %zu at same time, block %i:",
+	    seqs_count, SEQ_SIZE, active, BLK_SIZE);
+	LOG_INFO_FMT("  loss%%  reorder%%     MB/s  Mfrags/s   done%%  timeout  evicted");
+	for (i = 0; i < nitems(loss); i ++) {
+		for (j = 0; j < nitems(reorder); j ++) {
+			error = reass_pool_create(&s, NULL, NULL, &pool);
+			if (0 != error)
+				goto err_out;
+			n = frags_gen(frags, seqs_count, active, loss[i],
+			    reorder[j]);
+			tm = time_ns_get();
+			for (k = 0; k < n; k ++) {
+				error = reass_pool_frag_add(pool,
+				    frags[k].key, k, frags[k].blk_idx,
+				    (int)frags[k].is_last,
+				    (src_data + (frags[k].blk_idx * BLK_SIZE)),
+				    (frags[k].is_last ? SEQ_LAST_SIZE : BLK_SIZE),
+				    &reass_hlp);
+				if (0 == error) {
+					reass_pool_done(pool, reass_hlp);
+				}
+			}
+			reass_pool_timeout_check(pool, (n + s.timeout));
+			tm = (time_ns_get() - tm);
+			reass_pool_stat_get(pool, &stat);
+			LOG_INFO_FMT("  %5.1f  %8.1f  %7"PRIu64"  %8.2f  %6.2f  %7"PRIu64"  %7"PRIu64,
+			    ((double)loss[i] / 10000.0),
+			    ((double)reorder[j] / 10000.0),
+			    ((((uint64_t)n * BLK_SIZE) * 1000) / MAX(1, tm)),
+			    (((double)n * 1000.0) / (double)MAX(1, tm)),
+			    (((double)stat.seq_done * 100.0) / (double)seqs_count),
+			    stat.seq_timeout, stat.seq_evicted);
+			reass_pool_destroy(pool);
+		}
+	}
+
+	/* Missing ranges scan: word-at-a-time vs bit-at-a-time. */
+	n = (64 * 1024); /* Blocks. */
+	bitmap = malloc(REASS_HLP_BITMAP_SIZE(n));
+	if (NULL == bitmap) {
+		error = ENOMEM;
+		goto err_out;
+	}
+	memset(bitmap, 0xff, REASS_HLP_BITMAP_SIZE(n));
+	for (i = 0; i < (n / 100); i ++) { /* 1% lost. */
+		k = (rnd_get() % n);
+		bitmap[(k >> 3)] &= ~(1 << (k & 0x07));
+	}
+	iters = 1000;
+	tm = time_ns_get();
+	for (k = 0; k < iters; k ++) {
+		for (i = 0; i < n; i ++) {
+			if (0 == REASS_HLP_GET_BIT(bitmap, i)) {
+				ranges_count ++;
+				while (i < n && 0 == REASS_HLP_GET_BIT(bitmap, i)) {
+					i ++;
+				}
+			}
+		}
+	}
+	tm = (time_ns_get() - tm);
+	LOG_INFO_FMT("Missing scan %zu blocks, 1%% lost: bit: %"PRIu64" ns",
+	    n, (tm / iters));
+	tm = time_ns_get();
+	for (k = 0; k < iters; k ++) {
+		for (i = 0; i < n; i = j) {
+			i = reass_hlp_bitmap_find(bitmap,
+			    REASS_HLP_BITMAP_SIZE(n), i, n, 0);
+			if (i >= n)
+				break;
+			j = reass_hlp_bitmap_find(bitmap,
+			    REASS_HLP_BITMAP_SIZE(n), i, n, 1);
+			ranges_count --;
+		}
+	}
+	tm = (time_ns_get() - tm);
+	LOG_INFO_FMT("Missing scan %zu blocks, 1%% lost: word: %"PRIu64" ns",
+	    n, (tm / iters));
+	free(bitmap);
+	error = ((0 == ranges_count) ? 0 : -1);
+
+err_out:
+	free(frags);
+
+	return (error);
+}
+
+
+int
+main(int argc, char *argv[]) {
+	int error;
+	size_t i;
+
+	for (i = 0; i < sizeof(src_data); i ++) {
+		src_data[i] = (uint8_t)(i * 131);
+	}
+	error = reass_bitmap_test();
+	if (0 != error) {
+		LOG_INFO_FMT("reass_bitmap_test(): err: %i", error);
+		return (error);
+	}
+	error = reass_hlp_test();
+	if (0 != error) {
+		LOG_INFO_FMT("reass_hlp_test(): err: %i", error);
+		return (error);
+	}
+	error = reass_pool_test();
+	if (0 != error) {
+		LOG_INFO_FMT("reass_pool_test(): err: %i", error);
+		return (error);
+	}
+	if (1 < argc && 0 == strcmp(argv[1], "-b")) {
+		error = reass_bench();
+	}
+
+	return (error);
+}
@@ -0,0 +1,264 @@
+/*-
+ * Copyright (c) 2016-2025 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* memcpy */
+#include <stdio.h> /* snprintf, fprintf */
+#include <unistd.h> /* sysconf */
+
+#include "utils/macro.h"
+#include "utils/ring_buffer.h"
+#include "../test_utils.h"
+
+#ifndef __unused
+#	define __unused	__attribute__((__unused__))
+#endif
+
+
+#define RING_SIZE	(64 * 1024)
+#define BLK_SIZE	188
+#define IOV_CNT		8
+
+
+typedef struct test_rb_s {
+	r_buf_p		r_buf;
+	r_buf_rpos_t	rpos;
+	uint8_t		wseq;		/* Next byte to write. */
+	uint8_t		rseq;		/* Next byte expected by reader. */
+	size_t		wr_cross;	/* Writes that cross buffer end. */
+	size_t		rd_cross;	/* Reads that cross buffer end. */
+	size_t		rd_multi;	/* Reads returned more than one iovec. */
+	size_t		rd_drop;	/* Reader overrun by writer. */
+} test_rb_t, *test_rb_p;
+
+
+/* Region continues over ring buffer end. */
+static int
+test_rb_is_cross(r_buf_p r_buf, uint8_t *buf, size_t size) {
+
+	return (((((size_t)(buf - r_buf->buf)) % r_buf->size) + size) >
+	    r_buf->size);
+}
+
+static int
+test_rb_init(test_rb_p trb, const uint32_t flags) {
+
+	memset(trb, 0x00, sizeof(test_rb_t));
+	trb->r_buf = r_buf_alloc((uintptr_t)-1, RING_SIZE, BLK_SIZE, flags);
+	TEST_CHK(NULL != trb->r_buf);
+	TEST_CHK(0 == r_buf_rpos_init(trb->r_buf, &trb->rpos, 0));
+
+	return (0);
+}
+
+static int
+test_rb_write(test_rb_p trb, const size_t size) {
+	r_buf_p r_buf = trb->r_buf;
+	uint8_t *buf;
+	size_t i;
+
+	TEST_CHK(size <= r_buf_wbuf_get(r_buf, size, &buf));
+	for (i = 0; i < size; i ++) {
+		buf[i] = trb->wseq ++;
+	}
+	if (test_rb_is_cross(r_buf, buf, size)) {
+		trb->wr_cross ++;
+	}
+	TEST_CHK(0 == r_buf_wbuf_set(r_buf, 0, size));
+
+	return (0);
+}
+
+/* Read up to size bytes, check sequence, return -1 on error.
+ * On overrun reader moved to write pos: continue from next write. */
+static int
+test_rb_read(test_rb_p trb, size_t size) {
+	r_buf_p r_buf = trb->r_buf;
+	iovec_t iov[IOV_CNT];
+	size_t i, j, cnt, avail, drop_size = 0, got = 0, sum = 0;
+
+	avail = r_buf_data_avail_size(r_buf, &trb->rpos, &drop_size);
+	if (0 != drop_size) {
+		TEST_CHK(0 == avail);
+		trb->rseq = trb->wseq;
+		trb->rd_drop ++;
+		return (0);
+	}
+	size = MIN(size, avail);
+	if (0 == size)
+		return (0);
+	cnt = r_buf_data_get(r_buf, &trb->rpos, size, iov, IOV_CNT,
+	    &drop_size, &got);
+	TEST_CHK(0 == drop_size);
+	TEST_CHK(0 != cnt);
+	if (1 < cnt) {
+		trb->rd_multi ++;
+	}
+	for (i = 0; i < cnt; i ++) {
+		if (test_rb_is_cross(r_buf, iov[i].iov_base, iov[i].iov_len)) {
+			trb->rd_cross ++;
+		}
+		for (j = 0; j < iov[i].iov_len; j ++) {
+			TEST_CHK(trb->rseq == iov[i].iov_base[j]);
+			trb->rseq ++;
+		}
+		sum += iov[i].iov_len;
+	}
+	TEST_CHK(sum == got);
+	r_buf_rpos_inc(r_buf, &trb->rpos, got);
+
+	return (0);
+}
+
+
+static int
+test_mirror_alloc(void) {
+	test_rb_t trb;
+	r_buf_p r_buf;
+	size_t i, page_size = (size_t)sysconf(_SC_PAGE_SIZE);
+
+	/* Size rounded up to page size, tail keep is pointless. */
+	trb.r_buf = r_buf_alloc((uintptr_t)-1, (RING_SIZE + 1), BLK_SIZE,
+	    (RBUF_F_U_MIRROR | RBUF_F_U_KEEP_TAIL));
+	r_buf = trb.r_buf;
+	TEST_CHK(NULL != r_buf);
+	TEST_CHK(ALIGNEX((RING_SIZE + 1), page_size) == r_buf->size);
+	TEST_CHK(0 != (RBUF_F_U_MIRROR & r_buf->flags));
+	TEST_CHK(0 == (RBUF_F_U_KEEP_TAIL & r_buf->flags));
+	/* Second mapping is an alias of the first one. */
+	for (i = 0; i < r_buf->size; i += 1021) {
+		r_buf->buf[i] = (uint8_t)i;
+		TEST_CHK((uint8_t)i == r_buf->buf[(r_buf->size + i)]);
+		r_buf->buf[(r_buf->size + i + 1)] = (uint8_t)~i;
+		TEST_CHK((uint8_t)~i == r_buf->buf[(i + 1)]);
+	}
+	r_buf_free(r_buf);
+
+	return (0);
+}
+
+/* Blocks size not divisible by ring size: some blocks cross buffer end,
+ * reader must get them as single contiguous iovec. */
+static int
+test_mirror_wrap(void) {
+	test_rb_t trb;
+	size_t i;
+
+	TEST_CHK(0 == test_rb_init(&trb, RBUF_F_U_MIRROR));
+	for (i = 0; i < 4096; i ++) {
+		TEST_CHK(0 == test_rb_write(&trb, (BLK_SIZE * 7)));
+		TEST_CHK(0 == test_rb_read(&trb, SIZE_MAX));
+	}
+	TEST_CHK(0 != trb.wr_cross);
+	TEST_CHK(0 != trb.rd_cross);
+	TEST_CHK(0 == trb.rd_multi);
+	/* Reader lags: window of many blocks spans buffer end. */
+	for (i = 0; i < 4096; i ++) {
+		TEST_CHK(0 == test_rb_write(&trb, (BLK_SIZE * 5)));
+		if (0 != (i % 9))
+			continue;
+		TEST_CHK(0 == test_rb_read(&trb, SIZE_MAX));
+	}
+	TEST_CHK(0 == trb.rd_multi);
+	TEST_CHK(0 == trb.rd_drop);
+	r_buf_free(trb.r_buf);
+
+	/* Same stream without mirror: reads near end must be split. */
+	TEST_CHK(0 == test_rb_init(&trb, 0));
+	for (i = 0; i < 4096; i ++) {
+		TEST_CHK(0 == test_rb_write(&trb, (BLK_SIZE * 5)));
+		if (0 != (i % 9))
+			continue;
+		TEST_CHK(0 == test_rb_read(&trb, SIZE_MAX));
+	}
+	TEST_CHK(0 == trb.wr_cross);
+	TEST_CHK(0 == trb.rd_cross);
+	TEST_CHK(0 != trb.rd_multi);
+	TEST_CHK(0 == trb.rd_drop);
+	r_buf_free(trb.r_buf);
+
+	return (0);
+}
+
+/* Random block and read sizes. */
+static int
+test_mirror_random(void) {
+	test_rb_t trb;
+	size_t i;
+	uint32_t rnd = 0x2545f491;
+
+	TEST_CHK(0 == test_rb_init(&trb, RBUF_F_U_MIRROR));
+	for (i = 0; i < 100000; i ++) {
+		rnd ^= (rnd << 13);
+		rnd ^= (rnd >> 17);
+		rnd ^= (rnd << 5);
+		TEST_CHK(0 == test_rb_write(&trb, (BLK_SIZE * (1 + (rnd % 20)))));
+		if (0 != ((rnd >> 8) % 3))
+			continue;
+		TEST_CHK(0 == test_rb_read(&trb,
+		    (1 + ((rnd >> 12) % (RING_SIZE / 2)))));
+	}
+	TEST_CHK(0 != trb.wr_cross);
+	TEST_CHK(0 != trb.rd_cross);
+	TEST_CHK(0 == trb.rd_multi);
+	LOG_INFO_FMT("test_mirror_random(): crossed writes: %zu, reads: %zu, "
+	    "drops: %zu", trb.wr_cross, trb.rd_cross, trb.rd_drop);
+	r_buf_free(trb.r_buf);
+
+	return (0);
+}
+
+
+int
+main(int argc __unused, char *argv[] __unused) {
+	int error;
+
+	error = test_mirror_alloc();
+	if (0 != error) {
+		LOG_INFO_FMT("test_mirror_alloc(): err: %i", error);
+		return (error);
+	}
+	error = test_mirror_wrap();
+	if (0 != error) {
+		LOG_INFO_FMT("test_mirror_wrap(): err: %i", error);
+		return (error);
+	}
+	error = test_mirror_random();
+	if (0 != error) {
+		LOG_INFO_FMT("test_mirror_random(): err: %i", error);
+		return (error);
+	}
+
+	return (0);
+}
@@ -0,0 +1,431 @@
+/*-
+ * Copyright (c) 2016-2025 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* memcpy */
+#include <stdio.h> /* snprintf, fprintf */
+#include <unistd.h> /* close, read */
+
+#include "threadpool/threadpool.h"
+#include "threadpool/threadpool_msg_sys.h"
+#include "utils/ring_buffer_fanout.h"
+#include "../test_utils.h"
+
+#ifndef __unused
+#	define __unused	__attribute__((__unused__))
+#endif
+
+
+#define RING_SIZE	(256 * 1024)
+#define BLK_SIZE	4096
+#define BLK_WORDS	(BLK_SIZE / sizeof(uint32_t))
+#define LAG_MAX		(128 * 1024)
+#define PRECACHE	(16 * 1024)
+#define DRAIN_WAIT	300 /* ms: no more data from reader. */
+
+
+typedef struct test_rdr_s {
+	r_buf_fo_p	fo;
+	r_buf_fo_rdr_p	rdr;
+	int		skt[2];		/* 0 - reader, 1 - test side. */
+	int		error;		/* From reader cb. */
+	r_buf_fo_rdr_stat_t stat;
+	uint8_t		*data;		/* Received. */
+	size_t		data_size;
+} test_rdr_t, *test_rdr_p;
+
+typedef void (*test_tpt_cb)(test_rdr_p trdr);
+
+static tp_p tp;
+static pthread_mutex_t call_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t call_cond = PTHREAD_COND_INITIALIZER;
+static int call_done;
+static test_tpt_cb call_cb;
+static uint32_t seq_next;
+
+
+static void
+test_call_msg_cb(tpt_p tpt __unused, void *udata) {
+
+	call_cb(udata);
+	pthread_mutex_lock(&call_mtx);
+	call_done = 1;
+	pthread_cond_signal(&call_cond);
+	pthread_mutex_unlock(&call_mtx);
+}
+
+/* Readers used only from own thread. */
+static void
+test_call(test_tpt_cb cb, test_rdr_p trdr) {
+
+	call_done = 0;
+	call_cb = cb;
+	tpt_msg_send(tp_thread_get(tp, 0), NULL, TP_MSG_F_FORCE,
+	    test_call_msg_cb, trdr);
+	pthread_mutex_lock(&call_mtx);
+	while (0 == call_done) {
+		pthread_cond_wait(&call_cond, &call_mtx);
+	}
+	pthread_mutex_unlock(&call_mtx);
+}
+
+static void
+test_nop_cb(test_rdr_p trdr __unused) {
+}
+
+static void
+test_rdr_cb(r_buf_fo_rdr_p rdr, int error, void *udata) {
+	test_rdr_p trdr = udata;
+
+	trdr->error = error;
+	r_buf_fo_rdr_stat_get(rdr, &trdr->stat);
+	r_buf_fo_rdr_free(rdr);
+	trdr->rdr = NULL;
+}
+
+static void
+test_rdr_add_cb(test_rdr_p trdr) {
+
+	trdr->error = r_buf_fo_rdr_add(trdr->fo, tp_thread_get(tp, 0),
+	    (uintptr_t)trdr->skt[0], test_rdr_cb, trdr, &trdr->rdr);
+}
+
+static void
+test_rdr_free_cb(test_rdr_p trdr) {
+
+	if (NULL == trdr->rdr)
+		return;
+	r_buf_fo_rdr_stat_get(trdr->rdr, &trdr->stat);
+	r_buf_fo_rdr_free(trdr->rdr);
+	trdr->rdr = NULL;
+}
+
+static int
+test_rdr_add(test_rdr_p trdr, r_buf_fo_p fo, int snd_buf_size) {
+
+	memset(trdr, 0x00, sizeof(test_rdr_t));
+	trdr->fo = fo;
+	if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, trdr->skt))
+		return (errno);
+	fcntl(trdr->skt[0], F_SETFL, O_NONBLOCK);
+	if (0 != snd_buf_size) {
+		setsockopt(trdr->skt[0], SOL_SOCKET, SO_SNDBUF,
+		    &snd_buf_size, sizeof(int));
+	}
+	trdr->data = malloc((4 * RING_SIZE));
+	if (NULL == trdr->data)
+		return (ENOMEM);
+	test_call(test_rdr_add_cb, trdr);
+
+	return (trdr->error);
+}
+
+/* Received data kept for checks. */
+static void
+test_rdr_free(test_rdr_p trdr) {
+
+	test_call(test_rdr_free_cb, trdr);
+	close(trdr->skt[0]);
+	close(trdr->skt[1]);
+}
+
+/* Read all data reader sent. */
+static void
+test_rdr_drain(test_rdr_p trdr) {
+	ssize_t ios;
+	struct pollfd pfd;
+
+	pfd.fd = trdr->skt[1];
+	pfd.events = POLLIN;
+	while (0 < poll(&pfd, 1, DRAIN_WAIT)) {
+		ios = read(trdr->skt[1], (trdr->data + trdr->data_size),
+		    ((4 * RING_SIZE) - trdr->data_size));
+		if (0 >= ios)
+			break;
+		trdr->data_size += (size_t)ios;
+	}
+}
+
+/* Count seq number breaks in received data. */
+static size_t
+test_rdr_gaps(test_rdr_p trdr, uint32_t *first, uint32_t *last) {
+	size_t i, ret = 0;
+	uint32_t *seq = (uint32_t*)trdr->data;
+
+	for (i = 1; i < (trdr->data_size / sizeof(uint32_t)); i ++) {
+		if (seq[i] != (seq[(i - 1)] + 1)) {
+			ret ++;
+		}
+	}
+	(*first) = seq[0];
+	(*last) = seq[((trdr->data_size / sizeof(uint32_t)) - 1)];
+
+	return (ret);
+}
+
+static int
+test_write(r_buf_fo_p fo, size_t blks, int sync) {
+	size_t i, j;
+	uint32_t blk[BLK_WORDS];
+
+	for (i = 0; i < blks; i ++) {
+		for (j = 0; j < BLK_WORDS; j ++) {
+			blk[j] = seq_next ++;
+		}
+		TEST_CHK(0 == r_buf_fo_write(fo, (uint8_t*)blk, sizeof(blk),
+		    ((0 != sync) ? R_BUF_FO_WR_F_SYNC : 0)));
+	}
+
+	return (0);
+}
+
+static int
+test_fo_create(uint32_t flags, r_buf_fo_p *fo_ret) {
+	r_buf_fo_settings_t s;
+
+	r_buf_fo_def_settings(&s);
+	s.ring_size = RING_SIZE;
+	s.lag_max = LAG_MAX;
+	s.precache = PRECACHE;
+	s.flags = flags;
+	seq_next = 0;
+
+	return (r_buf_fo_create(tp, &s, fo_ret));
+}
+
+
+static int
+test_settings(void) {
+	r_buf_fo_p fo;
+	r_buf_fo_settings_t s;
+
+	r_buf_fo_def_settings(&s);
+	s.ring_size = RING_SIZE;
+	s.lag_max = LAG_MAX;
+	s.precache = PRECACHE;
+	TEST_CHK(0 == r_buf_fo_create(tp, &s, &fo));
+	r_buf_fo_destroy(fo);
+	s.lag_max = RING_SIZE;
+	TEST_CHK(EINVAL == r_buf_fo_create(tp, &s, &fo));
+	s.lag_max = LAG_MAX;
+	s.precache = (LAG_MAX + 1);
+	TEST_CHK(EINVAL == r_buf_fo_create(tp, &s, &fo));
+	s.precache = PRECACHE;
+	/* Data waiting for snd_block_min must not be overwritten. */
+	s.snd_block_min = (RING_SIZE - LAG_MAX);
+	TEST_CHK(EINVAL == r_buf_fo_create(tp, &s, &fo));
+	s.snd_block_min = (RING_SIZE - LAG_MAX - 1);
+	TEST_CHK(0 == r_buf_fo_create(tp, &s, &fo));
+	r_buf_fo_destroy(fo);
+
+	return (0);
+}
+
+static int
+test_rdr_add_free(void) {
+	r_buf_fo_p fo;
+	r_buf_fo_stat_t stat;
+	test_rdr_t trdr[2];
+
+	TEST_CHK(0 == test_fo_create(R_BUF_FO_S_F_LAG_JUMP, &fo));
+	TEST_CHK(0 == test_rdr_add(&trdr[0], fo, 0));
+	TEST_CHK(0 == test_rdr_add(&trdr[1], fo, 0));
+	TEST_CHK(0 == r_buf_fo_stat_get(fo, &stat));
+	TEST_CHK(2 == stat.rdr_count);
+	TEST_CHK(0 == test_write(fo, 4, 1));
+	test_rdr_drain(&trdr[0]);
+	test_rdr_drain(&trdr[1]);
+	TEST_CHK((4 * BLK_SIZE) == trdr[0].data_size);
+	TEST_CHK((4 * BLK_SIZE) == trdr[1].data_size);
+	test_rdr_free(&trdr[0]);
+	TEST_CHK(0 == r_buf_fo_stat_get(fo, &stat));
+	TEST_CHK(1 == stat.rdr_count);
+	TEST_CHK((4 * BLK_SIZE) == trdr[0].stat.snd_size);
+	/* Remaining reader still served. */
+	TEST_CHK(0 == test_write(fo, 2, 0));
+	test_rdr_drain(&trdr[1]);
+	TEST_CHK((6 * BLK_SIZE) == trdr[1].data_size);
+	test_rdr_free(&trdr[1]);
+	TEST_CHK(0 == r_buf_fo_stat_get(fo, &stat));
+	TEST_CHK(0 == stat.rdr_count);
+	TEST_CHK(6 == stat.wr_blocks);
+	r_buf_fo_destroy(fo);
+	free(trdr[0].data);
+	free(trdr[1].data);
+
+	return (0);
+}
+
+static int
+test_precache(void) {
+	r_buf_fo_p fo;
+	test_rdr_t trdr;
+	size_t size;
+	uint32_t first, last;
+
+	TEST_CHK(0 == test_fo_create(R_BUF_FO_S_F_LAG_JUMP, &fo));
+	TEST_CHK(0 == test_write(fo, 32, 1));
+	/* New reader start from sync point at least precache size back. */
+	TEST_CHK(0 == test_rdr_add(&trdr, fo, 0));
+	test_rdr_drain(&trdr);
+	TEST_CHK(PRECACHE <= trdr.data_size);
+	TEST_CHK((PRECACHE + BLK_SIZE) >= trdr.data_size);
+	TEST_CHK(0 == test_rdr_gaps(&trdr, &first, &last));
+	TEST_CHK(0 == (first % BLK_WORDS));
+	TEST_CHK((seq_next - 1) == last);
+	/* Then continuous. */
+	size = trdr.data_size;
+	TEST_CHK(0 == test_write(fo, 4, 0));
+	test_rdr_drain(&trdr);
+	TEST_CHK((size + (4 * BLK_SIZE)) == trdr.data_size);
+	TEST_CHK(0 == test_rdr_gaps(&trdr, &first, &last));
+	TEST_CHK((seq_next - 1) == last);
+	test_rdr_free(&trdr);
+	TEST_CHK(trdr.data_size == trdr.stat.snd_size);
+	TEST_CHK(0 == trdr.stat.jump_count);
+	TEST_CHK(0 == trdr.stat.drop_count);
+	r_buf_fo_destroy(fo);
+	free(trdr.data);
+
+	return (0);
+}
+
+/* Socket buffer full, writer write blks: reader must apply lag policy. */
+static int
+test_lag(uint32_t flags, size_t blks, test_rdr_p trdr) {
+	r_buf_fo_p fo;
+	uint32_t first, last;
+
+	TEST_CHK(0 == test_fo_create(flags, &fo));
+	TEST_CHK(0 == test_rdr_add(trdr, fo, BLK_SIZE));
+	/* Fill socket buffer, wait reader thread process it. */
+	TEST_CHK(0 == test_write(fo, 8, 1));
+	test_call(test_nop_cb, trdr);
+	test_call(test_nop_cb, trdr);
+	TEST_CHK(0 == test_write(fo, (blks - 8), 1));
+	test_rdr_drain(trdr);
+	test_rdr_free(trdr);
+	TEST_CHK(0 != trdr->data_size);
+	TEST_CHK(trdr->data_size == trdr->stat.snd_size);
+	TEST_CHK(trdr->data_size < (blks * BLK_SIZE));
+	/* Data before lag and from sync point after: one jump. */
+	if (0 != (R_BUF_FO_S_F_LAG_JUMP & flags)) {
+		TEST_CHK(1 == test_rdr_gaps(trdr, &first, &last));
+		TEST_CHK(0 == first);
+		TEST_CHK((seq_next - 1) == last);
+		TEST_CHK(1 == trdr->stat.jump_count);
+		TEST_CHK(((blks * BLK_SIZE) - trdr->data_size) ==
+		    trdr->stat.drop_size);
+	}
+	r_buf_fo_destroy(fo);
+	free(trdr->data);
+
+	return (0);
+}
+
+static int
+test_lag_policy(void) {
+	test_rdr_t trdr;
+
+	/* Lag: more than lag_max, less than ring size. */
+	TEST_CHK(0 == test_lag(R_BUF_FO_S_F_LAG_JUMP, 48, &trdr));
+	TEST_CHK(0 == trdr.error);
+	TEST_CHK(0 == trdr.stat.drop_count);
+	TEST_CHK(LAG_MAX >= trdr.stat.lag_max);
+	/* Overrun: writer overwrite data not sent to reader. */
+	TEST_CHK(0 == test_lag(R_BUF_FO_S_F_LAG_JUMP, 96, &trdr));
+	TEST_CHK(0 == trdr.error);
+	TEST_CHK(1 == trdr.stat.drop_count);
+	/* Drop policy: reader cb get error and free reader. */
+	TEST_CHK(0 == test_lag(R_BUF_FO_S_F_LAG_DROP, 48, &trdr));
+	TEST_CHK(ENOBUFS == trdr.error);
+	TEST_CHK(1 == trdr.stat.drop_count);
+	TEST_CHK(0 != trdr.stat.drop_size);
+	TEST_CHK(0 == test_lag(R_BUF_FO_S_F_LAG_DROP, 96, &trdr));
+	TEST_CHK(ENOBUFS == trdr.error);
+	TEST_CHK(1 == trdr.stat.drop_count);
+
+	return (0);
+}
+
+
+int
+main(int argc __unused, char *argv[] __unused) {
+	int error;
+	tp_settings_t s;
+
+	tp_init();
+	tp_settings_def(&s);
+	s.threads_max = 1;
+	error = tp_create(&s, NULL, &tp);
+	if (0 != error) {
+		LOG_INFO_FMT("tp_create(): err: %i", error);
+		return (error);
+	}
+	error = tp_threads_create(tp, 0);
+	if (0 != error) {
+		LOG_INFO_FMT("tp_threads_create(): err: %i", error);
+		return (error);
+	}
+	error = test_settings();
+	if (0 != error) {
+		LOG_INFO_FMT("test_settings(): err: %i", error);
+		goto err_out;
+	}
+	error = test_rdr_add_free();
+	if (0 != error) {
+		LOG_INFO_FMT("test_rdr_add_free(): err: %i", error);
+		goto err_out;
+	}
+	error = test_precache();
+	if (0 != error) {
+		LOG_INFO_FMT("test_precache(): err: %i", error);
+		goto err_out;
+	}
+	error = test_lag_policy();
+	if (0 != error) {
+		LOG_INFO_FMT("test_lag_policy(): err: %i", error);
+		goto err_out;
+	}
+
+err_out:
+	tp_shutdown(tp);
+	tp_shutdown_wait(tp);
+	tp_destroy(tp);
+
+	return (error);
+}